@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+#
+# regression.py - Run a fixed set of examples with the batch version for a fixed number of
+#                 steps, record the time in each phase and the particle counts as json, and
+#                 compare against a stored baseline
+#
+# (c)2021 Applied Scientific Research, Inc.
+#         Mark J Stock <markjstock@gmail.com>
+#
+# usage:
+#   regression.py --exe build/Omega2Dbatch.bin                     (run and compare)
+#   regression.py --exe build/Omega2Dbatch.bin --save-baseline     (run and store)
+#
+# the phase timings come from the status file columns: step_secs, diffuse_secs, convect_secs,
+#   and the profiler's secs_<zone> columns when the binary was built with USE_PROFILER
+#
+
+import argparse
+import csv
+import json
+import os
+import platform
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+# the examples to run, from the examples directory
+CASES = ["speedtest20kx10", "flow_over_circle", "blender", "flap"]
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def make_input(example, steps, status):
+    """a copy of the example which stops after the given steps and writes a csv status file"""
+    with open(example) as f:
+        j = json.load(f)
+    sp = j.setdefault("simparams", {})
+    sp["maxSteps"] = steps
+    sp.pop("endTime", None)
+    sp["outputDt"] = 0.0
+    sp.pop("checkpointInterval", None)
+    rt = j.setdefault("runtime", {})
+    rt["statusFile"] = status
+    rt["statusFormat"] = "csv"
+    return j
+
+
+def read_status(fn):
+    """the rows of a csv status file, which writes a new header when its columns change"""
+    rows = []
+    header = None
+    with open(fn) as f:
+        for line in csv.reader(f):
+            if not line:
+                continue
+            try:
+                vals = [float(v) for v in line]
+            except ValueError:
+                header = line
+                continue
+            if header:
+                rows.append(dict(zip(header, vals)))
+    return rows
+
+
+def is_phase(col):
+    return col.endswith("_secs") or col.startswith("secs_")
+
+
+def summarize(rows):
+    """totals over all steps of each phase, and the particle counts"""
+    phases = {}
+    for r in rows:
+        for k, v in r.items():
+            if is_phase(k):
+                phases[k] = phases.get(k, 0.0) + v
+    nparts = [int(r["nparts"]) for r in rows if "nparts" in r]
+    return {"steps": len(rows),
+            "phases": phases,
+            "nparts_final": nparts[-1] if nparts else 0,
+            "nparts_max": max(nparts) if nparts else 0}
+
+
+def run_case(exe, examples, name, steps, repeat, threads, keep):
+    """run one example repeat times and keep the median of each phase"""
+    work = tempfile.mkdtemp(prefix="omega2d_" + name + "_")
+    env = dict(os.environ)
+    if threads > 0:
+        env["OMP_NUM_THREADS"] = str(threads)
+
+    runs = []
+    walls = []
+    for _ in range(repeat):
+        status = "status.csv"
+        inp = os.path.join(work, name + ".json")
+        with open(inp, "w") as f:
+            json.dump(make_input(os.path.join(examples, name + ".json"), steps, status), f, indent=1)
+        if os.path.exists(os.path.join(work, status)):
+            os.remove(os.path.join(work, status))
+
+        start = time.time()
+        with open(os.path.join(work, "out.txt"), "w") as out:
+            rc = subprocess.call([exe, inp], cwd=work, env=env, stdout=out, stderr=subprocess.STDOUT)
+        walls.append(time.time() - start)
+        if rc != 0:
+            print("  %s failed with code %d, see %s" % (name, rc, os.path.join(work, "out.txt")))
+            return None
+        runs.append(summarize(read_status(os.path.join(work, status))))
+
+    if not keep:
+        shutil.rmtree(work, ignore_errors=True)
+
+    result = dict(runs[-1])
+    names = set()
+    for r in runs:
+        names.update(r["phases"].keys())
+    result["phases"] = {k: statistics.median([r["phases"].get(k, 0.0) for r in runs]) for k in sorted(names)}
+    result["wall_secs"] = statistics.median(walls)
+    return result
+
+
+def compare(base, new, threshold, min_secs, count_tol):
+    """a list of the phases which got slower and the counts which moved"""
+    problems = []
+    for name, nc in new["cases"].items():
+        bc = base.get("cases", {}).get(name)
+        if bc is None:
+            print("  %-18s no baseline" % name)
+            continue
+        for k, t in nc["phases"].items():
+            b = bc["phases"].get(k)
+            if b is None or b < min_secs:
+                continue
+            ratio = t / b
+            flag = ""
+            if ratio > 1.0 + threshold:
+                flag = "  SLOWER"
+                problems.append("%s %s is %.0f%% slower" % (name, k, 100.0*(ratio-1.0)))
+            print("  %-18s %-36s %10.4f %10.4f %7.2f%s" % (name, k, b, t, ratio, flag))
+        for k in ("nparts_final", "nparts_max"):
+            b = bc.get(k, 0)
+            if b > 0 and abs(nc[k] - b) > count_tol * b:
+                problems.append("%s %s went from %d to %d" % (name, k, b, nc[k]))
+    return problems
+
+
+def main():
+    p = argparse.ArgumentParser(description="Omega2D end-to-end performance regression runs")
+    p.add_argument("--exe", required=True, help="the batch binary, like build/Omega2Dbatch.bin")
+    p.add_argument("--examples", default=os.path.join(HERE, "..", "examples"), help="directory of example inputs")
+    p.add_argument("--cases", default=",".join(CASES), help="comma-separated example names")
+    p.add_argument("--steps", type=int, default=20, help="steps to run each example")
+    p.add_argument("--repeat", type=int, default=3, help="runs of each example, the median is kept")
+    p.add_argument("--threads", type=int, default=0, help="OMP_NUM_THREADS, or 0 to leave it alone")
+    p.add_argument("--output", default="regression.json", help="where to write this run's results")
+    p.add_argument("--baseline", default=os.path.join(HERE, "baseline.json"), help="stored results to compare against")
+    p.add_argument("--save-baseline", action="store_true", help="store this run as the baseline")
+    p.add_argument("--threshold", type=float, default=0.15, help="allowed fractional slowdown of any phase")
+    p.add_argument("--min-secs", type=float, default=0.05, help="ignore phases shorter than this in the baseline")
+    p.add_argument("--count-tolerance", type=float, default=0.02, help="allowed fractional change in particle counts")
+    p.add_argument("--keep", action="store_true", help="keep the run directories")
+    args = p.parse_args()
+
+    exe = os.path.abspath(args.exe)
+    results = {"machine": {"host": platform.node(), "cpus": os.cpu_count(),
+                           "processor": platform.processor(), "threads": args.threads},
+               "steps": args.steps,
+               "cases": {}}
+
+    print("Running %d steps of each example" % args.steps)
+    for name in [c for c in args.cases.split(",") if c]:
+        print("  %s" % name)
+        r = run_case(exe, args.examples, name, args.steps, args.repeat, args.threads, args.keep)
+        if r is None:
+            return 2
+        results["cases"][name] = r
+
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=1, sort_keys=True)
+    print("Wrote %s" % args.output)
+
+    if args.save_baseline:
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+        print("Stored baseline %s" % args.baseline)
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print("No baseline at %s, run with --save-baseline to make one" % args.baseline)
+        return 0
+
+    with open(args.baseline) as f:
+        base = json.load(f)
+    if base.get("steps") != args.steps:
+        print("Baseline ran %s steps, this ran %d, not comparing" % (base.get("steps"), args.steps))
+        return 0
+    if base.get("machine", {}).get("host") != results["machine"]["host"]:
+        print("Baseline is from %s, timings may not compare" % base.get("machine", {}).get("host"))
+
+    print("\n  %-18s %-36s %10s %10s %7s" % ("case", "phase", "baseline", "now", "ratio"))
+    problems = compare(base, results, args.threshold, args.min_secs, args.count_tolerance)
+    if problems:
+        print("\nRegressions:")
+        for pr in problems:
+            print("  " + pr)
+        return 1
+    print("\nNo regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
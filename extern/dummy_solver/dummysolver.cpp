@@ -14,6 +14,13 @@
 #include <cassert>
 #include <cstdint>
 #include <cmath>
+#include <map>
+#include <utility>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace DummySolver {
 
@@ -55,6 +62,9 @@ Solver::init_d(std::vector<double> _pts,
                std::vector<uint32_t> _oidx) {
 
   std::cout << "  DummySolver initializing" << std::endl;
+#ifdef _OPENMP
+  std::cout << "    using " << omp_get_max_threads() << " threads" << std::endl;
+#endif
 
   //
   // the solver receives geometry nodes and elements and boundaries - save them
@@ -100,16 +110,93 @@ Solver::init_d(std::vector<double> _pts,
   N_selements = selems.size();
   std::cout << "    generated " << N_snodes << " solution nodes" << std::endl;
 
-  // identify which of the solution nodes are the ones nearest the open boundary
-  // HACK - assume it's the nodes with rad > 0.95
-  for (size_t i=0; i<selems.size(); ++i) {
-    const double xp = snodes[2*selems[i]];
-    const double yp = snodes[2*selems[i]+1];
-    if (xp*xp+yp*yp > 0.9) sopts.push_back((uint32_t)i);
+  //
+  // now the finite volume cells: each element is a cell, with its solution node at the center
+  //
+
+  // every element edge, by its two nodes, lowest first
+  auto edge_key = [](const uint32_t _a, const uint32_t _b) {
+    return std::make_pair(std::min(_a,_b), std::max(_a,_b));
+  };
+  std::map<std::pair<uint32_t,uint32_t>, std::vector<uint32_t>> edge_faces;
+  for (uint32_t i=0; i<N_elements; ++i) {
+    for (uint32_t k=0; k<4; ++k) {
+      edge_faces[edge_key(elems[4*i+k], elems[4*i+(k+1)%4])].push_back(4*i+k);
+    }
+  }
+
+  area.resize(N_elements);
+  fnbr.assign(4*N_elements, wall_face);
+  fnorm.resize(8*N_elements);
+  fdist.resize(4*N_elements);
+
+  for (uint32_t i=0; i<N_elements; ++i) {
+    const double cx = snodes[2*i];
+    const double cy = snodes[2*i+1];
+    double twicearea = 0.0;
+    for (uint32_t k=0; k<4; ++k) {
+      const uint32_t a = elems[4*i+k];
+      const uint32_t b = elems[4*i+(k+1)%4];
+      const double dx = nodes[2*b] - nodes[2*a];
+      const double dy = nodes[2*b+1] - nodes[2*a+1];
+      twicearea += nodes[2*a]*nodes[2*b+1] - nodes[2*b]*nodes[2*a+1];
+
+      // outward normal, whichever way the element winds
+      const double mx = 0.5*(nodes[2*a] + nodes[2*b]);
+      const double my = 0.5*(nodes[2*a+1] + nodes[2*b+1]);
+      const double sgn = (dy*(mx-cx) - dx*(my-cy) < 0.0) ? -1.0 : 1.0;
+      const uint32_t f = 4*i+k;
+      fnorm[2*f]   = sgn * dy;
+      fnorm[2*f+1] = -sgn * dx;
+
+      // the neighbor, or for a boundary face a ghost cell mirrored across it
+      const std::vector<uint32_t>& shared = edge_faces[edge_key(a,b)];
+      const uint32_t other = (shared.size() == 2) ? ((shared[0] == f) ? shared[1] : shared[0]) / 4 : i;
+      if (other != i) {
+        fnbr[f] = (int32_t)other;
+        fdist[f] = std::sqrt(std::pow(snodes[2*other]-cx, 2) + std::pow(snodes[2*other+1]-cy, 2));
+      } else {
+        fdist[f] = 2.0 * std::sqrt(std::pow(mx-cx, 2) + std::pow(my-cy, 2));
+      }
+    }
+    area[i] = 0.5 * std::abs(twicearea);
+  }
+
+  // the open boundary faces, in the order the open boundary elements came in, and their
+  //   cells are the solution nodes nearest the open boundary
+  std::vector<int32_t> openidx(N_elements, -1);
+  for (size_t j=0; j<obdry.size()/2; ++j) {
+    for (const uint32_t f : edge_faces[edge_key(obdry[2*j], obdry[2*j+1])]) {
+      const uint32_t i = f / 4;
+      if (fnbr[f] != wall_face) continue;
+      if (openidx[i] < 0) {
+        openidx[i] = (int32_t)sopts.size();
+        sopts.push_back(i);
+      }
+      fnbr[f] = -2 - openidx[i];
+    }
+  }
+  if (obdry.size()/2 != sopts.size()) {
+    std::cout << "  WARN (Solver::init_d) " << obdry.size()/2 << " open faces fall in " << sopts.size() << " cells" << std::endl;
   }
-  assert(obdry.size()/2 == sopts.size() && "ERROR (Solver::init_d_) hack does not appear to be working");
   std::cout << "    of which " << sopts.size() << " are on the open boundary" << std::endl;
 
+  // any other boundary face is a wall, where the velocity is zero
+  wallpts.clear();
+  for (uint32_t f=0; f<4*N_elements; ++f) {
+    if (fnbr[f] != wall_face) continue;
+    const uint32_t a = elems[4*(f/4)+(f%4)];
+    const uint32_t b = elems[4*(f/4)+(f%4+1)%4];
+    wallpts.push_back(0.5*(nodes[2*a] + nodes[2*b]));
+    wallpts.push_back(0.5*(nodes[2*a+1] + nodes[2*b+1]));
+  }
+  std::cout << "    and " << wallpts.size()/2 << " wall faces" << std::endl;
+
+  vort.assign(N_snodes, 0.0);
+  vel.assign(2*N_snodes, 0.0);
+  openvel.assign(2*sopts.size(), 0.0);
+  openvort.clear();
+
   curr_time = 0.0;
 
   return;
@@ -144,7 +231,7 @@ Solver::getopenpts_d() {
 // set velocity BCs at open boundaries
 //
 void
-Solver::setopenvels_d(std::vector<double> _vels) {
+Solver::setopenvels_d(const std::vector<double>& _vels) {
   std::cout << "  DummySolver set velocities at open soln nodes: " << _vels.size()/2 << std::endl;
   assert(_vels.size() == sopts.size()*2 && "ERROR (Solver::setopenvels_d_) bad incoming velocity vector length");
 
@@ -155,15 +242,29 @@ Solver::setopenvels_d(std::vector<double> _vels) {
     }
   }
 
+  openvel = _vels;
+  interpolate_vels();
+
   return;
 }
 
 
+//
+// set vorticity just outside the open boundaries
+//
+void
+Solver::setopenvort_d(const std::vector<double>& _vort) {
+  std::cout << "  DummySolver set vorticity at open soln nodes: " << _vort.size() << std::endl;
+  assert(_vort.size() == sopts.size() && "ERROR (Solver::setopenvort_d_) bad incoming vorticity vector length");
+  openvort = _vort;
+}
+
+
 //
 // set initial vorticity at all solution nodes
 //
 void
-Solver::setsolnvort_d(std::vector<double> _vort) {
+Solver::setsolnvort_d(const std::vector<double>& _vort) {
   std::cout << "  DummySolver set vorticity at all soln nodes: " << _vort.size() << std::endl;
   assert(_vort.size() == N_snodes && "ERROR (Solver::setsolnvort_d_) bad incoming vorticity vector length");
 
@@ -174,10 +275,119 @@ Solver::setsolnvort_d(std::vector<double> _vort) {
     }
   }
 
+  vort = _vort;
+
   return;
 }
 
 
+//
+// set the particle-to-grid weights at all solution nodes
+//
+void
+Solver::setptogweights_d(const std::vector<double>& _wgt) {
+  std::cout << "  DummySolver set particle-to-grid weights at all soln nodes: " << _wgt.size() << std::endl;
+  assert(_wgt.size() == N_snodes && "ERROR (Solver::setptogweights_d_) bad incoming weight vector length");
+  ptog = _wgt;
+}
+
+
+//
+// the velocity everywhere, from that on the open boundaries and zero on the walls, by
+//   inverse-distance weighting; the open boundary cells keep theirs exactly
+//
+void
+Solver::interpolate_vels() {
+
+  std::vector<int32_t> openidx(N_snodes, -1);
+  for (size_t j=0; j<sopts.size(); ++j) openidx[sopts[j]] = (int32_t)j;
+  const int32_t nopen = (int32_t)sopts.size();
+  const int32_t nwall = (int32_t)wallpts.size()/2;
+
+  #pragma omp parallel for schedule(static)
+  for (int32_t i=0; i<(int32_t)N_snodes; ++i) {
+    if (openidx[i] >= 0) {
+      vel[2*i]   = openvel[2*openidx[i]];
+      vel[2*i+1] = openvel[2*openidx[i]+1];
+      continue;
+    }
+    const double xp = snodes[2*i];
+    const double yp = snodes[2*i+1];
+    double wsum = 0.0, usum = 0.0, vsum = 0.0;
+    for (int32_t j=0; j<nopen; ++j) {
+      const double w = 1.0 / (std::pow(snodes[2*sopts[j]]-xp, 2) + std::pow(snodes[2*sopts[j]+1]-yp, 2));
+      wsum += w;
+      usum += w * openvel[2*j];
+      vsum += w * openvel[2*j+1];
+    }
+    for (int32_t j=0; j<nwall; ++j) {
+      wsum += 1.0 / (std::pow(wallpts[2*j]-xp, 2) + std::pow(wallpts[2*j+1]-yp, 2));
+    }
+    vel[2*i]   = (wsum > 0.0) ? usum / wsum : 0.0;
+    vel[2*i+1] = (wsum > 0.0) ? vsum / wsum : 0.0;
+  }
+}
+
+
+//
+// the largest explicit step which keeps every cell stable, with a safety factor
+//
+double
+Solver::stable_dt() const {
+
+  const double nu = (reynolds > 0.0) ? 1.0 / reynolds : 0.0;
+  double dtmin = std::numeric_limits<double>::max();
+
+  #pragma omp parallel for schedule(static) reduction(min:dtmin)
+  for (int32_t i=0; i<(int32_t)N_elements; ++i) {
+    double sum = 0.0;
+    for (int32_t f=4*i; f<4*i+4; ++f) {
+      if (fnbr[f] == wall_face) continue;
+      const double len = std::sqrt(fnorm[2*f]*fnorm[2*f] + fnorm[2*f+1]*fnorm[2*f+1]);
+      sum += std::abs(vel[2*i]*fnorm[2*f] + vel[2*i+1]*fnorm[2*f+1]) + nu * len / fdist[f];
+    }
+    if (sum > 0.0) dtmin = std::min(dtmin, 0.5 * area[i] / sum);
+  }
+  return dtmin;
+}
+
+
+//
+// rate of change of vorticity in every cell: upwind advection by the face velocities and
+//   two-point diffusion, with no flux through walls and the given vorticity past the open
+//   boundaries; each cell only writes its own rate, so the loop needs no locks
+//
+void
+Solver::find_rates(const std::vector<double>& _w, std::vector<double>& _dwdt) const {
+
+  const double nu = (reynolds > 0.0) ? 1.0 / reynolds : 0.0;
+
+  #pragma omp parallel for schedule(static)
+  for (int32_t i=0; i<(int32_t)N_elements; ++i) {
+    double rate = 0.0;
+    for (int32_t f=4*i; f<4*i+4; ++f) {
+      const int32_t nb = fnbr[f];
+      if (nb == wall_face) continue;
+
+      double wn, un;
+      if (nb >= 0) {
+        wn = _w[nb];
+        un = 0.5*(vel[2*i]+vel[2*nb])*fnorm[2*f] + 0.5*(vel[2*i+1]+vel[2*nb+1])*fnorm[2*f+1];
+      } else {
+        const int32_t o = -2 - nb;
+        wn = openvort.empty() ? _w[i] : openvort[o];
+        un = vel[2*i]*fnorm[2*f] + vel[2*i+1]*fnorm[2*f+1];
+      }
+
+      const double len = std::sqrt(fnorm[2*f]*fnorm[2*f] + fnorm[2*f+1]*fnorm[2*f+1]);
+      rate -= un * ((un > 0.0) ? _w[i] : wn);
+      rate += nu * len * (wn - _w[i]) / fdist[f];
+    }
+    _dwdt[i] = rate / area[i];
+  }
+}
+
+
 //
 // solve system to the given time
 //
@@ -188,9 +398,31 @@ Solver::solveto_d(const double _endtime, const int32_t _numss, const int32_t _to
   time_order = _torder;
   reynolds = _re;
 
-  double this_dt = (_endtime - curr_time) / (double)num_substeps;
+  const double this_dt = (_endtime - curr_time) / (double)num_substeps;
+  if (this_dt <= 0.0 or N_elements == 0) return;
+
+  // each substep takes as many inner steps as stability needs
+  const int32_t ninner = std::max(1, (int32_t)std::ceil(this_dt / stable_dt()));
+  const double dt = this_dt / (double)ninner;
+  std::vector<double> k1(N_elements), k2(N_elements), wtmp(N_elements);
+
   for (int32_t step=0; step<num_substeps; ++step) {
-    std::cout << "  substep " << step << " at t= " << curr_time << std::endl;
+    std::cout << "  substep " << step << " at t= " << curr_time << " in " << ninner << " steps" << std::endl;
+    for (int32_t inner=0; inner<ninner; ++inner) {
+      find_rates(vort, k1);
+      if (time_order < 2) {
+        // forward Euler
+        #pragma omp parallel for schedule(static)
+        for (int32_t i=0; i<(int32_t)N_elements; ++i) vort[i] += dt * k1[i];
+      } else {
+        // Heun's method
+        #pragma omp parallel for schedule(static)
+        for (int32_t i=0; i<(int32_t)N_elements; ++i) wtmp[i] = vort[i] + dt * k1[i];
+        find_rates(wtmp, k2);
+        #pragma omp parallel for schedule(static)
+        for (int32_t i=0; i<(int32_t)N_elements; ++i) vort[i] += 0.5 * dt * (k1[i] + k2[i]);
+      }
+    }
     curr_time += this_dt;
   }
   std::cout << "  solver time is now " << curr_time << std::endl;
@@ -204,24 +436,19 @@ Solver::solveto_d(const double _endtime, const int32_t _numss, const int32_t _to
 //
 std::vector<double>
 Solver::getallvorts_d() {
-  std::cout << "  DummySolver returning vorticity at all soln nodes" << std::endl;
-
-  // HACK - return a diffuse-like vorticity
   std::vector<double> vort;
-  vort.resize(N_snodes);
-
-  for (size_t i=0; i<vort.size(); ++i) {
-    const double xp = snodes[2*i];
-    const double yp = snodes[2*i+1];
-    const double r = std::sqrt(xp*xp + yp*yp);
-    // this is a model of an exponential-like bump from r=0.5 to ~0.75
-    const double factor = 5.0 * ((r<0.74 && r>0.501) ? 0.5 - 0.5*std::cos(10.0*std::pow(r-0.5,0.333333)) : 0.0);
-    // and this makes it negative vort on top and positive beneath
-    vort[i] = factor * (-yp) / r;
-  }
-
+  getallvorts_d(vort);
   return vort;
 }
 
+//
+// the same, into the caller's vector
+//
+void
+Solver::getallvorts_d(std::vector<double>& _vort) {
+  std::cout << "  DummySolver returning vorticity at all soln nodes" << std::endl;
+  _vort = vort;
+}
+
 
 } // end namespace
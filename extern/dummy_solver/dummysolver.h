@@ -35,10 +35,13 @@ public:
   void init_d(std::vector<double>, std::vector<uint32_t>, std::vector<uint32_t>, std::vector<uint32_t>);
   std::vector<double> getsolnpts_d();
   std::vector<double> getopenpts_d();
-  void setopenvels_d(std::vector<double>);
-  void setsolnvort_d(std::vector<double>);
+  void setopenvels_d(const std::vector<double>&);
+  void setopenvort_d(const std::vector<double>&);
+  void setsolnvort_d(const std::vector<double>&);
+  void setptogweights_d(const std::vector<double>&);
   void solveto_d(const double, const int32_t, const int32_t, const double);
   std::vector<double> getallvorts_d();
+  void getallvorts_d(std::vector<double>&);
 
 private:
 
@@ -57,12 +60,31 @@ private:
   std::vector<uint32_t> selems;  // pointers to nodes for all solution elements
   std::vector<uint32_t> sopts;  // pointers to nodes for all solution elements on open boundaries
 
-  int32_t num_substeps;	// number of internel substeps per external time step
-  int32_t elem_order;	// internal element order
-  int32_t time_order;	// internal time integration order
-  double curr_time;	// current simulation time (as far as we know it)
+  // the finite volume discretization: one cell per element, four faces per cell
+  std::vector<double> area;     // area of each cell
+  std::vector<int32_t> fnbr;    // neighbor cell across each face, or wall_face, or -2-open index
+  std::vector<double> fnorm;    // outward face normal times face length, 2 per face
+  std::vector<double> fdist;    // distance between the cell centers across each face
+  static constexpr int32_t wall_face = -1;
 
-  double reynolds;	// reynolds number
+  // the solution
+  std::vector<double> vort;     // vorticity at each solution node
+  std::vector<double> vel;      // velocity at each solution node, 2 per node
+  std::vector<double> openvel;  // velocity at the open boundary solution nodes, 2 per node
+  std::vector<double> openvort; // vorticity just outside the open boundaries
+  std::vector<double> ptog;     // particle-to-grid weights at each solution node
+  std::vector<double> wallpts;  // midpoints of the wall faces, where the velocity is zero
+
+  void interpolate_vels();
+  double stable_dt() const;
+  void find_rates(const std::vector<double>&, std::vector<double>&) const;
+
+  int32_t num_substeps = 1;	// number of internel substeps per external time step
+  int32_t elem_order = 1;	// internal element order
+  int32_t time_order = 1;	// internal time integration order
+  double curr_time = 0.0;	// current simulation time (as far as we know it)
+
+  double reynolds = 0.0;	// reynolds number
 
 }; // end class Solver
 
@@ -0,0 +1,65 @@
+//
+// plugin.cpp - A velocity plugin doing plain direct sums, as a template for real ones
+//              and a check that the plugin path gives what the internal sums do
+//
+// (c)2021 Applied Scientific Research, Inc.
+//         Mark J. Stock <markjstock@gmail.com>
+
+#include "VelPluginAbi.h"
+
+// the same core function the internal kernels use, so results match
+#include "CoreFunc.h"
+
+#include <cstdint>
+
+namespace {
+
+template <class S>
+float points_on_points(int* nsrcs, const int* ns,
+                       const S* const* sx, const S* const* sy,
+                       const S* const* ss, const S* const* sr,
+                       int* ntargs, const int* nt,
+                       const S* const* tx, const S* const* ty, const S* const* tr,
+                       S* const* tu, S* const* tv) {
+  double npairs = 0.0;
+  for (int t=0; t<*ntargs; ++t) {
+    #pragma omp parallel for
+    for (int32_t i=0; i<nt[t]; ++i) {
+      // accumulate in double, as the internal sums do
+      double u = 0.0;
+      double v = 0.0;
+      for (int s=0; s<*nsrcs; ++s) {
+        for (int32_t j=0; j<ns[s]; ++j) {
+          const S dx = tx[t][i] - sx[s][j];
+          const S dy = ty[t][i] - sy[s][j];
+          const S r2 = ss[s][j] * (tr[t] ? core_func<S>(dx*dx + dy*dy, sr[s][j], tr[t][i])
+                                         : core_func<S>(dx*dx + dy*dy, sr[s][j]));
+          u -= r2 * dy;
+          v += r2 * dx;
+        }
+      }
+      tu[t][i] += u;
+      tv[t][i] += v;
+    }
+    for (int s=0; s<*nsrcs; ++s) npairs += (double)nt[t] * (double)ns[s];
+  }
+  return (float)(npairs * (10.0 + (double)flops_tp_nograds<S>()));
+}
+
+const Omega2DVelPlugin table = {
+  OMEGA2D_VEL_PLUGIN_ABI_VERSION,
+  sizeof(Omega2DVelPlugin),
+  "direct sums",
+  points_on_points<float>,
+  points_on_points<double>
+};
+
+}
+
+extern "C"
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const Omega2DVelPlugin* omega2d_vel_plugin(void) {
+  return &table;
+}
@@ -61,15 +61,17 @@ public:
   typedef typename MatrixType::Scalar Scalar;
   typedef typename MatrixType::RealScalar RealScalar;
   typedef typename MatrixType::Index Index;
-  typedef Matrix<Scalar, ColsAtCompileTime, ColsAtCompileTime> MatrixAtAType;
-  typedef Matrix<Scalar, ColsAtCompileTime, RowsAtCompileTime> HatMatrixType;
-  typedef Matrix<Scalar, RowsAtCompileTime, RowsAtCompileTime> QMatrixType;
+  // the maximum sizes carry through, so a system matrix with fixed maximum dimensions
+  //   gives a solver that never allocates
+  typedef Matrix<Scalar, ColsAtCompileTime, ColsAtCompileTime, 0, MaxColsAtCompileTime, MaxColsAtCompileTime> MatrixAtAType;
+  typedef Matrix<Scalar, ColsAtCompileTime, RowsAtCompileTime, 0, MaxColsAtCompileTime, MaxRowsAtCompileTime> HatMatrixType;
+  typedef Matrix<Scalar, RowsAtCompileTime, RowsAtCompileTime, 0, MaxRowsAtCompileTime, MaxRowsAtCompileTime> QMatrixType;
 
   /** Type of a row vector of the system matrix \f$A\f$. */
-  typedef Matrix<Scalar, ColsAtCompileTime, 1> RowVectorType;
+  typedef Matrix<Scalar, ColsAtCompileTime, 1, 0, MaxColsAtCompileTime, 1> RowVectorType;
   /** Type of a column vector of the system matrix \f$A\f$. */
-  typedef Matrix<Scalar, RowsAtCompileTime, 1> ColVectorType;
-  typedef PermutationMatrix<ColsAtCompileTime, ColsAtCompileTime, Index> PermutationType;
+  typedef Matrix<Scalar, RowsAtCompileTime, 1, 0, MaxRowsAtCompileTime, 1> ColVectorType;
+  typedef PermutationMatrix<ColsAtCompileTime, MaxColsAtCompileTime, Index> PermutationType;
   typedef typename PermutationType::IndicesType IndicesType;
 
 
@@ -0,0 +1,216 @@
+/*
+ * AutoTune.h - Pick the summation method and instructions for each source-target pair
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "Points.h"
+#include "Surfaces.h"
+#include "ExecEnv.h"
+#include "ResultsType.h"
+#include "Influence.h"
+#include "Logger.h"
+
+#include <vector>
+#include <array>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+
+//
+// Each backend's time is modeled as an overhead plus a rate times its work: sources times
+//   targets for direct sums, sources plus targets times the log of the sources for the
+//   treecode, and sources plus targets for the fmm; both terms come from timing each
+//   backend on two sizes of random particles the first time the tuner is asked, and after
+//   that each kind of pair scales the model of the backend it ran by how long it really took
+//
+// a pair keeps its choice, keyed on both collections' lineage so that the stage copies of
+//   one step share it, until either size changes by half; the opening angle, expansion
+//   order and everything else still come from the ExecEnv passed in
+//
+template <class S, class A>
+class BackendTuner {
+public:
+  BackendTuner() {
+#ifdef USE_VC
+    backends.push_back({direct, cpu_vc, "direct, Vc"});
+#endif
+#ifdef USE_STDSIMD
+    backends.push_back({direct, cpu_simd, "direct, SIMD"});
+#endif
+    backends.push_back({direct, cpu_x86, "direct, x86"});
+#ifdef USE_CUDA
+    backends.push_back({direct, gpu_cuda, "direct, GPU"});
+#endif
+    // the fast methods run with the fastest cpu instructions
+    backends.push_back({barneshut, backends.front().instrs, "treecode"});
+    backends.push_back({fmm, backends.front().instrs, "fmm"});
+    for (auto& s : scale) s.assign(backends.size(), 1.0);
+  }
+
+  // the same calls as InfluenceVisitor makes
+  void points_on_points(const Points<S>& _src, Points<S>& _targ, const ResultsType& _rt, const ExecEnv& _env) {
+    run(pts_on_pts, _src.get_lineage(), _targ.get_lineage(), _src.get_n(), _targ.get_n(), _env,
+        [&](const ExecEnv& _e) { points_affect_points<S,A>(_src, _targ, _rt, _e); });
+  }
+  void panels_on_points(const Surfaces<S>& _src, Points<S>& _targ, const ResultsType& _rt, const ExecEnv& _env) {
+    run(pans_on_pts, _src.get_lineage(), _targ.get_lineage(), _src.get_npanels(), _targ.get_n(), _env,
+        [&](const ExecEnv& _e) { panels_affect_points<S,A>(_src, _targ, _rt, _e); });
+  }
+  void points_on_panels(const Points<S>& _src, Surfaces<S>& _targ, const ResultsType& _rt, const ExecEnv& _env) {
+    run(pts_on_pans, _src.get_lineage(), _targ.get_lineage(), _src.get_n(), _targ.get_npanels(), _env,
+        [&](const ExecEnv& _e) { points_affect_panels<S,A>(_src, _targ, _rt, _e); });
+  }
+
+  // forget the choices, but keep the calibration
+  void reset() {
+    std::lock_guard<std::mutex> lock(mtx);
+    decisions.clear();
+    for (auto& s : scale) std::fill(s.begin(), s.end(), 1.0);
+  }
+
+private:
+  enum pair_t { pts_on_pts = 0, pans_on_pts, pts_on_pans, num_pairs };
+
+  struct Backend {
+    summation_t summ;
+    accel_t instrs;
+    const char* name;
+  };
+  struct Model {
+    double overhead = 0.0;
+    double rate = 0.0;
+  };
+  struct Decision {
+    size_t backend;
+    size_t ns, nt;
+  };
+
+  std::vector<Backend> backends;
+  std::vector<Model> models;
+  std::array<std::vector<double>,num_pairs> scale;
+  std::map<std::tuple<int,uint32_t,uint32_t>, Decision> decisions;
+  bool calibrated = false;
+  std::mutex mtx;
+
+  static double work(const summation_t _summ, const size_t _ns, const size_t _nt) {
+    const double ns = (double)_ns;
+    const double nt = (double)_nt;
+    if (_summ == barneshut) return (ns + nt) * std::log2(ns + 2.0);
+    if (_summ == fmm) return ns + nt;
+    return ns * nt;
+  }
+
+  // the fast methods only exist for some pairs, and small sources go direct anyway
+  bool allowed(const pair_t _pair, const Backend& _b, const size_t _ns, const ExecEnv& _env) const {
+    if (_b.summ == direct) return true;
+    if (_ns <= 4*_env.get_leaf_size()) return false;
+    if (_b.summ == barneshut) return _pair == pts_on_pts;
+    return true;
+  }
+
+  template <class F>
+  void run(const pair_t _pair, const uint32_t _slin, const uint32_t _tlin,
+           const size_t _ns, const size_t _nt, const ExecEnv& _env, F _eval) {
+
+    size_t ib = 0;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (not calibrated) calibrate(_env);
+
+      // throwaway targets (validation samples, say) would pile up here
+      if (decisions.size() > 1024) decisions.clear();
+
+      const auto key = std::make_tuple((int)_pair, _slin, _tlin);
+      auto it = decisions.find(key);
+      const bool keep = it != decisions.end() and
+                        2*_ns >= it->second.ns and _ns <= 2*it->second.ns and
+                        2*_nt >= it->second.nt and _nt <= 2*it->second.nt;
+      if (keep) {
+        ib = it->second.backend;
+      } else {
+        double best = 0.0;
+        for (size_t b=0; b<backends.size(); ++b) {
+          if (not allowed(_pair, backends[b], _ns, _env)) continue;
+          const double t = predict(_pair, b, _ns, _nt);
+          if (b == 0 or t < best) { ib = b; best = t; }
+        }
+        if (it == decisions.end() or it->second.backend != ib) {
+          LOG_INFO("  Auto-selected " << backends[ib].name << " for " << _ns << " sources on " << _nt << " targets");
+        }
+        decisions[key] = {ib, _ns, _nt};
+      }
+    }
+
+    ExecEnv env = _env;
+    env.set_summation(backends[ib].summ);
+    env.set_instrs(backends[ib].instrs);
+    const auto start = std::chrono::steady_clock::now();
+    _eval(env);
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // let the model for this kind of pair follow what it really costs, a little at a time
+    std::lock_guard<std::mutex> lock(mtx);
+    const double model = models[ib].overhead + models[ib].rate * work(backends[ib].summ, _ns, _nt);
+    if (model > 0.0 and secs > 0.0) {
+      double& s = scale[_pair][ib];
+      s = std::clamp(std::pow(s, 0.7) * std::pow(secs / model, 0.3), 0.01, 100.0);
+    }
+  }
+
+  double predict(const pair_t _pair, const size_t _b, const size_t _ns, const size_t _nt) const {
+    return scale[_pair][_b] * (models[_b].overhead + models[_b].rate * work(backends[_b].summ, _ns, _nt));
+  }
+
+  // time every backend on two sizes of random particles in a unit square
+  void calibrate(const ExecEnv& _env) {
+    std::mt19937 gen(12345);
+    std::uniform_real_distribution<S> unit(0.0, 1.0);
+    auto make_pts = [&](const size_t _n) {
+      std::vector<S> x(Dimensions*_n), s(_n);
+      for (auto& v : x) v = unit(gen);
+      for (auto& v : s) v = unit(gen) - 0.5;
+      ElementPacket<S> packet(x, std::vector<Int>(), s, _n, 0);
+      return Points<S>(packet, active, lagrangian, nullptr, 0.01);
+    };
+
+    LOG_INFO("Calibrating the velocity summation backends");
+    models.resize(backends.size());
+    for (size_t b=0; b<backends.size(); ++b) {
+      const bool fast = (backends[b].summ != direct);
+      const std::array<size_t,2> sizes = fast ? std::array<size_t,2>{2000, 20000}
+                                              : std::array<size_t,2>{500, 2000};
+      ExecEnv env = _env;
+      env.set_summation(backends[b].summ);
+      env.set_instrs(backends[b].instrs);
+      env.set_tree_tag(0);
+
+      std::array<double,2> secs;
+      for (size_t k=0; k<2; ++k) {
+        Points<S> src = make_pts(sizes[k]);
+        Points<S> targ = make_pts(sizes[k]);
+        targ.zero_vels();
+        const auto start = std::chrono::steady_clock::now();
+        points_affect_points<S,A>(src, targ, ResultsType(velonly), env);
+        secs[k] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      }
+
+      const double w0 = work(backends[b].summ, sizes[0], sizes[0]);
+      const double w1 = work(backends[b].summ, sizes[1], sizes[1]);
+      models[b].rate = std::max(1.e-15, (secs[1] - secs[0]) / (w1 - w0));
+      models[b].overhead = std::max(0.0, secs[0] - models[b].rate * w0);
+      LOG_INFO("  " << backends[b].name << ": " << secs[0] << " and " << secs[1] << " s on "
+               << sizes[0] << " and " << sizes[1] << " particles");
+    }
+    calibrated = true;
+  }
+};
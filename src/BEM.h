@@ -8,20 +8,118 @@
 #pragma once
 
 #include "VectorHelper.h"
+#include "Checkpoint.h"
+#include "Profiler.h"
+#include "Logger.h"
 
 #include <Eigen/Dense>
 #include <Eigen/IterativeLinearSolvers>		// for BiCGSTAB and GMRES
 #include <unsupported/Eigen/src/IterativeSolvers/GMRES.h>	// for GMRES
 
+#include <json/json.hpp>
+
 #include <ciso646>
 #include <cstdlib>
 #include <cstdio>
 #include <cstdint>
 #include <cassert>
-#include <chrono>
+#include <algorithm>
 #include <cmath>
+#include <functional>
 #include <iostream>
 #include <vector>
+#include <array>
+#include <utility>
+
+// how the system is stored: assembled, as fast-summation products, or compressed
+enum bem_backend_t {
+  dense_matrix = 0,
+  matrix_free  = 1,
+  hmatrix      = 2
+};
+
+//
+// Block-Jacobi preconditioner for Eigen's iterative solvers
+//
+// each diagonal block holds one boundary collection's influence on itself, and multi-body
+//   systems are dominated by these; rows outside of any block, or every row when there
+//   is only one block, get plain diagonal scaling like Eigen's default preconditioner
+//
+template <class S>
+class BlockJacobiPreconditioner {
+  typedef Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic> MatType;
+  typedef Eigen::Matrix<S, Eigen::Dynamic, 1> VecType;
+public:
+  typedef typename VecType::StorageIndex StorageIndex;
+  enum { ColsAtCompileTime = Eigen::Dynamic, MaxColsAtCompileTime = Eigen::Dynamic };
+
+  BlockJacobiPreconditioner() : nrefactored(0) {}
+  template <typename M> explicit BlockJacobiPreconditioner(const M& _A) : nrefactored(0) { compute(_A); }
+
+  Eigen::Index rows() const { return invdiag.size(); }
+  Eigen::Index cols() const { return invdiag.size(); }
+
+  // the (start, size) of each diagonal block, and whether it needs to be factored again
+  void set_blocks(const std::vector<std::pair<size_t,size_t>>& _blocks, const std::vector<bool>& _dirty) {
+    if (_blocks != blocks) {
+      blocks = _blocks;
+      lus.assign(blocks.size(), Eigen::PartialPivLU<MatType>());
+      dirty.assign(blocks.size(), true);
+    } else {
+      for (size_t i=0; i<dirty.size(); ++i) dirty[i] = dirty[i] or _dirty[i];
+    }
+  }
+  size_t get_num_refactored() const { return nrefactored; }
+  size_t get_mem_bytes() const {
+    size_t nstored = invdiag.size();
+    for (const auto& lu : lus) nstored += lu.rows()*lu.cols();
+    return nstored * sizeof(S);
+  }
+
+  template <typename M> BlockJacobiPreconditioner& analyzePattern(const M&) { return *this; }
+
+  template <typename M> BlockJacobiPreconditioner& factorize(const M& _A) {
+    invdiag.resize(_A.rows());
+    for (Eigen::Index i=0; i<_A.rows(); ++i) {
+      invdiag[i] = (_A(i,i) == S(0.0)) ? S(1.0) : S(1.0) / _A(i,i);
+    }
+    // only factor what changed shape, rigid bodies keep theirs for the whole run
+    nrefactored = 0;
+    if (blocks.size() > 1) {
+      for (size_t i=0; i<blocks.size(); ++i) {
+        if (not dirty[i]) continue;
+        const auto [start, n] = blocks[i];
+        lus[i].compute(_A.block(start, start, n, n));
+        dirty[i] = false;
+        ++nrefactored;
+      }
+    }
+    return *this;
+  }
+
+  template <typename M> BlockJacobiPreconditioner& compute(const M& _A) { analyzePattern(_A); return factorize(_A); }
+
+  template <typename Rhs> VecType solve(const Rhs& _b) const {
+    VecType x = invdiag.cwiseProduct(_b);
+    if (blocks.size() > 1) {
+      for (size_t i=0; i<blocks.size(); ++i) {
+        const auto [start, n] = blocks[i];
+        x.segment(start, n) = lus[i].solve(_b.segment(start, n));
+      }
+    }
+    return x;
+  }
+
+  Eigen::ComputationInfo info() { return Eigen::Success; }
+
+private:
+  VecType invdiag;
+  std::vector<std::pair<size_t,size_t>> blocks;
+  std::vector<Eigen::PartialPivLU<MatType>> lus;
+  std::vector<bool> dirty;
+  size_t nrefactored;
+};
+
 
 //
 // Class to hold BEM parameters and temporaries
@@ -31,17 +129,94 @@
 template <class S, class I>
 class BEM {
 public:
-  BEM() : A_is_current(false), solver_initialized(false) {};
+  BEM() : A_is_current(false), solver_initialized(false),
+          lu_current(false), solves_with_this_A(0), direct_after(3),
+          warm_start(true), have_solution(false), tolerance(0.0), max_iters(0),
+          matrix_free_above(0), hmatrix_above(0), hmatrix_tol(1.e-5), hmatrix_direct(true),
+          backend(dense_matrix), operator_bytes(0), block_jacobi(true), refine_tol(0.0), max_refine(5),
+          solved_time(-99.9), num_solves(0), num_skipped(0), num_iterations(0) {};
+
+  // a function which finds y = A x, used in place of A when the system is large
+  typedef std::function<void(const Eigen::Matrix<S, Eigen::Dynamic, 1>&,
+                             Eigen::Matrix<S, Eigen::Dynamic, 1>&)> Operator;
 
   bool is_A_current() { return A_is_current; }
   void just_made_A() { A_is_current = true; }
-  void panels_changed() { A_is_current = false; solver_initialized = false; }
+  void panels_changed() { A_is_current = false; solver_initialized = false;
+                          lu_current = false; solves_with_this_A = 0; }
+  // factor A directly once it has been used this many times unchanged, 0 means never
+  void set_direct_after(const size_t _n) { direct_after = _n; }
+  size_t get_direct_after() const { return direct_after; }
+  // seed GMRES with the last solution; tolerance and iteration cap of 0 use Eigen's defaults
+  void set_warm_start(const bool _warm) { warm_start = _warm; }
+  void set_tolerance(const double _tol) { tolerance = _tol; }
+  void set_max_iterations(const int32_t _iters) { max_iters = _iters; }
+  // skip assembly for systems with at least this many rows, 0 means always assemble;
+  //   the H-matrix is chosen over the matrix-free products if both apply
+  void set_matrix_free_above(const size_t _n) { matrix_free_above = _n; }
+  void set_hmatrix_above(const size_t _n) { hmatrix_above = _n; }
+  void set_hmatrix_tolerance(const double _tol) { hmatrix_tol = _tol; }
+  double get_hmatrix_tolerance() const { return hmatrix_tol; }
+  bool use_hmatrix_direct() const { return hmatrix_direct; }
+  bem_backend_t select_backend(const size_t _nrows) const {
+    if (hmatrix_above > 0 and _nrows >= hmatrix_above) return hmatrix;
+    if (matrix_free_above > 0 and _nrows >= matrix_free_above) return matrix_free;
+    return dense_matrix;
+  }
+  bem_backend_t get_backend() const { return backend; }
+  // precondition GMRES with the factored per-body diagonal blocks
+  void set_block_jacobi(const bool _bj) { block_jacobi = _bj; }
+  // refine dense solutions with residuals in double until this relative error, 0 means never
+  void set_refine_tolerance(const double _tol) { refine_tol = _tol; }
+  void set_max_refinements(const int32_t _n) { max_refine = _n; }
+  // the product, and optionally a direct solve, replace A
+  void set_operator(Operator _op, Operator _direct, const bem_backend_t _backend, const size_t _bytes = 0) {
+    matvec = _op;
+    direct = _direct;
+    backend = _backend;
+    operator_bytes = _bytes;
+  }
+
+  // the dense system and its factors, or a compressed operator
+  size_t get_mem_bytes() const {
+    return sizeof(S) * (A.size() + b.size() + strengths.size() + lu.rows()*lu.cols()) +
+           solver.preconditioner().get_mem_bytes() + operator_bytes;
+  }
+  // the generations of every collection, the time, and the freestream fully define the solution
+  bool inputs_unchanged(const double, const std::array<double,Dimensions>&, const std::vector<uint32_t>&);
+  void set_inputs(const double, const std::array<double,Dimensions>&, const std::vector<uint32_t>&);
+  double get_solved_time() const { return solved_time; }
+  size_t get_num_solves() const { return num_solves; }
+  size_t get_num_skipped() const { return num_skipped; }
+  // iterations of every iterative solve so far
+  size_t get_num_iterations() const { return num_iterations; }
   void reset();
+
+  // the last solution seeds the next iterative solve, and the uses of the unchanged A decide
+  //   when it gets factored, so a restart needs both; A itself is rebuilt
+  void write_state(CheckpointWriter& _out) const {
+    _out.put(have_solution);
+    _out.put_vec(strengths);
+    _out.put(solved_time);
+    _out.put((uint64_t)solves_with_this_A);
+  }
+  void read_state(CheckpointReader& _in) {
+    have_solution = _in.get<bool>();
+    _in.get_vec(strengths);
+    solved_time = _in.get<double>();
+    resumed_solves = (size_t)_in.get<uint64_t>();
+  }
+  size_t take_resumed_solves() { const size_t n = resumed_solves; resumed_solves = 0; return n; }
+  void resume_solves(const size_t _n) { solves_with_this_A = _n; }
   void set_block(const size_t, const size_t, const size_t, const size_t, const Vector<S>&);
   void set_rhs(std::vector<S>&);
   void set_rhs(const size_t, const size_t, std::vector<S>&);
   void solve();
 
+  // read/write parameters to json
+  void from_json(const nlohmann::json);
+  void add_to_json(nlohmann::json&) const;
+
   std::vector<S> getRhs();
   std::vector<S> getStrengths();
   Vector<S> get_str(const size_t, const size_t);
@@ -57,13 +232,97 @@ private:
   // is the A matrix current?
   bool A_is_current;
   bool solver_initialized;
+
+  // the iterative solver, persistent from call to call
+  Eigen::GMRES<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>, BlockJacobiPreconditioner<S>> solver;
+
+  // dense factorization of A, for geometries that do not change from step to step
+  Eigen::PartialPivLU<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>> lu;
+  bool lu_current;
+  size_t solves_with_this_A;
+  size_t resumed_solves = 0;
+  size_t direct_after;
+
+  // iterative solver controls
+  bool warm_start;
+  bool have_solution;
+  double tolerance;
+  int32_t max_iters;
+
+  // matrix-free and compressed modes
+  size_t matrix_free_above;
+  size_t hmatrix_above;
+  double hmatrix_tol;
+  bool hmatrix_direct;
+  bem_backend_t backend;
+  Operator matvec;
+  Operator direct;
+  size_t operator_bytes;
+
+  // the diagonal blocks for the preconditioner, and which have been set since it was built
+  bool block_jacobi;
+  std::vector<std::pair<size_t,size_t>> diag_blocks;
+  std::vector<bool> diag_dirty;
+  int32_t solve_matrix_free(const bool);
+
+  // mixed-precision iterative refinement of the dense solution
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1> DVec;
+  double refine_tol;
+  int32_t max_refine;
+  double residual(const DVec&, const DVec&, DVec&) const;
+  void refine();
+
+  // the state used for the current strengths
+  double solved_time;
+  std::array<double,Dimensions> solved_fs;
+  std::vector<uint32_t> solved_gens;
+  size_t num_solves;
+  size_t num_skipped;
+  size_t num_iterations;
 };
 
+// is the current solution already the one for this state? count it if so
+template <class S, class I>
+bool BEM<S,I>::inputs_unchanged(const double _time,
+                                const std::array<double,Dimensions>& _fs,
+                                const std::vector<uint32_t>& _gens) {
+  if (not A_is_current or not have_solution) return false;
+  if (_time != solved_time or _fs != solved_fs or _gens != solved_gens) return false;
+  ++num_skipped;
+  return true;
+}
+
+template <class S, class I>
+void BEM<S,I>::set_inputs(const double _time,
+                          const std::array<double,Dimensions>& _fs,
+                          const std::vector<uint32_t>& _gens) {
+  solved_time = _time;
+  solved_fs = _fs;
+  solved_gens = _gens;
+  ++num_solves;
+}
+
 // remove any memory and reset flags
 template <class S, class I>
 void BEM<S,I>::reset() {
   A_is_current = false;
   solver_initialized = false;
+  lu_current = false;
+  solves_with_this_A = 0;
+  resumed_solves = 0;
+  have_solution = false;
+  matvec = nullptr;
+  direct = nullptr;
+  backend = dense_matrix;
+  operator_bytes = 0;
+  diag_blocks.clear();
+  diag_dirty.clear();
+  solved_time = -99.9;
+  solved_gens.clear();
+  num_solves = 0;
+  num_skipped = 0;
+  num_iterations = 0;
+  lu = Eigen::PartialPivLU<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>>();
   A.resize(1,1);
   b.resize(1);
   strengths.resize(1);
@@ -97,6 +356,92 @@ Vector<S> BEM<S,I>::get_str(const size_t cstart, const size_t ncols) {
   return retval;
 }
 
+//
+// read/write parameters to json
+//
+
+// read "simparams" json object
+template <class S, class I>
+void BEM<S,I>::from_json(const nlohmann::json j) {
+
+  if (j.find("bem") != j.end()) {
+    nlohmann::json bj = j["bem"];
+
+    if (bj.find("warmStart") != bj.end()) {
+      warm_start = bj["warmStart"];
+      std::cout << "  setting bem warm start= " << warm_start << std::endl;
+    }
+
+    if (bj.find("tolerance") != bj.end()) {
+      tolerance = bj["tolerance"];
+      std::cout << "  setting bem tolerance= " << tolerance << std::endl;
+    }
+
+    if (bj.find("maxIterations") != bj.end()) {
+      max_iters = bj["maxIterations"];
+      std::cout << "  setting bem max iterations= " << max_iters << std::endl;
+    }
+
+    if (bj.find("directAfter") != bj.end()) {
+      direct_after = bj["directAfter"];
+      std::cout << "  setting bem direct solve after= " << direct_after << std::endl;
+    }
+
+    if (bj.find("blockJacobi") != bj.end()) {
+      block_jacobi = bj["blockJacobi"];
+      std::cout << "  setting bem block-Jacobi preconditioner= " << block_jacobi << std::endl;
+    }
+
+    if (bj.find("matrixFreeAbove") != bj.end()) {
+      matrix_free_above = bj["matrixFreeAbove"];
+      std::cout << "  setting bem matrix-free above= " << matrix_free_above << std::endl;
+    }
+
+    if (bj.find("hmatrixAbove") != bj.end()) {
+      hmatrix_above = bj["hmatrixAbove"];
+      std::cout << "  setting bem H-matrix above= " << hmatrix_above << std::endl;
+    }
+
+    if (bj.find("hmatrixTolerance") != bj.end()) {
+      hmatrix_tol = bj["hmatrixTolerance"];
+      std::cout << "  setting bem H-matrix tolerance= " << hmatrix_tol << std::endl;
+    }
+
+    if (bj.find("hmatrixDirect") != bj.end()) {
+      hmatrix_direct = bj["hmatrixDirect"];
+      std::cout << "  setting bem H-matrix direct solve= " << hmatrix_direct << std::endl;
+    }
+
+    if (bj.find("refineTolerance") != bj.end()) {
+      refine_tol = bj["refineTolerance"];
+      std::cout << "  setting bem refinement tolerance= " << refine_tol << std::endl;
+    }
+
+    if (bj.find("maxRefinements") != bj.end()) {
+      max_refine = bj["maxRefinements"];
+      std::cout << "  setting bem max refinements= " << max_refine << std::endl;
+    }
+  }
+}
+
+// create and write a json object for all bem parameters
+template <class S, class I>
+void BEM<S,I>::add_to_json(nlohmann::json& j) const {
+  nlohmann::json bj;
+  bj["warmStart"] = warm_start;
+  bj["tolerance"] = tolerance;
+  bj["maxIterations"] = max_iters;
+  bj["directAfter"] = direct_after;
+  bj["blockJacobi"] = block_jacobi;
+  bj["matrixFreeAbove"] = matrix_free_above;
+  bj["hmatrixAbove"] = hmatrix_above;
+  bj["hmatrixTolerance"] = hmatrix_tol;
+  bj["hmatrixDirect"] = hmatrix_direct;
+  bj["refineTolerance"] = refine_tol;
+  bj["maxRefinements"] = max_refine;
+  j["bem"] = bj;
+}
+
 //
 // Set a block in the A matrix from the given vector of coefficients
 //
@@ -120,6 +465,19 @@ void BEM<S,I>::set_block(const size_t rstart, const size_t nrows,
       A(i+rstart,j+cstart) = _in[iptr++];
     }
   }
+
+  // a collection's influence on itself is a diagonal block, it will need to be factored again
+  if (rstart == cstart and nrows == ncols) {
+    auto it = std::find_if(diag_blocks.begin(), diag_blocks.end(),
+                           [=](const auto& blk) { return blk.first == rstart; });
+    if (it == diag_blocks.end()) {
+      diag_blocks.emplace_back(rstart, nrows);
+      diag_dirty.push_back(true);
+    } else {
+      it->second = nrows;
+      diag_dirty[it - diag_blocks.begin()] = true;
+    }
+  }
 }
 
 //
@@ -135,7 +493,7 @@ void BEM<S,I>::set_rhs(std::vector<S>& _b) {
 template <class S, class I>
 void BEM<S,I>::set_rhs(const size_t cstart, const size_t ncols, std::vector<S>& _b) {
   // use cstart and ncols to put the _b vector in a specific place
-  std::cout << "    putting data into rhs vector from " << cstart << " to " << (cstart+ncols) << std::endl;
+  LOG_DEBUG("    putting data into rhs vector from " << cstart << " to " << (cstart+ncols));
   assert(_b.size() == ncols && "Input array size does not match");
   const size_t new_n = std::max((size_t)(b.size()), (size_t)(cstart+ncols));
   b.conservativeResize(new_n);
@@ -155,9 +513,14 @@ void BEM<S,I>::set_rhs(const size_t cstart, const size_t ncols, std::vector<S>&
 //
 template <class S, class I>
 void BEM<S,I>::solve() {
+  PROFILE_ZONE("bem solve");
+
+  // last step's solution is a good first guess, if the system is the same size
+  const bool use_guess = warm_start and have_solution and (strengths.size() == b.size());
 
   // ensure that the solution vector is the right size
   strengths.resizeLike(b);
+  have_solution = true;
 
   if (VERBOSE and false) {
     std::cout << "A is " << A.size() << std::endl;
@@ -165,31 +528,91 @@ void BEM<S,I>::solve() {
     std::cout << "x is " << strengths.size() << std::endl;
   }
 
-  // the Eigen solver object - persistent from call to call
-  static Eigen::GMRES<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic> > solver(A);
+  // a compressed A which is already factored
+  if (direct) {
+    PROFILE_ZONE("direct");
+    direct(b, strengths);
+
+    if (VERBOSE and matvec) {
+      Eigen::Matrix<S, Eigen::Dynamic, 1> ax;
+      matvec(strengths, ax);
+      double b_norm = b.norm();
+      if (b_norm == 0) { b_norm = 1.0; }
+      LOG_DEBUG("    L2 norm of error is " << (ax - b).norm() / b_norm);
+    }
+    return;
+  }
+
+  // there is no A to factor or hand to Eigen, only its product with a vector
+  if (matvec) {
+    if (not use_guess) strengths.setZero();
+    PROFILE_ZONE("iterate");
+    const int32_t iters = solve_matrix_free(use_guess);
+    num_iterations += iters;
+    LOG_INFO("    " << ((backend == hmatrix) ? "hmatrix" : "matrix-free") << " solve:\t" << iters
+             << " iterations" << (use_guess ? " from last solution" : ""));
+    return;
+  }
+
+  // A has survived several solves, so the geometry is fixed or rigid: a one-time
+  //   factorization makes every later solve a back-substitution
+  ++solves_with_this_A;
+  if (not lu_current and direct_after > 0 and solves_with_this_A > direct_after) {
+    PROFILE_ZONE("factor");
+    lu.compute(A);
+    lu_current = true;
+  }
+
+  if (lu_current) {
+    {
+      PROFILE_ZONE("back-substitute");
+      strengths = lu.solve(b);
+    }
+
+    if (VERBOSE or refine_tol > 0.0) refine();
+    return;
+  }
 
   if (not solver_initialized) {
 
-    // if A changes, we need to re-run this
-    auto istart = std::chrono::system_clock::now();
-    solver.compute(A);
-    auto iend = std::chrono::system_clock::now();
+    // only the diagonal blocks which were set again get factored again
+    if (block_jacobi) {
+      solver.preconditioner().set_blocks(diag_blocks, diag_dirty);
+    } else {
+      solver.preconditioner().set_blocks({}, {});
+    }
+    std::fill(diag_dirty.begin(), diag_dirty.end(), false);
 
-    std::chrono::duration<double> ielapsed_seconds = iend-istart;
-    printf("    solver.init:\t[%.6f] cpu seconds\n", (float)ielapsed_seconds.count());
+    // if A changes, we need to re-run this
+    {
+      PROFILE_ZONE("precondition");
+      solver.compute(A);
+    }
+    LOG_DEBUG("    solver.init:\tfactored " << solver.preconditioner().get_num_refactored() << " of "
+              << ((block_jacobi and diag_blocks.size() > 1) ? diag_blocks.size() : 0) << " diagonal blocks");
 
     solver_initialized = true;
   }
 
-  // note that BiCGSTAB accepts a preconditioner as a template arg
-  // note that solveWithGuess() can seed the solution with last step's solution!
+  const double tol = (tolerance > 0.0) ? tolerance : (double)Eigen::NumTraits<S>::epsilon();
+  solver.setTolerance(tol);
+  if (max_iters > 0) solver.setMaxIterations(max_iters);
 
   // here is the matrix solution
-  auto start = std::chrono::system_clock::now();
-  strengths = solver.solve(b);
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  printf("    solver.solve:\t[%.6f] cpu seconds\n", (float)elapsed_seconds.count());
+  PROFILE_ZONE("iterate");
+  if (use_guess) {
+    const Eigen::Matrix<S, Eigen::Dynamic, 1> guess = strengths;
+    // Eigen's GMRES converges relative to the starting (preconditioned) residual, but we want
+    //   it relative to b
+    const double r0_norm = solver.preconditioner().solve(b - A*guess).norm();
+    const double b_norm = solver.preconditioner().solve(b).norm();
+    if (r0_norm > 0.0 and b_norm > 0.0) solver.setTolerance(std::min(1.0, tol * b_norm / r0_norm));
+    strengths = solver.solveWithGuess(b, guess);
+  } else {
+    strengths = solver.solve(b);
+  }
+  LOG_INFO("    solver.solve:\t" << solver.iterations() << " iterations" << (use_guess ? " from last solution" : ""));
+  num_iterations += (size_t)solver.iterations();
 
   if (VERBOSE and false) {
     const size_t nr = 20;
@@ -204,19 +627,165 @@ void BEM<S,I>::solve() {
     std::cout << strengths.head(nr) << std::endl;
   }
 
-  if (VERBOSE) printf("    num iterations:     %d\n", (uint32_t)solver.iterations());
-  if (VERBOSE) printf("    estimated error: %g\n", solver.error());
+  if (VERBOSE) LOG_DEBUG("    estimated error: " << solver.error());
+
+  // find L2 norm of error, and reduce it if asked
+  if (VERBOSE or refine_tol > 0.0) refine();
+}
+
+
+//
+// r = b - A x with every product and sum in double, A is column-major so work on row strips
+//
+template <class S, class I>
+double BEM<S,I>::residual(const DVec& _x, const DVec& _b, DVec& _r) const {
+  const Eigen::Index nr = A.rows();
+  const Eigen::Index nc = A.cols();
+  const Eigen::Index strip = 256;
+  _r = _b;
+  #pragma omp parallel for
+  for (Eigen::Index ib=0; ib<nr; ib+=strip) {
+    const Eigen::Index nb = std::min(strip, nr-ib);
+    for (Eigen::Index j=0; j<nc; ++j) {
+      _r.segment(ib,nb) -= A.col(j).segment(ib,nb).template cast<double>() * _x[j];
+    }
+  }
+  return _r.norm();
+}
+
+
+//
+// Iterative refinement: A and its factorization (or Krylov solver) stay in the storage type,
+//   only the residual and the accumulated solution are in double
+//
+template <class S, class I>
+void BEM<S,I>::refine() {
+  PROFILE_ZONE("refine");
 
-  // find L2 norm of error
-  start = std::chrono::system_clock::now();
-  //assert(b.norm() != 0 && "Can't divide by 0");
   // b.norm() is 0 for first computation, so we let it be one for the error computation
-  double b_norm = b.norm(); // norm() is L2 norm
+  const DVec bd = b.template cast<double>();
+  double b_norm = bd.norm();
   if (b_norm == 0) { b_norm = 1.0; }
-  double relative_error = (A*strengths - b).norm() / b_norm;
-  if (VERBOSE) printf("    L2 norm of error is %g\n", relative_error);
-  end = std::chrono::system_clock::now();
-  elapsed_seconds = end-start;
-  if (VERBOSE) printf("    solver.error:\t[%.6f] cpu seconds\n", (float)elapsed_seconds.count());
+
+  DVec x = strengths.template cast<double>();
+  DVec r, rnew;
+  double rel_error = residual(x, bd, r) / b_norm;
+  if (VERBOSE) LOG_DEBUG("    L2 norm of error is " << rel_error);
+
+  // each correction solves A d = r with the same factorization or solver
+  int32_t nrefine = 0;
+  if (not lu_current) solver.setTolerance((tolerance > 0.0) ? tolerance : (double)Eigen::NumTraits<S>::epsilon());
+  while (refine_tol > 0.0 and rel_error > refine_tol and nrefine < max_refine) {
+    const Eigen::Matrix<S, Eigen::Dynamic, 1> rs = r.template cast<S>();
+    const Eigen::Matrix<S, Eigen::Dynamic, 1> d = lu_current ? Eigen::Matrix<S, Eigen::Dynamic, 1>(lu.solve(rs))
+                                                             : Eigen::Matrix<S, Eigen::Dynamic, 1>(solver.solve(rs));
+    const DVec xnew = x + d.template cast<double>();
+    const double new_error = residual(xnew, bd, rnew) / b_norm;
+    ++nrefine;
+
+    // the storage-type solve can not get any closer
+    if (not (new_error < rel_error)) break;
+    x = xnew;
+    r.swap(rnew);
+    rel_error = new_error;
+  }
+
+  if (nrefine > 0) {
+    strengths = x.template cast<S>();
+    LOG_DEBUG("    refined " << nrefine << " times to L2 norm of error " << rel_error << ", before rounding");
+  }
 }
 
+
+//
+// Restarted GMRES driven only by the operator, the Arnoldi vectors are kept in double
+//   since the products themselves are only as accurate as the fast summation
+//
+template <class S, class I>
+int32_t BEM<S,I>::solve_matrix_free(const bool _use_guess) {
+
+  const Eigen::Index n = b.size();
+  const Eigen::Index m = std::min((Eigen::Index)50, n);
+  // fast summation errors are near 1e-6, so do not default to machine precision here
+  const double tol = (tolerance > 0.0) ? tolerance : 1.e-5;
+  const int32_t maxit = (max_iters > 0) ? max_iters : 10*(int32_t)m;
+
+  const DVec bd = b.template cast<double>();
+  const double b_norm = bd.norm();
+  if (b_norm == 0.0) {
+    strengths.setZero();
+    return 0;
+  }
+
+  // y = A x through the operator, in the storage type
+  Eigen::Matrix<S, Eigen::Dynamic, 1> xs(n), ys(n);
+  auto apply = [&](const DVec& _in, DVec& _out) {
+    xs = _in.template cast<S>();
+    matvec(xs, ys);
+    _out = ys.template cast<double>();
+  };
+
+  DVec x = _use_guess ? DVec(strengths.template cast<double>()) : DVec::Zero(n);
+  Eigen::MatrixXd V(n, m+1);
+  Eigen::MatrixXd H(m+1, m);
+  DVec cs(m), sn(m), g(m+1), w(n);
+  int32_t iters = 0;
+  bool converged = false;
+
+  while (not converged and iters < maxit) {
+    apply(x, w);
+    const DVec r = bd - w;
+    const double beta = r.norm();
+    if (beta <= tol * b_norm) break;
+
+    V.col(0) = r / beta;
+    H.setZero();
+    g.setZero();
+    g[0] = beta;
+
+    // build the Krylov space, rotating each new column of H to upper triangular
+    Eigen::Index k = 0;
+    while (k < m and iters < maxit) {
+      ++iters;
+      apply(V.col(k), w);
+      for (Eigen::Index i=0; i<=k; ++i) {
+        H(i,k) = w.dot(V.col(i));
+        w -= H(i,k) * V.col(i);
+      }
+      H(k+1,k) = w.norm();
+      if (H(k+1,k) > 0.0) V.col(k+1) = w / H(k+1,k);
+
+      for (Eigen::Index i=0; i<k; ++i) {
+        const double t = cs[i]*H(i,k) + sn[i]*H(i+1,k);
+        H(i+1,k) = -sn[i]*H(i,k) + cs[i]*H(i+1,k);
+        H(i,k) = t;
+      }
+      const double hyp = std::hypot(H(k,k), H(k+1,k));
+      cs[k] = (hyp > 0.0) ? H(k,k) / hyp : 1.0;
+      sn[k] = (hyp > 0.0) ? H(k+1,k) / hyp : 0.0;
+      H(k,k) = hyp;
+      H(k+1,k) = 0.0;
+      g[k+1] = -sn[k] * g[k];
+      g[k] *= cs[k];
+      ++k;
+
+      if (std::abs(g[k]) <= tol * b_norm) {
+        converged = true;
+        break;
+      }
+    }
+
+    // update the solution with this cycle's least-squares answer
+    const DVec yk = H.topLeftCorner(k,k).template triangularView<Eigen::Upper>().solve(g.head(k));
+    x += V.leftCols(k) * yk;
+  }
+
+  strengths = x.template cast<S>();
+
+  if (VERBOSE) {
+    apply(x, w);
+    LOG_DEBUG("    L2 norm of error is " << (bd - w).norm() / b_norm);
+  }
+
+  return iters;
+}
@@ -14,14 +14,150 @@
 #include "Coefficients.h"
 #include "RHS.h"
 #include "BEM.h"
+#include "BEMOperator.h"
+#include "HMatrix.h"
+#include "Logger.h"
 
 #include <cstdlib>
 #include <iostream>
 #include <array>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <utility>
 #include <cassert>
 
 
+//
+// Compress the BEM matrix of a set of panel collections
+//
+// entries are the same as panels_on_panels_coeff, and the rows and columns
+//   of augmented bodies become the dense border
+//
+template <class S, class A>
+std::shared_ptr<BorderedHMatrix<S>> make_bem_hmatrix(std::vector<Collection>& _bdry,
+                                                     InfluenceVisitor<A>& _ivisitor,
+                                                     const double _tol) {
+
+  // flat copies of every panel, and which panel and component each unknown refers to;
+  //   the far-field entries lose too many digits in float for ACA to find their low rank
+  std::vector<double> px0, py0, px1, py1, pcx, pcy, ptx, pty, pnx, pny, pa;
+  std::vector<size_t> hpanel;
+  std::vector<int32_t> hcomp;
+  std::vector<int64_t> hidx;
+  std::vector<size_t> augcoll;
+  for (size_t ic=0; ic<_bdry.size(); ++ic) {
+    const Surfaces<S>& surf = std::get<Surfaces<S>>(_bdry[ic]);
+    const std::array<Vector<S>,Dimensions>& x = surf.get_pos();
+    const std::vector<Int>& si = surf.get_idx();
+    const size_t nunk = surf.num_unknowns_per_panel();
+    for (size_t i=0; i<surf.get_npanels(); ++i) {
+      const size_t ip = px0.size();
+      px0.push_back(x[0][si[2*i]]);
+      py0.push_back(x[1][si[2*i]]);
+      px1.push_back(x[0][si[2*i+1]]);
+      py1.push_back(x[1][si[2*i+1]]);
+      pcx.push_back(0.5*(px0.back()+px1.back()));
+      pcy.push_back(0.5*(py0.back()+py1.back()));
+      ptx.push_back(surf.get_tang()[0][i]);
+      pty.push_back(surf.get_tang()[1][i]);
+      pnx.push_back(surf.get_norm()[0][i]);
+      pny.push_back(surf.get_norm()[1][i]);
+      pa.push_back(surf.get_area()[i]);
+      for (size_t q=0; q<nunk; ++q) {
+        hidx.push_back(hpanel.size());
+        hpanel.push_back(ip);
+        hcomp.push_back(q);
+      }
+    }
+    if (surf.is_augmented()) {
+      hidx.push_back(-1);
+      augcoll.push_back(ic);
+    }
+  }
+  const size_t nh = hpanel.size();
+  const size_t nb = augcoll.size();
+
+  // one entry, the two-way average of panel on collocation point; the HMatrix keeps this,
+  //   so it owns its copies of the panels rather than referring to these locals
+  auto entry = [px0=std::move(px0), py0=std::move(py0), px1=std::move(px1), py1=std::move(py1),
+                pcx=std::move(pcx), pcy=std::move(pcy), ptx=std::move(ptx), pty=std::move(pty),
+                pnx=std::move(pnx), pny=std::move(pny), pa=std::move(pa),
+                hpanel=std::move(hpanel), hcomp=std::move(hcomp)](const size_t _i, const size_t _j) -> S {
+    const size_t it = hpanel[_i];
+    const size_t is = hpanel[_j];
+    const int32_t qt = hcomp[_i];
+    const int32_t qs = hcomp[_j];
+    if (it == is) return (qt == qs) ? 0.5 : 0.0;
+
+    double vu, vv, su, sv;
+    kernelu_1vos_0p<double,double>(px0[is], py0[is], px1[is], py1[is], 1.0, 1.0, pcx[it], pcy[it], &vu, &vv, &su, &sv);
+    const double bx = (qt == 0) ? ptx[it] : pnx[it];
+    const double by = (qt == 0) ? pty[it] : pny[it];
+    double coeff = (qs == 0) ? (vu*bx + vv*by) : (su*bx + sv*by);
+
+    // flipping source and target returns negative of desired influence
+    kernelu_1vos_0p<double,double>(px0[it], py0[it], px1[it], py1[it], 1.0, 1.0, pcx[is], pcy[is], &vu, &vv, &su, &sv);
+    coeff -= ((qs == 0) ? (vu*bx + vv*by) : (su*bx + sv*by)) * pa[is] / pa[it];
+    return (S)(0.5 * coeff / (2.0 * M_PI));
+  };
+
+  HMatrix<S> h(nh, std::move(entry), _tol);
+
+  // the border: induced velocity from unit rotation, circulation, and enclosed area
+  typename HMatrix<S>::Mat c = HMatrix<S>::Mat::Zero(nh, nb);
+  typename HMatrix<S>::Mat r = HMatrix<S>::Mat::Zero(nb, nh);
+  typename HMatrix<S>::Mat e = HMatrix<S>::Mat::Zero(nb, nb);
+  for (size_t ib=0; ib<nb; ++ib) {
+    Collection& src = _bdry[augcoll[ib]];
+    std::visit([=](auto& elem) { elem.zero_strengths(); }, src);
+    std::visit([=](auto& elem) { elem.add_unit_rot_strengths(); }, src);
+    size_t ih = 0;
+    for (auto &targ : _bdry) {
+      std::visit([=](auto& elem) { elem.zero_vels(); }, targ);
+      std::visit(_ivisitor, src, targ);
+      std::visit([=](auto& elem) { elem.finalize_vels(std::array<double,Dimensions>({0.0,0.0})); }, targ);
+      const Surfaces<S>& tsurf = std::get<Surfaces<S>>(targ);
+      const std::array<Vector<S>,Dimensions>& vel = tsurf.get_vel();
+      for (size_t i=0; i<tsurf.get_npanels(); ++i) {
+        c(ih++, ib) = vel[0][i]*tsurf.get_tang()[0][i] + vel[1][i]*tsurf.get_tang()[1][i];
+        if (tsurf.num_unknowns_per_panel() == 2) {
+          c(ih++, ib) = vel[0][i]*tsurf.get_norm()[0][i] + vel[1][i]*tsurf.get_norm()[1][i];
+        }
+      }
+    }
+    std::visit([=](auto& elem) { elem.zero_strengths(); }, src);
+
+    const Surfaces<S>& ssurf = std::get<Surfaces<S>>(src);
+    e(ib, ib) = 2.0 * ssurf.get_vol();
+  }
+  for (size_t ib=0; ib<nb; ++ib) {
+    // the vortex unknowns of this body, weighted by panel length
+    const Surfaces<S>& surf = std::get<Surfaces<S>>(_bdry[augcoll[ib]]);
+    const size_t first = surf.get_first_row();
+    const size_t nunk = surf.num_unknowns_per_panel();
+    for (size_t i=0; i<surf.get_npanels(); ++i) {
+      r(ib, hidx[first + nunk*i]) = surf.get_area()[i];
+    }
+  }
+
+  return std::make_shared<BorderedHMatrix<S>>(hidx, std::move(h), c, r, e);
+}
+
+
+//
+// the state generation of every collection which feeds the BEM
+//
+inline std::vector<uint32_t> bem_input_gens(const std::vector<Collection>& _vort,
+                                            const std::vector<Collection>& _bdry) {
+  std::vector<uint32_t> gens;
+  gens.reserve(_vort.size() + _bdry.size());
+  for (auto &coll : _vort) gens.push_back(std::visit([=](auto& elem) { return elem.get_state_gen(); }, coll));
+  for (auto &coll : _bdry) gens.push_back(std::visit([=](auto& elem) { return elem.get_state_gen(); }, coll));
+  return gens;
+}
+
+
 //
 // helper function to solve BEM equations on given state
 //
@@ -30,13 +166,22 @@ void solve_bem(const double                         _time,
                const std::array<double,Dimensions>& _fs,
                std::vector<Collection>&             _vort,
                std::vector<Collection>&             _bdry,
-               BEM<S,I>&                            _bem) {
+               BEM<S,I>&                            _bem,
+               const ExecEnv&                       _env) {
 
   // no unknowns? no problem.
   if (_bdry.size() == 0) return;
 
-  // save the simulation time from the last time we entered this function
-  static double last_time = -99.9;
+  PROFILE_ZONE("bem");
+
+  // the simulation time of the last solve
+  const double last_time = _bem.get_solved_time();
+
+  // several parts of a step ask for the solution, often without changing anything first
+  if (_bem.inputs_unchanged(_time, _fs, bem_input_gens(_vort, _bdry))) {
+    LOG_INFO("  Skipping BEM solve, nothing changed since the last one");
+    return;
+  }
 
   // if this is the first time through after a reset, recalculate the row indices
   if (not _bem.is_A_current()) {
@@ -48,39 +193,120 @@ void solve_bem(const double                         _time,
     }
   }
 
+  // large systems of plain panels skip assembly, and use fast products or compression instead
+  const size_t nrows = std::visit([=](auto& elem) { return (size_t)elem.get_next_row(); }, _bdry.back());
+  bem_backend_t backend = _bem.select_backend(nrows);
+  if (backend != dense_matrix and not BEMOperator<S,A>::supports(_bdry)) {
+    LOG_DEBUG("  Non-panel boundaries need the full BEM matrix");
+    backend = dense_matrix;
+  }
+  if (backend != dense_matrix and (_env.get_periodic_domain().active() or _env.get_symmetry_plane().active())) {
+    LOG_DEBUG("  Periodic or mirrored images need the full BEM matrix");
+    backend = dense_matrix;
+  }
+  const bool skip_assembly = (backend != dense_matrix);
+  // switching modes means starting over
+  if (backend != _bem.get_backend()) {
+    _bem.panels_changed();
+    _bem.set_operator(nullptr, nullptr, dense_matrix);
+  }
+
   // add vortex and source strengths to account for rotating bodies - unless we augment!
   //for (auto &src : _bdry) {
   //  std::visit([=](auto& elem) { elem.add_unit_rot_strengths(); }, src);
   //}
 
   // need this for dispatching velocity influence calls, template param is accumulator type,
-  //   member variable is default execution environment
-#ifdef USE_VC
-  InfluenceVisitor<A> ivisitor = {ResultsType(velonly), ExecEnv(true, direct, cpu_vc)};
+  //   member variable is default execution environment, with the case's summation and domain
+  const summation_t _summ = _env.get_summation();
+#ifdef USE_CUDA
+  InfluenceVisitor<A> ivisitor = {ResultsType(velonly), ExecEnv(true, _summ, gpu_cuda)};
+#elif defined(USE_VC)
+  InfluenceVisitor<A> ivisitor = {ResultsType(velonly), ExecEnv(true, _summ, cpu_vc)};
+#elif defined(USE_STDSIMD)
+  InfluenceVisitor<A> ivisitor = {ResultsType(velonly), ExecEnv(true, _summ, cpu_simd)};
 #else
-  InfluenceVisitor<A> ivisitor = {ResultsType(velonly), ExecEnv(true, direct, cpu_x86)};
+  InfluenceVisitor<A> ivisitor = {ResultsType(velonly), ExecEnv(true, _summ, cpu_x86)};
 #endif
+  ivisitor.env.set_velocity_core(_env.get_velocity_core());
+  ivisitor.env.set_periodic_domain(_env.get_periodic_domain());
+  ivisitor.env.set_symmetry_plane(_env.get_symmetry_plane());
   RHSVisitor rvisitor;
 
   //
   // update rhs first
   //
 
-  std::cout << "  Solving for BEM RHS" << std::endl;
+  LOG_DEBUG("  Solving for BEM RHS");
+
+  // with several panel collections and direct sums, the particles pass the panels of all of
+  //   them in one sweep, see points_affect_panel_list, and the velocities are handed back
+  const bool fuse_panels = (_bdry.size() > 1 and _summ != fmm and _summ != vic and
+                            ivisitor.env.get_instrs() != gpu_cuda and
+                            not _env.get_periodic_domain().active() and not _env.get_symmetry_plane().active() and
+                            std::all_of(_bdry.begin(), _bdry.end(),
+                                        [](const Collection& c) { return std::holds_alternative<Surfaces<S>>(c); }));
+  std::vector<size_t> first_panel;
+  std::array<Vector<S>,4> pends;
+  Vector<S> parea;
+  std::array<Vector<S>,Dimensions> pvel;
+
+  if (fuse_panels) {
+    for (auto &targ : _bdry) {
+      Surfaces<S>& surf = std::get<Surfaces<S>>(targ);
+      surf.transform(_time);
+      surf.zero_vels();
+
+      const std::array<Vector<S>,Dimensions>& x = std::as_const(surf).get_pos();
+      const std::vector<Int>& si = surf.get_idx();
+      const Vector<S>& area = surf.get_area();
+      first_panel.push_back(parea.size());
+      for (size_t i=0; i<surf.get_npanels(); ++i) {
+        pends[0].push_back(x[0][si[2*i]]);
+        pends[1].push_back(x[1][si[2*i]]);
+        pends[2].push_back(x[0][si[2*i+1]]);
+        pends[3].push_back(x[1][si[2*i+1]]);
+        parea.push_back(area[i]);
+      }
+    }
+    for (size_t d=0; d<Dimensions; ++d) pvel[d].assign(parea.size(), 0.0);
+
+    LOG_DEBUG("  Solving for velocities on " << parea.size() << " panels of " << _bdry.size() << " collections");
+    for (auto &src : _vort) {
+      if (std::holds_alternative<Points<S>>(src)) {
+        points_affect_panel_list<S,A>(std::get<Points<S>>(src), pends, parea, pvel, ivisitor.env);
+      }
+    }
+  }
 
   // loop over boundary collections
-  for (auto &targ : _bdry) {
-    std::cout << "  Solving for velocities on" << to_string(targ) << std::endl;
+  for (size_t ic=0; ic<_bdry.size(); ++ic) {
+    Collection& targ = _bdry[ic];
+    LOG_DEBUG("  Solving for velocities on" << to_string(targ));
+
+    if (fuse_panels) {
+      // this collection's share of the particles' velocities, then the other sources
+      Surfaces<S>& surf = std::get<Surfaces<S>>(targ);
+      std::array<Vector<S>,Dimensions>& vel = surf.get_vel();
+      for (size_t d=0; d<Dimensions; ++d) {
+        std::copy(pvel[d].begin() + first_panel[ic], pvel[d].begin() + first_panel[ic] + surf.get_npanels(),
+                  vel[d].begin());
+      }
+      for (auto &src : _vort) {
+        if (not std::holds_alternative<Points<S>>(src)) std::visit(ivisitor, src, targ);
+      }
 
-    // transform the collection according to prescribed motion
-    std::visit([=](auto& elem) { elem.transform(_time); }, targ);
+    } else {
+      // transform the collection according to prescribed motion
+      std::visit([=](auto& elem) { elem.transform(_time); }, targ);
 
-    // zero velocities
-    std::visit([=](auto& elem) { elem.zero_vels(); }, targ);
+      // zero velocities
+      std::visit([=](auto& elem) { elem.zero_vels(); }, targ);
 
-    // accumulate from vorticity
-    for (auto &src : _vort) {
-      std::visit(ivisitor, src, targ);
+      // accumulate from vorticity
+      for (auto &src : _vort) {
+        std::visit(ivisitor, src, targ);
+      }
     }
 
     // divide by factor and add freestream
@@ -115,10 +341,10 @@ void solve_bem(const double                         _time,
       const S absorbed_circ = surf.get_reabsorbed();
 
       // combine and append
-      std::cout << "    components of rhs: " << self_circ << " " << absorbed_circ << " " << last_error << std::endl;
+      LOG_DEBUG("    components of rhs: " << self_circ << " " << absorbed_circ << " " << last_error);
       const S tot_circ = self_circ + absorbed_circ + last_error;
       rhs.push_back(tot_circ);
-      std::cout << "    augmenting rhs with tot_circ= " << tot_circ << std::endl;
+      LOG_DEBUG("    augmenting rhs with tot_circ= " << tot_circ);
     }
 
     // finally, send it to the BEM
@@ -144,19 +370,21 @@ void solve_bem(const double                         _time,
   } else {
     // if this is the first call after a reset, we need to rebuild everything
     rebuild_every_block = true;
-    std::cout << "  Solving for BEM matrix" << std::endl;
+    LOG_DEBUG("  Solving for BEM matrix");
   }
 
   // actually make or remake the A matrix
   if (rebuild_every_block or rebuild_some_blocks) {
+    PROFILE_ZONE("assemble");
 
-    auto start = std::chrono::system_clock::now();
-
-    // need this to inform bem that we need to re-init the solver
-    _bem.panels_changed();
+    // need this to inform bem that we need to re-init the solver, but only if a block changes
+    bool any_block_changed = false;
+    size_t resumed_solves = rebuild_every_block ? _bem.take_resumed_solves() : 0;
+    size_t num_blocks = 0;
+    size_t num_rebuilt = 0;
 
     // this is the dispatcher for Points/Surfaces on Points/Surfaces
-    CoefficientVisitor cvisitor;
+    CoefficientVisitor cvisitor = {ivisitor.env};
 
     // loop over boundary collections
     for (auto &targ : _bdry) {
@@ -172,17 +400,36 @@ void solve_bem(const double                         _time,
         // should we build/rebuild this block of the A matrix?
         bool rebuild_this_block = rebuild_every_block;
         if (rebuild_some_blocks) {
-          // test for relative motion between these two blocks (translation only for now)
+          // test for a change in relative pose between these two blocks, self-blocks never
+          //   change, and a collection without a body is fixed to the ground
+          std::shared_ptr<Body> tb = std::visit([=](auto& elem) { return elem.get_body_ptr(); }, targ);
+          std::shared_ptr<Body> sb = std::visit([=](auto& elem) { return elem.get_body_ptr(); }, src);
+          if (tb) rebuild_this_block = tb->relative_motion_vs(sb, last_time, _time);
+          else if (sb) rebuild_this_block = sb->relative_motion_vs(tb, last_time, _time);
+        }
+        // the A from before a restart only counts if none of its blocks would have changed
+        if (resumed_solves > 0 and last_time != _time) {
           std::shared_ptr<Body> tb = std::visit([=](auto& elem) { return elem.get_body_ptr(); }, targ);
           std::shared_ptr<Body> sb = std::visit([=](auto& elem) { return elem.get_body_ptr(); }, src);
-          if (tb and sb) rebuild_this_block = tb->relative_motion_vs(sb, last_time, _time);
+          if ((tb and tb->relative_motion_vs(sb, last_time, _time)) or
+              (not tb and sb and sb->relative_motion_vs(tb, last_time, _time))) resumed_solves = 0;
         }
+        ++num_blocks;
 
         if (rebuild_this_block) {
+          ++num_rebuilt;
+          if (not any_block_changed) {
+            _bem.panels_changed();
+            any_block_changed = true;
+          }
+
+          // the operator or H-matrix is rebuilt as a whole below
+          if (skip_assembly) continue;
+
           // find portion of influence matrix
           const size_t sstart = std::visit([=](auto& elem) { return elem.get_first_row(); }, src);
           const size_t snum = std::visit([=](auto& elem) { return elem.get_num_rows(); }, src);
-          std::cout << "  Computing A matrix block [" << tstart << ":" << (tstart+tnum) << "] x [" << sstart << ":" << (sstart+snum) << "]" << std::endl;
+          LOG_DEBUG("  Computing A matrix block [" << tstart << ":" << (tstart+tnum) << "] x [" << sstart << ":" << (sstart+snum) << "]");
 
           // for augmentation, find the induced velocity from the source on the target
           if (std::visit([=](auto& elem) { return elem.is_augmented(); }, src)) {
@@ -203,17 +450,48 @@ void solve_bem(const double                         _time,
       }
     }
 
+    // the trees take far less time to build than the dense blocks, so make them all again
+    if (backend == matrix_free and any_block_changed) {
+      LOG_DEBUG("  Building matrix-free BEM operator for " << nrows << " unknowns");
+      auto op = std::make_shared<BEMOperator<S,A>>(_bdry, ExecEnv(true, fmm, cpu_x86));
+      _bem.set_operator([op](const Eigen::Matrix<S, Eigen::Dynamic, 1>& _x,
+                             Eigen::Matrix<S, Eigen::Dynamic, 1>& _y) { (*op)(_x, _y); },
+                        nullptr, matrix_free);
+    }
+
+    // the compressed matrix is only worth its setup for geometries which rarely change
+    if (backend == hmatrix and any_block_changed) {
+      LOG_DEBUG("  Building BEM H-matrix for " << nrows << " unknowns");
+      auto hm = make_bem_hmatrix<S,A>(_bdry, ivisitor, _bem.get_hmatrix_tolerance());
+      LOG_INFO("    H-matrix uses " << 100.0*hm->get_h().get_compression() << "% of dense storage, max rank "
+               << hm->get_h().get_max_rank());
+      typename BEM<S,I>::Operator hsolve = nullptr;
+      if (_bem.use_hmatrix_direct()) {
+        hm->factor();
+        hsolve = [hm](const Eigen::Matrix<S, Eigen::Dynamic, 1>& _b,
+                      Eigen::Matrix<S, Eigen::Dynamic, 1>& _x) { hm->solve(_b, _x); };
+      }
+      _bem.set_operator([hm](const Eigen::Matrix<S, Eigen::Dynamic, 1>& _x,
+                             Eigen::Matrix<S, Eigen::Dynamic, 1>& _y) { hm->multiply(_x, _y); },
+                        hsolve, hmatrix, hm->get_mem_bytes());
+    }
+
     _bem.just_made_A();
+    if (resumed_solves > 0) _bem.resume_solves(resumed_solves);
 
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end-start;
-    printf("    make A matrix:\t[%.4f] cpu seconds\n", (float)elapsed_seconds.count());
+    if (any_block_changed) {
+      LOG_DEBUG("    made A " << ((backend == dense_matrix) ? "matrix" :
+                                   ((backend == hmatrix) ? "H-matrix" : "operator")));
+    }
+    if (rebuild_some_blocks) {
+      LOG_INFO("  Rebuilt " << num_rebuilt << " of " << num_blocks << " A matrix blocks");
+    }
   }
 
   //
   // solve here
   //
-  std::cout << "  Solving BEM for strengths" << std::endl;
+  LOG_DEBUG("  Solving BEM for strengths");
   _bem.solve();
   //
   //
@@ -226,21 +504,21 @@ void solve_bem(const double                         _time,
     const size_t tnum = std::visit([=](auto& elem) { return elem.get_num_rows(); }, targ);
 
     // get that chunk
-    Vector<S> new_s = _bem.get_str(tstart, tnum);
+    const Vector<S> new_s = _bem.get_str(tstart, tnum);
 
     // debug print
     if (false) {
-      std::cout << "  Solution vector contains" << std::endl;
+      LOG_DEBUG("  Solution vector contains");
       for (size_t i=tstart; i<tstart+tnum; ++i) {
         std::cout << "    " << i << " \t" << new_s[i-tstart] << std::endl;
       }
     }
 
     // send it to the elements, including the augmented entry
-    std::visit([=](auto& elem) { elem.set_str(tstart, new_s.size(), new_s);  }, targ);
+    std::visit([&](auto& elem) { elem.set_str(tstart, new_s.size(), new_s);  }, targ);
   }
 
-  // save the simulation time to compare to the next call
-  last_time = _time;
+  // save the state to compare to the next call, the boundaries now hold their new strengths
+  _bem.set_inputs(_time, _fs, bem_input_gens(_vort, _bdry));
 }
 
@@ -0,0 +1,185 @@
+/*
+ * BEMOperator.h - Apply the BEM influence matrix without ever forming it
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Collection.h"
+#include "ExecEnv.h"
+#include "Fmm.h"
+
+#include <Eigen/Dense>
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <utility>
+#include <cmath>
+#include <cassert>
+
+
+//
+// The influence of one boundary collection on another, kept as an FMM whose trees and
+//   interaction lists survive from one product to the next; only the expansions change
+//
+// augmented bodies add their rotation rate as an unknown: its column is the influence of
+//   the unit-rotation strengths, and its row is the circulation, as in panels_on_panels_coeff
+//
+template <class S, class A>
+struct BEMOperatorBlock {
+  BEMOperatorBlock(Surfaces<S>& _src, const Surfaces<S>& _targ, const ExecEnv& _env)
+    : fmm(_env.get_expansion_order(), _env.get_leaf_size(), _env.get_velocity_core()),
+      sstart(_src.get_first_row()),
+      nsrc(_src.get_npanels()),
+      sunk(_src.num_unknowns_per_panel()),
+      tstart(_targ.get_first_row()),
+      ntarg(_targ.get_npanels()),
+      tunk(_targ.num_unknowns_per_panel()),
+      self(&_src == &_targ),
+      saug(_src.is_augmented()),
+      taug(_targ.is_augmented()) {
+
+    // the targets are the collocation points, the panel centers
+    const std::array<Vector<S>,Dimensions>& tx = _targ.get_pos();
+    const std::vector<Int>&                 ti = _targ.get_idx();
+    std::array<Vector<S>,Dimensions> tc;
+    for (size_t d=0; d<Dimensions; ++d) {
+      tc[d].resize(ntarg);
+      tt[d] = _targ.get_tang()[d];
+      tn[d] = _targ.get_norm()[d];
+      vel[d].resize(ntarg);
+    }
+    for (size_t i=0; i<ntarg; ++i) {
+      tc[0][i] = 0.5 * (tx[0][ti[2*i]] + tx[0][ti[2*i+1]]);
+      tc[1][i] = 0.5 * (tx[1][ti[2*i]] + tx[1][ti[2*i+1]]);
+    }
+
+    fmm.set_sources(_src);
+    fmm.set_targets(tc);
+    fmm.set_skip_self(self);
+    fmm.compute(_env.get_opening_angle());
+
+    vs.resize(nsrc);
+    ss.resize(sunk == 2 ? nsrc : 0);
+
+    // this block's extra column, from strengths which reproduce a unit rotation of the source,
+    //   found just off of each target panel like in panels_affect_panels
+    if (saug) {
+      _src.zero_strengths();
+      _src.add_unit_rot_strengths();
+      const S offset = 0.0001;
+      std::array<Vector<S>,Dimensions> toff = tc;
+      for (size_t i=0; i<ntarg; ++i) {
+        toff[0][i] += offset * tn[0][i];
+        toff[1][i] += offset * tn[1][i];
+      }
+      for (size_t d=0; d<Dimensions; ++d) std::fill(vel[d].begin(), vel[d].end(), 0.0);
+      Fmm<S,A> rotfmm(_env.get_expansion_order(), _env.get_leaf_size(), _env.get_velocity_core());
+      rotfmm.set_sources(std::as_const(_src));
+      rotfmm.set_targets(toff);
+      rotfmm.compute(_env.get_opening_angle());
+      rotfmm.add_vels(vel);
+
+      const S fac = 1.0 / (2.0 * M_PI);
+      augcol.resize(ntarg*tunk);
+      for (size_t i=0; i<ntarg; ++i) {
+        augcol[tunk*i] = fac * (vel[0][i]*tt[0][i] + vel[1][i]*tt[1][i]);
+        if (tunk == 2) augcol[2*i+1] = fac * (vel[0][i]*tn[0][i] + vel[1][i]*tn[1][i]);
+      }
+      _src.zero_strengths();
+    }
+
+    // and its extra row, the circulation
+    if (self and taug) {
+      area = _src.get_area();
+      circ = 2.0 * _src.get_vol();
+    }
+  }
+
+  // accumulate this block's rows of y = A x
+  void apply(const Eigen::Matrix<S, Eigen::Dynamic, 1>& _x, Eigen::Matrix<S, Eigen::Dynamic, 1>& _y) {
+    for (size_t j=0; j<nsrc; ++j) vs[j] = _x[sstart + sunk*j];
+    if (sunk == 2) {
+      for (size_t j=0; j<nsrc; ++j) ss[j] = _x[sstart + 2*j + 1];
+    }
+    fmm.update_strengths(vs, ss);
+
+    for (size_t d=0; d<Dimensions; ++d) std::fill(vel[d].begin(), vel[d].end(), 0.0);
+    fmm.add_vels(vel);
+
+    // same scaling and row layout as panels_on_panels_coeff
+    const S fac = 1.0 / (2.0 * M_PI);
+    for (size_t i=0; i<ntarg; ++i) {
+      _y[tstart + tunk*i] += fac * (vel[0][i]*tt[0][i] + vel[1][i]*tt[1][i]);
+      if (tunk == 2) _y[tstart + 2*i + 1] += fac * (vel[0][i]*tn[0][i] + vel[1][i]*tn[1][i]);
+    }
+
+    // the fmm skipped each panel on itself, its coefficient is pi before scaling
+    if (self) {
+      for (size_t i=0; i<ntarg*tunk; ++i) _y[tstart+i] += 0.5 * _x[sstart+i];
+    }
+
+    if (saug) {
+      const S omega = _x[sstart + nsrc*sunk];
+      for (size_t i=0; i<ntarg*tunk; ++i) _y[tstart+i] += omega * augcol[i];
+    }
+
+    // the body's circulation, the vortex strengths times the panel lengths
+    if (self and taug) {
+      S sum = circ * _x[sstart + nsrc*sunk];
+      for (size_t j=0; j<nsrc; ++j) sum += area[j] * _x[sstart + sunk*j];
+      _y[tstart + ntarg*tunk] += sum;
+    }
+  }
+
+  Fmm<S,A> fmm;
+  size_t sstart, nsrc, sunk;
+  size_t tstart, ntarg, tunk;
+  bool self, saug, taug;
+  std::array<Vector<S>,Dimensions> tt, tn, vel;
+  Vector<S> vs, ss;
+  Vector<S> augcol, area;
+  S circ = 0.0;
+};
+
+
+//
+// All of the blocks, this is the matrix-vector product for the iterative solver
+//
+template <class S, class A>
+class BEMOperator {
+public:
+  BEMOperator(std::vector<Collection>& _bdry, const ExecEnv& _env) : nrows(0) {
+    for (auto &targ : _bdry) {
+      Surfaces<S>& tsurf = std::get<Surfaces<S>>(targ);
+      nrows = std::max(nrows, (size_t)tsurf.get_next_row());
+      for (auto &src : _bdry) {
+        blocks.emplace_back(std::get<Surfaces<S>>(src), tsurf, _env);
+      }
+    }
+  }
+
+  // only panels can be handled this way, reactive points need the full matrix
+  static bool supports(const std::vector<Collection>& _bdry) {
+    for (auto &coll : _bdry) {
+      if (not std::holds_alternative<Surfaces<S>>(coll)) return false;
+    }
+    return true;
+  }
+
+  void operator() (const Eigen::Matrix<S, Eigen::Dynamic, 1>& _x, Eigen::Matrix<S, Eigen::Dynamic, 1>& _y) {
+    assert((size_t)_x.size() == nrows && "Operator input size does not match");
+    _y.setZero(nrows);
+    for (auto &blk : blocks) blk.apply(_x, _y);
+  }
+
+private:
+  size_t nrows;
+  std::vector<BEMOperatorBlock<S,A>> blocks;
+};
+
@@ -8,6 +8,7 @@
 #include "Body.h"
 
 #include <cassert>
+#include <algorithm>
 #include <iostream>
 
 //
@@ -39,6 +40,7 @@ Body::Body(const double _x, const double _y) :
 Body::~Body() {
   // free the internal memory used by tinyexpr
   for (size_t i=0; i<pos_func.size(); ++i) te_free(pos_func[i]);
+  te_free(apos_func);
 }
 
 
@@ -67,6 +69,8 @@ Body::to_json() const {
     j["rotation"] = apos;
   }
 
+  if (coupling and not coupling->to_json().is_null()) j["coupling"] = coupling->to_json();
+
   return j;
 }
 
@@ -80,6 +84,7 @@ std::string Body::get_name() { return name; }
 void Body::set_pos(const size_t _i, const double _val) {
   assert(_i>=0 and _i<Dimensions && "Invalid index into array");
   pos[_i] = _val;
+  forget_motion();
 }
 
 void Body::set_pos(const size_t _i, const std::string _val) {
@@ -88,7 +93,10 @@ void Body::set_pos(const size_t _i, const std::string _val) {
   pos_expr[_i] = _val;
   // compile it
   int ierr = 0;
+  te_free(pos_func[_i]);
   pos_func[_i] = te_compile(_val.c_str(), func_vars.data(), 1, &ierr);
+  pos_prog[_i] = MotionExpr(pos_func[_i], &this_time);
+  forget_motion();
   if (pos_func[_i]) {
     std::cout << "  read expression (" << pos_expr[_i] << ")" << std::endl;
     this_time = 0.0;
@@ -104,6 +112,7 @@ void Body::set_pos(const size_t _i, const std::string _val) {
 
 void Body::set_rot(const double _val) {
   apos = _val;
+  forget_motion();
 }
 
 void Body::set_rot(const std::string _val) {
@@ -111,7 +120,10 @@ void Body::set_rot(const std::string _val) {
   apos_expr = _val;
   // compile it
   int ierr = 0;
+  te_free(apos_func);
   apos_func = te_compile(_val.c_str(), func_vars.data(), 1, &ierr);
+  apos_prog = MotionExpr(apos_func, &this_time);
+  forget_motion();
   if (apos_func) {
     std::cout << "  read expression (" << apos_expr << ")" << std::endl;
     this_time = 0.0;
@@ -125,57 +137,98 @@ void Body::set_rot(const std::string _val) {
   }
 }
 
-void Body::transform(const double _time) {
+void Body::set_coupling(std::shared_ptr<BodyCoupling> _coupling) {
+  {
+    std::lock_guard<std::mutex> lock(motion_mtx);
+    coupling = _coupling;
+    nsamples = 0;
+  }
+  forget_motion();
+}
 
-  // evaluate all expressions at this time
-  const double dt = 1.e-5;
+// read the structure's latest motion, at the start of a step
+void Body::pull_motion(const double _time) {
+  if (not coupling) return;
+  BodySample s;
+  if (not coupling->read_motion(_time, s)) return;
+  {
+    std::lock_guard<std::mutex> lock(motion_mtx);
+    if (nsamples > 0 and s.time == cur_sample.time) return;
+    last_sample = cur_sample;
+    cur_sample = s;
+    nsamples = std::min(nsamples + 1, (size_t)2);
+  }
+  forget_motion();
+}
 
-  for (size_t i=0; i<Dimensions; ++i) {
-    if (pos_func[i]) {
-      this_time = _time;
-      pos[i] = te_eval(pos_func[i]);
-
-      this_time = _time + dt;
-      const double pplus = te_eval(pos_func[i]);
-      this_time = _time - dt;
-      const double pminus = te_eval(pos_func[i]);
-      vel[i] = (pplus - pminus) / (2.0*dt);
-    }
+// and give it the load, at the end
+void Body::push_load(const double _time, const Vec& _force) {
+  if (coupling) coupling->write_load(_time, _force);
+}
+
+//
+// Position, orientation, and their rates at one time, from the kept answers if this time was
+//   asked for before
+//
+Body::Motion Body::motion_at(const double _time) {
+  std::lock_guard<std::mutex> lock(motion_mtx);
+
+  for (size_t i=0; i<nmotions; ++i) {
+    if (motions[i].time == _time) return motions[i];
   }
 
-  if (apos_func) {
-    this_time = _time;
-    apos = te_eval(apos_func);
-    apos = std::remainder(apos, 2.0*M_PI);
-
-    this_time = _time + dt;
-    const double pplus = te_eval(apos_func);
-    this_time = _time - dt;
-    const double pminus = te_eval(apos_func);
-    // 2-point first derivative estimate
-    avel = (pplus - pminus) / (2.0*dt);
+  // constant parts keep what was set
+  Motion m = {_time, pos, vel, apos, avel};
+  if (nsamples > 0) {
+    const BodySample& s = (nsamples > 1 and _time < cur_sample.time) ? last_sample : cur_sample;
+    const double dt = _time - s.time;
+    for (size_t i=0; i<Dimensions; ++i) {
+      m.pos[i] = s.pos[i] + dt*s.vel[i];
+      m.vel[i] = s.vel[i];
+    }
+    m.apos = std::remainder(s.apos + dt*s.avel, 2.0*M_PI);
+    m.avel = s.avel;
+
+  } else {
+    for (size_t i=0; i<Dimensions; ++i) {
+      if (not pos_prog[i].empty()) {
+        const std::array<double,2> p = pos_prog[i].eval(_time);
+        m.pos[i] = p[0];
+        m.vel[i] = p[1];
+      }
+    }
+    if (not apos_prog.empty()) {
+      const std::array<double,2> p = apos_prog.eval(_time);
+      m.apos = std::remainder(p[0], 2.0*M_PI);
+      m.avel = p[1];
+    }
   }
+
+  motions[next_motion] = m;
+  next_motion = (next_motion + 1) % max_motions;
+  nmotions = std::min(nmotions + 1, max_motions);
+  return m;
+}
+
+void Body::forget_motion() {
+  std::lock_guard<std::mutex> lock(motion_mtx);
+  nmotions = 0;
+  next_motion = 0;
+}
+
+void Body::transform(const double _time) {
+  const Motion m = motion_at(_time);
+  pos = m.pos;
+  vel = m.vel;
+  apos = m.apos;
+  avel = m.avel;
 }
 
 Vec Body::get_pos() {
   return pos;
 }
 Vec Body::get_pos(const double _time) {
-  // for testing, return a loop
-  //pos[0] = 0.5 * sin(2.0*_time);
-  //pos[1] = 0.5 * (1.0-cos(2.0*_time));
-
-  // for realsies, get the value or evaluate the expression
-  this_time = _time;
-  //std::cout << "  MOVING BODY (" << get_name() << ") at time " << _time << std::endl;
-  for (size_t i=0; i<Dimensions; ++i) {
-    if (pos_func[i]) {
-      pos[i] = te_eval(pos_func[i]);
-      //std::cout << "IDEAL POS " << (0.5 * (1.0-cos(2.0*_time))) << "  AND ACTUAL " << pos[i] << std::endl;
-      //std::cout << "  MOVED BODY pos[" << i << "] to " << pos[i] << std::endl;
-    }
-  }
-
+  pos = motion_at(_time).pos;
   return pos;
 }
 
@@ -183,24 +236,7 @@ Vec Body::get_vel() {
   return vel;
 }
 Vec Body::get_vel(const double _time) {
-  // for testing, return a loop
-  //vel[0] = cos(2.0*_time);
-  //vel[1] = 0.5 * 2.0*sin(2.0*_time);
-
-  // 2-point first derivative estimate
-  const double dt = 1.e-5;
-  for (size_t i=0; i<Dimensions; ++i) {
-    if (pos_func[i]) {
-      this_time = _time + dt;
-      const double pplus = te_eval(pos_func[i]);
-      this_time = _time - dt;
-      const double pminus = te_eval(pos_func[i]);
-      vel[i] = (pplus - pminus) / (2.0*dt);
-      //std::cout << "      VEL " << (0.5 * 2.0*sin(2.0*_time)) << "  AND ACTUAL " << vel[i] << std::endl;
-      //std::cout << "        used " << pplus << " and " << pminus << std::endl;
-    }
-  }
-
+  vel = motion_at(_time).vel;
   return vel;
 }
 
@@ -208,15 +244,7 @@ double Body::get_orient() {
   return apos;
 }
 double Body::get_orient(const double _time) {
-  // for realsies, get the value or evaluate the expression
-  this_time = _time;
-  //std::cout << "  ROTATING BODY (" << get_name() << ") at time " << _time << std::endl;
-  if (apos_func) {
-    apos = te_eval(apos_func);
-    apos = std::remainder(apos, 2.0*M_PI);
-    //std::cout << "  ROTATED BODY apos to " << apos << std::endl;
-  }
-
+  apos = motion_at(_time).apos;
   return apos;
 }
 
@@ -224,45 +252,37 @@ double Body::get_rotvel() {
   return avel;
 }
 double Body::get_rotvel(const double _time) {
-
-  // 2-point first derivative estimate
-  const double dt = 1.e-5;
-  if (apos_func) {
-    this_time = _time + dt;
-    const double pplus = te_eval(apos_func);
-    this_time = _time - dt;
-    const double pminus = te_eval(apos_func);
-    avel = (pplus - pminus) / (2.0*dt);
-  }
-
+  avel = motion_at(_time).avel;
   return avel;
 }
 
 // compare motion vs another Body
 bool Body::relative_motion_vs(std::shared_ptr<Body> _other, const double _last, const double _current) {
-  bool motion = false;
 
-  const Vec this_old_pos = get_pos(_last);
-  const Vec other_old_pos = _other->get_pos(_last);
-  const Vec this_new_pos = get_pos(_current);
-  const Vec other_new_pos = _other->get_pos(_current);
+  // the pose of this body in the frame of the other (or of the ground, if there is no other)
+  auto relative_pose = [&](const double _time) {
+    const Vec this_pos = get_pos(_time);
+    const double this_theta = get_orient(_time);
+    const Vec other_pos = _other ? _other->get_pos(_time) : Vec({0.0, 0.0});
+    const double other_theta = _other ? _other->get_orient(_time) : 0.0;
+    const double dx = this_pos[0] - other_pos[0];
+    const double dy = this_pos[1] - other_pos[1];
+    const double ct = std::cos(other_theta);
+    const double st = std::sin(other_theta);
+    return std::array<double,3>({ct*dx + st*dy, -st*dx + ct*dy, this_theta - other_theta});
+  };
+
+  // two bodies turning together about separate centers have moved relative to each other,
+  //   even though their positions and orientations change by the same amounts
+  const std::array<double,3> old_pose = relative_pose(_last);
+  const std::array<double,3> new_pose = relative_pose(_current);
 
+  bool motion = false;
   for (size_t i=0; i<Dimensions; ++i) {
-    const double relative = this_new_pos[i] - this_old_pos[i] - other_new_pos[i] + other_old_pos[i];
-    if (std::abs(relative) > 4.0*std::numeric_limits<double>::epsilon()) motion = true;
+    const double tol = 4.0*std::numeric_limits<double>::epsilon() * (1.0 + std::abs(old_pose[i]));
+    if (std::abs(new_pose[i] - old_pose[i]) > tol) motion = true;
   }
-
-  // how do we account for rotation?
-
-  // the correct way - compute the true relative motion between the two objects
-  // the hack-y way - just compare positions and orientations separately <- do this one for now
-
-  const double this_old_theta = get_orient(_last);
-  const double other_old_theta = _other->get_orient(_last);
-  const double this_new_theta = get_orient(_current);
-  const double other_new_theta = _other->get_orient(_current);
-  const double relative = this_new_theta - this_old_theta - other_new_theta + other_old_theta;
-  if (std::abs(relative) > 4.0*std::numeric_limits<double>::epsilon()) motion = true;
+  if (std::abs(std::remainder(new_pose[2] - old_pose[2], 2.0*M_PI)) > 4.0*std::numeric_limits<double>::epsilon()) motion = true;
 
   //std::cout << "  relative_motion_vs " << this << " " << _other << " returns " << motion << std::endl;
 
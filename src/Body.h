@@ -8,6 +8,8 @@
 #pragma once
 
 #include "Omega2D.h"
+#include "MotionExpr.h"
+#include "Coupling.h"
 
 #define TE_NAT_LOG
 #include <tinyexpr/tinyexpr.h>
@@ -17,8 +19,8 @@
 #include <memory>
 #include <cmath>
 #include <array>
-
-using Vec = std::array<double,Dimensions>;
+#include <vector>
+#include <mutex>
 
 //------------------------------------------------------------------------
 //
@@ -50,6 +52,12 @@ public:
   void set_rot(const double);
   void set_rot(const std::string);
 
+  // take the motion from an external solver instead, see Coupling.h
+  void set_coupling(std::shared_ptr<BodyCoupling>);
+  bool is_coupled() const { return (bool)coupling; }
+  void pull_motion(const double);
+  void push_load(const double, const Vec&);
+
   // return positional, orientation, or other data
   std::string get_name();
   void transform(const double);
@@ -80,6 +88,33 @@ private:
   std::vector<te_expr*> pos_func;
   te_expr* apos_func;
 
+  // the same expressions, flattened to give values and rates in one pass
+  std::array<MotionExpr,Dimensions> pos_prog;
+  MotionExpr apos_prog;
+
+  // a coupled body moves at the rates of its latest sample, or of the one before for
+  //   times before that, so a sudden change still shows as motion over the step
+  std::shared_ptr<BodyCoupling> coupling;
+  BodySample cur_sample, last_sample;
+  size_t nsamples = 0;
+
+  // every collection on this body asks for its motion at each stage time, and the answers
+  //   never change, so the last few are kept
+  struct Motion {
+    double time;
+    Vec pos;
+    Vec vel;
+    double apos;
+    double avel;
+  };
+  Motion motion_at(const double);
+  void forget_motion();
+  static constexpr size_t max_motions = 8;
+  std::array<Motion,max_motions> motions;
+  size_t nmotions = 0;
+  size_t next_motion = 0;
+  std::mutex motion_mtx;
+
   // 2D position and velocity (initial, or constant)
   Vec pos;
   Vec vel;
@@ -11,7 +11,7 @@
 #include "imgui/imgui.h"
 #include "imgui/imgui_stdlib.h"
 #include "Simulation.h"
-#include "read_MSH_Mesh.h"
+#include "MshCache.h"
 
 #define __STDCPP_WANT_MATH_SPEC_FUNCS__ 1
 #include <cassert>
@@ -1349,13 +1349,13 @@ void SolidAirfoil::generate_draw_geom() {
 ElementPacket<float>
 FromMsh::init_elements(const float _ips) const {
 
-  // read gmsh file
-  ReadMsh::Mesh mesh;
+  // read gmsh file, or what was parsed from it before
   std::cout << "Reading gmsh mesh file (" << m_infile << ")";
-  int32_t retval = mesh.read_msh_file(m_infile.c_str());
-  if (retval == 1) {
-    std::cout << " contains " << mesh.get_nnodes() << " nodes";
-    std::cout << " and " << mesh.get_nelems() << " elems" << std::endl;
+  int32_t retval = 1;
+  const std::shared_ptr<const MshData> mesh = MshCache::read(m_infile, m_cachedir, retval);
+  if (mesh) {
+    std::cout << " contains " << mesh->get_nnodes() << " nodes";
+    std::cout << " and " << mesh->nelems << " elems" << std::endl;
   } else {
     std::cout << " does not exist or did not read properly (code=";
     std::cout << retval << "), skipping." << std::endl;
@@ -1368,60 +1368,48 @@ FromMsh::init_elements(const float _ips) const {
   std::vector<float> vals;
 
   // get the boundary corresponding to the wall
-  const ReadMsh::boundary wall = mesh.get_bdry("wall");
-  if (wall.N_edges == 0) {
+  const size_t np = mesh->wall_starts.size() - 1;
+  if (np == 0) {
     std::cout << "  no boundary called 'wall' in this msh file, skipping." << std::endl;
     return ElementPacket<float>();
   }
 
-  // read *all* the nodes in
-  const std::vector<ReadMsh::node>& nodes = mesh.get_nodes();
-  for (auto& thisnode : nodes) {
-    const ReadMsh::Cmpnts2& thispos = thisnode.coor;
-    x.push_back(thispos.x);
-    x.push_back(thispos.y);
-  }
-
-  // get a reference to the complete edge list
-  const std::vector<ReadMsh::edge>& edges = mesh.get_edges();
-
   // find out how large each array will be
-  const size_t np = wall.N_edges;
   std::cout << "  wall has " << np << " edges" << std::endl;
-  for (uint32_t thisedge : wall.edges) {
-    //std::cout << "  edge " << thisedge << " has " << edges[thisedge].N_nodes << " nodes" << std::endl;
+  idx.reserve(2*np);
+  for (size_t e=0; e<np; ++e) {
+    const Int* nodes = mesh->wall.data() + mesh->wall_starts[e];
     // 1st and 2nd nodes are the end nodes, regardless of how many nodes there are on this edge
-    assert(edges[thisedge].N_nodes > 1 && "Edge does not have enough nodes!");
+    assert(mesh->wall_starts[e+1] - mesh->wall_starts[e] > 1 && "Edge does not have enough nodes!");
     // HACK - annular gmsh meshes have wall defined CCW (right wall is to fluid), not CW (left wall is)
-    idx.push_back(edges[thisedge].nodes[1]);
-    idx.push_back(edges[thisedge].nodes[0]);
+    idx.push_back(nodes[1]);
+    idx.push_back(nodes[0]);
     // TODO: check edge element length vs. _ips and subsample if necessary
   }
 
   // compress the nodes vector to remove unused, adjust idx pointers
 
-  std::vector<int32_t> newidx(nodes.size());
+  std::vector<int32_t> newidx(mesh->get_nnodes());
   // -1 means that this node is not used
   std::fill(newidx.begin(), newidx.end(), -1);
   // flag all nodes that are used
   for (auto& thisidx : idx) newidx[thisidx] = thisidx;
-  // compress the x vector first
+  // copy only the used nodes
   size_t nnodesused = 0;
   for (size_t i=0; i<newidx.size(); ++i) {
     if (newidx[i] == -1) {
       // this node is not used in the wall boundary
     } else {
       // this node *is* used
-      // move it backwards AND translate it
-      x[2*nnodesused]   = x[2*i]   + m_x;
-      x[2*nnodesused+1] = x[2*i+1] + m_y;
+      // copy it AND translate it
+      x.push_back(mesh->x[2*i]   + m_x);
+      x.push_back(mesh->x[2*i+1] + m_y);
       // and tell the index where it moved to
       newidx[i] = nnodesused;
       // increment the counter
       nnodesused++;
     }
   }
-  x.resize(2*nnodesused);
   // reset indices to indicate their new position in the compressed array
   for (auto& thisidx : idx) thisidx = newidx[thisidx];
 
@@ -1450,13 +1438,13 @@ FromMsh::init_hybrid(const float _ips) const {
   //   last is the open Surfaces (1D) elements
   std::vector<ElementPacket<float>> pack;
 
-  // read gmsh file
-  ReadMsh::Mesh mesh;
+  // read gmsh file, or what was parsed from it before
   std::cout << "Reading gmsh mesh file (" << m_infile << ")";
-  int32_t retval = mesh.read_msh_file(m_infile.c_str());
-  if (retval == 1) {
-    std::cout << " contains " << mesh.get_nnodes() << " nodes";
-    std::cout << " and " << mesh.get_nelems() << " elems" << std::endl;
+  int32_t retval = 1;
+  const std::shared_ptr<const MshData> mesh = MshCache::read(m_infile, m_cachedir, retval);
+  if (mesh) {
+    std::cout << " contains " << mesh->get_nnodes() << " nodes";
+    std::cout << " and " << mesh->nelems << " elems" << std::endl;
   } else {
     std::cout << " does not exist or did not read properly (code=";
     std::cout << retval << "), skipping." << std::endl;
@@ -1464,134 +1452,84 @@ FromMsh::init_hybrid(const float _ips) const {
   }
 
   // prepare the data arrays for the element packet
-  std::vector<float> x;
-  std::vector<Int> idx;
   std::vector<float> vals;
 
-  // read *all* the nodes in
-  const std::vector<ReadMsh::node>& nodes = mesh.get_nodes();
-  for (auto& thisnode : nodes) {
-    const ReadMsh::Cmpnts2& thispos = thisnode.coor;
-    x.push_back(thispos.x);
-    x.push_back(thispos.y);
-  }
-  const Int nn = x.size() / 2;
-  std::cout << "  read in " << nn << " nodes" << std::endl;
+  // *all* the nodes go into every packet
+  const std::vector<float>& x = mesh->x;
+  std::cout << "  read in " << mesh->get_nnodes() << " nodes" << std::endl;
 
   //
   // first EP is the volume elements
   //
   std::cout << "Generate Grid Cells" << std::endl;
 
-  // get a reference to the complete edge list
-  const std::vector<ReadMsh::element2d>& elems = mesh.get_elems();
-
-  // find out how large each array will be
-  const size_t ne = elems.size();
+  // using VTK/GMSH node ordering! CCW corners, then CCW side nodes, then middle
+  const size_t ne = (mesh->nnpe > 0) ? mesh->elems.size() / mesh->nnpe : 0;
   std::cout << "  volume has " << ne << " elems" << std::endl;
-  // number of nodes per element - must be constant!
-  size_t nnpe = 0;
-  size_t ec = 0;
-  for (auto& thiselem : elems) {
-    //std::cout << "  elem " << ec << " with " << thiselem.N_nodes << " nodes: ";
-    if (nnpe == 0) nnpe = thiselem.N_nodes;
-    assert(nnpe == thiselem.N_nodes && "ReadMsh does not support different element types!");
-
-    // using VTK/GMSH node ordering! CCW corners, then CCW side nodes, then middle
-    assert(thiselem.N_nodes > 2 && "Elem does not have enough nodes!");
-    // assign indices
-    for (size_t i=0; i<thiselem.N_nodes; ++i) {
-      //std::cout << " " << thiselem.nodes[i];
-      idx.push_back(thiselem.nodes[i]);
-    }
-    //std::cout << " " << std::endl;
-    ++ec;
-  }
-  // if that was successful, then nnpe is the correct number of nodes per element
+  assert((ne == 0 or mesh->nnpe > 2) && "Elem does not have enough nodes!");
 
   // check all nodes for validity? or is that in the ctor?
-  pack.emplace_back(ElementPacket<float>({x, idx, vals, (size_t)(ne), (uint8_t)2}));
+  pack.emplace_back(ElementPacket<float>({x, mesh->elems, vals, (size_t)(ne), (uint8_t)2}));
 
   //
   // second EP is the wall
   //
   std::cout << "Generate Wall Boundary" << std::endl;
-  // better way: do it right here with what we already have in memory
-
-  // get a reference to the complete edge list
-  const std::vector<ReadMsh::edge>& edges = mesh.get_edges();
 
   // get the boundary corresponding to the wall
-  const ReadMsh::boundary wall = mesh.get_bdry("wall");
-  if (wall.N_edges == 0) {
+  const size_t nwall = mesh->wall_starts.size() - 1;
+  if (nwall == 0) {
     std::cout << "  no boundary called 'wall' in this msh file, skipping." << std::endl;
     pack.emplace_back(ElementPacket<float>());
 
   } else {
 
     // set the idx pointers to the new surface elements
-    const size_t np = wall.N_edges;
-    std::cout << "  wall has " << np << " edges" << std::endl;
-    idx.clear();
-    for (uint32_t thisedge : wall.edges) {
-      const size_t nn = edges[thisedge].N_nodes;
-      //std::cout << "  edge " << thisedge << " has " << nn << " nodes" << std::endl;
+    std::cout << "  wall has " << nwall << " edges" << std::endl;
+    std::vector<Int> idx;
+    idx.reserve(mesh->wall.size());
+    for (size_t e=0; e<nwall; ++e) {
+      const Int* nodes = mesh->wall.data() + mesh->wall_starts[e];
+      const size_t nn = mesh->wall_starts[e+1] - mesh->wall_starts[e];
       // 1st and 2nd nodes are the end nodes, regardless of how many nodes there are on this edge
       assert(nn > 1 && "Edge does not have enough nodes!");
       // reversing the orientation of the wall elements
-      idx.push_back(edges[thisedge].nodes[1]);
-      idx.push_back(edges[thisedge].nodes[0]);
-      for (size_t i=1; i<nn-1; ++i) idx.push_back(edges[thisedge].nodes[nn-i]);
-      //std::cout << "    ";
-      //for (size_t i=0; i<edges[thisedge].N_nodes; ++i) {
-      //  std::cout << " " << edges[thisedge].nodes[i];
-      //}
-      //std::cout << std::endl;
+      idx.push_back(nodes[1]);
+      idx.push_back(nodes[0]);
+      for (size_t i=1; i<nn-1; ++i) idx.push_back(nodes[nn-i]);
     }
 
     // set boundary condition value to 0.0 (velocity BC)
-    vals.resize(np);
+    vals.resize(nwall);
     std::fill(vals.begin(), vals.end(), 0.0);
 
     // return the element packet (will have many unused nodes - that's OK)
-    pack.emplace_back(ElementPacket<float>({x, idx, vals, (size_t)(np), (uint8_t)1}));
+    pack.emplace_back(ElementPacket<float>({x, idx, vals, (size_t)(nwall), (uint8_t)1}));
   }
 
   //
   // third EP is the open boundary
   //
   std::cout << "Generate Open Boundary" << std::endl;
-  // better way: do it right here with what we already have in memory
 
   // get the boundary corresponding to the open side
-  const ReadMsh::boundary open = mesh.get_bdry("open");
-  if (open.N_edges == 0) {
+  const size_t nopen = mesh->open_starts.size() - 1;
+  if (nopen == 0) {
     std::cout << "  no boundary called 'open' in this msh file, skipping." << std::endl;
     pack.emplace_back(ElementPacket<float>());
 
   } else {
 
-    // set the idx pointers to the new surface elements
-    const size_t np = open.N_edges;
-    //std::cout << "  open has " << np << " edges" << std::endl;
-    idx.clear();
-    for (uint32_t thisedge : open.edges) {
-      const size_t nn = edges[thisedge].N_nodes;
-      //std::cout << "  edge " << thisedge << " has " << nn << " nodes" << std::endl;
-      // 1st and 2nd nodes are the end nodes, regardless of how many nodes there are on this edge
-      assert(nn > 1 && "Edge does not have enough nodes!");
-      // note - annular gmsh meshes have open defined CCW, which is correct here
-      //idx.push_back(edges[thisedge].nodes[0]);
-      //idx.push_back(edges[thisedge].nodes[1]);
-      for (size_t i=0; i<nn; ++i) idx.push_back(edges[thisedge].nodes[i]);
-    }
+    // note - annular gmsh meshes have open defined CCW, which is correct here, so the
+    //   edges' nodes go in just as gmsh lists them
+    assert(mesh->open.size() >= 2*nopen && "Edge does not have enough nodes!");
 
     // set boundary condition value to 0.0 (velocity BC)
-    vals.resize(np);
+    vals.resize(nopen);
     std::fill(vals.begin(), vals.end(), 0.0);
 
     // return the element packet (will have many unused nodes - that's OK)
-    pack.emplace_back(ElementPacket<float>({x, idx, vals, (size_t)(np), (uint8_t)1}));
+    pack.emplace_back(ElementPacket<float>({x, mesh->open, vals, (size_t)(nopen), (uint8_t)1}));
   }
 
   return pack;
@@ -1619,6 +1557,7 @@ FromMsh::from_json(const nlohmann::json j) {
   if (infile_object.is_string()) {
     m_infile = infile_object.get<std::string>();
   }
+  m_cachedir = j.value("cacheDir", std::string());
 
   const std::vector<float> tr = j["translation"];
   m_x = tr[0];
@@ -1633,6 +1572,7 @@ FromMsh::to_json() const {
   nlohmann::json mesh = nlohmann::json::object();
   mesh["geometry"] = m_infile;
   mesh["translation"] = {m_x, m_y};
+  if (not m_cachedir.empty()) mesh["cacheDir"] = m_cachedir;
   mesh["enabled"] = m_enabled;
   return mesh;
 }
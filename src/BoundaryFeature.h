@@ -397,5 +397,7 @@ public:
 
 protected:
   std::string m_infile;
+  // where to keep the parsed copy of the mesh, none if empty
+  std::string m_cachedir;
   std::list<BoundarySegment> m_bsl;
 };
@@ -0,0 +1,202 @@
+/*
+ * CellList.h - A hashed uniform cell list for finding nearby particles
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "MemoryHelper.h"
+
+#include <vector>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+
+
+//
+// Particles are binned into square cells of a given size, and the cells are hashed into a
+//   table about as long as the particle list, so a wide, sparse wake costs no more memory
+//   than a dense cluster; building is a counting sort, so O(N)
+//
+// the positions are copied in bucket order, so callers may move particles while querying
+//   (just like the Eigen copy that nanoflann used to search)
+//
+// after small motions, update() leaves every particle in the cell it was binned into and
+//   only refreshes the copied positions; searches then widen by the largest displacement,
+//   and a full rebuild is needed only once that displacement passes the skin
+//
+template <class S>
+class CellList {
+public:
+  CellList() = default;
+
+  void build(const std::array<Vector<S>,Dimensions>&, const S);
+  bool update(const std::array<Vector<S>,Dimensions>&);
+
+  size_t size() const { return idx.size(); }
+  S get_cell_size() const { return h; }
+  S get_displacement() const { return disp; }
+  size_t get_mem_bytes() const {
+    return vec_bytes(start) + vec_bytes(idx) + vec_bytes(key) + vec_bytes(px) + vec_bytes(py) + vec_bytes(bx);
+  }
+
+  // all particles closer than sqrt(_distsq), sorted by distance, distances are squared
+  void radius_search(const S, const S, const S, std::vector<std::pair<int32_t,S>>&) const;
+
+  // run _func on every particle that may be in the box, the caller tests the positions
+  template <class F>
+  void for_each_in_box(const S, const S, const S, const S, F) const;
+
+private:
+  int32_t cell_of(const S _x) const { return (int32_t)std::floor(_x * hinv); }
+  static int64_t pack(const int32_t _cx, const int32_t _cy) {
+    return ((int64_t)_cx << 32) | (int64_t)(uint32_t)_cy;
+  }
+  size_t bucket_of(const int32_t _cx, const int32_t _cy) const {
+    const uint64_t hash = ((uint64_t)(uint32_t)_cx * 73856093u) ^ ((uint64_t)(uint32_t)_cy * 19349663u);
+    return (size_t)(hash & (nbuckets-1));
+  }
+
+  // largest motion allowed before update() gives up, as a fraction of the cell size
+  static constexpr S skin_frac = 0.5;
+
+  S h = 0.0;
+  S hinv = 0.0;
+  S disp = 0.0;				// largest displacement from the binned position
+  size_t nbuckets = 0;
+  std::vector<uint32_t> start;		// first entry of each bucket, nbuckets+1 of these
+  std::vector<int32_t> idx;		// particle index of each entry
+  std::vector<int64_t> key;		// and its cell, to skip hash collisions
+  Vector<S> px, py;			// and its position
+  std::array<Vector<S>,Dimensions> bx;	// where each particle was binned, by particle index
+};
+
+
+//
+// bin the particles, keeping them in index order within each bucket
+//
+template <class S>
+void CellList<S>::build(const std::array<Vector<S>,Dimensions>& _x, const S _cellsize) {
+  assert(_cellsize > 0.0 && "Cell list needs a positive cell size");
+  const size_t n = _x[0].size();
+
+  h = _cellsize;
+  hinv = 1.0 / _cellsize;
+  disp = 0.0;
+  bx = _x;
+  nbuckets = 1;
+  while (nbuckets < n) nbuckets *= 2;
+
+  std::vector<uint32_t> bucket(n);
+  start.assign(nbuckets+1, 0);
+  for (size_t i=0; i<n; ++i) {
+    bucket[i] = bucket_of(cell_of(_x[0][i]), cell_of(_x[1][i]));
+    start[bucket[i]+1]++;
+  }
+  for (size_t b=0; b<nbuckets; ++b) start[b+1] += start[b];
+
+  idx.resize(n);
+  key.resize(n);
+  px.resize(n);
+  py.resize(n);
+  std::vector<uint32_t> next(start.begin(), start.end()-1);
+  for (size_t i=0; i<n; ++i) {
+    const uint32_t e = next[bucket[i]]++;
+    idx[e] = (int32_t)i;
+    key[e] = pack(cell_of(_x[0][i]), cell_of(_x[1][i]));
+    px[e] = _x[0][i];
+    py[e] = _x[1][i];
+  }
+}
+
+//
+// refresh the positions of the same particles, return false if they moved too far
+//
+template <class S>
+bool CellList<S>::update(const std::array<Vector<S>,Dimensions>& _x) {
+  const size_t n = idx.size();
+  if (_x[0].size() != n) return false;
+
+  S maxdistsq = 0.0;
+  for (size_t i=0; i<n; ++i) {
+    const S distsq = std::pow(_x[0][i]-bx[0][i], 2) + std::pow(_x[1][i]-bx[1][i], 2);
+    maxdistsq = std::max(maxdistsq, distsq);
+  }
+  if (maxdistsq > std::pow(skin_frac*h, 2)) return false;
+
+  disp = std::sqrt(maxdistsq);
+  for (size_t e=0; e<n; ++e) {
+    px[e] = _x[0][idx[e]];
+    py[e] = _x[1][idx[e]];
+  }
+  return true;
+}
+
+template <class S>
+void CellList<S>::radius_search(const S _x, const S _y, const S _distsq,
+                                std::vector<std::pair<int32_t,S>>& _matches) const {
+  _matches.clear();
+  if (idx.empty()) return;
+
+  const S rad = std::sqrt(_distsq) + disp;
+  const int32_t cx0 = cell_of(_x-rad);
+  const int32_t cx1 = cell_of(_x+rad);
+  const int32_t cy0 = cell_of(_y-rad);
+  const int32_t cy1 = cell_of(_y+rad);
+
+  for (int32_t cx=cx0; cx<=cx1; ++cx) {
+    for (int32_t cy=cy0; cy<=cy1; ++cy) {
+      const size_t b = bucket_of(cx, cy);
+      const int64_t k = pack(cx, cy);
+      for (uint32_t e=start[b]; e<start[b+1]; ++e) {
+        if (key[e] != k) continue;
+        const S distsq = std::pow(px[e]-_x, 2) + std::pow(py[e]-_y, 2);
+        if (distsq < _distsq) _matches.emplace_back(idx[e], distsq);
+      }
+    }
+  }
+
+  // ties go to the lower index, so results do not depend on the hash
+  std::sort(_matches.begin(), _matches.end(),
+            [](const std::pair<int32_t,S>& a, const std::pair<int32_t,S>& b) {
+              return (a.second < b.second) or (a.second == b.second and a.first < b.first); });
+}
+
+template <class S>
+template <class F>
+void CellList<S>::for_each_in_box(const S _xmin, const S _xmax, const S _ymin, const S _ymax, F _func) const {
+  if (idx.empty()) return;
+
+  const int32_t cx0 = cell_of(_xmin-disp);
+  const int32_t cx1 = cell_of(_xmax+disp);
+  const int32_t cy0 = cell_of(_ymin-disp);
+  const int32_t cy1 = cell_of(_ymax+disp);
+
+  // a box bigger than the table is faster to check entry-by-entry
+  if ((double)(cx1-cx0+1) * (double)(cy1-cy0+1) > (double)nbuckets) {
+    for (size_t e=0; e<idx.size(); ++e) {
+      const int32_t cx = (int32_t)(key[e] >> 32);
+      const int32_t cy = (int32_t)(uint32_t)(key[e] & 0xffffffff);
+      if (cx >= cx0 and cx <= cx1 and cy >= cy0 and cy <= cy1) _func(idx[e]);
+    }
+    return;
+  }
+
+  for (int32_t cx=cx0; cx<=cx1; ++cx) {
+    for (int32_t cy=cy0; cy<=cy1; ++cy) {
+      const size_t b = bucket_of(cx, cy);
+      const int64_t k = pack(cx, cy);
+      for (uint32_t e=start[b]; e<start[b+1]; ++e) {
+        if (key[e] == k) _func(idx[e]);
+      }
+    }
+  }
+}
+
@@ -0,0 +1,252 @@
+/*
+ * Checkpoint.h - Binary files holding the complete dynamic state of a simulation
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <array>
+#include <optional>
+#include <memory>
+#include <type_traits>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+//
+// Every value is written as its bytes and every array as its length and then its bytes, so
+//   a restart reads back exactly what was written; a file is only written on the machine
+//   (and in the precision) that will read it, so there is no byte swapping
+//
+// each array is one component of one collection, and starts on a 64-byte boundary, so the
+//   reader maps the file and hands out pointers straight into it: a restart copies each
+//   array once from the pages the kernel brings in, and tools which only want some arrays
+//   never touch the rest
+//
+// files are written under a temporary name which replaces the old checkpoint once complete,
+//   so the last good one survives a crash while writing
+//
+static constexpr char checkpoint_magic[8] = {'O','M','E','G','A','2','D','C'};
+static constexpr uint32_t checkpoint_version = 7;
+static constexpr size_t checkpoint_align = 64;
+
+class CheckpointWriter {
+public:
+  explicit CheckpointWriter(const std::string _file)
+    : file(_file), tmpfile(_file + ".tmp") {
+    fp = std::fopen(tmpfile.c_str(), "wb");
+    ok = (fp != nullptr);
+  }
+
+  // or append to bytes in memory, see CheckpointSnapshot
+  explicit CheckpointWriter(std::vector<char>& _mem)
+    : fp(nullptr), ok(true), mem(&_mem) {}
+
+  ~CheckpointWriter() { if (fp) std::fclose(fp); }
+
+  template <class T>
+  void put(const T& _v) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written");
+    write(&_v, sizeof(T));
+  }
+
+  template <class V>
+  void put_vec(const V& _v) {
+    put((uint64_t)_v.size());
+    pad();
+    write(_v.data(), sizeof(typename V::value_type)*_v.size());
+  }
+
+  template <class V, size_t N>
+  void put_vecs(const std::array<V,N>& _v) { for (const auto& v : _v) put_vec(v); }
+
+  template <class V>
+  void put_opt(const std::optional<V>& _v) {
+    put((uint8_t)_v.has_value());
+    if (_v) put_vec(*_v);
+  }
+
+  void put_str(const std::string& _s) { put_vec(_s); }
+
+  // close and move into place, false if anything failed
+  bool finish() {
+    if (mem) return ok;
+    if (not fp) return false;
+    ok = (std::fclose(fp) == 0) and ok;
+    fp = nullptr;
+    if (ok) ok = (std::rename(tmpfile.c_str(), file.c_str()) == 0);
+    return ok;
+  }
+
+private:
+  void write(const void* _p, const size_t _n) {
+    if (mem) {
+      if (_n > 0) mem->insert(mem->end(), (const char*)_p, (const char*)_p + _n);
+    } else if (ok and _n > 0) {
+      ok = (std::fwrite(_p, 1, _n, fp) == _n);
+    }
+    pos += _n;
+  }
+
+  void pad() {
+    static constexpr char zeros[checkpoint_align] = {0};
+    write(zeros, (checkpoint_align - pos%checkpoint_align) % checkpoint_align);
+  }
+
+  std::string file, tmpfile;
+  std::FILE* fp;
+  bool ok;
+  std::vector<char>* mem = nullptr;
+  size_t pos = 0;
+};
+
+//
+// A checkpoint kept in memory, for going back to an earlier state within one session; the
+//   bytes never change once taken, so copies of a snapshot share them and cost nothing
+//
+struct CheckpointSnapshot {
+  double time = 0.0;
+  size_t nstep = 0;
+  std::shared_ptr<const std::vector<char>> bytes;
+
+  bool empty() const { return not bytes; }
+  size_t get_mem_bytes() const { return bytes ? bytes->capacity() : 0; }
+};
+
+class CheckpointReader {
+public:
+  explicit CheckpointReader(const std::string _file) {
+#ifdef _WIN32
+    std::FILE* fp = std::fopen(_file.c_str(), "rb");
+    ok = (fp != nullptr);
+    if (ok) {
+      std::fseek(fp, 0, SEEK_END);
+      buffer.resize((size_t)std::ftell(fp));
+      std::fseek(fp, 0, SEEK_SET);
+      ok = (std::fread(buffer.data(), 1, buffer.size(), fp) == buffer.size());
+      std::fclose(fp);
+      base = buffer.data();
+      size = buffer.size();
+    }
+#else
+    const int fd = open(_file.c_str(), O_RDONLY);
+    struct stat st;
+    ok = (fd >= 0 and fstat(fd, &st) == 0);
+    if (ok and st.st_size > 0) {
+      size = (size_t)st.st_size;
+      void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = (p != MAP_FAILED);
+      if (ok) {
+        base = (const char*)p;
+        madvise(p, size, MADV_SEQUENTIAL);
+      } else {
+        size = 0;
+      }
+    }
+    if (fd >= 0) close(fd);
+#endif
+  }
+
+  // read a snapshot in place, and keep it alive while reading
+  explicit CheckpointReader(const CheckpointSnapshot& _snap) : held(_snap.bytes) {
+    ok = (bool)held;
+    if (ok) {
+      base = held->data();
+      size = held->size();
+    }
+  }
+
+  ~CheckpointReader() {
+#ifndef _WIN32
+    if (base and not held) munmap((void*)base, size);
+#endif
+  }
+
+  CheckpointReader(const CheckpointReader&) = delete;
+  CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+  template <class T>
+  T get() {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read");
+    T v{};
+    if (take(sizeof(T))) std::memcpy(&v, base+pos-sizeof(T), sizeof(T));
+    return v;
+  }
+
+  // the next array in place, valid while this reader lives; nullptr and 0 on failure
+  template <class T>
+  const T* view_vec(size_t& _n) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read");
+    const uint64_t n = get<uint64_t>();
+    skip_pad();
+    _n = 0;
+    // a bad length must not run off the end
+    if (not ok or n > (size - pos) / sizeof(T)) { ok = false; return nullptr; }
+    const T* p = reinterpret_cast<const T*>(base+pos);
+    pos += sizeof(T)*n;
+    _n = (size_t)n;
+    return p;
+  }
+
+  template <class V>
+  void get_vec(V& _v) {
+    size_t n = 0;
+    const typename V::value_type* p = view_vec<typename V::value_type>(n);
+    if (not p) return;
+    _v.resize(n);
+    if (n > 0) std::memcpy(_v.data(), p, sizeof(*p)*n);
+  }
+
+  template <class V, size_t N>
+  void get_vecs(std::array<V,N>& _v) { for (auto& v : _v) get_vec(v); }
+
+  template <class V>
+  void get_opt(std::optional<V>& _v) {
+    if (get<uint8_t>()) {
+      if (not _v) _v = V();
+      get_vec(*_v);
+    } else {
+      _v.reset();
+    }
+  }
+
+  std::string get_str() {
+    std::string s;
+    get_vec(s);
+    return s;
+  }
+
+  bool good() const { return ok; }
+  void fail() { ok = false; }
+
+private:
+  bool take(const size_t _n) {
+    ok = ok and (_n <= size - pos);
+    if (ok) pos += _n;
+    return ok;
+  }
+
+  void skip_pad() { take((checkpoint_align - pos%checkpoint_align) % checkpoint_align); }
+
+  const char* base = nullptr;
+  size_t size = 0;
+  size_t pos = 0;
+  bool ok = false;
+  std::shared_ptr<const std::vector<char>> held;
+#ifdef _WIN32
+  std::vector<char> buffer;
+#endif
+};
+
@@ -0,0 +1,164 @@
+/*
+ * Coarsen.h - Zones where the wake is carried by fewer, larger particles
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Collection.h"
+#include "Logger.h"
+
+#include <json/json.hpp>
+
+#include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <iostream>
+
+
+//
+// Far from the bodies the wake needs much less resolution than near them. In a coarsening
+//   zone, the particle radii grow a little every step toward a multiple of the nominal
+//   radius. The VRM and the merge both space particles by each particle's own radius, so
+//   in these zones new particles are placed, and old ones merged, at the larger separation,
+//   and the particle count stops growing with time.
+//
+// growing a core moves no strength, and a merge keeps the total strength, so circulation
+//   is conserved; the merged position is weighted by |strength|, so linear impulse is kept
+//   when the merged particles share a sign and only approximately when they do not; radii
+//   never shrink, so a particle which leaves a zone stays coarse
+//
+// a zone is either everything farther than some distance from every body (measured to the
+//   boxes around the boundaries) or a box; a particle in several zones takes the largest factor
+//
+template <class S>
+class CoarseningZones {
+public:
+  bool is_active() const { return not zones.empty(); }
+
+  // grow the radii of the free particles in every zone, returns how many grew
+  size_t apply(const std::vector<Collection>& _bdry, std::vector<Collection>& _vort, const S _vdelta) {
+    if (zones.empty()) return 0;
+
+    // boxes around the boundaries
+    std::vector<std::array<S,4>> boxes;
+    for (const auto& coll : _bdry) {
+      if (not std::holds_alternative<Surfaces<S>>(coll)) continue;
+      const std::array<Vector<S>,Dimensions>& x = std::get<Surfaces<S>>(coll).get_pos();
+      if (x[0].empty()) continue;
+      const auto [xlo, xhi] = std::minmax_element(x[0].begin(), x[0].end());
+      const auto [ylo, yhi] = std::minmax_element(x[1].begin(), x[1].end());
+      boxes.push_back({*xlo, *xhi, *ylo, *yhi});
+    }
+
+    size_t ngrown = 0;
+    for (auto& coll : _vort) {
+      if (not std::holds_alternative<Points<S>>(coll)) continue;
+      Points<S>& pts = std::get<Points<S>>(coll);
+      if (pts.is_inert() or pts.get_movet() != lagrangian or pts.get_body_ptr()) continue;
+
+      // find the new radii first, so a collection with nothing to grow is not touched
+      const std::array<Vector<S>,Dimensions>& x = std::as_const(pts).get_pos();
+      const Vector<S>& r = std::as_const(pts).get_rad();
+      std::vector<std::pair<size_t,S>> grown;
+      for (size_t i=0; i<pts.get_n(); ++i) {
+        const S target = factor_at(x[0][i], x[1][i], boxes) * _vdelta;
+        if (r[i] < target) grown.emplace_back(i, std::min(target, r[i] * (S)(1.0 + growth)));
+      }
+      if (grown.empty()) continue;
+
+      Vector<S>& rw = pts.get_rad();
+      for (const auto& [i, newr] : grown) rw[i] = newr;
+      ngrown += grown.size();
+    }
+
+    if (ngrown > 0) LOG_DEBUG("    coarsening grew " << ngrown << " particles");
+    return ngrown;
+  }
+
+  void from_json(const nlohmann::json simj) {
+    zones.clear();
+    if (simj.find("coarsening") == simj.end()) return;
+    const nlohmann::json j = simj["coarsening"];
+
+    if (j.find("growth") != j.end()) {
+      growth = j["growth"];
+      std::cout << "  setting coarsening growth= " << growth << std::endl;
+    }
+    if (j.find("zones") != j.end()) {
+      for (const auto& jz : j["zones"]) {
+        Zone z;
+        z.factor = jz.value("factor", (S)2.0);
+        if (jz.find("beyond") != jz.end()) {
+          z.beyond = jz["beyond"];
+          std::cout << "  coarsening by " << z.factor << " beyond " << z.beyond << " from the bodies" << std::endl;
+        } else if (jz.find("box") != jz.end()) {
+          const std::vector<S> b = jz["box"];
+          if (b.size() != 4) {
+            std::cout << "  coarsening box needs [xmin, ymin, xmax, ymax], skipping" << std::endl;
+            continue;
+          }
+          z.box = {b[0], b[1], b[2], b[3]};
+          std::cout << "  coarsening by " << z.factor << " in [" << b[0] << " " << b[1] << " " << b[2] << " " << b[3] << "]" << std::endl;
+        } else {
+          continue;
+        }
+        zones.push_back(z);
+      }
+    }
+  }
+
+  void add_to_json(nlohmann::json& simj) const {
+    if (zones.empty()) return;
+    nlohmann::json j;
+    j["growth"] = growth;
+    for (const auto& z : zones) {
+      nlohmann::json jz;
+      jz["factor"] = z.factor;
+      if (z.beyond > 0.0) jz["beyond"] = z.beyond;
+      else jz["box"] = {z.box[0], z.box[1], z.box[2], z.box[3]};
+      j["zones"].push_back(jz);
+    }
+    simj["coarsening"] = j;
+  }
+
+private:
+  struct Zone {
+    S factor = 2.0;
+    S beyond = 0.0;
+    std::array<S,4> box = {0.0, 0.0, 0.0, 0.0};
+  };
+
+  // the largest factor of any zone holding this point
+  S factor_at(const S _x, const S _y, const std::vector<std::array<S,4>>& _boxes) const {
+    S f = 1.0;
+    for (const auto& z : zones) {
+      if (z.factor <= f) continue;
+      if (z.beyond > 0.0) {
+        if (_boxes.empty()) continue;
+        S mindsq = std::numeric_limits<S>::max();
+        for (const auto& b : _boxes) {
+          const S dx = std::max({b[0]-_x, (S)0.0, _x-b[1]});
+          const S dy = std::max({b[2]-_y, (S)0.0, _y-b[3]});
+          mindsq = std::min(mindsq, dx*dx + dy*dy);
+        }
+        if (mindsq > z.beyond*z.beyond) f = z.factor;
+      } else if (_x >= z.box[0] and _x <= z.box[2] and _y >= z.box[1] and _y <= z.box[3]) {
+        f = z.factor;
+      }
+    }
+    return f;
+  }
+
+  std::vector<Zone> zones;
+
+  // largest relative change of a radius in one step
+  S growth = 0.05;
+};
@@ -9,13 +9,22 @@
 
 #include "Omega2D.h"
 #include "VectorHelper.h"
+#include "Precision.h"
 #include "Kernels.h"
 #include "Points.h"
 #include "Surfaces.h"
+#include "ExecEnv.h"
+#include "Periodic.h"
+#include "Symmetry.h"
+#include "Logger.h"
+#include "Profiler.h"
 
 #ifdef USE_VC
 #include <Vc/Vc>
 #endif
+#ifdef USE_STDSIMD
+#include "SimdHelper.h"
+#endif
 
 #include <algorithm>	// for std::transform
 #include <iostream>
@@ -24,6 +33,7 @@
 #include <optional>
 #include <chrono>
 #include <cmath>	// for M_PI
+#include <type_traits>
 
 
 template <class S>
@@ -36,15 +46,14 @@ Vector<S> points_on_points_coeff (Points<S> const& src, Points<S>& targ) {
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
-  const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-  printf("    points_on_points_coeff: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+  LOG_DEBUG("    points_on_points_coeff: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
 
   return coeffs;
 }
 
 template <class S>
 Vector<S> panels_on_points_coeff (Surfaces<S> const& src, Points<S>& targ) {
-  std::cout << "    1_0 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    1_0 compute coefficients of" << src.to_string() << " on" << targ.to_string());
 
   Vector<S> coeffs;
   return coeffs;
@@ -88,7 +97,7 @@ Vector<S> panels_on_points_coeff (Surfaces<S> const& src, Points<S>& targ) {
 
 template <class S>
 Vector<S> bricks_on_points_coeff (Volumes<S> const& src, Points<S>& targ) {
-  std::cout << "    2_0 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    2_0 compute coefficients of" << src.to_string() << " on" << targ.to_string());
   Vector<S> coeffs;
   return coeffs;
 }
@@ -97,7 +106,7 @@ Vector<S> bricks_on_points_coeff (Volumes<S> const& src, Points<S>& targ) {
 
 template <class S>
 Vector<S> points_on_panels_coeff (Points<S> const& src, Surfaces<S>& targ) {
-  std::cout << "    0_1 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    0_1 compute coefficients of" << src.to_string() << " on" << targ.to_string());
 
   Vector<S> coeffs;
   return coeffs;
@@ -139,9 +148,194 @@ Vector<S> points_on_panels_coeff (Points<S> const& src, Surfaces<S>& targ) {
 */
 }
 
+// ===========================================================================================================
+
+//
+// the vector type for coefficient assembly, and loading from and reading out of it
+//
+#ifdef USE_VC
+template <class S> using CoeffVec = Vc::Vector<S>;
+#elif defined(USE_STDSIMD)
+template <class S> using CoeffVec = SimdVec<S>;
+#else
+template <class S> using CoeffVec = S;
+#endif
+
+template <class V, class S>
+constexpr size_t coeff_vec_size () {
+  if constexpr (std::is_same_v<V,S>) return 1;
+  else return V::size();
+}
+
+template <class V, class S>
+inline V coeff_vec_load (const S* const _p) {
+  if constexpr (std::is_same_v<V,S>) return *_p;
+#ifdef USE_VC
+  else return V(_p, Vc::Unaligned);
+#elif defined(USE_STDSIMD)
+  else return V(_p, stdx::element_aligned);
+#endif
+}
+
+template <class V, class S>
+inline S coeff_vec_lane (const V& _v, const size_t _i) {
+  if constexpr (std::is_same_v<V,S>) return _v;
+  else return _v[_i];
+}
+
+//
+// the influence of a set of panels on itself, with two-way averaging
+//
+// the coefficient for target i and source j needs the influence of j on the center of i and
+//   of i on the center of j - and so does the coefficient for target j and source i, so each
+//   unordered pair is visited once and fills both; vectorized over targets i < j
+//
+// returns the column-major block without the 1/2pi factor, like the loop in panels_on_panels_coeff
+//
+template <class S>
+Vector<S> panels_on_self_coeff (Surfaces<S> const& surf) {
+
+  typedef CoeffVec<S> V;
+  constexpr size_t vsize = coeff_vec_size<V,S>();
+
+  const size_t n = surf.get_npanels();
+  const size_t unk = surf.num_unknowns_per_panel();
+  const size_t nrows = n * unk;
+
+  // de-interleave the geometry, padding panels are far away and never stored
+  const std::array<Vector<S>,Dimensions>& x = surf.get_pos();
+  const std::vector<Int>&                 idx = surf.get_idx();
+  const std::array<Vector<S>,Dimensions>& tt = surf.get_tang();
+  const std::array<Vector<S>,Dimensions>& tn = surf.get_norm();
+  const Vector<S>&                        pa = surf.get_area();
+  const size_t npad = vsize * ((n + vsize - 1) / vsize);
+  Vector<S> x0(npad, -9999.0), y0(npad, -9999.0), x1(npad, 9999.0), y1(npad, -9999.0);
+  Vector<S> cx(npad, 0.0), cy(npad, -9999.0), ttx(npad, 1.0), tty(npad, 0.0), tnx(npad, 0.0), tny(npad, 1.0);
+  Vector<S> ta(npad, 1.0);
+  for (size_t i=0; i<n; ++i) {
+    x0[i] = x[0][idx[2*i]];
+    y0[i] = x[1][idx[2*i]];
+    x1[i] = x[0][idx[2*i+1]];
+    y1[i] = x[1][idx[2*i+1]];
+    cx[i] = 0.5 * (x0[i] + x1[i]);
+    cy[i] = 0.5 * (y0[i] + y1[i]);
+    ttx[i] = tt[0][i];
+    tty[i] = tt[1][i];
+    tnx[i] = tn[0][i];
+    tny[i] = tn[1][i];
+    ta[i] = pa[i];
+  }
+
+  Vector<S> coeffs(nrows*nrows);
+
+  // the work for source j grows with j
+  #pragma omp parallel for schedule(dynamic,8)
+  for (int32_t jj=0; jj<(int32_t)n; ++jj) {
+    const size_t j = (size_t)jj;
+
+    // the source panel, in every lane
+    const V sx0 = x0[j];
+    const V sy0 = y0[j];
+    const V sx1 = x1[j];
+    const V sy1 = y1[j];
+    const V scx = cx[j];
+    const V scy = cy[j];
+    const V stx = ttx[j];
+    const V sty = tty[j];
+    const V snx = tnx[j];
+    const V sny = tny[j];
+    const V sa = ta[j];
+
+    for (size_t ib=0; ib<j; ib+=vsize) {
+      const V tx0 = coeff_vec_load<V,S>(&x0[ib]);
+      const V ty0 = coeff_vec_load<V,S>(&y0[ib]);
+      const V tx1 = coeff_vec_load<V,S>(&x1[ib]);
+      const V ty1 = coeff_vec_load<V,S>(&y1[ib]);
+      const V tcx = coeff_vec_load<V,S>(&cx[ib]);
+      const V tcy = coeff_vec_load<V,S>(&cy[ib]);
+      const V itx = coeff_vec_load<V,S>(&ttx[ib]);
+      const V ity = coeff_vec_load<V,S>(&tty[ib]);
+      const V tva = coeff_vec_load<V,S>(&ta[ib]);
+      const V fij = sa / tva;
+      const V fji = tva / sa;
+      const V half = S(0.5);
+      const size_t nlanes = std::min(vsize, j-ib);
+
+      if (unk == 2) {
+        const V inx = coeff_vec_load<V,S>(&tnx[ib]);
+        const V iny = coeff_vec_load<V,S>(&tny[ib]);
+
+        // panel j on center i, and panel i on center j
+        V vu, vv, su, sv, rvu, rvv, rsu, rsv;
+        kernelu_1vos_0p<V,V>(sx0, sy0, sx1, sy1, V(S(1.0)), V(S(1.0)), tcx, tcy, &vu, &vv, &su, &sv);
+        kernelu_1vos_0p<V,V>(tx0, ty0, tx1, ty1, V(S(1.0)), V(S(1.0)), scx, scy, &rvu, &rvv, &rsu, &rsv);
+
+        // target i, source j; flipping source and target returns negative of desired influence
+        const V avu = vu - fij*rvu;
+        const V avv = vv - fij*rvv;
+        const V asu = su - fij*rsu;
+        const V asv = sv - fij*rsv;
+        const V ij_vt = half * (avu*itx + avv*ity);
+        const V ij_vn = half * (avu*inx + avv*iny);
+        const V ij_st = half * (asu*itx + asv*ity);
+        const V ij_sn = half * (asu*inx + asv*iny);
+
+        // target j, source i
+        const V bvu = rvu - fji*vu;
+        const V bvv = rvv - fji*vv;
+        const V bsu = rsu - fji*su;
+        const V bsv = rsv - fji*sv;
+        const V ji_vt = half * (bvu*stx + bvv*sty);
+        const V ji_vn = half * (bvu*snx + bvv*sny);
+        const V ji_st = half * (bsu*stx + bsv*sty);
+        const V ji_sn = half * (bsu*snx + bsv*sny);
+
+        for (size_t ii=0; ii<nlanes; ++ii) {
+          const size_t i = ib + ii;
+          coeffs[(2*j  )*nrows + 2*i  ] = coeff_vec_lane<V,S>(ij_vt, ii);
+          coeffs[(2*j  )*nrows + 2*i+1] = coeff_vec_lane<V,S>(ij_vn, ii);
+          coeffs[(2*j+1)*nrows + 2*i  ] = coeff_vec_lane<V,S>(ij_st, ii);
+          coeffs[(2*j+1)*nrows + 2*i+1] = coeff_vec_lane<V,S>(ij_sn, ii);
+          coeffs[(2*i  )*nrows + 2*j  ] = coeff_vec_lane<V,S>(ji_vt, ii);
+          coeffs[(2*i  )*nrows + 2*j+1] = coeff_vec_lane<V,S>(ji_vn, ii);
+          coeffs[(2*i+1)*nrows + 2*j  ] = coeff_vec_lane<V,S>(ji_st, ii);
+          coeffs[(2*i+1)*nrows + 2*j+1] = coeff_vec_lane<V,S>(ji_sn, ii);
+        }
+
+      } else {
+        // vortex strengths only
+        V vu, vv, rvu, rvv;
+        kernelu_1v_0p<V,V>(sx0, sy0, sx1, sy1, V(S(1.0)), tcx, tcy, &vu, &vv);
+        kernelu_1v_0p<V,V>(tx0, ty0, tx1, ty1, V(S(1.0)), scx, scy, &rvu, &rvv);
+
+        const V ij = half * ((vu - fij*rvu)*itx + (vv - fij*rvv)*ity);
+        const V ji = half * ((rvu - fji*vu)*stx + (rvv - fji*vv)*sty);
+
+        for (size_t ii=0; ii<nlanes; ++ii) {
+          const size_t i = ib + ii;
+          coeffs[j*nrows + i] = coeff_vec_lane<V,S>(ij, ii);
+          coeffs[i*nrows + j] = coeff_vec_lane<V,S>(ji, ii);
+        }
+      }
+    }
+
+    // special case: self-influence
+    if (unk == 2) {
+      coeffs[(2*j  )*nrows + 2*j  ] = M_PI;
+      coeffs[(2*j  )*nrows + 2*j+1] = 0.0;
+      coeffs[(2*j+1)*nrows + 2*j  ] = 0.0;
+      coeffs[(2*j+1)*nrows + 2*j+1] = M_PI;
+    } else {
+      coeffs[j*nrows + j] = M_PI;
+    }
+  }
+
+  return coeffs;
+}
+
 template <class S>
-Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ) {
-  std::cout << "    1_1 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
+Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ, const ExecEnv& env) {
+  LOG_DEBUG("    1_1 compute coefficients of" << src.to_string() << " on" << targ.to_string());
 
   const bool use_two_way = true;
 
@@ -177,11 +371,22 @@ Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ) {
 
   // allocate space for the output array
   Vector<S> coeffs;
+
+  // a block on itself shares every pair of kernel evaluations between two coefficients
+  const bool use_pairs = use_two_way and (&src == &targ);
+  if (use_pairs) {
+    coeffs = panels_on_self_coeff<S>(targ);
+    flops += 0.5 * (float)nsrc * (float)(nsrc-1) * 2.0 *
+              (14.0 +
+               (float)(src_have_src ? flopsu_1vos_0p<S,S>() : flopsu_1v_0p<S,S>()) +
+               (targ_have_src ? 24.0 : 6.0));
+  } else {
   coeffs.resize(oldncols*oldnrows);
 
-  // run a panels-on-points algorithm - THIS CAN BE MORE EFFICIENT
+  // run a panels-on-points algorithm
   #pragma omp parallel
   {
+  PROFILE_ZONE("coefficients");
   Vector<S> col1,col2;
   col1.resize(oldnrows);
   if (src_have_src) col2.resize(oldnrows);
@@ -406,6 +611,7 @@ Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ) {
               (4.0 +
                (float)(src_have_src ? flopsu_1vos_0p<S,S>() : flopsu_1v_0p<S,S>()) +
                (targ_have_src ? 12.0 : 3.0));
+  } // end if use_pairs
 
   // scale all influences by the constant
   const S fac = 1.0 / (2.0 * M_PI);
@@ -413,6 +619,11 @@ Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ) {
                  [fac](S elem) { return elem * fac; });
   flops += 2.0 + (float)coeffs.size();
 
+  // and every other panel in the row of copies
+  if (env.get_periodic_domain().active()) add_periodic_panel_coeffs<S>(src, targ, env.get_periodic_domain(), coeffs);
+  // or the images in the symmetry plane
+  if (env.get_symmetry_plane().active()) add_mirror_panel_coeffs<S>(src, targ, env.get_symmetry_plane(), coeffs);
+
   // skip out if we don't augment
   if (not targ.is_augmented() and not src.is_augmented()) return coeffs;
 
@@ -424,7 +635,7 @@ Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ) {
   const size_t nrows = oldnrows + (targ.is_augmented() ? 1 : 0);
   const size_t ncols = oldncols + ( src.is_augmented() ? 1 : 0);
   if (targ.is_augmented() or src.is_augmented()) {
-    std::cout << "    augmenting the " << ntarg << " x " << nsrc << " block to " << nrows << " x " << ncols << std::endl;
+    LOG_DEBUG("    augmenting the " << ntarg << " x " << nsrc << " block to " << nrows << " x " << ncols);
   }
 
   bool debug = false;
@@ -561,7 +772,7 @@ Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ) {
 
 template <class S>
 Vector<S> bricks_on_panels_coeff (Volumes<S> const& src, Surfaces<S>& targ) {
-  std::cout << "    2_1 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    2_1 compute coefficients of" << src.to_string() << " on" << targ.to_string());
   Vector<S> coeffs;
   return coeffs;
 }
@@ -571,21 +782,21 @@ Vector<S> bricks_on_panels_coeff (Volumes<S> const& src, Surfaces<S>& targ) {
 // bricks (volume elements) do not participate in BEM yet
 template <class S>
 Vector<S> points_on_bricks_coeff (Points<S> const& src, Volumes<S>& targ) {
-  std::cout << "    0_2 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    0_2 compute coefficients of" << src.to_string() << " on" << targ.to_string());
   Vector<S> coeffs;
   return coeffs;
 }
 
 template <class S>
 Vector<S> panels_on_bricks_coeff (Surfaces<S> const& src, Volumes<S>& targ) {
-  std::cout << "    1_2 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    1_2 compute coefficients of" << src.to_string() << " on" << targ.to_string());
   Vector<S> coeffs;
   return coeffs;
 }
 
 template <class S>
 Vector<S> bricks_on_bricks_coeff (Volumes<S> const& src, Volumes<S>& targ) {
-  std::cout << "    2_2 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    2_2 compute coefficients of" << src.to_string() << " on" << targ.to_string());
   Vector<S> coeffs;
   return coeffs;
 }
@@ -597,14 +808,17 @@ Vector<S> bricks_on_bricks_coeff (Volumes<S> const& src, Volumes<S>& targ) {
 // helper struct for dispatching through a variant
 struct CoefficientVisitor {
   // source collection, target collection
-  Vector<float> operator()(Points<float> const& src,   Points<float>& targ)   { return points_on_points_coeff<float>(src, targ); } 
-  Vector<float> operator()(Surfaces<float> const& src, Points<float>& targ)   { return panels_on_points_coeff<float>(src, targ); } 
-  Vector<float> operator()(Volumes<float> const& src,  Points<float>& targ)   { return bricks_on_points_coeff<float>(src, targ); } 
-  Vector<float> operator()(Points<float> const& src,   Surfaces<float>& targ) { return points_on_panels_coeff<float>(src, targ); } 
-  Vector<float> operator()(Surfaces<float> const& src, Surfaces<float>& targ) { return panels_on_panels_coeff<float>(src, targ); } 
-  Vector<float> operator()(Volumes<float> const& src,  Surfaces<float>& targ) { return bricks_on_panels_coeff<float>(src, targ); } 
-  Vector<float> operator()(Points<float> const& src,   Volumes<float>& targ)  { return points_on_bricks_coeff<float>(src, targ); } 
-  Vector<float> operator()(Surfaces<float> const& src, Volumes<float>& targ)  { return panels_on_bricks_coeff<float>(src, targ); } 
-  Vector<float> operator()(Volumes<float> const& src,  Volumes<float>& targ)  { return bricks_on_bricks_coeff<float>(src, targ); } 
+  Vector<STORE> operator()(Points<STORE> const& src,   Points<STORE>& targ)   { return points_on_points_coeff<STORE>(src, targ); } 
+  Vector<STORE> operator()(Surfaces<STORE> const& src, Points<STORE>& targ)   { return panels_on_points_coeff<STORE>(src, targ); } 
+  Vector<STORE> operator()(Volumes<STORE> const& src,  Points<STORE>& targ)   { return bricks_on_points_coeff<STORE>(src, targ); } 
+  Vector<STORE> operator()(Points<STORE> const& src,   Surfaces<STORE>& targ) { return points_on_panels_coeff<STORE>(src, targ); } 
+  Vector<STORE> operator()(Surfaces<STORE> const& src, Surfaces<STORE>& targ) { return panels_on_panels_coeff<STORE>(src, targ, env); } 
+  Vector<STORE> operator()(Volumes<STORE> const& src,  Surfaces<STORE>& targ) { return bricks_on_panels_coeff<STORE>(src, targ); } 
+  Vector<STORE> operator()(Points<STORE> const& src,   Volumes<STORE>& targ)  { return points_on_bricks_coeff<STORE>(src, targ); } 
+  Vector<STORE> operator()(Surfaces<STORE> const& src, Volumes<STORE>& targ)  { return panels_on_bricks_coeff<STORE>(src, targ); } 
+  Vector<STORE> operator()(Volumes<STORE> const& src,  Volumes<STORE>& targ)  { return bricks_on_bricks_coeff<STORE>(src, targ); } 
+
+  // only for the images of a periodic or mirrored domain
+  ExecEnv env;
 };
 
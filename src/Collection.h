@@ -7,17 +7,31 @@
 
 #pragma once
 
+#include "Precision.h"
 #include "Points.h"
 #include "Surfaces.h"
 #include "Volumes.h"
 
 #include <variant>
+#include <vector>
 
-// alias for any type of collection of elements
-// eventually will have Volumes<float> here and in 3D
-//                  and Lines<float> in 3D only
+// alias for any type of collection of elements, in the storage precision of this build
+// eventually will have Volumes<STORE> here and in 3D
+//                  and Lines<STORE> in 3D only
 
-using Collection = std::variant<Points<float>,
-                                Surfaces<float>,
-                                Volumes<float>>;
+using Collection = std::variant<Points<STORE>,
+                                Surfaces<STORE>,
+                                Volumes<STORE>>;
 
+// bytes held by a list of collections, in host memory and in GL buffers
+inline size_t get_mem_bytes(const std::vector<Collection>& _vec) {
+  size_t bytes = 0;
+  for (const auto& coll : _vec) bytes += std::visit([](const auto& elem) { return elem.get_mem_bytes(); }, coll);
+  return bytes;
+}
+
+inline size_t get_gl_bytes(const std::vector<Collection>& _vec) {
+  size_t bytes = 0;
+  for (const auto& coll : _vec) bytes += std::visit([](const auto& elem) { return elem.get_gl_bytes(); }, coll);
+  return bytes;
+}
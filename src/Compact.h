@@ -0,0 +1,69 @@
+/*
+ * Compact.h - Remove flagged elements from many arrays at once, in place
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+
+//
+// Each block of elements is compacted inside itself, every array of a block in turn while
+//   that block is in cache, and the blocks run in parallel because none writes outside its
+//   own range; the compacted blocks are then slid down to their final places in order
+//
+// survivors keep their order, no scratch copies of the arrays are made, and arrays not
+//   sized to the mask are left alone
+//
+static constexpr size_t compact_block = 4096;
+
+template <class V>
+size_t compact_arrays(const std::vector<uint8_t>& _keep, const std::vector<V*>& _arrays) {
+  const size_t n = _keep.size();
+  const size_t nblocks = (n + compact_block - 1) / compact_block;
+
+  std::vector<V*> arrays;
+  for (auto a : _arrays) if (a and a->size() == n) arrays.push_back(a);
+
+  // first pass, within each block
+  std::vector<size_t> nkept(nblocks+1, 0);
+  #pragma omp parallel for schedule(static) if (nblocks > 4)
+  for (int32_t b=0; b<(int32_t)nblocks; ++b) {
+    const size_t i0 = b*compact_block;
+    const size_t i1 = std::min(n, i0+compact_block);
+    size_t j = i0;
+    for (size_t i=i0; i<i1; ++i) j += _keep[i];
+    nkept[b+1] = j - i0;
+    if (j == i1) continue;
+    for (auto a : arrays) {
+      auto& v = *a;
+      size_t k = i0;
+      for (size_t i=i0; i<i1; ++i) {
+        v[k] = v[i];
+        k += _keep[i];
+      }
+    }
+  }
+
+  // second pass, close the gaps between blocks
+  size_t nnew = 0;
+  for (size_t b=0; b<nblocks; ++b) {
+    const size_t i0 = b*compact_block;
+    if (nnew != i0) {
+      for (auto a : arrays) {
+        std::copy(a->begin()+i0, a->begin()+i0+nkept[b+1], a->begin()+nnew);
+      }
+    }
+    nnew += nkept[b+1];
+  }
+
+  for (auto a : arrays) a->resize(nnew);
+  return nnew;
+}
+
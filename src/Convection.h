@@ -15,7 +15,15 @@
 #include "BEMHelper.h"
 #include "InfluenceVort.h"
 #include "Reflect.h"
+#include "MpiHelper.h"
+#include "ThreadPool.h"
+#include "VelPlugin.h"
+#include "AutoTune.h"
+#include "PairCache.h"
+#include "TracerGrid.h"
+#include "Profiler.h"
 #include "GuiHelper.h"
+#include "Logger.h"
 
 #include <json/json.hpp>
 
@@ -23,6 +31,14 @@
 #include <iostream>
 #include <vector>
 #include <variant>
+#include <future>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <numeric>
+#include <random>
+#include <chrono>
+#include <cmath>
 #include <cassert>
 
 
@@ -36,7 +52,21 @@ class Convection {
 public:
   Convection()
     : convection_order(2),
-      conv_env()
+      low_storage(false),
+      conv_env(),
+      fldpt_interval(1),
+      fldpt_wait(0),
+      concurrent_fldpt(false),
+      reuse_vels(false),
+      reuse_trees(false),
+      reuse_pairs(false),
+      validate_interval(0),
+      validate_samples(1000),
+      validate_tol(0.0),
+      validate_wait(0),
+      validate_now(false),
+      vort_grads(false),
+      grads_now(false)
     {}
 
   void find_vort( std::vector<Collection>&,
@@ -54,6 +84,13 @@ public:
                   std::vector<Collection>&,
                   std::vector<Collection>&,
                   std::vector<Collection>&);
+  std::future<void> find_derivs_async(const double,
+                  const std::array<double,Dimensions>&,
+                  BEM<S,I>&,
+                  std::vector<Collection>&,
+                  std::vector<Collection>&,
+                  std::vector<Collection>&,
+                  const bool _reuse = false);
   void advect(    const double,
                   const double,
                   const std::array<double,Dimensions>&,
@@ -61,7 +98,8 @@ public:
                   std::vector<Collection>&,
                   std::vector<Collection>&,
                   std::vector<Collection>&,
-                  BEM<S,I>&);
+                  BEM<S,I>&,
+                  const bool _full_fldpt = false);
   void advect_1st(const double,
                   const double,
                   const std::array<double,Dimensions>&,
@@ -86,6 +124,14 @@ public:
                   std::vector<Collection>&,
                   std::vector<Collection>&,
                   BEM<S,I>&);
+  void advect_3ls(const double,
+                  const double,
+                  const std::array<double,Dimensions>&,
+                  const S,
+                  std::vector<Collection>&,
+                  std::vector<Collection>&,
+                  std::vector<Collection>&,
+                  BEM<S,I>&);
 
 #ifdef USE_IMGUI
   void draw_advanced();
@@ -95,15 +141,123 @@ public:
   void from_json(const nlohmann::json);
   void add_to_json(nlohmann::json&) const;
 
+  // the velocity summation method, core function, and images are also useful for the BEM rhs,
+  //   and the Simulation sets the images per case
+  const ExecEnv& get_env() const { return conv_env; }
+  ExecEnv& get_env() { return conv_env; }
+
+  // field points and tracers can take fresh velocities only every few steps
+  void set_fldpt_interval(const int32_t _k) { fldpt_interval = std::max(1, _k); }
+  int32_t get_fldpt_interval() const { return fldpt_interval; }
+
+  // the first velocity evaluation of each step also finds the particles' velocity gradients
+  void set_vort_grads(const bool _grads) { vort_grads = _grads; }
+
+  // how a fast summation compared with direct sums on a sample of the particles
+  struct Validation {
+    size_t nsamples = 0;
+    double max_err = 0.0;
+    double rms_err = 0.0;
+    double speedup = 0.0;
+  };
+  int32_t get_validate_interval() const { return validate_interval; }
+  const Validation& get_last_validation() const { return last_validation; }
+
+  // the stages are rebuilt every step, so only the field point countdown carries over
+  void write_state(CheckpointWriter& _out) const { _out.put(fldpt_wait); }
+  void read_state(CheckpointReader& _in) { fldpt_wait = _in.get<int32_t>(); }
+
+  // the stage copies and registers kept between steps
+  size_t get_mem_bytes() const {
+    size_t bytes = ::get_mem_bytes(stage_vort1) + ::get_mem_bytes(stage_vort2) +
+                   ::get_mem_bytes(stage_fldpt1) + ::get_mem_bytes(stage_fldpt2);
+    for (const auto& reg : ls_dvort) bytes += vec_bytes(reg);
+    for (const auto& reg : ls_dfldpt) bytes += vec_bytes(reg);
+    bytes += pair_cache.get_mem_bytes();
+    return bytes;
+  }
+
 private:
   // local copies of particle data
   //Particles<S> temp;
 
-  // integrator order
+  // integrator order, and whether 3rd order uses the two-register scheme, see advect_3ls
   int32_t convection_order;
+  bool low_storage;
 
   // execution environment for velocity summations (not BEM)
   ExecEnv conv_env;
+
+  // picks the summation per pair when conv_env says to
+  BackendTuner<S,A> tuner;
+
+  // steps between full integrations of the field points, and steps left until the next one
+  int32_t fldpt_interval;
+  int32_t fldpt_wait;
+
+  // evaluate field point velocities while the vorticity moves, see find_derivs_async
+  bool concurrent_fldpt;
+
+  // start each 2nd order step from the last step's final-stage velocities, see advect_2nd
+  bool reuse_vels;
+  std::vector<std::array<Vector<S>,Dimensions>> reused_u;
+
+  // later stages of a step refit the treecode or fmm trees of the first, see TreeCache.h
+  bool reuse_trees;
+
+  // pairs whose source and target have not changed since their last evaluation add what
+  //   they gave then, see PairCache.h
+  bool reuse_pairs;
+  PairCache<S> pair_cache;
+
+  // free tracers take their velocities from a grid over them, see TracerGrid.h
+  TracerGrid<S> tracer_grid;
+
+  // every validate_interval steps (0 never), compare the velocities from a treecode, fmm or
+  //   vic against direct sums on validate_samples particles, and if validate_tol is nonzero
+  //   tighten the approximation whenever the max error is larger, see validate_vels
+  int32_t validate_interval;
+  int32_t validate_samples;
+  double validate_tol;
+  int32_t validate_wait;
+  bool validate_now;
+  Validation last_validation;
+
+  // gradients are found along with the velocities, in the same sums, only when they are used
+  bool vort_grads;
+  bool grads_now;
+
+  void validate_vels(const std::array<double,Dimensions>&,
+                     std::vector<Collection>&,
+                     std::vector<Collection>&,
+                     const double);
+
+  // intermediate states for the multi-stage integrators, kept to reuse their storage
+  std::vector<Collection> stage_vort1, stage_vort2;
+  std::vector<Collection> stage_fldpt1, stage_fldpt2;
+
+  bool find_new_vort_vels(const std::array<double,Dimensions>&,
+                          std::vector<Collection>&,
+                          std::vector<Collection>&);
+  void start_stage(const double,
+                   const double,
+                   const std::vector<Collection>&,
+                   const std::vector<Collection>&,
+                   std::vector<Collection>&);
+
+  // the second register of the low-storage integrator, one per collection
+  typedef std::array<Vector<S>,Dimensions> Register;
+  std::vector<Register> ls_dvort, ls_dfldpt;
+
+  void ls_accumulate(const double,
+                     const double,
+                     std::vector<Collection>&,
+                     std::vector<Register>&);
+  void ls_advance(const double,
+                  const double,
+                  const double,
+                  std::vector<Collection>&,
+                  std::vector<Register>&);
 };
 
 
@@ -122,7 +276,7 @@ void Convection<S,A,I>::find_vort(std::vector<Collection>&             _vort,
   for (auto &targ : _targets) if (std::holds_alternative<Points<S>>(targ)) {
     Points<S>& ptarg = std::get<Points<S>>(targ);
 
-    std::cout << "  Solving vorticity on" << to_string(targ) << std::endl;
+    LOG_DEBUG("  Solving vorticity on" << to_string(targ));
 
     // zero vels and vorticity
     ptarg.zero_vels();
@@ -130,13 +284,13 @@ void Convection<S,A,I>::find_vort(std::vector<Collection>&             _vort,
     // accumulate from vorticity, but only from Points
     for (auto &src : _vort) if (std::holds_alternative<Points<S>>(src)) {
       Points<S>& psrc = std::get<Points<S>>(src);
-      points_affect_points_vorticity<float,A>(psrc, ptarg, conv_env);
+      points_affect_points_vorticity<S,A>(psrc, ptarg, conv_env);
     }
 
     // accumulate from reactive, but only from Points
     for (auto &src : _bdry) if (std::holds_alternative<Points<S>>(src)) {
       Points<S>& psrc = std::get<Points<S>>(src);
-      points_affect_points_vorticity<float,A>(psrc, ptarg, conv_env);
+      points_affect_points_vorticity<S,A>(psrc, ptarg, conv_env);
     }
 
     // finalize vels and vorticity by dividing by constant
@@ -161,13 +315,61 @@ void Convection<S,A,I>::find_vels(const std::array<double,Dimensions>& _fs,
 
   // need this for dispatching velocity influence calls, template param is accumulator type
   // member variable is passed-in execution environment
-  InfluenceVisitor<A> visitor = {ResultsType(_results), conv_env};
+  InfluenceVisitor<A> visitor = {ResultsType(_results), conv_env,
+                                 conv_env.use_auto_summation() ? &tuner : nullptr};
 
-  // add vortex and source strengths to account for rotating bodies
+  // add vortex and source strengths to account for rotating bodies, keeping the panels'
+  //   own so that they go back exactly as they were, see PairCache.h
+  std::vector<typename Surfaces<S>::SavedStrengths> saved_str;
   for (auto &src : _bdry) {
+    if (std::holds_alternative<Surfaces<S>>(src)) {
+      saved_str.push_back(std::get<Surfaces<S>>(src).save_strengths());
+    }
     std::visit([=](auto& elem) { elem.add_solved_rot_strengths(1.0); }, src);
   }
 
+  // one pair at a time, or from what that pair gave the last time if nothing changed; a
+  //   collection split over mpi ranks is a new one every call, so is never kept
+  const bool keep_pairs = reuse_pairs and mpi_size() == 1;
+  if (keep_pairs) pair_cache.next_pass();
+  auto visit_pair = [&](Collection& _src, Collection& _targ) {
+    if (keep_pairs) {
+      pair_cache.apply(_src, _targ, visitor.restype, conv_env, [&]() { std::visit(visitor, _src, _targ); });
+    } else {
+      std::visit(visitor, _src, _targ);
+    }
+  };
+
+  // a plugin or an external solver takes all of the particles' influence on all point
+  //   targets at once
+  std::vector<const Points<S>*> batched;
+  batch_vel_fn<S> batch_solver = nullptr;
+  if (conv_env.has_plugin()) {
+    batch_solver = VelPlugin::points_on_points<S>(VelPlugin::get(conv_env.get_plugin()));
+  }
+#ifdef EXTERNAL_VEL_SOLVE
+  else if (not conv_env.is_internal()) {
+    batch_solver = external_batch_solver<S>();
+  }
+#endif
+  if (batch_solver and mpi_size() == 1 and ResultsType(_results).compute_vel()
+      and not ResultsType(_results).compute_grad()) {
+    std::vector<const Points<S>*> srcs;
+    for (auto &src : _vort) {
+      if (std::holds_alternative<Points<S>>(src)) srcs.push_back(&std::get<Points<S>>(src));
+    }
+    std::vector<Points<S>*> targs;
+    for (auto &targ : _targets) {
+      if (not std::holds_alternative<Points<S>>(targ)) continue;
+      Points<S>& pts = std::get<Points<S>>(targ);
+      if (not (_force or pts.get_movet() == lagrangian)) continue;
+      pts.zero_vels();
+      targs.push_back(&pts);
+    }
+    batch_points_affect_points<S>(batch_solver, srcs, targs);
+    batched.assign(targs.begin(), targs.end());
+  }
+
   // find the influence on every field point/tracer element
   for (auto &targ : _targets) {
 
@@ -175,29 +377,258 @@ void Convection<S,A,I>::find_vels(const std::array<double,Dimensions>& _fs,
     const move_t tmt = std::visit([=](auto& elem) { return elem.get_movet(); }, targ);
     if (not (_force or tmt == lagrangian)) continue;
 
-    std::cout << "  Solving" << ResultsType(_results).to_string() << " on" << to_string(targ) << std::endl;
+    LOG_DEBUG("  Solving" << ResultsType(_results).to_string() << " on" << to_string(targ));
+
+    // only points and particles take velocity gradients
+    visitor.restype = ResultsType((_results == velandgrad and not std::holds_alternative<Points<S>>(targ)) ? velonly : _results);
+
+    // the particles' part is already in if this went through the batched solver
+    const bool is_batched = std::holds_alternative<Points<S>>(targ) and
+        std::find(batched.begin(), batched.end(), &std::get<Points<S>>(targ)) != batched.end();
+
+    auto solve_on = [&](Collection& _targ) {
+      if (not is_batched) {
+        // zero velocities
+        std::visit([=](auto& elem) { elem.zero_vels(); }, _targ);
+
+        // accumulate from vorticity
+        for (auto &src : _vort) {
+          visit_pair(src, _targ);
+        }
+      } else {
+        // the other vorticity still goes one pair at a time
+        for (auto &src : _vort) {
+          if (not std::holds_alternative<Points<S>>(src)) visit_pair(src, _targ);
+        }
+      }
+
+      // accumulate from boundaries
+      for (auto &src : _bdry) {
+        // call the Influence routine for these collections
+        visit_pair(src, _targ);
+      }
+
+      // add freestream and divide by constant
+      std::visit([=](auto& elem) { elem.finalize_vels(_fs); }, _targ);
+    };
+
+    if (mpi_size() > 1 and std::holds_alternative<Points<S>>(targ)) {
+      // with several ranks, each solves on its share of the particles, see MpiHelper.h
+      Points<S>& ptarg = std::get<Points<S>>(targ);
+      std::vector<int32_t> idx;
+      Collection local = mpi_local_targets<S>(ptarg, idx);
+      solve_on(local);
+      mpi_gather_vels<S>(ptarg, std::get<Points<S>>(local), idx);
+    } else {
+      solve_on(targ);
+    }
+  }
+
+  // remove vortex and source strengths due to rotation
+  size_t isaved = 0;
+  for (auto &src : _bdry) {
+    if (std::holds_alternative<Surfaces<S>>(src)) {
+      std::get<Surfaces<S>>(src).restore_strengths(std::move(saved_str[isaved++]));
+    } else {
+      std::visit([=](auto& elem) { elem.add_solved_rot_strengths(-1.0); }, src);
+    }
+  }
+}
 
-    // zero velocities
-    std::visit([=](auto& elem) { elem.zero_vels(); }, targ);
 
-    // accumulate from vorticity
-    for (auto &src : _vort) {
-      std::visit(visitor, src, targ);
+//
+// find velocities on only those particles which joined their collection after the last full
+//   evaluation, the rest keep theirs; returns false if it could not, and nothing was done
+//
+template <class S, class A, class I>
+bool Convection<S,A,I>::find_new_vort_vels(const std::array<double,Dimensions>& _fs,
+                                           std::vector<Collection>&             _vort,
+                                           std::vector<Collection>&             _bdry) {
+
+  for (auto &coll : _vort) {
+    if (not std::holds_alternative<Points<S>>(coll)) return false;
+    const Points<S>& pts = std::get<Points<S>>(coll);
+    if (pts.get_num_current_vels() == 0 or pts.get_bdry_vel()[0].size() != pts.get_n()) return false;
+  }
+
+  // copy the new particles into targets of their own
+  std::vector<Collection> tails;
+  std::vector<size_t> which;
+  size_t ntotal = 0;
+  for (size_t c=0; c<_vort.size(); ++c) {
+    const Points<S>& pts = std::get<Points<S>>(_vort[c]);
+    const size_t i0 = pts.get_num_current_vels();
+    const size_t nnew = pts.get_n() - i0;
+    if (nnew == 0) continue;
+
+    const std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+    std::vector<S> newx(Dimensions*nnew);
+    std::vector<S> news(pts.get_str().begin()+i0, pts.get_str().end());
+    for (size_t i=0; i<nnew; ++i) {
+      for (size_t d=0; d<Dimensions; ++d) newx[Dimensions*i+d] = x[d][i0+i];
     }
+    ElementPacket<S> packet(newx, std::vector<Int>(), news, nnew, 0);
+    Points<S> tail(packet, active, lagrangian, nullptr, 0.0);
+    std::copy(pts.get_rad().begin()+i0, pts.get_rad().end(), tail.get_rad().begin());
+    tails.emplace_back(std::move(tail));
+    which.push_back(c);
+    ntotal += nnew;
+  }
 
-    // accumulate from boundaries
-    for (auto &src : _bdry) {
-      // call the Influence routine for these collections
-      std::visit(visitor, src, targ);
+  LOG_INFO("  Reusing velocities on all but " << ntotal << " particles");
+
+  // the kept velocities hold the last step's freestream and panels, see advect_2nd, so
+  //   trade those for what they give after this step's BEM solve
+  reused_u.resize(_vort.size());
+  for (size_t c=0; c<_vort.size(); ++c) {
+    const Points<S>& pts = std::get<Points<S>>(_vort[c]);
+    const std::array<Vector<S>,Dimensions>& u = pts.get_vel();
+    const std::array<Vector<S>,Dimensions>& ub = pts.get_bdry_vel();
+    for (size_t d=0; d<Dimensions; ++d) {
+      reused_u[c][d].resize(pts.get_num_current_vels());
+      for (size_t i=0; i<pts.get_num_current_vels(); ++i) reused_u[c][d][i] = u[d][i] - ub[d][i];
+    }
+  }
+  std::vector<Collection> no_vort;
+  find_vels(_fs, no_vort, _bdry, _vort);
+  for (size_t c=0; c<_vort.size(); ++c) {
+    std::array<Vector<S>,Dimensions>& u = std::get<Points<S>>(_vort[c]).get_vel();
+    for (size_t d=0; d<Dimensions; ++d) {
+      for (size_t i=0; i<reused_u[c][d].size(); ++i) u[d][i] += reused_u[c][d][i];
     }
+  }
+
+  find_vels(_fs, _vort, _bdry, tails);
 
-    // add freestream and divide by constant
-    std::visit([=](auto& elem) { elem.finalize_vels(_fs); }, targ);
+  // and bring their velocities back
+  for (size_t t=0; t<tails.size(); ++t) {
+    Points<S>& pts = std::get<Points<S>>(_vort[which[t]]);
+    const size_t i0 = pts.get_num_current_vels();
+    const std::array<Vector<S>,Dimensions>& tu = std::get<Points<S>>(tails[t]).get_vel();
+    std::array<Vector<S>,Dimensions>& u = pts.get_vel();
+    for (size_t d=0; d<Dimensions; ++d) std::copy(tu[d].begin(), tu[d].end(), u[d].begin()+i0);
   }
+  return true;
+}
 
-  // remove vortex and source strengths due to rotation
-  for (auto &src : _bdry) {
-    std::visit([=](auto& elem) { elem.add_solved_rot_strengths(-1.0); }, src);
+
+//
+// compare the velocities just found on the particles against direct sums, on a random sample
+//   of them, the sample's cost scaled up to all of them gives the speedup over direct sums
+//
+// errors are relative to the rms of the flow's own velocity, the freestream taken out, as
+//   the error on any one particle near a stagnation point means little
+//
+template <class S, class A, class I>
+void Convection<S,A,I>::validate_vels(const std::array<double,Dimensions>& _fs,
+                                      std::vector<Collection>&             _vort,
+                                      std::vector<Collection>&             _bdry,
+                                      const double                         _fast_secs) {
+
+  PROFILE_ZONE("validate");
+
+  size_t ntotal = 0;
+  for (auto &coll : _vort) {
+    if (std::holds_alternative<Points<S>>(coll)) ntotal += std::get<Points<S>>(coll).get_n();
+  }
+  if (ntotal == 0) return;
+  const double frac = std::min(1.0, (double)validate_samples / (double)ntotal);
+
+  // copy the chosen particles into targets of their own, and keep their fast velocities
+  std::mt19937 rng(12345 + (uint32_t)ntotal);
+  std::vector<Collection> samples;
+  std::vector<std::array<std::vector<S>,Dimensions>> fastu;
+  size_t nsamp = 0;
+  for (auto &coll : _vort) {
+    if (not std::holds_alternative<Points<S>>(coll)) continue;
+    const Points<S>& pts = std::get<Points<S>>(coll);
+    const size_t n = pts.get_n();
+    const size_t ns = std::min(n, (size_t)std::ceil(frac*(double)n));
+    if (ns == 0) continue;
+
+    std::vector<size_t> all(n);
+    std::iota(all.begin(), all.end(), 0);
+    std::vector<size_t> idx;
+    idx.reserve(ns);
+    std::sample(all.begin(), all.end(), std::back_inserter(idx), ns, rng);
+
+    const std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+    const std::array<Vector<S>,Dimensions>& u = pts.get_vel();
+    std::vector<S> newx(Dimensions*ns);
+    std::vector<S> news(ns);
+    std::array<std::vector<S>,Dimensions> newu;
+    for (size_t d=0; d<Dimensions; ++d) newu[d].resize(ns);
+    for (size_t i=0; i<ns; ++i) {
+      for (size_t d=0; d<Dimensions; ++d) {
+        newx[Dimensions*i+d] = x[d][idx[i]];
+        newu[d][i] = u[d][idx[i]];
+      }
+      news[i] = pts.get_str()[idx[i]];
+    }
+    ElementPacket<S> packet(newx, std::vector<Int>(), news, ns, 0);
+    Points<S> sample(packet, active, lagrangian, nullptr, 0.0);
+    for (size_t i=0; i<ns; ++i) sample.get_rad()[i] = pts.get_rad()[idx[i]];
+    samples.emplace_back(std::move(sample));
+    fastu.push_back(std::move(newu));
+    nsamp += ns;
+  }
+
+  // the exact path: direct sums, and every panel exact
+  const summation_t summ = conv_env.get_summation();
+  const float pnear = conv_env.get_panel_near_field();
+  const bool autosumm = conv_env.use_auto_summation();
+  conv_env.set_summation(direct);
+  conv_env.set_panel_near_field(0.0);
+  conv_env.set_auto_summation(false);
+  const auto start = std::chrono::steady_clock::now();
+  find_vels(_fs, _vort, _bdry, samples);
+  const double direct_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  conv_env.set_summation(summ);
+  conv_env.set_panel_near_field(pnear);
+  conv_env.set_auto_summation(autosumm);
+
+  double maxdu = 0.0, sumdu2 = 0.0, sumu2 = 0.0;
+  for (size_t c=0; c<samples.size(); ++c) {
+    const std::array<Vector<S>,Dimensions>& u = std::get<Points<S>>(samples[c]).get_vel();
+    for (size_t i=0; i<u[0].size(); ++i) {
+      double du2 = 0.0, u2 = 0.0;
+      for (size_t d=0; d<Dimensions; ++d) {
+        const double du = (double)fastu[c][d][i] - (double)u[d][i];
+        const double uf = (double)u[d][i] - _fs[d];
+        du2 += du*du;
+        u2 += uf*uf;
+      }
+      maxdu = std::max(maxdu, std::sqrt(du2));
+      sumdu2 += du2;
+      sumu2 += u2;
+    }
+  }
+  const double urms = std::sqrt(sumu2 / (double)nsamp);
+
+  last_validation.nsamples = nsamp;
+  last_validation.max_err = (urms > 0.0) ? maxdu / urms : 0.0;
+  last_validation.rms_err = (urms > 0.0) ? std::sqrt(sumdu2 / (double)nsamp) / urms : 0.0;
+  last_validation.speedup = (_fast_secs > 0.0) ? direct_secs * (double)ntotal / (double)nsamp / _fast_secs : 0.0;
+
+  LOG_INFO("  Validated" << conv_env.to_string() << " on " << nsamp << " particles: max err "
+            << last_validation.max_err << ", rms err " << last_validation.rms_err << ", speedup "
+            << last_validation.speedup);
+
+  // tighten whichever parameter sets the accuracy, the new value shows up in the next step
+  if (validate_tol > 0.0 and last_validation.max_err > validate_tol) {
+    if (summ == fmm and conv_env.get_expansion_order() < 16) {
+      conv_env.set_expansion_order(conv_env.get_expansion_order() + 2);
+      LOG_INFO("  Error over " << validate_tol << ", raising expansion order to "
+                << conv_env.get_expansion_order());
+    } else if (summ == vic) {
+      conv_env.set_vic_cell_ratio(std::max(0.5f, 0.8f*conv_env.get_vic_cell_ratio()));
+      LOG_INFO("  Error over " << validate_tol << ", reducing vic cell ratio to "
+                << conv_env.get_vic_cell_ratio());
+    } else {
+      conv_env.set_opening_angle(std::max(0.1f, 0.8f*conv_env.get_opening_angle()));
+      LOG_INFO("  Error over " << validate_tol << ", reducing opening angle to "
+                << conv_env.get_opening_angle());
+    }
   }
 }
 
@@ -213,12 +644,68 @@ void Convection<S,A,I>::find_derivs(const double                         _time,
                                     std::vector<Collection>&             _vort,
                                     std::vector<Collection>&             _fldpt) {
 
+  find_derivs_async(_time, _fs, _bem, _bdry, _vort, _fldpt).get();
+}
+
+//
+// the same, but nothing feeds back from the field points, so their velocities can be found
+//   while the caller moves copies of the vorticity; the returned future must be waited on
+//   before anything changes these sources or the field points
+//
+// the vorticity on itself has already built every source cache, but the two threads do share
+//   the boundaries: the field-point thread adds and then removes the rotation strengths on
+//   _bdry, so the caller may use only their geometry until the wait, and both threads search
+//   the panel trees, so those are brought up to date here first; without concurrent_fldpt
+//   the work is simply deferred to the wait
+//
+template <class S, class A, class I>
+std::future<void> Convection<S,A,I>::find_derivs_async(const double                         _time,
+                                                       const std::array<double,Dimensions>& _fs,
+                                                       BEM<S,I>&                            _bem,
+                                                       std::vector<Collection>&             _bdry,
+                                                       std::vector<Collection>&             _vort,
+                                                       std::vector<Collection>&             _fldpt,
+                                                       const bool                           _reuse) {
+
   // and solve the bem
-  solve_bem<S,A,I>(_time, _fs, _vort, _bdry, _bem);
+  solve_bem<S,A,I>(_time, _fs, _vort, _bdry, _bem, conv_env);
 
   //find the vels
-  find_vels(_fs, _vort, _bdry, _vort);
-  find_vels(_fs, _vort, _bdry, _fldpt);
+  {
+    PROFILE_ZONE("velocities");
+    const auto vstart = std::chrono::steady_clock::now();
+    const results_t vres = grads_now ? velandgrad : velonly;
+    grads_now = false;
+    if (not (_reuse and find_new_vort_vels(_fs, _vort, _bdry))) {
+      find_vels(_fs, _vort, _bdry, _vort, vres);
+      // only a full evaluation is worth checking, and timing
+      if (validate_now) {
+        validate_now = false;
+        validate_vels(_fs, _vort, _bdry,
+                      std::chrono::duration<double>(std::chrono::steady_clock::now() - vstart).count());
+      }
+    }
+  }
+
+  // the tracers and the caller's clear_inner_layer would otherwise both rebuild a moved tree
+  if (concurrent_fldpt) {
+    for (auto &coll : _bdry) {
+      if (std::holds_alternative<Surfaces<S>>(coll)) (void) std::get<Surfaces<S>>(coll).get_panel_tree();
+    }
+  }
+
+  // only timed when it is not running beside the step
+  auto job = [this, _fs, &_vort, &_bdry, &_fldpt]() {
+    PROFILE_ZONE("field points");
+    if (tracer_grid.is_active()) {
+      tracer_grid.find_vels(_fldpt, _bdry,
+                            [&](std::vector<Collection>& _targs) { find_vels(_fs, _vort, _bdry, _targs); });
+    } else {
+      find_vels(_fs, _vort, _bdry, _fldpt);
+    }
+  };
+  if (concurrent_fldpt) return ThreadPool::background().submit(job);
+  return std::async(std::launch::deferred, job);
 }
 
 
@@ -233,14 +720,59 @@ void Convection<S,A,I>::advect(const double                         _time,
                                std::vector<Collection>&             _vort,
                                std::vector<Collection>&             _bdry,
                                std::vector<Collection>&             _fldpt,
-                               BEM<S,I>&                            _bem) {
+                               BEM<S,I>&                            _bem,
+                               const bool                           _full_fldpt) {
 
   assert(convection_order > 0 and convection_order < 4 && "Convection integrator orders over 3 unsupported");
+  PROFILE_ZONE("convection");
+
+  // field points only affect output, so in between full updates (and output times) they
+  //   coast on the velocities from their last full update
+  const bool do_fldpt = _full_fldpt or fldpt_wait <= 0;
+
+  // and fixed ones never move, so nothing in a step needs their velocities: they are found
+  //   when output asks for them (Simulation::write_vtk), and only the tracers are integrated
+  std::vector<Collection> fldpt;
+  std::vector<size_t> fldpt_idx;
+  if (do_fldpt) {
+    for (size_t i=0; i<_fldpt.size(); ++i) {
+      if (std::visit([=](auto& elem) { return elem.get_movet(); }, _fldpt[i]) == fixed) continue;
+      fldpt.push_back(std::move(_fldpt[i]));
+      fldpt_idx.push_back(i);
+    }
+  }
+
+  // trees built during this step may be refit by its later stages, but not by the next step
+  conv_env.set_tree_tag(reuse_trees ? next_state_gen() : 0);
+
+  // the first full velocity evaluation of this step gets checked against direct sums
+  if (validate_interval > 0 and (conv_env.get_summation() != direct or conv_env.use_auto_summation())
+      and --validate_wait <= 0) {
+    validate_now = true;
+    validate_wait = validate_interval;
+  }
+
+  // and so are the gradients, if wanted
+  grads_now = vort_grads;
 
   // call the individual methods
-  if (convection_order == 1) advect_1st(_time, _dt, _fs, _ips, _vort, _bdry, _fldpt, _bem);
-  else if (convection_order == 2) advect_2nd(_time, _dt, _fs, _ips, _vort, _bdry, _fldpt, _bem);
-  else advect_3rd(_time, _dt, _fs, _ips, _vort, _bdry, _fldpt, _bem);
+  if (convection_order == 1) advect_1st(_time, _dt, _fs, _ips, _vort, _bdry, fldpt, _bem);
+  else if (convection_order == 2) advect_2nd(_time, _dt, _fs, _ips, _vort, _bdry, fldpt, _bem);
+  else if (low_storage) advect_3ls(_time, _dt, _fs, _ips, _vort, _bdry, fldpt, _bem);
+  else advect_3rd(_time, _dt, _fs, _ips, _vort, _bdry, fldpt, _bem);
+
+  if (do_fldpt) {
+    for (size_t i=0; i<fldpt.size(); ++i) _fldpt[fldpt_idx[i]] = std::move(fldpt[i]);
+    fldpt_wait = fldpt_interval - 1;
+  } else {
+    LOG_INFO("  Coasting field points, " << fldpt_wait << " steps until the next update");
+    for (auto &coll : _fldpt) {
+      if (std::visit([=](auto& elem) { return elem.get_movet(); }, coll) == fixed) continue;
+      std::visit([=](auto& elem) { elem.move(_time, _dt, 1.0, elem); }, coll);
+    }
+    clear_inner_layer<S>(1, _bdry, _fldpt, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
+    --fldpt_wait;
+  }
 
   // do the smarter, general way - ugh, maybe later
 
@@ -275,6 +807,38 @@ void Convection<S,A,I>::advect(const double                         _time,
 }
 
 
+//
+// set a stage to the elements of _from moved over _dt with the velocities of _vels
+//
+// this copies only positions, strengths, and radii, into storage kept from the last step,
+//   so nothing is allocated unless the particle count grew
+//
+template <class S, class A, class I>
+void Convection<S,A,I>::start_stage(const double                   _time,
+                                    const double                   _dt,
+                                    const std::vector<Collection>& _from,
+                                    const std::vector<Collection>& _vels,
+                                    std::vector<Collection>&       _stage) {
+
+  if (_stage.size() != _from.size()) _stage = _from;
+
+  for (size_t i=0; i<_from.size(); ++i) {
+    if (std::holds_alternative<Points<S>>(_from[i]) and std::holds_alternative<Points<S>>(_stage[i])) {
+      Points<S>& pts = std::get<Points<S>>(_stage[i]);
+      pts.copy_state_from(std::get<Points<S>>(_from[i]));
+      pts.move(_time, _dt, 1.0, std::get<Points<S>>(_vels[i]));
+    } else {
+      _stage[i] = _from[i];
+      std::visit([=](auto& elem, const auto& vel) {
+        if constexpr (std::is_same<std::decay_t<decltype(elem)>, std::decay_t<decltype(vel)>>::value) {
+          elem.move(_time, _dt, 1.0, vel);
+        }
+      }, _stage[i], _vels[i]);
+    }
+  }
+}
+
+
 //
 // first-order Euler forward integration
 //
@@ -288,7 +852,7 @@ void Convection<S,A,I>::advect_1st(const double                         _time,
                                    std::vector<Collection>&             _fldpt,
                                    BEM<S,I>&                            _bem) {
 
-  std::cout << "Inside Convection::advect_1st with dt=" << _dt << std::endl;
+  LOG_INFO("Inside Convection::advect_1st with dt=" << _dt);
 
   // compute derivatives
   find_derivs(_time, _fs, _bem, _bdry, _vort, _fldpt);
@@ -305,7 +869,7 @@ void Convection<S,A,I>::advect_1st(const double                         _time,
   }
 
   // wrap up movement by pushing away particles inside or too close to the body
-  clear_inner_layer<S>(1, _bdry, _vort, 0.5/std::sqrt(2.0*M_PI), _ips);
+  clear_inner_layer<S>(1, _bdry, _vort, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
 }
 
 
@@ -322,33 +886,30 @@ void Convection<S,A,I>::advect_2nd(const double                         _time,
                                    std::vector<Collection>&             _fldpt,
                                    BEM<S,I>&                            _bem) {
 
-  std::cout << "Inside Convection::advect_2nd with dt=" << _dt << std::endl;
+  LOG_INFO("Inside Convection::advect_2nd with dt=" << _dt);
 
   // take the first Euler step ---------
 
-  // compute derivatives
-  find_derivs(_time, _fs, _bem, _bdry, _vort, _fldpt);
+  // compute derivatives, maybe starting from the velocities of the last step's second stage
+  std::future<void> fldpt_vels = find_derivs_async(_time, _fs, _bem, _bdry, _vort, _fldpt, reuse_vels);
 
   // advect into an intermediate system
-  std::vector<Collection> interim_vort = _vort;
-  for (auto &coll : interim_vort) {
-    std::visit([=](auto& elem) { elem.move(_time, _dt, 1.0, elem); }, coll);
-  }
-  clear_inner_layer<S>(1, _bdry, interim_vort, 0.5/std::sqrt(2.0*M_PI), _ips);
+  std::vector<Collection>& interim_vort = stage_vort1;
+  start_stage(_time, _dt, _vort, _vort, interim_vort);
+  clear_inner_layer<S>(1, _bdry, interim_vort, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
   // now _vort has its original positions and the velocities evaluated there
   // and interm_vort has the positions at t+dt
 
-  // do the same for fldpt
-  std::vector<Collection> interim_fldpt = _fldpt;
-  for (auto &coll : interim_fldpt) {
-    std::visit([=](auto& elem) { elem.move(_time, _dt, 1.0, elem); }, coll);
-  }
-  clear_inner_layer<S>(1, _bdry, interim_fldpt, 0.5/std::sqrt(2.0*M_PI), _ips);
+  // do the same for fldpt, once their velocities are done
+  fldpt_vels.get();
+  std::vector<Collection>& interim_fldpt = stage_fldpt1;
+  start_stage(_time, _dt, _fldpt, _fldpt, interim_fldpt);
+  clear_inner_layer<S>(1, _bdry, interim_fldpt, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
 
   // begin the 2nd step ---------
 
   // compute derivatives
-  find_derivs(_time+_dt, _fs, _bem, _bdry, interim_vort, interim_fldpt);
+  fldpt_vels = find_derivs_async(_time+_dt, _fs, _bem, _bdry, interim_vort, interim_fldpt);
 
   // _vort still has its original positions and the velocities evaluated there
   // but interm_vort now has the velocities at t+dt
@@ -360,24 +921,46 @@ void Convection<S,A,I>::advect_2nd(const double                         _time,
     Collection& c1 = *v1p;
     Collection& c2 = *v2p;
     // switch based on what type is actually held in the std::variant
-    if (std::holds_alternative<Points<float>>(c1) and std::holds_alternative<Points<float>>(c2)) {
-      Points<float>& p1 = std::get<Points<float>>(c1);
-      Points<float>& p2 = std::get<Points<float>>(c2);
+    if (std::holds_alternative<Points<S>>(c1) and std::holds_alternative<Points<S>>(c2)) {
+      Points<S>& p1 = std::get<Points<S>>(c1);
+      Points<S>& p2 = std::get<Points<S>>(c2);
       p1.move(_time, _dt, 0.5, p1, 0.5, p2);
+      if (reuse_vels) p1.get_vel() = std::as_const(p2).get_vel();
     }
     ++v1p;
     ++v2p;
   }
 
+  fldpt_vels.get();
+
+  // the next step can start from the predictor's velocities: it trades their freestream and
+  //   panel part, kept here, for its own, and the vorticity's part is within O(dt^2) of that
+  //   at the new positions, so the step stays second order
+  if (reuse_vels) {
+    std::vector<Collection> no_vort;
+    find_vels(_fs, no_vort, _bdry, interim_vort);
+    for (size_t i = 0; i < _vort.size(); ++i) {
+      if (not std::holds_alternative<Points<S>>(_vort[i]) or
+          not std::holds_alternative<Points<S>>(interim_vort[i])) continue;
+      Points<S>& p1 = std::get<Points<S>>(_vort[i]);
+      const Points<S>& p2 = std::get<Points<S>>(interim_vort[i]);
+      if (p2.get_n() != p1.get_n()) {
+        p1.set_num_current_vels(0);
+        continue;
+      }
+      p1.get_bdry_vel() = p2.get_vel();
+      p1.set_num_current_vels(p1.get_n());
+    }
+  }
   v1p = _fldpt.begin();
   v2p = interim_fldpt.begin();
   for (size_t i = 0; i < _fldpt.size(); ++i) {
     Collection& c1 = *v1p;
     Collection& c2 = *v2p;
     // switch based on what type is actually held in the std::variant
-    if (std::holds_alternative<Points<float>>(c1) and std::holds_alternative<Points<float>>(c2)) {
-      Points<float>& p1 = std::get<Points<float>>(c1);
-      Points<float>& p2 = std::get<Points<float>>(c2);
+    if (std::holds_alternative<Points<S>>(c1) and std::holds_alternative<Points<S>>(c2)) {
+      Points<S>& p1 = std::get<Points<S>>(c1);
+      Points<S>& p2 = std::get<Points<S>>(c2);
       p1.move(_time, _dt, 0.5, p1, 0.5, p2);
     }
     ++v1p;
@@ -385,8 +968,8 @@ void Convection<S,A,I>::advect_2nd(const double                         _time,
   }
 
   // wrap up movement by pushing away *active* particles inside or too close to the body
-  clear_inner_layer<S>(1, _bdry, _vort, 0.5/std::sqrt(2.0*M_PI), _ips);
-  clear_inner_layer<S>(1, _bdry, _fldpt, 0.5/std::sqrt(2.0*M_PI), _ips);
+  clear_inner_layer<S>(1, _bdry, _vort, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
+  clear_inner_layer<S>(1, _bdry, _fldpt, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
 }
 
 
@@ -403,26 +986,23 @@ void Convection<S,A,I>::advect_3rd(const double                         _time,
                                    std::vector<Collection>&             _fldpt,
                                    BEM<S,I>&                            _bem) {
 
-  std::cout << "Inside Convection::advect_3rd with dt=" << _dt << std::endl;
+  LOG_INFO("Inside Convection::advect_3rd with dt=" << _dt);
 
   // take the first Euler step ------------------------------------
 
   // compute derivatives
-  find_derivs(_time, _fs, _bem, _bdry, _vort, _fldpt);
+  std::future<void> fldpt_vels = find_derivs_async(_time, _fs, _bem, _bdry, _vort, _fldpt);
 
   // advect into an intermediate system
-  std::vector<Collection> vort1 = _vort;
-  for (auto &coll : vort1) {
-    std::visit([=](auto& elem) { elem.move(_time, 0.5*_dt, 1.0, elem); }, coll);
-  }
-  clear_inner_layer<S>(1, _bdry, vort1, 0.5/std::sqrt(2.0*M_PI), _ips);
+  std::vector<Collection>& vort1 = stage_vort1;
+  start_stage(_time, 0.5*_dt, _vort, _vort, vort1);
+  clear_inner_layer<S>(1, _bdry, vort1, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
 
-  // do the same for fldpt
-  std::vector<Collection> fldpt1 = _fldpt;
-  for (auto &coll : fldpt1) {
-    std::visit([=](auto& elem) { elem.move(_time, 0.5*_dt, 1.0, elem); }, coll);
-  }
-  clear_inner_layer<S>(1, _bdry, fldpt1, 0.5/std::sqrt(2.0*M_PI), _ips);
+  // do the same for fldpt, once their velocities are done
+  fldpt_vels.get();
+  std::vector<Collection>& fldpt1 = stage_fldpt1;
+  start_stage(_time, 0.5*_dt, _fldpt, _fldpt, fldpt1);
+  clear_inner_layer<S>(1, _bdry, fldpt1, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
 
   // now _vort has its original positions and the velocities evaluated there
   // and vort1 has the positions at t+0.5*dt
@@ -430,66 +1010,42 @@ void Convection<S,A,I>::advect_3rd(const double                         _time,
   // begin the 2nd step -------------------------------------------
 
   // compute derivatives
-  find_derivs(_time+0.5*_dt, _fs, _bem, _bdry, vort1, fldpt1);
+  fldpt_vels = find_derivs_async(_time+0.5*_dt, _fs, _bem, _bdry, vort1, fldpt1);
 
   // _vort still has its original positions and the velocities evaluated there
   // but vort1 now has positions and velocities at t+0.5*dt
 
   // advect the original positions into a second intermediate system using the vels from the first intermediate
-  std::vector<Collection> vort2 = _vort;
-  auto v1p = vort1.begin();
-  auto v2p = vort2.begin();
-  for (size_t i = 0; i < vort1.size(); ++i) {
-    Collection& c1 = *v1p;
-    Collection& c2 = *v2p;
-    if (std::holds_alternative<Points<float>>(c1) and std::holds_alternative<Points<float>>(c2)) {
-      Points<float>& p1 = std::get<Points<float>>(c1);
-      Points<float>& p2 = std::get<Points<float>>(c2);
-      p2.move(_time, 0.75*_dt, 1.0, p1);
-    }
-    ++v1p;
-    ++v2p;
-  }
-  clear_inner_layer<S>(1, _bdry, vort2, 0.5/std::sqrt(2.0*M_PI), _ips);
+  std::vector<Collection>& vort2 = stage_vort2;
+  start_stage(_time, 0.75*_dt, _vort, vort1, vort2);
+  clear_inner_layer<S>(1, _bdry, vort2, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
 
   // do the same for fldpt
-  std::vector<Collection> fldpt2 = _fldpt;
-  v1p = fldpt1.begin();
-  v2p = fldpt2.begin();
-  for (size_t i = 0; i < fldpt1.size(); ++i) {
-    Collection& c1 = *v1p;
-    Collection& c2 = *v2p;
-    // switch based on what type is actually held in the std::variant
-    if (std::holds_alternative<Points<float>>(c1) and std::holds_alternative<Points<float>>(c2)) {
-      Points<float>& p1 = std::get<Points<float>>(c1);
-      Points<float>& p2 = std::get<Points<float>>(c2);
-      p2.move(_time, 0.75*_dt, 1.0, p1);
-    }
-    ++v1p;
-    ++v2p;
-  }
-  clear_inner_layer<S>(1, _bdry, fldpt2, 0.5/std::sqrt(2.0*M_PI), _ips);
+  fldpt_vels.get();
+  std::vector<Collection>& fldpt2 = stage_fldpt2;
+  start_stage(_time, 0.75*_dt, _fldpt, fldpt1, fldpt2);
+  clear_inner_layer<S>(1, _bdry, fldpt2, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
   // now vort2 has positions at t+0.75*dt
 
   // begin the 3rd step -------------------------------------------
 
   // compute derivatives
-  find_derivs(_time+0.75*_dt, _fs, _bem, _bdry, vort2, fldpt2);
+  fldpt_vels = find_derivs_async(_time+0.75*_dt, _fs, _bem, _bdry, vort2, fldpt2);
   // now vort2 has positions and vels at t+0.75*dt
 
   // advect using the combination of all three velocities
   auto v0p = _vort.begin();
-  v1p = vort1.begin();
-  v2p = vort2.begin();
+  auto v1p = vort1.begin();
+  auto v2p = vort2.begin();
   for (size_t i = 0; i < _vort.size(); ++i) {
     Collection& c0 = *v0p;
     Collection& c1 = *v1p;
     Collection& c2 = *v2p;
     // switch based on what type is actually held in the std::variant
-    if (std::holds_alternative<Points<float>>(c0)) {
-      Points<float>& p0 = std::get<Points<float>>(c0);
-      Points<float>& p1 = std::get<Points<float>>(c1);
-      Points<float>& p2 = std::get<Points<float>>(c2);
+    if (std::holds_alternative<Points<S>>(c0)) {
+      Points<S>& p0 = std::get<Points<S>>(c0);
+      Points<S>& p1 = std::get<Points<S>>(c1);
+      Points<S>& p2 = std::get<Points<S>>(c2);
       p0.move(_time, _dt, 2.0/9.0, p0, 3.0/9.0, p1, 4.0/9.0, p2);
     }
     ++v0p;
@@ -497,6 +1053,7 @@ void Convection<S,A,I>::advect_3rd(const double                         _time,
     ++v2p;
   }
 
+  fldpt_vels.get();
   v0p = _fldpt.begin();
   v1p = fldpt1.begin();
   v2p = fldpt2.begin();
@@ -505,10 +1062,10 @@ void Convection<S,A,I>::advect_3rd(const double                         _time,
     Collection& c1 = *v1p;
     Collection& c2 = *v2p;
     // switch based on what type is actually held in the std::variant
-    if (std::holds_alternative<Points<float>>(c0)) {
-      Points<float>& p0 = std::get<Points<float>>(c0);
-      Points<float>& p1 = std::get<Points<float>>(c1);
-      Points<float>& p2 = std::get<Points<float>>(c2);
+    if (std::holds_alternative<Points<S>>(c0)) {
+      Points<S>& p0 = std::get<Points<S>>(c0);
+      Points<S>& p1 = std::get<Points<S>>(c1);
+      Points<S>& p2 = std::get<Points<S>>(c2);
       p0.move(_time, _dt, 2.0/9.0, p0, 3.0/9.0, p1, 4.0/9.0, p2);
     }
     ++v0p;
@@ -517,8 +1074,116 @@ void Convection<S,A,I>::advect_3rd(const double                         _time,
   }
 
   // wrap up movement by pushing away *active* particles inside or too close to the body
-  clear_inner_layer<S>(1, _bdry, _vort, 0.5/std::sqrt(2.0*M_PI), _ips);
-  clear_inner_layer<S>(1, _bdry, _fldpt, 0.5/std::sqrt(2.0*M_PI), _ips);
+  clear_inner_layer<S>(1, _bdry, _vort, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
+  clear_inner_layer<S>(1, _bdry, _fldpt, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
+}
+
+
+//
+// third-order low-storage RK3 forward integration (Williamson's)
+//
+// each stage samples the velocities at the current positions, then
+//   dx = a_k dx + dt u,  x = x + b_k dx
+// so besides the elements themselves there is only the one register dx per collection,
+//   where advect_3rd holds two full copies of every collection
+//
+// the stages move the elements in place, so the field point velocities must be done
+//   before the vorticity moves; the register update overlaps them instead
+//
+template <class S, class A, class I>
+void Convection<S,A,I>::advect_3ls(const double                         _time,
+                                   const double                         _dt,
+                                   const std::array<double,Dimensions>& _fs,
+                                   const S                              _ips,
+                                   std::vector<Collection>&             _vort,
+                                   std::vector<Collection>&             _bdry,
+                                   std::vector<Collection>&             _fldpt,
+                                   BEM<S,I>&                            _bem) {
+
+  LOG_INFO("Inside Convection::advect_3ls with dt=" << _dt);
+
+  // Williamson (1980), case 7
+  const std::array<double,3> ca = {0.0, -5.0/9.0, -153.0/128.0};
+  const std::array<double,3> cb = {1.0/3.0, 15.0/16.0, 8.0/15.0};
+  const std::array<double,4> ct = {0.0, 1.0/3.0, 3.0/4.0, 1.0};
+
+  for (size_t k=0; k<3; ++k) {
+    LOG_DEBUG("  Low-storage stage " << k+1);
+
+    // compute derivatives at t + c_k dt
+    std::future<void> fldpt_vels = find_derivs_async(_time+ct[k]*_dt, _fs, _bem, _bdry, _vort, _fldpt);
+    ls_accumulate(ca[k], _dt, _vort, ls_dvort);
+
+    // nothing moves until the field points are done with the vorticity
+    fldpt_vels.get();
+    ls_accumulate(ca[k], _dt, _fldpt, ls_dfldpt);
+
+    // and advance both to t + c_(k+1) dt
+    ls_advance(_time, ct[k+1]*_dt, cb[k], _vort, ls_dvort);
+    ls_advance(_time, ct[k+1]*_dt, cb[k], _fldpt, ls_dfldpt);
+
+    // push away *active* particles inside or too close to the body
+    clear_inner_layer<S>(1, _bdry, _vort, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
+    clear_inner_layer<S>(1, _bdry, _fldpt, 0.5/std::sqrt(2.0*M_PI), _ips, conv_env.get_symmetry_plane());
+  }
+
+  for (auto &coll : _vort) {
+    if (std::holds_alternative<Points<S>>(coll)) std::get<Points<S>>(coll).update_max_str();
+  }
+}
+
+//
+// dx = a dx + dt u on every Lagrangian particle, sizing the registers as needed
+//
+template <class S, class A, class I>
+void Convection<S,A,I>::ls_accumulate(const double             _a,
+                                      const double             _dt,
+                                      std::vector<Collection>& _coll,
+                                      std::vector<Register>&   _dx) {
+
+  _dx.resize(_coll.size());
+  for (size_t c=0; c<_coll.size(); ++c) {
+    if (not std::holds_alternative<Points<S>>(_coll[c])) continue;
+    const Points<S>& pts = std::get<Points<S>>(_coll[c]);
+    if (pts.get_movet() != lagrangian) continue;
+
+    const std::array<Vector<S>,Dimensions>& u = pts.get_vel();
+    for (size_t d=0; d<Dimensions; ++d) {
+      Vector<S>& dx = _dx[c][d];
+      dx.resize(pts.get_n());
+      // the first stage starts the register, whatever it held before
+      if (_a == 0.0) {
+        for (size_t i=0; i<pts.get_n(); ++i) dx[i] = (S)_dt * u[d][i];
+      } else {
+        for (size_t i=0; i<pts.get_n(); ++i) dx[i] = (S)_a * dx[i] + (S)_dt * u[d][i];
+      }
+    }
+  }
+}
+
+//
+// x = x + b dx on every Lagrangian particle, everything else just goes to the stage time
+//
+template <class S, class A, class I>
+void Convection<S,A,I>::ls_advance(const double             _time,
+                                   const double             _dt,
+                                   const double             _b,
+                                   std::vector<Collection>& _coll,
+                                   std::vector<Register>&   _dx) {
+
+  for (size_t c=0; c<_coll.size(); ++c) {
+    if (std::holds_alternative<Points<S>>(_coll[c]) and
+        std::get<Points<S>>(_coll[c]).get_movet() == lagrangian) {
+      Points<S>& pts = std::get<Points<S>>(_coll[c]);
+      LOG_DEBUG("  Moving" << pts.to_string());
+      std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+      for (size_t d=0; d<Dimensions; ++d) {
+        for (size_t i=0; i<pts.get_n(); ++i) x[d][i] += (S)_b * _dx[c][d][i];
+      }
+    } else {
+      std::visit([=](auto& elem) { elem.move(_time, _dt, 0.0, elem); }, _coll[c]);
+    }
+  }
 }
 
 
@@ -565,6 +1230,29 @@ void Convection<S,A,I>::draw_advanced() {
         case 1: conv_env.set_instrs(cpu_vc); break;
     } // end switch
   #endif
+#elif defined(USE_STDSIMD)
+  #ifdef USE_OGL_COMPUTE
+    static int acc_item = 2;
+    const char* acc_items[] = { "x86 (CPU)", "SIMD (CPU)", "OpenGL (GPU)" };
+    ImGui::PushItemWidth(240);
+    ImGui::Combo("Select instructions", &acc_item, acc_items, 3);
+    ImGui::PopItemWidth();
+    switch(acc_item) {
+        case 0: conv_env.set_instrs(cpu_x86); break;
+        case 1: conv_env.set_instrs(cpu_simd); break;
+        case 2: conv_env.set_instrs(gpu_opengl); break;
+    } // end switch
+  #else
+    static int acc_item = 1;
+    const char* acc_items[] = { "x86 (CPU)", "SIMD (CPU)" };
+    ImGui::PushItemWidth(240);
+    ImGui::Combo("Select instructions", &acc_item, acc_items, 2);
+    ImGui::PopItemWidth();
+    switch(acc_item) {
+        case 0: conv_env.set_instrs(cpu_x86); break;
+        case 1: conv_env.set_instrs(cpu_simd); break;
+    } // end switch
+  #endif
 #else
   #ifdef USE_OGL_COMPUTE
     static int acc_item = 1;
@@ -583,24 +1271,98 @@ void Convection<S,A,I>::draw_advanced() {
 #endif
 
     // now, depending on which was selected, allow different summation algorithms
-    //static int algo_item = 0;
-    const accel_t accel_selected = conv_env.get_instrs();
-    if (accel_selected == cpu_x86) {
-      ImGui::Text("Algorithm is direct, O(N^2)");
-      conv_env.set_summation(direct);
-      //const char* algo_items[] = { "direct, O(N^2)", "treecode, O(NlogN)" };
-      //ImGui::PushItemWidth(240);
-      //ImGui::Combo("Select algorithm", &algo_item, algo_items, 2);
-      //ImGui::PopItemWidth();
-      //switch(algo_item) {
-      //  case 0: conv_env.set_summation(direct); break;
-      //  case 1: conv_env.set_summation(barneshut); break;
-      //} // end switch
-    } else {
-      ImGui::Text("Algorithm is direct, O(N^2)");
-      conv_env.set_summation(direct);
+    static int algo_item = conv_env.use_auto_summation() ? 4 :
+                           ((conv_env.get_summation() == barneshut) ? 1 :
+                           ((conv_env.get_summation() == fmm) ? 2 :
+                           ((conv_env.get_summation() == vic) ? 3 : 0)));
+    const char* algo_items[] = { "direct, O(N^2)", "treecode, O(NlogN)", "FMM, O(N)", "VIC, O(N+MlogM)", "automatic, per pair" };
+    ImGui::PushItemWidth(240);
+    ImGui::Combo("Select algorithm", &algo_item, algo_items, 5);
+    ImGui::PopItemWidth();
+    conv_env.set_auto_summation(algo_item == 4);
+    switch(algo_item) {
+      case 0: conv_env.set_summation(direct); break;
+      case 1: conv_env.set_summation(barneshut); break;
+      case 2: conv_env.set_summation(fmm); break;
+      case 3: conv_env.set_summation(vic); break;
+      case 4: conv_env.set_summation(direct); break;
+    } // end switch
+    if (algo_item == 4) {
+      ImGui::SameLine();
+      ShowHelpMarker("Each source and target pair uses whichever of direct sums, treecode and FMM a cost model, calibrated on the first step, predicts is fastest.");
+    }
+
+    if (conv_env.get_summation() == vic) {
+      float vcell = conv_env.get_vic_cell_ratio();
+      ImGui::PushItemWidth(240);
+      ImGui::SliderFloat("Grid cell size", &vcell, 0.5f, 2.0f, "%.2f");
+      ImGui::PopItemWidth();
+      conv_env.set_vic_cell_ratio(vcell);
+      ImGui::SameLine();
+      ShowHelpMarker("Vortex-in-cell grid spacing as a multiple of the particle core radius. Panels and their influence still use the FMM.");
+    }
+
+    if (conv_env.get_summation() != direct or conv_env.use_auto_summation()) {
+      float theta = conv_env.get_opening_angle();
+      ImGui::PushItemWidth(240);
+      ImGui::SliderFloat("Opening angle", &theta, 0.1f, 1.0f, "%.2f");
+      ImGui::PopItemWidth();
+      conv_env.set_opening_angle(theta);
+      ImGui::SameLine();
+      ShowHelpMarker("Ratio of tree node size to distance below which the multipole expansion is used. Smaller is more accurate and slower.");
+    }
+
+    if (conv_env.get_summation() != direct or conv_env.use_auto_summation()) {
+      ImGui::PushItemWidth(240);
+      ImGui::SliderInt("Validate every", &validate_interval, 0, 100, "%d steps");
+      ImGui::PopItemWidth();
+      ImGui::SameLine();
+      ShowHelpMarker("Every this many steps, compare the velocities against direct sums on a random sample of the particles. Zero never does.");
+      if (validate_interval > 0 and last_validation.nsamples > 0) {
+        ImGui::Text("  max err %.2e  rms err %.2e  speedup %.1fx", last_validation.max_err,
+                    last_validation.rms_err, last_validation.speedup);
+      }
+    }
+
+    float pnear = conv_env.get_panel_near_field();
+    ImGui::PushItemWidth(240);
+    ImGui::SliderFloat("Exact panel range", &pnear, 0.0f, 50.0f, "%.1f");
+    ImGui::PopItemWidth();
+    conv_env.set_panel_near_field(pnear);
+    ImGui::SameLine();
+    ShowHelpMarker("Panels act as point vortices and sources on targets more than this many panel lengths away. Zero always uses the exact panel influence.");
+
+    bool use_comp = conv_env.use_compensated_sums();
+    ImGui::Checkbox("Compensated sums", &use_comp);
+    conv_env.set_compensated_sums(use_comp);
+    ImGui::SameLine();
+    ShowHelpMarker("Add up blocks of source influences with Kahan compensation. Costs little, and helps most when accumulating in single precision.");
+  }
+
+#ifdef USE_PROFILER
+  // how fast each interaction type ran over the last step
+  const std::vector<Profiler::Kernel> kernels = Profiler::get().get_last_kernels();
+  if (not kernels.empty()) {
+    ImGui::Spacing();
+    ImGui::Text("Influence kernels, last step");
+    float peak = (float)Profiler::get().get_peak_gflops();
+    ImGui::PushItemWidth(240);
+    ImGui::InputFloat("Peak GFlop/s", &peak, 10.0f, 100.0f, "%.1f");
+    ImGui::PopItemWidth();
+    Profiler::get().set_peak_gflops((double)peak);
+    ImGui::SameLine();
+    ShowHelpMarker("Peak floating-point rate of this machine, for the percent of peak. Zero leaves it out.");
+    for (const auto& k : kernels) {
+      if (k.step_secs <= 0.0) continue;
+      if (peak > 0.0f) {
+        ImGui::Text("  %-6s %9.4f s  %8.2f GFlop/s  %5.1f%% of peak", k.name, k.step_secs, k.step_gflops(),
+                    Profiler::get().percent_of_peak(k.step_gflops()));
+      } else {
+        ImGui::Text("  %-6s %9.4f s  %8.2f GFlop/s", k.name, k.step_secs, k.step_gflops());
+      }
     }
   }
+#endif
 }
 #endif
 
@@ -617,12 +1379,156 @@ void Convection<S,A,I>::from_json(const nlohmann::json j) {
     std::cout << "  setting forward integrator order= " << convection_order << std::endl;
   }
 
-  // may eventually set method by name?
+  if (j.find("lowStorage") != j.end()) {
+    low_storage = j["lowStorage"];
+    std::cout << "  setting low-storage 3rd order integrator= " << low_storage << std::endl;
+  }
+
+  if (j.find("concurrentFieldPoints") != j.end()) {
+    concurrent_fldpt = j["concurrentFieldPoints"];
+    std::cout << "  setting concurrent field points= " << concurrent_fldpt << std::endl;
+  }
+
+  if (j.find("reuseVelocities") != j.end()) {
+    reuse_vels = j["reuseVelocities"];
+    std::cout << "  setting reuse velocities= " << reuse_vels << std::endl;
+  }
+
+  if (j.find("reuseTrees") != j.end()) {
+    reuse_trees = j["reuseTrees"];
+    std::cout << "  setting reuse trees= " << reuse_trees << std::endl;
+  }
+
+  if (j.find("reusePairs") != j.end()) {
+    reuse_pairs = j["reusePairs"];
+    std::cout << "  setting reuse unchanged pairs= " << reuse_pairs << std::endl;
+  }
+
+  if (j.find("fieldPointInterval") != j.end()) {
+    set_fldpt_interval(j["fieldPointInterval"]);
+    std::cout << "  setting field point update interval= " << fldpt_interval << std::endl;
+  }
+
+  tracer_grid.from_json(j);
+  conv_env.set_source_pruning(source_pruning_from_json(j));
+
+  // each simulation keeps its own core, in the environment its sums run under
+  VelCore core = default_vel_core;
+  if (j.find("velocityCore") != j.end()) {
+    if (not vel_core_from_name(j["velocityCore"], core)) {
+      std::cout << "  unknown velocityCore " << j["velocityCore"] << ", use rm, exponential, wl, v2 or v3" << std::endl;
+    }
+    std::cout << "  setting velocity core function= " << vel_core_name(core) << std::endl;
+  }
+  conv_env.set_velocity_core(core);
+
+  if (j.find("velocity") != j.end()) {
+    nlohmann::json vj = j["velocity"];
+
+    if (vj.find("summation") != vj.end()) {
+      const std::string summstr = vj["summation"];
+      conv_env.set_auto_summation(summstr == "auto");
+      if (summstr == "auto") {
+        // direct is what a pair falls back on
+        conv_env.set_summation(direct);
+      } else if (summstr == "treecode") {
+        conv_env.set_summation(barneshut);
+      } else if (summstr == "fmm") {
+        conv_env.set_summation(fmm);
+      } else if (summstr == "vic") {
+        conv_env.set_summation(vic);
+      } else {
+        // default is direct
+        conv_env.set_summation(direct);
+      }
+      std::cout << "  setting velocity summation= " << summstr << std::endl;
+    }
+
+    if (vj.find("openingAngle") != vj.end()) {
+      conv_env.set_opening_angle(vj["openingAngle"]);
+      std::cout << "  setting opening angle= " << conv_env.get_opening_angle() << std::endl;
+    }
+
+    if (vj.find("expansionOrder") != vj.end()) {
+      conv_env.set_expansion_order(vj["expansionOrder"]);
+      std::cout << "  setting expansion order= " << conv_env.get_expansion_order() << std::endl;
+    }
+
+    if (vj.find("vicCellRatio") != vj.end()) {
+      conv_env.set_vic_cell_ratio(vj["vicCellRatio"]);
+      std::cout << "  setting vic cell ratio= " << conv_env.get_vic_cell_ratio() << std::endl;
+    }
+
+    if (vj.find("panelNearField") != vj.end()) {
+      conv_env.set_panel_near_field(vj["panelNearField"]);
+      std::cout << "  setting panel near field= " << conv_env.get_panel_near_field() << std::endl;
+    }
+
+    if (vj.find("compensatedSums") != vj.end()) {
+      conv_env.set_compensated_sums(vj["compensatedSums"]);
+      std::cout << "  setting compensated sums= " << conv_env.use_compensated_sums() << std::endl;
+    }
+
+    if (vj.find("plugin") != vj.end()) {
+      conv_env.set_plugin(vj["plugin"]);
+      std::cout << "  setting velocity plugin= " << conv_env.get_plugin() << std::endl;
+    }
+
+    if (vj.find("validateInterval") != vj.end()) {
+      validate_interval = std::max(0, (int32_t)vj["validateInterval"]);
+      LOG_INFO("  setting validation interval= " << validate_interval);
+    }
+
+    if (vj.find("validateSamples") != vj.end()) {
+      validate_samples = std::max(1, (int32_t)vj["validateSamples"]);
+      LOG_INFO("  setting validation samples= " << validate_samples);
+    }
+
+    if (vj.find("validateTolerance") != vj.end()) {
+      validate_tol = vj["validateTolerance"];
+      LOG_INFO("  setting validation tolerance= " << validate_tol);
+    }
+  }
 }
 
 // create and write a json object for all diffusion parameters
 template <class S, class A, class I>
 void Convection<S,A,I>::add_to_json(nlohmann::json& j) const {
   j["timeOrder"] = convection_order;
+  if (low_storage) j["lowStorage"] = true;
+  if (fldpt_interval > 1) j["fieldPointInterval"] = fldpt_interval;
+  if (concurrent_fldpt) j["concurrentFieldPoints"] = true;
+  if (reuse_vels) j["reuseVelocities"] = true;
+  if (reuse_trees) j["reuseTrees"] = true;
+  if (reuse_pairs) j["reusePairs"] = true;
+  tracer_grid.add_to_json(j);
+  source_pruning_to_json(conv_env.get_source_pruning(), j);
+  if (conv_env.get_velocity_core() != default_vel_core) j["velocityCore"] = vel_core_name(conv_env.get_velocity_core());
+
+  // set velocity summation parameters
+  nlohmann::json vj;
+  if (conv_env.use_auto_summation()) {
+    vj["summation"] = "auto";
+  } else if (conv_env.get_summation() == barneshut) {
+    vj["summation"] = "treecode";
+  } else if (conv_env.get_summation() == fmm) {
+    vj["summation"] = "fmm";
+  } else if (conv_env.get_summation() == vic) {
+    vj["summation"] = "vic";
+    vj["vicCellRatio"] = conv_env.get_vic_cell_ratio();
+  } else {
+    vj["summation"] = "direct";
+  }
+  vj["openingAngle"] = conv_env.get_opening_angle();
+  vj["expansionOrder"] = conv_env.get_expansion_order();
+  vj["panelNearField"] = conv_env.get_panel_near_field();
+  vj["compensatedSums"] = conv_env.use_compensated_sums();
+  if (conv_env.has_plugin()) vj["plugin"] = conv_env.get_plugin();
+  if (validate_interval > 0) {
+    vj["validateInterval"] = validate_interval;
+    vj["validateSamples"] = validate_samples;
+    if (validate_tol > 0.0) vj["validateTolerance"] = validate_tol;
+  }
+  j["velocity"] = vj;
 }
 
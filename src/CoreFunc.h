@@ -18,61 +18,80 @@
 #endif
 
 #include <cmath>
+#include <string>
+#include <type_traits>
 
-//#define USE_RM_KERNEL
-//#define USE_EXPONENTIAL_KERNEL
-//#define USE_WL_KERNEL
-#define USE_V2_KERNEL
-//#define USE_V3_KERNEL
-
-
-#ifdef USE_RM_KERNEL
 //
-// Rosenhead-Moore velocity-only
+// The core functions regularize the point vortex kernel: each returns the velocity factor f
+//   (u = -dy*f, v = dx*f, before the 1/2pi) and optionally its radial derivative. Every
+//   core is built, as a specialization of VelCoreFn, and the kernels in Kernels.h take the
+//   core as a template parameter, so each influence loop exists once per core and has no
+//   branch inside; the influence routines pick the instantiation once per call, from the
+//   core in their ExecEnv, which a case sets with simparams "velocityCore"
 //
-template <class S>
-static inline S core_func (const S distsq, const S sr) {
-  const S r2 = distsq + sr*sr;
-  return my_recip(r2);
-}
-template <class S> size_t flops_tp_nograds () { return 3; }
+enum VelCore { core_rm, core_exponential, core_wl, core_v2, core_v3 };
+
+// the compile line may still choose a default, like the kernel benchmarks do; V2 otherwise
+#if defined(USE_RM_KERNEL)
+constexpr VelCore default_vel_core = core_rm;
+#elif defined(USE_EXPONENTIAL_KERNEL)
+constexpr VelCore default_vel_core = core_exponential;
+#elif defined(USE_WL_KERNEL)
+constexpr VelCore default_vel_core = core_wl;
+#elif defined(USE_V3_KERNEL)
+constexpr VelCore default_vel_core = core_v3;
+#else
+constexpr VelCore default_vel_core = core_v2;
+#endif
+
+template <VelCore C> struct VelCoreFn;
 
-// and the one for non-singular targets
-template <class S>
-static inline S core_func (const S distsq, const S sr, const S tr) {
-  const S r2 = distsq + sr*sr + tr*tr;
-  return my_recip(r2);
-}
-template <class S> size_t flops_tv_nograds () { return 5; }
 
 //
-// Rosenhead-Moore with gradients
+// Rosenhead-Moore velocity-only
 //
-template <class S>
-static inline void core_func (const S distsq, const S sr,
-                              S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S td2 = distsq + sr*sr;
-  *r2 = my_recip(td2);
-  *bbb = S(-2.0) * (*r2) * (*r2);
-}
-template <class S> size_t flops_tp_grads () { return 9; }
+template <>
+struct VelCoreFn<core_rm> {
+  template <class S>
+  static inline S core_func (const S distsq, const S sr) {
+    const S r2 = distsq + sr*sr;
+    return my_recip(r2);
+  }
+  template <class S> static size_t flops_tp_nograds () { return 3; }
 
-// and the one for non-singular targets
-template <class S>
-static inline void core_func (const S distsq, const S sr, const S tr,
-                              S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S td2 = distsq + sr*sr + tr*tr;
-  *r2 = my_recip(td2);
-  *bbb = S(-2.0) * (*r2) * (*r2);
-}
-template <class S> size_t flops_tv_grads () { return 9; }
-#endif
+  // and the one for non-singular targets
+  template <class S>
+  static inline S core_func (const S distsq, const S sr, const S tr) {
+    const S r2 = distsq + sr*sr + tr*tr;
+    return my_recip(r2);
+  }
+  template <class S> static size_t flops_tv_nograds () { return 5; }
+
+  //
+  // Rosenhead-Moore with gradients
+  //
+  template <class S>
+  static inline void core_func (const S distsq, const S sr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S td2 = distsq + sr*sr;
+    *r2 = my_recip(td2);
+    *bbb = S(-2.0f) * (*r2) * (*r2);
+  }
+  template <class S> static size_t flops_tp_grads () { return 9; }
+
+  // and the one for non-singular targets
+  template <class S>
+  static inline void core_func (const S distsq, const S sr, const S tr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S td2 = distsq + sr*sr + tr*tr;
+    *r2 = my_recip(td2);
+    *bbb = S(-2.0f) * (*r2) * (*r2);
+  }
+  template <class S> static size_t flops_tv_grads () { return 9; }
+};
 
 
-#ifdef USE_EXPONENTIAL_KERNEL
-//
-// exponential core - velocity only
-//
+// the exponential core, which needs no exp far outside the core and a limit at its center
 #ifdef USE_VC
 template <class S>
 static inline S exp_cond (const S ood2, const S corefac, const S reld2) {
@@ -101,6 +120,34 @@ inline double exp_cond (const double ood2, const double corefac, const double re
     return ood2 * (1.0 - std::exp(-reld2));
   }
 }
+#elif defined(USE_STDSIMD)
+template <class S>
+static inline S exp_cond (const S ood2, const S corefac, const S reld2) {
+  S returnval = ood2;
+  stdx::where(reld2 < S(16.0f), returnval) = ood2 * (S(1.0f) - stdx::exp(-reld2));
+  stdx::where(reld2 < S(0.001f), returnval) = corefac;
+  return returnval;
+}
+template <>
+inline float exp_cond (const float ood2, const float corefac, const float reld2) {
+  if (reld2 > 16.0f) {
+    return ood2;
+  } else if (reld2 < 0.001f) {
+    return corefac;
+  } else {
+    return ood2 * (1.0f - std::exp(-reld2));
+  }
+}
+template <>
+inline double exp_cond (const double ood2, const double corefac, const double reld2) {
+  if (reld2 > 16.0) {
+    return ood2;
+  } else if (reld2 < 0.001) {
+    return corefac;
+  } else {
+    return ood2 * (1.0 - std::exp(-reld2));
+  }
+}
 #else
 template <class S>
 static inline S exp_cond (const S ood2, const S corefac, const S reld2) {
@@ -117,194 +164,260 @@ static inline S exp_cond (const S ood2, const S corefac, const S reld2) {
 }
 #endif
 
-template <class S>
-static inline S core_func (const S distsq, const S sr) {
-  const S ood2 = my_recip(distsq);
-  const S corefac = my_recip(sr*sr);
-  const S reld2 = corefac / ood2;
-  // 4 flops to here
-  return exp_cond(ood2, corefac, reld2);
-}
-template <class S> size_t flops_tp_nograds () { return 7; }
-
-// non-singular targets
-template <class S>
-static inline S core_func (const S distsq, const S sr, const S tr) {
-  const S ood2 = my_recip(distsq);
-  const S corefac = my_recip(sr*sr + tr*tr);
-  const S reld2 = corefac / ood2;
-  return exp_cond(ood2, corefac, reld2);
-}
-template <class S> size_t flops_tv_nograds () { return 9; }
-
 //
-// exponential core - with gradients
+// exponential core - velocity only
 //
-template <class S>
-static inline void core_func (const S distsq, const S sr,
-                              S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S ood2 = my_recip(distsq);
-  const S corefac = my_recip(sr*sr);
-  const S reld2 = corefac / ood2;
-  // 4 flops to here
-  *r2 = exp_cond(ood2, corefac, reld2);
-  *bbb = S(-2.0) * (*r2) * ood2
-       + S(2.0) * corefac * ood2 * my_exp(-reld2);
-}
-template <class S> size_t flops_tp_grads () { return 14; }
-
-// non-singular targets
-template <class S>
-static inline void core_func (const S distsq, const S sr, const S tr,
-                              S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S ood2 = my_recip(distsq);
-  const S corefac = my_recip(sr*sr + tr*tr);
-  const S reld2 = corefac / ood2;
-  *r2 = exp_cond(ood2, corefac, reld2);
-  *bbb = S(-2.0) * (*r2) * ood2
-       + S(2.0) * corefac * ood2 * my_exp(-reld2);
-}
-template <class S> size_t flops_tv_grads () { return 16; }
-#endif
+template <>
+struct VelCoreFn<core_exponential> {
+
+  template <class S>
+  static inline S core_func (const S distsq, const S sr) {
+    const S ood2 = my_recip(distsq);
+    const S corefac = my_recip(sr*sr);
+    const S reld2 = corefac / ood2;
+    // 4 flops to here
+    return exp_cond(ood2, corefac, reld2);
+  }
+  template <class S> static size_t flops_tp_nograds () { return 7; }
+
+  // non-singular targets
+  template <class S>
+  static inline S core_func (const S distsq, const S sr, const S tr) {
+    const S ood2 = my_recip(distsq);
+    const S corefac = my_recip(sr*sr + tr*tr);
+    const S reld2 = corefac / ood2;
+    return exp_cond(ood2, corefac, reld2);
+  }
+  template <class S> static size_t flops_tv_nograds () { return 9; }
+
+  //
+  // exponential core - with gradients
+  //
+  template <class S>
+  static inline void core_func (const S distsq, const S sr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S ood2 = my_recip(distsq);
+    const S corefac = my_recip(sr*sr);
+    const S reld2 = corefac / ood2;
+    // 4 flops to here
+    *r2 = exp_cond(ood2, corefac, reld2);
+    *bbb = S(-2.0f) * (*r2) * ood2
+         + S(2.0f) * corefac * ood2 * my_exp(-reld2);
+  }
+  template <class S> static size_t flops_tp_grads () { return 14; }
+
+  // non-singular targets
+  template <class S>
+  static inline void core_func (const S distsq, const S sr, const S tr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S ood2 = my_recip(distsq);
+    const S corefac = my_recip(sr*sr + tr*tr);
+    const S reld2 = corefac / ood2;
+    *r2 = exp_cond(ood2, corefac, reld2);
+    *bbb = S(-2.0f) * (*r2) * ood2
+         + S(2.0f) * corefac * ood2 * my_exp(-reld2);
+  }
+  template <class S> static size_t flops_tv_grads () { return 16; }
+};
 
 
-#ifdef USE_WL_KERNEL
 //
 // Winckelmans-Leonard - velocity only
 //
-template <class S>
-static inline S core_func (const S distsq, const S sr) {
-  const S s2 = sr*sr;
-  const S d2 = distsq + s2;
-  return (d2 + s2) / (d2*d2);
-}
-template <class S> size_t flops_tp_nograds () { return 5; }
-
-// and the one for non-singular targets
-template <class S>
-static inline S core_func (const S distsq, const S sr, const S tr) {
-  const S s2 = sr*sr + tr*tr;
-  const S d2 = distsq + s2;
-  return (d2 + s2) / (d2*d2);
-}
-template <class S> size_t flops_tv_nograds () { return 7; }
-
-//
-// Winckelmans-Leonard - with gradients
-//
-template <class S>
-static inline void core_func (const S distsq, const S sr,
-                              S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S s2 = sr*sr;
-  const S d2 = distsq + s2;
-  const S ood2s = my_recip(d2*d2);
-  *r2 = (d2 + s2) * ood2s;
-  *bbb = (S(2.0) - S(4.0) * (*r2) * d2) * ood2s;
-}
-template <class S> size_t flops_tp_grads () { return 10; }
-
-// and the one for non-singular targets
-template <class S>
-static inline void core_func (const S distsq, const S sr, const S tr,
-                              S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S s2 = sr*sr + tr*tr;
-  const S d2 = distsq + s2;
-  const S ood2s = my_recip(d2*d2);
-  *r2 = (d2 + s2) * ood2s;
-  *bbb = (S(2.0) - S(4.0) * (*r2) * d2) * ood2s;
-}
-template <class S> size_t flops_tv_grads () { return 12; }
-#endif
+template <>
+struct VelCoreFn<core_wl> {
+  template <class S>
+  static inline S core_func (const S distsq, const S sr) {
+    const S s2 = sr*sr;
+    const S d2 = distsq + s2;
+    return (d2 + s2) / (d2*d2);
+  }
+  template <class S> static size_t flops_tp_nograds () { return 5; }
+
+  // and the one for non-singular targets
+  template <class S>
+  static inline S core_func (const S distsq, const S sr, const S tr) {
+    const S s2 = sr*sr + tr*tr;
+    const S d2 = distsq + s2;
+    return (d2 + s2) / (d2*d2);
+  }
+  template <class S> static size_t flops_tv_nograds () { return 7; }
+
+  //
+  // Winckelmans-Leonard - with gradients
+  //
+  template <class S>
+  static inline void core_func (const S distsq, const S sr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S s2 = sr*sr;
+    const S d2 = distsq + s2;
+    const S ood2s = my_recip(d2*d2);
+    *r2 = (d2 + s2) * ood2s;
+    *bbb = (S(2.0f) - S(4.0f) * (*r2) * d2) * ood2s;
+  }
+  template <class S> static size_t flops_tp_grads () { return 10; }
+
+  // and the one for non-singular targets
+  template <class S>
+  static inline void core_func (const S distsq, const S sr, const S tr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S s2 = sr*sr + tr*tr;
+    const S d2 = distsq + s2;
+    const S ood2s = my_recip(d2*d2);
+    *r2 = (d2 + s2) * ood2s;
+    *bbb = (S(2.0f) - S(4.0f) * (*r2) * d2) * ood2s;
+  }
+  template <class S> static size_t flops_tv_grads () { return 12; }
+};
 
 
-#ifdef USE_V2_KERNEL
 //
 // Vatistas n=2 - velocity only
 //
-template <class S>
-static inline S core_func (const S distsq, const S sr) {
-  const S s2 = sr*sr;
-  return my_rsqrt(distsq*distsq + s2*s2);
-}
-template <class S> size_t flops_tp_nograds () { return 6; }
+template <>
+struct VelCoreFn<core_v2> {
+  template <class S>
+  static inline S core_func (const S distsq, const S sr) {
+    const S s2 = sr*sr;
+    return my_rsqrt(distsq*distsq + s2*s2);
+  }
+  template <class S> static size_t flops_tp_nograds () { return 6; }
+
+  // and for non-singular targets
+  template <class S>
+  static inline S core_func (const S distsq, const S sr, const S tr) {
+    const S s2 = sr*sr;
+    const S t2 = tr*tr;
+    return my_rsqrt(distsq*distsq + s2*s2 + t2*t2);
+  }
+  template <class S> static size_t flops_tv_nograds () { return 9; }
+
+  //
+  // Vatistas n=2 - with gradients
+  //
+  template <class S>
+  static inline void core_func (const S distsq, const S sr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S s2 = sr*sr;
+    *r2 = my_rsqrt(distsq*distsq + s2*s2);
+    *bbb = S(-2.0f) * (*r2) * (*r2) * (*r2) * distsq;
+  }
+  template <class S> static size_t flops_tp_grads () { return 10; }
+
+  // and the one for non-singular targets
+  template <class S>
+  static inline void core_func (const S distsq, const S sr, const S tr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S s2 = sr*sr;
+    const S t2 = tr*tr;
+    *r2 = my_rsqrt(distsq*distsq + s2*s2 + t2*t2);
+    *bbb = S(-2.0f) * (*r2) * (*r2) * (*r2) * distsq;
+  }
+  template <class S> static size_t flops_tv_grads () { return 13; }
+};
 
-// and for non-singular targets
-template <class S>
-static inline S core_func (const S distsq, const S sr, const S tr) {
-  const S s2 = sr*sr;
-  const S t2 = tr*tr;
-  return my_rsqrt(distsq*distsq + s2*s2 + t2*t2);
-}
-template <class S> size_t flops_tv_nograds () { return 9; }
 
 //
-// Vatistas n=2 - with gradients
+// Vatistas n=3 - velocity only
 //
-template <class S>
-static inline void core_func (const S distsq, const S sr,
-                              S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S s2 = sr*sr;
-  *r2 = my_rsqrt(distsq*distsq + s2*s2);
-  *bbb = S(-2.0) * (*r2) * (*r2) * (*r2) * distsq;
-}
-template <class S> size_t flops_tp_grads () { return 10; }
+template <>
+struct VelCoreFn<core_v3> {
+  template <class S>
+  static inline S core_func (const S distsq, const S sr) {
+    const S s2 = sr*sr;
+    return my_rcbrt(distsq*distsq*distsq + s2*s2*s2);
+  }
+  template <class S> static size_t flops_tp_nograds () { return 8; }
+
+  // and for non-singular targets
+  template <class S>
+  static inline S core_func (const S distsq, const S sr, const S tr) {
+    const S s2 = sr*sr;
+    const S t2 = tr*tr;
+    return my_rcbrt(distsq*distsq*distsq + s2*s2*s2 + t2*t2*t2);
+  }
+  template <class S> static size_t flops_tv_nograds () { return 12; }
+
+  //
+  // Vatistas n=3 - with gradients
+  //
+  template <class S>
+  static inline void core_func (const S distsq, const S sr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S s2 = sr*sr;
+    const S ds6 = distsq*distsq*distsq + s2*s2*s2;
+    *r2 = my_rcbrt(ds6);
+    *bbb = S(-2.0f) * distsq*distsq * (*r2) / ds6;
+  }
+  template <class S> static size_t flops_tp_grads () { return 12; }
+
+  // and the one for non-singular targets
+  template <class S>
+  static inline void core_func (const S distsq, const S sr, const S tr,
+                                S* const __restrict__ r2, S* const __restrict__ bbb) {
+    const S s2 = sr*sr;
+    const S t2 = tr*tr;
+    const S ds6 = distsq*distsq*distsq + s2*s2*s2 + t2*t2*t2;
+    *r2 = my_rcbrt(ds6);
+    *bbb = S(-2.0f) * distsq*distsq * (*r2) / ds6;
+  }
+  template <class S> static size_t flops_tv_grads () { return 16; }
+};
 
-// and the one for non-singular targets
-template <class S>
-static inline void core_func (const S distsq, const S sr, const S tr,
-                              S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S s2 = sr*sr;
-  const S t2 = tr*tr;
-  *r2 = my_rsqrt(distsq*distsq + s2*s2 + t2*t2);
-  *bbb = S(-2.0) * (*r2) * (*r2) * (*r2) * distsq;
-}
-template <class S> size_t flops_tv_grads () { return 13; }
-#endif
 
 
-#ifdef USE_V3_KERNEL
 //
-// Vatistas n=3 - velocity only
+// The core functions with the core chosen at compile time; the flop counts are per call
 //
-template <class S>
+template <class S, VelCore C>
 static inline S core_func (const S distsq, const S sr) {
-  const S s2 = sr*sr;
-  return my_rcbrt(distsq*distsq*distsq + s2*s2*s2);
+  return VelCoreFn<C>::template core_func<S>(distsq, sr);
 }
-template <class S> size_t flops_tp_nograds () { return 8; }
-
-// and for non-singular targets
-template <class S>
+template <class S, VelCore C>
 static inline S core_func (const S distsq, const S sr, const S tr) {
-  const S s2 = sr*sr;
-  const S t2 = tr*tr;
-  return my_rcbrt(distsq*distsq*distsq + s2*s2*s2 + t2*t2*t2);
+  return VelCoreFn<C>::template core_func<S>(distsq, sr, tr);
 }
-template <class S> size_t flops_tv_nograds () { return 12; }
-
-//
-// Vatistas n=3 - with gradients
-//
-template <class S>
+template <class S, VelCore C>
 static inline void core_func (const S distsq, const S sr,
                               S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S s2 = sr*sr;
-  const S ds6 = distsq*distsq*distsq + s2*s2*s2;
-  *r2 = my_rcbrt(ds6);
-  *bbb = S(-2.0) * distsq*distsq * (*r2) / ds6;
+  VelCoreFn<C>::template core_func<S>(distsq, sr, r2, bbb);
 }
-template <class S> size_t flops_tp_grads () { return 12; }
-
-// and the one for non-singular targets
-template <class S>
+template <class S, VelCore C>
 static inline void core_func (const S distsq, const S sr, const S tr,
                               S* const __restrict__ r2, S* const __restrict__ bbb) {
-  const S s2 = sr*sr;
-  const S t2 = tr*tr;
-  const S ds6 = distsq*distsq*distsq + s2*s2*s2 + t2*t2*t2;
-  *r2 = my_rcbrt(ds6);
-  *bbb = S(-2.0) * distsq*distsq * (*r2) / ds6;
+  VelCoreFn<C>::template core_func<S>(distsq, sr, tr, r2, bbb);
+}
+template <class S, VelCore C> size_t flops_tp_nograds () { return VelCoreFn<C>::template flops_tp_nograds<S>(); }
+template <class S, VelCore C> size_t flops_tv_nograds () { return VelCoreFn<C>::template flops_tv_nograds<S>(); }
+template <class S, VelCore C> size_t flops_tp_grads () { return VelCoreFn<C>::template flops_tp_grads<S>(); }
+template <class S, VelCore C> size_t flops_tv_grads () { return VelCoreFn<C>::template flops_tv_grads<S>(); }
+
+// call _f with the given core as a compile-time constant, std::integral_constant<VelCore,C>
+template <class F>
+inline decltype(auto) with_velocity_core (const VelCore _core, F&& _f) {
+  switch (_core) {
+    case core_rm:          return _f(std::integral_constant<VelCore,core_rm>());
+    case core_exponential: return _f(std::integral_constant<VelCore,core_exponential>());
+    case core_wl:          return _f(std::integral_constant<VelCore,core_wl>());
+    case core_v3:          return _f(std::integral_constant<VelCore,core_v3>());
+    default:               return _f(std::integral_constant<VelCore,core_v2>());
+  }
 }
-template <class S> size_t flops_tv_grads () { return 16; }
-#endif
 
+inline std::string vel_core_name (const VelCore _c) {
+  switch (_c) {
+    case core_rm:          return "rm";
+    case core_exponential: return "exponential";
+    case core_wl:          return "wl";
+    case core_v3:          return "v3";
+    default:               return "v2";
+  }
+}
+
+// returns false and leaves _c alone for an unknown name
+inline bool vel_core_from_name (const std::string& _name, VelCore& _c) {
+  for (const VelCore c : {core_rm, core_exponential, core_wl, core_v2, core_v3}) {
+    if (_name == vel_core_name(c)) { _c = c; return true; }
+  }
+  return false;
+}
@@ -9,9 +9,10 @@
 
 #include "Core.h"
 #include "VectorHelper.h"
+#include "Profiler.h"
+#include "Logger.h"
 
 #include <cassert>
-#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
@@ -66,10 +67,8 @@ void CoreSpread<ST>::diffuse_all(const std::array<Vector<ST>,2>& pos,
   assert(str.size()==rad.size() && "Input arrays are not uniform size");
   const size_t n = rad.size();
 
-  std::cout << "  Running CoreSpread with n " << n << std::endl;
-
-  // start timer
-  auto start = std::chrono::system_clock::now();
+  LOG_DEBUG("  Running CoreSpread with n " << n);
+  PROFILE_ZONE("corespread");
 
   const ST core_second_mom = get_core_second_mom<ST>(core_func);
 
@@ -79,11 +78,6 @@ void CoreSpread<ST>::diffuse_all(const std::array<Vector<ST>,2>& pos,
     // apply the random walk
     rad[i] = std::sqrt( std::pow(rad[i], 2) + (2.0/core_second_mom)*std::pow(h_nu, 2));
   }
-
-  // finish timer and report
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  printf("    corespread.diffuse_all:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
 }
 
 //
@@ -0,0 +1,210 @@
+/*
+ * Coupling.h - Body motion from, and loads to, an external structural solver
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "Logger.h"
+
+#include <json/json.hpp>
+
+#if defined(__unix__) or defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define OMEGA2D_HAVE_SHM
+#endif
+
+#include <atomic>
+#include <array>
+#include <string>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+// body positions and velocities
+using Vec = std::array<double,Dimensions>;
+
+//
+// A coupled body moves as its structure says: at the start of each step it reads the
+//   latest pose and rates from its channel, and between samples moves at those rates;
+//   at the end of each step it writes the force the flow put on it (the impulse estimate,
+//   as in the status file's per-body forces). Nothing is parsed or serialized either way.
+//
+struct BodySample {
+  double time = 0.0;
+  Vec pos = {0.0, 0.0};
+  Vec vel = {0.0, 0.0};
+  double apos = 0.0;
+  double avel = 0.0;
+};
+
+class BodyCoupling {
+public:
+  virtual ~BodyCoupling() = default;
+
+  // the latest motion, if there is one; a lockstep channel waits for one at or after _time
+  virtual bool read_motion(const double _time, BodySample&) = 0;
+
+  // the force on the body at a time
+  virtual void write_load(const double, const Vec&) = 0;
+
+  // to write back out, or null for channels made in code
+  virtual nlohmann::json to_json() const { return nullptr; }
+};
+
+//
+// the embedding program's own functions, see SimSession.h
+//
+class CallbackCoupling : public BodyCoupling {
+public:
+  using MotionFunc = std::function<bool(const double, BodySample&)>;
+  using LoadFunc = std::function<void(const double, const Vec&)>;
+
+  CallbackCoupling(MotionFunc _motion, LoadFunc _load)
+    : motion(std::move(_motion)), load(std::move(_load)) {}
+
+  bool read_motion(const double _time, BodySample& _s) override { return motion and motion(_time, _s); }
+  void write_load(const double _time, const Vec& _f) override { if (load) load(_time, _f); }
+
+private:
+  MotionFunc motion;
+  LoadFunc load;
+};
+
+//
+// a POSIX shared-memory block, made by whichever side opens it first; each half is a
+//   sequence lock: the writer bumps its counter to odd, writes, then bumps it to even, and
+//   the reader retries whenever the counter was odd or changed while it read
+//
+//   "coupling": {"sharedMemory": "/wing", "lockstep": true, "timeout": 10.0}
+//
+// with lockstep, each step waits (up to timeout seconds) for the structure's motion at that
+//   step's time, otherwise it takes whatever was there last
+//
+struct ShmBodyBlock {
+  static constexpr uint32_t magic_value = 0x4f324442;	// "O2DB"
+  uint32_t magic;
+  uint32_t version;
+  std::atomic<uint64_t> motion_seq;	// written by the structure
+  double motion[7];			// time, x, y, u, v, theta, omega
+  std::atomic<uint64_t> load_seq;	// written here
+  double load[3];			// time, fx, fy
+};
+
+class ShmCoupling : public BodyCoupling {
+public:
+  ShmCoupling(const std::string& _name, const bool _lockstep, const double _timeout)
+    : name(_name), lockstep(_lockstep), timeout(_timeout) {
+#ifdef OMEGA2D_HAVE_SHM
+    const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+      std::cout << "  Error opening shared memory " << name << ": " << std::strerror(errno) << std::endl;
+      return;
+    }
+    struct stat st;
+    const bool fresh = (fstat(fd, &st) == 0 and st.st_size < (off_t)sizeof(ShmBodyBlock));
+    if (fresh and ftruncate(fd, sizeof(ShmBodyBlock)) != 0) {
+      std::cout << "  Error sizing shared memory " << name << ": " << std::strerror(errno) << std::endl;
+      close(fd);
+      return;
+    }
+    void* addr = mmap(nullptr, sizeof(ShmBodyBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      std::cout << "  Error mapping shared memory " << name << ": " << std::strerror(errno) << std::endl;
+      return;
+    }
+    blk = static_cast<ShmBodyBlock*>(addr);
+    // a new region is all zeros, which is a valid, empty block
+    if (blk->magic != ShmBodyBlock::magic_value) {
+      blk->version = 1;
+      blk->magic = ShmBodyBlock::magic_value;
+    }
+    std::cout << "  coupling body through shared memory " << name << std::endl;
+#else
+    std::cout << "  Error: shared memory coupling is not available on this system" << std::endl;
+#endif
+  }
+
+  ~ShmCoupling() {
+#ifdef OMEGA2D_HAVE_SHM
+    if (blk) munmap(blk, sizeof(ShmBodyBlock));
+#endif
+  }
+
+  bool read_motion(const double _time, BodySample& _s) override {
+    if (not blk) return false;
+    const auto start = std::chrono::steady_clock::now();
+    while (true) {
+      const bool got = try_read(_s);
+      if (got and (not lockstep or _s.time >= _time - 1.e-9*(1.0+std::abs(_time)))) return true;
+      if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > timeout) {
+        LOG_WARN("  no motion at t=" << _time << " from " << name << " after " << timeout << " s");
+        return got;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void write_load(const double _time, const Vec& _f) override {
+    if (not blk) return;
+    const uint64_t seq = blk->load_seq.load(std::memory_order_relaxed);
+    blk->load_seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    const double vals[3] = {_time, _f[0], _f[1]};
+    std::memcpy(blk->load, vals, sizeof(vals));
+    blk->load_seq.store(seq+2, std::memory_order_release);
+  }
+
+  nlohmann::json to_json() const override {
+    return {{"sharedMemory", name}, {"lockstep", lockstep}, {"timeout", timeout}};
+  }
+
+private:
+  // one consistent copy of the motion half, false if it was never written or is being written
+  bool try_read(BodySample& _s) const {
+    for (int tries=0; tries<100; ++tries) {
+      const uint64_t seq = blk->motion_seq.load(std::memory_order_acquire);
+      if (seq == 0) return false;
+      if (seq & 1) continue;
+      double vals[7];
+      std::memcpy(vals, blk->motion, sizeof(vals));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (blk->motion_seq.load(std::memory_order_relaxed) != seq) continue;
+      _s.time = vals[0];
+      _s.pos = {vals[1], vals[2]};
+      _s.vel = {vals[3], vals[4]};
+      _s.apos = vals[5];
+      _s.avel = vals[6];
+      return true;
+    }
+    return false;
+  }
+
+  std::string name;
+  bool lockstep;
+  double timeout;
+  ShmBodyBlock* blk = nullptr;
+};
+
+// a channel from a body's "coupling" json, or null
+inline std::shared_ptr<BodyCoupling> make_coupling(const nlohmann::json& _j) {
+  if (_j.find("sharedMemory") != _j.end()) {
+    return std::make_shared<ShmCoupling>(_j["sharedMemory"].get<std::string>(),
+                                         _j.value("lockstep", false), _j.value("timeout", 10.0));
+  }
+  std::cout << "  Error: body coupling needs a sharedMemory name" << std::endl;
+  return nullptr;
+}
@@ -0,0 +1,45 @@
+/*
+ * CpuDispatch.h - Build the hot loops for several instruction sets and pick one at run time
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <string>
+
+
+//
+// A portable build (USE_CPU_DISPATCH) targets any x86-64, so the release flags cannot use
+//   -march=native; instead, the functions holding the influence loops are marked with
+//   KERNEL_CLONES, and the compiler makes an AVX2 and an AVX-512 copy of each (with the
+//   kernels from Kernels.h and Coefficients.h inlined into them) next to the baseline one.
+//   The loader picks the best copy the cpu supports, once, so a call costs nothing extra.
+//
+// Vc and std::experimental::simd fix their vector width when compiled, so they are not
+//   used in a portable build (see CMakeLists.txt)
+//
+#if defined(USE_CPU_DISPATCH) && (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && defined(__linux__)
+#if defined(__clang__) || __GNUC__ < 12
+#define KERNEL_CLONES __attribute__((target_clones("default", "avx2", "avx512f")))
+#else
+// the x86-64 levels also bring fma with avx2, and the rest of avx-512 with avx512f
+#define KERNEL_CLONES __attribute__((target_clones("default", "arch=x86-64-v3", "arch=x86-64-v4")))
+#endif
+#define HAVE_KERNEL_CLONES
+#else
+#define KERNEL_CLONES
+#endif
+
+// which copy of the influence loops this binary runs on this cpu
+inline std::string kernel_isa_string () {
+#ifdef HAVE_KERNEL_CLONES
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return "portable build, running AVX-512 kernels";
+  if (__builtin_cpu_supports("avx2")) return "portable build, running AVX2 kernels";
+  return "portable build, running baseline x86-64 kernels";
+#else
+  return "kernels built for this cpu only";
+#endif
+}
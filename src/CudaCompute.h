@@ -0,0 +1,136 @@
+/*
+ * CudaCompute.h - Run the direct-sum influence kernels on a CUDA or HIP device
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "CudaKernels.h"
+#include "Points.h"
+#include "Surfaces.h"
+#include "ResultsType.h"
+
+#include <vector>
+#include <array>
+#include <utility>
+
+//
+// Copies stay on the device between calls, so a collection is only sent again once
+//   its state generation changes (motion, new strengths, diffusion, merging)
+//
+
+// particles and field points go up as (x, y, radius, strength)
+template <class S>
+void cuda_upload_points (const Points<S>& pts) {
+  if (cuda_array_current(&pts, pts.get_state_gen())) return;
+
+  const std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+  const size_t n = pts.get_n();
+  std::vector<float> data(4*n, 0.0);
+  for (size_t i=0; i<n; ++i) {
+    data[4*i+0] = x[0][i];
+    data[4*i+1] = x[1][i];
+  }
+  if (not pts.is_inert()) {
+    const Vector<S>& r = pts.get_rad();
+    const Vector<S>& s = pts.get_str();
+    for (size_t i=0; i<n; ++i) {
+      data[4*i+2] = r[i];
+      data[4*i+3] = s[i];
+    }
+  }
+  cuda_array_upload(&pts, pts.get_state_gen(), data);
+}
+
+// panels go up as (x0, y0, x1, y1) and (vortex str, source str, 0, 0)
+template <class S>
+void cuda_upload_panels (const Surfaces<S>& surf) {
+  if (cuda_array_current(&surf, surf.get_state_gen())) return;
+
+  const std::array<Vector<S>,Dimensions>& x = surf.get_pos();
+  const std::vector<Int>& idx = surf.get_idx();
+  const Vector<S>& vs = surf.get_vort_str();
+  const size_t n = surf.get_npanels();
+  std::vector<float> data(8*n, 0.0);
+  for (size_t j=0; j<n; ++j) {
+    data[8*j+0] = x[0][idx[2*j]];
+    data[8*j+1] = x[1][idx[2*j]];
+    data[8*j+2] = x[0][idx[2*j+1]];
+    data[8*j+3] = x[1][idx[2*j+1]];
+    data[8*j+4] = vs[j];
+  }
+  if (surf.have_src_str()) {
+    const Vector<S>& ss = surf.get_src_str();
+    for (size_t j=0; j<n; ++j) data[8*j+5] = ss[j];
+  }
+  cuda_array_upload(&surf, surf.get_state_gen(), data);
+}
+
+// each of these return false if the calculation could not be run on the device
+template <class S>
+bool cuda_points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsType& restype,
+                                const VelCore _core) {
+  // the device code only implements the Vatistas n=2 core
+  if (_core != core_v2) return false;
+  if (restype.get_type() != velonly and restype.get_type() != velandvort) return false;
+  if (not cuda_device_ready()) return false;
+
+  cuda_upload_points(src);
+  cuda_upload_points(std::as_const(targ));
+
+  std::vector<float> res;
+  cuda_points_on_points(&src, src.get_n(), &targ, targ.get_n(), not targ.is_inert(), res);
+
+  std::array<Vector<S>,Dimensions>& tu = targ.get_vel();
+  for (size_t i=0; i<targ.get_n(); ++i) {
+    tu[0][i] += res[4*i+0];
+    tu[1][i] += res[4*i+1];
+  }
+  if (restype.get_type() == velandvort) {
+    Vector<S>& tw = targ.get_vort();
+    for (size_t i=0; i<targ.get_n(); ++i) tw[i] += res[4*i+2];
+  }
+  return true;
+}
+
+template <class S>
+bool cuda_panels_affect_points (const Surfaces<S>& src, Points<S>& targ, const ResultsType& restype) {
+  if (not restype.compute_vel() or restype.compute_grad()) return false;
+  if (not cuda_device_ready()) return false;
+
+  cuda_upload_panels(src);
+  cuda_upload_points(std::as_const(targ));
+
+  std::vector<float> res;
+  cuda_panels_on_points(&src, src.get_npanels(), &targ, targ.get_n(), res);
+
+  std::array<Vector<S>,Dimensions>& tu = targ.get_vel();
+  for (size_t i=0; i<targ.get_n(); ++i) {
+    tu[0][i] += res[2*i+0];
+    tu[1][i] += res[2*i+1];
+  }
+  return true;
+}
+
+template <class S>
+bool cuda_points_affect_panels (const Points<S>& src, Surfaces<S>& targ, const ResultsType& restype) {
+  if (not restype.compute_vel()) return false;
+  if (not cuda_device_ready()) return false;
+
+  cuda_upload_points(src);
+  cuda_upload_panels(std::as_const(targ));
+
+  std::vector<float> res;
+  cuda_points_on_panels(&src, src.get_n(), &targ, targ.get_npanels(), res);
+
+  // the kernel is used backwards, so the resulting velocities are negative
+  const Vector<S>& ta = targ.get_area();
+  std::array<Vector<S>,Dimensions>& tu = targ.get_vel();
+  for (size_t i=0; i<targ.get_npanels(); ++i) {
+    tu[0][i] -= res[2*i+0] / ta[i];
+    tu[1][i] -= res[2*i+1] / ta[i];
+  }
+  return true;
+}
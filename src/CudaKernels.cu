@@ -0,0 +1,260 @@
+/*
+ * CudaKernels.cu - Direct-sum influence kernels for CUDA and HIP devices
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "CudaKernels.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+// the same source builds with nvcc or hipcc
+#ifdef __HIPCC__
+  #include <hip/hip_runtime.h>
+  #define gpuError_t              hipError_t
+  #define gpuSuccess              hipSuccess
+  #define gpuGetDeviceCount       hipGetDeviceCount
+  #define gpuGetErrorString       hipGetErrorString
+  #define gpuGetLastError         hipGetLastError
+  #define gpuMalloc               hipMalloc
+  #define gpuFree                 hipFree
+  #define gpuMemcpy               hipMemcpy
+  #define gpuMemcpyHostToDevice   hipMemcpyHostToDevice
+  #define gpuMemcpyDeviceToHost   hipMemcpyDeviceToHost
+#else
+  #include <cuda_runtime.h>
+  #define gpuError_t              cudaError_t
+  #define gpuSuccess              cudaSuccess
+  #define gpuGetDeviceCount       cudaGetDeviceCount
+  #define gpuGetErrorString       cudaGetErrorString
+  #define gpuGetLastError         cudaGetLastError
+  #define gpuMalloc               cudaMalloc
+  #define gpuFree                 cudaFree
+  #define gpuMemcpy               cudaMemcpy
+  #define gpuMemcpyHostToDevice   cudaMemcpyHostToDevice
+  #define gpuMemcpyDeviceToHost   cudaMemcpyDeviceToHost
+#endif
+
+// threads per block, and sources per shared-memory tile
+constexpr int block_size = 128;
+
+static void check (const gpuError_t _err, const char* _where) {
+  if (_err != gpuSuccess) {
+    std::cerr << "GPU error in " << _where << ": " << gpuGetErrorString(_err) << std::endl;
+    exit(1);
+  }
+}
+
+//
+// the kernels, one thread per target
+//
+
+// vortex particles on particles or points, uses the Vatistas n=2 core like CoreFunc.h
+__global__ void ptpt_kernel (const float4* __restrict__ src, const int ns,
+                             const float4* __restrict__ targ, const int nt,
+                             const int thick, float* __restrict__ res) {
+  __shared__ float4 tile[block_size];
+  const int i = blockIdx.x*blockDim.x + threadIdx.x;
+  const float4 t = (i < nt) ? targ[i] : make_float4(0.f, 0.f, 0.f, 0.f);
+  const float t4 = thick ? t.z*t.z*t.z*t.z : 0.f;
+  float u = 0.f, v = 0.f, w = 0.f;
+
+  for (int jb=0; jb<ns; jb+=block_size) {
+    // padding sources have no strength
+    const int j = jb + threadIdx.x;
+    tile[threadIdx.x] = (j < ns) ? src[j] : make_float4(0.f, 0.f, 1.f, 0.f);
+    __syncthreads();
+
+    for (int k=0; k<block_size; ++k) {
+      const float4 s = tile[k];
+      const float dx = t.x - s.x;
+      const float dy = t.y - s.y;
+      const float distsq = dx*dx + dy*dy;
+      const float s2 = s.z*s.z;
+      const float rr = rsqrtf(distsq*distsq + s2*s2 + t4);
+      const float r2 = s.w * rr;
+      u -= r2 * dy;
+      v += r2 * dx;
+      w += s.w * (2.f*rr - 2.f*rr*rr*rr*distsq*distsq);
+    }
+    __syncthreads();
+  }
+
+  if (i < nt) reinterpret_cast<float4*>(res)[i] = make_float4(u, v, w, 0.f);
+}
+
+// the linear panel kernel, must match kernelu_1vs_0p in Kernels.h
+__device__ inline void panel_kernel (const float x0, const float y0, const float x1, const float y1,
+                                     const float vs, const float ss, const float tx, const float ty,
+                                     float* const u, float* const v) {
+  const float dx0 = tx - x0;
+  const float dy0 = ty - y0;
+  const float dx1 = tx - x1;
+  const float dy1 = ty - y1;
+  float px = x1 - x0;
+  float py = y1 - y0;
+  const float pinv = rsqrtf(px*px + py*py);
+  px *= pinv;
+  py *= pinv;
+  const float ustar = atan2f(dx1*dy0 - dy1*dx0, dy1*dy0 + dx1*dx0);
+  const float vstar = 0.5f * logf((dx0*dx0 + dy0*dy0) / (dx1*dx1 + dy1*dy1));
+  *u += vs * (ustar*px - vstar*py) + ss * (ustar*py + vstar*px);
+  *v += vs * (ustar*py + vstar*px) + ss * (vstar*py - ustar*px);
+}
+
+// vortex and source panels on particles or points
+__global__ void panpt_kernel (const float4* __restrict__ pan, const int np,
+                              const float4* __restrict__ targ, const int nt,
+                              float* __restrict__ res) {
+  __shared__ float4 geom[block_size];
+  __shared__ float4 strs[block_size];
+  const int i = blockIdx.x*blockDim.x + threadIdx.x;
+  const float4 t = (i < nt) ? targ[i] : make_float4(0.f, 0.f, 0.f, 0.f);
+  float u = 0.f, v = 0.f;
+
+  for (int jb=0; jb<np; jb+=block_size) {
+    // padding panels are far away with no strength
+    const int j = jb + threadIdx.x;
+    geom[threadIdx.x] = (j < np) ? pan[2*j]   : make_float4(-9999.f, -9999.f, 9999.f, -9999.f);
+    strs[threadIdx.x] = (j < np) ? pan[2*j+1] : make_float4(0.f, 0.f, 0.f, 0.f);
+    __syncthreads();
+
+    for (int k=0; k<block_size; ++k) {
+      panel_kernel(geom[k].x, geom[k].y, geom[k].z, geom[k].w, strs[k].x, strs[k].y, t.x, t.y, &u, &v);
+    }
+    __syncthreads();
+  }
+
+  if (i < nt) reinterpret_cast<float2*>(res)[i] = make_float2(u, v);
+}
+
+// vortex particles on panels, integrated along the target panel
+//   this is the panel kernel used backwards, as in points_affect_panels
+__global__ void ptpan_kernel (const float4* __restrict__ src, const int ns,
+                              const float4* __restrict__ pan, const int np,
+                              float* __restrict__ res) {
+  __shared__ float4 tile[block_size];
+  const int i = blockIdx.x*blockDim.x + threadIdx.x;
+  const float4 p = (i < np) ? pan[2*i] : make_float4(0.f, 0.f, 1.f, 0.f);
+  float u = 0.f, v = 0.f;
+
+  for (int jb=0; jb<ns; jb+=block_size) {
+    // padding particles are far away with no strength
+    const int j = jb + threadIdx.x;
+    tile[threadIdx.x] = (j < ns) ? src[j] : make_float4(999.999f, 999.999f, 1.f, 0.f);
+    __syncthreads();
+
+    for (int k=0; k<block_size; ++k) {
+      panel_kernel(p.x, p.y, p.z, p.w, tile[k].w, 0.f, tile[k].x, tile[k].y, &u, &v);
+    }
+    __syncthreads();
+  }
+
+  if (i < np) reinterpret_cast<float2*>(res)[i] = make_float2(u, v);
+}
+
+//
+// device memory, kept between calls
+//
+struct DeviceArray {
+  float* ptr = nullptr;
+  size_t count = 0;
+  uint32_t gen = 0;
+};
+
+static std::mutex dev_mutex;
+static std::map<const void*, DeviceArray> dev_arrays;
+static DeviceArray dev_results;
+
+static void ensure_size (DeviceArray& _arr, const size_t _count) {
+  if (_count <= _arr.count) return;
+  if (_arr.ptr) check(gpuFree(_arr.ptr), "free");
+  check(gpuMalloc((void**)&_arr.ptr, sizeof(float)*_count), "malloc");
+  _arr.count = _count;
+}
+
+static float* find_array (const void* _key) {
+  auto it = dev_arrays.find(_key);
+  if (it == dev_arrays.end()) {
+    std::cerr << "GPU array was never uploaded" << std::endl;
+    exit(1);
+  }
+  return it->second.ptr;
+}
+
+// run one launch and bring back _nper values per target
+template <class K, class... Args>
+static void launch_and_read (K _kernel, const size_t _nt, const size_t _nper, std::vector<float>& _res,
+                             Args... _args) {
+  _res.resize(_nper*_nt);
+  if (_nt == 0) return;
+  ensure_size(dev_results, _res.size());
+  const int nblocks = (int)((_nt + block_size - 1) / block_size);
+  _kernel<<<nblocks, block_size>>>(_args..., dev_results.ptr);
+  check(gpuGetLastError(), "kernel launch");
+  check(gpuMemcpy(_res.data(), dev_results.ptr, sizeof(float)*_res.size(), gpuMemcpyDeviceToHost), "readback");
+}
+
+bool cuda_device_ready() {
+  static int ndev = -1;
+  if (ndev < 0) {
+    if (gpuGetDeviceCount(&ndev) != gpuSuccess) ndev = 0;
+    std::cout << "  Found " << ndev << " GPU devices" << std::endl;
+  }
+  return (ndev > 0);
+}
+
+bool cuda_array_current(const void* _key, const uint32_t _gen) {
+  std::lock_guard<std::mutex> lock(dev_mutex);
+  auto it = dev_arrays.find(_key);
+  return (it != dev_arrays.end() and it->second.gen == _gen);
+}
+
+void cuda_array_upload(const void* _key, const uint32_t _gen, const std::vector<float>& _data) {
+  std::lock_guard<std::mutex> lock(dev_mutex);
+  DeviceArray& arr = dev_arrays[_key];
+  ensure_size(arr, _data.size());
+  check(gpuMemcpy(arr.ptr, _data.data(), sizeof(float)*_data.size(), gpuMemcpyHostToDevice), "upload");
+  arr.gen = _gen;
+}
+
+void cuda_release_all() {
+  std::lock_guard<std::mutex> lock(dev_mutex);
+  for (auto& [key, arr] : dev_arrays) {
+    if (arr.ptr) gpuFree(arr.ptr);
+  }
+  dev_arrays.clear();
+  if (dev_results.ptr) gpuFree(dev_results.ptr);
+  dev_results = DeviceArray();
+}
+
+void cuda_points_on_points(const void* _skey, const size_t _ns,
+                           const void* _tkey, const size_t _nt,
+                           const bool _thick, std::vector<float>& _res) {
+  std::lock_guard<std::mutex> lock(dev_mutex);
+  launch_and_read(ptpt_kernel, _nt, 4, _res,
+                  (const float4*)find_array(_skey), (int)_ns,
+                  (const float4*)find_array(_tkey), (int)_nt, (int)_thick);
+}
+
+void cuda_panels_on_points(const void* _skey, const size_t _ns,
+                           const void* _tkey, const size_t _nt,
+                           std::vector<float>& _res) {
+  std::lock_guard<std::mutex> lock(dev_mutex);
+  launch_and_read(panpt_kernel, _nt, 2, _res,
+                  (const float4*)find_array(_skey), (int)_ns,
+                  (const float4*)find_array(_tkey), (int)_nt);
+}
+
+void cuda_points_on_panels(const void* _skey, const size_t _ns,
+                           const void* _tkey, const size_t _nt,
+                           std::vector<float>& _res) {
+  std::lock_guard<std::mutex> lock(dev_mutex);
+  launch_and_read(ptpan_kernel, _nt, 2, _res,
+                  (const float4*)find_array(_skey), (int)_ns,
+                  (const float4*)find_array(_tkey), (int)_nt);
+}
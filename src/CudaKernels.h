@@ -0,0 +1,46 @@
+/*
+ * CudaKernels.h - Host interface to the CUDA (or HIP) influence kernels
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+//
+// These are implemented in CudaKernels.cu, and only work on float data
+//
+// Device arrays are identified by the collection that owns them (the key) and
+//   that collection's state generation; an upload is only needed when they differ.
+//   Points are stored as (x, y, radius, strength) and panels as
+//   (x0, y0, x1, y1, vortex str, source str, 0, 0).
+//
+
+// true if there is a usable device
+bool cuda_device_ready();
+
+// true if the device already holds this state of this collection
+bool cuda_array_current(const void* _key, const uint32_t _gen);
+void cuda_array_upload(const void* _key, const uint32_t _gen, const std::vector<float>& _data);
+
+// free every device array
+void cuda_release_all();
+
+// results are (u, v, vorticity, unused) per target
+void cuda_points_on_points(const void* _skey, const size_t _ns,
+                           const void* _tkey, const size_t _nt,
+                           const bool _thick, std::vector<float>& _res);
+
+// results are (u, v) per target
+void cuda_panels_on_points(const void* _skey, const size_t _ns,
+                           const void* _tkey, const size_t _nt,
+                           std::vector<float>& _res);
+
+// results are (u, v) per target panel, not yet scaled by the panel length
+void cuda_points_on_panels(const void* _skey, const size_t _ns,
+                           const void* _tkey, const size_t _nt,
+                           std::vector<float>& _res);
@@ -11,6 +11,7 @@
 #include "Core.h"
 #include "Merge.h"
 #include "Reflect.h"
+#include "Coarsen.h"
 #ifdef PLUGIN_AVRM
   #include "VRMadaptive.h"
 #else
@@ -20,7 +21,9 @@
 #include "RVM.h"
 #include "CoreSpread.h"
 #include "BEM.h"
+#include "Profiler.h"
 #include "GuiHelper.h"
+#include "Logger.h"
 
 #include <json/json.hpp>
 
@@ -61,13 +64,45 @@ public:
       adaptive_radii(false),
       merge_thresh(0.4),
       shed_before_diffuse(true),
-      clear_thick(0.5/std::sqrt(2.0*M_PI))
+      clear_thick(0.5/std::sqrt(2.0*M_PI)),
+      fused_cleanup(false),
+      budget_target(0),
+      budget_boost(1.0),
+      budget_action(0),
+      num_created(0),
+      num_merged(0)
     {}
 
   void set_diffuse(const bool _do_diffuse) { is_inviscid = not _do_diffuse; }
   void set_amr(const bool _do_amr);
   const bool get_diffuse() const { return !is_inviscid; }
   const bool get_amr() const { return adaptive_radii; }
+  void set_fused(const bool _fused) { fused_cleanup = _fused; }
+  const bool get_fused() const { return fused_cleanup; }
+  void set_budget(const size_t _target) { budget_target = _target; }
+  const size_t get_budget() const { return budget_target; }
+  const S get_budget_boost() const { return budget_boost; }
+  const int get_budget_action() const { return budget_action; }
+  // particles made by shedding and diffusion, and removed by merging, since the last clear
+  const size_t get_num_created() const { return num_created; }
+  const size_t get_num_merged() const { return num_merged; }
+  void clear_counts() { num_created = 0; num_merged = 0; }
+
+  // the budget controller's state; the optional VRM reuse cache just starts empty
+  void write_state(CheckpointWriter& _out) const {
+    _out.put(budget_boost);
+    _out.put(budget_action);
+    rvm.write_state(_out);
+  }
+  void read_state(CheckpointReader& _in) {
+    budget_boost = _in.get<S>();
+    budget_action = _in.get<int>();
+    rvm.read_state(_in);
+  }
+
+  // the VRM and PSE scratch space and caches
+  size_t get_vrm_mem_bytes() const { return vrm.get_mem_bytes(); }
+  size_t get_pse_mem_bytes() const { return pse.get_mem_bytes(); }
 
   // take a full diffusion step
   void step(const double,
@@ -78,7 +113,8 @@ public:
             const std::array<double,Dimensions>&,
             std::vector<Collection>&,
             std::vector<Collection>&,
-            BEM<S,I>& _bem);
+            BEM<S,I>& _bem,
+            const ExecEnv&);
 
 #ifdef USE_IMGUI
   void draw_advanced();
@@ -123,8 +159,57 @@ private:
 
   // layer below which to clear vorticity
   S clear_thick;
+
+  // reflect, merge, and clear each collection in one visit, see cleanup_fused
+  bool fused_cleanup;
+
+  // fewer, larger particles far from the bodies
+  CoarseningZones<S> coarsen;
+
+  void cleanup_fused(std::vector<Collection>&, std::vector<Collection>&,
+                     const S, const S, const bool, const SymmetryPlane&);
+
+  // particle budget: nearing this many particles, merge harder and ignore more weak ones
+  size_t budget_target;		// zero means no budget
+  S budget_boost;		// multiplies the merge and ignore thresholds
+  int budget_action;		// last change to the boost: +1 raised, -1 relaxed, 0 held
+
+  void update_budget(const std::vector<Collection>&);
+
+  // new particles are counted as shedding and diffusion add them, and merges by the drop in
+  //   particles across them, so other removals (clearing, outflow) count as neither
+  size_t num_created;
+  size_t num_merged;
+  size_t count_particles(const std::vector<Collection>&);
+  void merge_counted(std::vector<Collection>&, const S, size_t&);
+
+  void add_to_pool(std::vector<Collection>&, ElementPacket<S>&, const S);
 };
 
+//
+// all new wake particles go into the one collection of free, active, Lagrangian Points
+//   (Simulation::file_elements puts flow features there too), so that the influence loops
+//   see one large set of sources instead of one per origin; make it if it is not there
+//
+template <class S, class A, class I>
+void Diffusion<S,A,I>::add_to_pool(std::vector<Collection>& _vort,
+                                   ElementPacket<S>&        _new_pts,
+                                   const S                  _vdelta) {
+  if (_new_pts.nelem == 0) return;
+
+  // same search order as file_elements: the last match
+  for (auto it = _vort.rbegin(); it != _vort.rend(); ++it) {
+    if (not std::holds_alternative<Points<S>>(*it)) continue;
+    Points<S>& pts = std::get<Points<S>>(*it);
+    if (pts.get_elemt() == active and pts.get_movet() == lagrangian and not pts.get_body_ptr()) {
+      pts.add_new(_new_pts, _vdelta);
+      return;
+    }
+  }
+
+  _vort.push_back(Points<S>(_new_pts, active, lagrangian, nullptr, _vdelta));
+}
+
 //
 template <class S, class A, class I>
 void Diffusion<S,A,I>::set_amr(const bool _do_amr) {
@@ -144,19 +229,28 @@ void Diffusion<S,A,I>::step(const double                _time,
                             const std::array<double,Dimensions>& _fs,
                             std::vector<Collection>&    _vort,
                             std::vector<Collection>&    _bdry,
-                            BEM<S,I>&                   _bem) {
+                            BEM<S,I>&                   _bem,
+                            const ExecEnv&              _env) {
 
   // don't let part diffusion type change during execution
   const PartDiffuseType curr_pd_type = pd_type;
 
   if (is_inviscid or curr_pd_type==pd_none) return;
+  PROFILE_ZONE("diffusion");
 
   // some methods require different merging properties
   if (curr_pd_type==pd_rvm) merge_thresh = 0.0;
   if (curr_pd_type==pd_core) merge_thresh = 0.02;
   else merge_thresh = 0.2;
 
-  std::cout << "Inside Diffusion::step with dt=" << _dt << std::endl;
+  // and those can be tightened to keep within the particle budget
+  update_budget(_vort);
+  merge_thresh *= budget_boost;
+
+  LOG_INFO("Inside Diffusion::step with dt=" << _dt);
+
+  size_t created = 0;
+  size_t merged = 0;
 
   // ensure that we have a current h_nu
   assert((S)_re != 0); // Can't divide by 0
@@ -170,7 +264,14 @@ void Diffusion<S,A,I>::step(const double                _time,
   //
   // always re-run the BEM calculation before shedding
   //
-  solve_bem<S,A,I>(_time, _fs, _vort, _bdry, _bem);
+  solve_bem<S,A,I>(_time, _fs, _vort, _bdry, _bem, _env);
+
+  // shedding and the VRM usually add about as many particles as last step, make room for them
+  for (auto &coll : _vort) {
+    if (std::holds_alternative<Points<S>>(coll)) {
+      std::get<Points<S>>(coll).reserve_for_growth();
+    }
+  }
 
   //
   // important for augmented BEM: reset the circulation counter
@@ -198,24 +299,20 @@ void Diffusion<S,A,I>::step(const double                _time,
         ElementPacket<S> new_pts = surf.represent_as_particles(0.01*(S)h_nu);
 
         // add those particles to the main particle list
-        if (_vort.size() == 0) {
-          // no collections yet? make a new collection
-          _vort.push_back(Points<S>(new_pts, active, lagrangian, nullptr, _vdelta));
-        } else {
-          // HACK - add all particles to first collection
-          auto& coll = _vort.back();
-          // only proceed if the last collection is Points
-          if (std::holds_alternative<Points<S>>(coll)) {
-            Points<S>& pts = std::get<Points<S>>(coll);
-            pts.add_new(new_pts, _vdelta);
-          }
-        }
+        const size_t nbefore = count_particles(_vort);
+        add_to_pool(_vort, new_pts, _vdelta);
+        created += count_particles(_vort) - nbefore;
       }
 
       // Kutta points and lifting lines can generate points here
     }
   }
 
+  //
+  // far-wake particles grow toward their zones' radii, and diffuse and merge at that spacing
+  //
+  (void) coarsen.apply(_bdry, _vort, _vdelta);
+
   //
   // diffuse strength among existing particles
   //
@@ -229,33 +326,48 @@ void Diffusion<S,A,I>::step(const double                _time,
     if (std::holds_alternative<Points<S>>(coll)) {
 
       Points<S>& pts = std::get<Points<S>>(coll);
-      std::cout << "    computing diffusion among " << pts.get_n() << " particles" << std::endl;
+      // fixed vortices (the lumped far wake of an Outflow) belong to whoever placed them
+      if (pts.get_movet() == fixed) continue;
+      LOG_DEBUG("    computing diffusion among " << pts.get_n() << " particles");
+      const size_t nbefore = pts.get_n();
 
       if (curr_pd_type==pd_vrm) {
         // vectors are not passed as const, because they may be extended with new particles
         // this call also applies the changes, though we may want to save any changes into another
         //   vector of derivatives to be applied later
+        const CellList<S>& cells = pts.get_cell_list(_vdelta/_overlap);
+        const float base_ignore = vrm.get_ignore();
+        vrm.set_ignore(base_ignore * budget_boost);
         vrm.diffuse_all(pts.get_pos(),
                         pts.get_str(),
                         pts.get_rad(),
+                        cells,
                         h_nu, core_func,
                         _overlap);
+        vrm.set_ignore(base_ignore);
 
         // resize the rest of the arrays
         pts.resize(pts.get_rad().size());
+        created += pts.get_n() - std::min(nbefore, pts.get_n());
 
       } else if (curr_pd_type==pd_pse) {
         // vectors are not passed as const, because they may be extended with new particles
         // this call also applies the changes, though we may want to save any changes into another
         //   vector of derivatives to be applied later
+        const CellList<S>& cells = pts.get_cell_list(_vdelta/_overlap);
+        const float base_ignore = pse.get_ignore();
+        pse.set_ignore(base_ignore * budget_boost);
         pse.diffuse_all(pts.get_pos(),
                         pts.get_str(),
                         pts.get_rad(),
+                        cells,
                         h_nu, core_func,
                         _overlap);
+        pse.set_ignore(base_ignore);
 
         // resize the rest of the arrays
         pts.resize(pts.get_rad().size());
+        created += pts.get_n() - std::min(nbefore, pts.get_n());
 
       } else if (curr_pd_type==pd_core) {
         // core-spreading only changes the radii, nothing else
@@ -269,30 +381,41 @@ void Diffusion<S,A,I>::step(const double                _time,
         rvm.diffuse_all(pts.get_pos(),
                         pts.get_str(),
                         pts.get_rad(),
-                        h_nu);
+                        h_nu, _time);
       }
     }
   }
 
 
-  //
-  // reflect interior particles to exterior because VRM only works in free space
-  //
-  (void) reflect_interior<S>(_bdry, _vort);
+  if (fused_cleanup) {
+    //
+    // reflect, merge, and clear each collection while it is in cache, see below
+    //
+    const size_t nbefore = count_particles(_vort);
+    cleanup_fused(_bdry, _vort, _overlap, _vdelta, curr_pd_type != pd_rvm, _env.get_symmetry_plane());
+    merged += nbefore - std::min(nbefore, count_particles(_vort));
 
+  } else {
 
-  //
-  // merge any close particles to clean up potentially-dense areas
-  //
-  if (curr_pd_type != pd_rvm) merge_operation<S>(_vort, _overlap, merge_thresh, adaptive_radii);
+    //
+    // reflect interior particles to exterior because VRM only works in free space
+    //
+    (void) reflect_interior<S>(_bdry, _vort, _env.get_symmetry_plane());
 
 
-  //
-  // clean up by removing the innermost layer - the one that will be represented by boundary strengths
-  //
-  // use method which simply pushes all still-active particles to be at or above a threshold distance
-  // cutoff is a multiple of ips (these are the last two arguments)
-  (void) clear_inner_layer<S>(1, _bdry, _vort, clear_thick, _vdelta/_overlap);
+    //
+    // merge any close particles to clean up potentially-dense areas
+    //
+    if (curr_pd_type != pd_rvm) merge_counted(_vort, _overlap, merged);
+
+
+    //
+    // clean up by removing the innermost layer - the one that will be represented by boundary strengths
+    //
+    // use method which simply pushes all still-active particles to be at or above a threshold distance
+    // cutoff is a multiple of ips (these are the last two arguments)
+    (void) clear_inner_layer<S>(1, _bdry, _vort, clear_thick, _vdelta/_overlap, _env.get_symmetry_plane());
+  }
 
 
   //
@@ -310,18 +433,9 @@ void Diffusion<S,A,I>::step(const double                _time,
         ElementPacket<S> new_pts = surf.represent_as_particles(h_nu*std::sqrt(4.0/M_PI));
 
         // add those particles to the main particle list
-        if (_vort.size() == 0) {
-          // no collections yet? make a new collection
-          _vort.push_back(Points<S>(new_pts, active, lagrangian, nullptr, _vdelta));      // vortons
-        } else {
-          // HACK - add all particles to first collection
-          auto& coll = _vort.back();
-          // only proceed if the last collection is Points
-          if (std::holds_alternative<Points<S>>(coll)) {
-            Points<S>& pts = std::get<Points<S>>(coll);
-            pts.add_new(new_pts, _vdelta);
-          }
-        }
+        const size_t nbefore = count_particles(_vort);
+        add_to_pool(_vort, new_pts, _vdelta);
+        created += count_particles(_vort) - nbefore;
       }
 
       // Kutta points and lifting lines can generate points here
@@ -331,13 +445,134 @@ void Diffusion<S,A,I>::step(const double                _time,
   //
   // merge again if clear did any work
   // 
-  if (_bdry.size() > 0 and curr_pd_type != pd_rvm) merge_operation<S>(_vort, _overlap, merge_thresh, adaptive_radii);
+  if (_bdry.size() > 0 and curr_pd_type != pd_rvm) merge_counted(_vort, _overlap, merged);
 
 
   // now is a fine time to reset the max active/particle strength
   for (auto &coll : _vort) {
     std::visit([=](auto& elem) { elem.update_max_str(); }, coll);
   }
+
+  num_created += created;
+  num_merged += merged;
+}
+
+//
+// active particles in every collection of Points
+//
+template <class S, class A, class I>
+size_t Diffusion<S,A,I>::count_particles(const std::vector<Collection>& _vort) {
+  size_t n = 0;
+  for (auto &coll : _vort) {
+    if (std::holds_alternative<Points<S>>(coll) and not std::get<Points<S>>(coll).is_inert()) {
+      n += std::get<Points<S>>(coll).get_n();
+    }
+  }
+  return n;
+}
+
+template <class S, class A, class I>
+void Diffusion<S,A,I>::merge_counted(std::vector<Collection>& _vort, const S _overlap, size_t& _merged) {
+  const size_t nbefore = count_particles(_vort);
+  merge_operation<S>(_vort, _overlap, merge_thresh, adaptive_radii);
+  _merged += nbefore - std::min(nbefore, count_particles(_vort));
+}
+
+//
+// raise the boost as the active particle count nears the budget, and relax it when well under
+//
+template <class S, class A, class I>
+void Diffusion<S,A,I>::update_budget(const std::vector<Collection>& _vort) {
+
+  budget_action = 0;
+  if (budget_target == 0) return;
+
+  size_t n = 0;
+  for (auto &coll : _vort) {
+    if (std::visit([=](auto& elem) { return elem.is_inert(); }, coll)) continue;
+    n += std::visit([=](auto& elem) { return elem.get_n(); }, coll);
+  }
+  const S fill = (S)n / (S)budget_target;
+
+  // change by this factor per step, but never tighten past the max
+  const S boost_step = 1.25;
+  const S max_boost = 16.0;
+
+  if (fill > 0.9 and budget_boost < max_boost) {
+    budget_boost = std::min(max_boost, budget_boost*boost_step);
+    budget_action = 1;
+  } else if (fill < 0.75 and budget_boost > 1.0) {
+    budget_boost = std::max((S)1.0, budget_boost/boost_step);
+    budget_action = -1;
+  }
+
+  LOG_INFO("  particle budget at " << (int)(100.0*fill) << "%, threshold boost " << budget_boost);
+}
+
+//
+// the same reflect, merge, and clear as in step, but done one collection at a time: merging
+//   leaves its absorbed particles in place with no strength, so the push-out can reuse the
+//   cell list from the merge (it only needs updating), and each collection is compacted once
+//
+// the particles that survive are the same as with the separate calls
+//
+template <class S, class A, class I>
+void Diffusion<S,A,I>::cleanup_fused(std::vector<Collection>& _bdry,
+                                     std::vector<Collection>& _vort,
+                                     const S                  _overlap,
+                                     const S                  _vdelta,
+                                     const bool               _do_merge,
+                                     const SymmetryPlane&     _sp) {
+
+  for (auto &coll : _vort) {
+
+    // this should only function when _vort is Points and _bdry is Surfaces
+    if (not std::holds_alternative<Points<S>>(coll)) continue;
+    Points<S>& pts = std::get<Points<S>>(coll);
+
+    // reflect interior particles to exterior because VRM only works in free space, in the
+    //   same order as reflect_interior
+    for (auto &src : _bdry) {
+      if (std::holds_alternative<Surfaces<S>>(src)) {
+        (void) reflect_panp2<S>(std::get<Surfaces<S>>(src), pts);
+      }
+    }
+    (void) reflect_plane<S>(pts, _sp);
+
+    // merge_operation leaves fixed collections alone, and only lagrangian ones are pushed out
+    if (pts.get_movet() == fixed) continue;
+
+    // merge any close particles, but only flag the absorbed ones (keep all tracer particles)
+    std::vector<uint8_t> keep;
+    if (_do_merge and not pts.is_inert() and pts.get_n() > 0) {
+      const Vector<S>& r = std::as_const(pts).get_rad();
+      const S nom_sep = *std::max_element(r.begin(), r.end()) / _overlap;
+      const CellList<S>& cells = pts.get_cell_list(nom_sep);
+      (void) merge_close_particles(pts.get_pos(),
+                                   pts.get_str(),
+                                   pts.get_rad(),
+                                   cells,
+                                   _overlap,
+                                   merge_thresh,
+                                   adaptive_radii,
+                                   &keep);
+    }
+
+    // push all still-active particles to be at or above a threshold distance
+    //   absorbed particles get pushed too, but they have no strength
+    if (pts.get_movet() == lagrangian) {
+      for (auto &src : _bdry) {
+        if (std::holds_alternative<Surfaces<S>>(src)) {
+          Surfaces<S>& surf = std::get<Surfaces<S>>(src);
+          const S lost_circ = clear_inner_panp2<S>(1, surf, pts, clear_thick, _vdelta/_overlap);
+          surf.add_to_reabsorbed(lost_circ);
+        }
+      }
+    }
+
+    // and only now remove the absorbed particles
+    if (not keep.empty()) compact_collection(pts, keep);
+  }
 }
 
 #ifdef USE_IMGUI
@@ -371,6 +606,12 @@ void Diffusion<S,A,I>::draw_advanced() {
       case 3: pd_type = pd_vrm; break;
   } // end switch
 
+  bool use_fused = get_fused();
+  ImGui::Checkbox("Fuse reflect, merge, and clear stages", &use_fused);
+  ImGui::SameLine();
+  ShowHelpMarker("Process each particle collection through all cleanup stages at once, sharing one spatial index and one compaction. Results are unchanged.");
+  set_fused(use_fused);
+
 
   // now, present options, depending on the diffusion type
   if (pd_type == pd_vrm) {
@@ -472,9 +713,22 @@ void Diffusion<S,A,I>::from_json(const nlohmann::json j) {
   }
   std::cout << "  setting is_viscous= " << get_diffuse() << std::endl;
 
+  if (j.find("particleBudget") != j.end()) {
+    budget_target = j["particleBudget"];
+    std::cout << "  setting budget_target= " << budget_target << std::endl;
+  }
+
+  if (j.find("fusedCleanup") != j.end()) {
+    fused_cleanup = j["fusedCleanup"];
+    std::cout << "  setting fused_cleanup= " << fused_cleanup << std::endl;
+  }
+
+  coarsen.from_json(j);
+
   // regardless, load some settings as they were
   vrm.from_json(j);
   pse.from_json(j);
+  rvm.from_json(j);
 
 #ifdef PLUGIN_AVRM
   // set adaptive-VRM-specific settings
@@ -508,6 +762,10 @@ void Diffusion<S,A,I>::add_to_json(nlohmann::json& j) const {
   j["adaptiveSize"] = adaptive_radii;
 #endif
 
+  if (fused_cleanup) j["fusedCleanup"] = true;
+  if (budget_target > 0) j["particleBudget"] = budget_target;
+  coarsen.add_to_json(j);
+
   // eventually write other parameters
   //j["core"] = core_func;
 
@@ -515,5 +773,6 @@ void Diffusion<S,A,I>::add_to_json(nlohmann::json& j) const {
   vrm.add_to_json(j);
   // PSE always writes its parameters too
   pse.add_to_json(j);
+  if (pd_type == pd_rvm) rvm.add_to_json(j);
 }
 
@@ -11,6 +11,12 @@
 #include "Omega2D.h"
 #include "Body.h"
 #include "ElementPacket.h"
+#include "ReduceHelper.h"
+#include "Compact.h"
+#include "MemoryHelper.h"
+#include "Checkpoint.h"
+#include "Logger.h"
+#include "Numa.h"
 
 #include <iostream>
 #include <vector>
@@ -20,7 +26,54 @@
 #include <variant>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <atomic>
+
+
+// every change to any collection's positions or strengths draws a new, unique generation number,
+//   so that caches (host or device) can tell both "which collection" and "which state" from it
+inline uint32_t next_state_gen() {
+  static std::atomic<uint32_t> last_gen(0);
+  return ++last_gen;
+}
+
+// the arrays of every collection grow geometrically, so that many small additions (shedding,
+//   VRM insertions, emitters) reallocate only O(log N) times; this counts the reallocations
+inline std::atomic<size_t>& array_reallocs() {
+  static std::atomic<size_t> count(0);
+  return count;
+}
+
+// capacity grows by half again, or to the request if that is more; with USE_NUMA the
+//   OpenMP threads write the new elements, see Numa.h
+template <class V>
+void grow_array(V& _v, const size_t _n) {
+  size_t cap = _v.capacity();
+  if (_n > cap) {
+    cap = std::max(_n, cap + cap/2);
+    ++array_reallocs();
+  }
+  first_touch_resize(_v, _n, cap);
+}
+
+template <class V>
+void reserve_array(V& _v, const size_t _n) {
+  if (_n > _v.capacity()) {
+    _v.reserve(_n);
+    ++array_reallocs();
+  }
+}
+
+// after a large merge, an array using less than this fraction of its capacity gives it back
+static constexpr size_t shrink_fraction = 4;
 
+template <class V>
+void shrink_array(V& _v) {
+  if (_v.size() < _v.capacity() / shrink_fraction) {
+    _v.shrink_to_fit();
+    ++array_reallocs();
+  }
+}
 
 // the superclass
 
@@ -31,7 +84,8 @@ public:
                  const elem_t _e,
                  const move_t _m,
                  std::shared_ptr<Body> _bp) :
-      E(_e), M(_m), B(_bp), n(_n) {
+      E(_e), M(_m), B(_bp), n(_n), state_gen(next_state_gen()), pos_gen(state_gen), str_gen(state_gen),
+      lineage(next_state_gen()) {
   }
 
   size_t get_n() const { return n; }
@@ -41,9 +95,53 @@ public:
   const std::shared_ptr<Body>             get_body_ptr() const { return B; }
   std::shared_ptr<Body>                   get_body_ptr()   { return B; }
   const std::array<Vector<S>,Dimensions>& get_pos() const  { return x; }
-  std::array<Vector<S>,Dimensions>&       get_pos()        { return x; }
+  std::array<Vector<S>,Dimensions>&       get_pos()        { pos_changed(); return x; }
   const Vector<S>&                        get_str() const  { return *s; }
-  Vector<S>&                              get_str()        { return *s; }
+  Vector<S>&                              get_str()        { str_changed(); return *s; }
+
+  // any change (or chance of change) to positions or strengths bumps this
+  uint32_t get_state_gen() const { return state_gen; }
+  void state_changed() { state_gen = pos_gen = str_gen = next_state_gen(); }
+
+  // and these follow only the geometry (positions, radii) or only the strengths
+  uint32_t get_pos_gen() const { return pos_gen; }
+  uint32_t get_str_gen() const { return str_gen; }
+  void pos_changed() { state_gen = pos_gen = next_state_gen(); }
+  void str_changed() { state_gen = str_gen = next_state_gen(); }
+
+  // copies keep this, so a moved copy (an RK stage) can find what was built for its original
+  uint32_t get_lineage() const { return lineage; }
+
+  // bytes reserved by the per-element arrays
+  size_t get_mem_bytes() const {
+    return vec_bytes(x) + vec_bytes(u) + vec_bytes(ux) + vec_bytes(s) + vec_bytes(w) + vec_bytes(ug);
+  }
+
+  // everything which changes as the simulation runs, see Checkpoint.h
+  void write_state(CheckpointWriter& _out) const {
+    _out.put(n);
+    _out.put_vecs(x);
+    _out.put_opt(s);
+    _out.put_vecs(u);
+    _out.put_opt(w);
+    _out.put((uint8_t)ux.has_value());
+    if (ux) _out.put_vecs(*ux);
+  }
+  void read_state(CheckpointReader& _in) {
+    n = _in.get<size_t>();
+    _in.get_vecs(x);
+    _in.get_opt(s);
+    _in.get_vecs(u);
+    _in.get_opt(w);
+    if (_in.get<uint8_t>()) {
+      if (not ux) ux = std::array<Vector<S>,Dimensions>();
+      _in.get_vecs(*ux);
+    } else {
+      ux.reset();
+    }
+    if (x[0].size() != n) _in.fail();
+    state_changed();
+  }
   const std::array<Vector<S>,Dimensions>& get_vel() const  { return u; }
   std::array<Vector<S>,Dimensions>&       get_vel()        { return u; }
 
@@ -77,19 +175,32 @@ public:
       w = std::move(new_vort);
     }
     *w = _in;
+    this->str_changed();
     //std::cout << "Received vorticity on " << n << " nodes, starting with " << (*w)[0] << std::endl;
   }
 
-  void set_str(const size_t ioffset, const size_t icnt, Vector<S> _in) {
+  // velocity gradients du/dx, dv/dx, du/dy, dv/dy, found only when asked for
+  const bool has_velgrad() const { return ug and (*ug)[0].size() == n; }
+  const std::array<Vector<S>,4>& get_velgrad() const {
+    return *ug;
+  }
+  std::array<Vector<S>,4>& get_velgrad() {
+    if (not ug) ug = std::array<Vector<S>,4>();
+    for (auto& g : *ug) if (g.size() != n) g.resize(n, 0.0);
+    return *ug;
+  }
+
+  void set_str(const size_t ioffset, const size_t icnt, const Vector<S>& _in) {
     assert(s && "Strength array does not exist");
     assert(_in.size() == (*s).size() && "Set strength array size does not match");
 
     // copy over the strengths
     *s = _in;
+    str_changed();
   }
 
   // child class calls here to add nodes and other properties
-  void add_new(const std::vector<float>& _in) {
+  void add_new(const std::vector<S>& _in) {
 
     // check inputs
     if (_in.size() == 0) return;
@@ -100,7 +211,7 @@ public:
     // this initialization is specific to Points - so should we do it there?
     for (size_t d=0; d<Dimensions; ++d) {
       // extend with more space for new values
-      x[d].resize(n+nnew);
+      grow_array(x[d], n+nnew);
       // copy new values to end of vector
       for (size_t i=0; i<nnew; ++i) {
         x[d][n+i] = _in[nper*i+d];
@@ -110,7 +221,7 @@ public:
     // strength
     if (s) {
       // must dereference s to get the actual vector
-      (*s).resize(n+nnew);
+      grow_array(*s, n+nnew);
       for (size_t i=0; i<nnew; ++i) {
         (*s)[n+i] = _in[nper*i+2];
       }
@@ -118,8 +229,10 @@ public:
 
     // extend the other vectors as well
     for (size_t d=0; d<Dimensions; ++d) {
-      u[d].resize(n+nnew);
+      grow_array(u[d], n+nnew);
     }
+    // new elements have no gradients until the next evaluation
+    if (ug) for (auto& g : *ug) grow_array(g, n+nnew);
     //if (dsdt) {
     //  for (size_t d=0; d<Dimensions; ++d) {
     //    (*dsdt)[d].resize(n+nnew);
@@ -128,10 +241,11 @@ public:
 
     // finally, update n
     n += nnew;
+    state_changed();
   }
 
   // child class calls here to add nodes and other properties
-  void add_new(const ElementPacket<float>& _in) {
+  void add_new(const ElementPacket<S>& _in) {
 
     // check inputs
     if (_in.x.size() == 0 or _in.nelem == 0) return;
@@ -143,7 +257,7 @@ public:
     // add node coordinates
     for (size_t d=0; d<Dimensions; ++d) {
       // extend with more space for new values
-      x[d].resize(n+nnew);
+      grow_array(x[d], n+nnew);
       // copy new values to end of vector
       for (size_t i=0; i<nnew; ++i) {
         x[d][n+i] = _in.x[Dimensions*i+d];
@@ -155,7 +269,7 @@ public:
       assert(_in.val.size() >= nnew && "Input ElementPacket does not have enough values in val");
       const size_t nper = _in.val.size() / nnew;
       // must dereference s to get the actual vector
-      (*s).resize(n+nnew);
+      grow_array(*s, n+nnew);
       for (size_t i=0; i<nnew; ++i) {
         (*s)[n+i] = _in.val[nper*i+0];
       }
@@ -163,11 +277,14 @@ public:
 
     // extend the other vectors as well
     for (size_t d=0; d<Dimensions; ++d) {
-      u[d].resize(n+nnew);
+      grow_array(u[d], n+nnew);
     }
+    // new elements have no gradients until the next evaluation
+    if (ug) for (auto& g : *ug) grow_array(g, n+nnew);
 
     // finally, update n
     n += nnew;
+    state_changed();
   }
 
 
@@ -181,7 +298,7 @@ public:
     // positions first
     for (size_t d=0; d<Dimensions; ++d) {
       const size_t thisn = x[d].size();
-      x[d].resize(_nnew);
+      grow_array(x[d], _nnew);
       for (size_t i=thisn; i<_nnew; ++i) {
         x[d][i] = 0.0;
       }
@@ -190,7 +307,7 @@ public:
     // strength
     if (s) {
       const size_t thisn = (*s).size();
-      (*s).resize(_nnew);
+      grow_array(*s, _nnew);
       for (size_t i=thisn; i<_nnew; ++i) {
         (*s)[i] = 0.0;
       }
@@ -198,11 +315,56 @@ public:
 
     // and finally velocity (no need to set it)
     for (size_t d=0; d<Dimensions; ++d) {
-      u[d].resize(_nnew);
+      grow_array(u[d], _nnew);
     }
+    if (ug) for (auto& g : *ug) grow_array(g, _nnew);
 
     // lastly, update n
     n = _nnew;
+    state_changed();
+  }
+
+  // make room for this many elements without changing the count
+  void reserve(const size_t _ncap) {
+    for (size_t d=0; d<Dimensions; ++d) {
+      reserve_array(x[d], _ncap);
+      reserve_array(u[d], _ncap);
+      if (ux) reserve_array((*ux)[d], _ncap);
+    }
+    if (s) reserve_array(*s, _ncap);
+    if (w) reserve_array(*w, _ncap);
+    if (ug) for (auto& g : *ug) reserve_array(g, _ncap);
+  }
+
+  // remove the elements not flagged to keep from every per-element array in one pass,
+  //   along with any arrays a subclass adds
+  size_t compact(const std::vector<uint8_t>& _keep, std::vector<Vector<S>*> _more = {}) {
+    assert(_keep.size() == n && "Keep flags do not match collection");
+    for (size_t d=0; d<Dimensions; ++d) {
+      _more.push_back(&x[d]);
+      _more.push_back(&u[d]);
+      if (ux) _more.push_back(&(*ux)[d]);
+    }
+    if (s) _more.push_back(&(*s));
+    if (w) _more.push_back(&(*w));
+    if (ug) for (auto& g : *ug) if (g.size() == n) _more.push_back(&g);
+    n = compact_arrays<Vector<S>>(_keep, _more);
+    // velocities which did not cover every element are not worth keeping
+    for (size_t d=0; d<Dimensions; ++d) if (u[d].size() != n) u[d].resize(n);
+    state_changed();
+    return n;
+  }
+
+  // give back the capacity of any array which is now mostly empty
+  void shrink() {
+    for (size_t d=0; d<Dimensions; ++d) {
+      shrink_array(x[d]);
+      shrink_array(u[d]);
+      if (ux) shrink_array((*ux)[d]);
+    }
+    if (s) shrink_array(*s);
+    if (w) shrink_array(*w);
+    if (ug) for (auto& g : *ug) shrink_array(g);
   }
 
   // should rename these zero_results
@@ -214,6 +376,9 @@ public:
       if (w->size() != n) w->resize(n);
       std::fill((*w).begin(), (*w).end(), 0.0);
     }
+    if (ug) {
+      for (auto& g : *ug) g.assign(n, 0.0);
+    }
   }
 
   // should rename these finalize_results
@@ -230,6 +395,9 @@ public:
         (*w)[i] *= factor;
       }
     }
+    if (ug) {
+      for (auto& g : *ug) for (auto& gi : g) gi *= factor;
+    }
   }
 
   void add_body_motion(const S factor, const double _time) {
@@ -240,6 +408,7 @@ public:
     if (s) {
       std::fill((*s).begin(), (*s).end(), 0.0);
     }
+    str_changed();
   }
 
   // do nothing here
@@ -255,27 +424,68 @@ public:
       // for the no-rotation case, we can just transform here
       std::array<double,Dimensions> thispos = B->get_pos();
       const double theta = B->get_orient();
-      const S st = std::sin(theta);
-      const S ct = std::cos(theta);
 
-      std::cout << "    transforming body at time " << (S)_time << " to " << (S)thispos[0] << " " << (S)thispos[1]
-                << " and theta " << theta << " omega " << B->get_rotvel() << std::endl;
+      // nothing to do if the body is where we last put these nodes, and they were not touched since
+      const std::array<double,3> pose = {thispos[0], thispos[1], theta};
+      if (pose == xform_pose and pos_gen == xform_gen) return;
 
-      // and do the transform
-      for (size_t i=0; i<get_n(); ++i) {
+      const S st = std::sin(theta);
+      const S ct = std::cos(theta);
+      const S px = (S)thispos[0];
+      const S py = (S)thispos[1];
+
+      LOG_DEBUG("    transforming body at time " << (S)_time << " to " << (S)thispos[0] << " " << (S)thispos[1]
+                << " and theta " << theta << " omega " << B->get_rotvel());
+
+      // and do the transform, noting whether anything really moved
+      const S* const ux0 = (*ux)[0].data();
+      const S* const ux1 = (*ux)[1].data();
+      S* const x0 = x[0].data();
+      S* const x1 = x[1].data();
+      bool moved = false;
+      #pragma omp parallel for simd reduction(||:moved) if(n > 20000)
+      for (size_t i=0; i<n; ++i) {
         // rotate and translate
-        x[0][i] = (S)thispos[0] + (*ux)[0][i]*ct - (*ux)[1][i]*st;
-        x[1][i] = (S)thispos[1] + (*ux)[0][i]*st + (*ux)[1][i]*ct;
+        const S newx = px + ux0[i]*ct - ux1[i]*st;
+        const S newy = py + ux0[i]*st + ux1[i]*ct;
+        moved = moved or (newx != x0[i]) or (newy != x1[i]);
+        x0[i] = newx;
+        x1[i] = newy;
       }
+      if (moved) pos_changed();
+      xform_pose = pose;
+      xform_gen = pos_gen;
     }
   }
 
+  // take another collection's positions and strengths into this one's storage, which is
+  //   only reallocated if it must grow; velocities are sized but not copied
+  void copy_state_from(const ElementBase<S>& _src) {
+    E = _src.E;
+    M = _src.M;
+    B = _src.B;
+    n = _src.n;
+    for (size_t d=0; d<Dimensions; ++d) {
+      x[d].assign(_src.x[d].begin(), _src.x[d].end());
+      u[d].resize(n);
+    }
+    s = _src.s;
+    ux = _src.ux;
+    if (w) w->resize(n);
+    if (ug) for (auto& g : *ug) g.resize(n);
+    lineage = _src.lineage;
+    state_changed();
+    // an exact copy, so anything kept for the original's geometry and strengths still holds
+    pos_gen = _src.pos_gen;
+    str_gen = _src.str_gen;
+  }
+
   // time is the starting time, time+dt is the ending time
   void move(const double _time, const double _dt,
             const double _wt1, ElementBase<S> const & _u1) {
 
     if (M == lagrangian) {
-      std::cout << "  Moving" << to_string() << std::endl;
+      LOG_DEBUG("  Moving" << to_string());
 
       // update positions
       for (size_t d=0; d<Dimensions; ++d) {
@@ -284,6 +494,8 @@ public:
         }
       }
 
+      state_changed();
+
       // update strengths (in derived class)
 
     } else if (B and M == bodybound) {
@@ -299,7 +511,7 @@ public:
     // must confirm that incoming time derivates include velocity
     // if this has vels, then lets advect it
     if (M == lagrangian) {
-      std::cout << "  Moving" << to_string() << std::endl;
+      LOG_DEBUG("  Moving" << to_string());
 
       // update positions
       for (size_t d=0; d<Dimensions; ++d) {
@@ -308,6 +520,8 @@ public:
         }
       }
 
+      state_changed();
+
       // update strengths (in derived class)
 
     } else if (B and M == bodybound) {
@@ -324,7 +538,7 @@ public:
     // must confirm that incoming time derivates include velocity
     // if this has vels, then lets advect it
     if (M == lagrangian) {
-      std::cout << "  Moving" << to_string() << std::endl;
+      LOG_DEBUG("  Moving" << to_string());
 
       // update positions
       for (size_t d=0; d<Dimensions; ++d) {
@@ -333,6 +547,8 @@ public:
         }
       }
 
+      state_changed();
+
       // update strengths (in derived class)
 
     } else if (B and M == bodybound) {
@@ -357,18 +573,9 @@ public:
     S circ = 0.0;
 
     if (s) {
-      if (s->size() < 40000) {
-        // we have strengths, add them up
-        // this is the c++17 way
-        //return std::reduce(std::execution::par, s->begin(), s->end());
-        // this is the c++11 way
-        circ = std::accumulate(s->begin(), s->end(), 0.0);
-      } else {
-        // do it in double precision instead
-        Vector<double> dblstr(s->begin(), s->end());
-        double dblcirc = std::accumulate(dblstr.begin(), dblstr.end(), 0.0);
-        circ = (float)dblcirc;
-      }
+      // we have strengths, add them up, in double precision and the same order on any thread count
+      const Vector<S>& str = *s;
+      circ = (S)reproducible_sum<double>(str.size(), [&str](const size_t i) { return str[i]; });
     }
 
     return circ;
@@ -415,13 +622,20 @@ protected:
   // state vector
   std::array<Vector<S>,Dimensions> x;                   // position of nodes
   std::optional<Vector<S>> s;                           // strength at nodes
+  uint32_t state_gen;                                   // generation of x and s, for caches
+  uint32_t pos_gen;                                     // generation of x alone
+  uint32_t str_gen;                                     // generation of s alone
+  uint32_t lineage;                                     // shared by this and all of its copies
 
   // time derivative of state vector
   std::array<Vector<S>,Dimensions> u;                   // velocity at nodes
   std::optional<Vector<S>> w;                           // vorticity at nodes
+  std::optional<std::array<Vector<S>,4>> ug;            // velocity gradients at nodes
   //std::optional<std::array<Vector<S>,Dimensions>> dsdt; // strength change
 
   // for objects moving with a body
   std::optional<std::array<Vector<S>,Dimensions>> ux;   // untransformed position of nodes
+  std::array<double,3> xform_pose = {std::nan(""), std::nan(""), std::nan("")}; // body pose at last transform
+  uint32_t xform_gen = 0;                               // and the generation of x it left
 };
 
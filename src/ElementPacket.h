@@ -13,7 +13,9 @@
 #include <algorithm>
 #include <functional>
 #include <vector>
+#include <utility>
 #include <iostream>
+#include <type_traits>
 
 // Helper class for passing arbitrary elements around
 template<class S>
@@ -24,7 +26,7 @@ public:
                    std::vector<S> _val = std::vector<S>(),
                    size_t _nelem = 55,
                    uint8_t _ndim = 55)
-    : x(_x), idx(_idx), val(_val), nelem(_nelem), ndim(_ndim)
+    : x(std::move(_x)), idx(std::move(_idx)), val(std::move(_val)), nelem(_nelem), ndim(_ndim)
     {}
   ~ElementPacket<S>() = default;
 
@@ -101,3 +103,14 @@ public:
 		// 0=points, 1=lines, 2=surfaces, 3=volumes for 3D
 };
 
+// the same elements in another precision, or the packet itself if it is already in that one
+template <class T, class S>
+std::conditional_t<std::is_same<T,S>::value, const ElementPacket<S>&, ElementPacket<T>>
+as_precision(const ElementPacket<S>& _in) {
+  if constexpr (std::is_same<T,S>::value) {
+    return _in;
+  } else {
+    return ElementPacket<T>(std::vector<T>(_in.x.begin(), _in.x.end()), _in.idx,
+                            std::vector<T>(_in.val.begin(), _in.val.end()), _in.nelem, _in.ndim);
+  }
+}
@@ -7,22 +7,84 @@
 
 #pragma once
 
+#include "CoreFunc.h"
+
 #include <string>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
 
 // solver type/order
 enum summation_t {
   direct    = 1,
   barneshut = 2,
-  vic       = 3,	// unsupported internally
-  fmm       = 4		// unsupported internally
+  vic       = 3,	// particles only, see Vic.h
+  fmm       = 4
 };
 
 // solver acceleration
 enum accel_t {
   cpu_x86    = 1,
   cpu_vc     = 2,
-  gpu_opengl = 3,	// unsupported internally
-  gpu_cuda   = 4	// unsupported internally
+  gpu_opengl = 3,	// OpenGL compute shaders, GUI only
+  gpu_cuda   = 4,	// CUDA or HIP devices
+  cpu_simd   = 5	// portable SIMD via std::experimental::simd
+};
+
+
+// the domain repeats every period in x, from origin; no period means an open domain, see Periodic.h
+struct PeriodicDomain {
+  double period = 0.0;
+  double origin = 0.0;
+
+  bool active() const { return period > 0.0; }
+
+  // where _x lands inside [origin, origin+period)
+  template <class S>
+  S wrap(const S _x) const {
+    return _x - (S)(period * std::floor(((double)_x - origin) / period));
+  }
+
+  // separation to the nearest image
+  template <class S>
+  S nearest(const S _dx) const {
+    return _dx - (S)(period * std::round((double)_dx / period));
+  }
+
+  bool operator==(const PeriodicDomain& _p) const { return period == _p.period and origin == _p.origin; }
+};
+
+// only the half of the flow above the plane y=height is stored, see Symmetry.h
+struct SymmetryPlane {
+  bool on = false;
+  double height = 0.0;
+
+  bool active() const { return on; }
+
+  // twice the height, which the mirrored kernels take
+  double get_yp() const { return 2.0 * height; }
+
+  template <class S>
+  S mirror(const S _y) const { return (S)(2.0 * height) - _y; }
+
+  bool operator==(const SymmetryPlane& _p) const { return on == _p.on and height == _p.height; }
+};
+
+// the weakest particles may be left out of the far field of each sum, see Prune.h
+struct SourcePruning {
+  double tolerance = 0.0;	// largest velocity error allowed
+  double radius = 0.0;		// within this, dropped sources are added back (0 means 4 core radii)
+
+  // fewer particles than this are never pruned, nor when less than this fraction would go
+  size_t min_sources = 2000;
+  double min_fraction = 0.05;
+
+  bool active() const { return tolerance > 0.0; }
+
+  bool operator==(const SourcePruning& _p) const {
+    return tolerance == _p.tolerance and radius == _p.radius and
+           min_sources == _p.min_sources and min_fraction == _p.min_fraction;
+  }
 };
 
 
@@ -37,7 +99,20 @@ public:
           const accel_t _acceltype)
     : m_internal(_internal),
       m_summ(_sumtype),
-      m_accel(_acceltype)
+      m_accel(_acceltype),
+      m_theta(0.5),
+      m_order(8),
+      m_leafsize(32),
+      m_treetag(0),
+      m_pnear(0.0),
+      m_compensated(false),
+      m_viccell(1.0),
+      m_plugin(),
+      m_auto(false),
+      m_core(default_vel_core),
+      m_periodic(),
+      m_symmetry(),
+      m_pruning()
     {}
 
   // default (delegating) ctor
@@ -45,12 +120,18 @@ public:
 #ifdef EXTERNAL_VEL_SOLVE
   #ifdef USE_VC
     : ExecEnv(false, direct, cpu_vc)
+  #elif defined(USE_STDSIMD)
+    : ExecEnv(false, direct, cpu_simd)
   #else
     : ExecEnv(false, direct, cpu_x86)
   #endif
 #else
-  #ifdef USE_VC
+  #ifdef USE_CUDA
+    : ExecEnv(true, direct, gpu_cuda)
+  #elif defined(USE_VC)
     : ExecEnv(true, direct, cpu_vc)
+  #elif defined(USE_STDSIMD)
+    : ExecEnv(true, direct, cpu_simd)
   #else
     : ExecEnv(true, direct, cpu_x86)
   #endif
@@ -62,16 +143,82 @@ public:
   void set_internal(const bool _isint) { m_internal = _isint; };
   bool is_internal() const { return m_internal; };
   void set_summation(const summation_t _newsumm) { m_summ = _newsumm; };
+  summation_t get_summation() const { return m_summ; };
   void set_instrs(const accel_t _newaccel) { m_accel = _newaccel; };
   accel_t get_instrs() const { return m_accel; };
 
+  // treecode and fmm parameters
+  void set_opening_angle(const float _theta) { m_theta = _theta; };
+  float get_opening_angle() const { return m_theta; };
+  void set_expansion_order(const int32_t _order) { m_order = _order; };
+  int32_t get_expansion_order() const { return m_order; };
+  void set_leaf_size(const size_t _leafsize) { m_leafsize = _leafsize; };
+  size_t get_leaf_size() const { return m_leafsize; };
+  void set_tree_tag(const uint32_t _tag) { m_treetag = _tag; };
+  uint32_t get_tree_tag() const { return m_treetag; };
+
+  // direct sum parameters
+  void set_panel_near_field(const float _pnear) { m_pnear = _pnear; };
+  float get_panel_near_field() const { return m_pnear; };
+  void set_compensated_sums(const bool _comp) { m_compensated = _comp; };
+  bool use_compensated_sums() const { return m_compensated; };
+
+  // vortex-in-cell parameters
+  void set_vic_cell_ratio(const float _ratio) { m_viccell = _ratio; };
+  float get_vic_cell_ratio() const { return m_viccell; };
+
+  // let each source-target pair pick its own summation and instructions, see AutoTune.h
+  void set_auto_summation(const bool _auto) { m_auto = _auto; };
+  bool use_auto_summation() const { return m_auto; };
+
+  // a shared library to do the particle sums instead, see VelPlugin.h
+  void set_plugin(const std::string& _path) { m_plugin = _path; };
+  const std::string& get_plugin() const { return m_plugin; };
+  bool has_plugin() const { return not m_plugin.empty(); };
+
+  // the core function of the vortex particles, which each case sets, see CoreFunc.h
+  void set_velocity_core(const VelCore _core) { m_core = _core; };
+  VelCore get_velocity_core() const { return m_core; };
+
+  // the flow of each case may repeat in x, which every sum must then see
+  void set_periodic_domain(const PeriodicDomain& _pd) { m_periodic = _pd; };
+  const PeriodicDomain& get_periodic_domain() const { return m_periodic; };
+  // or have a mirror image below a plane
+  void set_symmetry_plane(const SymmetryPlane& _sp) { m_symmetry = _sp; };
+  const SymmetryPlane& get_symmetry_plane() const { return m_symmetry; };
+
+  // trade a bounded velocity error for fewer sources in the far field
+  void set_source_pruning(const SourcePruning& _sp) { m_pruning = _sp; };
+  const SourcePruning& get_source_pruning() const { return m_pruning; };
+
+  // would the two compute the same sums, to the bit; the tree tag only changes the speed
+  bool same_sums(const ExecEnv& _e) const {
+    return m_internal == _e.m_internal and m_summ == _e.m_summ and m_accel == _e.m_accel and
+           m_theta == _e.m_theta and m_order == _e.m_order and m_leafsize == _e.m_leafsize and
+           m_pnear == _e.m_pnear and m_compensated == _e.m_compensated and
+           m_viccell == _e.m_viccell and m_plugin == _e.m_plugin and m_auto == _e.m_auto and
+           m_core == _e.m_core and m_periodic == _e.m_periodic and
+           m_symmetry == _e.m_symmetry and m_pruning == _e.m_pruning;
+  }
+
   std::string to_string() const {
     std::string mystr;
-    if (m_internal) {
+    if (has_plugin()) {
+      mystr += " plugin " + m_plugin + " with";
+    }
+    if (m_internal and m_auto) {
+      mystr += " auto-selected sums";
+    } else if (m_internal) {
       if (m_accel == cpu_x86) {
         mystr += " native";
       } else if (m_accel == cpu_vc) {
         mystr += " Vc-accelerated";
+      } else if (m_accel == cpu_simd) {
+        mystr += " SIMD-accelerated";
+      } else if (m_accel == gpu_opengl) {
+        mystr += " OpenGL-accelerated";
+      } else if (m_accel == gpu_cuda) {
+        mystr += " GPU-accelerated";
       } else {
         mystr += " unknown acceleration";
       }
@@ -79,6 +226,10 @@ public:
         mystr += " direct sums";
       } else if (m_summ == barneshut) {
         mystr += " treecode";
+      } else if (m_summ == fmm) {
+        mystr += " fast multipole";
+      } else if (m_summ == vic) {
+        mystr += " vortex-in-cell";
       } else {
         mystr += " unknown algorithm";
       }
@@ -92,5 +243,40 @@ protected:
   bool m_internal;
   summation_t m_summ;
   accel_t m_accel;
+
+  // treecode/fmm opening angle (ratio of node size to distance), terms per expansion, sources per leaf
+  float m_theta;
+  int32_t m_order;
+  size_t m_leafsize;
+
+  // trees built under the same nonzero tag are refit to moved elements instead of rebuilt
+  uint32_t m_treetag;
+
+  // panels act as points on targets beyond this many panel lengths, 0 keeps every panel exact
+  float m_pnear;
+
+  // add blocks of source influences with Kahan compensation
+  bool m_compensated;
+
+  // vortex-in-cell grid spacing, relative to the mean source core radius
+  float m_viccell;
+
+  // path to a velocity plugin, empty for none
+  std::string m_plugin;
+
+  // summation chosen per pair
+  bool m_auto;
+
+  // particle core function
+  VelCore m_core;
+
+  // periodic images in x
+  PeriodicDomain m_periodic;
+
+  // mirror images in y
+  SymmetryPlane m_symmetry;
+
+  // far-field source pruning
+  SourcePruning m_pruning;
 };
 
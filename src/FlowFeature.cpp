@@ -7,7 +7,9 @@
  */
 
 #include "BoundaryFeature.h"
+#include "MpiHelper.h"
 #include "FlowFeature.h"
+#include "Philox.h"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
@@ -16,6 +18,7 @@
 #include <cmath>
 #include <iostream>
 #include <sstream>
+#include <utility>
 #include <random>
 
 // write out any object of parent type FlowFeature by dispatching to appropriate "debug" method
@@ -161,7 +164,7 @@ SingleParticle::init_elements(float _ips) const {
   std::vector<float> x = {m_x, m_y};
   std::vector<Int> idx = {};
   std::vector<float> vals = {m_str};
-  ElementPacket<float> packet({x, idx, vals, (size_t)1, 0});
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)1, 0});
   if (packet.verify(packet.x.size()+packet.val.size(), 3)) {
     return packet;
   } else {
@@ -282,7 +285,8 @@ VortexBlob::init_elements(float _ips) const {
     vals[i] = (float)((double)vals[i] * str_scale);
   }
 
-  ElementPacket<float> packet({x, idx, vals, x.size()/2, 0});
+  const size_t n = x.size()/2;
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), n, 0});
   if (packet.verify(packet.x.size()+packet.val.size(), 3)) {
     return packet;
   } else {
@@ -413,7 +417,8 @@ AsymmetricBlob::init_elements(float _ips) const {
     vals[i] = (float)((double)vals[i] * str_scale);
   }
 
-  ElementPacket<float> packet({x, idx, vals, x.size()/2, 0});
+  const size_t n = x.size()/2;
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), n, 0});
   if (packet.verify(packet.x.size()+packet.val.size(), 3)) {
     return packet;
   } else {
@@ -539,7 +544,8 @@ GaussianBlob::init_elements(float _ips) const {
     vals[i] = (float)((double)vals[i] * str_scale);
   }
 
-  ElementPacket<float> packet({x, idx, vals, x.size()/2, 0});
+  const size_t n = x.size()/2;
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), n, 0});
   if (packet.verify(packet.x.size()+packet.val.size(), 3)) {
     return packet;
   } else {
@@ -628,17 +634,18 @@ UniformBlock::init_elements(float _ips) const {
   const float each_str = m_str / (float)(isize*jsize);
 
   // initialize the particles' locations and strengths, leave radius zero for now
-  size_t ix = 0;
-  size_t iv = 0;
+  //   (every particle's place follows from its indices, so the rows can go in any order)
+  #pragma omp parallel for schedule(static) if (isize*jsize > 100000)
   for (int i=0; i<isize; ++i) {
   for (int j=0; j<jsize; ++j) {
-    x[ix++] = m_x + m_xsize * (((float)i + 0.5)/(float)isize - 0.5);
-    x[ix++] = m_y + m_ysize * (((float)j + 0.5)/(float)jsize - 0.5);
-    vals[iv++] = each_str;
+    const size_t iv = (size_t)i*jsize + j;
+    x[2*iv]   = m_x + m_xsize * (((float)i + 0.5)/(float)isize - 0.5);
+    x[2*iv+1] = m_y + m_ysize * (((float)j + 0.5)/(float)jsize - 0.5);
+    vals[iv] = each_str;
   }
   }
 
-  ElementPacket<float> packet({x, idx, vals, (size_t)(isize*jsize), 0});
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)(isize*jsize), 0});
   if (packet.verify(packet.x.size()+packet.val.size(), 3)) {
     return packet;
   } else {
@@ -723,24 +730,28 @@ ElementPacket<float>
 BlockOfRandom::init_elements(float _ips) const {
   std::cout << "Creating random block with " << m_num << " particles" << std::endl;
 
-  // set up the random number generator
-  static std::random_device rd;  //Will be used to obtain a seed for the random number engine
-  static std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
-  static std::uniform_real_distribution<> loc_dist(-1.0, 1.0);
-  static std::uniform_real_distribution<> str_dist(0.0, 1.0);
+  // set up the random number generator, seeded the same on every MPI rank
+  static std::mt19937 gen(mpi_shared_seed());
 
   std::vector<float> x(2*m_num);
   std::vector<Int> idx;
   std::vector<float> vals(m_num);
+
+  // one draw from the shared engine keys the block, and each particle's numbers come from
+  //   its own index, so the particles fill in parallel and every thread count makes the same block
+  const uint64_t seed_hi = gen();
+  const PhiloxKey key = philox_key((seed_hi << 32) | gen());
+
   // initialize the particles' locations and strengths, leave radius zero for now
-  for (size_t i=0; i<(size_t)m_num; ++i) {
-    size_t idx = 2*i;
-    x[idx] = m_x + m_xsize*loc_dist(gen);
-    x[idx+1] = m_y + m_ysize*loc_dist(gen);
-    vals[i] = m_minstr + (m_maxstr-m_minstr)*str_dist(gen);
+  #pragma omp parallel for if (m_num > 10000)
+  for (int64_t i=0; i<(int64_t)m_num; ++i) {
+    const PhiloxCtr u = philox4x32({(uint32_t)i, (uint32_t)((uint64_t)i >> 32), 0, 0}, key);
+    x[2*i]   = m_x + m_xsize*(2.0f*philox_uniform<float>(u[0]) - 1.0f);
+    x[2*i+1] = m_y + m_ysize*(2.0f*philox_uniform<float>(u[1]) - 1.0f);
+    vals[i] = m_minstr + (m_maxstr-m_minstr)*philox_uniform<float>(u[2]);
   }
   
-  ElementPacket<float> packet({x, idx, vals, (size_t)m_num, 0});
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)m_num, 0});
   if (packet.verify(packet.x.size()+packet.val.size(), 3)) {
     return packet;
   } else {
@@ -854,7 +865,7 @@ ParticleEmitter::step_elements(float _ips) const {
   std::vector<float> x = {m_x, m_y};
   std::vector<Int> idx;
   std::vector<float> vals = {m_str};
-  ElementPacket<float> packet({x, idx, vals, (size_t)1, 0});
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)1, 0});
   if (packet.verify(packet.x.size()+packet.val.size(), 3)) {
     return packet;
   } else {
@@ -0,0 +1,912 @@
+/*
+ * Fmm.h - Fast multipole method for particle and panel influence
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Kernels.h"
+#include "Points.h"
+#include "Surfaces.h"
+#include "ResultsType.h"
+#include "ExecEnv.h"
+#include "Treecode.h"
+#include "TreeCache.h"
+#include "Logger.h"
+#include "Profiler.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <array>
+#include <complex>
+#include <numeric>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cassert>
+
+
+//
+// Complex-variable 2D FMM using dual-tree traversal
+//
+// all elements are reduced to a complex strength q = Q - i Gamma, for which the
+//   velocity u - iv = sum_j q_j / (z - z_j), ignoring the 1/2pi factor as usual
+//
+// sources can be vortex particles or vortex/source panels, targets can be points,
+//   particles, or panels (for which the mean velocity over the panel is found)
+//
+// templatized on 'S'torage and 'A'ccumulator types
+//
+template <class S, class A>
+class Fmm {
+public:
+  Fmm(const int32_t _order, const size_t _leafsize, const VelCore _core = default_vel_core)
+    : order(_order),
+      leaf_size(_leafsize),
+      core(_core),
+      src_are_panels(false),
+      src_have_src_str(false),
+      targ_are_panels(false),
+      targ_are_thick(false),
+      skip_self(false),
+      nfar(0),
+      nnear(0) {
+    assert(order > 0 && "FMM expansion order must be positive");
+    make_binomials();
+  }
+
+  void set_sources(const Points<S>&);
+  void set_sources(const Surfaces<S>&);
+  void set_targets(const Points<S>&);
+  void set_targets(const Surfaces<S>&);
+  void set_targets(const std::array<Vector<S>,Dimensions>&);
+  void compute(const S);
+  void add_vels(Points<S>&, const ResultsType&);
+  void add_vels(std::array<Vector<S>,Dimensions>&, Vector<S>* = nullptr, std::array<Vector<S>,4>* = nullptr);
+  void add_vels(Surfaces<S>&);
+
+  // for repeated evaluations over an unchanged geometry, as in a matrix-free BEM
+  void set_skip_self(const bool _skip) { skip_self = _skip; }
+  void update_strengths(const Vector<S>&, const Vector<S>&);
+
+  // for the same particles, moved a little, as in a later stage of a time step
+  void refit_sources(const Points<S>&);
+  void refit_targets(const Points<S>&);
+  void recompute(const S);
+
+  size_t get_num_far() const { return nfar; }
+  size_t get_num_near() const { return nnear; }
+  float get_flops() const;
+
+private:
+  typedef std::complex<A> cplx;
+
+  void make_binomials();
+  void upward_pass();
+  bool well_separated(const int32_t, const int32_t, const S) const;
+  void interact(const int32_t, const int32_t, const S);
+  void far_to_local();
+  void downward_pass();
+  template <bool DO_VORT, bool DO_GRAD, VelCore C> void near_field(const size_t, const int32_t, A*, A*, A*, A*) const;
+
+  // number of terms in each expansion, max elements per leaf
+  int32_t order;
+  size_t leaf_size;
+  VelCore core;
+
+  // binomial coefficients up to 2*order
+  std::vector<A> binom;
+  A get_binom(const int32_t _n, const int32_t _k) const { return binom[_n*(2*order+1)+_k]; }
+
+  // source tree, multipole expansions, and tree-ordered copies of the sources
+  std::vector<TreeNode<S>> snodes;
+  std::vector<cplx> mp;
+  bool src_are_panels, src_have_src_str;
+  std::vector<size_t> sperm;
+  std::array<Vector<S>,Dimensions> sx0, sx1;
+  Vector<S> sr, svs, sss;
+
+  // target tree, local expansions, and tree-ordered copies of the targets
+  std::vector<TreeNode<S>> tnodes;
+  std::vector<cplx> loc;
+  bool targ_are_panels, targ_are_thick;
+  std::vector<size_t> tperm;
+  std::array<Vector<S>,Dimensions> tx0, tx1;
+  Vector<S> tr;
+
+  // for each target node, the source nodes which interact via M2L or directly
+  std::vector<std::vector<int32_t>> far_list, near_list;
+
+  // targets are the centers of the source panels, leave out each panel's own influence
+  bool skip_self;
+
+  // interaction counts for flops estimates
+  size_t nfar, nnear;
+};
+
+
+//
+// Fill the table of binomial coefficients
+//
+template <class S, class A>
+void Fmm<S,A>::make_binomials() {
+  const int32_t nb = 2*order+1;
+  binom.assign(nb*nb, 0.0);
+  for (int32_t n=0; n<nb; ++n) {
+    binom[n*nb] = 1.0;
+    for (int32_t k=1; k<=n; ++k) {
+      binom[n*nb+k] = binom[(n-1)*nb+k-1] + ((k<n) ? binom[(n-1)*nb+k] : 0.0);
+    }
+  }
+}
+
+//
+// Vortex particles as sources
+//
+template <class S, class A>
+void Fmm<S,A>::set_sources(const Points<S>& _src) {
+
+  const size_t n = _src.get_n();
+  const std::array<Vector<S>,Dimensions>& x = _src.get_pos();
+  const Vector<S>&                        r = _src.get_rad();
+  const Vector<S>&                        s = _src.get_str();
+
+  // build the tree
+  std::vector<size_t>& idx = sperm;
+  idx.resize(n);
+  std::iota(idx.begin(), idx.end(), 0);
+  snodes.clear();
+  snodes.reserve(2*(n/leaf_size+1));
+  if (n > 0) (void) build_tree_node<S>(snodes, idx, 0, n, x[0], x[1], nullptr, &r, leaf_size);
+
+  // copy the sources into tree order
+  src_are_panels = false;
+  src_have_src_str = false;
+  for (size_t d=0; d<Dimensions; ++d) sx0[d].resize(n);
+  sr.resize(n);
+  svs.resize(n);
+  for (size_t i=0; i<n; ++i) {
+    sx0[0][i] = x[0][idx[i]];
+    sx0[1][i] = x[1][idx[i]];
+    sr[i] = r[idx[i]];
+    svs[i] = s[idx[i]];
+  }
+
+  upward_pass();
+}
+
+//
+// Vortex and source panels as sources
+//
+template <class S, class A>
+void Fmm<S,A>::set_sources(const Surfaces<S>& _src) {
+
+  const size_t n = _src.get_npanels();
+  const std::array<Vector<S>,Dimensions>& x = _src.get_pos();
+  const std::vector<Int>&                 si = _src.get_idx();
+  const Vector<S>&                        vs = _src.get_str();
+  src_are_panels = true;
+  src_have_src_str = _src.have_src_str();
+
+  // tree is built over the panel centers, with the half-length as extent
+  std::array<Vector<S>,Dimensions> pc;
+  Vector<S> ext(n);
+  for (size_t d=0; d<Dimensions; ++d) pc[d].resize(n);
+  for (size_t i=0; i<n; ++i) {
+    const size_t ip0 = si[2*i];
+    const size_t ip1 = si[2*i+1];
+    pc[0][i] = 0.5 * (x[0][ip0] + x[0][ip1]);
+    pc[1][i] = 0.5 * (x[1][ip0] + x[1][ip1]);
+    ext[i] = 0.5 * std::sqrt(std::pow(x[0][ip1]-x[0][ip0], 2) + std::pow(x[1][ip1]-x[1][ip0], 2));
+  }
+
+  std::vector<size_t>& idx = sperm;
+  idx.resize(n);
+  std::iota(idx.begin(), idx.end(), 0);
+  snodes.clear();
+  snodes.reserve(2*(n/leaf_size+1));
+  if (n > 0) (void) build_tree_node<S>(snodes, idx, 0, n, pc[0], pc[1], &ext, nullptr, leaf_size);
+
+  // copy the panels into tree order
+  for (size_t d=0; d<Dimensions; ++d) {
+    sx0[d].resize(n);
+    sx1[d].resize(n);
+  }
+  svs.resize(n);
+  sss.resize(n);
+  for (size_t i=0; i<n; ++i) {
+    const size_t ip0 = si[2*idx[i]];
+    const size_t ip1 = si[2*idx[i]+1];
+    sx0[0][i] = x[0][ip0];
+    sx0[1][i] = x[1][ip0];
+    sx1[0][i] = x[0][ip1];
+    sx1[1][i] = x[1][ip1];
+    svs[i] = vs[idx[i]];
+    sss[i] = src_have_src_str ? _src.get_src_str()[idx[i]] : 0.0;
+  }
+
+  upward_pass();
+}
+
+//
+// Points or particles as targets
+//
+template <class S, class A>
+void Fmm<S,A>::set_targets(const Points<S>& _targ) {
+
+  const size_t n = _targ.get_n();
+  const std::array<Vector<S>,Dimensions>& x = _targ.get_pos();
+  targ_are_panels = false;
+  targ_are_thick = not _targ.is_inert();
+
+  tperm.resize(n);
+  std::iota(tperm.begin(), tperm.end(), 0);
+  tnodes.clear();
+  tnodes.reserve(2*(n/leaf_size+1));
+  if (n > 0) (void) build_tree_node<S>(tnodes, tperm, 0, n, x[0], x[1], nullptr,
+                                       targ_are_thick ? &_targ.get_rad() : nullptr, leaf_size);
+
+  for (size_t d=0; d<Dimensions; ++d) tx0[d].resize(n);
+  tr.resize(targ_are_thick ? n : 0);
+  for (size_t i=0; i<n; ++i) {
+    tx0[0][i] = x[0][tperm[i]];
+    tx0[1][i] = x[1][tperm[i]];
+    if (targ_are_thick) tr[i] = _targ.get_rad()[tperm[i]];
+  }
+}
+
+//
+// Bare field points as targets
+//
+template <class S, class A>
+void Fmm<S,A>::set_targets(const std::array<Vector<S>,Dimensions>& _x) {
+
+  const size_t n = _x[0].size();
+  targ_are_panels = false;
+  targ_are_thick = false;
+
+  tperm.resize(n);
+  std::iota(tperm.begin(), tperm.end(), 0);
+  tnodes.clear();
+  tnodes.reserve(2*(n/leaf_size+1));
+  if (n > 0) (void) build_tree_node<S>(tnodes, tperm, 0, n, _x[0], _x[1], nullptr, nullptr, leaf_size);
+
+  for (size_t d=0; d<Dimensions; ++d) tx0[d].resize(n);
+  tr.resize(0);
+  for (size_t i=0; i<n; ++i) {
+    tx0[0][i] = _x[0][tperm[i]];
+    tx0[1][i] = _x[1][tperm[i]];
+  }
+}
+
+//
+// Panels as targets
+//
+template <class S, class A>
+void Fmm<S,A>::set_targets(const Surfaces<S>& _targ) {
+
+  const size_t n = _targ.get_npanels();
+  const std::array<Vector<S>,Dimensions>& x = _targ.get_pos();
+  const std::vector<Int>&                 ti = _targ.get_idx();
+  targ_are_panels = true;
+  targ_are_thick = false;
+
+  std::array<Vector<S>,Dimensions> pc;
+  Vector<S> ext(n);
+  for (size_t d=0; d<Dimensions; ++d) pc[d].resize(n);
+  for (size_t i=0; i<n; ++i) {
+    const size_t ip0 = ti[2*i];
+    const size_t ip1 = ti[2*i+1];
+    pc[0][i] = 0.5 * (x[0][ip0] + x[0][ip1]);
+    pc[1][i] = 0.5 * (x[1][ip0] + x[1][ip1]);
+    ext[i] = 0.5 * std::sqrt(std::pow(x[0][ip1]-x[0][ip0], 2) + std::pow(x[1][ip1]-x[1][ip0], 2));
+  }
+
+  tperm.resize(n);
+  std::iota(tperm.begin(), tperm.end(), 0);
+  tnodes.clear();
+  tnodes.reserve(2*(n/leaf_size+1));
+  if (n > 0) (void) build_tree_node<S>(tnodes, tperm, 0, n, pc[0], pc[1], &ext, nullptr, leaf_size);
+
+  for (size_t d=0; d<Dimensions; ++d) {
+    tx0[d].resize(n);
+    tx1[d].resize(n);
+  }
+  for (size_t i=0; i<n; ++i) {
+    const size_t ip0 = ti[2*tperm[i]];
+    const size_t ip1 = ti[2*tperm[i]+1];
+    tx0[0][i] = x[0][ip0];
+    tx0[1][i] = x[1][ip0];
+    tx1[0][i] = x[0][ip1];
+    tx1[1][i] = x[1][ip1];
+  }
+}
+
+//
+// Upward pass: multipole moments a_k = sum_j q_j (z_j - z_c)^k in the leaves, then M2M
+//
+template <class S, class A>
+void Fmm<S,A>::upward_pass() {
+
+  mp.assign(snodes.size() * order, cplx(0.0,0.0));
+
+  // leaves first
+  #pragma omp parallel for schedule(dynamic,16)
+  for (int32_t i=0; i<(int32_t)snodes.size(); ++i) {
+    const TreeNode<S>& node = snodes[i];
+    if (node.child[0] >= 0) continue;
+    cplx* a = &mp[i*order];
+
+    for (size_t j=node.ibeg; j<node.iend; ++j) {
+      if (src_are_panels) {
+        // exact moments of a constant-strength segment
+        const cplx z0((A)(sx0[0][j] - node.cx), (A)(sx0[1][j] - node.cy));
+        const cplx z1((A)(sx1[0][j] - node.cx), (A)(sx1[1][j] - node.cy));
+        const A plen = std::abs(z1 - z0);
+        const cplx q = cplx((A)sss[j], -(A)svs[j]) * plen / (z1 - z0);
+        cplx z0k = z0;
+        cplx z1k = z1;
+        for (int32_t k=0; k<order; ++k) {
+          a[k] += q * (z1k - z0k) / (A)(k+1);
+          z0k *= z0;
+          z1k *= z1;
+        }
+      } else {
+        // a vortex particle
+        const cplx dz((A)(sx0[0][j] - node.cx), (A)(sx0[1][j] - node.cy));
+        cplx zk((A)0.0, -(A)svs[j]);
+        for (int32_t k=0; k<order; ++k) {
+          a[k] += zk;
+          zk *= dz;
+        }
+      }
+    }
+  }
+
+  // then shift children into parents, children always have larger indices
+  for (int32_t i=(int32_t)snodes.size()-1; i>=0; --i) {
+    const TreeNode<S>& node = snodes[i];
+    if (node.child[0] < 0) continue;
+    cplx* b = &mp[i*order];
+
+    for (int32_t c=0; c<2; ++c) {
+      const int32_t ic = node.child[c];
+      const cplx* a = &mp[ic*order];
+      const cplx d((A)(snodes[ic].cx - node.cx), (A)(snodes[ic].cy - node.cy));
+
+      // b_l = sum_k C(l,k) a_k d^(l-k)
+      std::vector<cplx> dpow(order);
+      dpow[0] = 1.0;
+      for (int32_t k=1; k<order; ++k) dpow[k] = dpow[k-1] * d;
+      for (int32_t l=0; l<order; ++l) {
+        for (int32_t k=0; k<=l; ++k) {
+          b[l] += get_binom(l,k) * a[k] * dpow[l-k];
+        }
+      }
+    }
+  }
+}
+
+//
+// The opening criterion, treating the core radii as part of the element size
+//
+template <class S, class A>
+bool Fmm<S,A>::well_separated(const int32_t _it, const int32_t _is, const S _theta) const {
+  const TreeNode<S>& tn = tnodes[_it];
+  const TreeNode<S>& sn = snodes[_is];
+  const S dx = tn.cx - sn.cx;
+  const S dy = tn.cy - sn.cy;
+  return tn.rad + tn.maxr + sn.rad + sn.maxr < _theta * std::sqrt(dx*dx + dy*dy);
+}
+
+//
+// Dual tree traversal, build interaction lists for each target node
+//
+template <class S, class A>
+void Fmm<S,A>::interact(const int32_t _it, const int32_t _is, const S _theta) {
+
+  const TreeNode<S>& tn = tnodes[_it];
+  const TreeNode<S>& sn = snodes[_is];
+
+  const S tsize = tn.rad + tn.maxr;
+  const S ssize = sn.rad + sn.maxr;
+
+  const bool tleaf = (tn.child[0] < 0);
+  const bool sleaf = (sn.child[0] < 0);
+
+  if (well_separated(_it, _is, _theta)) {
+    far_list[_it].push_back(_is);
+
+  } else if (tleaf and sleaf) {
+    near_list[_it].push_back(_is);
+
+  } else if (sleaf or (not tleaf and tsize > ssize)) {
+    // split the target node
+    interact(tn.child[0], _is, _theta);
+    interact(tn.child[1], _is, _theta);
+
+  } else {
+    // split the source node
+    interact(_it, sn.child[0], _theta);
+    interact(_it, sn.child[1], _theta);
+  }
+}
+
+//
+// M2L: convert far source multipoles into local expansions in each target node
+//
+template <class S, class A>
+void Fmm<S,A>::far_to_local() {
+
+  loc.assign(tnodes.size() * order, cplx(0.0,0.0));
+
+  #pragma omp parallel for schedule(dynamic,16)
+  for (int32_t i=0; i<(int32_t)tnodes.size(); ++i) {
+    cplx* b = &loc[i*order];
+    std::vector<cplx> oodpow(2*order+1);
+
+    for (const int32_t is : far_list[i]) {
+      const cplx* a = &mp[is*order];
+      const cplx d((A)(tnodes[i].cx - snodes[is].cx), (A)(tnodes[i].cy - snodes[is].cy));
+      const cplx ood = (A)1.0 / d;
+      oodpow[0] = 1.0;
+      for (int32_t k=1; k<2*order+1; ++k) oodpow[k] = oodpow[k-1] * ood;
+
+      // b_l = (-1)^l sum_k C(k+l,k) a_k / d^(k+l+1)
+      for (int32_t l=0; l<order; ++l) {
+        cplx sum(0.0, 0.0);
+        for (int32_t k=0; k<order; ++k) {
+          sum += get_binom(k+l,k) * a[k] * oodpow[k+l+1];
+        }
+        b[l] += (l%2==0) ? sum : -sum;
+      }
+    }
+  }
+}
+
+//
+// Downward pass: L2L from parents into children, parents always have smaller indices
+//
+template <class S, class A>
+void Fmm<S,A>::downward_pass() {
+
+  std::vector<cplx> dpow(order);
+
+  for (int32_t i=0; i<(int32_t)tnodes.size(); ++i) {
+    const TreeNode<S>& node = tnodes[i];
+    if (node.child[0] < 0) continue;
+    const cplx* b = &loc[i*order];
+
+    for (int32_t c=0; c<2; ++c) {
+      const int32_t ic = node.child[c];
+      cplx* bc = &loc[ic*order];
+      const cplx d((A)(tnodes[ic].cx - node.cx), (A)(tnodes[ic].cy - node.cy));
+      dpow[0] = 1.0;
+      for (int32_t k=1; k<order; ++k) dpow[k] = dpow[k-1] * d;
+
+      // c_m = sum_{l>=m} C(l,m) b_l d^(l-m)
+      for (int32_t m=0; m<order; ++m) {
+        for (int32_t l=m; l<order; ++l) {
+          bc[m] += get_binom(l,m) * b[l] * dpow[l-m];
+        }
+      }
+    }
+  }
+}
+
+//
+// Build the interaction lists and all expansions, call after setting sources and targets
+//
+template <class S, class A>
+void Fmm<S,A>::compute(const S _theta) {
+
+  far_list.assign(tnodes.size(), std::vector<int32_t>());
+  near_list.assign(tnodes.size(), std::vector<int32_t>());
+  if (tnodes.empty() or snodes.empty()) return;
+
+  interact(0, 0, _theta);
+
+  nfar = 0;
+  for (auto& fl : far_list) nfar += fl.size();
+
+  far_to_local();
+  downward_pass();
+}
+
+//
+// New strengths on the same sources: the trees and interaction lists are kept,
+//   only the expansions are recomputed, call after compute
+//
+template <class S, class A>
+void Fmm<S,A>::update_strengths(const Vector<S>& _vs, const Vector<S>& _ss) {
+
+  assert(_vs.size() == sperm.size() && "New strength array size does not match");
+  for (size_t i=0; i<sperm.size(); ++i) svs[i] = _vs[sperm[i]];
+  if (src_are_panels) {
+    src_have_src_str = (_ss.size() == sperm.size());
+    for (size_t i=0; i<sperm.size(); ++i) sss[i] = src_have_src_str ? _ss[sperm[i]] : 0.0;
+  }
+
+  upward_pass();
+  if (tnodes.empty() or snodes.empty()) return;
+  far_to_local();
+  downward_pass();
+}
+
+//
+// Moved particles, in the same order: the source tree keeps its topology, and only its
+//   node centers and sizes and the multipole moments are found again
+//
+template <class S, class A>
+void Fmm<S,A>::refit_sources(const Points<S>& _src) {
+
+  assert(not src_are_panels && "FMM refit only supports particle sources");
+  assert(_src.get_n() == sperm.size() && "Refit sources do not match the tree");
+
+  const std::array<Vector<S>,Dimensions>& x = _src.get_pos();
+  const Vector<S>&                        r = _src.get_rad();
+  const Vector<S>&                        s = _src.get_str();
+  for (size_t i=0; i<sperm.size(); ++i) {
+    sx0[0][i] = x[0][sperm[i]];
+    sx0[1][i] = x[1][sperm[i]];
+    sr[i] = r[sperm[i]];
+    svs[i] = s[sperm[i]];
+  }
+
+  refit_tree_nodes<S>(snodes, sx0[0], sx0[1], &sr);
+  upward_pass();
+}
+
+template <class S, class A>
+void Fmm<S,A>::refit_targets(const Points<S>& _targ) {
+
+  assert(not targ_are_panels && "FMM refit only supports point targets");
+  assert(_targ.get_n() == tperm.size() && "Refit targets do not match the tree");
+
+  const std::array<Vector<S>,Dimensions>& x = _targ.get_pos();
+  for (size_t i=0; i<tperm.size(); ++i) {
+    tx0[0][i] = x[0][tperm[i]];
+    tx0[1][i] = x[1][tperm[i]];
+    if (targ_are_thick) tr[i] = _targ.get_rad()[tperm[i]];
+  }
+
+  refit_tree_nodes<S>(tnodes, tx0[0], tx0[1], targ_are_thick ? &tr : nullptr);
+}
+
+//
+// Reuse the interaction lists over refit trees, call after refitting both; any far pair
+//   which the moved nodes no longer separate is traversed again from that pair down
+//
+template <class S, class A>
+void Fmm<S,A>::recompute(const S _theta) {
+
+  if (tnodes.empty() or snodes.empty()) return;
+
+  // find and remove the failing pairs
+  std::vector<std::vector<int32_t>> failed(tnodes.size());
+  #pragma omp parallel for schedule(dynamic,64)
+  for (int32_t i=0; i<(int32_t)tnodes.size(); ++i) {
+    std::vector<int32_t>& fl = far_list[i];
+    auto keep = std::stable_partition(fl.begin(), fl.end(), [&](const int32_t is) { return well_separated(i, is, _theta); });
+    failed[i].assign(keep, fl.end());
+    fl.erase(keep, fl.end());
+  }
+
+  // traversals append to the lists of this node's children too, so these run in order
+  for (int32_t i=0; i<(int32_t)tnodes.size(); ++i) {
+    for (const int32_t is : failed[i]) interact(i, is, _theta);
+  }
+
+  nfar = 0;
+  for (auto& fl : far_list) nfar += fl.size();
+
+  far_to_local();
+  downward_pass();
+}
+
+//
+// Direct influence of the sources in one source node on one target, with the four velocity
+//   gradients in _tg if asked for (only on point targets)
+//
+template <class S, class A>
+template <bool DO_VORT, bool DO_GRAD, VelCore C>
+void Fmm<S,A>::near_field(const size_t _i, const int32_t _is,
+                          A* const __restrict__ _tu,
+                          A* const __restrict__ _tv,
+                          A* const __restrict__ _tw,
+                          A* const __restrict__ _tg) const {
+
+  const TreeNode<S>& sn = snodes[_is];
+  A resultu = 0.0;
+  A resultv = 0.0;
+
+  if (targ_are_panels) {
+    // only point sources can reach here, we use the kernel backwards
+    const A plen = 1.0 / std::sqrt(std::pow(tx1[0][_i]-tx0[0][_i], 2) + std::pow(tx1[1][_i]-tx0[1][_i], 2));
+    for (size_t j=sn.ibeg; j<sn.iend; ++j) {
+      kernelu_1v_0p<S,A>(tx0[0][_i], tx0[1][_i], tx1[0][_i], tx1[1][_i],
+                         svs[j], sx0[0][j], sx0[1][j],
+                         &resultu, &resultv);
+      *_tu -= plen*resultu;
+      *_tv -= plen*resultv;
+    }
+
+  } else if (src_are_panels) {
+    for (size_t j=sn.ibeg; j<sn.iend; ++j) {
+      if (skip_self and sperm[j] == tperm[_i]) continue;
+      if constexpr (DO_GRAD) {
+        kernelug_1vs_0p<S,A>(sx0[0][j], sx0[1][j], sx1[0][j], sx1[1][j],
+                             svs[j], src_have_src_str ? sss[j] : (S)0.0, tx0[0][_i], tx0[1][_i],
+                             _tu, _tv, _tg, _tg+1, _tg+2, _tg+3);
+        continue;
+      }
+      if (src_have_src_str) {
+        kernelu_1vs_0p<S,A>(sx0[0][j], sx0[1][j], sx1[0][j], sx1[1][j],
+                            svs[j], sss[j], tx0[0][_i], tx0[1][_i],
+                            &resultu, &resultv);
+      } else {
+        kernelu_1v_0p<S,A>(sx0[0][j], sx0[1][j], sx1[0][j], sx1[1][j],
+                           svs[j], tx0[0][_i], tx0[1][_i],
+                           &resultu, &resultv);
+      }
+      *_tu += resultu;
+      *_tv += resultv;
+    }
+
+  } else if (targ_are_thick) {
+    for (size_t j=sn.ibeg; j<sn.iend; ++j) {
+      if constexpr (DO_GRAD) {
+        kernelug_0v_0b<S,A,C>(sx0[0][j], sx0[1][j], sr[j], svs[j], tx0[0][_i], tx0[1][_i], tr[_i], _tu, _tv, _tg, _tg+1, _tg+2, _tg+3);
+      } else if constexpr (DO_VORT) {
+        kerneluw_0v_0b<S,A,C>(sx0[0][j], sx0[1][j], sr[j], svs[j], tx0[0][_i], tx0[1][_i], tr[_i], _tu, _tv, _tw);
+      } else {
+        kernelu_0v_0b<S,A,C>(sx0[0][j], sx0[1][j], sr[j], svs[j], tx0[0][_i], tx0[1][_i], tr[_i], _tu, _tv);
+      }
+    }
+
+  } else {
+    for (size_t j=sn.ibeg; j<sn.iend; ++j) {
+      if constexpr (DO_GRAD) {
+        kernelug_0v_0p<S,A,C>(sx0[0][j], sx0[1][j], sr[j], svs[j], tx0[0][_i], tx0[1][_i], _tu, _tv, _tg, _tg+1, _tg+2, _tg+3);
+      } else if constexpr (DO_VORT) {
+        kerneluw_0v_0p<S,A,C>(sx0[0][j], sx0[1][j], sr[j], svs[j], tx0[0][_i], tx0[1][_i], _tu, _tv, _tw);
+      } else {
+        kernelu_0v_0p<S,A,C>(sx0[0][j], sx0[1][j], sr[j], svs[j], tx0[0][_i], tx0[1][_i], _tu, _tv);
+      }
+    }
+  }
+}
+
+//
+// Evaluate local expansions and near-field sums on Points targets
+//
+// far-field vorticity is taken as zero, as the opening criterion keeps all cores well-separated
+//
+template <class S, class A>
+void Fmm<S,A>::add_vels(Points<S>& _targ, const ResultsType& _rt) {
+  add_vels(_targ.get_vel(), _rt.get_type() == velandvort ? &_targ.get_vort() : nullptr,
+                            _rt.get_type() == velandgrad ? &_targ.get_velgrad() : nullptr);
+}
+
+// or onto bare velocity arrays, vorticity is skipped if tw is null, gradients if tg is
+template <class S, class A>
+void Fmm<S,A>::add_vels(std::array<Vector<S>,Dimensions>& tu, Vector<S>* tw, std::array<Vector<S>,4>* tg) {
+
+  assert(not targ_are_panels && "FMM targets are not Points");
+  const bool do_vort = (tw != nullptr);
+  const bool do_grad = (tg != nullptr);
+
+  size_t nn = 0;
+  // one copy of the loop per core, picked here
+  with_velocity_core(core, [&](auto _c) {
+    constexpr VelCore C = decltype(_c)::value;
+    #pragma omp parallel for schedule(dynamic,4) reduction(+:nn)
+    for (int32_t it=0; it<(int32_t)tnodes.size(); ++it) {
+      const TreeNode<S>& tn = tnodes[it];
+      if (tn.child[0] >= 0) continue;
+      const cplx* b = &loc[it*order];
+
+      for (size_t i=tn.ibeg; i<tn.iend; ++i) {
+        A accumu = 0.0;
+        A accumv = 0.0;
+        A accumw = 0.0;
+        A accumg[4] = {0.0, 0.0, 0.0, 0.0};
+
+        // local expansion, f = u - iv = sum_l b_l w^l, and df/dw = u_x - i v_x
+        const cplx w((A)(tx0[0][i] - tn.cx), (A)(tx0[1][i] - tn.cy));
+        cplx f = b[order-1];
+        cplx df(0.0, 0.0);
+        for (int32_t l=order-2; l>=0; --l) {
+          if (do_grad) df = df*w + f;
+          f = f*w + b[l];
+        }
+        accumu += f.real();
+        accumv -= f.imag();
+        // away from the sources, u_y = v_x and v_y = -u_x
+        accumg[0] += df.real();
+        accumg[1] -= df.imag();
+        accumg[2] -= df.imag();
+        accumg[3] -= df.real();
+
+        // direct sums
+        for (const int32_t is : near_list[it]) {
+          if (do_grad)      near_field<false,true,C>(i, is, &accumu, &accumv, &accumw, accumg);
+          else if (do_vort) near_field<true,false,C>(i, is, &accumu, &accumv, &accumw, accumg);
+          else              near_field<false,false,C>(i, is, &accumu, &accumv, &accumw, accumg);
+          nn += snodes[is].iend - snodes[is].ibeg;
+        }
+
+        const size_t iorig = tperm[i];
+        tu[0][iorig] += accumu;
+        tu[1][iorig] += accumv;
+        if (do_vort) (*tw)[iorig] += accumw;
+        if (do_grad) for (size_t k=0; k<4; ++k) (*tg)[k][iorig] += accumg[k];
+      }
+    }
+  });
+  nnear = nn;
+}
+
+//
+// Evaluate mean velocity over each target panel
+//
+template <class S, class A>
+void Fmm<S,A>::add_vels(Surfaces<S>& _targ) {
+
+  assert(targ_are_panels && "FMM targets are not Surfaces");
+  assert(not src_are_panels && "FMM does not support panels affecting panels");
+  std::array<Vector<S>,Dimensions>& tu = _targ.get_vel();
+
+  size_t nn = 0;
+  #pragma omp parallel for schedule(dynamic,4) reduction(+:nn)
+  for (int32_t it=0; it<(int32_t)tnodes.size(); ++it) {
+    const TreeNode<S>& tn = tnodes[it];
+    if (tn.child[0] >= 0) continue;
+    const cplx* b = &loc[it*order];
+
+    for (size_t i=tn.ibeg; i<tn.iend; ++i) {
+      A accumu = 0.0;
+      A accumv = 0.0;
+      A accumw = 0.0;
+      A accumg[4];
+
+      // mean of the local expansion over the segment w0..w1
+      //   is sum_l b_l (w1^(l+1) - w0^(l+1)) / ((l+1)(w1-w0))
+      const cplx w0((A)(tx0[0][i] - tn.cx), (A)(tx0[1][i] - tn.cy));
+      const cplx w1((A)(tx1[0][i] - tn.cx), (A)(tx1[1][i] - tn.cy));
+      cplx w0l = w0;
+      cplx w1l = w1;
+      cplx f(0.0, 0.0);
+      for (int32_t l=0; l<order; ++l) {
+        f += b[l] * (w1l - w0l) / (A)(l+1);
+        w0l *= w0;
+        w1l *= w1;
+      }
+      f /= (w1 - w0);
+      accumu += f.real();
+      accumv -= f.imag();
+
+      // direct sums
+      for (const int32_t is : near_list[it]) {
+        // panel targets take no core function, so any instantiation does
+        near_field<false,false,default_vel_core>(i, is, &accumu, &accumv, &accumw, accumg);
+        nn += snodes[is].iend - snodes[is].ibeg;
+      }
+
+      const size_t iorig = tperm[i];
+      tu[0][iorig] += accumu;
+      tu[1][iorig] += accumv;
+    }
+  }
+  nnear = nn;
+}
+
+//
+// Approximate flop count of the last evaluation
+//
+template <class S, class A>
+float Fmm<S,A>::get_flops() const {
+  // each M2L is order^2 complex multiply-adds, each target evaluates order terms
+  float flops = (float)nfar * (float)(8*order*order);
+  flops += (float)tperm.size() * (float)(8*order);
+  if (targ_are_panels or src_are_panels) {
+    flops += (float)nnear * (float)flopsu_1vs_0p<S,A>();
+  } else if (targ_are_thick) {
+    flops += (float)nnear * (float)with_velocity_core(core, [](auto _c) { return flopsu_0v_0b<S,A,decltype(_c)::value>(); });
+  } else {
+    flops += (float)nnear * (float)with_velocity_core(core, [](auto _c) { return flopsu_0v_0p<S,A,decltype(_c)::value>(); });
+  }
+  return flops;
+}
+
+
+//
+// Wrappers for the influence calculations
+//
+template <class S, class A, class ST, class TT>
+void fmm_affect (const ST& src, TT& targ, const ResultsType& restype, const ExecEnv& env) {
+
+  auto start = std::chrono::system_clock::now();
+
+  // particles on particles can refit the trees and lists from an earlier stage, see TreeCache.h
+  constexpr bool can_refit = std::is_same<ST,Points<S>>::value and std::is_same<TT,Points<S>>::value;
+  const uint32_t tag = can_refit ? env.get_tree_tag() : 0;
+  TreeKey key = {0, 0, 0, 0, env.get_expansion_order(), env.get_leaf_size(), env.get_opening_angle()};
+  std::unique_ptr<Fmm<S,A>> fmmptr;
+  if constexpr (can_refit) {
+    key.src = src.get_lineage();
+    key.targ = targ.get_lineage();
+    key.nsrc = src.get_n();
+    key.ntarg = targ.get_n();
+    if (tag != 0) fmmptr = TreeCache<Fmm<S,A>>::instance().take(key, tag);
+  }
+
+  const bool refit = (fmmptr != nullptr);
+  if constexpr (can_refit) {
+    if (refit) {
+      fmmptr->refit_sources(src);
+      fmmptr->refit_targets(targ);
+      fmmptr->recompute(env.get_opening_angle());
+    }
+  }
+  if (not refit) {
+    fmmptr = std::make_unique<Fmm<S,A>>(env.get_expansion_order(), env.get_leaf_size(), env.get_velocity_core());
+    fmmptr->set_sources(src);
+    fmmptr->set_targets(targ);
+    fmmptr->compute(env.get_opening_angle());
+  }
+  Fmm<S,A>& fmm = *fmmptr;
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    fmm " << (refit ? "refit" : "setup") << ":\t\t[" << elapsed_seconds.count() << "] seconds with " << fmm.get_num_far() << " M2L");
+  start = std::chrono::system_clock::now();
+
+  if constexpr (std::is_same<TT,Points<S>>::value) {
+    fmm.add_vels(targ, restype);
+  } else {
+    fmm.add_vels(targ);
+  }
+
+  end = std::chrono::system_clock::now();
+  elapsed_seconds = end-start;
+  LOG_DEBUG("    fmm evaluate:\t[" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * fmm.get_flops() / elapsed_seconds.count()) << " GFlop/s");
+  if constexpr (not std::is_same<ST,Points<S>>::value) {
+    PROFILE_FLOPS("1_0", fmm.get_flops(), elapsed_seconds.count());
+  } else if constexpr (not std::is_same<TT,Points<S>>::value) {
+    PROFILE_FLOPS("0_1", fmm.get_flops(), elapsed_seconds.count());
+  } else {
+    PROFILE_FLOPS((targ.is_inert() ? "0v_0p" : "0v_0v"), fmm.get_flops(), elapsed_seconds.count());
+  }
+
+  if (tag != 0) TreeCache<Fmm<S,A>>::instance().put(key, tag, std::move(fmmptr));
+}
+
+template <class S, class A>
+void points_affect_points_fmm (const Points<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+  LOG_DEBUG("    0v_0" << (targ.is_inert() ? "p" : "v") << " fmm influence of" << src.to_string() << " on" << targ.to_string());
+  assert (!restype.compute_psi() && "Point elements cannot compute streamfunction yet.");
+  fmm_affect<S,A>(src, targ, restype, env);
+}
+
+template <class S, class A>
+void panels_affect_points_fmm (const Surfaces<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+  LOG_DEBUG("    1_0 fmm influence of" << src.to_string() << " on" << targ.to_string());
+  assert (!restype.compute_psi() && "Surface elements cannot compute streamfunction yet.");
+  // panels do not induce vorticity on points, but do have gradients
+  fmm_affect<S,A>(src, targ, ResultsType(restype.compute_grad() ? velandgrad : velonly), env);
+}
+
+template <class S, class A>
+void points_affect_panels_fmm (const Points<S>& src, Surfaces<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+  LOG_DEBUG("    0_1 fmm influence of" << src.to_string() << " on" << targ.to_string());
+  assert (!restype.compute_psi() && "Point elements cannot compute streamfunction yet.");
+  assert (!restype.compute_grad() && "Point elements cannot compute velocity gradients yet.");
+  fmm_affect<S,A>(src, targ, restype, env);
+}
+
@@ -0,0 +1,160 @@
+/*
+ * FrameSaver.h - Write rendered frames to png files without stalling the GUI
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <glad/glad.h>
+#include <miniz/miniz.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <chrono>
+#include <iostream>
+
+
+//
+// Each request copies the back buffer into a pixel buffer object, which the GPU fills while
+//   the GUI keeps drawing; a later frame maps the finished buffer and hands the pixels to a
+//   background thread to compress and write
+//
+// at most max_readbacks buffers are in flight and max_encodes images wait to be written, past
+//   either the oldest is finished first, so a recording never piles up more than that
+//
+// all GL calls must come from the thread which owns the context, so call finish() before
+//   the context goes away
+//
+class FrameSaver {
+public:
+  ~FrameSaver() {
+    for (auto& job : encoding) job.wait();
+  }
+
+  // start reading back the current back buffer, to be written to this file
+  void request(const std::string _file) {
+    if (reading.size() >= max_readbacks) service(true);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // png rows stay 4-byte aligned
+    Readback rb;
+    rb.width = (viewport[2]/4) * 4;
+    rb.height = (viewport[3]/4) * 4;
+    rb.file = _file;
+    const size_t nbytes = 3 * (size_t)rb.width * (size_t)rb.height;
+
+    if (free_pbos.empty()) {
+      GLuint pbo;
+      glGenBuffers(1, &pbo);
+      free_pbos.push_back(pbo);
+    }
+    rb.pbo = free_pbos.back();
+    free_pbos.pop_back();
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, nbytes, nullptr, GL_STREAM_READ);
+    glReadBuffer(GL_BACK);
+    glReadPixels(0, 0, rb.width, rb.height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    rb.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    reading.push_back(rb);
+  }
+
+  // send every finished readback to be written, waiting for the oldest one if asked;
+  //   call this once per frame
+  void service(const bool _wait = false) {
+    bool wait = _wait;
+    while (not reading.empty()) {
+      Readback& rb = reading.front();
+      const GLenum status = glClientWaitSync(rb.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                             wait ? (GLuint64)10000000000 : 0);
+      if (status == GL_TIMEOUT_EXPIRED) break;
+      wait = false;
+      glDeleteSync(rb.fence);
+
+      const size_t nbytes = 3 * (size_t)rb.width * (size_t)rb.height;
+      std::vector<uint8_t> pixels(nbytes);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+      const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, nbytes, GL_MAP_READ_BIT);
+      if (mapped) {
+        std::memcpy(pixels.data(), mapped, nbytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      free_pbos.push_back(rb.pbo);
+
+      if (mapped) encode(std::move(pixels), rb.width, rb.height, rb.file);
+      reading.pop_front();
+    }
+
+    // forget the images already written
+    while (not encoding.empty() and
+           encoding.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      encoding.front().get();
+      encoding.pop_front();
+    }
+  }
+
+  // write everything still in flight and give back the buffers
+  void finish() {
+    while (not reading.empty()) service(true);
+    for (auto& job : encoding) job.get();
+    encoding.clear();
+    if (not free_pbos.empty()) glDeleteBuffers((GLsizei)free_pbos.size(), free_pbos.data());
+    free_pbos.clear();
+  }
+
+  bool is_busy() const { return not reading.empty() or not encoding.empty(); }
+
+private:
+  struct Readback {
+    GLuint pbo;
+    GLsync fence;
+    int width, height;
+    std::string file;
+  };
+
+  void encode(std::vector<uint8_t>&& _pixels, const int _w, const int _h, const std::string _file) {
+    while (encoding.size() >= max_encodes) {
+      encoding.front().get();
+      encoding.pop_front();
+    }
+    encoding.push_back(ThreadPool::background().submit(
+        [pixels=std::move(_pixels), _w, _h, _file]() {
+          PROFILE_ZONE("write frame");
+          size_t png_size = 0;
+          // the rows come from GL bottom first
+          void* png = tdefl_write_image_to_png_file_in_memory_ex(pixels.data(), _w, _h, 3,
+                                                                 &png_size, MZ_DEFAULT_LEVEL, MZ_TRUE);
+          std::FILE* fp = png ? std::fopen(_file.c_str(), "wb") : nullptr;
+          if (fp) {
+            std::fwrite(png, 1, png_size, fp);
+            std::fclose(fp);
+          } else {
+            std::cout << "WARNING: could not write " << _file << std::endl;
+          }
+          mz_free(png);
+        }));
+  }
+
+  static constexpr size_t max_readbacks = 3;
+  static constexpr size_t max_encodes = 4;
+
+  std::vector<GLuint> free_pbos;
+  std::deque<Readback> reading;
+  std::deque<std::future<void>> encoding;
+};
+
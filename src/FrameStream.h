@@ -0,0 +1,411 @@
+/*
+ * FrameStream.h - Send simulation frames to remote viewers over TCP
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+//
+// A frame is the positions and strengths of every collection at one step, one block per
+//   collection; particles and field points may be decimated and any array may be quantized
+//   to 16 bits over its range before sending
+//
+// on the wire each frame is its length (8 bytes) and then "O2DF", a quantized flag, the
+//   time, step, and core size, the block count, and for each block its kind and the number
+//   of nodes, panel indices, and strengths, then its arrays: x, y, and strengths as floats,
+//   or each as its low and high floats and then 16-bit values, and then the panel indices;
+//   everything is in the sender's byte order
+//
+// the server keeps only the newest frame, and sends it from its own thread, so a slow or
+//   stalled viewer never holds up the simulation; viewers which stop reading are dropped
+//
+enum frame_kind_t : uint8_t {
+  frame_particles = 0,
+  frame_panels    = 1,
+  frame_fieldpts  = 2
+};
+
+struct FrameBlock {
+  frame_kind_t kind = frame_particles;
+  std::vector<float> x, y;
+  std::vector<float> s;		// per point or per panel, empty for field points
+  std::vector<uint32_t> idx;	// two node indices per panel
+};
+
+struct Frame {
+  double time = 0.0;
+  uint64_t step = 0;
+  float vdelta = 0.0;
+  std::vector<FrameBlock> blocks;
+};
+
+
+namespace frame_detail {
+  template <class T>
+  inline void put(std::vector<char>& _buf, const T& _v) {
+    const char* p = reinterpret_cast<const char*>(&_v);
+    _buf.insert(_buf.end(), p, p+sizeof(T));
+  }
+
+  template <class T>
+  inline void put_array(std::vector<char>& _buf, const std::vector<T>& _v) {
+    const char* p = reinterpret_cast<const char*>(_v.data());
+    _buf.insert(_buf.end(), p, p+sizeof(T)*_v.size());
+  }
+
+  inline void put_floats(std::vector<char>& _buf, const std::vector<float>& _v, const bool _quant) {
+    if (not _quant) { put_array(_buf, _v); return; }
+    float lo = 0.0, hi = 0.0;
+    if (not _v.empty()) {
+      const auto [mn, mx] = std::minmax_element(_v.begin(), _v.end());
+      lo = *mn;
+      hi = *mx;
+    }
+    put(_buf, lo);
+    put(_buf, hi);
+    const float scale = (hi > lo) ? 65535.f / (hi - lo) : 0.f;
+    std::vector<uint16_t> q(_v.size());
+    for (size_t i=0; i<_v.size(); ++i) q[i] = (uint16_t)std::lround((_v[i] - lo) * scale);
+    put_array(_buf, q);
+  }
+
+  // reads bounds-checked from one message
+  class Cursor {
+  public:
+    Cursor(const char* _p, const size_t _n) : p(_p), n(_n) {}
+    template <class T>
+    T get() {
+      T v{};
+      if (take(sizeof(T))) std::memcpy(&v, p+pos-sizeof(T), sizeof(T));
+      return v;
+    }
+    template <class T>
+    void get_array(std::vector<T>& _v, const size_t _count) {
+      if (not ok or _count > (n-pos)/sizeof(T)) { ok = false; return; }
+      _v.resize(_count);
+      if (_count > 0) std::memcpy(_v.data(), p+pos, sizeof(T)*_count);
+      pos += sizeof(T)*_count;
+    }
+    void get_floats(std::vector<float>& _v, const size_t _count, const bool _quant) {
+      if (not _quant) { get_array(_v, _count); return; }
+      const float lo = get<float>();
+      const float hi = get<float>();
+      std::vector<uint16_t> q;
+      get_array(q, _count);
+      _v.resize(q.size());
+      const float scale = (hi - lo) / 65535.f;
+      for (size_t i=0; i<q.size(); ++i) _v[i] = lo + scale * (float)q[i];
+    }
+    bool good() const { return ok; }
+  private:
+    bool take(const size_t _k) { ok = ok and (_k <= n-pos); if (ok) pos += _k; return ok; }
+    const char* p;
+    size_t n;
+    size_t pos = 0;
+    bool ok = true;
+  };
+}
+
+// make one message, including its length
+inline std::vector<char> encode_frame(const Frame& _f, const bool _quantize) {
+  using namespace frame_detail;
+  std::vector<char> buf;
+  put(buf, (uint64_t)0);
+  buf.insert(buf.end(), {'O','2','D','F'});
+  put(buf, (uint8_t)_quantize);
+  put(buf, _f.time);
+  put(buf, _f.step);
+  put(buf, _f.vdelta);
+  put(buf, (uint32_t)_f.blocks.size());
+  for (const auto& b : _f.blocks) {
+    put(buf, (uint8_t)b.kind);
+    put(buf, (uint32_t)b.x.size());
+    put(buf, (uint32_t)b.idx.size());
+    put(buf, (uint32_t)b.s.size());
+    put_floats(buf, b.x, _quantize);
+    put_floats(buf, b.y, _quantize);
+    put_floats(buf, b.s, _quantize);
+    put_array(buf, b.idx);
+  }
+  const uint64_t len = buf.size() - sizeof(uint64_t);
+  std::memcpy(buf.data(), &len, sizeof(len));
+  return buf;
+}
+
+// read one message, without its length
+inline bool decode_frame(const char* _p, const size_t _n, Frame& _f) {
+  frame_detail::Cursor in(_p, _n);
+  const auto magic = in.get<std::array<char,4>>();
+  if (not in.good() or std::memcmp(magic.data(), "O2DF", 4) != 0) return false;
+  const bool quant = in.get<uint8_t>();
+  _f.time = in.get<double>();
+  _f.step = in.get<uint64_t>();
+  _f.vdelta = in.get<float>();
+  const uint32_t nblocks = in.get<uint32_t>();
+  _f.blocks.clear();
+  for (uint32_t i=0; i<nblocks and in.good(); ++i) {
+    FrameBlock b;
+    b.kind = (frame_kind_t)in.get<uint8_t>();
+    const uint32_t n = in.get<uint32_t>();
+    const uint32_t nidx = in.get<uint32_t>();
+    const uint32_t ns = in.get<uint32_t>();
+    in.get_floats(b.x, n, quant);
+    in.get_floats(b.y, n, quant);
+    in.get_floats(b.s, ns, quant);
+    in.get_array(b.idx, nidx);
+    _f.blocks.push_back(std::move(b));
+  }
+  return in.good();
+}
+
+
+class FrameStreamServer {
+public:
+  FrameStreamServer() = default;
+  FrameStreamServer(const FrameStreamServer&) = delete;
+  FrameStreamServer& operator=(const FrameStreamServer&) = delete;
+  ~FrameStreamServer() { stop(); }
+
+  // listen on this port and IPv4 address; the default takes viewers on this machine only,
+  //   and "0.0.0.0" lets anyone who can reach the port see the run
+  bool start(const int _port, const std::string _address = "127.0.0.1") {
+    if (is_running()) return true;
+#ifndef _WIN32
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)_port);
+    if (inet_pton(AF_INET, _address.c_str(), &addr.sin_addr) != 1) {
+      std::cout << "WARNING: stream address " << _address << " is not an IPv4 address" << std::endl;
+      return false;
+    }
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) return false;
+    const int yes = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 or listen(listen_fd, 8) < 0) {
+      std::cout << "WARNING: could not listen for viewers on " << _address << ":" << _port << std::endl;
+      close(listen_fd);
+      listen_fd = -1;
+      return false;
+    }
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    quit = false;
+    sender = std::thread([this](){ run(); });
+    std::cout << "Streaming frames to viewers on " << _address << ":" << _port << std::endl;
+    return true;
+#else
+    std::cout << "WARNING: frame streaming is not supported on this platform" << std::endl;
+    (void)_port;
+    (void)_address;
+    return false;
+#endif
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      quit = true;
+    }
+    cv.notify_all();
+    if (sender.joinable()) sender.join();
+#ifndef _WIN32
+    for (const int fd : clients) close(fd);
+    if (listen_fd >= 0) close(listen_fd);
+#endif
+    clients.clear();
+    listen_fd = -1;
+  }
+
+  bool is_running() const { return listen_fd >= 0; }
+
+  // replaces any frame not yet sent
+  void publish(std::vector<char>&& _msg) {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      pending = std::move(_msg);
+      has_pending = true;
+    }
+    cv.notify_all();
+  }
+
+private:
+#ifndef _WIN32
+  void run() {
+    while (true) {
+      // let in anyone who has connected since
+      int fd;
+      while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0) {
+        const int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        timeval tv{2, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        clients.push_back(fd);
+      }
+
+      std::vector<char> msg;
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait_for(lock, std::chrono::milliseconds(200), [this]{ return quit or has_pending; });
+        if (quit) return;
+        if (not has_pending) continue;
+        msg.swap(pending);
+        has_pending = false;
+      }
+
+      for (auto it = clients.begin(); it != clients.end(); ) {
+        if (send_all(*it, msg)) {
+          ++it;
+        } else {
+          close(*it);
+          it = clients.erase(it);
+        }
+      }
+    }
+  }
+
+  static bool send_all(const int _fd, const std::vector<char>& _msg) {
+    size_t sent = 0;
+    while (sent < _msg.size()) {
+      const ssize_t k = send(_fd, _msg.data()+sent, _msg.size()-sent, MSG_NOSIGNAL);
+      if (k <= 0) return false;
+      sent += (size_t)k;
+    }
+    return true;
+  }
+#else
+  void run() {}
+#endif
+
+  int listen_fd = -1;
+  std::vector<int> clients;	// only touched by the sender thread
+  std::thread sender;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<char> pending;
+  bool has_pending = false;
+  bool quit = false;
+};
+
+
+class FrameStreamClient {
+public:
+  FrameStreamClient() = default;
+  FrameStreamClient(const FrameStreamClient&) = delete;
+  FrameStreamClient& operator=(const FrameStreamClient&) = delete;
+  ~FrameStreamClient() { disconnect(); }
+
+  // accepts "host:port"
+  bool connect_to(const std::string _addr) {
+    disconnect();
+#ifndef _WIN32
+    const size_t colon = _addr.rfind(':');
+    if (colon == std::string::npos) return false;
+    const std::string host = _addr.substr(0, colon);
+    const std::string port = _addr.substr(colon+1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return false;
+    for (addrinfo* ai = res; ai and fd < 0; ai = ai->ai_next) {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd >= 0 and connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) return false;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return true;
+#else
+    (void)_addr;
+    return false;
+#endif
+  }
+
+  void disconnect() {
+#ifndef _WIN32
+    if (fd >= 0) close(fd);
+#endif
+    fd = -1;
+    buf.clear();
+  }
+
+  bool is_connected() const { return fd >= 0; }
+
+  // read whatever has arrived, true if that finished a frame; only the newest one is kept
+  bool poll(Frame& _frame) {
+#ifndef _WIN32
+    if (fd < 0) return false;
+    char chunk[65536];
+    while (true) {
+      const ssize_t k = recv(fd, chunk, sizeof(chunk), 0);
+      if (k > 0) {
+        buf.insert(buf.end(), chunk, chunk+k);
+      } else {
+        if (k == 0 or (errno != EAGAIN and errno != EWOULDBLOCK)) {
+          std::cout << "Frame stream closed" << std::endl;
+          disconnect();
+        }
+        break;
+      }
+    }
+
+    // find the last complete message
+    size_t pos = 0;
+    size_t last = 0, lastlen = 0;
+    bool found = false;
+    while (buf.size() - pos >= sizeof(uint64_t)) {
+      uint64_t len;
+      std::memcpy(&len, buf.data()+pos, sizeof(len));
+      if (buf.size() - pos - sizeof(len) < len) break;
+      last = pos + sizeof(len);
+      lastlen = (size_t)len;
+      found = true;
+      pos = last + lastlen;
+    }
+    bool ok = false;
+    if (found) ok = decode_frame(buf.data()+last, lastlen, _frame);
+    buf.erase(buf.begin(), buf.begin()+pos);
+    return ok;
+#else
+    (void)_frame;
+    return false;
+#endif
+  }
+
+private:
+  int fd = -1;
+  std::vector<char> buf;
+};
+
@@ -0,0 +1,118 @@
+/*
+ * GlDensity.h - Sum particles into a texture when their splats would be smaller than a pixel
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "ShaderHelper.h"
+
+#include <glad/glad.h>
+
+#include <vector>
+
+
+//
+// Zoomed far out, every particle still gets a quad a few pixels wide, so a million of them
+//   cost a million overlapping quads; instead each one adds its share to a single pixel of a
+//   float texture, and one screen-covering triangle turns the sums into color
+//
+// only the drawing changes: the particles and their buffers are untouched
+//
+class GlDensity {
+public:
+  explicit GlDensity(const GLuint _blob_prog) {
+    sum_prog = create_draw_density_program(_blob_prog);
+    projmat_attribute = glGetUniformLocation(sum_prog, "Projection");
+    rad_scale_attribute = glGetUniformLocation(sum_prog, "rad_scale");
+    px_per_unit_attribute = glGetUniformLocation(sum_prog, "px_per_unit");
+    glBindFragDataLocation(sum_prog, 0, "frag_color");
+
+    color_prog = create_draw_composite_program();
+    pos_color_attribute = glGetUniformLocation(color_prog, "pos_color");
+    neg_color_attribute = glGetUniformLocation(color_prog, "neg_color");
+    str_scale_attribute = glGetUniformLocation(color_prog, "str_scale");
+    glUniform1i(glGetUniformLocation(color_prog, "density"), 0);
+    glBindFragDataLocation(color_prog, 0, "frag_color");
+
+    // core profiles want a vertex array bound even with no attributes
+    glGenVertexArrays(1, &empty_vao);
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &tex);
+  }
+
+  ~GlDensity() {
+    glDeleteTextures(1, &tex);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteVertexArrays(1, &empty_vao);
+    glDeleteProgram(sum_prog);
+    glDeleteProgram(color_prog);
+  }
+
+  // send the following draws into the cleared texture, sized to the current viewport, with
+  //   the summing program in use
+  void begin(const std::vector<float>& _projmat, const float _rad_scale) {
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &last_fbo);
+
+    if (viewport[2] != width or viewport[3] != height) {
+      width = viewport[2];
+      height = viewport[3];
+      glBindTexture(GL_TEXTURE_2D, tex);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, nullptr);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+      glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glUseProgram(sum_prog);
+    glUniformMatrix4fv(projmat_attribute, 1, GL_FALSE, _projmat.data());
+    glUniform1f(rad_scale_attribute, (const GLfloat)_rad_scale);
+    glUniform1f(px_per_unit_attribute, (const GLfloat)(0.5f * _projmat[0] * width));
+  }
+
+  // put the screen back and add the colored sums to it; blending must still be additive
+  void finish(const float* _poscolor, const float* _negcolor, const float _str_scale) {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)last_fbo);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    glUseProgram(color_prog);
+    glUniform4fv(pos_color_attribute, 1, (const GLfloat *)_poscolor);
+    glUniform4fv(neg_color_attribute, 1, (const GLfloat *)_negcolor);
+    glUniform1f (str_scale_attribute, (const GLfloat)_str_scale);
+
+    GLint last_vao;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vao);
+    glBindVertexArray(empty_vao);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray((GLuint)last_vao);
+  }
+
+  // bytes in the texture
+  size_t get_bytes() const { return 8 * (size_t)width * (size_t)height; }
+
+private:
+  GLuint sum_prog, color_prog;
+  GLuint empty_vao, fbo, tex;
+  int width = 0;
+  int height = 0;
+
+  // what to put back after summing
+  GLint viewport[4];
+  GLint last_fbo = 0;
+
+  GLint projmat_attribute, rad_scale_attribute, px_per_unit_attribute;
+  GLint pos_color_attribute, neg_color_attribute, str_scale_attribute;
+};
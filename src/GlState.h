@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include "GlStream.h"
+#include "GlDensity.h"
+
 #include <glad/glad.h>
 
 #include <iostream>
 #include <vector>
+#include <memory>
 #include <cassert>
 
 
@@ -69,6 +73,15 @@ public:
   // we probably don't need this
   GLsizei num_uploaded;
 
+  // bytes in the buffers at the last upload
+  size_t num_bytes = 0;
+
+  // the per-element buffers, when they are persistently mapped
+  std::unique_ptr<GlStream> stream;
+
+  // where particles too small to splat are summed, made when first needed
+  std::unique_ptr<GlDensity> density;
+
   // some number of attributes
   GLint projmat_attribute, projmat_attribute_bl, projmat_attribute_pt, quad_attribute_bl, quad_attribute_pt;
   GLint def_color_attribute, pos_color_attribute, neg_color_attribute; //, back_color_attribute; 
@@ -0,0 +1,210 @@
+/*
+ * GlStream.h - Persistently-mapped vertex buffers the step thread can write into
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <mutex>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+
+//
+// Each buffer holds nslots copies of one per-element array, one after the other, mapped once
+//   for good; the step thread copies its last state into a copy the GPU is not drawing and
+//   publishes it, and the GUI thread need only switch to it, so neither waits on the other
+//
+// every per-element attribute advances once per instance, so a draw picks its copy with
+//   the base instance and the vertex array never changes
+//
+// all GL calls (storage, fences) are on the GUI thread; reserve() and upload() must also
+//   come between steps, as updateGL() does, since they can move the mapped memory
+//
+class GlStream {
+public:
+  static constexpr int nslots = 3;
+
+  // persistent mapping needs buffer storage (4.4), and picking the copy base instances (4.2)
+  static bool is_supported() { return GLAD_GL_VERSION_4_4; }
+
+  // these entries of the collection's buffer names are streamed, each of _elem_bytes per element
+  GlStream(std::vector<GLuint>* _vbo, const std::vector<size_t> _which, const size_t _elem_bytes)
+    : vbo(_vbo), which(_which), elem_bytes(_elem_bytes), mapped(_which.size(), nullptr) {}
+
+  ~GlStream() {
+    for (auto& f : fences) if (f) glDeleteSync(f);
+  }
+
+  // make room for _n elements in every copy, with headroom so a growing collection is not
+  //   remade every step; true if the buffers were remade and need binding to the vao again
+  bool reserve(const size_t _n) {
+    if (_n <= capacity and capacity > 0) return false;
+
+    // nothing may still draw from the old storage
+    for (auto& f : fences) {
+      if (f) {
+        glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)10000000000);
+        glDeleteSync(f);
+        f = nullptr;
+      }
+    }
+
+    capacity = std::max((size_t)1024, _n + _n/2);
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (size_t k=0; k<which.size(); ++k) {
+      GLuint& buf = (*vbo)[which[k]];
+      // storage is immutable, so a new size needs a new buffer
+      glDeleteBuffers(1, &buf);
+      glGenBuffers(1, &buf);
+      glBindBuffer(GL_ARRAY_BUFFER, buf);
+      glBufferStorage(GL_ARRAY_BUFFER, nslots*capacity*elem_bytes, nullptr, flags);
+      mapped[k] = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, nslots*capacity*elem_bytes, flags);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    state.fill(slot_free);
+    counts.fill(0);
+    front = 0;
+    state[front] = slot_front;
+    return true;
+  }
+
+  // step thread: copy one array per buffer (null for zeros) into a free copy and publish it,
+  //   marked with the collection's state generation and with any bounds the draws need;
+  //   false if no copy was free or the arrays outgrew the buffers, and updateGL() will
+  //   upload them instead
+  bool publish(const std::vector<const void*>& _src, const size_t _n, const uint32_t _gen,
+               std::vector<float>&& _bounds) {
+    int slot = -1;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (capacity == 0 or _n > capacity or _src.size() != which.size()) return false;
+      // or over a snapshot published and never drawn
+      slot = find(slot_free);
+      if (slot < 0) slot = find(slot_ready);
+      if (slot < 0) return false;
+      state[slot] = slot_writing;
+    }
+
+    copy_into(slot, _src, _n);
+    bounds[slot] = std::move(_bounds);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    const int old = find(slot_ready);
+    if (old >= 0) state[old] = slot_free;
+    state[slot] = slot_ready;
+    counts[slot] = _n;
+    gens[slot] = _gen;
+    return true;
+  }
+
+  // GUI thread: switch to the published copy if it shows the collection as it is now
+  bool acquire(const uint32_t _gen) {
+    retire();
+    std::lock_guard<std::mutex> lock(mtx);
+    const int slot = find(slot_ready);
+    if (slot < 0) return false;
+    if (gens[slot] != _gen) {
+      state[slot] = slot_free;
+      return false;
+    }
+    // the old copy is freed once the GPU is done with it
+    state[front] = slot_drawn;
+    state[slot] = slot_front;
+    front = slot;
+    return true;
+  }
+
+  // GUI thread: copy the arrays in now, waiting for the GPU only if every copy is in use
+  void upload(const std::vector<const void*>& _src, const size_t _n, std::vector<float>&& _bounds) {
+    retire();
+    int slot = -1;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      const int old = find(slot_ready);
+      if (old >= 0) state[old] = slot_free;
+      slot = find(slot_free);
+      if (slot < 0) slot = find(slot_drawn);
+    }
+    if (fences[slot]) {
+      glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)10000000000);
+      glDeleteSync(fences[slot]);
+      fences[slot] = nullptr;
+    }
+
+    copy_into(slot, _src, _n);
+    bounds[slot] = std::move(_bounds);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    state[front] = slot_drawn;
+    state[slot] = slot_front;
+    front = slot;
+    counts[slot] = _n;
+  }
+
+  // GUI thread: every draw from the front copy has been issued
+  void fence_front() {
+    if (fences[front]) glDeleteSync(fences[front]);
+    fences[front] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  GLuint get_base_instance() const { return (GLuint)(front * capacity); }
+  size_t get_count() const { return counts[front]; }
+  const std::vector<float>& get_bounds() const { return bounds[front]; }
+  size_t get_bytes() const { return nslots * capacity * elem_bytes * which.size(); }
+
+private:
+  enum slot_t { slot_free, slot_writing, slot_ready, slot_front, slot_drawn };
+
+  int find(const slot_t _state) const {
+    for (int s=0; s<nslots; ++s) if (state[s] == _state) return s;
+    return -1;
+  }
+
+  // GUI thread: free the copies the GPU has finished drawing
+  void retire() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (int s=0; s<nslots; ++s) {
+      if (state[s] != slot_drawn) continue;
+      if (fences[s]) {
+        if (glClientWaitSync(fences[s], 0, 0) == GL_TIMEOUT_EXPIRED) continue;
+        glDeleteSync(fences[s]);
+        fences[s] = nullptr;
+      }
+      state[s] = slot_free;
+    }
+  }
+
+  void copy_into(const int _slot, const std::vector<const void*>& _src, const size_t _n) {
+    for (size_t k=0; k<which.size(); ++k) {
+      uint8_t* dst = mapped[k] + _slot*capacity*elem_bytes;
+      if (_src[k]) std::memcpy(dst, _src[k], _n*elem_bytes);
+      else std::memset(dst, 0, _n*elem_bytes);
+    }
+  }
+
+  std::vector<GLuint>* vbo;
+  std::vector<size_t> which;
+  size_t elem_bytes;
+  std::vector<uint8_t*> mapped;
+  size_t capacity = 0;
+
+  // the copy being drawn, and what each copy is doing and holds
+  int front = 0;
+  std::array<slot_t,nslots> state = {};
+  std::array<size_t,nslots> counts = {};
+  std::array<uint32_t,nslots> gens = {};
+  std::array<std::vector<float>,nslots> bounds;
+  std::array<GLsync,nslots> fences = {};
+  std::mutex mtx;
+};
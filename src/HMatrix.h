@@ -0,0 +1,372 @@
+/*
+ * HMatrix.h - Hierarchically off-diagonal low-rank (HODLR) compression of a dense matrix
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <Eigen/Dense>
+
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cassert>
+
+
+//
+// A matrix which is only known through a function returning any entry
+//
+// The index range is halved recursively; the two off-diagonal blocks at each level are
+//   compressed to U V^T with adaptive cross approximation (ACA), and the leaves on the
+//   diagonal are kept dense. This suits boundary elements ordered along each boundary,
+//   where neighboring indices are neighboring panels.
+//
+// Both a product and a direct solve are supported, the latter by applying the Woodbury
+//   identity at each level: storage, product, and solve all scale as N log N
+//
+// ACA needs entries which are smooth to well below its tolerance, so compute them in double
+//
+template <class S>
+class HMatrix {
+public:
+  typedef Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic> Mat;
+  typedef Eigen::Matrix<S, Eigen::Dynamic, 1> Vec;
+  typedef std::function<S(const size_t, const size_t)> Entry;
+
+  HMatrix(const size_t _n, Entry _entry, const S _tol, const size_t _leafsize = 64)
+    : n(_n), entry(std::move(_entry)), tol(_tol), leaf_size(_leafsize), factored(false) {
+    nodes.reserve(2*(n/leaf_size+1));
+    if (n > 0) (void) build(0, n);
+
+    // every block is independent, and the entry function only reads
+    #pragma omp parallel for schedule(dynamic,1)
+    for (int32_t i=0; i<(int32_t)nodes.size(); ++i) fill(i);
+  }
+
+  size_t size() const { return n; }
+  bool is_factored() const { return factored; }
+
+  // ratio of stored entries to those of the dense matrix
+  float get_compression() const {
+    size_t nstored = 0;
+    for (const Node& nd : nodes) {
+      nstored += nd.dense.size() + nd.u01.size() + nd.v01.size() + nd.u10.size() + nd.v10.size();
+    }
+    return (float)nstored / std::max((float)1.0, (float)n*(float)n);
+  }
+
+  // bytes in all of the blocks and factors
+  size_t get_mem_bytes() const {
+    size_t nstored = 0;
+    for (const Node& nd : nodes) {
+      nstored += nd.dense.size() + nd.u01.size() + nd.v01.size() + nd.u10.size() + nd.v10.size() +
+                 nd.z01.size() + nd.z10.size() + nd.lu.rows()*nd.lu.cols() + nd.cap.rows()*nd.cap.cols();
+    }
+    return nstored * sizeof(S);
+  }
+
+  // largest rank of any off-diagonal block
+  Eigen::Index get_max_rank() const {
+    Eigen::Index maxr = 0;
+    for (const Node& nd : nodes) maxr = std::max(maxr, std::max(nd.u01.cols(), nd.u10.cols()));
+    return maxr;
+  }
+
+  // y = A x
+  void multiply(const Vec& _x, Vec& _y) const {
+    _y.setZero(n);
+    if (n > 0) multiply(0, _x, _y);
+  }
+
+  // build the direct solver, children are always factored before their parents
+  void factor() {
+    for (int32_t i=(int32_t)nodes.size()-1; i>=0; --i) factor(i);
+    factored = true;
+  }
+
+  // x = A^-1 b, call factor first
+  void solve(const Vec& _b, Vec& _x) const {
+    assert(factored && "HMatrix has not been factored");
+    Mat bx = _b;
+    if (n > 0) solve_in_place(0, bx);
+    _x = bx.col(0);
+  }
+
+  // for blocks of right-hand sides
+  void solve(Mat& _bx) const {
+    assert(factored && "HMatrix has not been factored");
+    if (n > 0) solve_in_place(0, _bx);
+  }
+
+private:
+  struct Node {
+    size_t ibeg, iend;
+    int32_t child[2] = {-1, -1};
+    // leaves only
+    Mat dense;
+    Eigen::PartialPivLU<Mat> lu;
+    // parents only: A(c0,c1) ~ u01 v01^T, A(c1,c0) ~ u10 v10^T
+    Mat u01, v01, u10, v10;
+    // parents only: the children's inverses applied to u01 and u10, and the small capacitance matrix
+    Mat z01, z10;
+    Eigen::PartialPivLU<Mat> cap;
+  };
+
+  // the tree is just halves of index ranges, children always have larger indices
+  int32_t build(const size_t _beg, const size_t _end) {
+    const int32_t inode = (int32_t)nodes.size();
+    nodes.emplace_back();
+    nodes[inode].ibeg = _beg;
+    nodes[inode].iend = _end;
+
+    const size_t num = _end - _beg;
+    if (num > leaf_size) {
+      const size_t mid = _beg + num/2;
+      const int32_t c0 = build(_beg, mid);
+      const int32_t c1 = build(mid, _end);
+      nodes[inode].child[0] = c0;
+      nodes[inode].child[1] = c1;
+    }
+    return inode;
+  }
+
+  // dense leaves, compressed off-diagonal blocks for parents
+  void fill(const int32_t _in) {
+    Node& nd = nodes[_in];
+    if (nd.child[0] < 0) {
+      const size_t num = nd.iend - nd.ibeg;
+      nd.dense.resize(num, num);
+      for (size_t j=0; j<num; ++j) {
+        for (size_t i=0; i<num; ++i) nd.dense(i,j) = entry(nd.ibeg+i, nd.ibeg+j);
+      }
+    } else {
+      const size_t mid = nodes[nd.child[0]].iend;
+      aca(nd.ibeg, mid, mid, nd.iend, nd.u01, nd.v01);
+      aca(mid, nd.iend, nd.ibeg, mid, nd.u10, nd.v10);
+    }
+  }
+
+  // adaptive cross approximation with partial pivoting, A(rows,cols) ~ U V^T
+  void aca(const size_t _r0, const size_t _r1, const size_t _c0, const size_t _c1, Mat& _u, Mat& _v) const {
+    const Eigen::Index nr = _r1 - _r0;
+    const Eigen::Index nc = _c1 - _c0;
+    const Eigen::Index maxrank = std::min(nr, nc);
+    std::vector<Vec> us, vs;
+    std::vector<bool> row_used(nr, false);
+    double approx_norm_sq = 0.0;
+    Eigen::Index irow = 0;
+
+    while ((Eigen::Index)us.size() < maxrank) {
+      row_used[irow] = true;
+
+      // residual of the pivot row
+      Vec row(nc);
+      for (Eigen::Index j=0; j<nc; ++j) row[j] = entry(_r0+irow, _c0+j);
+      for (size_t l=0; l<us.size(); ++l) row -= us[l][irow] * vs[l];
+
+      Eigen::Index jcol;
+      const S pivot = row.cwiseAbs().maxCoeff(&jcol);
+      if (pivot == S(0.0)) {
+        // this row is already reproduced, try another
+        auto it = std::find(row_used.begin(), row_used.end(), false);
+        if (it == row_used.end()) break;
+        irow = it - row_used.begin();
+        continue;
+      }
+      const Vec v = row / row[jcol];
+
+      // residual of the pivot column
+      Vec col(nr);
+      for (Eigen::Index i=0; i<nr; ++i) col[i] = entry(_r0+i, _c0+jcol);
+      for (size_t l=0; l<us.size(); ++l) col -= vs[l][jcol] * us[l];
+
+      // update the Frobenius norm of the approximation
+      const double unorm = col.norm();
+      const double vnorm = v.norm();
+      for (size_t l=0; l<us.size(); ++l) {
+        approx_norm_sq += 2.0 * (double)col.dot(us[l]) * (double)v.dot(vs[l]);
+      }
+      approx_norm_sq += unorm*unorm * vnorm*vnorm;
+      us.push_back(col);
+      vs.push_back(v);
+
+      if (unorm*vnorm <= tol * std::sqrt(std::abs(approx_norm_sq))) break;
+
+      // next pivot row is the largest unused entry in this column
+      S best = -1.0;
+      for (Eigen::Index i=0; i<nr; ++i) {
+        if (not row_used[i] and std::abs(col[i]) > best) {
+          best = std::abs(col[i]);
+          irow = i;
+        }
+      }
+      if (best < S(0.0)) break;
+    }
+
+    _u.resize(nr, us.size());
+    _v.resize(nc, vs.size());
+    for (size_t l=0; l<us.size(); ++l) {
+      _u.col(l) = us[l];
+      _v.col(l) = vs[l];
+    }
+  }
+
+  void multiply(const int32_t _in, const Vec& _x, Vec& _y) const {
+    const Node& nd = nodes[_in];
+    if (nd.child[0] < 0) {
+      _y.segment(nd.ibeg, nd.iend-nd.ibeg) += nd.dense * _x.segment(nd.ibeg, nd.iend-nd.ibeg);
+      return;
+    }
+    const Node& n0 = nodes[nd.child[0]];
+    const Node& n1 = nodes[nd.child[1]];
+    const size_t num0 = n0.iend - n0.ibeg;
+    const size_t num1 = n1.iend - n1.ibeg;
+    if (nd.u01.cols() > 0) _y.segment(n0.ibeg, num0) += nd.u01 * (nd.v01.transpose() * _x.segment(n1.ibeg, num1));
+    if (nd.u10.cols() > 0) _y.segment(n1.ibeg, num1) += nd.u10 * (nd.v10.transpose() * _x.segment(n0.ibeg, num0));
+    multiply(nd.child[0], _x, _y);
+    multiply(nd.child[1], _x, _y);
+  }
+
+  //
+  // At each parent, A = D + W Y^T with D the two children, W = diag(u01, u10),
+  //   and Y^T = [0 v01^T; v10^T 0], so A^-1 = D^-1 - D^-1 W (I + Y^T D^-1 W)^-1 Y^T D^-1
+  //
+  void factor(const int32_t _in) {
+    Node& nd = nodes[_in];
+    if (nd.child[0] < 0) {
+      nd.lu.compute(nd.dense);
+      return;
+    }
+    nd.z01 = nd.u01;
+    nd.z10 = nd.u10;
+    solve_in_place(nd.child[0], nd.z01);
+    solve_in_place(nd.child[1], nd.z10);
+
+    const Eigen::Index k0 = nd.u01.cols();
+    const Eigen::Index k1 = nd.u10.cols();
+    Mat k = Mat::Identity(k0+k1, k0+k1);
+    if (k0 > 0 and k1 > 0) {
+      k.block(0, k0, k0, k1) = nd.v01.transpose() * nd.z10;
+      k.block(k0, 0, k1, k0) = nd.v10.transpose() * nd.z01;
+    }
+    nd.cap.compute(k);
+  }
+
+  // the rows of _bx are this node's range
+  void solve_in_place(const int32_t _in, Eigen::Ref<Mat> _bx) const {
+    const Node& nd = nodes[_in];
+    if (nd.child[0] < 0) {
+      const Mat x = nd.lu.solve(_bx);
+      _bx = x;
+      return;
+    }
+    const Node& n0 = nodes[nd.child[0]];
+    const Eigen::Index num0 = n0.iend - n0.ibeg;
+    const Eigen::Index num1 = (nd.iend - nd.ibeg) - num0;
+    solve_in_place(nd.child[0], _bx.topRows(num0));
+    solve_in_place(nd.child[1], _bx.bottomRows(num1));
+
+    const Eigen::Index k0 = nd.u01.cols();
+    const Eigen::Index k1 = nd.u10.cols();
+    if (k0+k1 == 0) return;
+    Mat t(k0+k1, _bx.cols());
+    t.topRows(k0) = nd.v01.transpose() * _bx.bottomRows(num1);
+    t.bottomRows(k1) = nd.v10.transpose() * _bx.topRows(num0);
+    const Mat s = nd.cap.solve(t);
+    _bx.topRows(num0) -= nd.z01 * s.topRows(k0);
+    _bx.bottomRows(num1) -= nd.z10 * s.bottomRows(k1);
+  }
+
+  size_t n;
+  Entry entry;
+  S tol;
+  size_t leaf_size;
+  bool factored;
+  std::vector<Node> nodes;
+};
+
+
+//
+// An HMatrix bordered by a few dense rows and columns, [H C; R E], such as the extra
+//   unknowns of augmented bodies; they are solved with the Schur complement
+//
+template <class S>
+class BorderedHMatrix {
+public:
+  typedef typename HMatrix<S>::Mat Mat;
+  typedef typename HMatrix<S>::Vec Vec;
+
+  // _hidx maps each full index to its place in H, or -1 if it is a border index
+  BorderedHMatrix(const std::vector<int64_t>& _hidx, HMatrix<S>&& _h,
+                  const Mat& _c, const Mat& _r, const Mat& _e)
+    : hidx(_hidx), h(std::move(_h)), c(_c), r(_r), e(_e) {
+    for (size_t i=0; i<hidx.size(); ++i) {
+      if (hidx[i] < 0) bidx.push_back(i);
+    }
+    assert(bidx.size() == (size_t)e.rows() && "Border size does not match");
+  }
+
+  const HMatrix<S>& get_h() const { return h; }
+
+  size_t get_mem_bytes() const {
+    return h.get_mem_bytes() + sizeof(S)*(c.size() + r.size() + e.size() + hinv_c.size() +
+                                          schur.rows()*schur.cols());
+  }
+
+  void factor() {
+    h.factor();
+    hinv_c = c;
+    h.solve(hinv_c);
+    schur.compute(e - r * hinv_c);
+  }
+
+  void multiply(const Vec& _x, Vec& _y) const {
+    Vec xh, xb;
+    split(_x, xh, xb);
+    Vec yh;
+    h.multiply(xh, yh);
+    yh += c * xb;
+    const Vec yb = r * xh + e * xb;
+    join(yh, yb, _y);
+  }
+
+  void solve(const Vec& _b, Vec& _x) const {
+    Vec bh, bb;
+    split(_b, bh, bb);
+    Vec hinv_b;
+    h.solve(bh, hinv_b);
+    const Vec xb = schur.solve(bb - r * hinv_b);
+    const Vec xh = hinv_b - hinv_c * xb;
+    join(xh, xb, _x);
+  }
+
+private:
+  void split(const Vec& _full, Vec& _h, Vec& _b) const {
+    _h.resize(h.size());
+    _b.resize(bidx.size());
+    for (size_t i=0; i<hidx.size(); ++i) {
+      if (hidx[i] >= 0) _h[hidx[i]] = _full[i];
+    }
+    for (size_t i=0; i<bidx.size(); ++i) _b[i] = _full[bidx[i]];
+  }
+
+  void join(const Vec& _h, const Vec& _b, Vec& _full) const {
+    _full.resize(hidx.size());
+    for (size_t i=0; i<hidx.size(); ++i) {
+      if (hidx[i] >= 0) _full[i] = _h[hidx[i]];
+    }
+    for (size_t i=0; i<bidx.size(); ++i) _full[bidx[i]] = _b[i];
+  }
+
+  std::vector<int64_t> hidx;
+  std::vector<size_t> bidx;
+  HMatrix<S> h;
+  Mat c, r, e;
+  Mat hinv_c;
+  Eigen::PartialPivLU<Mat> schur;
+};
+
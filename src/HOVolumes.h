@@ -137,7 +137,7 @@ public:
   }
 
   // append a Surfaces to the object for the wall-boundary geometry
-  void add_wall(const ElementPacket<float>& _in) {
+  void add_wall(const ElementPacket<S>& _in) {
 
     // ensure that this packet really is Surfaces
     assert(_in.idx.size() != 0 && "Input ElementPacket is empty");
@@ -153,7 +153,7 @@ public:
   }
 
   // append a Surfaces to the object for the open-boundary geometry
-  void add_open(const ElementPacket<float>& _in) {
+  void add_open(const ElementPacket<S>& _in) {
 
     // ensure that this packet really is Surfaces
     assert(_in.idx.size() != 0 && "Input ElementPacket is empty");
@@ -288,9 +288,9 @@ public:
     assert(_circ.size() == soln_p.get_n() && "HOVolumes::get_equivalent_particles input vector size mismatch");
 
     // prepare the data arrays for the element packet (there's an "idx" in Volumes)
-    std::vector<float> _x;
+    std::vector<S> _x;
     std::vector<Int> _idx;
-    std::vector<float> _val;
+    std::vector<S> _val;
     size_t thisn = 0;
 
     // get this array so we can reference it more easily
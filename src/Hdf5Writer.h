@@ -0,0 +1,235 @@
+/*
+ * Hdf5Writer.h - Append output steps to one HDF5 file per series, with an XDMF index
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#ifdef USE_HDF5
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+
+#include <hdf5.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <set>
+#include <mutex>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <iostream>
+#include <type_traits>
+
+
+//
+// Each series (part_00, panel_00, fldpt_00...) gets one file, series.h5, holding a group per
+//   output step, and one series.xmf which lists those steps as a temporal collection that
+//   ParaView and VisIt open directly; every dataset is chunked, shuffled, and deflated
+//
+// HDF5 is usually built without thread safety, so a whole step is written under one lock,
+//   held by the Hdf5Step which writes it; the xmf gets each new step written over its closing
+//   tags, like the vtk .pvd indexes
+//
+class Hdf5Writer {
+public:
+  // the next steps start new files
+  void reset() {
+    std::lock_guard<std::mutex> lock(mtx);
+    started.clear();
+  }
+
+private:
+  friend class Hdf5Step;
+
+  std::mutex mtx;
+  std::set<std::string> started;
+};
+
+//
+// one output step of one series, made and finished within a single write:
+//
+//   Hdf5Step step(h5out, "part_00", frameno, time);
+//   step.add_geometry(x);
+//   ...
+//   return step.end_step();
+//
+class Hdf5Step {
+public:
+  Hdf5Step(Hdf5Writer& _out, const std::string _series, const size_t _frameno, const double _time)
+    : out(_out),
+      lock(_out.mtx),
+      series(_series) {
+
+    std::stringstream gs;
+    gs << "step_" << std::setfill('0') << std::setw(5) << _frameno;
+    group_name = gs.str();
+
+    // the first step of a run starts a new file
+    const std::string h5file = series + ".h5";
+    fresh = (out.started.count(series) == 0);
+    file = -1;
+    if (not fresh) file = H5Fopen(h5file.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+    if (file < 0) {
+      fresh = true;
+      file = H5Fcreate(h5file.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    }
+
+    // the same frame may be written twice, keep the last one
+    if (H5Lexists(file, group_name.c_str(), H5P_DEFAULT) > 0) {
+      H5Ldelete(file, group_name.c_str(), H5P_DEFAULT);
+    }
+    group = H5Gcreate2(file, group_name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+
+    xmf << "      <Grid Name=\"" << group_name << "\" GridType=\"Uniform\">\n";
+    xmf << "        <Time Value=\"" << std::setprecision(10) << _time << "\"/>\n";
+  }
+
+  // a step left without end_step still closes its file, and is not indexed
+  ~Hdf5Step() {
+    if (group >= 0) H5Gclose(group);
+    if (file >= 0) H5Fclose(file);
+  }
+
+  // node positions
+  template <class S>
+  void add_geometry(const std::array<Vector<S>,Dimensions>& _x) {
+    const std::string item = write_dataset("position", interleave(_x, Dimensions), Dimensions);
+    xmf << "        <Geometry GeometryType=\"XY\">\n" << item << "        </Geometry>\n";
+  }
+
+  // element connectivity, or nothing but the number of nodes for loose points
+  void add_topology(const std::string _type, const size_t _nelems, const size_t _nper,
+                    const std::vector<Int>& _idx = std::vector<Int>()) {
+    xmf << "        <Topology TopologyType=\"" << _type << "\" NumberOfElements=\"" << _nelems
+        << "\" NodesPerElement=\"" << _nper << "\"";
+    if (_idx.empty()) {
+      xmf << "/>\n";
+    } else {
+      xmf << ">\n" << write_dataset("connectivity", _idx, _nper) << "        </Topology>\n";
+    }
+  }
+
+  template <class S>
+  void add_scalar(const std::string _name, const Vector<S>& _data, const bool _on_cells = false) {
+    xmf << "        <Attribute Name=\"" << _name << "\" AttributeType=\"Scalar\" Center=\""
+        << (_on_cells ? "Cell" : "Node") << "\">\n"
+        << write_dataset(_name, _data, 1) << "        </Attribute>\n";
+  }
+
+  // xdmf vectors have three components
+  template <class S>
+  void add_vector(const std::string _name, const std::array<Vector<S>,Dimensions>& _data,
+                  const bool _on_cells = false) {
+    xmf << "        <Attribute Name=\"" << _name << "\" AttributeType=\"Vector\" Center=\""
+        << (_on_cells ? "Cell" : "Node") << "\">\n"
+        << write_dataset(_name, interleave(_data, 3), 3) << "        </Attribute>\n";
+  }
+
+  // close the step and add it to the index, returning the name of the index
+  std::string end_step() {
+    H5Gclose(group);
+    H5Fclose(file);
+    group = -1;
+    file = -1;
+    xmf << "      </Grid>\n";
+
+    const std::string xmffile = series + ".xmf";
+    std::FILE* fp = nullptr;
+    if (not fresh) fp = std::fopen(xmffile.c_str(), "r+b");
+    if (fp) {
+      std::fseek(fp, -(long)std::strlen(tail), SEEK_END);
+    } else {
+      fp = std::fopen(xmffile.c_str(), "wb");
+    }
+    if (fp) {
+      if (fresh) std::fprintf(fp, head, series.c_str());
+      std::fputs(xmf.str().c_str(), fp);
+      std::fputs(tail, fp);
+      std::fclose(fp);
+    } else {
+      std::cout << "WARNING: could not write " << xmffile << std::endl;
+    }
+
+    out.started.insert(series);
+    return xmffile;
+  }
+
+private:
+  template <class S>
+  Vector<S> interleave(const std::array<Vector<S>,Dimensions>& _data, const size_t _ncomp) {
+    const size_t n = _data[0].size();
+    Vector<S> out(_ncomp*n, 0.0);
+    for (size_t i=0; i<n; ++i) {
+      for (size_t d=0; d<Dimensions; ++d) out[_ncomp*i+d] = _data[d][i];
+    }
+    return out;
+  }
+
+  // write one chunked, compressed dataset in the current group, return its xdmf DataItem
+  template <class V>
+  std::string write_dataset(const std::string _name, const V& _data, const size_t _ncomp) {
+    using T = typename V::value_type;
+    const hid_t type = std::is_same<T,float>::value  ? H5T_NATIVE_FLOAT :
+                       std::is_same<T,double>::value ? H5T_NATIVE_DOUBLE : H5T_NATIVE_UINT32;
+    static_assert(std::is_floating_point<T>::value or sizeof(T) == 4, "Only floats and 32-bit indices");
+
+    const hsize_t nrows = _data.size() / _ncomp;
+    const int rank = (_ncomp == 1) ? 1 : 2;
+    const hsize_t dims[2] = {nrows, (hsize_t)_ncomp};
+    const hid_t space = H5Screate_simple(rank, dims, nullptr);
+
+    const hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    if (nrows > 0) {
+      const hsize_t chunk[2] = {std::min(nrows, (hsize_t)chunk_rows), (hsize_t)_ncomp};
+      H5Pset_chunk(dcpl, rank, chunk);
+      H5Pset_shuffle(dcpl);
+      H5Pset_deflate(dcpl, 1);
+    }
+
+    const hid_t dset = H5Dcreate2(group, _name.c_str(), type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    if (dset < 0 or (nrows > 0 and H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, _data.data()) < 0)) {
+      std::cout << "WARNING: could not write " << _name << " to " << series << ".h5" << std::endl;
+    }
+    if (dset >= 0) H5Dclose(dset);
+    H5Pclose(dcpl);
+    H5Sclose(space);
+
+    std::stringstream item;
+    item << "          <DataItem Dimensions=\"" << nrows;
+    if (rank == 2) item << " " << _ncomp;
+    item << "\" NumberType=\"" << (std::is_floating_point<T>::value ? "Float" : "UInt")
+         << "\" Precision=\"" << sizeof(T) << "\" Format=\"HDF\">"
+         << series << ".h5:/" << group_name << "/" << _name << "</DataItem>\n";
+    return item.str();
+  }
+
+  static constexpr size_t chunk_rows = 1 << 14;
+  static constexpr const char* head = "<?xml version=\"1.0\" ?>\n"
+                                      "<Xdmf Version=\"3.0\">\n"
+                                      "  <Domain>\n"
+                                      "    <Grid Name=\"%s\" GridType=\"Collection\" CollectionType=\"Temporal\">\n";
+  static constexpr const char* tail = "    </Grid>\n"
+                                      "  </Domain>\n"
+                                      "</Xdmf>\n";
+
+  Hdf5Writer& out;
+  std::lock_guard<std::mutex> lock;
+
+  // the step being written
+  std::string series;
+  std::string group_name;
+  bool fresh = true;
+  hid_t file = -1;
+  hid_t group = -1;
+  std::stringstream xmf;
+};
+
+#endif
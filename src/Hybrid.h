@@ -12,6 +12,10 @@
 #include "Convection.h"
 #include "BEM.h"
 #include "Merge.h"
+#include "CellList.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+#include "Profiler.h"
 
 // versions of the HO solver
 #ifdef HOFORTRAN
@@ -22,6 +26,11 @@
 
 #include <iostream>
 #include <vector>
+#include <deque>
+#include <future>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 //#include <numeric>	// for transform_reduce (C++17)
 
 
@@ -40,7 +49,15 @@ public:
       timeOrder(1),
       numSubsteps(100),
       preconditioner("none"),
-      solverType("fgmres")
+      solverType("fgmres"),
+      dumpslope(0.4868),
+      setslope(false),
+      pipelined(false),
+      lag_order(0),
+      static_geom(false),
+      geom_cached(false),
+      areas_cached(),
+      node_cells_valid(false)
 #ifndef HOFORTRAN
       ,solver()
 #endif
@@ -48,6 +65,9 @@ public:
       //h_nu(0.1)
     {}
 
+  // a solve may still be running on the background threads
+  ~Hybrid() { if (pending.valid()) pending.wait(); }
+
   const bool is_active() const { return active; }
   void set_active(const bool _do_hybrid) { active = _do_hybrid; }
   void activate() { active = true; }
@@ -81,6 +101,15 @@ public:
   void draw_advanced();
 
 private:
+  void send_bcs( const double,
+             const std::array<double,Dimensions>&,
+             std::vector<Collection>&,
+             std::vector<Collection>&,
+             Convection<S,A,I>&,
+             std::vector<HOVolumes<S>>&,
+             const bool);
+  void solve_euler(const double, const double, const float);
+
   // are we even using the hybrid scheme?
   bool active;
   bool initialized;
@@ -92,6 +121,47 @@ private:
   std::string preconditioner;
   std::string solverType;
 
+  // the ray along which the eulerian vorticity is dumped
+  float dumpslope;
+  bool setslope;
+
+  // run the Euler solve for the next step on a background thread while the particles take
+  //   that step, and take its result at the next strength update (part C); its boundary
+  //   conditions are those at the start of that step (lag_order 0), or extrapolated to its
+  //   end from the last lag_order+1 steps' boundary conditions, assuming steps of equal size;
+  //   each region keeps its own history
+  bool pipelined;
+  int lag_order;
+  std::future<void> pending;
+  std::vector<std::deque<std::vector<double>>> openvel_hist, openvort_hist;
+
+  // exchange buffers, kept between steps so that nothing is allocated once they are sized:
+  //   copies of each region's open boundary and solution nodes to find velocities on (and of
+  //   each region's solution nodes alone), and the values in the layouts the solver takes
+  //   (velocities interleaved, all in double)
+  std::vector<Collection> xfer_bdrys, xfer_vols;
+  std::vector<std::vector<Collection>> xfer_soln;
+  std::vector<double> xfer_openvel, xfer_openvort, xfer_solnvort, xfer_eulvort;
+  Vector<S> xfer_circ;
+  void refresh_targets(std::vector<Collection>&, const std::vector<const Points<S>*>&);
+
+  // regions which are fixed, or bound to bodies which are not moving this step, need not be
+  //   moved, nor their nodes recopied or their solution areas asked for again (per region)
+  bool static_geom;
+  bool geom_cached;
+  std::vector<bool> areas_cached;
+  bool is_static(std::vector<HOVolumes<S>>&, const double, const double) const;
+
+  // the particles' vorticity reaches only a few core radii, so the vorticity on the nodes
+  //   needs only the particles near some node, found through a cell list of all the nodes
+  std::array<Vector<S>,Dimensions> node_pos;
+  std::array<S,4> node_box;
+  CellList<S> node_cells;
+  bool node_cells_valid;
+  std::vector<Collection> near_vort;
+  std::vector<char> near_mask;
+  std::vector<Collection>& gather_near(std::vector<Collection>&);
+
   // the HO Solver
 #ifndef HOFORTRAN
   DummySolver::Solver solver;
@@ -197,6 +267,17 @@ void Hybrid<S,A,I>::init(std::vector<HOVolumes<S>>& _euler) {
 //
 template <class S, class A, class I>
 void Hybrid<S,A,I>::reset() {
+  // the solver must be idle before it is cleared
+  if (pending.valid()) pending.get();
+  openvel_hist.clear();
+  openvort_hist.clear();
+  xfer_bdrys.clear();
+  xfer_vols.clear();
+  xfer_soln.clear();
+  geom_cached = false;
+  areas_cached.clear();
+  node_cells_valid = false;
+  near_vort.clear();
   initialized = false;
 
 #ifdef HOFORTRAN
@@ -221,92 +302,11 @@ void Hybrid<S,A,I>::first_step(const double                   _time,
   if (not active) return;
   if (not initialized) init(_euler);
 
-  std::cout << "Inside Hybrid::first_step at t=" << _time << std::endl;
+  LOG_INFO("Inside Hybrid::first_step at t=" << _time);
+  static_geom = is_static(_euler, _time, 0.0);
 
-  //
-  // solve for velocity at each open-boundary solution node
-  //
-
-  // make a list of euler boundary regions
-  std::vector<Collection> euler_bdrys;
-  for (auto &coll : _euler) {
-    // transform to current position
-    coll.move(_time, 0.0, 1.0, coll);
-
-    // isolate open/outer boundaries
-    euler_bdrys.emplace_back(coll.get_bc_nodes(_time));
-  }
-
-  // get vels and vorts on each euler region - and force it
-  _conv.find_vels(_fs, _vort, _bdry, euler_bdrys, velonly, true);
-
-  for (auto &coll : euler_bdrys) {
-    // convert to transferable packet
-    std::array<Vector<S>,Dimensions> openvels = std::visit([=](auto& elem) { return elem.get_vel(); }, coll);
-
-    // convert to a std::vector<double>
-    std::vector<double> packedvels(Dimensions*openvels[0].size());
-    for (size_t d=0; d<Dimensions; ++d) {
-      for (size_t i=0; i<openvels[d].size(); ++i) {
-        packedvels[Dimensions*i+d] = openvels[d][i];
-      }
-    }
-
-    // transfer BC packet to solver
-#ifdef HOFORTRAN
-    (void) setopenvels_d((int32_t)packedvels.size(), packedvels.data());
-#else
-    (void) solver.setopenvels_d(packedvels);
-#endif
-  }
-
-  // get vels and vorts on each euler region - and force it
-  _conv.find_vort(_vort, _bdry, euler_bdrys);
-
-  for (auto &coll : euler_bdrys) {
-    // now prepare the open boundary vorticity values
-    Vector<S> volvort = std::visit([=](auto& elem) { return elem.get_vort(); }, coll);
-    std::vector<double> vorts(volvort.begin(), volvort.end());
-
-    // transfer BC packet to solver
-#ifdef HOFORTRAN
-    (void) setopenvort_d((int32_t)vorts.size(), vorts.data());
-#else
-    // nothing here
-#endif
-  }
-
-  //
-  // now do the same for the vorticity at each solution node
-  //
-
-  // make a list of euler volume regions
-  std::vector<Collection> euler_vols;
-  for (auto &coll : _euler) {
-    // transform to current position
-    coll.move(_time, 0.0, 1.0, coll);
-
-    // grab all of the solution nodes
-    euler_vols.emplace_back(coll.get_vol_nodes(_time));
-  }
-
-  // get vorts on each euler region - and force it
-  _conv.find_vort(_vort, _bdry, euler_vols);
-
-  for (auto &coll : euler_vols) {
-    // convert to transferable packet
-    Vector<S> volvort = std::visit([=](auto& elem) { return elem.get_vort(); }, coll);
-
-    // convert to a std::vector<double>
-    std::vector<double> vorts(volvort.begin(), volvort.end());
-
-    // transfer BC packet to solver
-#ifdef HOFORTRAN
-    (void) setsolnvort_d((int32_t)vorts.size(), vorts.data());
-#else
-    (void) solver.setsolnvort_d(vorts);
-#endif
-  }
+  // velocities and vorticity on the open boundary and vorticity on the solution nodes
+  send_bcs(_time, _fs, _vort, _bdry, _conv, _euler, false);
 
   //
   // finally, send the grid-to-particle weights to the solver
@@ -327,7 +327,7 @@ void Hybrid<S,A,I>::first_step(const double                   _time,
 #ifdef HOFORTRAN
     (void) setptogweights_d((int32_t)ptog_d.size(), ptog_d.data());
 #else
-    (void) solver.setsolnvort_d(ptog_d);
+    (void) solver.setptogweights_d(ptog_d);
 #endif
   }
   }
@@ -351,127 +351,41 @@ void Hybrid<S,A,I>::step(const double                         _time,
 
   if (not active) return;
   if (not initialized) init(_euler);
+  PROFILE_ZONE("hybrid");
 
-  std::cout << "Inside Hybrid::step at t=" << _time << " and dt=" << _dt << std::endl;
+  LOG_INFO("Inside Hybrid::step at t=" << _time << " and dt=" << _dt);
+  static_geom = is_static(_euler, _time, _dt);
+  if (not static_geom) {
+    geom_cached = false;
+    areas_cached.assign(areas_cached.size(), false);
+  }
 
   const bool dumpray = true;
-  static float dumpslope = 0.4868;
-  static bool setslope = false;
 
   //
   // part A - prepare BCs for Euler solver
   //
 
   // update the BEM solution
-  solve_bem<S,A,I>(_time, _fs, _vort, _bdry, _bem);
-
-  // make a list of euler boundary regions
-  std::vector<Collection> euler_bdrys;
-  for (auto &coll : _euler) {
-    // transform to current position
-    coll.move(_time, 0.0, 1.0, coll);
-
-    // isolate open/outer boundaries
-    euler_bdrys.emplace_back(coll.get_bc_nodes(_time));
-  }
-
-  // get vels on each euler region - and force it
-  _conv.find_vels(_fs, _vort, _bdry, euler_bdrys, velonly, true);
-
-  for (auto &coll : euler_bdrys) {
-    // convert to transferable packet
-    std::array<Vector<S>,Dimensions> openvels = std::visit([=](auto& elem) { return elem.get_vel(); }, coll);
-
-    // convert to a std::vector<double>
-    std::vector<double> packedvels(Dimensions*openvels[0].size());
-    for (size_t d=0; d<Dimensions; ++d) {
-      for (size_t i=0; i<openvels[d].size(); ++i) {
-        packedvels[Dimensions*i+d] = openvels[d][i];
-      }
-    }
-
-    // transfer BC packet to solver
-#ifdef HOFORTRAN
-    (void) setopenvels_d((int32_t)packedvels.size(), packedvels.data());
-#else
-    (void) solver.setopenvels_d(packedvels);
-#endif
-  }
-
-  // get vorts on each euler region
-  _conv.find_vort(_vort, _bdry, euler_bdrys);
-
-  for (auto &coll : euler_bdrys) {
-    // now prepare the open boundary vorticity values
-    Vector<S> volvort = std::visit([=](auto& elem) { return elem.get_vort(); }, coll);
-    std::vector<double> vorts(volvort.begin(), volvort.end());
-
-    // transfer BC packet to solver
-#ifdef HOFORTRAN
-    (void) setopenvort_d((int32_t)vorts.size(), vorts.data());
-#else
-    // nothing here
-#endif
-  }
-
-  // and get vorts on the solution nodes of each euler region
-
-  // make a list of euler volume regions
-  std::vector<Collection> euler_vols;
-  for (auto &coll : _euler) {
-    // transform to current position
-    coll.move(_time, 0.0, 1.0, coll);
-
-    // grab all of the solution nodes
-    euler_vols.emplace_back(coll.get_vol_nodes(_time));
-  }
-
-  // get vorts on each euler region - and force it
-  _conv.find_vort(_vort, _bdry, euler_vols);
-
-  for (auto &coll : euler_vols) {
-    // convert to transferable packet
-    Vector<S> volvort = std::visit([=](auto& elem) { return elem.get_vort(); }, coll);
-
-    // convert to a std::vector<double>
-    std::vector<double> vorts(volvort.begin(), volvort.end());
-
-    // transfer BC packet to solver
-#ifdef HOFORTRAN
-    (void) setsolnvort_d((int32_t)vorts.size(), vorts.data());
-#else
-    (void) solver.setsolnvort_d(vorts);
-#endif
-  }
+  solve_bem<S,A,I>(_time, _fs, _vort, _bdry, _bem, _conv.get_env());
 
   //
-  // part B - call Euler solver
+  // part B - call Euler solver, or take the result of the one which ran beside this step
   //
 
-  // call solver - solves all Euler volumes at once?
-#ifdef HOFORTRAN
-  (void) solveto_d((double)_dt, (int32_t)numSubsteps, (int32_t)timeOrder, (double)_re);
-#else
-  (void) solver.solveto_d((double)_time, (int32_t)numSubsteps, (int32_t)timeOrder, (double)_re);
-#endif
-
-  // pull results from external solver (assume just one for now)
-  //for (auto &coll : _euler) {
-  //  std::vector<double> allvorts = solver.getallvorts_d();
-  //  assert(allvorts.size() == coll.get_vol_nodes(_time).get_n() && "ERROR (Hybrid::step) vorticity from solver is not the right size");
-
-    // assign to the HOVolume
-  //  coll.set_soln_vort(allvorts);
-  //}
-
-  // convert vorticity results to drawable and writable Volume elements (OpenGL stuff) - later
-
+  if (pending.valid()) {
+    PROFILE_ZONE("euler wait");
+    pending.get();
+  } else {
+    send_bcs(_time, _fs, _vort, _bdry, _conv, _euler, false);
+    solve_euler(_time, _dt, _re);
+  }
 
   //
   // part C - update particle strengths accordionly
   //
 
-  std::cout << "Inside Hybrid::step updating particle strengths" << std::endl;
+  LOG_INFO("Inside Hybrid::step updating particle strengths");
 
   // here's one way to do it:
   // identify all free vortex particles inside of euler regions and remove them
@@ -482,18 +396,21 @@ void Hybrid<S,A,I>::step(const double                         _time,
   // don't remove any existing particles, just add new ones over the old ones
   //   and let merge take care of the extra density - this is what we do here:
 
-  for (auto &coll : _euler) {
+  xfer_soln.resize(_euler.size());
+  areas_cached.resize(_euler.size(), false);
+  for (size_t ir=0; ir<_euler.size(); ++ir) {
+    HOVolumes<S>& coll = _euler[ir];
 
     Points<S>& solnpts = coll.get_vol_nodes(_time);
     const size_t thisn = solnpts.get_n();
 
     // pull results from external solver (assume just one for now)
-    std::vector<double> eulvort;
+    std::vector<double>& eulvort = xfer_eulvort;
 #ifdef HOFORTRAN
     {
       // again, since fortran is dumb, we need extra steps
       int32_t solnptlen = getsolnptlen() / 2;
-      std::cout << "There are " << solnptlen << " solution nodes" << std::endl;
+      LOG_DEBUG("There are " << solnptlen << " solution nodes");
       eulvort.resize(solnptlen);
       (void) getallvorts_d(solnptlen, eulvort.data());
       //std::cout << "  vort 2014 from solver " << eulvort[2013] << std::endl;
@@ -501,7 +418,7 @@ void Hybrid<S,A,I>::step(const double                         _time,
       //std::cout << "               more " << eulvort[3] << " " << eulvort[4] << " " << eulvort[5] << std::endl;
     }
 #else
-    eulvort = solver.getallvorts_d();
+    solver.getallvorts_d(eulvort);
 #endif
     assert(eulvort.size() == thisn && "ERROR (Hybrid::step) vorticity from solver is not the right size");
 
@@ -531,11 +448,11 @@ void Hybrid<S,A,I>::step(const double                         _time,
     }
 
     // find the Lagrangian-computed vorticity on all solution nodes (make a vector of one collection)
-    std::vector<Collection> euler_vols;
-    euler_vols.emplace_back(solnpts);	// this is a COPY
+    if (not (static_geom and xfer_soln[ir].size() == 1)) refresh_targets(xfer_soln[ir], {&solnpts});
+    std::vector<Collection>& euler_vols = xfer_soln[ir];
     //_conv.find_vels(_fs, _vort, _bdry, euler_vols, velandvort, true);
-    _conv.find_vort(_vort, _bdry, euler_vols);
-    Points<float>& solvedpts = std::get<Points<S>>(euler_vols[0]);
+    _conv.find_vort(gather_near(_vort), _bdry, euler_vols);
+    Points<S>& solvedpts = std::get<Points<S>>(euler_vols[0]);
     Vector<S>& lagvort = solvedpts.get_vort();
     assert(lagvort.size() == thisn && "ERROR (Hybrid::step) vorticity from particle sim is not the right size");
 
@@ -554,7 +471,7 @@ void Hybrid<S,A,I>::step(const double                         _time,
     // find the initial vorticity error/deficit
     // subtract the Lagrangian-computed vort from the actual Eulerian vort on those nodes
     // now we have the amount of vorticity we need to re-add to the Lagrangian side
-    Vector<S> circ;
+    Vector<S>& circ = xfer_circ;
     circ.resize(thisn);
     // computes eulvort - lagvort = circ
     std::transform(eulvort.begin(), eulvort.end(),
@@ -566,7 +483,10 @@ void Hybrid<S,A,I>::step(const double                         _time,
     // uses a mask for the solution nodes (elements here!) to indicate which we will consider,
     // and which are too close to the wall (and thus too thin) to require correction
     // use one full vdelta for this (input _vd)
-    (void) coll.set_soln_areas();
+    if (not (static_geom and areas_cached[ir])) {
+      (void) coll.set_soln_areas();
+      areas_cached[ir] = static_geom;
+    }
     const Vector<S>& area = coll.get_soln_area();
     assert(area.size() == thisn && "ERROR (Hybrid::step) volume area vector is not the right size");
 
@@ -618,11 +538,11 @@ void Hybrid<S,A,I>::step(const double                         _time,
     double thiserror = 0.0;
     for (size_t i=0; i<thisn; ++i) { thiserror += std::fabs(circ[i]); }
     thiserror /= totalcircmag;
-    std::cout << "  initial error " << thiserror << std::endl;
+    LOG_DEBUG("  initial error " << thiserror);
 
     // there must be an original set of vortex particles
-    assert(std::holds_alternative<Points<float>>(_vort[0]) && "ERROR: _vort[0] is not Points");
-    Points<float>& lag_vorts = std::get<Points<S>>(_vort[0]);
+    assert(std::holds_alternative<Points<S>>(_vort[0]) && "ERROR: _vort[0] is not Points");
+    Points<S>& lag_vorts = std::get<Points<S>>(_vort[0]);
 
     // during iterations, only generate particles with sufficient strength
     const S circ_thresh = 1.e-4 * lag_vorts.get_averaged_max_str();
@@ -652,7 +572,7 @@ void Hybrid<S,A,I>::step(const double                         _time,
 
       // find the new Lagrangian vorticity on the solution nodes
       // and the new vorticity error/deficit
-      _conv.find_vort(_vort, _bdry, euler_vols);
+      _conv.find_vort(gather_near(_vort), _bdry, euler_vols);
 
       // convert the new vort to a new circ
       std::transform(eulvort.begin(), eulvort.end(),
@@ -694,7 +614,7 @@ void Hybrid<S,A,I>::step(const double                         _time,
       thiserror = 0.0;
       for (size_t i=0; i<thisn; ++i) { thiserror += std::fabs(circ[i]); }
       thiserror /= totalcircmag;
-      std::cout << "  iter " << (iter+1) << " has error " << thiserror << std::endl;
+      LOG_DEBUG("  iter " << (iter+1) << " has error " << thiserror);
 
       // are we adding 0 particles?
       if (newparts.nelem == 0) iter = maxiter;
@@ -755,9 +675,288 @@ void Hybrid<S,A,I>::step(const double                         _time,
 
   }
 
+  //
+  // pipelined: send the next step's boundary conditions now, and solve while it runs
+  //
+  if (pipelined) {
+    // the strength update added particles
+    solve_bem<S,A,I>(_time, _fs, _vort, _bdry, _bem, _conv.get_env());
+    send_bcs(_time, _fs, _vort, _bdry, _conv, _euler, true);
+    pending = ThreadPool::background().submit([this, _time, _dt, _re]() {
+      PROFILE_ZONE("euler solve");
+      solve_euler(_time+_dt, _dt, _re);
+    });
+  }
+
   // done!!!
 }
 
+//
+// Send the open boundary velocities and vorticity and the solution node vorticity, as seen
+//   from the particles, to the external solver; with _predict, replace the boundary values
+//   with their extrapolation one step ahead, see pipelined
+//
+template <class S, class A, class I>
+void Hybrid<S,A,I>::send_bcs(const double                   _time,
+                         const std::array<double,Dimensions>& _fs,
+                         std::vector<Collection>&             _vort,
+                         std::vector<Collection>&             _bdry,
+                         Convection<S,A,I>&                   _conv,
+                         std::vector<HOVolumes<S>>&           _euler,
+                         const bool                           _predict) {
+
+  // extrapolate from the history of one quantity, after adding the current values to it;
+  //   the oldest entry's storage is reused for the newest
+  auto predict = [this](std::deque<std::vector<double>>& _hist, std::vector<double>& _vals) {
+    if (lag_order == 0) return;
+    if (_hist.size() == (size_t)lag_order+1) {
+      std::vector<double> oldest = std::move(_hist.back());
+      _hist.pop_back();
+      oldest.assign(_vals.begin(), _vals.end());
+      _hist.push_front(std::move(oldest));
+    } else {
+      _hist.push_front(_vals);
+    }
+    if (_hist.size() < (size_t)lag_order+1) return;
+    for (const auto& h : _hist) if (h.size() != _vals.size()) return;
+    for (size_t i=0; i<_vals.size(); ++i) {
+      if (lag_order == 1) _vals[i] = 2.0*_hist[0][i] - _hist[1][i];
+      else _vals[i] = 3.0*_hist[0][i] - 3.0*_hist[1][i] + _hist[2][i];
+    }
+  };
+
+  // transform to current position, and refresh the copies of the open and solution nodes
+  if (not (static_geom and geom_cached)) {
+    std::vector<const Points<S>*> bcs, vols;
+    for (auto &coll : _euler) {
+      coll.move(_time, 0.0, 1.0, coll);
+      bcs.push_back(&coll.get_bc_nodes(_time));
+      vols.push_back(&coll.get_vol_nodes(_time));
+    }
+    refresh_targets(xfer_bdrys, bcs);
+    refresh_targets(xfer_vols, vols);
+    geom_cached = static_geom;
+
+    // and every node, for finding nearby particles
+    for (size_t d=0; d<Dimensions; ++d) node_pos[d].clear();
+    for (const auto* nodes : {&bcs, &vols}) {
+      for (const auto* p : *nodes) {
+        for (size_t d=0; d<Dimensions; ++d) {
+          node_pos[d].insert(node_pos[d].end(), p->get_pos()[d].begin(), p->get_pos()[d].end());
+        }
+      }
+    }
+    node_cells_valid = false;
+  }
+
+  // only the particles near the nodes affect their vorticity
+  std::vector<Collection>& near = gather_near(_vort);
+
+  //
+  // solve for velocity at each open-boundary solution node
+  //
+
+  // get vels and vorts on each euler region - and force it
+  _conv.find_vels(_fs, _vort, _bdry, xfer_bdrys, velonly, true);
+
+  openvel_hist.resize(xfer_bdrys.size());
+  openvort_hist.resize(xfer_bdrys.size());
+  for (size_t ir=0; ir<xfer_bdrys.size(); ++ir) {
+    const std::array<Vector<S>,Dimensions>& openvels = std::get<Points<S>>(xfer_bdrys[ir]).get_vel();
+
+    // interleave into the transfer buffer
+    xfer_openvel.resize(Dimensions*openvels[0].size());
+    for (size_t d=0; d<Dimensions; ++d) {
+      for (size_t i=0; i<openvels[d].size(); ++i) {
+        xfer_openvel[Dimensions*i+d] = openvels[d][i];
+      }
+    }
+    if (_predict) predict(openvel_hist[ir], xfer_openvel);
+
+    // transfer BC packet to solver
+#ifdef HOFORTRAN
+    (void) setopenvels_d((int32_t)xfer_openvel.size(), xfer_openvel.data());
+#else
+    (void) solver.setopenvels_d(xfer_openvel);
+#endif
+  }
+
+  // get vels and vorts on each euler region - and force it
+  _conv.find_vort(near, _bdry, xfer_bdrys);
+
+  for (size_t ir=0; ir<xfer_bdrys.size(); ++ir) {
+    // now prepare the open boundary vorticity values
+    const Vector<S>& openvort = std::get<Points<S>>(xfer_bdrys[ir]).get_vort();
+    xfer_openvort.assign(openvort.begin(), openvort.end());
+    if (_predict) predict(openvort_hist[ir], xfer_openvort);
+
+    // transfer BC packet to solver
+#ifdef HOFORTRAN
+    (void) setopenvort_d((int32_t)xfer_openvort.size(), xfer_openvort.data());
+#else
+    (void) solver.setopenvort_d(xfer_openvort);
+#endif
+  }
+
+  //
+  // now do the same for the vorticity at each solution node
+  //
+
+  // get vorts on each euler region - and force it
+  _conv.find_vort(near, _bdry, xfer_vols);
+
+  for (auto &coll : xfer_vols) {
+    const Vector<S>& volvort = std::get<Points<S>>(coll).get_vort();
+    xfer_solnvort.assign(volvort.begin(), volvort.end());
+
+    // transfer BC packet to solver
+#ifdef HOFORTRAN
+    (void) setsolnvort_d((int32_t)xfer_solnvort.size(), xfer_solnvort.data());
+#else
+    (void) solver.setsolnvort_d(xfer_solnvort);
+#endif
+  }
+}
+
+//
+// Whether no region moves between _time and _time+_dt
+//
+template <class S, class A, class I>
+bool Hybrid<S,A,I>::is_static(std::vector<HOVolumes<S>>& _euler, const double _time, const double _dt) const {
+  for (auto &coll : _euler) {
+    const move_t mt = coll.get_movet();
+    if (mt == fixed) continue;
+    if (mt == lagrangian) return false;
+    std::shared_ptr<Body> bp = coll.get_body_ptr();
+    if (not bp) continue;
+    const auto v0 = bp->get_vel(_time);
+    const auto v1 = bp->get_vel(_time+_dt);
+    if (std::abs(v0[0]) + std::abs(v0[1]) + std::abs(bp->get_rotvel(_time)) +
+        std::abs(v1[0]) + std::abs(v1[1]) + std::abs(bp->get_rotvel(_time+_dt)) >
+        std::numeric_limits<float>::epsilon()) return false;
+  }
+  return true;
+}
+
+//
+// Copy into near_vort those particles within the vorticity kernel's reach of any node: the
+//   kernel is a Gaussian, cut off at four core radii (a factor of exp(-16)); a cheap box test
+//   against all the nodes comes first, then the cell list settles it
+//
+// near_vort keeps one Points per particle collection, resized in place each step, so its
+//   arrays are allocated only when a collection grows; any other kind of vorticity source
+//   can't be culled this way, so then all of _vort is used
+//
+template <class S, class A, class I>
+std::vector<Collection>& Hybrid<S,A,I>::gather_near(std::vector<Collection>& _vort) {
+
+  PROFILE_ZONE("gather near");
+
+  S maxrad = 0.0;
+  for (auto &coll : _vort) {
+    if (not std::holds_alternative<Points<S>>(coll)) {
+      LOG_DEBUG("  vorticity includes non-particle sources, using all of it on the Euler regions");
+      return _vort;
+    }
+    const Vector<S>& r = std::get<Points<S>>(coll).get_rad();
+    if (not r.empty()) maxrad = std::max(maxrad, *std::max_element(r.begin(), r.end()));
+  }
+  const S cutoff = (S)4.0 * maxrad;
+  if (cutoff <= 0.0 or node_pos[0].empty()) return _vort;
+
+  if (not node_cells_valid or node_cells.get_cell_size() != cutoff) {
+    node_cells.build(node_pos, cutoff);
+    node_box = {*std::min_element(node_pos[0].begin(), node_pos[0].end()) - cutoff,
+                *std::max_element(node_pos[0].begin(), node_pos[0].end()) + cutoff,
+                *std::min_element(node_pos[1].begin(), node_pos[1].end()) - cutoff,
+                *std::max_element(node_pos[1].begin(), node_pos[1].end()) + cutoff};
+    node_cells_valid = true;
+  }
+  const S cutsq = cutoff*cutoff;
+
+  // one slot per particle collection, made on the first call only
+  while (near_vort.size() > _vort.size()) near_vort.pop_back();
+  while (near_vort.size() < _vort.size()) {
+    ElementPacket<S> packet(std::vector<S>(), std::vector<Int>(), std::vector<S>(), 0, 0);
+    near_vort.emplace_back(Points<S>(packet, elem_t::active, lagrangian, nullptr, 0.0));
+  }
+
+  size_t ntotal = 0, nnear = 0;
+  for (size_t c=0; c<_vort.size(); ++c) {
+    const Points<S>& pts = std::get<Points<S>>(_vort[c]);
+    const std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+    const size_t n = pts.get_n();
+    ntotal += n;
+
+    near_mask.resize(n);
+    #pragma omp parallel for schedule(dynamic,1024)
+    for (int32_t i=0; i<(int32_t)n; ++i) {
+      const S px = x[0][i];
+      const S py = x[1][i];
+      near_mask[i] = 0;
+      if (px < node_box[0] or px > node_box[1] or py < node_box[2] or py > node_box[3]) continue;
+      bool found = false;
+      node_cells.for_each_in_box(px-cutoff, px+cutoff, py-cutoff, py+cutoff, [&](const int32_t j) {
+        if (not found and std::pow(node_pos[0][j]-px, 2) + std::pow(node_pos[1][j]-py, 2) < cutsq) found = true;
+      });
+      near_mask[i] = found ? 1 : 0;
+    }
+
+    // resizing to fewer keeps the capacity
+    const size_t nn = (size_t)std::count(near_mask.begin(), near_mask.end(), 1);
+    Points<S>& near = std::get<Points<S>>(near_vort[c]);
+    near.resize(nn);
+    std::array<Vector<S>,Dimensions>& nx = near.get_pos();
+    Vector<S>& ns = near.get_str();
+    Vector<S>& nr = near.get_rad();
+    size_t k = 0;
+    for (size_t i=0; i<n; ++i) if (near_mask[i]) {
+      for (size_t d=0; d<Dimensions; ++d) nx[d][k] = x[d][i];
+      ns[k] = pts.get_str()[i];
+      nr[k] = pts.get_rad()[i];
+      ++k;
+    }
+    nnear += nn;
+  }
+
+  LOG_DEBUG("  " << nnear << " of " << ntotal << " particles are near the Euler regions");
+  return near_vort;
+}
+
+//
+// Make the targets copies of the given nodes: when they already hold Points, the copy
+//   assignment reuses their arrays, so only the first call or a change in size allocates
+//
+template <class S, class A, class I>
+void Hybrid<S,A,I>::refresh_targets(std::vector<Collection>&             _targs,
+                                    const std::vector<const Points<S>*>& _nodes) {
+  if (_targs.size() != _nodes.size()) {
+    _targs.clear();
+    for (const auto* n : _nodes) _targs.emplace_back(*n);
+    return;
+  }
+  for (size_t i=0; i<_nodes.size(); ++i) {
+    if (std::holds_alternative<Points<S>>(_targs[i])) std::get<Points<S>>(_targs[i]) = *_nodes[i];
+    else _targs[i] = *_nodes[i];
+  }
+}
+
+//
+// Advance the external solver over one step
+//
+template <class S, class A, class I>
+void Hybrid<S,A,I>::solve_euler(const double _time, const double _dt, const float _re) {
+
+  // call solver - solves all Euler volumes at once?
+#ifdef HOFORTRAN
+  (void) _time;
+  (void) solveto_d((double)_dt, (int32_t)numSubsteps, (int32_t)timeOrder, (double)_re);
+#else
+  (void) _dt;
+  (void) solver.solveto_d((double)_time, (int32_t)numSubsteps, (int32_t)timeOrder, (double)_re);
+#endif
+}
+
 //
 // read/write parameters to json
 //
@@ -774,6 +973,8 @@ void Hybrid<S,A,I>::from_json(const nlohmann::json simj) {
     numSubsteps = j.value("numSubsteps", 100);
     preconditioner = j.value("preconditioner", "none");
     solverType = j.value("solverType", "fgmres");
+    pipelined = j.value("pipelined", false);
+    lag_order = std::min(2, std::max(0, j.value("lagOrder", 0)));
   }
 }
 
@@ -787,6 +988,10 @@ void Hybrid<S,A,I>::add_to_json(nlohmann::json& simj) const {
   j["numSubsteps"] = numSubsteps; //1-1000
   j["preconditioner"] = preconditioner;
   j["solverType"] = solverType;
+  if (pipelined) {
+    j["pipelined"] = true;
+    j["lagOrder"] = lag_order;
+  }
 
   simj["hybrid"] = j;
 }
@@ -813,6 +1018,11 @@ void Hybrid<S,A,I>::draw_advanced() {
   ImGui::SliderInt("Element Order", &elementOrder, 1, 5);
   ImGui::SliderInt("Time Order", &timeOrder, 1, 4);
 
+  ImGui::Checkbox("Solve beside the particles", &pipelined);
+  ImGui::SameLine();
+  ShowHelpMarker("Run the grid solve for the next step while the particles take it, using the boundary conditions from the start of the step, or extrapolated to its end.");
+  if (pipelined) ImGui::SliderInt("Boundary extrapolation order", &lag_order, 0, 2);
+
   /*
   const int numTimeOrders = 3;
   static int timeI = 0;
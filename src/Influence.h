@@ -9,23 +9,69 @@
 
 #include "Omega2D.h"
 #include "VectorHelper.h"
+#include "Precision.h"
 #include "Kernels.h"
 #include "Points.h"
 #include "Surfaces.h"
 #include "ResultsType.h"
 #include "ExecEnv.h"
+#include "Treecode.h"
+#include "Fmm.h"
+#include "ReduceHelper.h"
+#include "Vic.h"
+#include "Periodic.h"
+#include "Symmetry.h"
+#include "Prune.h"
+#include "Logger.h"
+#include "Profiler.h"
+#include "CpuDispatch.h"
 
 #ifdef EXTERNAL_VEL_SOLVE
 extern "C" float external_vel_solver_f_(int*, const float*, const float*, const float*, const float*,
                                         int*, const float*, const float*, float*, float*);
 extern "C" float external_vel_solver_d_(int*, const double*, const double*, const double*, const double*,
                                         int*, const double*, const double*, double*, double*);
+
+// every particle source and point target of one velocity evaluation in one call: the counts
+//   of sources and targets, then arrays of pointers into each collection's own arrays, so
+//   nothing is copied, with null target radii for field points; adds to the target
+//   velocities; these are weak where we can say so,
+//   and a library without them gets one call per pair through the functions above
+#if defined(__GNUC__)
+  #define EXTERNAL_WEAK __attribute__((weak))
+#else
+  #define EXTERNAL_WEAK
+#endif
+extern "C" float external_vel_solver_batch_f_(int*, const int*, const float* const*, const float* const*,
+                                              const float* const*, const float* const*,
+                                              int*, const int*, const float* const*, const float* const*,
+                                              const float* const*, float* const*, float* const*) EXTERNAL_WEAK;
+extern "C" float external_vel_solver_batch_d_(int*, const int*, const double* const*, const double* const*,
+                                              const double* const*, const double* const*,
+                                              int*, const int*, const double* const*, const double* const*,
+                                              const double* const*, double* const*, double* const*) EXTERNAL_WEAK;
 #endif
 
 #ifdef USE_VC
 #include <Vc/Vc>
 #endif
 
+#ifdef USE_STDSIMD
+#include "SimdHelper.h"
+#endif
+
+#ifdef USE_OGL_COMPUTE
+#include "OglCompute.h"
+#endif
+
+#ifdef USE_CUDA
+#include "CudaCompute.h"
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <iostream>
 #include <vector>
 #include <memory>
@@ -33,17 +79,309 @@ extern "C" float external_vel_solver_d_(int*, const double*, const double*, cons
 #include <chrono>
 #include <cmath>
 #include <cassert>
+#include <array>
+#include <type_traits>
+#include <algorithm>
+#include <utility>
+
+
+//
+// Cache blocking for the direct sums: each thread takes a small block of targets and sweeps it
+//   over blocks of sources small enough to stay in L1, instead of streaming every source past
+//   every target. Each target carries NACC accumulators of type ACC across the source blocks;
+//   _tile(i,jbeg,jend,acc) adds one block of sources to target i, _finish(i,acc) stores it.
+//
+// With _compensated, each block is summed on its own and the block sums are added with
+//   Kahan compensation, so float accumulators keep close to double accuracy on long sums.
+//
+const size_t tile_targets = 64;
+const size_t tile_sources = 1024;
+
+template <class ACC, size_t NACC, class FT, class FF>
+KERNEL_CLONES
+void blocked_direct_sum (const size_t _nt, const size_t _ns, const size_t _sblock,
+                         FT&& _tile, FF&& _finish, const bool _compensated = false) {
+
+  const size_t sblock = std::max((size_t)1, _sblock);
+
+  #pragma omp parallel
+  {
+  PROFILE_ZONE("direct sum");
+  #pragma omp for
+  for (int32_t ib=0; ib<(int32_t)_nt; ib+=(int32_t)tile_targets) {
+    const size_t iend = std::min(_nt, (size_t)ib+tile_targets);
+
+    std::array<std::array<ACC,NACC>,tile_targets> acc;
+    for (auto& thisacc : acc) thisacc.fill(ACC(0));
+
+    if (_compensated) {
+      // running compensation for each accumulator
+      std::array<std::array<ACC,NACC>,tile_targets> comp;
+      for (auto& thiscomp : comp) thiscomp.fill(ACC(0));
+
+      for (size_t jb=0; jb<_ns; jb+=sblock) {
+        const size_t jend = std::min(_ns, jb+sblock);
+        for (size_t i=(size_t)ib; i<iend; ++i) {
+          std::array<ACC,NACC> part;
+          part.fill(ACC(0));
+          _tile(i, jb, jend, part.data());
+          for (size_t k=0; k<NACC; ++k) {
+            const ACC y = part[k] - comp[i-ib][k];
+            const ACC t = acc[i-ib][k] + y;
+            comp[i-ib][k] = (t - acc[i-ib][k]) - y;
+            acc[i-ib][k] = t;
+          }
+        }
+      }
+
+    } else {
+      for (size_t jb=0; jb<_ns; jb+=sblock) {
+        const size_t jend = std::min(_ns, jb+sblock);
+        for (size_t i=(size_t)ib; i<iend; ++i) _tile(i, jb, jend, acc[i-ib].data());
+      }
+    }
+
+    for (size_t i=(size_t)ib; i<iend; ++i) _finish(i, acc[i-ib].data());
+  }
+  } // end omp parallel
+}
+
+
+//
+// Symmetric (mutual) evaluation of a collection of particles on itself: the core function is
+//   symmetric in the two radii, so each pair is computed once and scattered, with opposite
+//   sign for velocity, to both particles. Every thread accumulates into its own buffers, and
+//   those are summed at the end. Each row of pairs is evaluated mutual_chunk sources at a time.
+//
+const size_t mutual_chunk = 256;
+
+template <class S, class A, VelCore C>
+KERNEL_CLONES
+void points_affect_self (Points<S>& pts, const ResultsType& restype) {
+
+  LOG_DEBUG("    0v_0v compute mutual influence of" << pts.to_string() << " on itself");
+  assert (not pts.is_inert() && "Mutual influence needs thick-cored particles");
+
+  auto start = std::chrono::system_clock::now();
+
+  // read-only access keeps the cached source arrays valid
+  const std::array<Vector<S>,Dimensions>& x = std::as_const(pts).get_pos();
+  const Vector<S>&                        r = std::as_const(pts).get_rad();
+  const Vector<S>&                        s = std::as_const(pts).get_str();
+  std::array<Vector<S>,Dimensions>&       u = pts.get_vel();
+
+  const bool do_vort = (restype.get_type() == velandvort);
+  Vector<S>* const w = do_vort ? &pts.get_vort() : nullptr;
+  const size_t n = pts.get_n();
+  const size_t nacc = do_vort ? 3 : 2;
+
+  // one set of accumulators per thread, allocated inside the parallel region
+  std::vector<Vector<A>> threadacc;
+
+  #pragma omp parallel
+  {
+    PROFILE_ZONE("mutual");
+#ifdef _OPENMP
+    const size_t nthreads = omp_get_num_threads();
+    const size_t ithread = omp_get_thread_num();
+#else
+    const size_t nthreads = 1;
+    const size_t ithread = 0;
+#endif
+    #pragma omp single
+    threadacc.resize(nthreads);
+
+    Vector<A>& acc = threadacc[ithread];
+    acc.assign(nacc*n, 0.0);
+    A* const au = acc.data();
+    A* const av = acc.data() + n;
+    A* const aw = acc.data() + (do_vort ? 2*n : 0);
+
+    // rows get shorter as i grows, so hand them out dynamically
+    #pragma omp for schedule(dynamic,64)
+    for (int32_t ii=0; ii<(int32_t)n; ++ii) {
+      const size_t i = ii;
+      const S xi = x[0][i];
+      const S yi = x[1][i];
+      const S ri = r[i];
+      const S si = s[i];
+      A sumu = 0.0;
+      A sumv = 0.0;
+      A sumw = 0.0;
+
+      // the kernel itself is evaluated in vectorizable chunks, then the ordered sums and the
+      //   scatters follow in a second, cheaper pass; both sum in the accumulator type
+      for (size_t jb=i+1; jb<n; jb+=mutual_chunk) {
+        const size_t jn = std::min(mutual_chunk, n-jb);
+        alignas(64) S fu[mutual_chunk];
+        alignas(64) S fv[mutual_chunk];
+        alignas(64) S fw[mutual_chunk];
+
+        if (do_vort) {
+          for (size_t k=0; k<jn; ++k) {
+            const S dx = xi - x[0][jb+k];
+            const S dy = yi - x[1][jb+k];
+            const S distsq = dx*dx + dy*dy;
+            S r2, bbb;
+            (void) core_func<S,C>(distsq, ri, r[jb+k], &r2, &bbb);
+            fu[k] = r2 * dy;
+            fv[k] = r2 * dx;
+            fw[k] = bbb*distsq + S(2.0f)*r2;
+          }
+          A chunku = 0.0;
+          A chunkv = 0.0;
+          A chunkw = 0.0;
+          #pragma omp simd reduction(+:chunku,chunkv,chunkw)
+          for (size_t k=0; k<jn; ++k) {
+            const size_t j = jb+k;
+            chunku -= (A)s[j] * (A)fu[k];
+            chunkv += (A)s[j] * (A)fv[k];
+            chunkw += (A)s[j] * (A)fw[k];
+            au[j] += (A)si * (A)fu[k];
+            av[j] -= (A)si * (A)fv[k];
+            aw[j] += (A)si * (A)fw[k];
+          }
+          sumu += chunku;
+          sumv += chunkv;
+          sumw += chunkw;
+        } else {
+          for (size_t k=0; k<jn; ++k) {
+            const S dx = xi - x[0][jb+k];
+            const S dy = yi - x[1][jb+k];
+            const S r2 = core_func<S,C>(dx*dx + dy*dy, ri, r[jb+k]);
+            fu[k] = r2 * dy;
+            fv[k] = r2 * dx;
+          }
+          A chunku = 0.0;
+          A chunkv = 0.0;
+          #pragma omp simd reduction(+:chunku,chunkv)
+          for (size_t k=0; k<jn; ++k) {
+            const size_t j = jb+k;
+            chunku -= (A)s[j] * (A)fu[k];
+            chunkv += (A)s[j] * (A)fv[k];
+            au[j] += (A)si * (A)fu[k];
+            av[j] -= (A)si * (A)fv[k];
+          }
+          sumu += chunku;
+          sumv += chunkv;
+        }
+      }
+
+      // the self-interaction has no velocity, but does have vorticity
+      if (do_vort) {
+        S r2, bbb;
+        (void) core_func<S,C>(S(0.0f), ri, ri, &r2, &bbb);
+        sumw += (A)si * (A)(S(2.0f) * r2);
+      }
+
+      au[i] += sumu;
+      av[i] += sumv;
+      if (do_vort) aw[i] += sumw;
+    }
+
+    // the implicit barrier above means every thread's accumulators are complete
+    #pragma omp for
+    for (int32_t ii=0; ii<(int32_t)n; ++ii) {
+      A sumu = 0.0;
+      A sumv = 0.0;
+      A sumw = 0.0;
+      for (const auto& thisacc : threadacc) {
+        sumu += thisacc[ii];
+        sumv += thisacc[n+ii];
+        if (do_vort) sumw += thisacc[2*n+ii];
+      }
+      u[0][ii] += sumu;
+      u[1][ii] += sumv;
+      if (do_vort) (*w)[ii] += sumw;
+    }
+  }
+
+  // half as many pairs as the one-sided sum, with two scatters each
+  float flops = 0.5 * (float)n * (float)n;
+  flops *= (do_vort ? 10.0 + (float)flopsuw_0v_0b<S,A,C>() : 6.0 + (float)flopsu_0v_0b<S,A,C>());
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    points_affect_self:\t[" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS("0v_0v", flops, elapsed_seconds.count());
+}
+
+
+//
+// the shape of a batched solver, linked in (EXTERNAL_VEL_SOLVE) or from a plugin (VelPlugin.h)
+//
+template <class S>
+using batch_vel_fn = float (*)(int*, const int*, const S* const*, const S* const*, const S* const*, const S* const*,
+                               int*, const int*, const S* const*, const S* const*, const S* const*, S* const*, S* const*);
+
+#ifdef EXTERNAL_VEL_SOLVE
+// the linked-in one, or nullptr if the library has none
+template <class S>
+batch_vel_fn<S> external_batch_solver () {
+  if constexpr (std::is_same<S,float>::value) return external_vel_solver_batch_f_;
+  else return external_vel_solver_batch_d_;
+}
+#endif
+
+//
+// All particle collections affecting all point targets in one call to a batched solver,
+//   so it can build its tree or upload to the device once; the targets' velocities must be
+//   zeroed already
+//
+template <class S>
+void batch_points_affect_points (const batch_vel_fn<S>               solver,
+                                 const std::vector<const Points<S>*>& _srcs,
+                                 const std::vector<Points<S>*>&       _targs) {
+
+  if (_srcs.empty() or _targs.empty()) return;
 
+  auto start = std::chrono::system_clock::now();
+
+  std::vector<int> ns, nt;
+  std::vector<const S*> sx, sy, ss, sr, tx, ty, tr;
+  std::vector<S*> tu, tv;
+  for (const auto* src : _srcs) {
+    ns.push_back((int)src->get_n());
+    sx.push_back(src->get_pos()[0].data());
+    sy.push_back(src->get_pos()[1].data());
+    ss.push_back(src->get_str().data());
+    sr.push_back(src->get_rad().data());
+  }
+  for (auto* targ : _targs) {
+    nt.push_back((int)targ->get_n());
+    // read-only access, as a target may also be a source
+    tx.push_back(std::as_const(*targ).get_pos()[0].data());
+    ty.push_back(std::as_const(*targ).get_pos()[1].data());
+    tr.push_back(targ->is_inert() ? nullptr : std::as_const(*targ).get_rad().data());
+    tu.push_back(targ->get_vel()[0].data());
+    tv.push_back(targ->get_vel()[1].data());
+  }
+  int nsrcs = (int)_srcs.size();
+  int ntargs = (int)_targs.size();
+  LOG_DEBUG("    batched influence of " << nsrcs << " particle collections on " << ntargs << " targets");
+
+  const float flops = solver(&nsrcs,  ns.data(), sx.data(), sy.data(), ss.data(), sr.data(),
+                             &ntargs, nt.data(), tx.data(), ty.data(), tr.data(), tu.data(), tv.data());
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    batch_points_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS("0v_0v", flops, elapsed_seconds.count());
+}
+
+
+template <class S, class A, VelCore C>
+void points_affect_points_mirror (const Points<S>&, Points<S>&, const ResultsType&, const ExecEnv&);
 
 //
 // Vc and x86 versions of Points/Particles affecting Points/Particles
 //
-template <class S, class A>
-void points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+template <class S, class A, VelCore C>
+void points_affect_points_core (const Points<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env,
+                                const bool _images) {
 
-  std::cout << "    in ptpt with" << env.to_string() << std::endl;
+  LOG_DEBUG("    in ptpt with" << env.to_string());
   assert (!restype.compute_psi() && "Point elements cannot compute streamfunction yet.");
-  assert (!restype.compute_grad() && "Point elements cannot compute velocity gradients yet.");
 
   auto start = std::chrono::system_clock::now();
   float flops = (float)targ.get_n();
@@ -53,44 +391,108 @@ void points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsT
   const Vector<S>&                        sr = src.get_rad();
   const Vector<S>&                        ss = src.get_str();
 
-  const std::array<Vector<S>,Dimensions>& tx = targ.get_pos();
+  // read-only access to targ, which may be src, keeps its cached source arrays valid
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
   std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
 
+  // a periodic domain sums every image in closed form, see Periodic.h
+  if (env.get_periodic_domain().active()) {
+    points_affect_points_periodic<S,A,C>(src, targ, restype, env);
+    return;
+  }
+
+  // and a symmetry plane adds the images of the sources, see Symmetry.h
+  if (_images and env.get_symmetry_plane().active()) {
+    points_affect_points_mirror<S,A,C>(src, targ, restype, env);
+    return;
+  }
+
 #ifdef EXTERNAL_VEL_SOLVE
-  if (not env.is_internal()) {
-    std::cout << "    external influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  if (not env.is_internal() and not restype.compute_grad()) {
+    LOG_DEBUG("    external influence of" << src.to_string() << " on" << targ.to_string());
     int ns = src.get_n();
     int nt = targ.get_n();
 
     if (restype.compute_vel()) {
-    flops = external_vel_solver_f_(&ns, sx[0].data(), sx[1].data(),    ss.data(),    sr.data(), 
-                                   &nt, tx[0].data(), tx[1].data(), tu[0].data(), tu[1].data());
+      if constexpr (std::is_same<S,float>::value) {
+        flops = external_vel_solver_f_(&ns, sx[0].data(), sx[1].data(),    ss.data(),    sr.data(),
+                                       &nt, tx[0].data(), tx[1].data(), tu[0].data(), tu[1].data());
+      } else {
+        flops = external_vel_solver_d_(&ns, sx[0].data(), sx[1].data(),    ss.data(),    sr.data(),
+                                       &nt, tx[0].data(), tx[1].data(), tu[0].data(), tu[1].data());
+      }
     }
 
     auto end = std::chrono::system_clock::now();
     std::chrono::duration<double> elapsed_seconds = end-start;
-    const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-    printf("    points_affect_points: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+    LOG_DEBUG("    points_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+    PROFILE_FLOPS((targ.is_inert() ? "0v_0p" : "0v_0v"), flops, elapsed_seconds.count());
 
     return;
   }
 #endif  // no external fast solve, perform internal calculations below
 
 #ifdef USE_OGL_COMPUTE
-  if (env.get_instrs() == gpu_opengl) {
+  if (env.get_instrs() == gpu_opengl and env.get_summation() == direct) {
+    if (OglCompute::get().points_affect_points<S>(src, targ, restype, C)) {
+      flops *= 2.0 + (float)flopsuw_0v_0b<S,A,C>() * (float)src.get_n();
+      auto end = std::chrono::system_clock::now();
+      std::chrono::duration<double> elapsed_seconds = end-start;
+      LOG_DEBUG("    points_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+      PROFILE_FLOPS((targ.is_inert() ? "0v_0p" : "0v_0v"), flops, elapsed_seconds.count());
+      return;
+    }
+    LOG_DEBUG("    no OpenGL compute context, running on the cpu");
   }
 #endif  // no internal opengl solve, perform internal CPU calc below
+#ifdef USE_CUDA
+  if (env.get_instrs() == gpu_cuda and env.get_summation() == direct) {
+    if (cuda_points_affect_points<S>(src, targ, restype, C)) {
+      flops *= 2.0 + (float)flopsuw_0v_0b<S,A,C>() * (float)src.get_n();
+      auto end = std::chrono::system_clock::now();
+      std::chrono::duration<double> elapsed_seconds = end-start;
+      LOG_DEBUG("    points_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+      PROFILE_FLOPS((targ.is_inert() ? "0v_0p" : "0v_0v"), flops, elapsed_seconds.count());
+      return;
+    }
+    LOG_DEBUG("    no GPU device, running on the cpu");
+  }
+#endif  // no internal cuda solve, perform internal CPU calc below
+
+  // a treecode or fmm only pays off when there are many more sources than fit in one leaf
+  if (env.get_summation() == barneshut and src.get_n() > 4*env.get_leaf_size()) {
+    points_affect_points_treecode<S,A,C>(src, targ, restype, env);
+    return;
+  }
+  if (env.get_summation() == fmm and src.get_n() > 4*env.get_leaf_size()) {
+    points_affect_points_fmm<S,A>(src, targ, restype, env);
+    return;
+  }
+  if (env.get_summation() == vic and src.get_n() > 4*env.get_leaf_size()) {
+    points_affect_points_vic<S,A,C>(src, targ, restype, env);
+    return;
+  }
+
+  // particles acting on themselves only need half of the pairs, but the sums depend on the threads
+  if (&src == &targ and not targ.is_inert() and env.get_instrs() == cpu_x86 and
+      not reproducible_sums() and
+      not env.use_compensated_sums() and
+      (restype.get_type() == velonly or restype.get_type() == velandvort)) {
+    points_affect_self<S,A,C>(targ, restype);
+    return;
+  }
 
   // We need 4 different loops here, for the options:
   //   target radii or no target radii
   //   Vc or no Vc
+  // and each one runs over cache-sized tiles of targets and sources
 
 
   //
   // targets are field points, with no core radius ===============================================
   //
   if (targ.is_inert()) {
-    std::cout << "    0v_0p compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+    LOG_DEBUG("    0v_0p compute influence of" << src.to_string() << " on" << targ.to_string());
     // targets are field points
 
 #ifdef USE_VC
@@ -100,89 +502,190 @@ void points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsT
       typedef Vc::Vector<S> StoreVec;
       typedef Vc::SimdArray<A, Vc::Vector<S>::size()> AccumVec;
 
-      // initialize float_v versions of the source vectors
-      Vc::Memory<StoreVec> sxv = stdvec_to_vcvec<S>(sx[0], 0.0);
-      Vc::Memory<StoreVec> syv = stdvec_to_vcvec<S>(sx[1], 0.0);
-      Vc::Memory<StoreVec> srv = stdvec_to_vcvec<S>(sr,    1.0);
-      Vc::Memory<StoreVec> ssv = stdvec_to_vcvec<S>(ss,    0.0);
+      // float_v versions of the source vectors, kept by the collection between calls
+      const auto& vcsrc = src.get_vc_sources();
+      const Vc::Memory<StoreVec>& sxv = vcsrc.x;
+      const Vc::Memory<StoreVec>& syv = vcsrc.y;
+      const Vc::Memory<StoreVec>& srv = vcsrc.r;
+      const Vc::Memory<StoreVec>& ssv = vcsrc.s;
 
       if (restype.get_type() == velonly) {
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-          const StoreVec txv = tx[0][i];
-          const StoreVec tyv = tx[1][i];
-          AccumVec accumu = 0.0;
-          AccumVec accumv = 0.0;
-          for (size_t j=0; j<sxv.vectorsCount(); ++j) {
-            kernelu_0v_0p<StoreVec,AccumVec>(
-                              sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
-                              txv, tyv,
-                              &accumu, &accumv);
-          }
-          tu[0][i] += accumu.sum();
-          tu[1][i] += accumv.sum();
-        }
-        //std::cout << "pt " << i << " has new vel " << tu[0][i] << " " << tu[1][i] << std::endl;
-        flops *= 2.0 + (float)flopsu_0v_0p<S,A>() * (float)src.get_n();
+        blocked_direct_sum<AccumVec,2>(targ.get_n(), sxv.vectorsCount(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelu_0v_0p<StoreVec,AccumVec,C>(sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
+                                               txv, tyv,
+                                               &acc[0], &acc[1]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsu_0v_0p<S,A,C>() * (float)src.get_n();
       }
       if (restype.get_type() == velandvort) {
         Vector<S>& tw = targ.get_vort();
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-          const StoreVec txv = tx[0][i];
-          const StoreVec tyv = tx[1][i];
-          AccumVec accumu = 0.0;
-          AccumVec accumv = 0.0;
-          AccumVec accumw = 0.0;
-          for (size_t j=0; j<sxv.vectorsCount(); ++j) {
-            kerneluw_0v_0p<StoreVec,AccumVec>(
-                              sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
-                              txv, tyv,
-                              &accumu, &accumv, &accumw);
-          }
-          tu[0][i] += accumu.sum();
-          tu[1][i] += accumv.sum();
-          tw[i] += accumw.sum();
-        }
-        //std::cout << "pt " << i << " has new vel " << tu[0][i] << " " << tu[1][i] << std::endl;
-        flops *= 2.0 + (float)flopsuw_0v_0p<S,A>() * (float)src.get_n();
+        blocked_direct_sum<AccumVec,3>(targ.get_n(), sxv.vectorsCount(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kerneluw_0v_0p<StoreVec,AccumVec,C>(sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
+                                                txv, tyv,
+                                                &acc[0], &acc[1], &acc[2]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+            tw[i] += acc[2].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsuw_0v_0p<S,A,C>() * (float)src.get_n();
+      }
+      if (restype.get_type() == velandgrad) {
+        std::array<Vector<S>,4>& tg = targ.get_velgrad();
+        blocked_direct_sum<AccumVec,6>(targ.get_n(), sxv.vectorsCount(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelug_0v_0p<StoreVec,AccumVec,C>(sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
+                                                  txv, tyv,
+                                                  &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+            for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsug_0v_0p<S,A,C>() * (float)src.get_n();
       }
     } else
 #endif  // no Vc
+#ifdef USE_STDSIMD
+    if (env.get_instrs() == cpu_simd) {
+
+      // portable vector types, accumulate in A as the Vc path does
+      typedef SimdVec<S> StoreVec;
+      typedef SimdAccum<S,A> AccumVec;
+
+      // padded copies of the source vectors, kept by the collection between calls
+      const std::array<SimdMemory<S>,4>& simdsrc = src.get_simd_sources();
+      const SimdMemory<S>& sxv = simdsrc[0];
+      const SimdMemory<S>& syv = simdsrc[1];
+      const SimdMemory<S>& srv = simdsrc[2];
+      const SimdMemory<S>& ssv = simdsrc[3];
+
+      if (restype.get_type() == velonly) {
+        blocked_direct_sum<AccumVec,2>(targ.get_n(), sxv.size(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelu_0v_0p<StoreVec,AccumVec,C>(sxv[j], syv[j], srv[j], ssv[j],
+                                               txv, tyv,
+                                               &acc[0], &acc[1]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsu_0v_0p<S,A,C>() * (float)src.get_n();
+      }
+      if (restype.get_type() == velandvort) {
+        Vector<S>& tw = targ.get_vort();
+        blocked_direct_sum<AccumVec,3>(targ.get_n(), sxv.size(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kerneluw_0v_0p<StoreVec,AccumVec,C>(sxv[j], syv[j], srv[j], ssv[j],
+                                                txv, tyv,
+                                                &acc[0], &acc[1], &acc[2]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+            tw[i] += acc[2].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsuw_0v_0p<S,A,C>() * (float)src.get_n();
+      }
+      if (restype.get_type() == velandgrad) {
+        std::array<Vector<S>,4>& tg = targ.get_velgrad();
+        blocked_direct_sum<AccumVec,6>(targ.get_n(), sxv.size(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelug_0v_0p<StoreVec,AccumVec,C>(sxv[j], syv[j], srv[j], ssv[j],
+                                                  txv, tyv,
+                                                  &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+            for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsug_0v_0p<S,A,C>() * (float)src.get_n();
+      }
+    } else
+#endif  // no portable SIMD
     {
       if (restype.get_type() == velonly) {
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-          A accumu = 0.0;
-          A accumv = 0.0;
-          for (size_t j=0; j<src.get_n(); ++j) {
-            kernelu_0v_0p<S,A>(sx[0][j], sx[1][j], sr[j], ss[j], 
-                               tx[0][i], tx[1][i],
-                               &accumu, &accumv);
-          }
-          tu[0][i] += accumu;
-          tu[1][i] += accumv;
-        }
-        flops *= 2.0 + (float)flopsu_0v_0p<S,A>() * (float)src.get_n();
+        blocked_direct_sum<A,2>(targ.get_n(), src.get_n(), tile_sources,
+          [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelu_0v_0p<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j],
+                                 tx[0][i], tx[1][i],
+                                 &acc[0], &acc[1]);
+            }
+          },
+          [&](const size_t i, const A* const acc) {
+            tu[0][i] += acc[0];
+            tu[1][i] += acc[1];
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsu_0v_0p<S,A,C>() * (float)src.get_n();
       }
       if (restype.get_type() == velandvort) {
         Vector<S>& tw = targ.get_vort();
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-          A accumu = 0.0;
-          A accumv = 0.0;
-          A accumw = 0.0;
-          for (size_t j=0; j<src.get_n(); ++j) {
-            kerneluw_0v_0p<S,A>(sx[0][j], sx[1][j], sr[j], ss[j], 
-                                tx[0][i], tx[1][i],
-                                &accumu, &accumv, &accumw);
-          }
-          tu[0][i] += accumu;
-          tu[1][i] += accumv;
-          tw[i] += accumw;
-          //std::cout << "pt " << i << " has new vel " << tu[0][i] << " " << tu[1][i] << std::endl;
-        }
-        flops *= 2.0 + (float)flopsuw_0v_0p<S,A>() * (float)src.get_n();
+        blocked_direct_sum<A,3>(targ.get_n(), src.get_n(), tile_sources,
+          [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+            for (size_t j=jbeg; j<jend; ++j) {
+              kerneluw_0v_0p<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j],
+                                  tx[0][i], tx[1][i],
+                                  &acc[0], &acc[1], &acc[2]);
+            }
+          },
+          [&](const size_t i, const A* const acc) {
+            tu[0][i] += acc[0];
+            tu[1][i] += acc[1];
+            tw[i] += acc[2];
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsuw_0v_0p<S,A,C>() * (float)src.get_n();
+      }
+      if (restype.get_type() == velandgrad) {
+        std::array<Vector<S>,4>& tg = targ.get_velgrad();
+        blocked_direct_sum<A,6>(targ.get_n(), src.get_n(), tile_sources,
+          [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelug_0v_0p<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j],
+                                    tx[0][i], tx[1][i],
+                                    &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+            }
+          },
+          [&](const size_t i, const A* const acc) {
+            tu[0][i] += acc[0];
+            tu[1][i] += acc[1];
+            for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2];
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsug_0v_0p<S,A,C>() * (float)src.get_n();
       }
     }
 
@@ -190,9 +693,9 @@ void points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsT
   // targets are particles, with a core radius ===================================================
   //
   } else {
-    std::cout << "    0v_0v compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+    LOG_DEBUG("    0v_0v compute influence of" << src.to_string() << " on" << targ.to_string());
     // targets are particles
-    const Vector<S>&				tr = targ.get_rad();
+    const Vector<S>&				tr = std::as_const(targ).get_rad();
 
 #ifdef USE_VC
     if (env.get_instrs() == cpu_vc) {
@@ -201,101 +704,199 @@ void points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsT
       typedef Vc::Vector<S> StoreVec;
       typedef Vc::SimdArray<A, Vc::Vector<S>::size()> AccumVec;
 
-      // initialize float_v versions of the source vectors
-      Vc::Memory<StoreVec> sxv = stdvec_to_vcvec<S>(sx[0], 0.0);
-      Vc::Memory<StoreVec> syv = stdvec_to_vcvec<S>(sx[1], 0.0);
-      Vc::Memory<StoreVec> srv = stdvec_to_vcvec<S>(sr,    1.0);
-      Vc::Memory<StoreVec> ssv = stdvec_to_vcvec<S>(ss,    0.0);
+      // float_v versions of the source vectors, kept by the collection between calls
+      const auto& vcsrc = src.get_vc_sources();
+      const Vc::Memory<StoreVec>& sxv = vcsrc.x;
+      const Vc::Memory<StoreVec>& syv = vcsrc.y;
+      const Vc::Memory<StoreVec>& srv = vcsrc.r;
+      const Vc::Memory<StoreVec>& ssv = vcsrc.s;
 
       if (restype.get_type() == velonly) {
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-          const StoreVec txv = tx[0][i];
-          const StoreVec tyv = tx[1][i];
-          const StoreVec trv = tr[i];
-          AccumVec accumu = 0.0;
-          AccumVec accumv = 0.0;
-          for (size_t j=0; j<sxv.vectorsCount(); ++j) {
-            kernelu_0v_0b<StoreVec,AccumVec>(
-                              sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
-                              txv, tyv, trv,
-                              &accumu, &accumv);
-            /* if (false) {
-              // this is how to print
-              StoreVec temp = sxv.vector(j,0);
-              std::cout << "src " << j << " has sxv " << temp << std::endl;
-            } */
-          }
-          tu[0][i] += accumu.sum();
-          tu[1][i] += accumv.sum();
-          //std::cout << "part " << i << " has new vel " << tu[0][i] << " " << tu[1][i] << std::endl;
-        }
-        flops *= 2.0 + (float)flopsu_0v_0b<S,A>() * (float)src.get_n();
+        blocked_direct_sum<AccumVec,2>(targ.get_n(), sxv.vectorsCount(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            const StoreVec trv = tr[i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelu_0v_0b<StoreVec,AccumVec,C>(sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
+                                               txv, tyv, trv,
+                                               &acc[0], &acc[1]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsu_0v_0b<S,A,C>() * (float)src.get_n();
       }
       if (restype.get_type() == velandvort) {
         Vector<S>& tw = targ.get_vort();
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-          const StoreVec txv = tx[0][i];
-          const StoreVec tyv = tx[1][i];
-          const StoreVec trv = tr[i];
-          AccumVec accumu = 0.0;
-          AccumVec accumv = 0.0;
-          AccumVec accumw = 0.0;
-          for (size_t j=0; j<sxv.vectorsCount(); ++j) {
-            kerneluw_0v_0b<StoreVec,AccumVec>(
-                              sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
-                              txv, tyv, trv,
-                              &accumu, &accumv, &accumw);
-          }
-          tu[0][i] += accumu.sum();
-          tu[1][i] += accumv.sum();
-          tw[i] += accumw.sum();
-          //std::cout << "part " << i << " has new vort " << tw[i] << std::endl;
-        }
-        flops *= 2.0 + (float)flopsu_0v_0b<S,A>() * (float)src.get_n();
+        blocked_direct_sum<AccumVec,3>(targ.get_n(), sxv.vectorsCount(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            const StoreVec trv = tr[i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kerneluw_0v_0b<StoreVec,AccumVec,C>(sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
+                                                txv, tyv, trv,
+                                                &acc[0], &acc[1], &acc[2]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+            tw[i] += acc[2].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsu_0v_0b<S,A,C>() * (float)src.get_n();
+      }
+      if (restype.get_type() == velandgrad) {
+        std::array<Vector<S>,4>& tg = targ.get_velgrad();
+        blocked_direct_sum<AccumVec,6>(targ.get_n(), sxv.vectorsCount(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            const StoreVec trv = tr[i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelug_0v_0b<StoreVec,AccumVec,C>(sxv.vector(j), syv.vector(j), srv.vector(j), ssv.vector(j),
+                                                  txv, tyv, trv,
+                                                  &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+            for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsug_0v_0b<S,A,C>() * (float)src.get_n();
       }
     } else
 #endif  // no Vc
+#ifdef USE_STDSIMD
+    if (env.get_instrs() == cpu_simd) {
+
+      // portable vector types, accumulate in A as the Vc path does
+      typedef SimdVec<S> StoreVec;
+      typedef SimdAccum<S,A> AccumVec;
+
+      // padded copies of the source vectors, kept by the collection between calls
+      const std::array<SimdMemory<S>,4>& simdsrc = src.get_simd_sources();
+      const SimdMemory<S>& sxv = simdsrc[0];
+      const SimdMemory<S>& syv = simdsrc[1];
+      const SimdMemory<S>& srv = simdsrc[2];
+      const SimdMemory<S>& ssv = simdsrc[3];
+
+      if (restype.get_type() == velonly) {
+        blocked_direct_sum<AccumVec,2>(targ.get_n(), sxv.size(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            const StoreVec trv = tr[i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelu_0v_0b<StoreVec,AccumVec,C>(sxv[j], syv[j], srv[j], ssv[j],
+                                               txv, tyv, trv,
+                                               &acc[0], &acc[1]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsu_0v_0b<S,A,C>() * (float)src.get_n();
+      }
+      if (restype.get_type() == velandvort) {
+        Vector<S>& tw = targ.get_vort();
+        blocked_direct_sum<AccumVec,3>(targ.get_n(), sxv.size(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            const StoreVec trv = tr[i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kerneluw_0v_0b<StoreVec,AccumVec,C>(sxv[j], syv[j], srv[j], ssv[j],
+                                                txv, tyv, trv,
+                                                &acc[0], &acc[1], &acc[2]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+            tw[i] += acc[2].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsuw_0v_0b<S,A,C>() * (float)src.get_n();
+      }
+      if (restype.get_type() == velandgrad) {
+        std::array<Vector<S>,4>& tg = targ.get_velgrad();
+        blocked_direct_sum<AccumVec,6>(targ.get_n(), sxv.size(), tile_sources/StoreVec::size(),
+          [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+            const StoreVec txv = tx[0][i];
+            const StoreVec tyv = tx[1][i];
+            const StoreVec trv = tr[i];
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelug_0v_0b<StoreVec,AccumVec,C>(sxv[j], syv[j], srv[j], ssv[j],
+                                                  txv, tyv, trv,
+                                                  &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+            }
+          },
+          [&](const size_t i, const AccumVec* const acc) {
+            tu[0][i] += acc[0].sum();
+            tu[1][i] += acc[1].sum();
+            for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2].sum();
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsug_0v_0b<S,A,C>() * (float)src.get_n();
+      }
+    } else
+#endif  // no portable SIMD
     {
       if (restype.get_type() == velonly) {
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-          A accumu = 0.0;
-          A accumv = 0.0;
-          if (restype.compute_vel()) {
-            for (size_t j=0; j<src.get_n(); ++j) {
-              kernelu_0v_0b<S,A>(sx[0][j], sx[1][j], sr[j], ss[j], 
+        blocked_direct_sum<A,2>(targ.get_n(), src.get_n(), tile_sources,
+          [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+            if (not restype.compute_vel()) return;
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelu_0v_0b<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j],
                                  tx[0][i], tx[1][i], tr[i],
-                                 &accumu, &accumv);
+                                 &acc[0], &acc[1]);
             }
-          }
-          tu[0][i] += accumu;
-          tu[1][i] += accumv;
-        }
-        flops *= 2.0 + (float)flopsu_0v_0b<S,A>() * (float)src.get_n();
+          },
+          [&](const size_t i, const A* const acc) {
+            tu[0][i] += acc[0];
+            tu[1][i] += acc[1];
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsu_0v_0b<S,A,C>() * (float)src.get_n();
       }
       if (restype.get_type() == velandvort) {
         Vector<S>& tw = targ.get_vort();
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-          A accumu = 0.0;
-          A accumv = 0.0;
-          A accumw = 0.0;
-          if (restype.compute_vel()) {
-            for (size_t j=0; j<src.get_n(); ++j) {
-              kerneluw_0v_0b<S,A>(sx[0][j], sx[1][j], sr[j], ss[j], 
+        blocked_direct_sum<A,3>(targ.get_n(), src.get_n(), tile_sources,
+          [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+            if (not restype.compute_vel()) return;
+            for (size_t j=jbeg; j<jend; ++j) {
+              kerneluw_0v_0b<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j],
                                   tx[0][i], tx[1][i], tr[i],
-                                  &accumu, &accumv, &accumw);
+                                  &acc[0], &acc[1], &acc[2]);
             }
-          }
-          tu[0][i] += accumu;
-          tu[1][i] += accumv;
-          tw[i] += accumw;
-        }
-        flops *= 2.0 + (float)flopsuw_0v_0b<S,A>() * (float)src.get_n();
+          },
+          [&](const size_t i, const A* const acc) {
+            tu[0][i] += acc[0];
+            tu[1][i] += acc[1];
+            tw[i] += acc[2];
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsuw_0v_0b<S,A,C>() * (float)src.get_n();
+      }
+      if (restype.get_type() == velandgrad) {
+        std::array<Vector<S>,4>& tg = targ.get_velgrad();
+        blocked_direct_sum<A,6>(targ.get_n(), src.get_n(), tile_sources,
+          [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+            for (size_t j=jbeg; j<jend; ++j) {
+              kernelug_0v_0b<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j],
+                                    tx[0][i], tx[1][i], tr[i],
+                                    &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+            }
+          },
+          [&](const size_t i, const A* const acc) {
+            tu[0][i] += acc[0];
+            tu[1][i] += acc[1];
+            for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2];
+          }, env.use_compensated_sums());
+        flops *= 2.0 + (float)flopsug_0v_0b<S,A,C>() * (float)src.get_n();
       }
-      //std::cout << "part " << i << " has new vel " << tu[0][i] << " " << tu[1][i] << std::endl;
     }
 
   //
@@ -305,21 +906,62 @@ void points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsT
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
-  const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-  printf("    points_affect_points: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+  LOG_DEBUG("    points_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS((targ.is_inert() ? "0v_0p" : "0v_0v"), flops, elapsed_seconds.count());
+}
+
+// pick the core function once, and run the loops built for it
+template <class S, class A>
+void points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env,
+                           const bool _images = true) {
+
+  // the weakest sources may be left out of the far field, see Prune.h
+  std::shared_ptr<const PrunedSources<S>> pruned;
+  if (env.get_source_pruning().active() and restype.compute_vel() and not restype.compute_psi() and
+      not env.get_periodic_domain().active() and not env.get_symmetry_plane().active()) {
+    pruned = prune_sources<S>(src, env.get_source_pruning());
+  }
+
+  with_velocity_core(env.get_velocity_core(), [&](auto _c) {
+    if (pruned and pruned->pruned()) {
+      // the kept set is new with each change of state, so its trees would never be refit,
+      //   only push the real ones out of the TreeCache
+      ExecEnv kept_env = env;
+      kept_env.set_tree_tag(0);
+      points_affect_points_core<S,A,decltype(_c)::value>(*pruned->kept, targ, restype, kept_env, _images);
+      add_pruned_near<S,A,decltype(_c)::value>(*pruned, targ, restype);
+    } else {
+      points_affect_points_core<S,A,decltype(_c)::value>(src, targ, restype, env, _images);
+    }
+  });
 }
 
 
+template <class S, class A>
+void panels_affect_points_periodic (const Surfaces<S>&, Points<S>&, const ResultsType&, const ExecEnv&, const char*);
+template <class S, class A>
+void points_affect_panels_periodic (const Points<S>&, Surfaces<S>&, const ResultsType&, const ExecEnv&);
+template <class S, class A>
+void panels_affect_points_mirror (const Surfaces<S>&, Points<S>&, const ResultsType&, const ExecEnv&, const char*);
+template <class S, class A>
+void points_affect_panels_mirror (const Points<S>&, Surfaces<S>&, const ResultsType&, const ExecEnv&);
+
 //
 // Vc and x86 versions of Panels/Surfaces affecting Points/Particles
 //
 template <class S, class A>
-void panels_affect_points (const Surfaces<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+void panels_affect_points (const Surfaces<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env,
+                           const char* _kernel = "1_0", const bool _images = true) {
+
+  if (_images and env.get_periodic_domain().active()) {
+    panels_affect_points_periodic<S,A>(src, targ, restype, env, _kernel);
+    return;
+  }
+  if (_images and env.get_symmetry_plane().active()) panels_affect_points_mirror<S,A>(src, targ, restype, env, _kernel);
 
-  std::cout << "    in panpt with" << env.to_string() << std::endl;
-  std::cout << "    1_0 compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    in panpt with" << env.to_string());
+  LOG_DEBUG("    1_0 compute influence of" << src.to_string() << " on" << targ.to_string());
   assert (!restype.compute_psi() && "Surface elements cannot compute streamfunction yet.");
-  assert (!restype.compute_grad() && "Surface elements cannot compute velocity gradients yet.");
 
   auto start = std::chrono::system_clock::now();
   float flops = (float)targ.get_n();
@@ -329,7 +971,7 @@ void panels_affect_points (const Surfaces<S>& src, Points<S>& targ, const Result
   const std::vector<Int>&                 si = src.get_idx();
   //const Vector<S>&                        sa = src.get_area();
   const Vector<S>&                        vs = src.get_str();
-  const std::array<Vector<S>,Dimensions>& tx = targ.get_pos();
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
   std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
 
   // and get the source strengths, if they exist
@@ -342,6 +984,65 @@ void panels_affect_points (const Surfaces<S>& src, Points<S>& targ, const Result
   }
 #endif  // no external fast solve, perform calculations below
 
+  // only particles go on the vic mesh, panels use the fmm there
+  if ((env.get_summation() == fmm or env.get_summation() == vic) and src.get_npanels() > 4*env.get_leaf_size()) {
+    panels_affect_points_fmm<S,A>(src, targ, restype, env);
+    return;
+  }
+
+#ifdef USE_OGL_COMPUTE
+  if (env.get_instrs() == gpu_opengl and env.get_summation() == direct) {
+    if (OglCompute::get().panels_affect_points<S>(src, targ, restype)) {
+      flops *= 2.0 + (float)flopsu_1vs_0p<S,A>() * (float)src.get_npanels();
+      auto end = std::chrono::system_clock::now();
+      std::chrono::duration<double> elapsed_seconds = end-start;
+      LOG_DEBUG("    panels_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+      PROFILE_FLOPS(_kernel, flops, elapsed_seconds.count());
+      return;
+    }
+    LOG_DEBUG("    no OpenGL compute context, running on the cpu");
+  }
+#endif  // no internal opengl solve, perform internal CPU calc below
+#ifdef USE_CUDA
+  if (env.get_instrs() == gpu_cuda and env.get_summation() == direct) {
+    if (cuda_panels_affect_points<S>(src, targ, restype)) {
+      flops *= 2.0 + (float)flopsu_1vs_0p<S,A>() * (float)src.get_npanels();
+      auto end = std::chrono::system_clock::now();
+      std::chrono::duration<double> elapsed_seconds = end-start;
+      LOG_DEBUG("    panels_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+      PROFILE_FLOPS(_kernel, flops, elapsed_seconds.count());
+      return;
+    }
+    LOG_DEBUG("    no GPU device, running on the cpu");
+  }
+#endif  // no internal cuda solve, perform internal CPU calc below
+
+  // far from a panel, it acts like a point vortex and source at its center
+  const S pnear = env.get_panel_near_field();
+  const bool use_far = (pnear > 0.0);
+  Vector<S> pmx, pmy, pgam, psig, pnearsq;
+  if (use_far) {
+    const size_t np = src.get_npanels();
+    pmx.resize(np);
+    pmy.resize(np);
+    pgam.resize(np);
+    psig.resize(np, 0.0);
+    pnearsq.resize(np);
+    for (size_t j=0; j<np; ++j) {
+      const size_t id0 = si[2*j];
+      const size_t id1 = si[2*j+1];
+      const S px = sx[0][id1] - sx[0][id0];
+      const S py = sx[1][id1] - sx[1][id0];
+      const S plensq = px*px + py*py;
+      pmx[j] = 0.5 * (sx[0][id0] + sx[0][id1]);
+      pmy[j] = 0.5 * (sx[1][id0] + sx[1][id1]);
+      pgam[j] = vs[j] * std::sqrt(plensq);
+      if (have_source_strengths) psig[j] = ss[j] * std::sqrt(plensq);
+      pnearsq[j] = pnear * pnear * plensq;
+    }
+    LOG_DEBUG("    using exact panel influence within " << pnear << " panel lengths");
+  }
+
 #ifdef USE_VC
   if (env.get_instrs() == cpu_vc) {
 
@@ -387,115 +1088,306 @@ void panels_affect_points (const Surfaces<S>& src, Points<S>& targ, const Result
       }
     }
 
-    #pragma omp parallel for
-    for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-
-      // spread the target points out over a vector
-      const StoreVec vtx = tx[0][i];
-      const StoreVec vty = tx[1][i];
-
-      // generate accumulator
-      AccumVec accumu(0.0);
-      AccumVec accumv(0.0);
-      AccumVec resultu(0.0);
-      AccumVec resultv(0.0);
-
-      if (restype.compute_vel()) {
-      if (have_source_strengths) {
-        for (size_t j=0; j<vsvs.vectorsCount(); ++j) {
-          // note that this is the same kernel as panels_affect_points!
-          if (restype.compute_vel()) {
-          kernelu_1vs_0p<StoreVec,AccumVec>(vsx0.vector(j), vsy0.vector(j),
-                                            vsx1.vector(j), vsy1.vector(j),
-                                            vsvs.vector(j), vsss.vector(j),
-                                            vtx, vty,
-                                            &resultu, &resultv);
-          }
-          accumu += resultu;
-          accumv += resultv;
-        }
-      } else {
-        // only vortex strengths
-        for (size_t j=0; j<vsvs.vectorsCount(); ++j) {
-          // note that this is the same kernel as panels_affect_points!
-          if (restype.compute_vel()) {
-          kernelu_1v_0p<StoreVec,AccumVec>(vsx0.vector(j), vsy0.vector(j),
-                                           vsx1.vector(j), vsy1.vector(j),
-                                           vsvs.vector(j),
-                                           vtx, vty,
-                                           &resultu, &resultv);
-          }
-          accumu += resultu;
-          accumv += resultv;
-        }
+    // panel centers and total strengths, padding panels have no strength
+    Vc::Memory<StoreVec> vsmx(src.get_npanels());
+    Vc::Memory<StoreVec> vsmy(src.get_npanels());
+    Vc::Memory<StoreVec> vsgam(src.get_npanels());
+    Vc::Memory<StoreVec> vssig(src.get_npanels());
+    Vc::Memory<StoreVec> vsnear(src.get_npanels());
+    if (use_far) {
+      for (size_t j=0; j<src.get_npanels(); ++j) {
+        vsmx[j]   = pmx[j];
+        vsmy[j]   = pmy[j];
+        vsgam[j]  = pgam[j];
+        vssig[j]  = psig[j];
+        vsnear[j] = pnearsq[j];
       }
+      for (size_t j=src.get_npanels(); j<vsmx.vectorsCount()*StoreVec::size(); ++j) {
+        vsmx[j]   = 0.0;
+        vsmy[j]   = -9999.0;
+        vsgam[j]  = 0.0;
+        vssig[j]  = 0.0;
+        vsnear[j] = 0.0;
       }
+    }
 
-      // use this as normal
-      tu[0][i] += accumu.sum();
-      tu[1][i] += accumv.sum();
-      //std::cout << "    new 1_0 vel on " << i << " is " << accumu.sum() << " " << accumv.sum() << std::endl;
+    if (restype.compute_grad()) {
+      std::array<Vector<S>,4>& tg = targ.get_velgrad();
+      blocked_direct_sum<AccumVec,6>(targ.get_n(), vsvs.vectorsCount(), tile_sources/StoreVec::size(),
+        [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+          const StoreVec vtx = tx[0][i];
+          const StoreVec vty = tx[1][i];
+          for (size_t j=jbeg; j<jend; ++j) {
+            if (use_far) {
+              const StoreVec dx = vtx - vsmx.vector(j);
+              const StoreVec dy = vty - vsmy.vector(j);
+              if ((dx*dx + dy*dy > vsnear.vector(j)).isFull()) {
+                kernelug_1vs_0p_far<StoreVec,AccumVec>(vsmx.vector(j), vsmy.vector(j),
+                                                       vsgam.vector(j), vssig.vector(j),
+                                                       vtx, vty,
+                                                       &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+                continue;
+              }
+            }
+            kernelug_1vs_0p<StoreVec,AccumVec>(vsx0.vector(j), vsy0.vector(j),
+                                               vsx1.vector(j), vsy1.vector(j),
+                                               vsvs.vector(j), vsss.vector(j),
+                                               vtx, vty,
+                                               &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+          }
+        },
+        [&](const size_t i, const AccumVec* const acc) {
+          tu[0][i] += acc[0].sum();
+          tu[1][i] += acc[1].sum();
+          for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2].sum();
+        }, env.use_compensated_sums());
+    } else if (restype.compute_vel()) {
+      blocked_direct_sum<AccumVec,2>(targ.get_n(), vsvs.vectorsCount(), tile_sources/StoreVec::size(),
+        [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+
+          // spread the target points out over a vector
+          const StoreVec vtx = tx[0][i];
+          const StoreVec vty = tx[1][i];
+          AccumVec resultu(0.0);
+          AccumVec resultv(0.0);
+
+          for (size_t j=jbeg; j<jend; ++j) {
+            // only if every panel in the vector is far away
+            if (use_far) {
+              const StoreVec dx = vtx - vsmx.vector(j);
+              const StoreVec dy = vty - vsmy.vector(j);
+              if ((dx*dx + dy*dy > vsnear.vector(j)).isFull()) {
+                kernelu_1vs_0p_far<StoreVec,AccumVec>(vsmx.vector(j), vsmy.vector(j),
+                                                      vsgam.vector(j), vssig.vector(j),
+                                                      vtx, vty,
+                                                      &resultu, &resultv);
+                acc[0] += resultu;
+                acc[1] += resultv;
+                continue;
+              }
+            }
+
+            // note that this is the same kernel as panels_affect_points!
+            if (have_source_strengths) {
+              kernelu_1vs_0p<StoreVec,AccumVec>(vsx0.vector(j), vsy0.vector(j),
+                                                vsx1.vector(j), vsy1.vector(j),
+                                                vsvs.vector(j), vsss.vector(j),
+                                                vtx, vty,
+                                                &resultu, &resultv);
+            } else {
+              kernelu_1v_0p<StoreVec,AccumVec>(vsx0.vector(j), vsy0.vector(j),
+                                               vsx1.vector(j), vsy1.vector(j),
+                                               vsvs.vector(j),
+                                               vtx, vty,
+                                               &resultu, &resultv);
+            }
+            acc[0] += resultu;
+            acc[1] += resultv;
+          }
+        },
+        [&](const size_t i, const AccumVec* const acc) {
+          tu[0][i] += acc[0].sum();
+          tu[1][i] += acc[1].sum();
+        }, env.use_compensated_sums());
     }
   } else
 
 #endif  // no Vc
-  {
-    #pragma omp parallel for
-    for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
-
-      A accumu  = 0.0;
-      A accumv  = 0.0;
-      A resultu = 0.0;
-      A resultv = 0.0;
+#ifdef USE_STDSIMD
+  if (env.get_instrs() == cpu_simd) {
+
+    // portable vector types, accumulate in A as the Vc path does
+    typedef SimdVec<S> StoreVec;
+    typedef SimdAccum<S,A> AccumVec;
+    constexpr size_t vsize = StoreVec::size();
+
+    // sources are panels, assemble de-interleaved vectors, padding panels are far away with no strength
+    const size_t nvec = (src.get_npanels() + vsize - 1) / vsize;
+    Vector<S> x0(nvec*vsize, -9999.0), y0(nvec*vsize, -9999.0);
+    Vector<S> x1(nvec*vsize,  9999.0), y1(nvec*vsize, -9999.0);
+    Vector<S> pvs(nvec*vsize, 0.0),    pss(nvec*vsize, 0.0);
+    for (size_t j=0; j<src.get_npanels(); ++j) {
+      x0[j]  = sx[0][si[2*j]];
+      y0[j]  = sx[1][si[2*j]];
+      x1[j]  = sx[0][si[2*j+1]];
+      y1[j]  = sx[1][si[2*j+1]];
+      pvs[j] = vs[j];
+      if (have_source_strengths) pss[j] = ss[j];
+    }
+    const SimdMemory<S> vsx0 = stdvec_to_simdvec<S>(x0,  -9999.0);
+    const SimdMemory<S> vsy0 = stdvec_to_simdvec<S>(y0,  -9999.0);
+    const SimdMemory<S> vsx1 = stdvec_to_simdvec<S>(x1,   9999.0);
+    const SimdMemory<S> vsy1 = stdvec_to_simdvec<S>(y1,  -9999.0);
+    const SimdMemory<S> vsvs = stdvec_to_simdvec<S>(pvs,  0.0);
+    const SimdMemory<S> vsss = stdvec_to_simdvec<S>(pss,  0.0);
+
+    // panel centers and total strengths, padding panels have no strength
+    SimdMemory<S> vsmx, vsmy, vsgam, vssig, vsnear;
+    if (use_far) {
+      vsmx   = stdvec_to_simdvec<S>(pmx,     0.0);
+      vsmy   = stdvec_to_simdvec<S>(pmy,     -9999.0);
+      vsgam  = stdvec_to_simdvec<S>(pgam,    0.0);
+      vssig  = stdvec_to_simdvec<S>(psig,    0.0);
+      vsnear = stdvec_to_simdvec<S>(pnearsq, 0.0);
+    }
 
-      if (restype.compute_vel()) {
-      if (have_source_strengths) {
-        // source and vortex strengths
-        for (size_t j=0; j<src.get_npanels(); ++j) {
-          const size_t jp0 = si[2*j];
-          const size_t jp1 = si[2*j+1];
-
-          // note that this is the same kernel as points_affect_panels
-          if (restype.compute_vel()) {
-          kernelu_1vs_0p<S,A>(sx[0][jp0], sx[1][jp0], 
-                              sx[0][jp1], sx[1][jp1],
-                              vs[j],      ss[j],
-                              tx[0][i],   tx[1][i],
-                              &resultu, &resultv);
+    if (restype.compute_grad()) {
+      std::array<Vector<S>,4>& tg = targ.get_velgrad();
+      blocked_direct_sum<AccumVec,6>(targ.get_n(), nvec, tile_sources/vsize,
+        [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+          const StoreVec vtx = tx[0][i];
+          const StoreVec vty = tx[1][i];
+          for (size_t j=jbeg; j<jend; ++j) {
+            if (use_far) {
+              const StoreVec dx = vtx - vsmx[j];
+              const StoreVec dy = vty - vsmy[j];
+              if (stdx::all_of(dx*dx + dy*dy > vsnear[j])) {
+                kernelug_1vs_0p_far<StoreVec,AccumVec>(vsmx[j], vsmy[j], vsgam[j], vssig[j],
+                                                       vtx, vty,
+                                                       &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+                continue;
+              }
+            }
+            kernelug_1vs_0p<StoreVec,AccumVec>(vsx0[j], vsy0[j], vsx1[j], vsy1[j],
+                                               vsvs[j], vsss[j],
+                                               vtx, vty,
+                                               &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
           }
+        },
+        [&](const size_t i, const AccumVec* const acc) {
+          tu[0][i] += acc[0].sum();
+          tu[1][i] += acc[1].sum();
+          for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2].sum();
+        }, env.use_compensated_sums());
+    } else if (restype.compute_vel()) {
+      blocked_direct_sum<AccumVec,2>(targ.get_n(), nvec, tile_sources/vsize,
+        [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+
+          // spread the target points out over a vector
+          const StoreVec vtx = tx[0][i];
+          const StoreVec vty = tx[1][i];
+          StoreVec resultu = 0.0f;
+          StoreVec resultv = 0.0f;
+
+          for (size_t j=jbeg; j<jend; ++j) {
+            // only if every panel in the vector is far away
+            if (use_far) {
+              const StoreVec dx = vtx - vsmx[j];
+              const StoreVec dy = vty - vsmy[j];
+              if (stdx::all_of(dx*dx + dy*dy > vsnear[j])) {
+                kernelu_1vs_0p_far<StoreVec,StoreVec>(vsmx[j], vsmy[j], vsgam[j], vssig[j],
+                                                      vtx, vty,
+                                                      &resultu, &resultv);
+                acc[0] += resultu;
+                acc[1] += resultv;
+                continue;
+              }
+            }
 
-          accumu += resultu;
-          accumv += resultv;
-        }
-      } else {
-        // only vortex strengths
-        for (size_t j=0; j<src.get_npanels(); ++j) {
-          const size_t jp0 = si[2*j];
-          const size_t jp1 = si[2*j+1];
-
-          // note that this is the same kernel as points_affect_panels
-          if (restype.compute_vel()) {
-          kernelu_1v_0p<S,A>(sx[0][jp0], sx[1][jp0], 
-                             sx[0][jp1], sx[1][jp1],
-                             vs[j],
-                             tx[0][i],   tx[1][i],
-                             &resultu, &resultv);
+            if (have_source_strengths) {
+              kernelu_1vs_0p<StoreVec,StoreVec>(vsx0[j], vsy0[j], vsx1[j], vsy1[j],
+                                                vsvs[j], vsss[j],
+                                                vtx, vty,
+                                                &resultu, &resultv);
+            } else {
+              kernelu_1v_0p<StoreVec,StoreVec>(vsx0[j], vsy0[j], vsx1[j], vsy1[j],
+                                               vsvs[j],
+                                               vtx, vty,
+                                               &resultu, &resultv);
+            }
+            acc[0] += resultu;
+            acc[1] += resultv;
           }
+        },
+        [&](const size_t i, const AccumVec* const acc) {
+          tu[0][i] += acc[0].sum();
+          tu[1][i] += acc[1].sum();
+        }, env.use_compensated_sums());
+    }
+  } else
 
-          accumu += resultu;
-          accumv += resultv;
-        }
-      }
-      }
+#endif  // no portable SIMD
+  {
+    if (restype.compute_grad()) {
+      std::array<Vector<S>,4>& tg = targ.get_velgrad();
+      blocked_direct_sum<A,6>(targ.get_n(), src.get_npanels(), tile_sources,
+        [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+          for (size_t j=jbeg; j<jend; ++j) {
+            if (use_far) {
+              const S dx = tx[0][i] - pmx[j];
+              const S dy = tx[1][i] - pmy[j];
+              if (dx*dx + dy*dy > pnearsq[j]) {
+                kernelug_1vs_0p_far<S,A>(pmx[j], pmy[j], pgam[j], psig[j],
+                                         tx[0][i], tx[1][i],
+                                         &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+                continue;
+              }
+            }
+            const size_t jp0 = si[2*j];
+            const size_t jp1 = si[2*j+1];
+            kernelug_1vs_0p<S,A>(sx[0][jp0], sx[1][jp0],
+                                 sx[0][jp1], sx[1][jp1],
+                                 vs[j],      have_source_strengths ? ss[j] : (S)0.0,
+                                 tx[0][i],   tx[1][i],
+                                 &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+          }
+        },
+        [&](const size_t i, const A* const acc) {
+          tu[0][i] += acc[0];
+          tu[1][i] += acc[1];
+          for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2];
+        }, env.use_compensated_sums());
+    } else if (restype.compute_vel()) {
+      blocked_direct_sum<A,2>(targ.get_n(), src.get_npanels(), tile_sources,
+        [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+          A resultu = 0.0;
+          A resultv = 0.0;
+
+          for (size_t j=jbeg; j<jend; ++j) {
+            if (use_far) {
+              const S dx = tx[0][i] - pmx[j];
+              const S dy = tx[1][i] - pmy[j];
+              if (dx*dx + dy*dy > pnearsq[j]) {
+                kernelu_1vs_0p_far<S,A>(pmx[j], pmy[j], pgam[j], psig[j],
+                                        tx[0][i], tx[1][i],
+                                        &resultu, &resultv);
+                acc[0] += resultu;
+                acc[1] += resultv;
+                continue;
+              }
+            }
 
-      // use this as normal
-      tu[0][i] += accumu;
-      tu[1][i] += accumv;
-      //std::cout << "    new 1_0 vel on " << i << " is " << accumu << " " << accumv << std::endl;
+            const size_t jp0 = si[2*j];
+            const size_t jp1 = si[2*j+1];
+
+            // note that this is the same kernel as points_affect_panels
+            if (have_source_strengths) {
+              kernelu_1vs_0p<S,A>(sx[0][jp0], sx[1][jp0],
+                                  sx[0][jp1], sx[1][jp1],
+                                  vs[j],      ss[j],
+                                  tx[0][i],   tx[1][i],
+                                  &resultu, &resultv);
+            } else {
+              kernelu_1v_0p<S,A>(sx[0][jp0], sx[1][jp0],
+                                 sx[0][jp1], sx[1][jp1],
+                                 vs[j],
+                                 tx[0][i],   tx[1][i],
+                                 &resultu, &resultv);
+            }
+            acc[0] += resultu;
+            acc[1] += resultv;
+          }
+        },
+        [&](const size_t i, const A* const acc) {
+          tu[0][i] += acc[0];
+          tu[1][i] += acc[1];
+        }, env.use_compensated_sums());
     }
   }
 
-  if (have_source_strengths) {
+  if (restype.compute_grad()) {
+    flops *= 6.0 + (float)flopsug_1vs_0p<S,A>() * (float)src.get_npanels();
+  } else if (have_source_strengths) {
     flops *= 2.0 + (float)flopsu_1vs_0p<S,A>() * (float)src.get_npanels();
   } else {
     flops *= 2.0 + (float)flopsu_1v_0p<S,A>() * (float)src.get_npanels();
@@ -503,19 +1395,123 @@ void panels_affect_points (const Surfaces<S>& src, Points<S>& targ, const Result
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
-  const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-  printf("    panels_affect_points: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+  LOG_DEBUG("    panels_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS(_kernel, flops, elapsed_seconds.count());
 }
 
 //
-// Vc and x86 versions of Volumes affecting Points/Particles
+// Volumes affecting Points/Particles: the vorticity on the nodes, as particles at each
+//   element's Gauss points, goes through points_affect_points and whatever summation and
+//   instructions it picks; then any target within two element radii of an element trades
+//   that element's coarse points for a finely subdivided set; this is a refined quadrature,
+//   not the singular integral, so its error shrinks but does not vanish near the element
 //
 template <class S, class A>
 void bricks_affect_points (const Volumes<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
-  std::cout << "    2_0 compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
-  assert (false && "Volume elements cannot affect points yet.");
+  LOG_DEBUG("    2_0 compute influence of" << src.to_string() << " on" << targ.to_string());
   assert (!restype.compute_psi() && "Volume elements cannot compute streamfunction yet.");
-  assert (!restype.compute_grad() && "Volume elements cannot compute velocity gradients yet.");
+
+  if (not src.has_src_vort() or targ.get_n() == 0) return;
+
+  // the far field
+  const Points<S>& coarse = src.get_quad_src(1);
+  points_affect_points<S,A>(coarse, targ, restype, env);
+  if (not restype.compute_vel()) return;
+
+  auto start = std::chrono::system_clock::now();
+
+  // the near field
+  constexpr int nsub = 4;
+  const Points<S>& fine = src.get_quad_src(nsub);
+  const size_t nc = 4;
+  const size_t nf = 4*nsub*nsub;
+
+  // element centers and radii, and a cell list over them
+  const size_t ne = src.get_nelems();
+  std::array<Vector<S>,Dimensions> ec;
+  Vector<S> erad(ne);
+  for (size_t d=0; d<Dimensions; ++d) ec[d].resize(ne);
+  const std::array<Vector<S>,Dimensions>& cx = coarse.get_pos();
+  S maxrad = 0.0;
+  for (size_t e=0; e<ne; ++e) {
+    for (size_t d=0; d<Dimensions; ++d) {
+      ec[d][e] = 0.25 * (cx[d][nc*e] + cx[d][nc*e+1] + cx[d][nc*e+2] + cx[d][nc*e+3]);
+    }
+    // the Gauss points sit at 1/sqrt(3) of the way to the corners
+    S r2 = 0.0;
+    for (size_t k=nc*e; k<nc*(e+1); ++k) {
+      r2 = std::max(r2, (S)(std::pow(cx[0][k]-ec[0][e], 2) + std::pow(cx[1][k]-ec[1][e], 2)));
+    }
+    erad[e] = (S)2.0 * std::sqrt(3.0*r2);
+    maxrad = std::max(maxrad, erad[e]);
+  }
+  CellList<S> ecells;
+  ecells.build(ec, maxrad);
+
+  const std::array<Vector<S>,Dimensions>& cs = coarse.get_pos();
+  const Vector<S>& csr = coarse.get_rad();
+  const Vector<S>& css = coarse.get_str();
+  const std::array<Vector<S>,Dimensions>& fs = fine.get_pos();
+  const Vector<S>& fsr = fine.get_rad();
+  const Vector<S>& fss = fine.get_str();
+
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
+  std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
+  const bool has_trad = not targ.is_inert();
+  const Vector<S>& tr = std::as_const(targ).get_rad();
+  const bool do_grad = restype.compute_grad();
+  std::array<Vector<S>,4>* tg = do_grad ? &targ.get_velgrad() : nullptr;
+  size_t npairs = 0;
+
+  float flops = 0.0;
+  with_velocity_core(env.get_velocity_core(), [&](auto _c) {
+    constexpr VelCore C = decltype(_c)::value;
+    #pragma omp parallel for schedule(dynamic,256) reduction(+:npairs)
+    for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
+      const S x = tx[0][i];
+      const S y = tx[1][i];
+      A accumu = 0.0;
+      A accumv = 0.0;
+      A accumg[4] = {0.0, 0.0, 0.0, 0.0};
+      ecells.for_each_in_box(x-maxrad, x+maxrad, y-maxrad, y+maxrad, [&](const int32_t e) {
+        if (std::pow(ec[0][e]-x, 2) + std::pow(ec[1][e]-y, 2) > erad[e]*erad[e]) return;
+        ++npairs;
+        A fu = 0.0, fv = 0.0, cu = 0.0, cv = 0.0;
+        if (do_grad) {
+          // the fine set's gradients in, the coarse set's out
+          A fg[4] = {0.0, 0.0, 0.0, 0.0};
+          A cg[4] = {0.0, 0.0, 0.0, 0.0};
+          for (size_t k=nf*e; k<nf*(e+1); ++k) {
+            if (has_trad) kernelug_0v_0b<S,A,C>(fs[0][k], fs[1][k], fsr[k], fss[k], x, y, tr[i], &fu, &fv, &fg[0], &fg[1], &fg[2], &fg[3]);
+            else          kernelug_0v_0p<S,A,C>(fs[0][k], fs[1][k], fsr[k], fss[k], x, y, &fu, &fv, &fg[0], &fg[1], &fg[2], &fg[3]);
+          }
+          for (size_t k=nc*e; k<nc*(e+1); ++k) {
+            if (has_trad) kernelug_0v_0b<S,A,C>(cs[0][k], cs[1][k], csr[k], css[k], x, y, tr[i], &cu, &cv, &cg[0], &cg[1], &cg[2], &cg[3]);
+            else          kernelug_0v_0p<S,A,C>(cs[0][k], cs[1][k], csr[k], css[k], x, y, &cu, &cv, &cg[0], &cg[1], &cg[2], &cg[3]);
+          }
+          for (size_t k=0; k<4; ++k) accumg[k] += fg[k] - cg[k];
+        } else if (has_trad) {
+          for (size_t k=nf*e; k<nf*(e+1); ++k) kernelu_0v_0b<S,A,C>(fs[0][k], fs[1][k], fsr[k], fss[k], x, y, tr[i], &fu, &fv);
+          for (size_t k=nc*e; k<nc*(e+1); ++k) kernelu_0v_0b<S,A,C>(cs[0][k], cs[1][k], csr[k], css[k], x, y, tr[i], &cu, &cv);
+        } else {
+          for (size_t k=nf*e; k<nf*(e+1); ++k) kernelu_0v_0p<S,A,C>(fs[0][k], fs[1][k], fsr[k], fss[k], x, y, &fu, &fv);
+          for (size_t k=nc*e; k<nc*(e+1); ++k) kernelu_0v_0p<S,A,C>(cs[0][k], cs[1][k], csr[k], css[k], x, y, &cu, &cv);
+        }
+        accumu += fu - cu;
+        accumv += fv - cv;
+      });
+      tu[0][i] += accumu;
+      tu[1][i] += accumv;
+      if (do_grad) for (size_t k=0; k<4; ++k) (*tg)[k][i] += accumg[k];
+    }
+
+    flops = (float)npairs * (float)(nf+nc) * (float)(do_grad ? flopsug_0v_0b<S,A,C>() : flopsu_0v_0b<S,A,C>());
+  });
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    bricks_affect_points near field: " << npairs << " pairs in [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS("2_0", flops, elapsed_seconds.count());
 }
 
 
@@ -525,10 +1521,18 @@ void bricks_affect_points (const Volumes<S>& src, Points<S>& targ, const Results
 // Vc and x86 versions of Points/Particles affecting Panels/Surfaces
 //
 template <class S, class A>
-void points_affect_panels (const Points<S>& src, Surfaces<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+KERNEL_CLONES
+void points_affect_panels (const Points<S>& src, Surfaces<S>& targ, const ResultsType& restype, const ExecEnv& env,
+                           const bool _images = true) {
 
-  std::cout << "    in ptpan with" << env.to_string() << std::endl;
-  std::cout << "    0_1 compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  if (_images and env.get_periodic_domain().active()) {
+    points_affect_panels_periodic<S,A>(src, targ, restype, env);
+    return;
+  }
+  if (_images and env.get_symmetry_plane().active()) points_affect_panels_mirror<S,A>(src, targ, restype, env);
+
+  LOG_DEBUG("    in ptpan with" << env.to_string());
+  LOG_DEBUG("    0_1 compute influence of" << src.to_string() << " on" << targ.to_string());
   assert (!restype.compute_psi() && "Point elements cannot compute streamfunction yet.");
   assert (!restype.compute_grad() && "Point elements cannot compute velocity gradients yet.");
 
@@ -538,7 +1542,7 @@ void points_affect_panels (const Points<S>& src, Surfaces<S>& targ, const Result
   // get references to use locally
   const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
   const Vector<S>&                        vs = src.get_str();
-  const std::array<Vector<S>,Dimensions>& tx = targ.get_pos();
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
   const std::vector<Int>&                 ti = targ.get_idx();
   const Vector<S>&                        ta = targ.get_area();
   std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
@@ -549,6 +1553,25 @@ void points_affect_panels (const Points<S>& src, Surfaces<S>& targ, const Result
   }
 #endif  // no external fast solve, perform calculations below
 
+  if ((env.get_summation() == fmm or env.get_summation() == vic) and src.get_n() > 4*env.get_leaf_size()) {
+    points_affect_panels_fmm<S,A>(src, targ, restype, env);
+    return;
+  }
+
+#ifdef USE_CUDA
+  if (env.get_instrs() == gpu_cuda and env.get_summation() == direct) {
+    if (cuda_points_affect_panels<S>(src, targ, restype)) {
+      flops *= 2.0 + (float)flopsu_1v_0p<S,A>() * (float)src.get_n();
+      auto end = std::chrono::system_clock::now();
+      std::chrono::duration<double> elapsed_seconds = end-start;
+      LOG_DEBUG("    points_affect_panels: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+      PROFILE_FLOPS("0_1", flops, elapsed_seconds.count());
+      return;
+    }
+    LOG_DEBUG("    no GPU device, running on the cpu");
+  }
+#endif  // no internal cuda solve, perform internal CPU calc below
+
 #ifdef USE_VC
   if (env.get_instrs() == cpu_vc) {
 
@@ -610,6 +1633,59 @@ void points_affect_panels (const Points<S>& src, Surfaces<S>& targ, const Result
   } else
 
 #endif  // no Vc
+#ifdef USE_STDSIMD
+  if (env.get_instrs() == cpu_simd) {
+
+    // portable vector types, accumulate in A as the Vc path does
+    typedef SimdVec<S> StoreVec;
+    typedef SimdAccum<S,A> AccumVec;
+
+    // padding particles are far away with no strength
+    const SimdMemory<S> sxv = stdvec_to_simdvec<S>(sx[0], 999.999f);
+    const SimdMemory<S> syv = stdvec_to_simdvec<S>(sx[1], 999.999f);
+    const SimdMemory<S> vsv = stdvec_to_simdvec<S>(vs,    0.0);
+
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)targ.get_npanels(); ++i) {
+
+      const size_t ip0 = ti[2*i];
+      const size_t ip1 = ti[2*i+1];
+
+      // scale by the panel size
+      const A plen = 1.0 / ta[i];
+
+      // spread the target out over a vector
+      const StoreVec vtx0 = tx[0][ip0];
+      const StoreVec vty0 = tx[1][ip0];
+      const StoreVec vtx1 = tx[0][ip1];
+      const StoreVec vty1 = tx[1][ip1];
+
+      // generate accumulator
+      AccumVec accumu(0.0);
+      AccumVec accumv(0.0);
+      StoreVec resultu = 0.0f;
+      StoreVec resultv = 0.0f;
+
+      if (restype.compute_vel()) {
+        for (size_t j=0; j<vsv.size(); ++j) {
+          // note that this is the same kernel as panels_affect_points!
+          kernelu_1v_0p<StoreVec,StoreVec>(vtx0, vty0,
+                                           vtx1, vty1,
+                                           vsv[j],
+                                           sxv[j], syv[j],
+                                           &resultu, &resultv);
+          accumu += resultu;
+          accumv += resultv;
+        }
+      }
+
+      // but we use it backwards, so the resulting velocities are negative
+      tu[0][i] -= plen*accumu.sum();
+      tu[1][i] -= plen*accumv.sum();
+    }
+  } else
+
+#endif  // no portable SIMD
   {
     #pragma omp parallel for
     for (int32_t i=0; i<(int32_t)targ.get_npanels(); ++i) {
@@ -660,14 +1736,449 @@ void points_affect_panels (const Points<S>& src, Surfaces<S>& targ, const Result
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
-  const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-  printf("    points_affect_panels: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+  LOG_DEBUG("    points_affect_panels: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS("0_1", flops, elapsed_seconds.count());
+}
+
+
+//
+// Points affecting the panels of several collections at once, see solve_bem: the ends and
+//   areas of every panel are in one list, so each block of sources passes all of them in a
+//   single blocked sweep, instead of the whole source set being read once per collection
+//
+// the same sums as points_affect_panels, direct only and without images; _ends holds the
+//   x0, y0, x1, y1 of each panel and the results are added to _vel
+//
+template <class S, class A>
+KERNEL_CLONES
+void points_affect_panel_list (const Points<S>& src,
+                               const std::array<Vector<S>,4>& _ends,
+                               const Vector<S>& _area,
+                               std::array<Vector<S>,Dimensions>& _vel,
+                               const ExecEnv& env) {
+
+  const size_t npan = _area.size();
+  LOG_DEBUG("    0_1 compute influence of" << src.to_string() << " on " << npan << " panels");
+
+  auto start = std::chrono::system_clock::now();
+  float flops = (float)npan;
+
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const Vector<S>&                        vs = src.get_str();
+
+#ifdef USE_VC
+  if (env.get_instrs() == cpu_vc) {
+
+    // define vector types for Vc
+    typedef Vc::Vector<S> StoreVec;
+    typedef Vc::SimdArray<A, Vc::Vector<S>::size()> AccumVec;
+
+    // padding particles are far away with no strength
+    const Vc::Memory<StoreVec> sxv = stdvec_to_vcvec<S>(sx[0], 999.999f);
+    const Vc::Memory<StoreVec> syv = stdvec_to_vcvec<S>(sx[1], 999.999f);
+    const Vc::Memory<StoreVec> vsv = stdvec_to_vcvec<S>(vs,    0.0);
+
+    blocked_direct_sum<AccumVec,2>(npan, vsv.vectorsCount(), tile_sources/StoreVec::size(),
+      [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+        const StoreVec vtx0 = _ends[0][i];
+        const StoreVec vty0 = _ends[1][i];
+        const StoreVec vtx1 = _ends[2][i];
+        const StoreVec vty1 = _ends[3][i];
+        AccumVec resultu(0.0);
+        AccumVec resultv(0.0);
+        for (size_t j=jbeg; j<jend; ++j) {
+          kernelu_1v_0p<StoreVec,AccumVec>(vtx0, vty0, vtx1, vty1,
+                                           vsv.vector(j), sxv.vector(j), syv.vector(j),
+                                           &resultu, &resultv);
+          acc[0] += resultu;
+          acc[1] += resultv;
+        }
+      },
+      [&](const size_t i, const AccumVec* const acc) {
+        // but we use it backwards, so the resulting velocities are negative
+        const A plen = 1.0 / _area[i];
+        _vel[0][i] -= plen*acc[0].sum();
+        _vel[1][i] -= plen*acc[1].sum();
+      }, env.use_compensated_sums());
+  } else
+
+#endif  // no Vc
+#ifdef USE_STDSIMD
+  if (env.get_instrs() == cpu_simd) {
+
+    // portable vector types, accumulate in A as the Vc path does
+    typedef SimdVec<S> StoreVec;
+    typedef SimdAccum<S,A> AccumVec;
+
+    // padding particles are far away with no strength
+    const SimdMemory<S> sxv = stdvec_to_simdvec<S>(sx[0], 999.999f);
+    const SimdMemory<S> syv = stdvec_to_simdvec<S>(sx[1], 999.999f);
+    const SimdMemory<S> vsv = stdvec_to_simdvec<S>(vs,    0.0);
+
+    blocked_direct_sum<AccumVec,2>(npan, vsv.size(), tile_sources/StoreVec::size(),
+      [&](const size_t i, const size_t jbeg, const size_t jend, AccumVec* const acc) {
+        const StoreVec vtx0 = _ends[0][i];
+        const StoreVec vty0 = _ends[1][i];
+        const StoreVec vtx1 = _ends[2][i];
+        const StoreVec vty1 = _ends[3][i];
+        StoreVec resultu = 0.0f;
+        StoreVec resultv = 0.0f;
+        for (size_t j=jbeg; j<jend; ++j) {
+          kernelu_1v_0p<StoreVec,StoreVec>(vtx0, vty0, vtx1, vty1,
+                                           vsv[j], sxv[j], syv[j],
+                                           &resultu, &resultv);
+          acc[0] += resultu;
+          acc[1] += resultv;
+        }
+      },
+      [&](const size_t i, const AccumVec* const acc) {
+        const A plen = 1.0 / _area[i];
+        _vel[0][i] -= plen*acc[0].sum();
+        _vel[1][i] -= plen*acc[1].sum();
+      }, env.use_compensated_sums());
+  } else
+
+#endif  // no portable SIMD
+  {
+    blocked_direct_sum<A,2>(npan, src.get_n(), tile_sources,
+      [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+        A resultu = 0.0;
+        A resultv = 0.0;
+        for (size_t j=jbeg; j<jend; ++j) {
+          kernelu_1v_0p<S,A>(_ends[0][i], _ends[1][i], _ends[2][i], _ends[3][i],
+                             vs[j], sx[0][j], sx[1][j],
+                             &resultu, &resultv);
+          acc[0] += resultu;
+          acc[1] += resultv;
+        }
+      },
+      [&](const size_t i, const A* const acc) {
+        const A plen = 1.0 / _area[i];
+        _vel[0][i] -= plen*acc[0];
+        _vel[1][i] -= plen*acc[1];
+      }, env.use_compensated_sums());
+  }
+
+  flops *= 11.0 + (float)flopsu_1v_0p<S,A>() * (float)src.get_n();
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    points_affect_panel_list: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS("0_1", flops, elapsed_seconds.count());
+}
+
+
+//
+// Panels affecting Points in a periodic domain: the targets, brought into the period, see
+//   the panels and their images on either side exactly, and the rest of each row through
+//   periodic_images from the panel centers
+//
+template <class S, class A>
+void panels_affect_points_periodic (const Surfaces<S>& src, Points<S>& targ, const ResultsType& restype,
+                                    const ExecEnv& env, const char* _kernel) {
+
+  const PeriodicDomain& pd = env.get_periodic_domain();
+  const S L = (S)pd.period;
+  const size_t nt = targ.get_n();
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
+  std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
+
+  // one copy of the targets per image, moved the other way
+  std::vector<S> cx(3*Dimensions*nt);
+  for (size_t k=0; k<3; ++k) {
+    for (size_t i=0; i<nt; ++i) {
+      cx[Dimensions*(k*nt+i)]   = pd.wrap<S>(tx[0][i]) + ((S)k - 1.0) * L;
+      cx[Dimensions*(k*nt+i)+1] = tx[1][i];
+    }
+  }
+  Points<S> copies(ElementPacket<S>(cx, std::vector<Int>(), std::vector<S>(), 3*nt, 0),
+                   inert, lagrangian, nullptr, 0.0);
+  copies.zero_vels();
+  const bool do_grad = restype.compute_grad();
+  panels_affect_points<S,A>(src, copies, ResultsType(do_grad ? velandgrad : velonly), env, _kernel, false);
+
+  // the rest of each row
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const std::vector<Int>&                 si = src.get_idx();
+  const Vector<S>&                        sa = src.get_area();
+  const Vector<S>&                        vs = src.get_str();
+  const bool           have_source_strengths = src.have_src_str();
+  const Vector<S>&                        ss = src.get_src_str();
+  const std::array<Vector<S>,Dimensions>& cu = copies.get_vel();
+  const std::array<Vector<S>,4>* cg = do_grad ? &copies.get_velgrad() : nullptr;
+  std::array<Vector<S>,4>* tg = do_grad ? &targ.get_velgrad() : nullptr;
+
+  #pragma omp parallel for
+  for (int32_t i=0; i<(int32_t)nt; ++i) {
+    A accumu = 0.0;
+    A accumv = 0.0;
+    A accumux = 0.0;
+    A accumvx = 0.0;
+    for (size_t k=0; k<3; ++k) {
+      accumu += cu[0][k*nt+i];
+      accumv += cu[1][k*nt+i];
+    }
+    const double xi = pd.wrap<S>(tx[0][i]);
+    for (size_t j=0; j<src.get_npanels(); ++j) {
+      const double pcx = 0.5 * (sx[0][si[2*j]] + sx[0][si[2*j+1]]);
+      const double pcy = 0.5 * (sx[1][si[2*j]] + sx[1][si[2*j+1]]);
+      double rr, ri;
+      periodic_images(xi - pcx, tx[1][i] - pcy, pd.period, 1, &rr, &ri);
+      const double gam = vs[j] * sa[j];
+      const double sig = have_source_strengths ? ss[j] * sa[j] : 0.0;
+      accumu += (A)(gam*ri + sig*rr);
+      accumv += (A)(gam*rr - sig*ri);
+      if (do_grad) {
+        double gr, gi;
+        periodic_images_grad(xi - pcx, tx[1][i] - pcy, pd.period, 1, &gr, &gi);
+        accumux += (A)(gam*gi + sig*gr);
+        accumvx += (A)(gam*gr - sig*gi);
+      }
+    }
+    tu[0][i] += accumu;
+    tu[1][i] += accumv;
+    if (do_grad) {
+      for (size_t d=0; d<4; ++d) {
+        for (size_t k=0; k<3; ++k) (*tg)[d][i] += (*cg)[d][k*nt+i];
+      }
+      (*tg)[0][i] += accumux;
+      (*tg)[1][i] += accumvx;
+      (*tg)[2][i] += accumvx;
+      (*tg)[3][i] -= accumux;
+    }
+  }
+}
+
+//
+// Points affecting Panels in a periodic domain, likewise with the sources copied
+//
+template <class S, class A>
+void points_affect_panels_periodic (const Points<S>& src, Surfaces<S>& targ, const ResultsType& restype,
+                                    const ExecEnv& env) {
+
+  const PeriodicDomain& pd = env.get_periodic_domain();
+  const S L = (S)pd.period;
+  const size_t ns = src.get_n();
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const Vector<S>&                        vs = src.get_str();
+
+  // one copy of the sources per image
+  std::vector<S> cx(3*Dimensions*ns);
+  std::vector<S> cs(3*ns);
+  for (size_t k=0; k<3; ++k) {
+    for (size_t j=0; j<ns; ++j) {
+      cx[Dimensions*(k*ns+j)]   = pd.wrap<S>(sx[0][j]) + ((S)k - 1.0) * L;
+      cx[Dimensions*(k*ns+j)+1] = sx[1][j];
+      cs[k*ns+j] = vs[j];
+    }
+  }
+  Points<S> copies(ElementPacket<S>(cx, std::vector<Int>(), cs, 3*ns, 0),
+                   active, lagrangian, nullptr, 0.0);
+  points_affect_panels<S,A>(copies, targ, restype, env, false);
+
+  // the rest of each row, at the panel centers
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
+  const std::vector<Int>&                 ti = targ.get_idx();
+  std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
+
+  #pragma omp parallel for
+  for (int32_t i=0; i<(int32_t)targ.get_npanels(); ++i) {
+    const double pcx = 0.5 * (tx[0][ti[2*i]] + tx[0][ti[2*i+1]]);
+    const double pcy = 0.5 * (tx[1][ti[2*i]] + tx[1][ti[2*i+1]]);
+    A accumu = 0.0;
+    A accumv = 0.0;
+    for (size_t j=0; j<ns; ++j) {
+      double rr, ri;
+      periodic_images(pcx - pd.wrap<S>(sx[0][j]), pcy - sx[1][j], pd.period, 1, &rr, &ri);
+      accumu += (A)(vs[j] * ri);
+      accumv += (A)(vs[j] * rr);
+    }
+    tu[0][i] += accumu;
+    tu[1][i] += accumv;
+  }
+}
+
+
+//
+// Points/Particles and their images in a symmetry plane affecting Points/Particles: direct
+//   sums take both in one kernel, the fast sums run again from the mirrored targets
+//
+template <class S, class A, VelCore C>
+void points_affect_points_mirror (const Points<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+
+  LOG_DEBUG("    0v_0" << (targ.is_inert() ? "p" : "v") << " mirrored influence of" << src.to_string() << " on" << targ.to_string());
+  auto start = std::chrono::system_clock::now();
+  float flops = (float)targ.get_n();
+
+  const SymmetryPlane& sp = env.get_symmetry_plane();
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const Vector<S>&                        sr = src.get_rad();
+  const Vector<S>&                        ss = src.get_str();
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
+  std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
+  const bool thick = not targ.is_inert();
+  const Vector<S>& tr = targ.get_rad();
+  const size_t nt = targ.get_n();
+
+  if (env.get_summation() != direct and src.get_n() > 4*env.get_leaf_size()) {
+    points_affect_points_core<S,A,C>(src, targ, restype, env, false);
+
+    // the images' velocity is the stored half's, reflected, at the mirrored targets
+    std::vector<S> cx(Dimensions*nt);
+    for (size_t i=0; i<nt; ++i) {
+      cx[Dimensions*i]   = tx[0][i];
+      cx[Dimensions*i+1] = sp.mirror<S>(tx[1][i]);
+    }
+    Points<S> copies(ElementPacket<S>(cx, std::vector<Int>(), thick ? std::vector<S>(nt, 0.0) : std::vector<S>(), nt, 0),
+                     thick ? active : inert, lagrangian, nullptr, 0.0);
+    if (thick) copies.get_rad() = tr;
+    copies.zero_vels();
+    const bool do_grad = restype.compute_grad();
+    points_affect_points_core<S,A,C>(src, copies, ResultsType(do_grad ? velandgrad : velonly), env, false);
+
+    const std::array<Vector<S>,Dimensions>& cu = copies.get_vel();
+    for (size_t i=0; i<nt; ++i) {
+      tu[0][i] += cu[0][i];
+      tu[1][i] -= cu[1][i];
+    }
+    // and the gradients reflect too, those taken across the plane changing sign again
+    if (do_grad) {
+      std::array<Vector<S>,4>& tg = targ.get_velgrad();
+      const std::array<Vector<S>,4>& cg = copies.get_velgrad();
+      for (size_t i=0; i<nt; ++i) {
+        tg[0][i] += cg[0][i];
+        tg[1][i] -= cg[1][i];
+        tg[2][i] -= cg[2][i];
+        tg[3][i] += cg[3][i];
+      }
+    }
+    return;
+  }
+
+  const S yp = (S)sp.get_yp();
+  if (restype.compute_grad()) {
+    std::array<Vector<S>,4>& tg = targ.get_velgrad();
+    blocked_direct_sum<A,6>(nt, src.get_n(), tile_sources,
+      [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+        for (size_t j=jbeg; j<jend; ++j) {
+          if (thick) kernelug_0v_0b_mirror<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], tx[0][i], tx[1][i], tr[i], yp,
+                                                &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+          else       kernelug_0v_0p_mirror<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], tx[0][i], tx[1][i], yp,
+                                                &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+        }
+      },
+      [&](const size_t i, const A* const acc) {
+        tu[0][i] += acc[0];
+        tu[1][i] += acc[1];
+        for (size_t k=0; k<4; ++k) tg[k][i] += acc[k+2];
+      }, env.use_compensated_sums());
+    flops *= 6.0 + (float)(thick ? flopsug_0v_0b_mirror<S,A,C>() : flopsug_0v_0p_mirror<S,A,C>()) * (float)src.get_n();
+  } else if (restype.compute_vort() and targ.has_vort()) {
+    Vector<S>& tw = targ.get_vort();
+    blocked_direct_sum<A,3>(nt, src.get_n(), tile_sources,
+      [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+        for (size_t j=jbeg; j<jend; ++j) {
+          if (thick) kerneluw_0v_0b_mirror<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], tx[0][i], tx[1][i], tr[i], yp,
+                                                &acc[0], &acc[1], &acc[2]);
+          else       kerneluw_0v_0p_mirror<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], tx[0][i], tx[1][i], yp,
+                                                &acc[0], &acc[1], &acc[2]);
+        }
+      },
+      [&](const size_t i, const A* const acc) {
+        tu[0][i] += acc[0];
+        tu[1][i] += acc[1];
+        tw[i] += acc[2];
+      }, env.use_compensated_sums());
+    flops *= 3.0 + (float)(thick ? flopsuw_0v_0b_mirror<S,A,C>() : flopsuw_0v_0p_mirror<S,A,C>()) * (float)src.get_n();
+  } else {
+    blocked_direct_sum<A,2>(nt, src.get_n(), tile_sources,
+      [&](const size_t i, const size_t jbeg, const size_t jend, A* const acc) {
+        for (size_t j=jbeg; j<jend; ++j) {
+          if (thick) kernelu_0v_0b_mirror<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], tx[0][i], tx[1][i], tr[i], yp,
+                                               &acc[0], &acc[1]);
+          else       kernelu_0v_0p_mirror<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], tx[0][i], tx[1][i], yp,
+                                               &acc[0], &acc[1]);
+        }
+      },
+      [&](const size_t i, const A* const acc) {
+        tu[0][i] += acc[0];
+        tu[1][i] += acc[1];
+      }, env.use_compensated_sums());
+    flops *= 2.0 + (float)(thick ? flopsu_0v_0b_mirror<S,A,C>() : flopsu_0v_0p_mirror<S,A,C>()) * (float)src.get_n();
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    points_affect_points_mirror: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS((targ.is_inert() ? "0v_0p" : "0v_0v"), flops, elapsed_seconds.count());
 }
 
+//
+// The images of Panels in a symmetry plane affecting Points, from the mirrored targets
+//
+template <class S, class A>
+void panels_affect_points_mirror (const Surfaces<S>& src, Points<S>& targ, const ResultsType& restype,
+                                  const ExecEnv& env, const char* _kernel) {
+
+  const SymmetryPlane& sp = env.get_symmetry_plane();
+  const size_t nt = targ.get_n();
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
+  std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
+
+  std::vector<S> cx(Dimensions*nt);
+  for (size_t i=0; i<nt; ++i) {
+    cx[Dimensions*i]   = tx[0][i];
+    cx[Dimensions*i+1] = sp.mirror<S>(tx[1][i]);
+  }
+  Points<S> copies(ElementPacket<S>(cx, std::vector<Int>(), std::vector<S>(), nt, 0),
+                   inert, lagrangian, nullptr, 0.0);
+  copies.zero_vels();
+  const bool do_grad = restype.compute_grad();
+  panels_affect_points<S,A>(src, copies, ResultsType(do_grad ? velandgrad : velonly), env, _kernel, false);
+
+  const std::array<Vector<S>,Dimensions>& cu = copies.get_vel();
+  for (size_t i=0; i<nt; ++i) {
+    tu[0][i] += cu[0][i];
+    tu[1][i] -= cu[1][i];
+  }
+  if (do_grad) {
+    std::array<Vector<S>,4>& tg = targ.get_velgrad();
+    const std::array<Vector<S>,4>& cg = copies.get_velgrad();
+    for (size_t i=0; i<nt; ++i) {
+      tg[0][i] += cg[0][i];
+      tg[1][i] -= cg[1][i];
+      tg[2][i] -= cg[2][i];
+      tg[3][i] += cg[3][i];
+    }
+  }
+}
+
+//
+// The images of Points in a symmetry plane affecting Panels, as mirrored sources
+//
+template <class S, class A>
+void points_affect_panels_mirror (const Points<S>& src, Surfaces<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+
+  const SymmetryPlane& sp = env.get_symmetry_plane();
+  const size_t ns = src.get_n();
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const Vector<S>&                        vs = src.get_str();
+
+  std::vector<S> cx(Dimensions*ns);
+  std::vector<S> cs(ns);
+  for (size_t j=0; j<ns; ++j) {
+    cx[Dimensions*j]   = sx[0][j];
+    cx[Dimensions*j+1] = sp.mirror<S>(sx[1][j]);
+    cs[j] = -vs[j];
+  }
+  Points<S> copies(ElementPacket<S>(cx, std::vector<Int>(), cs, ns, 0),
+                   active, lagrangian, nullptr, 0.0);
+  points_affect_panels<S,A>(copies, targ, restype, env, false);
+}
 
 template <class S, class A>
 void panels_affect_panels (const Surfaces<S>& src, Surfaces<S>& targ, const ResultsType& restype, const ExecEnv& env) {
-  std::cout << "    1_1 compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    1_1 compute influence of" << src.to_string() << " on" << targ.to_string());
   assert (!restype.compute_psi() && "Surface elements cannot compute streamfunction yet.");
   assert (!restype.compute_grad() && "Surface elements cannot compute velocity gradients yet.");
 
@@ -675,10 +2186,10 @@ void panels_affect_panels (const Surfaces<S>& src, Surfaces<S>& targ, const Resu
 
   // generate temporary colocation points as Points - is this inefficient?
   ElementPacket<S> surfaspts = targ.represent_as_particles(0.0001);
-  Points<float> temppts(surfaspts, active, lagrangian, nullptr, 0.0001);
+  Points<S> temppts(surfaspts, active, lagrangian, nullptr, 0.0001);
 
   // run the calculation
-  panels_affect_points<S,A>(src, temppts, restype, env);
+  panels_affect_points<S,A>(src, temppts, restype, env, "1_1");
 
   // and add the velocities to the real target
   const std::array<Vector<S>,Dimensions>& fromvel = temppts.get_vel();
@@ -691,10 +2202,23 @@ void panels_affect_panels (const Surfaces<S>& src, Surfaces<S>& targ, const Resu
 
 template <class S, class A>
 void bricks_affect_panels (const Volumes<S>& src, Surfaces<S>& targ, const ResultsType& restype, const ExecEnv& env) {
-  std::cout << "    2_1 compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
-  assert (false && "Volume elements cannot affect panels yet.");
+  LOG_DEBUG("    2_1 compute influence of" << src.to_string() << " on" << targ.to_string());
   assert (!restype.compute_psi() && "Volume elements cannot compute streamfunction yet.");
   assert (!restype.compute_grad() && "Volume elements cannot compute velocity gradients yet.");
+
+  if (not src.has_src_vort()) return;
+
+  // run bricks_affect_points instead, as panels_affect_panels does
+  ElementPacket<S> surfaspts = targ.represent_as_particles(0.0001);
+  Points<S> temppts(surfaspts, active, lagrangian, nullptr, 0.0001);
+  bricks_affect_points<S,A>(src, temppts, restype, env);
+
+  // and add the velocities to the real target
+  const std::array<Vector<S>,Dimensions>& fromvel = temppts.get_vel();
+  std::array<Vector<S>,Dimensions>& tovel   = targ.get_vel();
+  for (size_t i=0; i<Dimensions; ++i) {
+    std::transform(tovel[i].begin( ), tovel[i].end( ), fromvel[i].begin( ), tovel[i].begin( ), std::plus<S>( ));
+  }
 }
 
 
@@ -703,8 +2227,8 @@ void bricks_affect_panels (const Volumes<S>& src, Surfaces<S>& targ, const Resul
 
 template <class S, class A>
 void points_affect_bricks (const Points<S>& src, Volumes<S>& targ, const ResultsType& restype, const ExecEnv& env) {
-  std::cout << "    in ptvol with" << env.to_string() << std::endl;
-  std::cout << "    0_2 compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    in ptvol with" << env.to_string());
+  LOG_DEBUG("    0_2 compute influence of" << src.to_string() << " on" << targ.to_string());
   //assert (false && "Points cannot affect Volumes yet.");
   assert (!restype.compute_psi() && "Point elements cannot compute streamfunction yet.");
   assert (!restype.compute_grad() && "Point elements cannot compute velocity gradients yet.");
@@ -740,8 +2264,8 @@ void points_affect_bricks (const Points<S>& src, Volumes<S>& targ, const Results
 
 template <class S, class A>
 void panels_affect_bricks (const Surfaces<S>& src, Volumes<S>& targ, const ResultsType& soln, const ExecEnv& env) {
-  std::cout << "    in panvol with" << env.to_string() << std::endl;
-  std::cout << "    1_2 compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    in panvol with" << env.to_string());
+  LOG_DEBUG("    1_2 compute influence of" << src.to_string() << " on" << targ.to_string());
   assert (!soln.compute_psi() && "Surface elements cannot compute streamfunction yet.");
   assert (!soln.compute_grad() && "Surface elements cannot compute velocity gradients yet.");
 
@@ -764,7 +2288,7 @@ void panels_affect_bricks (const Surfaces<S>& src, Volumes<S>& targ, const Resul
 
 template <class S, class A>
 void bricks_affect_bricks (const Volumes<S>& src, Volumes<S>& targ, const ResultsType& restype, const ExecEnv& env) {
-  std::cout << "    2_2 compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+  LOG_DEBUG("    2_2 compute influence of" << src.to_string() << " on" << targ.to_string());
   assert (false && "Volume elements cannot affect themselves yet.");
   assert (!restype.compute_psi() && "Volume elements cannot compute streamfunction yet.");
   assert (!restype.compute_grad() && "Volume elements cannot compute velocity gradients yet.");
@@ -773,23 +2297,33 @@ void bricks_affect_bricks (const Volumes<S>& src, Volumes<S>& targ, const Result
 
 // ==========================================================================================================
 
+// picks the summation per pair, see AutoTune.h
+template <class S, class A> class BackendTuner;
+
 //
 // helper struct for dispatching through a variant
 //
 template <class A>
 struct InfluenceVisitor {
   // source collection, target collection, solution type, execution environment
-  void operator()(const Points<float>& src,   Points<float>& targ)   { points_affect_points<float,A>(src, targ, restype, env); }
-  void operator()(const Surfaces<float>& src, Points<float>& targ)   { panels_affect_points<float,A>(src, targ, restype, env); }
-  void operator()(const Volumes<float>& src,  Points<float>& targ)   { bricks_affect_points<float,A>(src, targ, restype, env); }
-  void operator()(const Points<float>& src,   Surfaces<float>& targ) { points_affect_panels<float,A>(src, targ, restype, env); }
-  void operator()(const Surfaces<float>& src, Surfaces<float>& targ) { panels_affect_panels<float,A>(src, targ, restype, env); }
-  void operator()(const Volumes<float>& src,  Surfaces<float>& targ) { bricks_affect_panels<float,A>(src, targ, restype, env); }
-  void operator()(const Points<float>& src,   Volumes<float>& targ)  { points_affect_bricks<float,A>(src, targ, restype, env); }
-  void operator()(const Surfaces<float>& src, Volumes<float>& targ)  { panels_affect_bricks<float,A>(src, targ, restype, env); }
-  void operator()(const Volumes<float>& src,  Volumes<float>& targ)  { bricks_affect_bricks<float,A>(src, targ, restype, env); }
+  void operator()(const Points<STORE>& src,   Points<STORE>& targ)   {
+    if (tuner) tuner->points_on_points(src, targ, restype, env);
+    else points_affect_points<STORE,A>(src, targ, restype, env); }
+  void operator()(const Surfaces<STORE>& src, Points<STORE>& targ)   {
+    if (tuner) tuner->panels_on_points(src, targ, restype, env);
+    else panels_affect_points<STORE,A>(src, targ, restype, env); }
+  void operator()(const Volumes<STORE>& src,  Points<STORE>& targ)   { bricks_affect_points<STORE,A>(src, targ, restype, env); }
+  void operator()(const Points<STORE>& src,   Surfaces<STORE>& targ) {
+    if (tuner) tuner->points_on_panels(src, targ, restype, env);
+    else points_affect_panels<STORE,A>(src, targ, restype, env); }
+  void operator()(const Surfaces<STORE>& src, Surfaces<STORE>& targ) { panels_affect_panels<STORE,A>(src, targ, restype, env); }
+  void operator()(const Volumes<STORE>& src,  Surfaces<STORE>& targ) { bricks_affect_panels<STORE,A>(src, targ, restype, env); }
+  void operator()(const Points<STORE>& src,   Volumes<STORE>& targ)  { points_affect_bricks<STORE,A>(src, targ, restype, env); }
+  void operator()(const Surfaces<STORE>& src, Volumes<STORE>& targ)  { panels_affect_bricks<STORE,A>(src, targ, restype, env); }
+  void operator()(const Volumes<STORE>& src,  Volumes<STORE>& targ)  { bricks_affect_bricks<STORE,A>(src, targ, restype, env); }
 
   ResultsType restype;
   ExecEnv env;
+  BackendTuner<STORE,A>* tuner = nullptr;
 };
 
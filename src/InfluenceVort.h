@@ -14,6 +14,7 @@
 #include "Surfaces.h"
 #include "ResultsType.h"
 #include "ExecEnv.h"
+#include "Logger.h"
 
 #ifdef USE_VC
 #include <Vc/Vc>
@@ -34,7 +35,7 @@
 template <class S, class A>
 void points_affect_points_vorticity (const Points<S>& src, Points<S>& targ, const ExecEnv& env) {
 
-  std::cout << "    in ptptvort with" << env.to_string() << std::endl;
+  LOG_DEBUG("    in ptptvort with" << env.to_string());
 
   auto start = std::chrono::system_clock::now();
   float flops = (float)targ.get_n();
@@ -53,7 +54,7 @@ void points_affect_points_vorticity (const Points<S>& src, Points<S>& targ, cons
   //
   // targets are field points, with no core radius ===============================================
   //
-    std::cout << "    0v_0p compute influence of" << src.to_string() << " on" << targ.to_string() << std::endl;
+    LOG_DEBUG("    0v_0p compute influence of" << src.to_string() << " on" << targ.to_string());
     // targets are field points
 
 #ifdef USE_VC
@@ -63,11 +64,12 @@ void points_affect_points_vorticity (const Points<S>& src, Points<S>& targ, cons
       typedef Vc::Vector<S> StoreVec;
       typedef Vc::SimdArray<A, Vc::Vector<S>::size()> AccumVec;
 
-      // initialize float_v versions of the source vectors
-      Vc::Memory<StoreVec> sxv = stdvec_to_vcvec<S>(sx[0], 0.0);
-      Vc::Memory<StoreVec> syv = stdvec_to_vcvec<S>(sx[1], 0.0);
-      Vc::Memory<StoreVec> srv = stdvec_to_vcvec<S>(sr,    1.0);
-      Vc::Memory<StoreVec> ssv = stdvec_to_vcvec<S>(ss,    0.0);
+      // float_v versions of the source vectors, kept by the collection between calls
+      const auto& vcsrc = src.get_vc_sources();
+      const Vc::Memory<StoreVec>& sxv = vcsrc.x;
+      const Vc::Memory<StoreVec>& syv = vcsrc.y;
+      const Vc::Memory<StoreVec>& srv = vcsrc.r;
+      const Vc::Memory<StoreVec>& ssv = vcsrc.s;
 
         #pragma omp parallel for
         for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
@@ -108,8 +110,7 @@ void points_affect_points_vorticity (const Points<S>& src, Points<S>& targ, cons
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
-  const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-  printf("    points_affect_points_vorticity: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+  LOG_DEBUG("    points_affect_points_vorticity: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
 }
 
 
@@ -119,7 +120,7 @@ void points_affect_points_vorticity (const Points<S>& src, Points<S>& targ, cons
 template <class S>
 Vector<S> points_on_points_vort_coeff (Points<S> const& src, Points<S>& targ, const ExecEnv& env) {
 
-  std::cout << "    in ptptvortcoeff with" << env.to_string() << std::endl;
+  LOG_DEBUG("    in ptptvortcoeff with" << env.to_string());
 
   auto start = std::chrono::system_clock::now();
   float flops = (float)targ.get_n();
@@ -136,7 +137,7 @@ Vector<S> points_on_points_vort_coeff (Points<S> const& src, Points<S>& targ, co
   //
   // targets are field points, with no core radius ===============================================
   //
-    std::cout << "    0v_0p compute coeffs of" << src.to_string() << " on" << targ.to_string() << std::endl;
+    LOG_DEBUG("    0v_0p compute coeffs of" << src.to_string() << " on" << targ.to_string());
     // targets are field points
 
     {
@@ -157,6 +158,5 @@ Vector<S> points_on_points_vort_coeff (Points<S> const& src, Points<S>& targ, co
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
-  const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-  printf("    points_on_points_vort_coeff: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+  LOG_DEBUG("    points_on_points_vort_coeff: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
 }
@@ -7,6 +7,8 @@
 
 #include "JsonHelper.h"
 #include "Body.h"
+#include "Logger.h"
+#include "Profiler.h"
 
 #include "json/json.hpp"
 
@@ -76,6 +78,11 @@ void parse_json(Simulation& sim,
       sim.set_status_file_name(sfile);
       std::cout << "  status file name= " << sfile << std::endl;
     }
+    if (params.find("statusFormat") != params.end()) {
+      std::string sfmt = params["statusFormat"];
+      sim.set_status_file_format(sfmt);
+      std::cout << "  status file format= " << sim.get_status_file_format() << std::endl;
+    }
     if (params.find("autoStart") != params.end()) {
       bool autostart = params["autoStart"];
       sim.set_auto_start(autostart);
@@ -86,6 +93,30 @@ void parse_json(Simulation& sim,
       sim.set_quit_on_stop(qos);
       std::cout << "  quit on stop? " << qos << std::endl;
     }
+    if (params.find("logLevel") != params.end()) {
+      std::string lvl = params["logLevel"];
+      Logger::get().set_level(lvl);
+      std::cout << "  log level= " << Logger::get().get_level_name() << std::endl;
+      if (Logger::get().get_level() > LOG_MAX_LEVEL) {
+        std::cout << "  messages past " << lvl << " were not built in, rebuild with a higher LOG_LEVEL" << std::endl;
+      }
+    }
+    if (params.find("peakGflops") != params.end()) {
+      const double peak = params["peakGflops"];
+      Profiler::get().set_peak_gflops(peak);
+      std::cout << "  peak GFlop/s= " << Profiler::get().get_peak_gflops() << std::endl;
+    }
+    if (params.find("traceFile") != params.end()) {
+      std::string tfile = params["traceFile"];
+      const int tsteps = params.value("traceSteps", 10);
+#ifdef USE_PROFILER
+      PROFILE_START_TRACE(tfile, tsteps);
+      std::cout << "  trace file name= " << tfile << " for " << tsteps << " steps" << std::endl;
+#else
+      (void) tsteps;
+      std::cout << "  no trace to " << tfile << ", rebuild with USE_PROFILER" << std::endl;
+#endif
+    }
   }
 
   // must do this first, as we need to set viscous before reading Re
@@ -93,9 +124,11 @@ void parse_json(Simulation& sim,
     sim.from_json(j["simparams"]);
   }
 
-  // now we can read Re, freestream
+  // now we can read Re, freestream; the domain is per case, so always reset it
   if (j.count("flowparams") == 1) {
     sim.flow_from_json(j["flowparams"]);
+  } else {
+    sim.flow_from_json(nlohmann::json::object());
   }
 
   // ask RenderParams to read itself
@@ -170,6 +203,11 @@ void parse_json(Simulation& sim,
         }
       }
 
+      // or the motion comes from a structural solver, see Coupling.h
+      if (bdy.find("coupling") != bdy.end()) {
+        bp->set_coupling(make_coupling(bdy["coupling"]));
+      }
+
       // see if there are meshes (there don't have to be - a Body can just act as a virtual joint
       if (bdy.count("meshes") == 1) {
         //std::cout << "  found the meshes" << std::endl;
@@ -234,7 +272,10 @@ void write_json(Simulation& sim,
   const std::string sfile = sim.get_status_file_name();
   if (not sfile.empty()) {
     j["runtime"] = { {"statusFile", sfile} };
+    if (sim.get_status_file_format() != "text") j["runtime"]["statusFormat"] = sim.get_status_file_format();
   }
+  if (Logger::get().get_level() != log_info) j["runtime"]["logLevel"] = Logger::get().get_level_name();
+  if (Profiler::get().get_peak_gflops() > 0.0) j["runtime"]["peakGflops"] = Profiler::get().get_peak_gflops();
 
   j["flowparams"] = sim.flow_to_json();
 
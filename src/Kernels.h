@@ -37,7 +37,7 @@
 //
 
 // thick-cored particle on thick-cored point
-template <class S, class A> size_t flopsp_0v_0b () { return 10 + flops_tv_nograds<S>(); }
+template <class S, class A> size_t flopsp_0v_0b () { return 10 + flops_tv_nograds<S,default_vel_core>(); }
 template <class S, class A>
 static inline void kernelp_0v_0b (const S sx, const S sy, const S sr, const S ss,
                                   const S tx, const S ty, const S tr,
@@ -49,7 +49,7 @@ static inline void kernelp_0v_0b (const S sx, const S sy, const S sr, const S ss
 }
 
 // thick-cored particle on singular point
-template <class S, class A> size_t flopsp_0v_0p () { return 10 + flops_tp_nograds<S>(); }
+template <class S, class A> size_t flopsp_0v_0p () { return 10 + flops_tp_nograds<S,default_vel_core>(); }
 template <class S, class A>
 static inline void kernelp_0v_0p (const S sx, const S sy, const S sr, const S ss,
                                   const S tx, const S ty,
@@ -65,29 +65,29 @@ static inline void kernelp_0v_0p (const S sx, const S sy, const S sr, const S ss
 //
 
 // thick-cored particle on thick-cored point, no gradients
-template <class S, class A> size_t flopsu_0v_0b () { return 10 + flops_tv_nograds<S>(); }
-template <class S, class A>
+template <class S, class A, VelCore C> size_t flopsu_0v_0b () { return 10 + flops_tv_nograds<S,C>(); }
+template <class S, class A, VelCore C>
 static inline void kernelu_0v_0b (const S sx, const S sy, const S sr, const S ss,
                                   const S tx, const S ty, const S tr,
                                   A* const __restrict__ tu, A* const __restrict__ tv) {
   // 18 flops
   const S dx = tx - sx;
   const S dy = ty - sy;
-  const S r2 = ss * core_func<S>(dx*dx + dy*dy, sr, tr);
+  const S r2 = ss * core_func<S,C>(dx*dx + dy*dy, sr, tr);
   *tu -= r2 * dy;
   *tv += r2 * dx;
 }
 
 // thick-cored particle on singular point, no gradients
-template <class S, class A> size_t flopsu_0v_0p () { return 10 + flops_tp_nograds<S>(); }
-template <class S, class A>
+template <class S, class A, VelCore C> size_t flopsu_0v_0p () { return 10 + flops_tp_nograds<S,C>(); }
+template <class S, class A, VelCore C>
 static inline void kernelu_0v_0p (const S sx, const S sy, const S sr, const S ss,
                                   const S tx, const S ty,
                                   A* const __restrict__ tu, A* const __restrict__ tv) {
   // 16 flops
   const S dx = tx - sx;
   const S dy = ty - sy;
-  const S r2 = ss * core_func<S>(dx*dx + dy*dy, sr);
+  const S r2 = ss * core_func<S,C>(dx*dx + dy*dy, sr);
   *tu -= r2 * dy;
   *tv += r2 * dx;
 }
@@ -96,8 +96,8 @@ static inline void kernelu_0v_0p (const S sx, const S sy, const S sr, const S ss
 // Velocity gradient kernels
 //
 
-template <class S, class A> size_t flopsug_0v_0b () { return 25 + flops_tv_grads<S>(); }
-template <class S, class A>
+template <class S, class A, VelCore C> size_t flopsug_0v_0b () { return 25 + flops_tv_grads<S,C>(); }
+template <class S, class A, VelCore C>
 static inline void kernelug_0v_0b (const S sx, const S sy, const S sr, const S ss,
                                    const S tx, const S ty, const S tr,
                                    A* const __restrict__ tu, A* const __restrict__ tv,
@@ -107,7 +107,7 @@ static inline void kernelug_0v_0b (const S sx, const S sy, const S sr, const S s
   const S dx = tx - sx;
   const S dy = ty - sy;
   S r2, bbb;
-  (void) core_func<S>(dx*dx + dy*dy, sr, tr, &r2, &bbb);
+  (void) core_func<S,C>(dx*dx + dy*dy, sr, tr, &r2, &bbb);
   r2 *= ss;
   bbb *= ss;
   *tu -= r2 * dy;
@@ -119,8 +119,31 @@ static inline void kernelug_0v_0b (const S sx, const S sy, const S sr, const S s
   *tvy +=  bbb*dx*dy;
 }
 
-template <class S, class A> size_t flopsuw_0v_0p () { return 19 + flops_tp_grads<S>(); }
-template <class S, class A>
+template <class S, class A, VelCore C> size_t flopsug_0v_0p () { return 25 + flops_tp_grads<S,C>(); }
+template <class S, class A, VelCore C>
+static inline void kernelug_0v_0p (const S sx, const S sy, const S sr, const S ss,
+                                   const S tx, const S ty,
+                                   A* const __restrict__ tu, A* const __restrict__ tv,
+                                   A* const __restrict__ tux, A* const __restrict__ tvx,
+                                   A* const __restrict__ tuy, A* const __restrict__ tvy) {
+  // 25 flops without core_func
+  const S dx = tx - sx;
+  const S dy = ty - sy;
+  S r2, bbb;
+  (void) core_func<S,C>(dx*dx + dy*dy, sr, &r2, &bbb);
+  r2 *= ss;
+  bbb *= ss;
+  *tu -= r2 * dy;
+  *tv += r2 * dx;
+  // and the grads
+  *tux += -bbb*dx*dy;
+  *tuy += -bbb*dy*dy - r2;
+  *tvx +=  bbb*dx*dx + r2;
+  *tvy +=  bbb*dx*dy;
+}
+
+template <class S, class A, VelCore C> size_t flopsuw_0v_0p () { return 19 + flops_tp_grads<S,C>(); }
+template <class S, class A, VelCore C>
 static inline void kerneluw_0v_0p (const S sx, const S sy, const S sr, const S ss,
                                    const S tx, const S ty,
                                    A* const __restrict__ tu, A* const __restrict__ tv,
@@ -129,7 +152,7 @@ static inline void kerneluw_0v_0p (const S sx, const S sy, const S sr, const S s
   const S dx = tx - sx;
   const S dy = ty - sy;
   S r2, bbb;
-  (void) core_func<S>(dx*dx + dy*dy, sr, &r2, &bbb);
+  (void) core_func<S,C>(dx*dx + dy*dy, sr, &r2, &bbb);
   r2 *= ss;
   bbb *= ss;
   *tu -= r2 * dy;
@@ -140,8 +163,8 @@ static inline void kerneluw_0v_0p (const S sx, const S sy, const S sr, const S s
   *tw += dvdx - dudy;
 }
 
-template <class S, class A> size_t flopsuw_0v_0b () { return 19 + flops_tv_grads<S>(); }
-template <class S, class A>
+template <class S, class A, VelCore C> size_t flopsuw_0v_0b () { return 19 + flops_tv_grads<S,C>(); }
+template <class S, class A, VelCore C>
 static inline void kerneluw_0v_0b (const S sx, const S sy, const S sr, const S ss,
                                    const S tx, const S ty, const S tr,
                                    A* const __restrict__ tu, A* const __restrict__ tv,
@@ -150,7 +173,7 @@ static inline void kerneluw_0v_0b (const S sx, const S sy, const S sr, const S s
   const S dx = tx - sx;
   const S dy = ty - sy;
   S r2, bbb;
-  (void) core_func<S>(dx*dx + dy*dy, sr, tr, &r2, &bbb);
+  (void) core_func<S,C>(dx*dx + dy*dy, sr, tr, &r2, &bbb);
   r2 *= ss;
   bbb *= ss;
   *tu -= r2 * dy;
@@ -162,6 +185,70 @@ static inline void kerneluw_0v_0b (const S sx, const S sy, const S sr, const S s
 }
 
 
+//
+// Mirrored velocity kernels: the particle plus its image in a symmetry plane, which has the
+//   opposite strength; yp is twice the height of the plane, so the image sits at yp-sy
+//
+template <class S, class A, VelCore C> size_t flopsu_0v_0p_mirror () { return 2 + 2*flopsu_0v_0p<S,A,C>(); }
+template <class S, class A, VelCore C>
+static inline void kernelu_0v_0p_mirror (const S sx, const S sy, const S sr, const S ss,
+                                         const S tx, const S ty, const S yp,
+                                         A* const __restrict__ tu, A* const __restrict__ tv) {
+  kernelu_0v_0p<S,A,C>(sx, sy,    sr,  ss, tx, ty, tu, tv);
+  kernelu_0v_0p<S,A,C>(sx, yp-sy, sr, -ss, tx, ty, tu, tv);
+}
+
+template <class S, class A, VelCore C> size_t flopsu_0v_0b_mirror () { return 2 + 2*flopsu_0v_0b<S,A,C>(); }
+template <class S, class A, VelCore C>
+static inline void kernelu_0v_0b_mirror (const S sx, const S sy, const S sr, const S ss,
+                                         const S tx, const S ty, const S tr, const S yp,
+                                         A* const __restrict__ tu, A* const __restrict__ tv) {
+  kernelu_0v_0b<S,A,C>(sx, sy,    sr,  ss, tx, ty, tr, tu, tv);
+  kernelu_0v_0b<S,A,C>(sx, yp-sy, sr, -ss, tx, ty, tr, tu, tv);
+}
+
+template <class S, class A, VelCore C> size_t flopsuw_0v_0p_mirror () { return 2 + 2*flopsuw_0v_0p<S,A,C>(); }
+template <class S, class A, VelCore C>
+static inline void kerneluw_0v_0p_mirror (const S sx, const S sy, const S sr, const S ss,
+                                          const S tx, const S ty, const S yp,
+                                          A* const __restrict__ tu, A* const __restrict__ tv,
+                                          A* const __restrict__ tw) {
+  kerneluw_0v_0p<S,A,C>(sx, sy,    sr,  ss, tx, ty, tu, tv, tw);
+  kerneluw_0v_0p<S,A,C>(sx, yp-sy, sr, -ss, tx, ty, tu, tv, tw);
+}
+
+template <class S, class A, VelCore C> size_t flopsuw_0v_0b_mirror () { return 2 + 2*flopsuw_0v_0b<S,A,C>(); }
+template <class S, class A, VelCore C>
+static inline void kerneluw_0v_0b_mirror (const S sx, const S sy, const S sr, const S ss,
+                                          const S tx, const S ty, const S tr, const S yp,
+                                          A* const __restrict__ tu, A* const __restrict__ tv,
+                                          A* const __restrict__ tw) {
+  kerneluw_0v_0b<S,A,C>(sx, sy,    sr,  ss, tx, ty, tr, tu, tv, tw);
+  kerneluw_0v_0b<S,A,C>(sx, yp-sy, sr, -ss, tx, ty, tr, tu, tv, tw);
+}
+
+template <class S, class A, VelCore C> size_t flopsug_0v_0p_mirror () { return 2 + 2*flopsug_0v_0p<S,A,C>(); }
+template <class S, class A, VelCore C>
+static inline void kernelug_0v_0p_mirror (const S sx, const S sy, const S sr, const S ss,
+                                          const S tx, const S ty, const S yp,
+                                          A* const __restrict__ tu, A* const __restrict__ tv,
+                                          A* const __restrict__ tux, A* const __restrict__ tvx,
+                                          A* const __restrict__ tuy, A* const __restrict__ tvy) {
+  kernelug_0v_0p<S,A,C>(sx, sy,    sr,  ss, tx, ty, tu, tv, tux, tvx, tuy, tvy);
+  kernelug_0v_0p<S,A,C>(sx, yp-sy, sr, -ss, tx, ty, tu, tv, tux, tvx, tuy, tvy);
+}
+
+template <class S, class A, VelCore C> size_t flopsug_0v_0b_mirror () { return 2 + 2*flopsug_0v_0b<S,A,C>(); }
+template <class S, class A, VelCore C>
+static inline void kernelug_0v_0b_mirror (const S sx, const S sy, const S sr, const S ss,
+                                          const S tx, const S ty, const S tr, const S yp,
+                                          A* const __restrict__ tu, A* const __restrict__ tv,
+                                          A* const __restrict__ tux, A* const __restrict__ tvx,
+                                          A* const __restrict__ tuy, A* const __restrict__ tvy) {
+  kernelug_0v_0b<S,A,C>(sx, sy,    sr,  ss, tx, ty, tr, tu, tv, tux, tvx, tuy, tvy);
+  kernelug_0v_0b<S,A,C>(sx, yp-sy, sr, -ss, tx, ty, tr, tu, tv, tux, tvx, tuy, tvy);
+}
+
 //
 // analytic influence of 2d linear constant-strength vortex panel on target point
 //   ignoring the 1/2pi factor, which will be multiplied later
@@ -189,6 +276,24 @@ template <> inline double get_ustar (const double dx0, const double dy0, const d
   if (ustar > M_PI) ustar -= 2.0*M_PI;
   return ustar;
 }
+#elif defined(USE_STDSIMD)
+template <class S>
+static inline S get_ustar (const S dx0, const S dy0, const S dx1, const S dy1) {
+  // the difference of the two angles, already wrapped to [-pi,pi], with one arctangent
+  return simd_atan2<S>(dx1*dy0 - dy1*dx0, dy1*dy0 + dx1*dx0);
+}
+template <> inline float get_ustar (const float dx0, const float dy0, const float dx1, const float dy1) {
+  float ustar = std::atan2(dx1, dy1) - std::atan2(dx0, dy0);
+  if (ustar < -M_PI) ustar += 2.0f*M_PI;
+  if (ustar > M_PI) ustar -= 2.0f*M_PI;
+  return ustar;
+}
+template <> inline double get_ustar (const double dx0, const double dy0, const double dx1, const double dy1) {
+  double ustar = std::atan2(dx1, dy1) - std::atan2(dx0, dy0);
+  if (ustar < -M_PI) ustar += 2.0*M_PI;
+  if (ustar > M_PI) ustar -= 2.0*M_PI;
+  return ustar;
+}
 #else
 template <class S>
 static inline S get_ustar (const S dx0, const S dy0, const S dx1, const S dy1) {
@@ -219,6 +324,24 @@ inline float get_ustar_fast (const float a2, const float b2, const float c2, con
   float ustar = std::acos(numer * denom);
   return std::copysign(ustar, -norm);
 }
+#elif defined(USE_STDSIMD)
+// this is flops for the portable SIMD version
+template <class S> size_t flops_usf () { return 8; }
+template <class S>
+static inline S get_ustar_fast (const S a2, const S b2, const S c2, const S norm) {
+  const S numer = b2 + c2 - a2;
+  const S denom = S(0.5f) * my_rsqrt<S>(b2*c2);
+  S ustar = -my_acos<S>(numer * denom);
+  stdx::where(norm < S(0.0f), ustar) = -ustar;
+  return ustar;
+}
+template <>
+inline float get_ustar_fast (const float a2, const float b2, const float c2, const float norm) {
+  const float numer = b2 + c2 - a2;
+  const float denom = 0.5f / std::sqrt(b2*c2);
+  float ustar = std::acos(numer * denom);
+  return std::copysign(ustar, -norm);
+}
 #else
 template <class S> size_t flops_usf () { return 8; }
 template <class S>
@@ -336,6 +459,95 @@ static inline void kernelu_1vs_0p (const S sx0, const S sy0,
 }
 
 
+//
+// far-field influence of 2d linear constant-strength vortex AND source panel
+//   on target point ignoring the 1/2pi factor, using a point vortex and source
+//   at the panel center with the panel's total strengths; the error falls as (len/dist)^2
+//   9 flops average
+//
+template <class S, class A> size_t flopsu_1vs_0p_far () { return 9; }
+template <class S, class A>
+static inline void kernelu_1vs_0p_far (const S sx, const S sy,
+                                       const S vs, const S ss,
+                                       const S tx, const S ty,
+                                       A* const __restrict__ tu, A* const __restrict__ tv) {
+  const S dx = tx - sx;
+  const S dy = ty - sy;
+  const S r2 = my_recip<S>(dx*dx + dy*dy);
+  *tu = r2 * (ss*dx - vs*dy);
+  *tv = r2 * (vs*dx + ss*dy);
+}
+
+//
+// velocity gradient of a constant-strength vortex AND source panel, added to the velocity
+//   from kernelu_1vs_0p; off the panel the flow is irrotational and solenoidal, so with
+//   q = ss - i vs and unit tangent e, d(u-iv)/dz = (q/e) (1/(z-z0) - 1/(z-z1)) gives all four
+//   59 flops average
+//
+template <class S, class A> size_t flopsug_1vs_0p () { return 12 + 47; }
+template <class S, class A>
+static inline void kernelug_1vs_0p (const S sx0, const S sy0,
+                                    const S sx1, const S sy1,
+                                    const S vs, const S ss,
+                                    const S tx, const S ty,
+                                    A* const __restrict__ tu, A* const __restrict__ tv,
+                                    A* const __restrict__ tux, A* const __restrict__ tvx,
+                                    A* const __restrict__ tuy, A* const __restrict__ tvy) {
+  A u, v;
+  kernelu_1vs_0p<S,A>(sx0, sy0, sx1, sy1, vs, ss, tx, ty, &u, &v);
+  *tu += u;
+  *tv += v;
+
+  const S dx0 = tx - sx0;
+  const S dy0 = ty - sy0;
+  const S dx1 = tx - sx1;
+  const S dy1 = ty - sy1;
+  const S oor0 = my_recip<S>(dx0*dx0 + dy0*dy0);
+  const S oor1 = my_recip<S>(dx1*dx1 + dy1*dy1);
+  const S dr = dx0*oor0 - dx1*oor1;
+  const S di = dy1*oor1 - dy0*oor0;
+  S px = sx1 - sx0;
+  S py = sy1 - sy0;
+  const S mult = my_rsqrt<S>(px*px + py*py);
+  px *= mult;
+  py *= mult;
+  const S kr = ss*px - vs*py;
+  const S ki = -vs*px - ss*py;
+  const S ux = kr*dr - ki*di;
+  const S vx = -kr*di - ki*dr;
+  *tux += ux;
+  *tvx += vx;
+  *tuy += vx;
+  *tvy -= ux;
+}
+
+//
+// and the same far away, from the point vortex and source at the panel center
+//   18 flops average
+//
+template <class S, class A> size_t flopsug_1vs_0p_far () { return 18; }
+template <class S, class A>
+static inline void kernelug_1vs_0p_far (const S sx, const S sy,
+                                        const S vs, const S ss,
+                                        const S tx, const S ty,
+                                        A* const __restrict__ tu, A* const __restrict__ tv,
+                                        A* const __restrict__ tux, A* const __restrict__ tvx,
+                                        A* const __restrict__ tuy, A* const __restrict__ tvy) {
+  const S dx = tx - sx;
+  const S dy = ty - sy;
+  const S r2 = my_recip<S>(dx*dx + dy*dy);
+  *tu += r2 * (ss*dx - vs*dy);
+  *tv += r2 * (vs*dx + ss*dy);
+  const S a = r2*r2 * (dx*dx - dy*dy);
+  const S b = r2*r2 * S(2.0f)*dx*dy;
+  const S ux = vs*b - ss*a;
+  const S vx = -vs*a - ss*b;
+  *tux += ux;
+  *tvx += vx;
+  *tuy += vx;
+  *tvy -= ux;
+}
+
 //
 // analytic influence of 2d linear constant-strength vortex AND source panel
 //   on target point ignoring the 1/2pi factor, and separating out each velocity
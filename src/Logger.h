@@ -0,0 +1,175 @@
+/*
+ * Logger.h - Leveled console messages, written by a background thread
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+
+
+// lower is more important
+enum log_level_t {
+  log_error = 0,
+  log_warn  = 1,
+  log_info  = 2,
+  log_debug = 3
+};
+
+// messages above this level are not even compiled, set with LOG_LEVEL in CMake
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL 2
+#endif
+
+//
+// Any thread formats its own message and drops it into a ring of slots without taking a
+//   lock (the bounded queue of D. Vyukov), and one thread empties the ring to stdout in
+//   large writes every few milliseconds, so a step never waits on the console
+//
+// a full ring drops new messages, and the writer says how many; errors and warnings wait
+//   until they and everything before them are written
+//
+// messages written straight to std::cout may land ahead of those still in the ring, so
+//   call flush() before mixing the two
+//
+class Logger {
+public:
+  static Logger& get() {
+    static Logger instance;
+    return instance;
+  }
+
+  ~Logger() {
+    stopping.store(true);
+    if (writer.joinable()) writer.join();
+  }
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  void set_level(const log_level_t _lvl) { level.store(_lvl, std::memory_order_relaxed); }
+  log_level_t get_level() const { return level.load(std::memory_order_relaxed); }
+  bool enabled(const log_level_t _lvl) const { return _lvl <= get_level(); }
+
+  void set_level(const std::string _name) {
+    if (_name == "error") set_level(log_error);
+    else if (_name == "warn") set_level(log_warn);
+    else if (_name == "info") set_level(log_info);
+    else if (_name == "debug") set_level(log_debug);
+  }
+  std::string get_level_name() const {
+    static const char* names[] = {"error", "warn", "info", "debug"};
+    return names[get_level()];
+  }
+
+  void push(const log_level_t _lvl, std::string&& _msg) {
+    // once the writer is gone, write it here
+    if (stopping.load(std::memory_order_relaxed)) {
+      std::fwrite(_msg.data(), 1, _msg.size(), stdout);
+      return;
+    }
+
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    while (true) {
+      slot = &slots[pos & mask];
+      const size_t seq = slot->seq.load(std::memory_order_acquire);
+      const intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+      if (dif == 0) {
+        if (head.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+      } else if (dif < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+    slot->msg = std::move(_msg);
+    slot->seq.store(pos+1, std::memory_order_release);
+
+    if (_lvl <= log_warn) flush();
+  }
+
+  // wait until everything sent so far is written
+  void flush() {
+    const size_t target = head.load(std::memory_order_acquire);
+    while (written.load(std::memory_order_acquire) < target and not stopping.load()) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+private:
+  Logger() : slots(new Slot[capacity]) {
+    for (size_t i=0; i<capacity; ++i) slots[i].seq.store(i, std::memory_order_relaxed);
+    writer = std::thread([this]() { run(); });
+  }
+
+  struct Slot {
+    std::atomic<size_t> seq;
+    std::string msg;
+  };
+
+  // the only reader
+  void run() {
+    std::string out;
+    size_t tail = 0;
+    bool last_pass = false;
+    while (true) {
+      out.clear();
+      while (true) {
+        Slot& slot = slots[tail & mask];
+        if (slot.seq.load(std::memory_order_acquire) != tail+1) break;
+        out += slot.msg;
+        slot.msg.clear();
+        slot.seq.store(tail+capacity, std::memory_order_release);
+        ++tail;
+      }
+      const size_t ndrop = dropped.exchange(0, std::memory_order_relaxed);
+      if (ndrop > 0) out += "  (" + std::to_string(ndrop) + " log messages dropped)\n";
+      if (not out.empty()) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+      }
+      written.store(tail, std::memory_order_release);
+
+      if (last_pass) break;
+      if (stopping.load()) last_pass = true;
+      else if (out.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+  }
+
+  static constexpr size_t capacity = 1 << 13;
+  static constexpr size_t mask = capacity - 1;
+
+  std::unique_ptr<Slot[]> slots;
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> written{0};
+  std::atomic<size_t> dropped{0};
+  std::atomic<log_level_t> level{log_info};
+  std::atomic<bool> stopping{false};
+  std::thread writer;
+};
+
+// the message is a chain of << items, and is only formatted if it will be written
+#define LOG_AT(lvl, msg) \
+  do { \
+    if ((lvl) <= LOG_MAX_LEVEL and Logger::get().enabled(lvl)) { \
+      std::ostringstream log_os_; \
+      log_os_ << msg << '\n'; \
+      Logger::get().push(lvl, log_os_.str()); \
+    } \
+  } while (false)
+
+#define LOG_ERROR(msg) LOG_AT(log_error, msg)
+#define LOG_WARN(msg)  LOG_AT(log_warn, msg)
+#define LOG_INFO(msg)  LOG_AT(log_info, msg)
+#define LOG_DEBUG(msg) LOG_AT(log_debug, msg)
@@ -15,6 +15,10 @@
 #include <Vc/Vc>
 #endif
 
+#ifdef USE_STDSIMD
+#include "SimdHelper.h"
+#endif
+
 #include <cmath>
 
 // helper functions: exp, recip, rsqrt, rcbrt, acos
@@ -32,6 +36,19 @@ template <>
 inline double my_exp(const double _in) {
   return std::exp(_in);
 }
+#elif defined(USE_STDSIMD)
+template <class S>
+static inline S my_exp(const S _in) {
+  return stdx::exp(_in);
+}
+template <>
+inline float my_exp(const float _in) {
+  return std::exp(_in);
+}
+template <>
+inline double my_exp(const double _in) {
+  return std::exp(_in);
+}
 #else
 template <class S>
 static inline S my_exp(const S _in) {
@@ -52,6 +69,19 @@ template <>
 inline double my_recip(const double _in) {
   return 1.0 / _in;
 }
+#elif defined(USE_STDSIMD)
+template <class S>
+static inline S my_recip(const S _in) {
+  return S(typename S::value_type(1.0)) / _in;
+}
+template <>
+inline float my_recip(const float _in) {
+  return 1.0f / _in;
+}
+template <>
+inline double my_recip(const double _in) {
+  return 1.0 / _in;
+}
 #else
 template <class S>
 static inline S my_recip(const S _in) {
@@ -72,6 +102,19 @@ template <>
 inline double my_rsqrt(const double _in) {
   return 1.0 / std::sqrt(_in);
 }
+#elif defined(USE_STDSIMD)
+template <class S>
+static inline S my_rsqrt(const S _in) {
+  return S(typename S::value_type(1.0)) / stdx::sqrt(_in);
+}
+template <>
+inline float my_rsqrt(const float _in) {
+  return 1.0f / std::sqrt(_in);
+}
+template <>
+inline double my_rsqrt(const double _in) {
+  return 1.0 / std::sqrt(_in);
+}
 #else
 template <class S>
 static inline S my_rsqrt(const S _in) {
@@ -92,6 +135,20 @@ template <>
 inline double my_rcbrt(const double _in) {
   return 1.0 / std::cbrt(_in);
 }
+#elif defined(USE_STDSIMD)
+template <class S>
+static inline S my_rcbrt(const S _in) {
+  // stdx::cbrt is not vectorized in libstdc++
+  return stdx::exp(S(typename S::value_type(-0.3333333))*stdx::log(_in));
+}
+template <>
+inline float my_rcbrt(const float _in) {
+  return 1.0f / std::cbrt(_in);
+}
+template <>
+inline double my_rcbrt(const double _in) {
+  return 1.0 / std::cbrt(_in);
+}
 #else
 template <class S>
 static inline S my_rcbrt(const S _in) {
@@ -128,6 +185,32 @@ template <>
 inline double my_acos(const double _x) {
   return std::acos(_x);
 }
+#elif defined(USE_STDSIMD)
+template <class S>
+inline S my_acos(const S _x) {
+  S negate = S(0.0f);
+  stdx::where(_x < S(0.0f), negate) = S(1.0f);
+  S x = stdx::abs(_x);
+  stdx::where(x > S(1.0f), x) = S(1.0f);
+  S ret = S(-0.0187293f);
+  ret *= x;
+  ret += S(0.0742610f);
+  ret *= x;
+  ret -= S(0.2121144f);
+  ret *= x;
+  ret += S(1.5707288f);    // NOT pi/2
+  ret *= stdx::sqrt(S(1.0f)-x);
+  ret -= S(2.0f) * ret * negate;
+  return negate * S(float(M_PI)) + ret;
+}
+template <>
+inline float my_acos(const float _x) {
+  return std::acos(_x);
+}
+template <>
+inline double my_acos(const double _x) {
+  return std::acos(_x);
+}
 #else
 template <class S>
 inline S my_acos(const S _x) {
@@ -146,6 +229,17 @@ template <> inline float my_halflog (const float _x) {
 template <> inline double my_halflog (const double _x) {
   return 0.5 * std::log(_x);
 }
+#elif defined(USE_STDSIMD)
+template <class S>
+static inline S my_halflog (const S _x) {
+  return S(0.5f) * stdx::log(_x);
+}
+template <> inline float my_halflog (const float _x) {
+  return 0.5f * std::log(_x);
+}
+template <> inline double my_halflog (const double _x) {
+  return 0.5 * std::log(_x);
+}
 #else
 template <class S>
 static inline S my_halflog (const S _x) {
@@ -7,6 +7,7 @@
  */
 
 #include "BoundaryFeature.h"
+#include "MpiHelper.h"
 #include "MeasureFeature.h"
 #include "imgui/imgui.h"
 
@@ -14,6 +15,7 @@
 #include <cmath>
 #include <iostream>
 #include <sstream>
+#include <utility>
 #include <random>
 #include <string>
 
@@ -143,9 +145,8 @@ void MeasureFeature::draw_feature_list(std::vector<std::unique_ptr<MeasureFeatur
 #endif
 
 float MeasureFeature::jitter(const float _z, const float _ips) const {
-  // set up the random number generator
-  static std::random_device rd;  //Will be used to obtain a seed for the random number engine
-  static std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
+  // set up the random number generator, seeded the same on every MPI rank
+  static std::mt19937 gen(mpi_shared_seed());
   static std::uniform_real_distribution<float> dist(-0.5, 0.5);
   // emits one per step, jittered slightly
   return _z+_ips*dist(gen);
@@ -161,7 +162,7 @@ SinglePoint::init_elements(float _ips) const {
   std::vector<float> x = {m_x, m_y};
   std::vector<Int> idx;
   std::vector<float> vals;
-  ElementPacket<float> packet({x, idx, vals, (size_t)1, (uint8_t)0});
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)1, (uint8_t)0});
   if (packet.verify(packet.x.size(), Dimensions)) {
     return packet;
   } else {
@@ -175,7 +176,7 @@ SinglePoint::step_elements(float _ips) const {
     std::vector<float> x = {jitter(m_x, _ips), jitter(m_y, _ips)};
     std::vector<Int> idx;
     std::vector<float> vals;
-    ElementPacket<float> packet({x, idx, vals, (size_t)1, (uint8_t)0});
+    ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)1, (uint8_t)0});
     if (packet.verify(packet.x.size(), Dimensions)) {
       return packet;
     } else {
@@ -262,9 +263,8 @@ bool SinglePoint::draw_info_gui(const std::string action, const float &tracerSca
 ElementPacket<float>
 MeasurementBlob::init_elements(float _ips) const {
 
-  // set up the random number generator
-  static std::random_device rd;  //Will be used to obtain a seed for the random number engine
-  static std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
+  // set up the random number generator, seeded the same on every MPI rank
+  static std::mt19937 gen(mpi_shared_seed());
   static std::uniform_real_distribution<float> zmean_dist(-0.5, 0.5);
 
   // create a new vector to pass on
@@ -292,7 +292,8 @@ MeasurementBlob::init_elements(float _ips) const {
   }
   }
   
-  ElementPacket<float> packet({x, idx, vals, (size_t)(x.size()/2), (uint8_t)0});
+  const size_t n = x.size()/2;
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), n, (uint8_t)0});
   if (packet.verify(packet.x.size(), Dimensions)) {
     return packet;
   } else {
@@ -417,7 +418,7 @@ MeasurementLine::init_elements(float _ips) const {
     x.emplace_back((1.0-frac)*m_y + frac*m_yf);
   }
 
-  ElementPacket<float> packet({x, idx, vals, (size_t)ilen, (uint8_t)0});
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)ilen, (uint8_t)0});
   if (packet.verify(packet.x.size(), Dimensions)) {
     return packet;
   } else {
@@ -546,7 +547,8 @@ GridPoints::init_elements(float _ips) const {
 
   std::cout << "Creating measure grid with " << (x.size()/2) << " points" << std::endl;
 
-  ElementPacket<float> packet({x, idx, vals, (size_t)(x.size()/2), (uint8_t)0});
+  const size_t n = x.size()/2;
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), n, (uint8_t)0});
   if (packet.verify(packet.x.size(), Dimensions)) {
     return packet;
   } else {
@@ -718,7 +720,7 @@ GridField::init_elements(float _ips) const {
     }
   }
 
-  ElementPacket<float> packet({x, idx, vals, (size_t)(m_nx*m_ny), (uint8_t)2});
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)(m_nx*m_ny), (uint8_t)2});
   if (packet.verify(packet.x.size(), Dimensions)) {
     return packet;
   } else {
@@ -910,7 +912,7 @@ AnnularField::init_elements(float _ips) const {
     }
   }
 
-  ElementPacket<float> packet({x, idx, vals, (size_t)(m_nt*m_nr), (uint8_t)2});
+  ElementPacket<float> packet({std::move(x), std::move(idx), std::move(vals), (size_t)(m_nt*m_nr), (uint8_t)2});
   if (packet.verify(packet.x.size(), Dimensions)) {
     return packet;
   } else {
@@ -0,0 +1,95 @@
+/*
+ * MemoryHelper.h - Count the bytes held by each part of a simulation
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <optional>
+#include <algorithm>
+#include <mutex>
+#include <cstddef>
+
+
+//
+// Every part reports what it holds from its containers' capacities, so these are the
+//   bytes actually reserved, not the bytes in use; scratch space which only lives inside
+//   one call is reported as it was at the end of the last call, and MemoryUse keeps peaks
+//
+
+template <class V>
+size_t vec_bytes(const V& _v) { return _v.capacity() * sizeof(typename V::value_type); }
+
+// these may hold each other
+template <class V, size_t N> size_t vec_bytes(const std::array<V,N>&);
+template <class V> size_t vec_bytes(const std::optional<V>&);
+
+template <class V, size_t N>
+size_t vec_bytes(const std::array<V,N>& _v) {
+  size_t bytes = 0;
+  for (const auto& v : _v) bytes += vec_bytes(v);
+  return bytes;
+}
+
+template <class V>
+size_t vec_bytes(const std::optional<V>& _v) { return _v ? vec_bytes(*_v) : 0; }
+
+
+// current and peak bytes for each named part, in the order they were first set; the step
+//   thread sets them while the GUI reads them, so every access takes the lock and readers
+//   get a copy
+class MemoryUse {
+public:
+  struct Entry {
+    std::string name;
+    size_t current = 0;
+    size_t peak = 0;
+  };
+
+  void set(const std::string& _name, const size_t _bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [&_name](const Entry& e) { return e.name == _name; });
+    if (it == entries.end()) {
+      entries.push_back(Entry{_name, 0, 0});
+      it = entries.end()-1;
+    }
+    it->current = _bytes;
+    it->peak = std::max(it->peak, _bytes);
+  }
+
+  // call once every part has been set
+  void update_peak() {
+    std::lock_guard<std::mutex> lock(mtx);
+    peak_total = std::max(peak_total, sum_current());
+  }
+
+  size_t get_total() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return sum_current();
+  }
+  size_t get_peak_total() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return peak_total;
+  }
+  std::vector<Entry> get_entries() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return entries;
+  }
+
+private:
+  size_t sum_current() const {
+    size_t total = 0;
+    for (const auto& e : entries) total += e.current;
+    return total;
+  }
+
+  mutable std::mutex mtx;
+  std::vector<Entry> entries;
+  size_t peak_total = 0;
+};
@@ -9,18 +9,35 @@
 
 #include "Omega2D.h"
 #include "VectorHelper.h"
-#include "nanoflann/nanoflann.hpp"
-
-#include <Eigen/Dense>
+#include "CellList.h"
+#include "Compact.h"
+#include "Profiler.h"
+#include "Logger.h"
 
 #include <array>
 #include <cstdlib>
 #include <cstdio>
 #include <cassert>
 #include <iostream>
-#include <chrono>
 #include <vector>
 #include <algorithm>
+#include <utility>
+#include <limits>
+#include <cstdint>
+
+
+//
+// remove every particle not flagged to keep, preserving the order of the rest
+//
+template <class S>
+size_t compact_particles(std::array<Vector<S>,2>&    pos,
+                         Vector<S>&                  str,
+                         Vector<S>&                  rad,
+                         const std::vector<uint8_t>& keep) {
+
+  assert(pos[0].size()==keep.size() && "Input array sizes do not match");
+  return compact_arrays<Vector<S>>(keep, {&pos[0], &pos[1], &str, &rad});
+}
 
 
 //
@@ -29,13 +46,18 @@
 //
 // templated on storage class S (typically float or double)
 //
+// if keep is given, the absorbed particles are left in place with no strength and flagged
+//   there, so that later stages can reuse the same index; compact_particles removes them
+//
 template <class S>
 size_t merge_close_particles(std::array<Vector<S>,2>& pos,
                              Vector<S>&               str,
                              Vector<S>&               rad,
+                             const CellList<S>&       cells,
                              const S                  particle_overlap,
                              const S                  threshold,
-                             const bool               adapt_radii) {
+                             const bool               adapt_radii,
+                             std::vector<uint8_t>*    keep = nullptr) {
 
   // make sure all vector sizes are identical
   assert(pos[0].size()==pos[1].size() && "Input array sizes do not match");
@@ -43,10 +65,9 @@ size_t merge_close_particles(std::array<Vector<S>,2>& pos,
   assert(str.size()==rad.size() && "Input array sizes do not match");
   const size_t n = rad.size();
 
-  std::cout << "  Merging close particles with n " << n << std::endl;
+  LOG_DEBUG("  Merging close particles with n " << n);
 
-  // start timer
-  auto start = std::chrono::system_clock::now();
+  PROFILE_ZONE("merge");
 
   // reference or generate the local set of vectors
   Vector<S>& x = pos[0];
@@ -54,29 +75,13 @@ size_t merge_close_particles(std::array<Vector<S>,2>& pos,
   Vector<S>& r = rad;
   Vector<S>& s = str;
 
-  // convert particle positions into something nanoflann can understand
-  Eigen::Matrix<S, Eigen::Dynamic, Dimensions> xp;
-  xp.resize(n,Dimensions);
-  xp.col(0) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(x.data(), n);
-  xp.col(1) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(y.data(), n);
-  
-  // generate the searchable data structure
-  typedef typename Eigen::Matrix<S, Eigen::Dynamic, Dimensions> EigenMatType;
-  typedef typename EigenMatType::Index EigenIndexType;
-  typedef nanoflann::KDTreeEigenMatrixAdaptor< EigenMatType >  my_kd_tree_t;
-  my_kd_tree_t mat_index(Dimensions, std::cref(xp));
-  mat_index.index->buildIndex();
-
-  std::vector<std::pair<EigenIndexType,S> > ret_matches;
-  ret_matches.reserve(16);
-  nanoflann::SearchParams params;
-  params.sorted = true;
+  assert(cells.size()==n && "Cell list does not match particles");
 
   // new merging needs two new thresholds
   const S initial_thresh = 0.5;
   const S always_thresh = 0.1;
 
-  // and a measure of the mean strength
+  // and a measure of the mean strength (summed in order, so it does not depend on threads)
   S meanstr = 0.0;
   for (size_t i=0; i<n; ++i) {
     meanstr += std::abs(s[i]);
@@ -86,110 +91,170 @@ size_t merge_close_particles(std::array<Vector<S>,2>& pos,
   //
   // merge co-located particles with identical radii
   //
-  
-  // prepare a vector of particles to remove
-  std::vector<bool> erase_me;
-  erase_me.resize(n);
-  std::fill(erase_me.begin(), erase_me.end(), false);
 
-  // now, for every particle, search for a co-located and identical-radius particle!
-  for (size_t i=0; i<n; ++i) {
-    if (not erase_me[i]) {
-
-      // nominal separation for this particle
-      const S nom_sep = r[i] / particle_overlap;
-      const S search_rad = nom_sep * initial_thresh;
-      const S distsq_thresh = std::pow(search_rad, 2);
-
-      // tree-based search with nanoflann
-      const S query_pt[Dimensions] = { x[i], y[i] };
-      const size_t nMatches = mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
+  // the pairs that may merge, found concurrently from the incoming particles in fixed
+  //   chunks, then stored compactly: mates of i are mlist[mstart[i]] to mlist[mstart[i+1]-1]
+  //   (the test is symmetric, so each particle finds the same pairs from either side)
+  const size_t chunk_size = 1024;
+  const size_t nchunks = (n + chunk_size - 1) / chunk_size;
+  std::vector<std::vector<int32_t>> chunk_mates(nchunks);
+  std::vector<uint32_t> mstart(n+1, 0);
+
+  #pragma omp parallel
+  {
+    std::vector<std::pair<int32_t,S> > ret_matches;
+    ret_matches.reserve(16);
+
+    #pragma omp for schedule(dynamic,1)
+    for (int32_t ic=0; ic<(int32_t)nchunks; ++ic) {
+      std::vector<int32_t>& cm = chunk_mates[ic];
+      const int32_t iend = (int32_t)std::min(n, (ic+1)*chunk_size);
+      for (int32_t i=ic*chunk_size; i<iend; ++i) {
+        const size_t first = cm.size();
+
+        // nominal separation for this particle
+        const S nom_sep = r[i] / particle_overlap;
+        const S search_rad = nom_sep * initial_thresh;
+        const S distsq_thresh = std::pow(search_rad, 2);
+
+        // search the cell list, match 0 should be self
+        cells.radius_search(x[i], y[i], distsq_thresh, ret_matches);
 
-      // match 0 should be self, match 1 is closest
-      // if there are more than one, check the radii
-      if (nMatches > 1) {
         for (size_t j=0; j<ret_matches.size(); ++j) {
-          const size_t iother = (size_t)ret_matches[j].first;
-          if (i != iother and not erase_me[iother]) {
-            // make sure distance is also less than target particle's threshold
-            // note that distance returned from radiusSearch is already squared
-            const S dist = std::sqrt(ret_matches[j].second);
-            if (dist < initial_thresh*r[iother]/particle_overlap) {
-              //std::cout << "  particles " << i << " and " << iother << " will merge" << std::endl;
-              //std::cout << "    first at " << x[i] << " " << y[i] << " with str " << s[i] << " and rad " << r[i] << std::endl;
-              //std::cout << "    other at " << x[iother] << " " << y[iother] << " with str " << s[iother] << " and rad " << r[iother] << std::endl;
-              const S si = std::abs(s[i]) + std::numeric_limits<S>::epsilon();
-              const S so = std::abs(s[iother]) + std::numeric_limits<S>::epsilon();
-              const S frac = so / (si + so);
-
-              bool do_merge = false;
-              const S min_rad = std::min(r[iother],r[i]) / particle_overlap;
-              // check vs. magnitude of relative error
-              if (dist*frac*si < threshold*meanstr*min_rad) do_merge = true;
-              // or merge regardless if particles are very close
-              if (dist < always_thresh*min_rad) do_merge = true;
-
-              if (do_merge) {
-                // find center of strength
-                const S omfrac = 1.0 - frac;
-                const S newx = x[i]*omfrac + x[iother]*frac;
-                const S newy = y[i]*omfrac + y[iother]*frac;
-
-                // move strengths to particle i
-                x[i] = newx;
-                y[i] = newy;
-                if (adapt_radii) {
-                  r[i] = std::sqrt(omfrac*r[i]*r[i] + frac*r[iother]*r[iother]);
-                }
-                s[i] = s[i] + s[iother];
-                //std::cout << "    result   " << x[i] << " " << y[i] << " with str " << s[i] << " and rad " << r[i] << std::endl;
-                // flag other particle for deletion
-                erase_me[iother] = true;
-              }
-            }
+          const int32_t iother = ret_matches[j].first;
+          if (i == iother) continue;
+
+          // make sure distance is also less than target particle's threshold
+          // note that distance returned from radiusSearch is already squared
+          const S dist = std::sqrt(ret_matches[j].second);
+          if (dist < initial_thresh*r[iother]/particle_overlap) {
+            const S si = std::abs(s[i]) + std::numeric_limits<S>::epsilon();
+            const S so = std::abs(s[iother]) + std::numeric_limits<S>::epsilon();
+
+            bool do_merge = false;
+            const S min_rad = std::min(r[iother],r[i]) / particle_overlap;
+            // check vs. magnitude of relative error (written so it is the same from either side)
+            if (dist*(si*so)/(si + so) < threshold*meanstr*min_rad) do_merge = true;
+            // or merge regardless if particles are very close
+            if (dist < always_thresh*min_rad) do_merge = true;
+
+            if (do_merge) cm.push_back(iother);
           }
         }
+        std::sort(cm.begin()+first, cm.end());
+        mstart[i+1] = cm.size() - first;
       }
     }
   }
+  for (size_t i=0; i<n; ++i) mstart[i+1] += mstart[i];
+  std::vector<int32_t> mlist;
+  mlist.reserve(mstart[n]);
+  for (auto& cm : chunk_mates) mlist.insert(mlist.end(), cm.begin(), cm.end());
+
+  // the lowest-index particle wins: a particle keeps its strength unless a lower-index mate
+  //   keeps its own, which is what a serial sweep in index order would do; decide this in
+  //   rounds, each using only the last round's states, so thread count does not matter
+  enum merge_state : uint8_t { undecided, keeper, absorbed };
+  std::vector<uint8_t> state(n, undecided), newstate(n);
+  bool some_undecided = true;
+  while (some_undecided) {
+    some_undecided = false;
+    #pragma omp parallel for reduction(||:some_undecided)
+    for (int32_t i=0; i<(int32_t)n; ++i) {
+      newstate[i] = state[i];
+      if (state[i] != undecided) continue;
+      bool all_absorbed = true;
+      for (uint32_t k=mstart[i]; k<mstart[i+1]; ++k) {
+        const int32_t j = mlist[k];
+        if (j >= i) break;
+        if (state[j] == keeper) { newstate[i] = absorbed; break; }
+        if (state[j] != absorbed) all_absorbed = false;
+      }
+      if (newstate[i] == undecided) {
+        if (all_absorbed) newstate[i] = keeper;
+        else some_undecided = true;
+      }
+    }
+    std::swap(state, newstate);
+  }
 
-  // how many to be erased?
-  const size_t num_removed = std::count (erase_me.begin(), erase_me.end(), true);
-
-  if (num_removed > 0) {
-
-    // now march through the arrays and compress them
-    size_t copyto = 0;
-    for (size_t i=0; i<n; ++i) {
-      if (not erase_me[i]) {
-        if (i != copyto) {
-          x[copyto] = x[i];
-          y[copyto] = y[i];
-          r[copyto] = r[i];
-          s[copyto] = s[i];
-        }
-        copyto++;
+  // every keeper absorbs its mates that no lower-index keeper took, in index order
+  std::vector<int32_t> owner(n, -1);
+  #pragma omp parallel for
+  for (int32_t i=0; i<(int32_t)n; ++i) {
+    if (state[i] != absorbed) continue;
+    for (uint32_t k=mstart[i]; k<mstart[i+1]; ++k) {
+      if (state[mlist[k]] == keeper) { owner[i] = mlist[k]; break; }
+    }
+  }
+  std::vector<uint32_t> astart(n+1, 0);
+  for (size_t i=0; i<n; ++i) if (owner[i] >= 0) astart[owner[i]+1]++;
+  for (size_t i=0; i<n; ++i) astart[i+1] += astart[i];
+  std::vector<int32_t> alist(astart[n]);
+  {
+    std::vector<uint32_t> next(astart.begin(), astart.end()-1);
+    for (size_t i=0; i<n; ++i) if (owner[i] >= 0) alist[next[owner[i]]++] = (int32_t)i;
+  }
+
+  #pragma omp parallel for schedule(dynamic,256)
+  for (int32_t i=0; i<(int32_t)n; ++i) {
+    for (uint32_t k=astart[i]; k<astart[i+1]; ++k) {
+      const int32_t iother = alist[k];
+      const S si = std::abs(s[i]) + std::numeric_limits<S>::epsilon();
+      const S so = std::abs(s[iother]) + std::numeric_limits<S>::epsilon();
+      const S frac = so / (si + so);
+
+      // find center of strength
+      const S omfrac = 1.0 - frac;
+      const S newx = x[i]*omfrac + x[iother]*frac;
+      const S newy = y[i]*omfrac + y[iother]*frac;
+
+      // move strengths to particle i
+      x[i] = newx;
+      y[i] = newy;
+      if (adapt_radii) {
+        r[i] = std::sqrt(omfrac*r[i]*r[i] + frac*r[iother]*r[iother]);
       }
+      s[i] = s[i] + s[iother];
     }
-    // reset n and resize the arrays
-    const size_t new_n = copyto;
-    x.resize(new_n);
-    y.resize(new_n);
-    r.resize(new_n);
-    s.resize(new_n);
-
-    std::cout << "    merge removed " << num_removed << " particles" << std::endl;
   }
 
-  // finish timer and report
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  printf("    merging time:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
+  // how many to be erased?
+  const size_t num_removed = std::count (state.begin(), state.end(), absorbed);
+
+  if (keep) {
+    keep->resize(n);
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)n; ++i) {
+      (*keep)[i] = (state[i] == absorbed) ? 0 : 1;
+      if (state[i] == absorbed) s[i] = 0.0;
+    }
+    if (num_removed > 0) LOG_INFO("    merge absorbed " << num_removed << " particles");
+
+  } else if (num_removed > 0) {
+    std::vector<uint8_t> survives(n);
+    for (size_t i=0; i<n; ++i) survives[i] = (state[i] == absorbed) ? 0 : 1;
+    (void) compact_particles(pos, str, rad, survives);
+
+    LOG_INFO("    merge removed " << num_removed << " particles");
+  }
 
   return num_removed;
 }
 
 
+//
+// remove the particles not flagged to keep from a whole collection, velocities too
+//
+template <class S>
+void compact_collection(Points<S>& _pts, const std::vector<uint8_t>& _keep) {
+  (void) _pts.compact(_keep);
+
+  // a merge which removed most of the particles leaves mostly empty capacity behind
+  _pts.shrink();
+}
+
+
 //
 // run some number of merge ops on one collection of Point vorts
 //
@@ -210,18 +275,25 @@ void merge_collection(Points<S>& _pts,
 
     //npre = _pts.get_n();
 
+    // index the particles at their nominal separation before the calls below bump the state
+    const Vector<S>& r = std::as_const(_pts).get_rad();
+    const S nom_sep = *std::max_element(r.begin(), r.end()) / _overlap;
+    const CellList<S>& cells = _pts.get_cell_list(nom_sep);
+
     // last two arguments are: relative distance, allow variable core radii
+    std::vector<uint8_t> keep;
     (void) merge_close_particles(_pts.get_pos(),
                                  _pts.get_str(),
                                  _pts.get_rad(),
+                                 cells,
                                  _overlap,
                                  _thresh,
-                                 _isadapt);
-
-    npost = _pts.get_rad().size();
+                                 _isadapt,
+                                 &keep);
 
-    // resize the rest of the arrays
-    _pts.resize(npost);
+    // remove the absorbed particles from every array
+    compact_collection(_pts, keep);
+    npost = _pts.get_n();
   }
 }
 
@@ -244,6 +316,7 @@ void merge_operation(std::vector<Collection>& _vort,
     if (std::holds_alternative<Points<S>>(coll)) {
 
       Points<S>& pts = std::get<Points<S>>(coll);
+      if (pts.get_movet() == fixed) continue;
 
       // last two arguments are: relative distance, allow variable core radii
       (void) merge_collection(pts,
@@ -0,0 +1,64 @@
+/*
+ * Morton.h - Sort elements along a space-filling curve
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+
+#include <vector>
+#include <array>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+
+
+//
+// interleave the bits of two 16-bit cell indices
+//
+inline uint32_t morton_key(const uint32_t _ix, const uint32_t _iy) {
+  uint32_t key = 0;
+  for (uint32_t b=0; b<16; ++b) {
+    key |= ((_ix >> b) & 1u) << (2*b);
+    key |= ((_iy >> b) & 1u) << (2*b+1);
+  }
+  return key;
+}
+
+//
+// sort the elements _ibeg to _iend along a Morton curve over their bounding box,
+//   returning their indices in that order
+//
+template <class S>
+std::vector<int32_t> morton_order(const std::array<Vector<S>,Dimensions>& _x,
+                                  const size_t _ibeg, const size_t _iend) {
+  std::vector<int32_t> order(_iend-_ibeg);
+  std::iota(order.begin(), order.end(), (int32_t)_ibeg);
+  if (_iend <= _ibeg) return order;
+
+  const auto [xmin, xmax] = std::minmax_element(_x[0].begin()+_ibeg, _x[0].begin()+_iend);
+  const auto [ymin, ymax] = std::minmax_element(_x[1].begin()+_ibeg, _x[1].begin()+_iend);
+  const S size = std::max(std::max(*xmax-*xmin, *ymax-*ymin), (S)1.e-10);
+  const S fac = (S)65535.0 / size;
+
+  std::vector<uint32_t> key(_iend-_ibeg);
+  for (size_t i=_ibeg; i<_iend; ++i) {
+    const uint32_t ix = (uint32_t)std::min((S)65535.0, (_x[0][i]-*xmin) * fac);
+    const uint32_t iy = (uint32_t)std::min((S)65535.0, (_x[1][i]-*ymin) * fac);
+    key[i-_ibeg] = morton_key(ix, iy);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&key,_ibeg](const int32_t a, const int32_t b) { return key[a-_ibeg] < key[b-_ibeg]; });
+  return order;
+}
+
+// or all of them
+template <class S>
+std::vector<int32_t> morton_order(const std::array<Vector<S>,Dimensions>& _x) {
+  return morton_order<S>(_x, 0, _x[0].size());
+}
+
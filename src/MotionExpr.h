@@ -0,0 +1,260 @@
+/*
+ * MotionExpr.h - A body's motion expression flattened for evaluation with its rate of change
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <tinyexpr/tinyexpr.h>
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+
+//
+// tinyexpr walks its tree recursively, and the old rates took two more walks with the time
+//   nudged either way; here the tree becomes a postfix program, and one pass over it carries
+//   every value with its derivative in time (a dual number), so a position and its velocity
+//   come out together and the velocity is exact
+//
+// tinyexpr keeps its arithmetic functions to itself, so they are found by compiling a few
+//   tiny expressions and looking at what came out; any function with no known derivative
+//   (fac, ncr, clamp...) leaves the whole expression on a central difference of the program
+//
+class MotionExpr {
+public:
+  MotionExpr() = default;
+
+  // _time is the variable the expression was compiled against; nothing is kept of the tree
+  MotionExpr(const te_expr* _expr, const double* _time) : time(_time) {
+    if (not _expr) return;
+    valid = true;
+    exact = true;
+    size_t depth = 0;
+    flatten(_expr, depth);
+    valid = valid and (depth == 1);
+  }
+
+  bool empty() const { return not valid; }
+  bool exact_rate() const { return exact; }
+
+  // the value at this time, and how fast it changes
+  std::array<double,2> eval(const double _t) const {
+    if (exact) {
+      const Dual v = run<Dual>(_t);
+      return {v.v, v.d};
+    }
+    const double dt = 1.e-5;
+    return {run<double>(_t), (run<double>(_t+dt) - run<double>(_t-dt)) / (2.0*dt)};
+  }
+
+private:
+  enum code_t : uint8_t { op_const, op_time, op_var, op_call,
+                          op_add, op_sub, op_mul, op_div, op_neg, op_comma, op_pow, op_fmod,
+                          op_sin, op_cos, op_tan, op_asin, op_acos, op_atan, op_atan2,
+                          op_sinh, op_cosh, op_tanh, op_exp, op_log, op_log10, op_sqrt, op_cbrt,
+                          op_fabs, op_floor, op_ceil, op_fmax, op_fmin };
+
+  struct Op {
+    code_t code;
+    uint8_t arity;
+    double value;
+    const void* ptr;
+  };
+
+  struct Dual {
+    double v, d;
+  };
+
+  // the enum and masks tinyexpr.c keeps to itself
+  static constexpr int te_constant = 1;
+  static int type_mask(const int _t) { return _t & 0x1F; }
+  static int arity(const int _t) { return (_t & (TE_FUNCTION0 | TE_CLOSURE0)) ? (_t & 0x7) : 0; }
+
+  // the function at the root of a probe expression
+  static const void* probe(const char* _expr) {
+    double x = 1.0;
+    te_variable v = {"x", &x, TE_VARIABLE, nullptr};
+    int err = 0;
+    te_expr* n = te_compile(_expr, &v, 1, &err);
+    const void* f = n ? n->function : nullptr;
+    te_free(n);
+    return f;
+  }
+
+  struct Known {
+    const void* ptr;
+    code_t code;
+  };
+
+  static const std::vector<Known>& known() {
+    // the libm functions tinyexpr points to, not the C++ overloads
+    auto f1 = [](double (*_f)(double)) { return (const void*)_f; };
+    auto f2 = [](double (*_f)(double,double)) { return (const void*)_f; };
+    static const std::vector<Known> list = {
+      {probe("x+x"), op_add}, {probe("x-x"), op_sub}, {probe("x*x"), op_mul},
+      {probe("x/x"), op_div}, {probe("-x"), op_neg},  {probe("x,x"), op_comma},
+      {f2(::pow), op_pow},      {f2(::fmod), op_fmod},    {f1(::sin), op_sin},
+      {f1(::cos), op_cos},      {f1(::tan), op_tan},      {f1(::asin), op_asin},
+      {f1(::acos), op_acos},    {f1(::atan), op_atan},    {f2(::atan2), op_atan2},
+      {f1(::sinh), op_sinh},    {f1(::cosh), op_cosh},    {f1(::tanh), op_tanh},
+      {f1(::exp), op_exp},      {f1(::log), op_log},      {f1(::log10), op_log10},
+      {f1(::sqrt), op_sqrt},    {f1(::cbrt), op_cbrt},    {f1(::fabs), op_fabs},
+      {f1(::floor), op_floor},  {f1(::ceil), op_ceil},    {f2(::fmax), op_fmax},
+      {f2(::fmin), op_fmin} };
+    return list;
+  }
+
+  void flatten(const te_expr* _n, size_t& _depth) {
+    const int t = type_mask(_n->type);
+    if (t == te_constant) {
+      prog.push_back({op_const, 0, _n->value, nullptr});
+    } else if (t == TE_VARIABLE) {
+      prog.push_back({_n->bound == time ? op_time : op_var, 0, 0.0, _n->bound});
+    } else if (t >= TE_FUNCTION0 and t <= TE_FUNCTION7) {
+      const int na = arity(_n->type);
+      for (int i=0; i<na; ++i) flatten((const te_expr*)_n->parameters[i], _depth);
+      code_t code = op_call;
+      for (const Known& k : known()) if (k.ptr == _n->function) { code = k.code; break; }
+      if (code == op_call) exact = false;
+      prog.push_back({code, (uint8_t)na, 0.0, _n->function});
+      _depth -= na;
+    } else {
+      // closures never come from a body's expressions
+      valid = false;
+      prog.push_back({op_const, 0, NAN, nullptr});
+    }
+    ++_depth;
+    max_depth = std::max(max_depth, _depth);
+  }
+
+  static double call(const Op& _op, const double* _a) {
+    switch (_op.arity) {
+      case 0: return ((double(*)())_op.ptr)();
+      case 1: return ((double(*)(double))_op.ptr)(_a[0]);
+      case 2: return ((double(*)(double,double))_op.ptr)(_a[0], _a[1]);
+      case 3: return ((double(*)(double,double,double))_op.ptr)(_a[0], _a[1], _a[2]);
+      case 4: return ((double(*)(double,double,double,double))_op.ptr)(_a[0], _a[1], _a[2], _a[3]);
+      case 5: return ((double(*)(double,double,double,double,double))_op.ptr)(_a[0], _a[1], _a[2], _a[3], _a[4]);
+      case 6: return ((double(*)(double,double,double,double,double,double))_op.ptr)(_a[0], _a[1], _a[2], _a[3], _a[4], _a[5]);
+      case 7: return ((double(*)(double,double,double,double,double,double,double))_op.ptr)(_a[0], _a[1], _a[2], _a[3], _a[4], _a[5], _a[6]);
+      default: return NAN;
+    }
+  }
+
+  // values only: every call goes through its pointer, as te_eval would
+  static void apply(const Op& _op, double* _a) { _a[0] = call(_op, _a); }
+
+  // values and derivatives of the functions we know
+  static void apply(const Op& _op, Dual* _a) {
+    const double a = _a[0].v, da = _a[0].d;
+    const double b = (_op.arity > 1) ? _a[1].v : 0.0;
+    const double db = (_op.arity > 1) ? _a[1].d : 0.0;
+    Dual& r = _a[0];
+    // nothing here changes in time (and sqrt or pow at zero would make 0/0); the values go
+    //   through an array as long as the longest call, see call()
+    const size_t na = std::min((size_t)_op.arity, (size_t)7);
+    double args[7] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    bool steady = true;
+    for (size_t i=0; i<na; ++i) {
+      args[i] = _a[i].v;
+      steady = steady and (_a[i].d == 0.0);
+    }
+    if (steady) {
+      r = {call(_op, args), 0.0};
+      return;
+    }
+    switch (_op.code) {
+      case op_add:   r = {a+b, da+db}; break;
+      case op_sub:   r = {a-b, da-db}; break;
+      case op_mul:   r = {a*b, da*b + a*db}; break;
+      case op_div:   r = {a/b, (da*b - a*db) / (b*b)}; break;
+      case op_neg:   r = {-a, -da}; break;
+      case op_comma: r = {b, db}; break;
+      case op_pow: {
+        const double v = ::pow(a, b);
+        // a constant exponent allows a negative base
+        r = {v, (db == 0.0) ? b*::pow(a, b-1.0)*da : v*(db*::log(a) + b*da/a)};
+        } break;
+      case op_fmod:  r = {::fmod(a, b), da - ::trunc(a/b)*db}; break;
+      case op_sin:   r = {::sin(a), ::cos(a)*da}; break;
+      case op_cos:   r = {::cos(a), -::sin(a)*da}; break;
+      case op_tan: {
+        const double v = ::tan(a);
+        r = {v, (1.0 + v*v)*da};
+        } break;
+      case op_asin:  r = {::asin(a), da / ::sqrt(1.0 - a*a)}; break;
+      case op_acos:  r = {::acos(a), -da / ::sqrt(1.0 - a*a)}; break;
+      case op_atan:  r = {::atan(a), da / (1.0 + a*a)}; break;
+      case op_atan2: r = {::atan2(a, b), (b*da - a*db) / (a*a + b*b)}; break;
+      case op_sinh:  r = {::sinh(a), ::cosh(a)*da}; break;
+      case op_cosh:  r = {::cosh(a), ::sinh(a)*da}; break;
+      case op_tanh: {
+        const double v = ::tanh(a);
+        r = {v, (1.0 - v*v)*da};
+        } break;
+      case op_exp: {
+        const double v = ::exp(a);
+        r = {v, v*da};
+        } break;
+      case op_log:   r = {::log(a), da/a}; break;
+      case op_log10: r = {::log10(a), da / (a*M_LN10)}; break;
+      case op_sqrt: {
+        const double v = ::sqrt(a);
+        r = {v, 0.5*da/v};
+        } break;
+      case op_cbrt: {
+        const double v = ::cbrt(a);
+        r = {v, da/(3.0*v*v)};
+        } break;
+      case op_fabs:  r = {::fabs(a), (a < 0.0) ? -da : da}; break;
+      case op_floor: r = {::floor(a), 0.0}; break;
+      case op_ceil:  r = {::ceil(a), 0.0}; break;
+      case op_fmax:  r = (a >= b) ? Dual({a, da}) : Dual({b, db}); break;
+      case op_fmin:  r = (a <= b) ? Dual({a, da}) : Dual({b, db}); break;
+      default:       r = {NAN, NAN}; break;
+    }
+  }
+
+  static void leaf(double& _s, const double _v, const double) { _s = _v; }
+  static void leaf(Dual& _s, const double _v, const double _d) { _s = {_v, _d}; }
+
+  template <class T>
+  T run(const double _t) const {
+    std::array<T,32> fixed = {};
+    std::vector<T> grown;
+    T* stack = fixed.data();
+    if (max_depth > fixed.size()) {
+      grown.resize(max_depth);
+      stack = grown.data();
+    }
+
+    size_t sp = 0;
+    for (const Op& op : prog) {
+      switch (op.code) {
+        case op_const: leaf(stack[sp++], op.value, 0.0); break;
+        case op_time:  leaf(stack[sp++], _t, 1.0); break;
+        case op_var:   leaf(stack[sp++], *(const double*)op.ptr, 0.0); break;
+        default:
+          sp -= op.arity;
+          // a function of nothing pushes a new value
+          if (op.arity == 0) leaf(stack[sp], call(op, nullptr), 0.0);
+          else apply(op, stack+sp);
+          ++sp;
+          break;
+      }
+    }
+    return stack[0];
+  }
+
+  const double* time = nullptr;
+  std::vector<Op> prog;
+  size_t max_depth = 0;
+  bool valid = false;
+  bool exact = false;
+};
@@ -0,0 +1,179 @@
+/*
+ * MpiHelper.h - Share velocity evaluations among MPI ranks
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Points.h"
+#include "Morton.h"
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include <vector>
+#include <array>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+
+
+//
+// Every rank holds and steps the whole simulation, which is deterministic, so only the
+//   velocity evaluations are divided: each rank takes a contiguous stretch of the target
+//   particles in Morton order and all ranks then exchange their results
+//
+// anything random draws from seeds given by mpi_shared_seed, so that every rank starts
+//   from, and keeps, the same particles; check_simulation compares them at every step
+//
+// the split is redone at every evaluation, so ownership follows diffusion and merging
+//   without any particles being migrated
+//
+
+inline int mpi_rank() {
+#ifdef USE_MPI
+  int rank = 0;
+  int ready = 0;
+  MPI_Initialized(&ready);
+  if (ready) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  return rank;
+#else
+  return 0;
+#endif
+}
+
+inline int mpi_size() {
+#ifdef USE_MPI
+  int size = 1;
+  int ready = 0;
+  MPI_Initialized(&ready);
+  if (ready) MPI_Comm_size(MPI_COMM_WORLD, &size);
+  return size;
+#else
+  return 1;
+#endif
+}
+
+// files and screen output only come from the first rank
+inline bool is_root_rank() { return mpi_rank() == 0; }
+
+// a random seed, the first rank's on every rank; all ranks must call this at the same point
+inline uint64_t mpi_shared_seed() {
+  std::random_device rd;
+  uint64_t seed = rd();
+  seed = (seed << 32) | rd();
+#ifdef USE_MPI
+  if (mpi_size() > 1) MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+#endif
+  return seed;
+}
+
+// is this true on any rank; all ranks must call this at the same point
+inline bool mpi_any(const bool _val) {
+#ifdef USE_MPI
+  if (mpi_size() > 1) {
+    int local = _val ? 1 : 0;
+    int global = 0;
+    MPI_Allreduce(&local, &global, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    return global != 0;
+  }
+#endif
+  return _val;
+}
+
+// do all ranks hold the same values, as counts or checksums of their state
+template <size_t N>
+bool mpi_all_agree(const std::array<uint64_t,N>& _vals) {
+#ifdef USE_MPI
+  if (mpi_size() > 1) {
+    std::array<uint64_t,N> lo, hi;
+    MPI_Allreduce(_vals.data(), lo.data(), N, MPI_UINT64_T, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(_vals.data(), hi.data(), N, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+    return lo == hi;
+  }
+#endif
+  return true;
+}
+
+//
+// this rank's share of the targets, as a collection of their own; _idx gets all of the
+//   targets in the Morton order that every rank agrees on
+//
+template <class S>
+Points<S> mpi_local_targets(const Points<S>& _targ, std::vector<int32_t>& _idx) {
+  const std::array<Vector<S>,Dimensions>& x = _targ.get_pos();
+  _idx = morton_order<S>(x);
+  const size_t n = _idx.size();
+  const size_t i0 = n * mpi_rank() / mpi_size();
+  const size_t i1 = n * (mpi_rank()+1) / mpi_size();
+
+  std::vector<S> newx(Dimensions*(i1-i0));
+  for (size_t i=i0; i<i1; ++i) {
+    for (size_t d=0; d<Dimensions; ++d) newx[Dimensions*(i-i0)+d] = x[d][_idx[i]];
+  }
+
+  // the strengths are not needed on the targets, but active points require them
+  const bool thick = not _targ.is_inert();
+  std::vector<S> news(thick ? i1-i0 : 0, 0.0);
+  ElementPacket<S> packet(newx, std::vector<Int>(), news, i1-i0, 0);
+  Points<S> local(packet, thick ? active : inert, lagrangian, nullptr, 0.0);
+  if (thick) {
+    Vector<S>& r = local.get_rad();
+    for (size_t i=i0; i<i1; ++i) r[i-i0] = _targ.get_rad()[_idx[i]];
+  }
+  return local;
+}
+
+//
+// give every rank all of the velocities (and vorticities or velocity gradients, if found)
+//
+template <class S>
+void mpi_gather_vels(Points<S>& _targ, Points<S>& _local, const std::vector<int32_t>& _idx) {
+  const size_t n = _idx.size();
+  const int nranks = mpi_size();
+  std::vector<int> counts(nranks), offsets(nranks);
+  for (int r=0; r<nranks; ++r) {
+    offsets[r] = (int)(n * r / nranks);
+    counts[r] = (int)(n * (r+1) / nranks) - offsets[r];
+  }
+
+  const bool do_vort = _local.has_vort();
+  std::vector<Vector<S>*> fields;
+  std::vector<Vector<S>*> locals;
+  for (size_t d=0; d<Dimensions; ++d) {
+    fields.push_back(&_targ.get_vel()[d]);
+    locals.push_back(&_local.get_vel()[d]);
+  }
+  if (do_vort) {
+    fields.push_back(&_targ.get_vort());
+    locals.push_back(&_local.get_vort());
+  }
+  if (_local.has_velgrad()) {
+    for (size_t k=0; k<4; ++k) {
+      fields.push_back(&_targ.get_velgrad()[k]);
+      locals.push_back(&_local.get_velgrad()[k]);
+    }
+  }
+
+  Vector<S> all(n);
+  for (size_t f=0; f<fields.size(); ++f) {
+#ifdef USE_MPI
+    const MPI_Datatype dtype = std::is_same<S,double>::value ? MPI_DOUBLE : MPI_FLOAT;
+    MPI_Allgatherv(locals[f]->data(), counts[mpi_rank()], dtype,
+                   all.data(), counts.data(), offsets.data(), dtype, MPI_COMM_WORLD);
+#else
+    std::copy(locals[f]->begin(), locals[f]->end(), all.begin());
+#endif
+    Vector<S>& dest = *fields[f];
+    dest.resize(n);
+    for (size_t i=0; i<n; ++i) dest[_idx[i]] = all[i];
+  }
+}
+
@@ -0,0 +1,252 @@
+/*
+ * MshCache.h - Parse each gmsh file once, and optionally keep a binary copy for later runs
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "Checkpoint.h"
+#include "read_MSH_Mesh.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <filesystem>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+
+//
+// Everything FromMsh takes from a mesh, in flat arrays: the parse of a large gmsh file costs
+//   far more than making the packets, and the same file is read by every reset, by both the
+//   wall and hybrid paths, and by every case of an ensemble
+//
+// each boundary keeps all of its edges' nodes in gmsh order, one edge after the next, with
+//   where each edge starts (and one past the last)
+//
+struct MshData {
+  std::vector<float> x;
+  std::vector<Int> elems;
+  uint32_t nnpe = 0;
+  uint64_t nelems = 0;
+  std::vector<Int> wall, open;
+  std::vector<uint32_t> wall_starts, open_starts;
+
+  size_t get_nnodes() const { return x.size() / 2; }
+};
+
+//
+// The file is known by its size and modification time, and by a hash of its contents, so a
+//   touched but unchanged mesh is read from the copy and an edited one is parsed again; the
+//   copy is written as a checkpoint is, in this machine's byte order
+//
+// copies are kept on disk only when asked for, in their own directory, so reading a mesh
+//   never writes beside it
+//
+class MshCache {
+public:
+  // the parsed mesh, or nullptr with gmsh's return code; with a directory, the parsed copy
+  //   is read from and written to there
+  static std::shared_ptr<const MshData> read(const std::string& _file, const std::string& _dir,
+                                             int32_t& _retval) {
+    static MshCache instance;
+    return instance.fetch(_file, _dir, _retval);
+  }
+
+private:
+  struct Stamp {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+  };
+
+  struct Entry {
+    Stamp stamp;
+    std::shared_ptr<const MshData> data;
+  };
+
+  static constexpr char magic[8] = {'O','M','E','G','A','M','S','H'};
+  static constexpr uint32_t version = 1;
+
+  std::shared_ptr<const MshData> fetch(const std::string& _file, const std::string& _dir, int32_t& _retval) {
+    std::lock_guard<std::mutex> lock(mtx);
+    _retval = 1;
+
+    Stamp stamp;
+    if (not get_stamp(_file, stamp)) {
+      // gmsh gives the reason
+      return parse(_file, _retval);
+    }
+
+    // seen in this process, and not touched since
+    auto it = entries.find(_file);
+    if (it != entries.end() and it->second.stamp.size == stamp.size and it->second.stamp.mtime == stamp.mtime) {
+      return it->second.data;
+    }
+
+    stamp.hash = hash_file(_file);
+    if (it != entries.end() and it->second.stamp.hash == stamp.hash and it->second.stamp.size == stamp.size) {
+      it->second.stamp = stamp;
+      return it->second.data;
+    }
+
+    // meshes with one name in different places share a copy, and the stamp tells them apart
+    std::string cachefile;
+    if (not _dir.empty()) {
+      cachefile = (std::filesystem::path(_dir) / std::filesystem::path(_file).filename()).string() + ".o2dmsh";
+    }
+    std::shared_ptr<const MshData> data = cachefile.empty() ? nullptr : load(cachefile, stamp);
+    if (data) {
+      std::cout << "  using the parsed copy in " << cachefile << std::endl;
+    } else {
+      data = parse(_file, _retval);
+      if (not data) return data;
+      // best effort: an unwritable directory only means parsing again next run
+      if (not cachefile.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(_dir, ec);
+        if (not save(cachefile, stamp, *data)) std::remove((cachefile + ".tmp").c_str());
+      }
+    }
+
+    entries[_file] = Entry({stamp, data});
+    return data;
+  }
+
+  static bool get_stamp(const std::string& _file, Stamp& _stamp) {
+#ifdef _WIN32
+    std::FILE* fp = std::fopen(_file.c_str(), "rb");
+    if (not fp) return false;
+    std::fseek(fp, 0, SEEK_END);
+    _stamp.size = (uint64_t)std::ftell(fp);
+    std::fclose(fp);
+    // no mtime here, so the hash decides every time
+    _stamp.mtime = -1;
+#else
+    struct stat st;
+    if (stat(_file.c_str(), &st) != 0) return false;
+    _stamp.size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    _stamp.mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    _stamp.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+  }
+
+  // FNV-1a over the bytes; this only tells meshes apart, it guards against nothing
+  static uint64_t hash_file(const std::string& _file) {
+    uint64_t h = 14695981039346656037ull;
+    std::FILE* fp = std::fopen(_file.c_str(), "rb");
+    if (not fp) return h;
+    std::vector<unsigned char> buf(1<<20);
+    size_t n;
+    while ((n = std::fread(buf.data(), 1, buf.size(), fp)) > 0) {
+      for (size_t i=0; i<n; ++i) {
+        h ^= buf[i];
+        h *= 1099511628211ull;
+      }
+    }
+    std::fclose(fp);
+    return h;
+  }
+
+  static std::shared_ptr<const MshData> parse(const std::string& _file, int32_t& _retval) {
+    ReadMsh::Mesh mesh;
+    _retval = mesh.read_msh_file(_file.c_str());
+    if (_retval != 1) return nullptr;
+
+    auto data = std::make_shared<MshData>();
+    data->nelems = mesh.get_nelems();
+
+    const std::vector<ReadMsh::node>& nodes = mesh.get_nodes();
+    data->x.reserve(2*nodes.size());
+    for (auto& thisnode : nodes) {
+      data->x.push_back(thisnode.coor.x);
+      data->x.push_back(thisnode.coor.y);
+    }
+
+    const std::vector<ReadMsh::element2d>& elems = mesh.get_elems();
+    if (not elems.empty()) data->nnpe = elems[0].N_nodes;
+    data->elems.reserve(data->nnpe*elems.size());
+    for (auto& thiselem : elems) {
+      // number of nodes per element - must be constant!
+      if (thiselem.N_nodes != data->nnpe) {
+        std::cout << "  elements with " << thiselem.N_nodes << " and " << data->nnpe
+                  << " nodes in one mesh are not supported" << std::endl;
+        _retval = -1;
+        return nullptr;
+      }
+      for (size_t i=0; i<thiselem.N_nodes; ++i) data->elems.push_back(thiselem.nodes[i]);
+    }
+
+    const std::vector<ReadMsh::edge>& edges = mesh.get_edges();
+    auto gather = [&](const std::string _name, std::vector<Int>& _nodes, std::vector<uint32_t>& _starts) {
+      const ReadMsh::boundary bdry = mesh.get_bdry(_name);
+      _starts.push_back(0);
+      for (uint32_t thisedge : bdry.edges) {
+        for (size_t i=0; i<edges[thisedge].N_nodes; ++i) _nodes.push_back(edges[thisedge].nodes[i]);
+        _starts.push_back((uint32_t)_nodes.size());
+      }
+    };
+    gather("wall", data->wall, data->wall_starts);
+    gather("open", data->open, data->open_starts);
+
+    return data;
+  }
+
+  static std::shared_ptr<const MshData> load(const std::string& _cachefile, const Stamp& _stamp) {
+    CheckpointReader in(_cachefile);
+    if (not in.good()) return nullptr;
+
+    char m[8];
+    for (auto& c : m) c = in.get<char>();
+    if (not in.good() or std::memcmp(m, magic, 8) != 0) return nullptr;
+    if (in.get<uint32_t>() != version or in.get<uint32_t>() != (uint32_t)sizeof(Int)) return nullptr;
+    if (in.get<uint64_t>() != _stamp.size or in.get<uint64_t>() != _stamp.hash) return nullptr;
+
+    auto data = std::make_shared<MshData>();
+    data->nnpe = in.get<uint32_t>();
+    data->nelems = in.get<uint64_t>();
+    in.get_vec(data->x);
+    in.get_vec(data->elems);
+    in.get_vec(data->wall);
+    in.get_vec(data->wall_starts);
+    in.get_vec(data->open);
+    in.get_vec(data->open_starts);
+    if (not in.good()) return nullptr;
+    return data;
+  }
+
+  static bool save(const std::string& _cachefile, const Stamp& _stamp, const MshData& _data) {
+    CheckpointWriter out(_cachefile);
+    for (const char c : magic) out.put(c);
+    out.put(version);
+    out.put((uint32_t)sizeof(Int));
+    out.put(_stamp.size);
+    out.put(_stamp.hash);
+    out.put(_data.nnpe);
+    out.put(_data.nelems);
+    out.put_vec(_data.x);
+    out.put_vec(_data.elems);
+    out.put_vec(_data.wall);
+    out.put_vec(_data.wall_starts);
+    out.put_vec(_data.open);
+    out.put_vec(_data.open_starts);
+    return out.finish();
+  }
+
+  std::map<std::string, Entry> entries;
+  std::mutex mtx;
+};
@@ -0,0 +1,194 @@
+/*
+ * Numa.h - Thread pinning and first-touch placement for multi-socket nodes
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "VectorHelper.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#endif
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+
+//
+// Linux puts a page on the NUMA node of the thread which first writes it, so an array
+//   zeroed by the step thread lives on one socket, and the OpenMP threads on the other
+//   read every element over the interconnect. With USE_NUMA, collections which grow write
+//   their new elements from the OpenMP threads, each the same contiguous share of the
+//   indices that it takes in the influence loops (a static schedule); that only holds if
+//   the threads stay put, so the team can be pinned to cores:
+//
+//   "threadAffinity": "close"   one thread per core, in order, filling a socket first
+//                     "spread"  threads spaced evenly over the cores, so over the sockets
+//                     "none"    leave the threads where the system puts them (default)
+//
+// each Simulation keeps its own setting, and pins the team of whichever thread steps it;
+//   two threads stepping at once would pin onto the same cores, so an ensemble with
+//   several jobs runs unpinned
+//
+enum affinity_t { affinity_none, affinity_close, affinity_spread };
+
+inline bool affinity_from_name(const std::string& _name, affinity_t& _aff) {
+  if (_name == "none") _aff = affinity_none;
+  else if (_name == "close") _aff = affinity_close;
+  else if (_name == "spread") _aff = affinity_spread;
+  else return false;
+  return true;
+}
+
+inline const char* affinity_name(const affinity_t _aff) {
+  if (_aff == affinity_close) return "close";
+  if (_aff == affinity_spread) return "spread";
+  return "none";
+}
+
+// which node a cpu sits on, from sysfs, or 0 when that cannot be found
+inline int numa_node_of_cpu(const int _cpu) {
+#ifdef __linux__
+  const std::string dirname = "/sys/devices/system/cpu/cpu" + std::to_string(_cpu);
+  DIR* dir = opendir(dirname.c_str());
+  if (not dir) return 0;
+  int node = 0;
+  while (struct dirent* ent = readdir(dir)) {
+    if (std::strncmp(ent->d_name, "node", 4) == 0) {
+      node = std::atoi(ent->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+#else
+  (void) _cpu;
+  return 0;
+#endif
+}
+
+// the share of [0,_n) which thread _t of _nt takes in an omp for with a static schedule
+inline std::pair<size_t,size_t> static_share(const size_t _n, const int _t, const int _nt) {
+  const size_t q = _n / _nt;
+  const size_t r = _n % _nt;
+  const size_t first = _t*q + std::min((size_t)_t, r);
+  return {first, first + q + ((size_t)_t < r ? 1 : 0)};
+}
+
+//
+// pin the OpenMP team of the calling thread, once per thread, setting, and team size;
+//   returns where each thread went, as "cpu/node" for thread 0, 1, ..., "none" if it put
+//   a pinned team back on the cpus it started with, or empty if nothing changed
+//
+inline std::string pin_omp_team(const affinity_t aff) {
+  thread_local affinity_t pinned = affinity_none;
+  thread_local int pinned_threads = 0;
+#ifdef _OPENMP
+  const int nthreads = omp_get_max_threads();
+#else
+  const int nthreads = 1;
+#endif
+  if (aff == pinned and (aff == affinity_none or nthreads == pinned_threads)) return std::string();
+
+#ifdef __linux__
+  // the cpus this thread had before it was first pinned, which its team goes back to
+  thread_local cpu_set_t allowed;
+  if (pinned == affinity_none) {
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return std::string();
+  }
+#endif
+  pinned = aff;
+  pinned_threads = nthreads;
+
+  if (aff == affinity_none) {
+#ifdef __linux__
+    #pragma omp parallel
+    {
+    (void) pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+    }
+#endif
+    return std::string("none");
+  }
+
+  std::vector<int> cpus;
+#ifdef __linux__
+  for (int c=0; c<CPU_SETSIZE; ++c) if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+#endif
+  if (cpus.empty()) return std::string();
+
+  std::vector<int> where;
+#ifdef _OPENMP
+  where.assign(nthreads, -1);
+  #pragma omp parallel
+  {
+  const int t = omp_get_thread_num();
+  const int nt = omp_get_num_threads();
+  const size_t ncpu = cpus.size();
+  const int cpu = (aff == affinity_spread) ? cpus[((size_t)t * ncpu / nt) % ncpu] : cpus[t % ncpu];
+#ifdef __linux__
+  cpu_set_t one;
+  CPU_ZERO(&one);
+  CPU_SET(cpu, &one);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(one), &one) == 0) where[t] = cpu;
+#endif
+  }
+#endif
+
+  std::ostringstream out;
+  for (size_t t=0; t<where.size(); ++t) {
+    if (t > 0) out << " ";
+    if (where[t] < 0) out << "-";
+    else out << where[t] << "/" << numa_node_of_cpu(where[t]);
+  }
+  return out.str();
+}
+
+//
+// resize a collection array, with the new elements (and all of them, if it must move)
+//   written by the threads which will read them; small arrays are not worth the team
+//
+template <class V>
+void first_touch_resize(V& _v, const size_t _n, const size_t _newcap) {
+#if defined(USE_NUMA) and defined(_OPENMP)
+  static constexpr size_t min_bytes = 1 << 20;
+  if (_n * sizeof(typename V::value_type) >= min_bytes and omp_get_max_threads() > 1) {
+    using T = typename V::value_type;
+    const size_t nold = std::min(_v.size(), _n);
+
+    // a fresh buffer for the whole array, or just the new tail of this one
+    const bool moving = (_newcap > _v.capacity());
+    V fresh;
+    V& dest = moving ? fresh : _v;
+    if (moving) dest.reserve(_newcap);
+    deferred_init() = true;
+    dest.resize(_n);
+    deferred_init() = false;
+
+    const size_t first = moving ? 0 : nold;
+    #pragma omp parallel
+    {
+    const auto [ibeg, iend] = static_share(_n, omp_get_thread_num(), omp_get_num_threads());
+    for (size_t i=std::max(ibeg,first); i<iend; ++i) dest[i] = (i < nold) ? _v[i] : T();
+    }
+
+    if (moving) _v.swap(fresh);
+    return;
+  }
+#endif
+  if (_newcap > _v.capacity()) _v.reserve(_newcap);
+  _v.resize(_n);
+}
@@ -0,0 +1,109 @@
+/*
+ * OffscreenGL.h - An OpenGL context with no window, for drawing frames in the batch version
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "OglHelper.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+
+//
+// EGL gives a core-profile context drawing into a pbuffer the size of the GUI window, so
+//   the same drawGL calls and shaders work on a compute node with no display: a GPU when
+//   the driver offers one, otherwise Mesa's software rasterizer
+//
+// a pbuffer only has a back buffer, which is where FrameSaver reads from
+//
+class OffscreenGL {
+public:
+  ~OffscreenGL() {
+    if (dpy == EGL_NO_DISPLAY) return;
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (ctx != EGL_NO_CONTEXT) eglDestroyContext(dpy, ctx);
+    if (surf != EGL_NO_SURFACE) eglDestroySurface(dpy, surf);
+    eglTerminate(dpy);
+  }
+
+  // make the context current on this thread; returns an empty string or what went wrong
+  std::string init(const int _w, const int _h) {
+    width = _w;
+    height = _h;
+
+    EGLint major, minor;
+    dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (dpy == EGL_NO_DISPLAY or not eglInitialize(dpy, &major, &minor)) {
+      // no X server or device behind the default: Mesa can still draw with no platform at all
+      auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+      dpy = get_platform_display ? get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+                                 : EGL_NO_DISPLAY;
+      if (dpy == EGL_NO_DISPLAY or not eglInitialize(dpy, &major, &minor)) {
+        dpy = EGL_NO_DISPLAY;
+        return "Could not open an EGL display\n";
+      }
+    }
+
+    const EGLint config_attribs[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+      EGL_NONE };
+    EGLConfig config;
+    EGLint nconfigs = 0;
+    if (not eglChooseConfig(dpy, config_attribs, &config, 1, &nconfigs) or nconfigs < 1) {
+      return "No EGL configuration can draw OpenGL into a pbuffer\n";
+    }
+
+    const EGLint pbuffer_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    surf = eglCreatePbufferSurface(dpy, config, pbuffer_attribs);
+    if (surf == EGL_NO_SURFACE) {
+      return "Could not make a " + std::to_string(width) + "x" + std::to_string(height) + " EGL pbuffer\n";
+    }
+
+    // same profile as the GUI asks of glfw
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 3,
+      EGL_CONTEXT_MINOR_VERSION, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE };
+    ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, context_attribs);
+    if (ctx == EGL_NO_CONTEXT) return "Could not make an OpenGL 3.3 core context through EGL\n";
+    if (not eglMakeCurrent(dpy, surf, surf, ctx)) return "Could not make the EGL context current\n";
+
+    if (not gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) return "Could not load the OpenGL functions\n";
+
+    std::cout << "  rendering offscreen with EGL " << major << "." << minor << ", "
+              << glGetString(GL_RENDERER) << std::endl;
+    return std::string();
+  }
+
+  int get_width() const { return width; }
+  int get_height() const { return height; }
+
+  // the view from the GUI's camera at this resolution, as compute_ortho_proj_mat makes it
+  std::vector<float> get_projection(const float _cx, const float _cy, const float _size) const {
+    const float vsx = _size;
+    const float vsy = _size * (float)height / (float)width;
+    return { 1.0f/vsx, 0.0f,     0.0f, 0.0f,
+             0.0f,     1.0f/vsy, 0.0f, 0.0f,
+             0.0f,     0.0f,    -1.0f, 0.0f,
+            -_cx/vsx, -_cy/vsy,  0.0f, 1.0f };
+  }
+
+private:
+  EGLDisplay dpy = EGL_NO_DISPLAY;
+  EGLSurface surf = EGL_NO_SURFACE;
+  EGLContext ctx = EGL_NO_CONTEXT;
+  int width = 0;
+  int height = 0;
+};
@@ -0,0 +1,238 @@
+/*
+ * OglCompute.h - Run the direct-sum influence kernels on the gpu with OpenGL compute shaders
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "ShaderHelper.h"
+#include "Points.h"
+#include "Surfaces.h"
+#include "ResultsType.h"
+
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <array>
+#include <map>
+#include <mutex>
+
+//
+// Owns the compute programs and the device-resident copies of the collections
+//
+// The simulation runs in a worker thread, so the gui hands over a second, shared context
+//   through acquire_context and release_context. Arrays are only re-uploaded when the
+//   collection's state generation changes, so unmoving bodies stay on the device.
+//
+class OglCompute {
+public:
+  // set these from the thread that owns the window; acquire returns false if there is no context
+  static inline std::function<bool()> acquire_context;
+  static inline std::function<void()> release_context;
+
+  // one instance serves every influence call
+  static OglCompute& get() {
+    static OglCompute instance;
+    return instance;
+  }
+
+  // returns false if the calculation could not be run on the gpu
+  template <class S>
+  bool points_affect_points (const Points<S>& src, Points<S>& targ, const ResultsType& restype,
+                             const VelCore _core) {
+    // the shader only implements the Vatistas n=2 core
+    if (_core != core_v2) return false;
+    if (restype.get_type() != velonly and restype.get_type() != velandvort) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (not begin()) return false;
+
+    const GLuint sbuf = upload_points(src);
+    const GLuint tbuf = upload_points(static_cast<const Points<S>&>(targ));
+    const GLuint rbuf = result_buffer(targ.get_n());
+
+    glUseProgram(m_ptvel);
+    glUniform1ui(glGetUniformLocation(m_ptvel, "nsrc"), (GLuint)src.get_n());
+    glUniform1ui(glGetUniformLocation(m_ptvel, "ntarg"), (GLuint)targ.get_n());
+    glUniform1i(glGetUniformLocation(m_ptvel, "thick"), targ.is_inert() ? 0 : 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sbuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tbuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, rbuf);
+    dispatch(targ.get_n());
+
+    // accumulate onto the existing velocities
+    const std::vector<float>& res = read_results(rbuf, targ.get_n());
+    std::array<Vector<S>,Dimensions>& tu = targ.get_vel();
+    for (size_t i=0; i<targ.get_n(); ++i) {
+      tu[0][i] += res[4*i+0];
+      tu[1][i] += res[4*i+1];
+    }
+    if (restype.get_type() == velandvort) {
+      Vector<S>& tw = targ.get_vort();
+      for (size_t i=0; i<targ.get_n(); ++i) tw[i] += res[4*i+2];
+    }
+
+    end();
+    return true;
+  }
+
+  template <class S>
+  bool panels_affect_points (const Surfaces<S>& src, Points<S>& targ, const ResultsType& restype) {
+    if (not restype.compute_vel() or restype.compute_grad()) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (not begin()) return false;
+
+    const auto [pbuf, sbuf] = upload_panels(src);
+    const GLuint tbuf = upload_points(static_cast<const Points<S>&>(targ));
+    const GLuint rbuf = result_buffer(targ.get_n());
+
+    glUseProgram(m_panvel);
+    glUniform1ui(glGetUniformLocation(m_panvel, "nsrc"), (GLuint)src.get_npanels());
+    glUniform1ui(glGetUniformLocation(m_panvel, "ntarg"), (GLuint)targ.get_n());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pbuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tbuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, rbuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, sbuf);
+    dispatch(targ.get_n());
+
+    const std::vector<float>& res = read_results(rbuf, targ.get_n());
+    std::array<Vector<S>,Dimensions>& tu = targ.get_vel();
+    for (size_t i=0; i<targ.get_n(); ++i) {
+      tu[0][i] += res[4*i+0];
+      tu[1][i] += res[4*i+1];
+    }
+
+    end();
+    return true;
+  }
+
+private:
+  OglCompute() = default;
+  OglCompute(const OglCompute&) = delete;
+  OglCompute& operator=(const OglCompute&) = delete;
+
+  // one buffer on the device, and the state of the collection it was filled from
+  struct DeviceArray {
+    GLuint id = 0;
+    size_t bytes = 0;
+    uint32_t gen = 0;
+  };
+
+  // make the context current, and build the programs the first time through
+  bool begin() {
+    if (not acquire_context or not acquire_context()) return false;
+    if (m_ptvel == 0) m_ptvel = create_ptvel_compute_prog();
+    if (m_panvel == 0) m_panvel = create_panvel_compute_prog();
+    return true;
+  }
+
+  void end() {
+    glUseProgram(0);
+    if (release_context) release_context();
+  }
+
+  // copy data into a buffer, growing it only when necessary
+  void fill (DeviceArray& buf, const std::vector<float>& data) {
+    if (buf.id == 0) glGenBuffers(1, &buf.id);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf.id);
+    const size_t nbytes = sizeof(float) * data.size();
+    if (nbytes > buf.bytes) {
+      glBufferData(GL_SHADER_STORAGE_BUFFER, nbytes, data.data(), GL_DYNAMIC_DRAW);
+      buf.bytes = nbytes;
+    } else {
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, nbytes, data.data());
+    }
+  }
+
+  // particles and field points both go up as (x, y, radius, strength)
+  template <class S>
+  GLuint upload_points (const Points<S>& pts) {
+    DeviceArray& buf = m_arrays[&pts];
+    if (buf.id != 0 and buf.gen == pts.get_state_gen()) return buf.id;
+
+    const std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+    const size_t n = pts.get_n();
+    std::vector<float> data(4*n, 0.0);
+    for (size_t i=0; i<n; ++i) {
+      data[4*i+0] = x[0][i];
+      data[4*i+1] = x[1][i];
+    }
+    if (not pts.is_inert()) {
+      const Vector<S>& r = pts.get_rad();
+      const Vector<S>& s = pts.get_str();
+      for (size_t i=0; i<n; ++i) {
+        data[4*i+2] = r[i];
+        data[4*i+3] = s[i];
+      }
+    }
+    fill(buf, data);
+    buf.gen = pts.get_state_gen();
+    return buf.id;
+  }
+
+  // panels go up as (x0, y0, x1, y1) and (vortex, source) strengths
+  template <class S>
+  std::pair<GLuint,GLuint> upload_panels (const Surfaces<S>& surf) {
+    DeviceArray& pbuf = m_arrays[&surf];
+    DeviceArray& sbuf = m_arrays[&surf.get_idx()];
+    if (pbuf.id != 0 and pbuf.gen == surf.get_state_gen()) return {pbuf.id, sbuf.id};
+
+    const std::array<Vector<S>,Dimensions>& x = surf.get_pos();
+    const std::vector<Int>& idx = surf.get_idx();
+    const Vector<S>& vs = surf.get_vort_str();
+    const size_t n = surf.get_npanels();
+    std::vector<float> pdata(4*n);
+    std::vector<float> sdata(2*n, 0.0);
+    for (size_t j=0; j<n; ++j) {
+      pdata[4*j+0] = x[0][idx[2*j]];
+      pdata[4*j+1] = x[1][idx[2*j]];
+      pdata[4*j+2] = x[0][idx[2*j+1]];
+      pdata[4*j+3] = x[1][idx[2*j+1]];
+      sdata[2*j+0] = vs[j];
+    }
+    if (surf.have_src_str()) {
+      const Vector<S>& ss = surf.get_src_str();
+      for (size_t j=0; j<n; ++j) sdata[2*j+1] = ss[j];
+    }
+    fill(pbuf, pdata);
+    fill(sbuf, sdata);
+    pbuf.gen = surf.get_state_gen();
+    return {pbuf.id, sbuf.id};
+  }
+
+  GLuint result_buffer (const size_t n) {
+    const size_t nbytes = 4 * sizeof(float) * n;
+    if (m_results.id == 0) glGenBuffers(1, &m_results.id);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_results.id);
+    if (nbytes > m_results.bytes) {
+      glBufferData(GL_SHADER_STORAGE_BUFFER, nbytes, nullptr, GL_DYNAMIC_READ);
+      m_results.bytes = nbytes;
+    }
+    return m_results.id;
+  }
+
+  // one thread per target, must match local_size_x in the shaders
+  void dispatch (const size_t ntarg) {
+    const GLuint ngroups = (GLuint)((ntarg + 127) / 128);
+    if (ngroups > 0) glDispatchCompute(ngroups, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  }
+
+  const std::vector<float>& read_results (const GLuint rbuf, const size_t n) {
+    m_readback.resize(4*n);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rbuf);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float)*m_readback.size(), m_readback.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return m_readback;
+  }
+
+  std::mutex m_mutex;
+  GLuint m_ptvel = 0;
+  GLuint m_panvel = 0;
+  std::map<const void*, DeviceArray> m_arrays;
+  DeviceArray m_results;
+  std::vector<float> m_readback;
+};
@@ -0,0 +1,246 @@
+/*
+ * Outflow.h - A sponge downstream which absorbs and retires the wake
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Collection.h"
+#include "Merge.h"
+#include "Checkpoint.h"
+#include "Logger.h"
+
+#include <json/json.hpp>
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <iostream>
+
+
+//
+// Far downstream the wake no longer changes the flow near the bodies, but its particles
+//   still cost as much as any other. In the sponge, from x=start to start+width, a free
+//   particle gives up a fraction of its strength each step, more the deeper it is, and
+//   past the far edge it is removed; tracers past the far edge are removed too. The run
+//   then settles to a steady particle count as well as a steady flow.
+//
+// what leaves the particles is not lost: its circulation and impulse (-s y, s x) are kept
+//   here, and added to the totals for the status file, so the circulation stays constant
+//   and the impulse-derived force does not see the retired wake as a jump
+//
+// with lumped set, the retired strength instead goes into a few large vortices, one of each
+//   sign in each of lumped bands across span; each sits at the strength-weighted centroid
+//   of all that went into it, so it carries exactly the impulse it took in, and drifts with
+//   the freestream. They are an active, fixed collection in the vortex list, so every
+//   velocity sum (and the BEM) sees a far wake, but nothing diffuses, merges or moves them
+//   but this class
+//
+template <class S>
+class Outflow {
+public:
+  bool is_active() const { return width > 0.0; }
+
+  // absorb strength in the sponge and remove what has crossed it, returns how many were removed
+  size_t apply(std::vector<Collection>& _vort, std::vector<Collection>& _fldpt,
+               const double _dt, const std::array<double,Dimensions>& _fs, const S _vdelta) {
+    if (not is_active()) return 0;
+
+    // the far wake moves on with the freestream
+    for (size_t k=0; k<lump_s.size(); ++k) {
+      lump_x[k] += _fs[0] * _dt;
+      lump_y[k] += _fs[1] * _dt;
+    }
+
+    const double xend = start + width;
+    size_t nremoved = 0;
+
+    for (auto& coll : _vort) {
+      if (not std::holds_alternative<Points<S>>(coll)) continue;
+      Points<S>& pts = std::get<Points<S>>(coll);
+      if (pts.is_inert() or pts.get_movet() != lagrangian or pts.get_body_ptr()) continue;
+
+      const std::array<Vector<S>,Dimensions>& x = std::as_const(pts).get_pos();
+      if (std::none_of(x[0].begin(), x[0].end(), [=](const S _x) { return _x > (S)start; })) continue;
+
+      Vector<S>& s = pts.get_str();
+      std::vector<uint8_t> keep(pts.get_n(), 1);
+      size_t nkill = 0;
+      for (size_t i=0; i<pts.get_n(); ++i) {
+        if (x[0][i] <= (S)start) continue;
+        double ds = s[i];
+        if (x[0][i] >= (S)xend) {
+          keep[i] = 0;
+          ++nkill;
+        } else {
+          const double depth = (x[0][i] - start) / width;
+          ds *= 1.0 - std::exp(-rate * depth * _dt);
+        }
+        s[i] -= (S)ds;
+        retire(ds, x[0][i], x[1][i]);
+      }
+
+      if (nkill > 0) compact_collection(pts, keep);
+      nremoved += nkill;
+    }
+
+    // tracers carry nothing, they just go
+    for (auto& coll : _fldpt) {
+      if (not std::holds_alternative<Points<S>>(coll)) continue;
+      Points<S>& pts = std::get<Points<S>>(coll);
+      if (pts.get_movet() != lagrangian or pts.get_body_ptr()) continue;
+
+      const Vector<S>& x = std::as_const(pts).get_pos()[0];
+      std::vector<uint8_t> keep(pts.get_n());
+      for (size_t i=0; i<pts.get_n(); ++i) keep[i] = (x[i] < (S)xend);
+      const size_t nkill = std::count(keep.begin(), keep.end(), 0);
+      if (nkill > 0) compact_collection(pts, keep);
+      nremoved += nkill;
+    }
+
+    if (not lump_s.empty()) update_lumps(_vort, _vdelta);
+
+    if (nremoved > 0) LOG_DEBUG("    outflow removed " << nremoved << " particles");
+    return nremoved;
+  }
+
+  // circulation and impulse of the retired wake which no particle holds
+  double get_retired_circ() const { return retired_circ; }
+  const std::array<double,Dimensions>& get_retired_impulse() const { return retired_imp; }
+
+  void reset() {
+    retired_circ = 0.0;
+    retired_imp.fill(0.0);
+    init_lumps();
+  }
+
+  void write_state(CheckpointWriter& _out) const {
+    _out.put(retired_circ);
+    _out.put(retired_imp);
+    _out.put_vec(lump_x);
+    _out.put_vec(lump_y);
+    _out.put_vec(lump_s);
+  }
+  void read_state(CheckpointReader& _in) {
+    retired_circ = _in.get<double>();
+    retired_imp = _in.get<std::array<double,Dimensions>>();
+    _in.get_vec(lump_x);
+    _in.get_vec(lump_y);
+    _in.get_vec(lump_s);
+  }
+
+  void from_json(const nlohmann::json j) {
+    start = j.value("start", start);
+    width = j.value("width", width);
+    rate = j.value("rate", rate);
+    std::cout << "  setting outflow sponge from x= " << start << " to " << start+width << " at rate " << rate << std::endl;
+
+    nlumped = j.value("lumped", 0);
+    if (nlumped > 0) {
+      if (j.find("span") == j.end() or j["span"].size() != 2) {
+        std::cout << "  outflow lumped vortices need a span [ymin, ymax], retiring the wake instead" << std::endl;
+        nlumped = 0;
+      } else {
+        const std::vector<double> sp = j["span"];
+        span = {std::min(sp[0], sp[1]), std::max(sp[0], sp[1])};
+        std::cout << "  setting outflow wake into " << nlumped << " lumped bands across y= " << span[0] << " to " << span[1] << std::endl;
+      }
+    }
+    reset();
+  }
+
+  nlohmann::json to_json() const {
+    nlohmann::json j;
+    j["start"] = start;
+    j["width"] = width;
+    j["rate"] = rate;
+    if (nlumped > 0) {
+      j["lumped"] = nlumped;
+      j["span"] = {span[0], span[1]};
+    }
+    return j;
+  }
+
+private:
+  // strength ds leaves a particle at (x,y)
+  void retire(const double _ds, const double _x, const double _y) {
+    if (_ds == 0.0) return;
+
+    if (lump_s.empty()) {
+      retired_circ += _ds;
+      retired_imp[0] -= _ds * _y;
+      retired_imp[1] += _ds * _x;
+      return;
+    }
+
+    // the band, then the vortex of this sign in it
+    const double frac = (_y - span[0]) / (span[1] - span[0]);
+    const int band = std::clamp((int)std::floor(frac * nlumped), 0, nlumped-1);
+    const size_t k = 2*band + (_ds < 0.0 ? 1 : 0);
+    const double wold = std::abs(lump_s[k]);
+    const double wnew = wold + std::abs(_ds);
+    lump_x[k] = (wold*lump_x[k] + std::abs(_ds)*_x) / wnew;
+    lump_y[k] = (wold*lump_y[k] + std::abs(_ds)*_y) / wnew;
+    lump_s[k] += _ds;
+  }
+
+  void init_lumps() {
+    lump_x.assign(2*nlumped, start + width);
+    lump_y.resize(2*nlumped);
+    lump_s.assign(2*nlumped, 0.0);
+    for (int b=0; b<nlumped; ++b) {
+      lump_y[2*b] = lump_y[2*b+1] = span[0] + (b + 0.5) * (span[1] - span[0]) / nlumped;
+    }
+  }
+
+  // copy the lumps into their collection, making it the first time
+  void update_lumps(std::vector<Collection>& _vort, const S _vdelta) {
+    Points<S>* lumps = nullptr;
+    for (auto& coll : _vort) {
+      if (not std::holds_alternative<Points<S>>(coll)) continue;
+      Points<S>& pts = std::get<Points<S>>(coll);
+      if (not pts.is_inert() and pts.get_movet() == fixed and not pts.get_body_ptr() and
+          pts.get_n() == lump_s.size()) lumps = &pts;
+    }
+
+    if (not lumps) {
+      if (std::all_of(lump_s.begin(), lump_s.end(), [](const double _s) { return _s == 0.0; })) return;
+      // as wide as a band, and never smaller than a particle
+      const S rad = std::max(_vdelta, (S)((span[1] - span[0]) / nlumped));
+      std::vector<S> x(2*lump_s.size());
+      std::vector<S> s(lump_s.size(), 0.0);
+      _vort.push_back(Points<S>(ElementPacket<S>(x, std::vector<Int>(), s, lump_s.size(), 0),
+                                active, fixed, nullptr, rad));
+      lumps = &std::get<Points<S>>(_vort.back());
+    }
+
+    std::array<Vector<S>,Dimensions>& x = lumps->get_pos();
+    Vector<S>& s = lumps->get_str();
+    for (size_t k=0; k<lump_s.size(); ++k) {
+      x[0][k] = (S)lump_x[k];
+      x[1][k] = (S)lump_y[k];
+      s[k] = (S)lump_s[k];
+    }
+  }
+
+  // the sponge, and how fast it absorbs at its far edge, per unit time
+  double start = 0.0;
+  double width = 0.0;
+  double rate = 1.0;
+
+  // how many bands of lumped vortices across span, none means just keep the totals
+  int nlumped = 0;
+  std::array<double,2> span = {0.0, 0.0};
+
+  double retired_circ = 0.0;
+  std::array<double,Dimensions> retired_imp = {0.0, 0.0};
+
+  // position and strength of the lumped vortices, positive then negative in each band
+  std::vector<double> lump_x, lump_y, lump_s;
+};
@@ -0,0 +1,108 @@
+/*
+ * OutputFilter.h - Choose which points of a collection get written to output files
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+
+#include <json/json.hpp>
+
+#include <vector>
+#include <array>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+
+// all points, those inside a box, or those inside an annulus
+enum region_t {
+  region_all     = 0,
+  region_box     = 1,
+  region_annulus = 2
+};
+
+//
+// A point is written if it is inside the region, is every stride-th of those, and (for
+//   particles) has a strength of at least min_str; this only thins the files, every point
+//   is still simulated and evaluated
+//
+class OutputFilter {
+public:
+  bool is_active() const { return region != region_all or stride > 1 or min_str > 0.0; }
+
+  template <class S>
+  std::vector<uint8_t> keep_flags(const std::array<Vector<S>,Dimensions>& _x, const Vector<S>* _s) const {
+    const size_t n = _x[0].size();
+    std::vector<uint8_t> keep(n, 0);
+    size_t ninside = 0;
+    for (size_t i=0; i<n; ++i) {
+      const double x = _x[0][i];
+      const double y = _x[1][i];
+      bool inside = true;
+      if (region == region_box) {
+        inside = (x >= box[0] and x <= box[2] and y >= box[1] and y <= box[3]);
+      } else if (region == region_annulus) {
+        const double rsq = std::pow(x-center[0], 2) + std::pow(y-center[1], 2);
+        inside = (rsq >= radii[0]*radii[0] and rsq <= radii[1]*radii[1]);
+      }
+      if (inside and _s and min_str > 0.0) inside = (std::abs((*_s)[i]) >= min_str);
+      if (inside) keep[i] = (ninside++ % stride == 0);
+    }
+    return keep;
+  }
+
+  void from_json(const nlohmann::json j) {
+    if (j.find("region") != j.end()) {
+      const std::string reg = j["region"];
+      if (reg == "box" and j.find("box") != j.end()) {
+        region = region_box;
+        box = j["box"];
+      } else if (reg == "annulus" and j.find("center") != j.end() and j.find("radii") != j.end()) {
+        region = region_annulus;
+        center = j["center"];
+        radii = j["radii"];
+      } else if (reg != "all") {
+        std::cout << "  unknown or incomplete output region " << reg << ", writing all" << std::endl;
+      }
+      std::cout << "    setting output region= " << reg << std::endl;
+    }
+    if (j.find("stride") != j.end()) {
+      stride = std::max((size_t)1, (size_t)j["stride"]);
+      std::cout << "    setting output stride= " << stride << std::endl;
+    }
+    if (j.find("minStrength") != j.end()) {
+      min_str = j["minStrength"];
+      std::cout << "    setting output min strength= " << min_str << std::endl;
+    }
+  }
+
+  nlohmann::json to_json() const {
+    nlohmann::json j = nlohmann::json::object();
+    if (region == region_box) {
+      j["region"] = "box";
+      j["box"] = box;
+    } else if (region == region_annulus) {
+      j["region"] = "annulus";
+      j["center"] = center;
+      j["radii"] = radii;
+    }
+    if (stride > 1) j["stride"] = stride;
+    if (min_str > 0.0) j["minStrength"] = min_str;
+    return j;
+  }
+
+private:
+  region_t region = region_all;
+  std::array<double,4> box = {-1.0, -1.0, 1.0, 1.0};	// xmin, ymin, xmax, ymax
+  std::array<double,2> center = {0.0, 0.0};
+  std::array<double,2> radii = {0.0, 1.0};		// inner and outer
+  size_t stride = 1;
+  double min_str = 0.0;
+};
+
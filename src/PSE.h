@@ -9,7 +9,10 @@
 
 #include "Core.h"
 #include "VectorHelper.h"
-#include "nanoflann/nanoflann.hpp"
+#include "CellList.h"
+#include "MemoryHelper.h"
+#include "Profiler.h"
+#include "Logger.h"
 #include <json/json.hpp>
 
 #include <Eigen/Dense>
@@ -42,10 +45,14 @@ public:
   const float get_ignore() const { return ignore_thresh; }
   const bool get_volumes() const { return use_volumes; }
 
-  // all-to-all diffuse; can change array sizes
+  // the neighbor lists and volumes of the last call
+  size_t get_mem_bytes() const { return scratch_bytes; }
+
+  // all-to-all diffuse; can change array sizes; the cell list covers the incoming particles
   void diffuse_all(std::array<Vector<ST>,2>&,
                    Vector<ST>&,
                    Vector<ST>&,
+                   const CellList<ST>&,
                    const ST,
                    const CoreType,
                    const ST);
@@ -66,6 +73,7 @@ protected:
                                 Vector<ST>&,
                                 Vector<ST>&,
                                 Vector<ST>&,
+                                const CellList<ST>&,
                                 const ST);
 
   // find particle volumes
@@ -95,7 +103,9 @@ private:
   // calculate and use particle volumes? (increases accuracy)
   bool use_volumes = true;
 
-  // use nanoflann for nearest-neighbor searching? false uses direct search
+  size_t scratch_bytes = 0;
+
+  // use the cell list for nearest-neighbor searching? false uses direct search
   const bool use_tree = true;
 };
 
@@ -150,10 +160,9 @@ size_t PSE<ST,CT>::add_new_boundary_parts(Vector<ST>& x,
                                           Vector<ST>& y,
                                           Vector<ST>& r,
                                           Vector<ST>& s,
+                                          const CellList<ST>& cells,
                                           const ST particle_overlap) {
-
-  // start timer
-  auto start = std::chrono::system_clock::now();
+  PROFILE_ZONE("buffer");
 
   // make sure all vector sizes are identical
   assert(x.size()==y.size());
@@ -161,31 +170,18 @@ size_t PSE<ST,CT>::add_new_boundary_parts(Vector<ST>& x,
   assert(x.size()==s.size());
   size_t n = x.size();
 
-  std::cout << "  Adding buffer particles with n " << n << std::endl;
-
-  // convert particle positions into something nanoflann can understand
-  Eigen::Matrix<ST, Eigen::Dynamic, 2> xp;
-  xp.resize(n,2);
-  xp.col(0) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(x.data(), n);
-  xp.col(1) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(y.data(), n);
-  
-  // generate the searchable data structure
-  typedef typename Eigen::Matrix<ST, Eigen::Dynamic, 2> EigenMatType;
-  typedef typename EigenMatType::Index EigenIndexType;
-  typedef nanoflann::KDTreeEigenMatrixAdaptor< EigenMatType >  my_kd_tree_t;
-  my_kd_tree_t mat_index(Dimensions, std::cref(xp));
-  if (use_tree) mat_index.index->buildIndex();
-
-  std::vector<std::pair<EigenIndexType,ST> > ret_matches;
+  LOG_DEBUG("  Adding buffer particles with n " << n);
+
+  assert((not use_tree or cells.size()==n) && "Cell list does not match particles");
+
+  std::vector<std::pair<int32_t,ST> > ret_matches;
   ret_matches.reserve(max_near);
-  nanoflann::SearchParams params;
-  params.sorted = true;
 
   // what is maximum strength of all particles?
   const ST maxStr = s[std::max_element(s.begin(), s.end()) - s.begin()];
   const ST minStr = s[std::min_element(s.begin(), s.end()) - s.begin()];
   const ST maxAbsStr = std::max(maxStr, -1.f*minStr);
-  std::cout << "    maxAbsStr " << maxAbsStr << std::endl;
+  LOG_DEBUG("    maxAbsStr " << maxAbsStr);
 
   //
   // check each strong-enough particle for an appropriate number of neighbors
@@ -208,14 +204,13 @@ size_t PSE<ST,CT>::add_new_boundary_parts(Vector<ST>& x,
 
     // switch on search method
     if (use_tree) {
-      // tree-based search with nanoflann
+      // search the cell list
       const ST distsq_thresh = std::pow(search_rad, 2);
-      const ST query_pt[2] = { x[i], y[i] };
-      (void) mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
+      cells.radius_search(x[i], y[i], distsq_thresh, ret_matches);
       //if (ret_matches.size() > 20) std::cout << "part " << i << " at " << x[i] << " " << y[i] << " " << z[i] << " has " << ret_matches.size() << " matches" << std::endl;
 
       // copy the indexes into my vector
-      for (size_t j=0; j<ret_matches.size(); ++j) inear.push_back((int32_t)ret_matches[j].first);
+      for (size_t j=0; j<ret_matches.size(); ++j) inear.push_back(ret_matches[j].first);
 
       // now direct search over all newer particles
       for (size_t j=initial_n; j<n; ++j) {
@@ -249,12 +244,7 @@ size_t PSE<ST,CT>::add_new_boundary_parts(Vector<ST>& x,
     }
   }
 
-  std::cout << "    added " << (n - initial_n) << " buffer particles" << std::endl;
-
-  // finish timer and report
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  printf("    buffering time:\t\t[%.4f] cpu seconds\n", (float)elapsed_seconds.count());
+  LOG_DEBUG("    added " << (n - initial_n) << " buffer particles");
 
   return (n - initial_n);
 }
@@ -310,6 +300,7 @@ template <class ST, class CT>
 void PSE<ST,CT>::diffuse_all(std::array<Vector<ST>,2>& pos,
                              Vector<ST>& str,
                              Vector<ST>& rad,
+                             const CellList<ST>& cells,
                              const ST h_nu,
                              const CoreType core_func,
                              const ST particle_overlap) {
@@ -320,9 +311,7 @@ void PSE<ST,CT>::diffuse_all(std::array<Vector<ST>,2>& pos,
   assert(str.size()==rad.size() && "Input arrays are not uniform size");
 
   //std::cout << "  Running PSE with n " << n << std::endl;
-
-  // start timer
-  auto start = std::chrono::system_clock::now();
+  PROFILE_ZONE("pse");
 
   // reference or generate the local set of vectors
   Vector<ST>& x = pos[0];
@@ -334,7 +323,7 @@ void PSE<ST,CT>::diffuse_all(std::array<Vector<ST>,2>& pos,
   //
   // first step is to add buffer particles where we need them
   //
-  (void) add_new_boundary_parts(x,y,r,s,particle_overlap);
+  (void) add_new_boundary_parts(x,y,r,s,cells,particle_overlap);
   size_t n = x.size();
 
   // generate and zero out delta vector
@@ -349,23 +338,77 @@ void PSE<ST,CT>::diffuse_all(std::array<Vector<ST>,2>& pos,
   assert(x.size()==ds.size());
   n = x.size();
 
-  // convert particle positions into something nanoflann can understand
-  Eigen::Matrix<ST, Eigen::Dynamic, 2> xp;
-  xp.resize(n,2);
-  xp.col(0) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(x.data(), n);
-  xp.col(1) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(y.data(), n);
-  
-  // generate the searchable data structure
-  typedef typename Eigen::Matrix<ST, Eigen::Dynamic, 2> EigenMatType;
-  typedef typename EigenMatType::Index EigenIndexType;
-  typedef nanoflann::KDTreeEigenMatrixAdaptor< EigenMatType >  my_kd_tree_t;
-  my_kd_tree_t mat_index(Dimensions, std::cref(xp));
-  if (use_tree) mat_index.index->buildIndex();
-
-  std::vector<std::pair<EigenIndexType,ST> > ret_matches;
-  ret_matches.reserve(max_near);
-  nanoflann::SearchParams params;
-  params.sorted = true;
+  // the buffer particles are new, so they need a new cell list
+  CellList<ST> newcells;
+  if (use_tree and n != cells.size()) newcells.build(pos, cells.get_cell_size());
+  const CellList<ST>& allcells = (n == cells.size()) ? cells : newcells;
+
+  //
+  // find every particle's neighbors once, for both the volume and the exchange passes, and
+  //   keep them as compressed rows: i's are nbr[nstart[i]] to nbr[nstart[i+1]-1]
+  //
+
+  // must go out to 2-3 core radii to get this right
+  // these are set to introduce no more than 1% error vs. very large search radii
+  //   (the volume pass does not need to go out as far as for the derivative)
+  const ST exch_fac = (core_func == CoreType::compactg) ? 2.0 : 2.65;
+  const ST vol_fac  = (core_func == CoreType::compactg) ? 2.0 : 2.4;
+
+  std::vector<uint32_t> nstart(n+1, 0);
+  std::vector<int32_t> nbr;
+  std::vector<CT> nbrdsq;
+  {
+    // fixed chunks, then concatenated in order, so thread count does not change the rows
+    const size_t chunk_size = 1024;
+    const size_t nchunks = (n + chunk_size - 1) / chunk_size;
+    std::vector<std::vector<int32_t>> chunk_idx(nchunks);
+    std::vector<std::vector<CT>> chunk_dsq(nchunks);
+
+    #pragma omp parallel
+    {
+      std::vector<std::pair<int32_t,ST> > ret_matches;
+      ret_matches.reserve(max_near);
+
+      #pragma omp for schedule(dynamic,1)
+      for (int32_t ic=0; ic<(int32_t)nchunks; ++ic) {
+        const size_t iend = std::min(n, (ic+1)*chunk_size);
+        for (size_t i=ic*chunk_size; i<iend; ++i) {
+          const size_t first = chunk_idx[ic].size();
+          const ST distsq_thresh = std::pow(r[i] * exch_fac, 2);
+
+          // switch on search method
+          if (use_tree) {
+            // search the cell list
+            allcells.radius_search(x[i], y[i], distsq_thresh, ret_matches);
+            for (size_t j=0; j<ret_matches.size(); ++j) chunk_idx[ic].push_back(ret_matches[j].first);
+          } else {
+            // direct search: look for all neighboring particles
+            for (size_t j=0; j<n; ++j) {
+              ST distsq = std::pow(x[i]-x[j], 2) + std::pow(y[i]-y[j], 2);
+              if (distsq < distsq_thresh) chunk_idx[ic].push_back((int32_t)j);
+            }
+          }
+
+          // all distances are unnormalized
+          for (size_t k=first; k<chunk_idx[ic].size(); ++k) {
+            const int32_t jdx = chunk_idx[ic][k];
+            const CT dx = x[i] - x[jdx];
+            const CT dy = y[i] - y[jdx];
+            chunk_dsq[ic].push_back(dx*dx + dy*dy);
+          }
+          nstart[i+1] = chunk_idx[ic].size() - first;
+        }
+      }
+    }
+
+    for (size_t i=0; i<n; ++i) nstart[i+1] += nstart[i];
+    nbr.reserve(nstart[n]);
+    nbrdsq.reserve(nstart[n]);
+    for (size_t ic=0; ic<nchunks; ++ic) {
+      nbr.insert(nbr.end(), chunk_idx[ic].begin(), chunk_idx[ic].end());
+      nbrdsq.insert(nbrdsq.end(), chunk_dsq[ic].begin(), chunk_dsq[ic].end());
+    }
+  }
 
 
   //
@@ -376,82 +419,51 @@ void PSE<ST,CT>::diffuse_all(std::array<Vector<ST>,2>& pos,
   vol.resize(n);
 
   if (use_volumes) {
-    std::cout << "  Find volumes with n " << n << std::endl;
+    LOG_DEBUG("  Find volumes with n " << n);
 
     // loop over every particle
-    for (size_t i=0; i<n; ++i) {
-
-      // don't need to go out as far as for the derivative
-      ST search_rad = r[i] * 2.4;
-      if (core_func == CoreType::compactg) search_rad = r[i] * 2.0;
-
-      // initialize vector of indexes of nearest particles
-      std::vector<int32_t> inear;
-
-      // switch on search method
-      if (use_tree) {
-        // tree-based search with nanoflann
-        const ST distsq_thresh = std::pow(search_rad, 2);
-        const ST query_pt[2] = { x[i], y[i] };
-        (void) mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
-
-        // copy the indexes into my vector
-        for (size_t j=0; j<ret_matches.size(); ++j) inear.push_back((int32_t)ret_matches[j].first);
-
-      } else {
-        // direct search: look for all neighboring particles
-        const ST distsq_thresh = std::pow(search_rad, 2);
-        for (size_t j=0; j<n; ++j) {
-          ST distsq = std::pow(x[i]-x[j], 2) + std::pow(y[i]-y[j], 2);
-          if (distsq < distsq_thresh) inear.push_back((int32_t)j);
-        }
-      }
+    #pragma omp parallel for schedule(dynamic,1024)
+    for (int32_t i=0; i<(int32_t)n; ++i) {
 
-      // zero - just to be sure
-      vol[i] = 0.0;
+      const CT oorsq = 1.0 / std::pow(r[i], 2);
+      const CT vol_thresh = std::pow(vol_fac, 2);
+      const CT* const dsq = nbrdsq.data() + nstart[i];
+      const int32_t nn = nstart[i+1] - nstart[i];
+      CT sum = 0.0;
 
       // split on particle core function
       if (core_func == CoreType::gaussian) {
 
         // loop over all participating particles
-        for (size_t j=0; j<inear.size(); ++j) {
-          const int32_t jdx = inear[j];
-          // all distances are unnormalized
-          const CT dx = x[i] - x[jdx];
-          const CT dy = y[i] - y[jdx];
-          const CT distsq = (dx*dx + dy*dy) / std::pow(r[i], 2);
+        #pragma omp simd reduction(+:sum)
+        for (int32_t j=0; j<nn; ++j) {
+          const CT distsq = dsq[j] * oorsq;
           // compute the volume component
-          vol[i] += std::exp(-distsq);
+          sum += (distsq < vol_thresh) ? std::exp(-distsq) : 0.0;
         }
 
         // scale the volume by the proper constant factor
-        vol[i] *= 1.0 / (M_PI * std::pow(r[i], 2));
+        sum *= 1.0 / (M_PI * std::pow(r[i], 2));
 
       } else /* compact gaussian */ {
 
         // loop over all participating particles
-        for (size_t j=0; j<inear.size(); ++j) {
-          const int32_t jdx = inear[j];
-          // all distances are unnormalized
-          const CT dx = x[i] - x[jdx];
-          const CT dy = y[i] - y[jdx];
-          // WHOAH!!! shouldn't we use radius j ? or a combo of i and j?
-          const CT distsq = (dx*dx + dy*dy) / std::pow(r[i], 2);
-          const CT dist = std::sqrt(distsq);
-          const CT distcub = distsq * dist;
+        // WHOAH!!! shouldn't we use radius j ? or a combo of i and j?
+        #pragma omp simd reduction(+:sum)
+        for (int32_t j=0; j<nn; ++j) {
+          const CT distsq = dsq[j] * oorsq;
+          const CT distcub = distsq * std::sqrt(distsq);
           // compute the volume component
-          vol[i] += std::exp(-distcub);
+          sum += (distsq < vol_thresh) ? std::exp(-distcub) : 0.0;
         }
 
         // scale the volume by the proper constant factor
         // 0.352... is 3 / (2 pi gamma(2/3))
-        vol[i] *= 0.352602100137554 / std::pow(r[i], 2);
+        sum *= 0.352602100137554 / std::pow(r[i], 2);
       }
 
       // invert weight to get particle volume
-      vol[i] = 1.0 / vol[i];
-
-      //std::cout << "particle " << i << " has volume " << vol[i] << std::endl;
+      vol[i] = 1.0 / sum;
     } // end loop over all particles
   }
 
@@ -460,152 +472,97 @@ void PSE<ST,CT>::diffuse_all(std::array<Vector<ST>,2>& pos,
   // finally, perform the PSE operation
   //
 
-  std::cout << "  Running PSE with n " << n << std::endl;
+  LOG_DEBUG("  Running PSE with n " << n);
+  scratch_bytes = vec_bytes(nstart) + vec_bytes(nbr) + vec_bytes(nbrdsq) + vec_bytes(vol) +
+                  vec_bytes(ds) + newcells.get_mem_bytes();
 
   // zero out delta vector
   std::fill(ds.begin(), ds.end(), 0.0);
 
-  // what is maximum strength of all particles?
-  //const ST maxStr = s[std::max_element(s.begin(), s.end()) - s.begin()];
-  //const ST minStr = s[std::min_element(s.begin(), s.end()) - s.begin()];
-  //const ST maxAbsStr = std::max(maxStr, -1.f*minStr);
-  //std::cout << "maxAbsStr " << maxAbsStr << std::endl;
-
-  // for each particle (can parallelize this part)
-  size_t nneibs = 0;
-  size_t minneibs = 999999;
-  size_t maxneibs = 0;
-  for (size_t i=0; i<n; ++i) {
-
-    // find the nearest neighbor particles
-    //std::cout << "\nDiffusing particle " << i << " with strength " << s[i] << std::endl;
-
-    // do not check vs. threshold - just do all of them
-    //   (this particle still core-spreads somewhat)
-    //if ((thresholds_are_relative && (std::abs(s[i]) < maxAbsStr * ignore_thresh)) or
-    //    (!thresholds_are_relative && (std::abs(s[i]) < ignore_thresh))) continue;
+  // for each particle, do not check vs. threshold - just do all of them
+  //   (this particle still core-spreads somewhat)
+  #pragma omp parallel for schedule(dynamic,1024)
+  for (int32_t i=0; i<(int32_t)n; ++i) {
 
     // nominal separation for this particle (insertion distance)
     const ST nom_sep = r[i] / particle_overlap;
 
-    // must go out to 2-3 core radii to get this right
-    // these are set to introduce no more than 1% error vs. very large search radii
-    ST search_rad = r[i] * 2.65;
-    if (core_func == CoreType::compactg) search_rad = r[i] * 2.0;
-
-    // initialize vector of indexes of nearest particles
-    std::vector<int32_t> inear;
-
-    // switch on search method
-    if (use_tree) {
-      // tree-based search with nanoflann
-      const ST distsq_thresh = std::pow(search_rad, 2);
-      const ST query_pt[2] = { x[i], y[i] };
-      (void) mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
-
-      // copy the indexes into my vector
-      for (size_t j=0; j<ret_matches.size(); ++j) inear.push_back((int32_t)ret_matches[j].first);
-
-    } else {
-      // direct search: look for all neighboring particles
-      const ST distsq_thresh = std::pow(search_rad, 2);
-      for (size_t j=0; j<n; ++j) {
-        ST distsq = std::pow(x[i]-x[j], 2) + std::pow(y[i]-y[j], 2);
-        if (distsq < distsq_thresh) inear.push_back((int32_t)j);
-      }
-
-    }
+    const int32_t* const jdx = nbr.data() + nstart[i];
+    const CT* const dsq = nbrdsq.data() + nstart[i];
+    const int32_t nn = nstart[i+1] - nstart[i];
+    const CT oorsq = 1.0 / std::pow(r[i], 2);
+    // with no volumes - just compare strengths
+    const CT voli = use_volumes ? vol[i] : 1.0;
+    const CT si = s[i];
+    CT sum = 0.0;
 
     // core of the PSE algorithm is here
 
-    // zero - just to be sure
-    ds[i] = 0.0;
-
     // split on particle core function
     if (core_func == CoreType::gaussian) {
 
       // loop over all participating particles
-      for (size_t j=0; j<inear.size(); ++j) {
-        const int32_t jdx = inear[j];
-        CT str_diff;
-        if (use_volumes) {
-          // scale strengths by volumes
-          str_diff = vol[i]*s[jdx] - vol[jdx]*s[i];
-        } else {
-          // no volumes - just compare strengths
-          str_diff = s[jdx] - s[i];
-        }
-        // interparticle distance
-        const CT dx = x[i] - x[jdx];
-        const CT dy = y[i] - y[jdx];
-        const CT distsq = dx*dx + dy*dy;
+      #pragma omp simd reduction(+:sum)
+      for (int32_t j=0; j<nn; ++j) {
+        // scale strengths by volumes
+        const CT volj = use_volumes ? vol[jdx[j]] : 1.0;
+        const CT str_diff = voli*s[jdx[j]] - volj*si;
         // eta_eps in PSE terminology is corefunc / -dist   but apply the constant later
-        const CT eta = std::exp(-distsq/std::pow(r[i],2));
-        //printf("  part %d w str %g has neib %d %g away, eta is %g and change is %g\n", i, s[i], jdx, std::sqrt(distsq), eta, 2.0*h_nu*str_diff*eta);
-        //if (i==525) printf("  part %d is %g from part %ld eta is %g and str is %g\n", jdx, std::sqrt(distsq), i, eta, s[jdx]);
+        const CT eta = std::exp(-dsq[j]*oorsq);
         // compute the strength change
-        ds[i] += str_diff * eta;
+        sum += str_diff * eta;
       }
 
       // scale the ds by the proper constant factor
-      ds[i] *= 4.0 * std::pow(r[i], -4) / M_PI;		// this should be correct, according to C&K VM pg 145
+      sum *= 4.0 * std::pow(r[i], -4) / M_PI;		// this should be correct, according to C&K VM pg 145
 
     // compute as if every particle were a compact Gaussian
     } else {
 
       // loop over all participating particles
-      for (size_t j=0; j<inear.size(); ++j) {
-        const int32_t jdx = inear[j];
-        // for now, do not consider particle sizes or volumes
-        CT str_diff;
-        if (use_volumes) {
-          // scale strengths by volumes
-          str_diff = vol[i]*s[jdx] - vol[jdx]*s[i];
-        } else {
-          // no volumes - just compare strengths
-          str_diff = s[jdx] - s[i];
-        }
-        // all distances are unnormalized
-        const CT dx = x[i] - x[jdx];
-        const CT dy = y[i] - y[jdx];
-        const CT distsq = (dx*dx + dy*dy) / std::pow(r[i], 2);
+      // for now, do not consider particle sizes or volumes
+      #pragma omp simd reduction(+:sum)
+      for (int32_t j=0; j<nn; ++j) {
+        // scale strengths by volumes
+        const CT volj = use_volumes ? vol[jdx[j]] : 1.0;
+        const CT str_diff = voli*s[jdx[j]] - volj*si;
+        const CT distsq = dsq[j] * oorsq;
         const CT dist = std::sqrt(distsq);
         const CT distcub = distsq * dist;
         // eta_eps in PSE terminology is corefunc / -dist
         const CT eta = dist * std::exp(-distcub);
-        //printf("  part %d w str %g has neib %d %g away, eta is %g and change is %g\n", i, s[i], jdx, dist*r[i], eta, 2.0*h_nu*str_diff*eta);
         // compute the strength change
-        ds[i] += str_diff * eta;
+        sum += str_diff * eta;
       }
 
       // scale the ds by the proper constant factor
       // this is 9/(2 pi Gamma(2/3))
-      ds[i] *= 2.0 * 1.057806300412662 * std::pow(r[i], -4);
+      sum *= 2.0 * 1.057806300412662 * std::pow(r[i], -4);
 
     }
 
     if (not use_volumes) {
       // and correct for overlap
-      ds[i] *= std::pow(nom_sep, 2);
+      sum *= std::pow(nom_sep, 2);
     }
 
     // always scale the ds by the proper constant factor
-    ds[i] *= std::pow(h_nu,2);
-
-    // tally neighbor statistics
-    nneibs += inear.size();
-    if (inear.size() < minneibs) minneibs = inear.size();
-    if (inear.size() > maxneibs) maxneibs = inear.size();
-
-    // is ds significantly larger than s?
-    //if (std::abs(ds[i]) > 3.0 * std::abs(s[i]) and s[i] != 0.0) {
-    //  std::cout << "    part " << i << " at dist " << std::sqrt(x[i]*x[i]+y[i]*y[i]) << " had str before " << s[i] << " str after " << (s[i]+ds[i]) << std::endl;
-    //}
+    ds[i] = sum * std::pow(h_nu,2);
 
   } // end loop over all current particles
 
-  std::cout << "    neighbors: min/avg/max " << minneibs << "/" << ((ST)nneibs / (ST)n) << "/" << maxneibs << std::endl;
-  std::cout << "    after PSE, n is " << x.size() << std::endl;
+  // tally neighbor statistics
+  size_t nneibs = nstart[n];
+  size_t minneibs = 999999;
+  size_t maxneibs = 0;
+  for (size_t i=0; i<n; ++i) {
+    const size_t nn = nstart[i+1] - nstart[i];
+    if (nn < minneibs) minneibs = nn;
+    if (nn > maxneibs) maxneibs = nn;
+  }
+
+  LOG_DEBUG("    neighbors: min/avg/max " << minneibs << "/" << ((ST)nneibs / (ST)n) << "/" << maxneibs);
+  LOG_INFO("    after PSE, n is " << x.size());
 
   // apply the changes to the master vectors
   assert(n==s.size() and ds.size()==s.size() && "Array size mismatch in PSE");
@@ -613,11 +570,6 @@ void PSE<ST,CT>::diffuse_all(std::array<Vector<ST>,2>& pos,
   for (size_t i=0; i<n; ++i) {
     s[i] += ds[i];
   }
-
-  // finish timer and report
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  printf("    pse.diffuse_all:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
 }
 
 //
@@ -0,0 +1,159 @@
+/*
+ * PairCache.h - Keep each source-target pair's velocities until either side changes
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "MemoryHelper.h"
+#include "Collection.h"
+#include "ExecEnv.h"
+#include "ResultsType.h"
+#include "Logger.h"
+
+#include <vector>
+#include <array>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <variant>
+#include <cstdint>
+#include <cstddef>
+
+
+//
+// A pair is found by its source's and target's lineage (copies share it) and the results
+//   wanted; its velocities (and vorticity) are given out again only while the source's
+//   positions and strengths, the target's positions, and every setting which could change
+//   the sums are all as they were when it was computed
+//
+// only pairs with no Lagrangian side are kept: those are the fixed or body-bound panels and
+//   field points which can go several calls without moving, as in freestream-only cases or
+//   the repeated solves of one step; anything Lagrangian moves every call and would only
+//   cost the copies
+//
+template <class S>
+class PairCache {
+public:
+  // evaluate one pair with _eval, which adds its influence to the target, or add what was
+  //   kept from an identical evaluation before
+  template <class F>
+  void apply(const Collection& _src, Collection& _targ, const ResultsType& _rt,
+             const ExecEnv& _env, F _eval) {
+
+    const bool keepable = std::visit([](const auto& elem) { return elem.get_movet() != lagrangian; }, _src) and
+                          std::visit([](const auto& elem) { return elem.get_movet() != lagrangian; }, _targ) and
+                          (_rt.get_type() == velonly or _rt.get_type() == velandvort);
+    if (not keepable) {
+      _eval();
+      return;
+    }
+
+    const auto key = std::make_tuple(std::visit([](const auto& elem) { return elem.get_lineage(); }, _src),
+                                     std::visit([](const auto& elem) { return elem.get_lineage(); }, _targ),
+                                     (int)_rt.get_type());
+    const uint32_t spos = std::visit([](const auto& elem) { return elem.get_pos_gen(); }, _src);
+    const uint32_t sstr = std::visit([](const auto& elem) { return elem.get_str_gen(); }, _src);
+    const uint32_t tpos = std::visit([](const auto& elem) { return elem.get_pos_gen(); }, _targ);
+
+    std::visit([&](auto& targ) {
+      std::array<Vector<S>,Dimensions>& vel = targ.get_vel();
+      Vector<S>* vort = (_rt.compute_vort() and targ.has_vort()) ? &targ.get_vort() : nullptr;
+      const size_t nt = vel[0].size();
+
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(key);
+        if (it != entries.end() and it->second.src_pos == spos and it->second.src_str == sstr and
+            it->second.targ_pos == tpos and it->second.vel[0].size() == nt and
+            (bool)vort == not it->second.vort.empty() and it->second.env.same_sums(_env)) {
+          Entry& e = it->second;
+          for (size_t d=0; d<Dimensions; ++d) {
+            for (size_t i=0; i<nt; ++i) vel[d][i] += e.vel[d][i];
+          }
+          if (vort) for (size_t i=0; i<nt; ++i) (*vort)[i] += e.vort[i];
+          e.last_pass = pass;
+          ++nhits;
+          LOG_DEBUG("    reused the influence of this pair");
+          return;
+        }
+      }
+
+      // evaluate it alone, keep that, then put back what the target already had
+      std::array<Vector<S>,Dimensions> before;
+      Vector<S> vort_before;
+      for (size_t d=0; d<Dimensions; ++d) {
+        before[d] = vel[d];
+        std::fill(vel[d].begin(), vel[d].end(), 0.0);
+      }
+      if (vort) {
+        vort_before = *vort;
+        std::fill(vort->begin(), vort->end(), 0.0);
+      }
+
+      _eval();
+
+      Entry e = {spos, sstr, tpos, _env, {}, {}, 0};
+      for (size_t d=0; d<Dimensions; ++d) {
+        e.vel[d] = vel[d];
+        for (size_t i=0; i<nt; ++i) vel[d][i] += before[d][i];
+      }
+      if (vort) {
+        e.vort = *vort;
+        for (size_t i=0; i<nt; ++i) (*vort)[i] += vort_before[i];
+      }
+
+      std::lock_guard<std::mutex> lock(mtx);
+      e.last_pass = pass;
+      entries[key] = std::move(e);
+      ++nmisses;
+    }, _targ);
+  }
+
+  // call once per velocity evaluation; pairs not seen for a while (a body or set of field
+  //   points since removed, or an mpi rank's throwaway share) are dropped
+  void next_pass() {
+    std::lock_guard<std::mutex> lock(mtx);
+    ++pass;
+    for (auto it = entries.begin(); it != entries.end(); ) {
+      if (pass - it->second.last_pass > max_idle_passes) it = entries.erase(it);
+      else ++it;
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    entries.clear();
+  }
+
+  size_t get_hits() const { return nhits; }
+  size_t get_misses() const { return nmisses; }
+
+  size_t get_mem_bytes() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t bytes = 0;
+    for (const auto& item : entries) bytes += vec_bytes(item.second.vel) + vec_bytes(item.second.vort);
+    return bytes;
+  }
+
+private:
+  struct Entry {
+    uint32_t src_pos, src_str, targ_pos;
+    ExecEnv env;
+    std::array<Vector<S>,Dimensions> vel;
+    Vector<S> vort;
+    size_t last_pass;
+  };
+
+  static constexpr size_t max_idle_passes = 256;
+
+  std::map<std::tuple<uint32_t,uint32_t,int>, Entry> entries;
+  size_t pass = 0;
+  size_t nhits = 0;
+  size_t nmisses = 0;
+  mutable std::mutex mtx;
+};
@@ -0,0 +1,227 @@
+/*
+ * PanelTree.h - A bounding-volume hierarchy for finding the panels nearest a point
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+
+#include <vector>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+
+
+//
+// Panels are sorted into a binary tree of axis-aligned boxes, split at the median centroid
+//   along the longer side, so a query only measures the panels in boxes nearer than its
+//   current best; building is O(N log N) and is only needed when the geometry moves
+//
+// a query returns every panel that could tie the nearest one, in panel order, so callers
+//   can run their usual nearest-panel logic on just those
+//
+template <class S>
+class PanelTree {
+public:
+  PanelTree() = default;
+
+  void build(const std::array<Vector<S>,Dimensions>&, const std::vector<Int>&);
+
+  size_t size() const { return npanels; }
+
+  // panels within round-off of the nearest one to (_x,_y), sorted by index
+  void nearest_candidates(const S, const S, std::vector<int32_t>&) const;
+
+private:
+  struct Node {
+    S xmin, xmax, ymin, ymax;
+    uint32_t first, count;		// range in order, if a leaf
+    int32_t child;			// first of two children, or -1 if a leaf
+  };
+
+  static constexpr uint32_t leaf_size = 8;
+
+  // relative slack on squared distances, so round-off never prunes a tie
+  static constexpr S slack = 1.e-4;
+
+  void split(const int32_t);
+  S box_distsq(const Node& _n, const S _x, const S _y) const {
+    const S dx = std::max(std::max(_n.xmin-_x, _x-_n.xmax), (S)0.0);
+    const S dy = std::max(std::max(_n.ymin-_y, _y-_n.ymax), (S)0.0);
+    return dx*dx + dy*dy;
+  }
+  S panel_distsq(const uint32_t, const S, const S) const;
+
+  size_t npanels = 0;
+  std::vector<Node> nodes;
+  std::vector<int32_t> order;		// panel index of each entry
+  Vector<S> x0, y0, x1, y1;		// and its end nodes
+  Vector<S> cx, cy;			// centroids, only used while building
+};
+
+
+//
+// sort the panels into the tree
+//
+template <class S>
+void PanelTree<S>::build(const std::array<Vector<S>,Dimensions>& _x, const std::vector<Int>& _idx) {
+  npanels = _idx.size() / 2;
+
+  order.resize(npanels);
+  x0.resize(npanels);
+  y0.resize(npanels);
+  x1.resize(npanels);
+  y1.resize(npanels);
+  cx.resize(npanels);
+  cy.resize(npanels);
+  for (size_t j=0; j<npanels; ++j) {
+    order[j] = (int32_t)j;
+    cx[j] = 0.5 * (_x[0][_idx[2*j]] + _x[0][_idx[2*j+1]]);
+    cy[j] = 0.5 * (_x[1][_idx[2*j]] + _x[1][_idx[2*j+1]]);
+  }
+
+  nodes.clear();
+  nodes.reserve(2*(npanels/leaf_size+1));
+  if (npanels > 0) {
+    nodes.push_back(Node{0.0, 0.0, 0.0, 0.0, 0, (uint32_t)npanels, -1});
+    split(0);
+  }
+
+  // store the end nodes in tree order, so leaves read contiguous memory
+  for (size_t e=0; e<npanels; ++e) {
+    const int32_t j = order[e];
+    x0[e] = _x[0][_idx[2*j]];
+    y0[e] = _x[1][_idx[2*j]];
+    x1[e] = _x[0][_idx[2*j+1]];
+    y1[e] = _x[1][_idx[2*j+1]];
+  }
+
+  // but the boxes need the real extents, not the centroids
+  for (int32_t in=(int32_t)nodes.size()-1; in>=0; --in) {
+    Node& nd = nodes[in];
+    if (nd.child < 0) {
+      nd.xmin = nd.ymin = std::numeric_limits<S>::max();
+      nd.xmax = nd.ymax = std::numeric_limits<S>::lowest();
+      for (uint32_t e=nd.first; e<nd.first+nd.count; ++e) {
+        nd.xmin = std::min(nd.xmin, std::min(x0[e], x1[e]));
+        nd.xmax = std::max(nd.xmax, std::max(x0[e], x1[e]));
+        nd.ymin = std::min(nd.ymin, std::min(y0[e], y1[e]));
+        nd.ymax = std::max(nd.ymax, std::max(y0[e], y1[e]));
+      }
+    } else {
+      const Node& a = nodes[nd.child];
+      const Node& b = nodes[nd.child+1];
+      nd.xmin = std::min(a.xmin, b.xmin);
+      nd.xmax = std::max(a.xmax, b.xmax);
+      nd.ymin = std::min(a.ymin, b.ymin);
+      nd.ymax = std::max(a.ymax, b.ymax);
+    }
+  }
+
+  cx.clear();
+  cy.clear();
+}
+
+//
+// split node _in in two, children always sit side-by-side after their parent
+//
+template <class S>
+void PanelTree<S>::split(const int32_t _in) {
+  const uint32_t first = nodes[_in].first;
+  const uint32_t last = first + nodes[_in].count;
+  if (last - first <= leaf_size) return;
+
+  // split along the longer side of the centroids' box
+  S xmin = std::numeric_limits<S>::max();
+  S xmax = std::numeric_limits<S>::lowest();
+  S ymin = xmin;
+  S ymax = xmax;
+  for (uint32_t e=first; e<last; ++e) {
+    xmin = std::min(xmin, cx[order[e]]);
+    xmax = std::max(xmax, cx[order[e]]);
+    ymin = std::min(ymin, cy[order[e]]);
+    ymax = std::max(ymax, cy[order[e]]);
+  }
+  const Vector<S>& c = (xmax-xmin > ymax-ymin) ? cx : cy;
+  const uint32_t mid = first + (last-first)/2;
+  std::nth_element(order.begin()+first, order.begin()+mid, order.begin()+last,
+                   [&c](const int32_t a, const int32_t b) { return c[a] < c[b]; });
+
+  const int32_t left = (int32_t)nodes.size();
+  nodes[_in].child = left;
+  nodes.push_back(Node{0.0, 0.0, 0.0, 0.0, first, mid-first, -1});
+  nodes.push_back(Node{0.0, 0.0, 0.0, 0.0, mid, last-mid, -1});
+  split(left);
+  split(left+1);
+}
+
+//
+// squared distance from a point to the panel in entry _e
+//
+template <class S>
+S PanelTree<S>::panel_distsq(const uint32_t _e, const S _x, const S _y) const {
+  const S bx = x1[_e] - x0[_e];
+  const S by = y1[_e] - y0[_e];
+  const S ax = _x - x0[_e];
+  const S ay = _y - y0[_e];
+  const S blensq = bx*bx + by*by;
+  const S t = (blensq > 0.0) ? std::min(std::max((ax*bx + ay*by) / blensq, (S)0.0), (S)1.0) : 0.0;
+  const S dx = ax - t*bx;
+  const S dy = ay - t*by;
+  return dx*dx + dy*dy;
+}
+
+template <class S>
+void PanelTree<S>::nearest_candidates(const S _x, const S _y, std::vector<int32_t>& _cand) const {
+  _cand.clear();
+  if (npanels == 0) return;
+
+  // the closest box first, so the bound tightens quickly
+  std::vector<std::pair<int32_t,S>> found;
+  S best = std::numeric_limits<S>::max();
+  std::vector<int32_t> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+
+  while (not stack.empty()) {
+    const Node& nd = nodes[stack.back()];
+    stack.pop_back();
+    if (box_distsq(nd, _x, _y) > best*(1.0+slack)) continue;
+
+    if (nd.child < 0) {
+      for (uint32_t e=nd.first; e<nd.first+nd.count; ++e) {
+        const S distsq = panel_distsq(e, _x, _y);
+        if (distsq <= best*(1.0+slack)) {
+          found.emplace_back(order[e], distsq);
+          best = std::min(best, distsq);
+        }
+      }
+    } else {
+      const S da = box_distsq(nodes[nd.child], _x, _y);
+      const S db = box_distsq(nodes[nd.child+1], _x, _y);
+      // push the farther one first, so the nearer is searched next
+      if (da < db) {
+        stack.push_back(nd.child+1);
+        stack.push_back(nd.child);
+      } else {
+        stack.push_back(nd.child);
+        stack.push_back(nd.child+1);
+      }
+    }
+  }
+
+  // drop the panels found before the bound tightened
+  for (const auto& f : found) {
+    if (f.second <= best*(1.0+slack)) _cand.push_back(f.first);
+  }
+  std::sort(_cand.begin(), _cand.end());
+}
+
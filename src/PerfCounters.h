@@ -0,0 +1,129 @@
+/*
+ * PerfCounters.h - Hardware event counts for the profiler's zones, from Linux perf events
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+
+//
+// One counter per event for the whole process: opened with inherit set, so every thread
+//   started afterwards (the OpenMP team, the thread pools) adds to the same counts, which
+//   means open() must run at the top of main()
+//
+// cycles, instructions and last-level cache misses are generic events; the scalar and
+//   packed floating-point counts are Intel's FP_ARITH_INST_RETIRED and are only asked
+//   for on Intel cpus
+//
+// a counter the kernel or the machine won't give us (no PMU in a VM, perf_event_paranoid
+//   too high) stays closed and reads as zero
+//
+class PerfCounters {
+public:
+  enum counter_t {
+    cycles = 0,
+    instructions,
+    llc_misses,
+    fp_scalar,
+    fp_packed,
+    num_counters
+  };
+
+  PerfCounters() { for (int i=0; i<num_counters; ++i) fd[i] = -1; }
+  ~PerfCounters() { close(); }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  // returns the number of counters which opened
+  int open() {
+    int nopen = 0;
+#ifdef __linux__
+    nopen += open_one(cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    nopen += open_one(instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    nopen += open_one(llc_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    if (is_intel()) {
+      // event 0xC7, umasks 0x01 and 0x02 are scalar double and float, 0x04 to 0x80 packed
+      nopen += open_one(fp_scalar, PERF_TYPE_RAW, 0xC7 | (0x03 << 8));
+      nopen += open_one(fp_packed, PERF_TYPE_RAW, 0xC7 | (0xFC << 8));
+    }
+#endif
+    return nopen;
+  }
+
+  void close() {
+#ifdef __linux__
+    for (int i=0; i<num_counters; ++i) {
+      if (fd[i] >= 0) ::close(fd[i]);
+      fd[i] = -1;
+    }
+#endif
+  }
+
+  bool is_open(const int _i) const { return fd[_i] >= 0; }
+  bool any_open() const {
+    for (int i=0; i<num_counters; ++i) if (fd[i] >= 0) return true;
+    return false;
+  }
+
+  // the counts so far, scaled up if the kernel had to share the hardware counters
+  void read(double* const _out) const {
+    for (int i=0; i<num_counters; ++i) {
+      _out[i] = 0.0;
+#ifdef __linux__
+      if (fd[i] < 0) continue;
+      uint64_t vals[3] = {0, 0, 0};
+      if (::read(fd[i], vals, sizeof(vals)) != (ssize_t)sizeof(vals)) continue;
+      _out[i] = (double)vals[0];
+      if (vals[2] > 0 and vals[2] < vals[1]) _out[i] *= (double)vals[1] / (double)vals[2];
+#endif
+    }
+  }
+
+  static const char* name(const int _i) {
+    static const char* names[] = {"cycles", "instructions", "llc misses", "fp scalar", "fp packed"};
+    return names[_i];
+  }
+
+private:
+#ifdef __linux__
+  int open_one(const int _i, const uint32_t _type, const uint64_t _config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = _type;
+    attr.config = _config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fd[_i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    return (fd[_i] >= 0) ? 1 : 0;
+  }
+
+  static bool is_intel() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+      if (line.compare(0, 9, "vendor_id") == 0) return line.find("GenuineIntel") != std::string::npos;
+    }
+    return false;
+  }
+#endif
+
+  int fd[num_counters];
+};
@@ -0,0 +1,70 @@
+/*
+ * PerfHistory.h - The last few hundred steps' timings and sizes, for the GUI's performance panel
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <cstddef>
+
+
+//
+// The step thread adds one record at the end of each step and the GUI thread copies them
+//   out to draw, so both sides lock; the phases are the top-level zones of the step, in the
+//   order they were first seen, and a record only has entries for the phases seen so far
+//
+class PerfHistory {
+public:
+  struct Record {
+    size_t nstep = 0;
+    size_t nparts = 0;
+    double step_secs = 0.0;
+    int bem_iters = 0;
+    double mem_mb = 0.0;
+    std::vector<double> phase_secs;
+  };
+
+  explicit PerfHistory(const size_t _capacity = 300)
+    : capacity(std::max((size_t)1, _capacity))
+    {}
+
+  // returns the index of the phase, adding it if new
+  size_t phase(const std::string& _name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = std::find(phases.begin(), phases.end(), _name);
+    if (it != phases.end()) return (size_t)(it - phases.begin());
+    phases.push_back(_name);
+    return phases.size() - 1;
+  }
+
+  void add(Record&& _rec) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (records.size() == capacity) records.erase(records.begin());
+    records.push_back(std::move(_rec));
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    records.clear();
+    phases.clear();
+  }
+
+  // copies, oldest record first
+  void get(std::vector<Record>& _records, std::vector<std::string>& _phases) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    _records = records;
+    _phases = phases;
+  }
+
+private:
+  size_t capacity;
+  std::vector<Record> records;
+  std::vector<std::string> phases;
+  mutable std::mutex mtx;
+};
@@ -0,0 +1,306 @@
+/*
+ * Periodic.h - Velocity sums for a domain which repeats in x
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Kernels.h"
+#include "Points.h"
+#include "Surfaces.h"
+#include "ResultsType.h"
+#include "ExecEnv.h"
+#include "Logger.h"
+
+#include <vector>
+#include <array>
+#include <numeric>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+
+//
+// A row of copies of every element, one period apart in x, induces a velocity which sums in
+//   closed form: the images of a point vortex at z=0 add up to (pi/L) cot(pi z/L), the same
+//   kernel as a singly-periodic row of vortices (Lamb, sec. 156). So one period's worth of
+//   elements gives the flow of an infinite cascade, with no copies.
+//
+// each pair gets the usual regularized kernel from the nearest image, plus the rest of the
+//   row from periodic_images; the remainder is smooth, so it needs no core function
+//
+// a row seen from more than periodic_band periods away in y looks like a uniform vortex
+//   sheet (the error falls as exp(-2 pi |dy|/L), 1e-8 here), so all sources beyond the band
+//   add only a constant jump in u, taken from running sums over sources sorted by y; the
+//   sum costs the number of targets times the sources in the band, not all of them
+//
+
+static constexpr double periodic_band = 3.0;
+
+//
+// every image of a unit point at z=dx+i*dy except those with |k| <= _nskip, as the complex
+//   sum of 1/(z - kL) = (pi/L) cot(pi z/L) - sum_{|k|<=_nskip} 1/(z - kL); a vortex of
+//   strength s then induces u += s*ri, v += s*rr, and a source u += s*rr, v -= s*ri
+//
+inline void periodic_images (const double dx, const double dy, const double L, const int _nskip,
+                             double* const rr, double* const ri) {
+  const double pol = M_PI / L;
+  const double c = pol * pol;
+  const double r2 = dx*dx + dy*dy;
+
+  if (c*r2 < 1.e-4) {
+    // the series of cot(w) - 1/w, since the difference cancels all but a few digits here
+    const double z3r = dx*dx*dx - 3.0*dx*dy*dy;
+    const double z3i = 3.0*dx*dx*dy - dy*dy*dy;
+    *rr = -c*dx/3.0 - c*c*z3r/45.0;
+    *ri = -c*dy/3.0 - c*c*z3i/45.0;
+  } else {
+    const double a = 2.0 * pol * dx;
+    const double b = 2.0 * pol * dy;
+    const double d = std::cosh(b) - std::cos(a);
+    *rr =  pol * std::sin(a) / d - dx / r2;
+    *ri = -pol * std::sinh(b) / d + dy / r2;
+  }
+
+  for (int k=1; k<=_nskip; ++k) {
+    const double dxm = dx - k*L;
+    const double dxp = dx + k*L;
+    const double qm = dxm*dxm + dy*dy;
+    const double qp = dxp*dxp + dy*dy;
+    *rr -= dxm / qm + dxp / qp;
+    *ri += dy / qm + dy / qp;
+  }
+}
+
+//
+// and its derivative, the sum of -1/(z - kL)^2 over the same images; a vortex of strength s
+//   then adds u_x += s*gi, v_x += s*gr, and a source u_x += s*gr, v_x -= s*gi, while
+//   u_y = v_x and v_y = -u_x as everywhere away from the sources
+//
+inline void periodic_images_grad (const double dx, const double dy, const double L, const int _nskip,
+                                  double* const gr, double* const gi) {
+  const double pol = M_PI / L;
+  const double c = pol * pol;
+  const double r2 = dx*dx + dy*dy;
+
+  if (c*r2 < 1.e-4) {
+    // the derivative of the series above
+    *gr = -c/3.0 - c*c*(dx*dx - dy*dy)/15.0;
+    *gi = -c*c*2.0*dx*dy/15.0;
+  } else {
+    // -c / sin^2(w) = -2c / (1 - cos(2w)), and the k=0 image taken back out
+    const double a = 2.0 * pol * dx;
+    const double b = 2.0 * pol * dy;
+    const double p = 1.0 - std::cos(a) * std::cosh(b);
+    const double q = std::sin(a) * std::sinh(b);
+    const double oopq = -2.0 * c / (p*p + q*q);
+    const double oor4 = 1.0 / (r2*r2);
+    *gr = oopq * p + (dx*dx - dy*dy) * oor4;
+    *gi = -oopq * q - 2.0*dx*dy * oor4;
+  }
+
+  for (int k=1; k<=_nskip; ++k) {
+    const double dxm = dx - k*L;
+    const double dxp = dx + k*L;
+    const double qm = dxm*dxm + dy*dy;
+    const double qp = dxp*dxp + dy*dy;
+    *gr += (dxm*dxm - dy*dy) / (qm*qm) + (dxp*dxp - dy*dy) / (qp*qp);
+    *gi -= 2.0*dxm*dy / (qm*qm) + 2.0*dxp*dy / (qp*qp);
+  }
+}
+
+//
+// Points/Particles affecting Points/Particles, with every periodic image
+//
+template <class S, class A, VelCore C>
+void points_affect_points_periodic (const Points<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+
+  LOG_DEBUG("    0v_0" << (targ.is_inert() ? "p" : "v") << " periodic influence of" << src.to_string() << " on" << targ.to_string());
+  auto start = std::chrono::system_clock::now();
+
+  const PeriodicDomain& pd = env.get_periodic_domain();
+  const double L = pd.period;
+  const double band = periodic_band * L;
+
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const Vector<S>&                        sr = src.get_rad();
+  const Vector<S>&                        ss = src.get_str();
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
+  std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
+  const bool thick = not targ.is_inert();
+  const Vector<S>& tr = targ.get_rad();
+  const bool with_vort = restype.compute_vort() and targ.has_vort();
+  Vector<S>* tw = with_vort ? &targ.get_vort() : nullptr;
+  const bool with_grad = restype.compute_grad();
+  std::array<Vector<S>,4>* tg = with_grad ? &targ.get_velgrad() : nullptr;
+  const size_t ns = src.get_n();
+  const size_t nt = targ.get_n();
+
+  // sources sorted by y, and the running sum of their strengths
+  std::vector<size_t> order(ns);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return sx[1][a] < sx[1][b]; });
+  Vector<S> ox(ns), oy(ns), orad(ns), ostr(ns);
+  std::vector<double> below(ns+1, 0.0);
+  for (size_t j=0; j<ns; ++j) {
+    const size_t k = order[j];
+    ox[j] = sx[0][k];
+    oy[j] = sx[1][k];
+    orad[j] = sr[k];
+    ostr[j] = ss[k];
+    below[j+1] = below[j] + (double)ss[k];
+  }
+  const double total = below[ns];
+
+  size_t npairs = 0;
+
+  #pragma omp parallel for schedule(dynamic,64) reduction(+:npairs)
+  for (int32_t i=0; i<(int32_t)nt; ++i) {
+    const S xi = tx[0][i];
+    const S yi = tx[1][i];
+    const size_t jbeg = std::lower_bound(oy.begin(), oy.end(), (S)(yi - band)) - oy.begin();
+    const size_t jend = std::upper_bound(oy.begin(), oy.end(), (S)(yi + band)) - oy.begin();
+
+    A accumu = 0.0;
+    A accumv = 0.0;
+    A accumw = 0.0;
+    A accumg[4] = {0.0, 0.0, 0.0, 0.0};
+    double imgu = 0.0;
+    double imgv = 0.0;
+    double imgux = 0.0;
+    double imgvx = 0.0;
+    for (size_t j=jbeg; j<jend; ++j) {
+      // the nearest image through the core function
+      const S dx = pd.nearest<S>(xi - ox[j]);
+      const S sxj = xi - dx;
+      if (with_grad) {
+        if (thick) kernelug_0v_0b<S,A,C>(sxj, oy[j], orad[j], ostr[j], xi, yi, tr[i], &accumu, &accumv,
+                                         &accumg[0], &accumg[1], &accumg[2], &accumg[3]);
+        else       kernelug_0v_0p<S,A,C>(sxj, oy[j], orad[j], ostr[j], xi, yi, &accumu, &accumv,
+                                         &accumg[0], &accumg[1], &accumg[2], &accumg[3]);
+      } else if (thick) {
+        if (with_vort) kerneluw_0v_0b<S,A,C>(sxj, oy[j], orad[j], ostr[j], xi, yi, tr[i], &accumu, &accumv, &accumw);
+        else           kernelu_0v_0b<S,A,C>(sxj, oy[j], orad[j], ostr[j], xi, yi, tr[i], &accumu, &accumv);
+      } else {
+        if (with_vort) kerneluw_0v_0p<S,A,C>(sxj, oy[j], orad[j], ostr[j], xi, yi, &accumu, &accumv, &accumw);
+        else           kernelu_0v_0p<S,A,C>(sxj, oy[j], orad[j], ostr[j], xi, yi, &accumu, &accumv);
+      }
+
+      // and the rest of its row
+      double rr, ri;
+      periodic_images((double)dx, (double)(yi - oy[j]), L, 0, &rr, &ri);
+      imgu += (double)ostr[j] * ri;
+      imgv += (double)ostr[j] * rr;
+      if (with_grad) {
+        double gr, gi;
+        periodic_images_grad((double)dx, (double)(yi - oy[j]), L, 0, &gr, &gi);
+        imgux += (double)ostr[j] * gi;
+        imgvx += (double)ostr[j] * gr;
+      }
+    }
+    npairs += jend - jbeg;
+
+    // rows beyond the band are sheets: those below push this target in -x, those above in +x,
+    //   and the same everywhere, so they add no gradient
+    imgu += (M_PI / L) * ((total - below[jend]) - below[jbeg]);
+
+    tu[0][i] += accumu + (A)imgu;
+    tu[1][i] += accumv + (A)imgv;
+    if (with_vort) (*tw)[i] += accumw;
+    if (with_grad) {
+      (*tg)[0][i] += accumg[0] + (A)imgux;
+      (*tg)[1][i] += accumg[1] + (A)imgvx;
+      (*tg)[2][i] += accumg[2] + (A)imgvx;
+      (*tg)[3][i] += accumg[3] - (A)imgux;
+    }
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    points_affect_points_periodic: [" << elapsed_seconds.count() << "] seconds with " << npairs << " pairs in the band");
+}
+
+//
+// Add the images of the source panels to a block of BEM coefficients (already scaled by
+//   1/2pi, and before augmentation); the nearest images on either side use the exact panel
+//   influence, and the rest of the row acts on the collocation point from each panel center
+//
+template <class S>
+void add_periodic_panel_coeffs (const Surfaces<S>& src, const Surfaces<S>& targ, const PeriodicDomain& pd,
+                                Vector<S>& coeffs) {
+
+  const double L = pd.period;
+  const size_t nsrc  = src.get_npanels();
+  const size_t ntarg = targ.get_npanels();
+  const size_t nus = src.num_unknowns_per_panel();
+  const size_t nut = targ.num_unknowns_per_panel();
+  const size_t nrows = ntarg * nut;
+
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const std::vector<Int>&                 si = src.get_idx();
+  const Vector<S>&                        sa = src.get_area();
+  const std::array<Vector<S>,Dimensions>& tx = targ.get_pos();
+  const std::vector<Int>&                 ti = targ.get_idx();
+  const std::array<Vector<S>,Dimensions>& tt = targ.get_tang();
+  const std::array<Vector<S>,Dimensions>& tn = targ.get_norm();
+
+  const double fac = 1.0 / (2.0 * M_PI);
+
+  #pragma omp parallel for
+  for (int32_t j=0; j<(int32_t)nsrc; ++j) {
+    const double sx0 = sx[0][si[2*j]];
+    const double sy0 = sx[1][si[2*j]];
+    const double sx1 = sx[0][si[2*j+1]];
+    const double sy1 = sx[1][si[2*j+1]];
+    const double scx = 0.5 * (sx0 + sx1);
+    const double scy = 0.5 * (sy0 + sy1);
+
+    for (size_t i=0; i<ntarg; ++i) {
+      const double xi = 0.5 * (tx[0][ti[2*i]] + tx[0][ti[2*i+1]]);
+      const double yi = 0.5 * (tx[1][ti[2*i]] + tx[1][ti[2*i+1]]);
+
+      // velocity from unit vortex and unit source strength on this panel
+      double vu = 0.0, vv = 0.0, su = 0.0, sv = 0.0;
+      for (const double shift : {-L, L}) {
+        double a, b, c, d;
+        kernelu_1vos_0p<double,double>(sx0+shift, sy0, sx1+shift, sy1, 1.0, 1.0, xi, yi, &a, &b, &c, &d);
+        vu += a; vv += b; su += c; sv += d;
+      }
+      double rr, ri;
+      periodic_images(xi - scx, yi - scy, L, 1, &rr, &ri);
+      vu += sa[j] * ri;
+      vv += sa[j] * rr;
+      su += sa[j] * rr;
+      sv -= sa[j] * ri;
+
+      for (size_t q=0; q<nus; ++q) {
+        const double u = (q == 0) ? vu : su;
+        const double v = (q == 0) ? vv : sv;
+        S* const col = coeffs.data() + (j*nus + q)*nrows;
+        col[i*nut] += (S)(fac * (u*tt[0][i] + v*tt[1][i]));
+        if (nut == 2) col[i*nut+1] += (S)(fac * (u*tn[0][i] + v*tn[1][i]));
+      }
+    }
+  }
+}
+
+//
+// Bring free particles that have left the period back into it; fixed points stay put, since
+//   the sums above give them the same velocity anywhere
+//
+template <class S>
+void wrap_into_period (Points<S>& pts, const PeriodicDomain& pd) {
+  if (not pd.active() or pts.get_body_ptr() or pts.get_movet() != lagrangian) return;
+
+  const Vector<S>& x = std::as_const(pts).get_pos()[0];
+  const S lo = (S)pd.origin;
+  const S hi = (S)(pd.origin + pd.period);
+  if (std::none_of(x.begin(), x.end(), [=](const S _x) { return _x < lo or _x >= hi; })) return;
+
+  for (auto& xi : pts.get_pos()[0]) xi = pd.wrap<S>(xi);
+}
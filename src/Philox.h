@@ -0,0 +1,79 @@
+/*
+ * Philox.h - Counter-based random numbers, for draws which do not depend on order
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+//
+// Philox4x32-10 (Salmon, Moraes, Dror and Shaw, SC11): four 32-bit words of output from four
+//   of counter and two of key, with no state between calls. Each draw is a function of its
+//   own counter and key only, so loops over them need no shared generator: they can run in
+//   any order, on any number of threads, and vectorize.
+//
+using PhiloxCtr = std::array<uint32_t,4>;
+using PhiloxKey = std::array<uint32_t,2>;
+
+inline PhiloxCtr philox4x32 (PhiloxCtr _c, PhiloxKey _k) {
+  constexpr uint64_t m0 = 0xD2511F53;
+  constexpr uint64_t m1 = 0xCD9E8D57;
+  constexpr uint32_t w0 = 0x9E3779B9;
+  constexpr uint32_t w1 = 0xBB67AE85;
+
+  for (int r=0; r<10; ++r) {
+    const uint64_t p0 = m0 * _c[0];
+    const uint64_t p1 = m1 * _c[2];
+    _c = {(uint32_t)(p1 >> 32) ^ _c[1] ^ _k[0], (uint32_t)p1,
+          (uint32_t)(p0 >> 32) ^ _c[3] ^ _k[1], (uint32_t)p0};
+    _k[0] += w0;
+    _k[1] += w1;
+  }
+  return _c;
+}
+
+// a uniform number in (0,1), never either end; a float keeps only the top 23 bits, so
+//   that it can not round up to 1
+template <class S>
+inline S philox_uniform (const uint32_t _u) {
+  if constexpr (sizeof(S) < 8) {
+    return ((S)(_u >> 9) + (S)0.5) * (S)1.1920928955078125e-7;
+  } else {
+    return ((S)_u + (S)0.5) * (S)2.3283064365386963e-10;
+  }
+}
+
+// two independent standard normal numbers (Box-Muller) from two words
+template <class S>
+inline std::array<S,2> philox_normal_pair (const uint32_t _u0, const uint32_t _u1) {
+  const double r = std::sqrt(-2.0 * std::log(philox_uniform<double>(_u0)));
+  const double t = 2.0 * M_PI * philox_uniform<double>(_u1);
+  return {(S)(r * std::cos(t)), (S)(r * std::sin(t))};
+}
+
+// the bits of a float or double folded into one word, to key a draw by a value
+template <class S>
+inline uint32_t philox_bits (const S _v) {
+  if constexpr (sizeof(S) == 8) {
+    uint64_t b;
+    std::memcpy(&b, &_v, 8);
+    return (uint32_t)b ^ (uint32_t)(b >> 32);
+  } else {
+    uint32_t b;
+    std::memcpy(&b, &_v, 4);
+    return b;
+  }
+}
+
+// split a 64-bit seed into a key
+inline PhiloxKey philox_key (const uint64_t _seed) {
+  return {(uint32_t)_seed, (uint32_t)(_seed >> 32)};
+}
@@ -11,6 +11,13 @@
 #include "VectorHelper.h"
 #include "ElementBase.h"
 #include "VtkXmlWriter.h"
+#include "Hdf5Writer.h"
+#include "CellList.h"
+#include "Morton.h"
+
+#ifdef USE_STDSIMD
+#include "SimdHelper.h"
+#endif
 
 #ifdef USE_GL
 #include "GlState.h"
@@ -30,6 +37,7 @@
 #include <cassert>
 #include <cmath>
 #include <algorithm>
+#include <limits>
 
 
 // 0-D elements
@@ -102,10 +110,145 @@ public:
   }
 
   const Vector<S>& get_rad() const { return r; }
-  Vector<S>&       get_rad()       { return r; }
+  Vector<S>&       get_rad()       { this->pos_changed(); return r; }
+
+#ifdef USE_VC
+  // padded, aligned copies of x, y, radius and strength for the Vc kernels, these are
+  //   rebuilt only when the positions, radii, or strengths have changed since the last call
+  struct VcSources {
+    Vc::Memory<Vc::Vector<S>> x, y, r, s;
+  };
+  const VcSources& get_vc_sources() const {
+    if (not vcsrc or vcsrc_gen != this->state_gen) {
+      vcsrc.reset();
+      vcsrc.emplace(VcSources{stdvec_to_vcvec<S>(this->x[0], 0.0),
+                              stdvec_to_vcvec<S>(this->x[1], 0.0),
+                              stdvec_to_vcvec<S>(r,          1.0),
+                              stdvec_to_vcvec<S>(*this->s,   0.0)});
+      vcsrc_gen = this->state_gen;
+    }
+    return *vcsrc;
+  }
+#endif
+
+#ifdef USE_STDSIMD
+  // same, for the portable SIMD kernels
+  const std::array<SimdMemory<S>,4>& get_simd_sources() const {
+    if (not simdsrc or simdsrc_gen != this->state_gen) {
+      simdsrc = std::array<SimdMemory<S>,4>({stdvec_to_simdvec<S>(this->x[0], 0.0),
+                                              stdvec_to_simdvec<S>(this->x[1], 0.0),
+                                              stdvec_to_simdvec<S>(r,          1.0),
+                                              stdvec_to_simdvec<S>(*this->s,   0.0)});
+      simdsrc_gen = this->state_gen;
+    }
+    return *simdsrc;
+  }
+#endif
+
+  // a cell list of the current positions, shared by the diffusion, merging and clearing
+  //   routines; after small motions it is only updated, and it is rebuilt once particles
+  //   move too far or change in number, or if a caller asks for a very different cell size
+  //   (any size gives correct results, only speed changes)
+  const CellList<S>& get_cell_list(const S _cellsize) const {
+    if (cells.size() != this->n or
+        _cellsize < 0.75*cells.get_cell_size() or _cellsize > 1.5*cells.get_cell_size()) {
+      cells.build(this->x, _cellsize);
+    } else if (cells_gen != this->state_gen and not cells.update(this->x)) {
+      cells.build(this->x, _cellsize);
+    }
+    cells_gen = this->state_gen;
+    return cells;
+  }
 
   const S get_averaged_max_str() const { return max_strength; }
 
+  // the arrays, and the spatial index built over them
+  size_t get_mem_bytes() const {
+    return ElementBase<S>::get_mem_bytes() + vec_bytes(r) + vec_bytes(ub) + cells.get_mem_bytes();
+  }
+
+  // the velocities persist because later steps may reuse them, see Convection::find_new_vort_vels
+  void write_state(CheckpointWriter& _out) const {
+    ElementBase<S>::write_state(_out);
+    _out.put_vec(r);
+    _out.put(ncurr_vels);
+    _out.put_vecs(ub);
+    _out.put(sorted_stride);
+    _out.put(max_strength);
+  }
+  void read_state(CheckpointReader& _in) {
+    ElementBase<S>::read_state(_in);
+    _in.get_vec(r);
+    ncurr_vels = _in.get<size_t>();
+    _in.get_vecs(ub);
+    sorted_stride = _in.get<S>();
+    max_strength = _in.get<float>();
+  }
+  size_t get_gl_bytes() const {
+#ifdef USE_GL
+    if (mgl) return mgl->num_bytes;
+#endif
+    return 0;
+  }
+
+  // how many leading particles still hold the velocities from the last convection step:
+  //   new particles are only ever appended, and compact keeps this
+  size_t get_num_current_vels() const { return ncurr_vels; }
+  void set_num_current_vels(const size_t _n) { ncurr_vels = std::min(_n, this->n); }
+
+  // the freestream and boundaries' part of those velocities, so that a step which reuses
+  //   them can swap in its own; empty unless set, see Convection::find_new_vort_vels
+  const std::array<Vector<S>,Dimensions>& get_bdry_vel() const { return ub; }
+  std::array<Vector<S>,Dimensions>&       get_bdry_vel()       { return ub; }
+
+  // put the particles in a new order, _order[i] is the old index of the new i-th particle
+  void reorder(const std::vector<int32_t>& _order) {
+    assert(_order.size() == this->n && "Reorder does not cover every particle");
+    Vector<S> tmp(this->n);
+    auto apply = [&](Vector<S>& _v) {
+      if (_v.size() != this->n) return;
+      for (size_t i=0; i<this->n; ++i) tmp[i] = _v[_order[i]];
+      _v.swap(tmp);
+    };
+    for (size_t d=0; d<Dimensions; ++d) {
+      apply(this->x[d]);
+      apply(this->u[d]);
+      apply(ub[d]);
+      if (this->ux) apply((*this->ux)[d]);
+    }
+    if (this->s) apply(*this->s);
+    if (this->w) apply(*this->w);
+    if (this->ug) for (auto& g : *this->ug) apply(g);
+    apply(r);
+    this->state_changed();
+  }
+
+  // mean distance between particles adjacent in memory, which grows as they scatter
+  S get_mean_stride() const {
+    if (this->n < 2) return 0.0;
+    const double sum = reproducible_sum<double>(this->n-1, [&](const size_t i) {
+        return std::sqrt(std::pow(this->x[0][i+1]-this->x[0][i], 2) + std::pow(this->x[1][i+1]-this->x[1][i], 2)); });
+    return (S)(sum / (double)(this->n-1));
+  }
+
+  // sort along a Morton curve if forced or if they have scattered twice as far as when last
+  //   sorted; the particles holding current velocities are sorted among themselves, so they
+  //   stay in front (see get_num_current_vels); returns true if it sorted
+  bool sort_spatially(const bool _force) {
+    if (this->n < 2) return false;
+    const S stride = get_mean_stride();
+    if (not (_force or sorted_stride <= 0.0 or stride > 2.0*sorted_stride)) return false;
+
+    std::vector<int32_t> order = morton_order<S>(this->x, 0, ncurr_vels);
+    const std::vector<int32_t> tail = morton_order<S>(this->x, ncurr_vels, this->n);
+    order.insert(order.end(), tail.begin(), tail.end());
+    reorder(order);
+
+    sorted_stride = get_mean_stride();
+    LOG_DEBUG("  Sorted" << to_string() << ", mean stride " << stride << " to " << sorted_stride);
+    return true;
+  }
+
   // a little logic to see if we should augment the BEM equations for this object (see Surfaces.h)
   const bool is_augmented() const { return false; }
 
@@ -132,7 +275,7 @@ public:
     // remember old size and incoming size (note that Points nelems = nnodes)
     const size_t nold = this->n;
     const size_t nnew = _in.nelem;
-    std::cout << "  adding " << nnew << " particles to collection..." << std::endl;
+    LOG_DEBUG("  adding " << nnew << " particles to collection...");
 
     // must explicitly call the method in the base class first - this pulls out positions and strengths
     ElementBase<S>::add_new(_in);
@@ -142,14 +285,15 @@ public:
       // no radius needed
 
     } else {
-      r.resize(nold+nnew);
+      grow_array(r, nold+nnew);
       std::fill(r.begin()+nold, r.end(), _vd);
     }
+    for (size_t d=0; d<Dimensions; ++d) if (not ub[d].empty()) grow_array(ub[d], nold+nnew);
 
     // save the new untransformed positions if we have a Body pointer
     if (this->B) {
       for (size_t d=0; d<Dimensions; ++d) {
-        (*this->ux)[d].resize(nold+nnew);
+        grow_array((*this->ux)[d], nold+nnew);
         for (size_t i=nold; i<nold+nnew; ++i) {
           (*this->ux)[d][i] = this->x[d][i];
         }
@@ -164,21 +308,60 @@ public:
 
     // must explicitly call the method in the base class - this sets n
     ElementBase<S>::resize(_nnew);
+    ncurr_vels = std::min(ncurr_vels, _nnew);
 
     if (_nnew == currn) return;
+    for (size_t d=0; d<Dimensions; ++d) if (not ub[d].empty()) grow_array(ub[d], _nnew);
 
     // radii here
     if (this->E == inert) {
       // no radii
     } else {
       const size_t thisrn = r.size();
-      r.resize(_nnew);
+      grow_array(r, _nnew);
       for (size_t i=thisrn; i<_nnew; ++i) {
         r[i] = 1.0;
       }
     }
   }
 
+  // make room ahead of an expected number of particles, see ElementBase::reserve
+  void reserve(const size_t _ncap) {
+    ElementBase<S>::reserve(_ncap);
+    if (this->E != inert) reserve_array(r, _ncap);
+  }
+
+  // reserve for as many new particles as arrived since the last call, so that the VRM and
+  //   shedding (which extend the arrays directly) rarely need to reallocate
+  void reserve_for_growth() {
+    const size_t grown = (this->n > n_last_reserve) ? this->n - n_last_reserve : 0;
+    n_last_reserve = this->n;
+    reserve(this->n + grown + grown/2);
+  }
+
+  // velocities follow their particles, and stay current only if they were
+  size_t compact(const std::vector<uint8_t>& _keep) {
+    size_t nkept = 0;
+    for (size_t i=0; i<ncurr_vels; ++i) nkept += _keep[i];
+    ElementBase<S>::compact(_keep, {&r, &ub[0], &ub[1]});
+    ncurr_vels = nkept;
+    return this->n;
+  }
+
+  void shrink() {
+    ElementBase<S>::shrink();
+    shrink_array(r);
+    for (auto& v : ub) shrink_array(v);
+  }
+
+  // become a time-stepping stage of _src, see ElementBase::copy_state_from
+  void copy_state_from(const Points<S>& _src) {
+    ElementBase<S>::copy_state_from(_src);
+    r.assign(_src.r.begin(), _src.r.end());
+    max_strength = _src.max_strength;
+    ncurr_vels = 0;
+  }
+
   void zero_vels() {
     // must explicitly call the method in the base class to zero the vels
     ElementBase<S>::zero_vels();
@@ -200,8 +383,11 @@ public:
   //
   void move(const double _time, const double _dt,
             const double _wt1, Points<S> const & _u1) {
-    // must explicitly call the method in the base class
-    ElementBase<S>::move(_time, _dt, _wt1, _u1);
+    if (this->M == lagrangian) {
+      advect(_dt, [&](const size_t d, const size_t i) { return _wt1*_u1.u[d][i]; });
+    } else {
+      ElementBase<S>::move(_time, _dt, _wt1, _u1);
+    }
 
     // and update the max strength measure
     (void) update_max_str();
@@ -213,8 +399,11 @@ public:
   void move(const double _time, const double _dt,
             const double _wt1, Points<S> const & _u1,
             const double _wt2, Points<S> const & _u2) {
-    // must explicitly call the method in the base class
-    ElementBase<S>::move(_time, _dt, _wt1, _u1, _wt2, _u2);
+    if (this->M == lagrangian) {
+      advect(_dt, [&](const size_t d, const size_t i) { return _wt1*_u1.u[d][i] + _wt2*_u2.u[d][i]; });
+    } else {
+      ElementBase<S>::move(_time, _dt, _wt1, _u1, _wt2, _u2);
+    }
 
     // must confirm that incoming time derivates include velocity (?)
 
@@ -229,8 +418,12 @@ public:
             const double _wt0, Points<S> const & _u0,
             const double _wt1, Points<S> const & _u1,
             const double _wt2, Points<S> const & _u2) {
-    // must explicitly call the method in the base class
-    ElementBase<S>::move(_time, _dt, _wt0, _u0, _wt1, _u1, _wt2, _u2);
+    if (this->M == lagrangian) {
+      advect(_dt, [&](const size_t d, const size_t i) {
+        return _wt0*_u0.u[d][i] + _wt1*_u1.u[d][i] + _wt2*_u2.u[d][i]; });
+    } else {
+      ElementBase<S>::move(_time, _dt, _wt0, _u0, _wt1, _u1, _wt2, _u2);
+    }
 
     // must confirm that incoming time derivates include velocity (?)
 
@@ -238,6 +431,31 @@ public:
     (void) update_max_str();
   }
 
+  // move every particle by _dt times the velocity _vel(d,i), and if the total impulse was
+  //   current before, add the change in the same pass
+  template <class F>
+  void advect(const double _dt, F _vel) {
+    LOG_DEBUG("  Moving" << this->to_string());
+    const bool carry = (this->s and imp_gen == this->state_gen and imp_carried < impulse_refresh);
+    double dimp[Dimensions] = {0.0};
+    for (size_t i=0; i<this->n; ++i) {
+      const double dx = (S)_dt * _vel(0, i);
+      const double dy = (S)_dt * _vel(1, i);
+      this->x[0][i] += dx;
+      this->x[1][i] += dy;
+      if (carry) {
+        dimp[0] -= (double)(*this->s)[i] * dy;
+        dimp[1] += (double)(*this->s)[i] * dx;
+      }
+    }
+    this->state_changed();
+    if (carry) {
+      for (size_t d=0; d<Dimensions; ++d) imp_sum[d] += dimp[d];
+      imp_gen = this->state_gen;
+      ++imp_carried;
+    }
+  }
+
   // find the new peak strength magnitude
   void update_max_str() {
     S thismax = ElementBase<S>::get_max_str();
@@ -250,7 +468,9 @@ public:
     }
   }
 
-  // add and return the total impulse of all elements
+  // add and return the total impulse of all elements; the sum is kept, and advection only
+  //   adds what the particles' displacements changed, see advect, until the particles
+  //   change in any other way or it has been carried forward impulse_refresh times
   std::array<S,Dimensions> get_total_impulse() {
 
     // here is the return vector
@@ -258,16 +478,46 @@ public:
     imp.fill(0.0);
 
     if (this->s) {
-      // accumulate impulse from each particle
-      for (size_t i=0; i<this->n; ++i) {
-        imp[0] -= (*this->s)[i] * this->x[1][i];
-        imp[1] += (*this->s)[i] * this->x[0][i];
+      if (imp_gen != this->state_gen) {
+        // accumulate impulse from each particle
+        const Vector<S>& s = *this->s;
+        const std::array<Vector<S>,Dimensions>& x = this->x;
+        imp_sum[0] = -reproducible_sum<double>(this->n, [&](const size_t i) { return (double)s[i] * x[1][i]; });
+        imp_sum[1] =  reproducible_sum<double>(this->n, [&](const size_t i) { return (double)s[i] * x[0][i]; });
+        imp_gen = this->state_gen;
+        imp_carried = 0;
       }
+      for (size_t d=0; d<Dimensions; ++d) imp[d] = (S)imp_sum[d];
     }
 
     return imp;
   }
 
+  // the impulse of the particles nearest each of these centers, added to _imp; this
+  //   attributes the wake to the bodies for the per-body force estimate
+  void add_impulse_by_nearest(const std::vector<std::array<double,Dimensions>>& _ctr,
+                              std::vector<std::array<double,Dimensions>>& _imp) const {
+    if (not this->s or _ctr.empty()) return;
+    assert(_imp.size() == _ctr.size() && "Impulse and center lists differ in size");
+    const Vector<S>& s = *this->s;
+    const std::array<Vector<S>,Dimensions>& x = this->x;
+    for (size_t i=0; i<this->n; ++i) {
+      size_t jnear = 0;
+      double dnear = std::numeric_limits<double>::max();
+      for (size_t j=0; j<_ctr.size(); ++j) {
+        const double dx = x[0][i] - _ctr[j][0];
+        const double dy = x[1][i] - _ctr[j][1];
+        const double dsq = dx*dx + dy*dy;
+        if (dsq < dnear) {
+          dnear = dsq;
+          jnear = j;
+        }
+      }
+      _imp[jnear][0] -= (double)s[i] * x[1][i];
+      _imp[jnear][1] += (double)s[i] * x[0][i];
+    }
+  }
+
   void add_body_motion(const S _factor, const double _time) {
     // no need to call base class now
     //ElementBase<S>::add_body_motion(_factor);
@@ -304,6 +554,50 @@ public:
     glVertexAttribDivisor(position_attribute, 1);
   }
 
+  // point the bound vao's per-particle attributes at the current buffers
+  void bind_opengl_buffers() {
+    if (this->E == inert) {
+      prepare_opengl_buffer(mgl->spo[0], 0, "px");
+      prepare_opengl_buffer(mgl->spo[0], 1, "py");
+    } else {
+      prepare_opengl_buffer(mgl->spo[1], 0, "px");
+      prepare_opengl_buffer(mgl->spo[1], 1, "py");
+      prepare_opengl_buffer(mgl->spo[1], 2, "rad");
+      prepare_opengl_buffer(mgl->spo[1], 3, "sx");
+    }
+  }
+
+  // the arrays behind those buffers, in the same order
+  std::vector<const void*> gl_arrays() const {
+    if (this->E == inert) return {this->x[0].data(), this->x[1].data()};
+    return {this->x[0].data(), this->x[1].data(), r.data(), this->s ? (*this->s).data() : nullptr};
+  }
+
+  // the box and largest radius of each run of gl_chunk particles, five floats a run, so
+  //   draws can skip the runs out of view; Morton ordering keeps the runs compact
+  std::vector<float> gl_chunk_bounds() const {
+    std::vector<float> bounds;
+    const size_t n = this->x[0].size();
+    if (n < 2*gl_chunk) return bounds;
+    const bool has_rad = (this->E != inert and r.size() == n);
+    bounds.reserve(5*(n/gl_chunk + 1));
+    for (size_t i0=0; i0<n; i0+=gl_chunk) {
+      const size_t i1 = std::min(n, i0+gl_chunk);
+      float xmin = this->x[0][i0], xmax = xmin;
+      float ymin = this->x[1][i0], ymax = ymin;
+      float rmax = 0.0f;
+      for (size_t i=i0; i<i1; ++i) {
+        xmin = std::min(xmin, (float)this->x[0][i]);
+        xmax = std::max(xmax, (float)this->x[0][i]);
+        ymin = std::min(ymin, (float)this->x[1][i]);
+        ymax = std::max(ymax, (float)this->x[1][i]);
+        if (has_rad) rmax = std::max(rmax, (float)r[i]);
+      }
+      bounds.insert(bounds.end(), {xmin, xmax, ymin, ymax, rmax});
+    }
+    return bounds;
+  }
+
   // this gets done once - load the shaders, set up the vao
   void initGL(std::vector<float>& _projmat,
               float*              _poscolor,
@@ -316,8 +610,16 @@ public:
     // generate the opengl state object with space for 4 vbos and 2 shader programs
     mgl = std::make_shared<GlState>(4,2);
 
+    // where the driver allows, the step thread writes straight into mapped buffers
+    if (GlStream::is_supported()) {
+      const std::vector<size_t> streamed = (this->E == inert) ? std::vector<size_t>({0, 1})
+                                                              : std::vector<size_t>({0, 1, 2, 3});
+      mgl->stream = std::make_unique<GlStream>(&mgl->vbo, streamed, sizeof(S));
+      (void) mgl->stream->reserve(this->x[0].size());
+    }
+
     // Allocate space, but don't upload the data from CPU to GPU yet
-    for (size_t i=0; i<Dimensions; ++i) {
+    for (size_t i=0; i<Dimensions and not mgl->stream; ++i) {
       glBindBuffer(GL_ARRAY_BUFFER, mgl->vbo[i]);
       glBufferData(GL_ARRAY_BUFFER, 0, this->x[i].data(), GL_STATIC_DRAW);
     }
@@ -329,8 +631,7 @@ public:
       mgl->spo[0] = create_draw_point_program();
 
       // Only send position arrays - no radius or strength
-      prepare_opengl_buffer(mgl->spo[0], 0, "px");
-      prepare_opengl_buffer(mgl->spo[0], 1, "py");
+      bind_opengl_buffers();
 
       // and for the compute shaders!
 
@@ -367,21 +668,20 @@ public:
 
     } else { // this->E is active or reactive
 
-      glBindBuffer(GL_ARRAY_BUFFER, mgl->vbo[2]);
-      glBufferData(GL_ARRAY_BUFFER, 0, r.data(), GL_STATIC_DRAW);
-      if (this->s) {
-        glBindBuffer(GL_ARRAY_BUFFER, mgl->vbo[3]);
-        glBufferData(GL_ARRAY_BUFFER, 0, (*this->s).data(), GL_STATIC_DRAW);
+      if (not mgl->stream) {
+        glBindBuffer(GL_ARRAY_BUFFER, mgl->vbo[2]);
+        glBufferData(GL_ARRAY_BUFFER, 0, r.data(), GL_STATIC_DRAW);
+        if (this->s) {
+          glBindBuffer(GL_ARRAY_BUFFER, mgl->vbo[3]);
+          glBufferData(GL_ARRAY_BUFFER, 0, (*this->s).data(), GL_STATIC_DRAW);
+        }
       }
 
       // Load and create the blob-drawing shader program
       mgl->spo[1] = create_draw_blob_program();
 
       // Now do the four arrays
-      prepare_opengl_buffer(mgl->spo[1], 0, "px");
-      prepare_opengl_buffer(mgl->spo[1], 1, "py");
-      prepare_opengl_buffer(mgl->spo[1], 2, "rad");
-      prepare_opengl_buffer(mgl->spo[1], 3, "sx");
+      bind_opengl_buffers();
 
       // and for the compute shaders!
 
@@ -429,6 +729,22 @@ public:
     if (not mgl) return;
     if (glIsVertexArray(mgl->vao) == GL_FALSE) return;
 
+    if (mgl->stream) {
+      // the step thread may have written this very state in already
+      const size_t n = this->x[0].size();
+      if (not mgl->stream->acquire(this->get_state_gen())) {
+        if (mgl->stream->reserve(n)) {
+          glBindVertexArray(mgl->vao);
+          bind_opengl_buffers();
+          glBindVertexArray(0);
+        }
+        mgl->stream->upload(gl_arrays(), n, gl_chunk_bounds());
+      }
+      mgl->num_uploaded = mgl->stream->get_count();
+      mgl->num_bytes = mgl->stream->get_bytes();
+      return;
+    }
+
     const size_t vlen = this->x[0].size()*sizeof(S);
     if (vlen > 0) {
       glBindVertexArray(mgl->vao);
@@ -461,9 +777,58 @@ public:
 
       // must tell draw call how many elements are there
       mgl->num_uploaded = this->x[0].size();
+      mgl->num_bytes = vlen * ((this->E == inert) ? Dimensions : Dimensions + (this->s ? 2 : 1));
     }
   }
 
+  // one primitive of _nverts per particle, from whichever copy of the buffers is current,
+  //   skipping the runs wholly out of view; a splat reaches _rscale times a particle's
+  //   radius, or at least _rmin
+  void draw_instances(const GLenum _mode, const GLsizei _nverts, const std::vector<float>& _projmat,
+                      const float _rscale, const float _rmin) {
+    if (not mgl->stream) {
+      glDrawArraysInstanced(_mode, 0, _nverts, mgl->num_uploaded);
+      return;
+    }
+
+    const GLuint base = mgl->stream->get_base_instance();
+    const std::vector<float>& bounds = mgl->stream->get_bounds();
+    const size_t nchunks = bounds.size() / 5;
+    if (nchunks == 0) {
+      glDrawArraysInstancedBaseInstance(_mode, 0, _nverts, mgl->num_uploaded, base);
+    } else {
+      // the view in world space, from the orthographic projection
+      const float x0 = (-1.0f - _projmat[12]) / _projmat[0];
+      const float x1 = ( 1.0f - _projmat[12]) / _projmat[0];
+      const float y0 = (-1.0f - _projmat[13]) / _projmat[5];
+      const float y1 = ( 1.0f - _projmat[13]) / _projmat[5];
+
+      // neighboring runs in view go out as one draw
+      size_t first = 0, count = 0;
+      for (size_t c=0; c<nchunks; ++c) {
+        const float* b = &bounds[5*c];
+        const float pad = std::max(_rmin, _rscale*b[4]);
+        const bool visible = b[0]-pad <= x1 and b[1]+pad >= x0 and b[2]-pad <= y1 and b[3]+pad >= y0;
+        const size_t nc = std::min(gl_chunk, (size_t)mgl->num_uploaded - c*gl_chunk);
+        if (visible) {
+          if (count == 0) first = c*gl_chunk;
+          count += nc;
+        }
+        if ((not visible or c == nchunks-1) and count > 0) {
+          glDrawArraysInstancedBaseInstance(_mode, 0, _nverts, (GLsizei)count, base + (GLuint)first);
+          count = 0;
+        }
+      }
+    }
+    mgl->stream->fence_front();
+  }
+
+  // called from the step thread as a step ends, so the GUI need not upload the results itself
+  void publishGL() {
+    if (mgl and mgl->stream) (void) mgl->stream->publish(gl_arrays(), this->x[0].size(), this->get_state_gen(),
+                                                         gl_chunk_bounds());
+  }
+
   // OpenGL3 stuff to display points, called once per frame
   void drawGL(std::vector<float>& _projmat,
               RenderParams&       _rparams,
@@ -501,27 +866,44 @@ public:
         glUniform1f (mgl->unif_rad_attribute, (const GLfloat)(2.5f*_rparams.tracer_size));
 
         // the one draw call here
-        glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, mgl->num_uploaded);
+        draw_instances(GL_TRIANGLE_FAN, 4, _projmat, 0.0f, std::max(0.002f/_projmat[0], 2.5f*_rparams.tracer_size));
 
       } else { // this->E is active or reactive
 
-        // draw as colored clouds
-        glUseProgram(mgl->spo[1]);
+        const float color_scaling = _rparams.circ_density * std::pow(_vdelta/_rparams.vorton_scale,2) / max_strength;
 
-        glEnableVertexAttribArray(mgl->quad_attribute_bl);
+        // how wide a particle's own splat is on screen
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        const float splat_px = 2.5f * _vdelta * _rparams.vorton_scale * 0.5f * _projmat[0] * viewport[2];
 
-        // upload the current projection matrix
-        glUniformMatrix4fv(mgl->projmat_attribute_bl, 1, GL_FALSE, _projmat.data());
+        if (splat_px < 1.0f and (size_t)mgl->num_uploaded >= lod_min_count) {
 
-        // upload the current color values
-        const float color_scaling = _rparams.circ_density * std::pow(_vdelta/_rparams.vorton_scale,2) / max_strength;
-        glUniform4fv(mgl->pos_color_attribute, 1, (const GLfloat *)_rparams.pos_circ_color);
-        glUniform4fv(mgl->neg_color_attribute, 1, (const GLfloat *)_rparams.neg_circ_color);
-        glUniform1f (mgl->str_scale_attribute, (const GLfloat)color_scaling);
-        glUniform1f (mgl->rad_scale_attribute, (const GLfloat)_rparams.vorton_scale);
+          // too small to see one by one, so sum them into pixels and color those
+          if (not mgl->density) mgl->density = std::make_unique<GlDensity>(mgl->spo[1]);
+          mgl->density->begin(_projmat, _rparams.vorton_scale);
+          draw_instances(GL_POINTS, 1, _projmat, 0.0f, 0.0f);
+          mgl->density->finish(_rparams.pos_circ_color, _rparams.neg_circ_color, color_scaling);
 
-        // the one draw call here
-        glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, mgl->num_uploaded);
+        } else {
+
+          // draw as colored clouds
+          glUseProgram(mgl->spo[1]);
+
+          glEnableVertexAttribArray(mgl->quad_attribute_bl);
+
+          // upload the current projection matrix
+          glUniformMatrix4fv(mgl->projmat_attribute_bl, 1, GL_FALSE, _projmat.data());
+
+          // upload the current color values
+          glUniform4fv(mgl->pos_color_attribute, 1, (const GLfloat *)_rparams.pos_circ_color);
+          glUniform4fv(mgl->neg_color_attribute, 1, (const GLfloat *)_rparams.neg_circ_color);
+          glUniform1f (mgl->str_scale_attribute, (const GLfloat)color_scaling);
+          glUniform1f (mgl->rad_scale_attribute, (const GLfloat)_rparams.vorton_scale);
+
+          // the one draw call here
+          draw_instances(GL_TRIANGLE_FAN, 4, _projmat, 2.5f*_rparams.vorton_scale, 0.002f/_projmat[0]);
+        }
       }
 
       // return state
@@ -537,10 +919,10 @@ public:
     return retstr;
   }
 
-  std::string write_vtk(const size_t _index, const size_t _frameno, const double _time) {
+  std::string write_vtk(const size_t _index, const size_t _frameno, const double _time,
+                        const vtk_enc_t _enc = vtk_zlib) {
     assert(this->n > 0 && "Inside write_vtk with no points");
   
-    const bool asbase64 = true;
 
     bool has_radii = true;
     bool has_strengths = true;
@@ -554,7 +936,7 @@ public:
     // generate file name
     std::stringstream vtkfn;
     vtkfn << prefix << std::setfill('0') << std::setw(2) << _index << "_" << std::setw(5) << _frameno << ".vtu";
-    VtkXmlWriter ptsWriter = VtkXmlWriter(vtkfn.str(), asbase64);
+    VtkXmlWriter ptsWriter = VtkXmlWriter(vtkfn.str(), _enc);
   
     // include simulation time here
     ptsWriter.addElement("FieldData");
@@ -581,9 +963,9 @@ public:
     {
       std::map<std::string, std::string> attribs = {{"NumberOfComponents", "3"},
                                                     {"Name",               "position"},
-                                                    {"type",               "Float32"}};
+                                                    {"type",               vtk_type_name<S>()}};
       ptsWriter.addElement("DataArray", attribs);
-      Vector<float> pos = ptsWriter.unpackArray(this->x);
+      Vector<S> pos = ptsWriter.unpackArray(this->x);
       ptsWriter.writeDataArray(pos);
       // DataArray
       ptsWriter.closeElement();
@@ -649,7 +1031,7 @@ public:
   
     if (has_strengths) {
       std::map<std::string, std::string> attribs = {{"Name", "circulation"},
-                                                    {"type", "Float32"}};
+                                                    {"type", vtk_type_name<S>()}};
       ptsWriter.addElement("DataArray", attribs);
       ptsWriter.writeDataArray(*(this->s));
       ptsWriter.closeElement(); // DataArray
@@ -657,7 +1039,7 @@ public:
 
     if (has_radii) {
       std::map<std::string, std::string> attribs = {{"Name", "radius"},
-                                                    {"type", "Float32"}};
+                                                    {"type", vtk_type_name<S>()}};
       ptsWriter.addElement("DataArray", attribs);
       ptsWriter.writeDataArray(this->r);
       ptsWriter.closeElement(); // DataArray
@@ -665,7 +1047,7 @@ public:
 
     if (this->has_vort()) {
       std::map<std::string, std::string> attribs = {{"Name", "vorticity"},
-                                                    {"type", "Float32"}};
+                                                    {"type", vtk_type_name<S>()}};
       ptsWriter.addElement("DataArray", attribs);
       ptsWriter.writeDataArray(*(this->w));
       ptsWriter.closeElement(); // DataArray
@@ -674,9 +1056,9 @@ public:
     {
       std::map<std::string, std::string> attribs = {{"NumberOfComponents", "3"},
                                                     {"Name",               "velocity"},
-                                                    {"type",               "Float32"}};
+                                                    {"type",               vtk_type_name<S>()}};
       ptsWriter.addElement("DataArray", attribs);
-      Vector<float> vel = ptsWriter.unpackArray(this->u);
+      Vector<S> vel = ptsWriter.unpackArray(this->u);
       ptsWriter.writeDataArray(vel);
       ptsWriter.closeElement(); // DataArray
     }
@@ -684,37 +1066,35 @@ public:
     // Point Data 
     ptsWriter.closeElement();
   
-    // here's the problem: ParaView's VTK/XML reader is not able to read "raw" bytestreams
-    // it parses each character and inevitably sees a > or <, so complains about mismatched
-    //   tags, and doesn't seem to point to the right place
-    // everyone who complains about raw data in the AppendedData section makes the mistake
-    //   of forgetting the 4-byte length - I've got that
-    // it's VTK's fault here
-    // Jesus, for how inefficient saving 2D particle data is, it's compounded by having to 
-    //   do it all in ascii!!! VTK just sucks. That's really what my 6 hours of wasted work
-    //   has taught me. It just sucks. Don't use it. Not that anything else is better.
-  /*
-    printer.OpenElement( "AppendedData" );
-    printer.PushAttribute( "encoding", "raw" );
-    printer.PushText( " " );
-    printer.PushText( "_" );
-    uint32_t arry_len = s.size() * sizeof(s[0]);
-    char* ptr = (char*)(&arry_len);
-    std::cout << "  writing " << arry_len << " bytes to appended data" << std::endl;
-    //std::fwrite(&arry_len, sizeof(uint32_t), 1, fp);
-    std::fwrite(ptr, sizeof(uint32_t), 1, fp);
-    std::fwrite(s.data(), sizeof(s[0]), s.size(), fp);
-    printer.PushText( " " );
-    printer.CloseElement();	// AppendedData
-  */
   
     // Piece 
     ptsWriter.closeElement();
     ptsWriter.finish();
-    std::cout << "Wrote " << this->n << " points to " << vtkfn.str() << std::endl;
+    LOG_INFO("Wrote " << this->n << " points to " << vtkfn.str());
     return vtkfn.str();
   }
 
+#ifdef USE_HDF5
+  // the same data as write_vtk, as one step of an hdf5 series
+  std::string write_hdf5(Hdf5Writer& _out, const size_t _index, const size_t _frameno, const double _time) {
+    assert(this->n > 0 && "Inside write_hdf5 with no points");
+
+    std::stringstream series;
+    series << (this->E==inert ? "fldpt_" : "part_") << std::setfill('0') << std::setw(2) << _index;
+    Hdf5Step step(_out, series.str(), _frameno, _time);
+    step.add_geometry(this->x);
+    step.add_topology("Polyvertex", this->n, 1);
+    if (this->E != inert) {
+      step.add_scalar("circulation", *(this->s));
+      step.add_scalar("radius", this->r);
+    }
+    if (this->has_vort()) step.add_scalar("vorticity", *(this->w));
+    step.add_vector("velocity", this->u);
+    LOG_INFO("Wrote " << this->n << " points to " << series.str() << ".h5");
+    return step.end_step();
+  }
+#endif
+
 protected:
   // additional state vector
   Vector<S> r;					// thickness/radius
@@ -723,7 +1103,36 @@ protected:
 private:
 #ifdef USE_GL
   std::shared_ptr<GlState> mgl;
+
+  // particles per run for culling, and the fewest worth summing into pixels
+  static constexpr size_t gl_chunk = 4096;
+  static constexpr size_t lod_min_count = 65536;
 #endif
   float max_strength;
+  size_t ncurr_vels = 0;
+  std::array<Vector<S>,Dimensions> ub;
+  S sorted_stride = 0.0;
+  size_t n_last_reserve = 0;
+
+  // the total impulse, the state generation it is current for, and how many moves it has
+  //   been carried through since last summed in full (which bounds the round-off drift)
+  static constexpr size_t impulse_refresh = 32;
+  std::array<double,Dimensions> imp_sum = {0.0};
+  uint32_t imp_gen = 0;
+  size_t imp_carried = 0;
+
+  // the shared spatial index, and the state generation it came from
+  mutable CellList<S> cells;
+  mutable uint32_t cells_gen = 0;
+
+  // cached source arrays for the vector kernels, and the state generation they came from
+#ifdef USE_VC
+  mutable std::optional<VcSources> vcsrc;
+  mutable uint32_t vcsrc_gen = 0;
+#endif
+#ifdef USE_STDSIMD
+  mutable std::optional<std::array<SimdMemory<S>,4>> simdsrc;
+  mutable uint32_t simdsrc_gen = 0;
+#endif
 };
 
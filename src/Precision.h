@@ -0,0 +1,33 @@
+/*
+ * Precision.h - Storage and accumulation types, chosen when building
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+//
+// Elements, and everything which holds copies of them, store values as STORE; velocity and
+//   coefficient sums accumulate in ACCUM. Pick one profile with PRECISION in cmake:
+//
+//   float   all-float, fastest, and what Vc builds have always used
+//   mixed   float storage with double sums, the usual choice
+//   double  all-double, for checking the others; batch only, the GL buffers expect floats
+//
+// every kernel template is built for the chosen pair, so profiles are separate builds
+//
+#if defined(PRECISION_DOUBLE)
+  #ifdef USE_GL
+    #error "The all-double precision profile is for batch builds only"
+  #endif
+  #define STORE double
+  #define ACCUM double
+#elif defined(PRECISION_FLOAT) or defined(USE_VC)
+  #define STORE float
+  #define ACCUM float
+#else
+  #define STORE float
+  #define ACCUM double
+#endif
+
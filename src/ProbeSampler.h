@@ -0,0 +1,168 @@
+/*
+ * ProbeSampler.h - Keep time series of velocity and vorticity at the field points
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "Collection.h"
+
+#include <json/json.hpp>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+
+//
+// Every interval-th step, the position, velocity and vorticity at every field point (from
+//   the MeasureFeatures) go into a ring of samples held in memory, which is appended to one
+//   file whenever it fills and at the end of the run; this gives probe histories at every
+//   step for a tiny fraction of the cost of writing the whole field
+//
+// the file is csv (one line per point per sample) unless its name ends in .bin, in which
+//   case each sample is the time (double), the step and the number of points (uint64), then
+//   x, y, u, v and vorticity (float) for each point
+//
+class ProbeSampler {
+public:
+  bool is_active() const { return interval > 0; }
+  bool is_due(const size_t _nstep) const { return interval > 0 and _nstep % interval == 0; }
+  size_t get_interval() const { return interval; }
+
+  // copy out the field points' results, which must be current
+  void sample(const double _time, const size_t _nstep, const std::vector<Collection>& _pts) {
+    size_t npts = 0;
+    for (const auto& coll : _pts) {
+      if (std::holds_alternative<Points<STORE>>(coll)) npts += std::get<Points<STORE>>(coll).get_n();
+    }
+    if (npts == 0) return;
+
+    // a new set of points needs a new ring
+    const size_t rowlen = vals_per_point * npts;
+    if (rowlen != ring_rowlen) {
+      flush();
+      ring_rowlen = rowlen;
+      ring.assign(capacity * rowlen, 0.0f);
+      ring_time.assign(capacity, 0.0);
+      ring_step.assign(capacity, 0);
+    }
+
+    const size_t slot = (first + count) % capacity;
+    ring_time[slot] = _time;
+    ring_step[slot] = _nstep;
+    float* row = ring.data() + slot*rowlen;
+    for (const auto& coll : _pts) {
+      if (not std::holds_alternative<Points<STORE>>(coll)) continue;
+      const Points<STORE>& pts = std::get<Points<STORE>>(coll);
+      const auto& x = pts.get_pos();
+      const auto& u = pts.get_vel();
+      const bool have_w = pts.has_vort() and pts.get_vort().size() == pts.get_n();
+      for (size_t i=0; i<pts.get_n(); ++i) {
+        *row++ = (float)x[0][i];
+        *row++ = (float)x[1][i];
+        *row++ = (i < u[0].size()) ? (float)u[0][i] : 0.0f;
+        *row++ = (i < u[1].size()) ? (float)u[1][i] : 0.0f;
+        *row++ = have_w ? (float)pts.get_vort()[i] : 0.0f;
+      }
+    }
+
+    if (++count == capacity) flush();
+  }
+
+  // append every held sample to the file, oldest first
+  void flush() {
+    if (count == 0) return;
+    const bool binary = (file.size() > 4 and file.compare(file.size()-4, 4, ".bin") == 0);
+    std::ofstream out(file, started ? (std::ios::app | std::ios::binary) : std::ios::binary);
+    if (not out) {
+      std::cout << "  could not write probe samples to " << file << std::endl;
+      count = 0;
+      return;
+    }
+    if (not binary and not started) out << "step,time,point,x,y,u,v,vort\n";
+    started = true;
+
+    const size_t npts = ring_rowlen / vals_per_point;
+    for (size_t k=0; k<count; ++k) {
+      const size_t slot = (first + k) % capacity;
+      const float* row = ring.data() + slot*ring_rowlen;
+      if (binary) {
+        const uint64_t header[2] = {(uint64_t)ring_step[slot], (uint64_t)npts};
+        out.write((const char*)&ring_time[slot], sizeof(double));
+        out.write((const char*)header, sizeof(header));
+        out.write((const char*)row, ring_rowlen*sizeof(float));
+      } else {
+        for (size_t i=0; i<npts; ++i) {
+          const float* v = row + vals_per_point*i;
+          out << ring_step[slot] << "," << ring_time[slot] << "," << i << "," << v[0] << ","
+              << v[1] << "," << v[2] << "," << v[3] << "," << v[4] << "\n";
+        }
+      }
+    }
+    first = (first + count) % capacity;
+    count = 0;
+  }
+
+  // a new run writes a new file
+  void reset() {
+    count = 0;
+    first = 0;
+    started = false;
+  }
+
+  // but a run resumed from a checkpoint adds to the one it wrote before; samples past the
+  //   checkpoint come again, and the step column tells them apart
+  void resume() {
+    count = 0;
+    first = 0;
+    started = true;
+  }
+
+  void from_json(const nlohmann::json j) {
+    if (j.find("interval") != j.end()) {
+      interval = j["interval"];
+      std::cout << "    setting probe interval= " << interval << std::endl;
+    }
+    if (j.find("capacity") != j.end()) {
+      capacity = std::max((size_t)1, (size_t)j["capacity"]);
+      std::cout << "    setting probe capacity= " << capacity << std::endl;
+    }
+    if (j.find("file") != j.end()) {
+      file = j["file"];
+      std::cout << "    setting probe file= " << file << std::endl;
+    }
+    ring_rowlen = 0;
+  }
+
+  nlohmann::json to_json() const {
+    nlohmann::json j = nlohmann::json::object();
+    j["interval"] = interval;
+    j["capacity"] = capacity;
+    j["file"] = file;
+    return j;
+  }
+
+private:
+  static constexpr size_t vals_per_point = 5;
+
+  // sample every interval-th step (0 means never), and write after capacity samples
+  size_t interval = 0;
+  size_t capacity = 1024;
+  std::string file = "probes.csv";
+
+  // the samples, from the slot first, and the file has had its first write
+  std::vector<float> ring;
+  std::vector<double> ring_time;
+  std::vector<size_t> ring_step;
+  size_t ring_rowlen = 0;
+  size_t first = 0;
+  size_t count = 0;
+  bool started = false;
+};
@@ -0,0 +1,566 @@
+/*
+ * Profiler.h - Nested timing zones, summed over each step and over the whole run
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef USE_PERF_COUNTERS
+#include "PerfCounters.h"
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <array>
+#include <atomic>
+#include <algorithm>
+
+
+//
+// A PROFILE_ZONE("name") times the rest of its scope, and a zone opened inside another one
+//   becomes its child, so the zones build a tree like step > diffusion > vrm > solve; each
+//   keeps its seconds and calls for the current step and for the run
+//
+// only the thread which runs the step records: zones opened by background jobs or inside
+//   OpenMP parallel regions do nothing, so no zone needs a lock and none can overlap
+//
+// the influence kernels also report their flop counts and seconds with PROFILE_FLOPS, from
+//   any thread, so each interaction type (0v_0p, 1_0, ...) gets its achieved GFlop/s, and
+//   a percent of the peak set with set_peak_gflops
+//
+// with USE_PERF_COUNTERS, each zone also sums the hardware events counted while it was
+//   open (see PerfCounters.h), for the instructions per cycle, cache misses and share of
+//   packed floating-point instructions in each phase
+//
+// and start_trace() records every zone on every thread (background jobs and the threads of
+//   OpenMP regions too) for a few steps, then writes them as trace events, which
+//   chrome://tracing and ui.perfetto.dev draw as a timeline per thread
+//
+// build without USE_PROFILER and the zones are gone entirely
+//
+class Profiler {
+public:
+  struct Zone {
+    const char* name;
+    int parent;
+    int depth;
+    double step_secs = 0.0;
+    double run_secs = 0.0;
+    size_t step_calls = 0;
+    size_t run_calls = 0;
+#ifdef USE_PERF_COUNTERS
+    std::array<double,PerfCounters::num_counters> step_counts = {};
+    std::array<double,PerfCounters::num_counters> run_counts = {};
+#endif
+  };
+
+  struct Kernel {
+    const char* name;
+    double step_flops = 0.0;
+    double step_secs = 0.0;
+    double run_flops = 0.0;
+    double run_secs = 0.0;
+
+    double step_gflops() const { return (step_secs > 0.0) ? 1.e-9 * step_flops / step_secs : 0.0; }
+    double run_gflops() const { return (run_secs > 0.0) ? 1.e-9 * run_flops / run_secs : 0.0; }
+  };
+
+  static Profiler& get() {
+    static Profiler instance;
+    return instance;
+  }
+
+  // one zone as seen by one thread, microseconds after the trace began
+  struct TraceEvent {
+    const char* name;
+    int tid;
+    double ts;
+    double dur;
+    long step;
+  };
+
+  // trace the next _nsteps steps, then write them to _file
+  void start_trace(const std::string _file, const int _nsteps) {
+    std::lock_guard<std::mutex> lock(tmtx);
+    trace_file = _file;
+    trace_steps_left = std::max(1, _nsteps);
+    trace_armed = true;
+  }
+  bool is_tracing() const { return tracing.load(std::memory_order_relaxed); }
+  bool trace_pending() const { return trace_armed or is_tracing(); }
+
+  // any thread
+  void add_trace(const char* _name, const std::chrono::steady_clock::time_point _start,
+                 const std::chrono::steady_clock::time_point _end, const long _step = -1) {
+    if (not is_tracing()) return;
+    const int tid = trace_tid();
+    std::lock_guard<std::mutex> lock(tmtx);
+    if (not has_thread_name_locked(tid)) {
+#ifdef _OPENMP
+      if (omp_in_parallel()) thread_names.emplace_back(tid, "omp thread " + std::to_string(omp_get_thread_num()));
+      else
+#endif
+      thread_names.emplace_back(tid, "thread " + std::to_string(tid));
+    }
+    trace.push_back(TraceEvent{_name, tid,
+                    std::chrono::duration<double,std::micro>(_start - trace_start).count(),
+                    std::chrono::duration<double,std::micro>(_end - _start).count(), _step});
+  }
+
+  // a name for this thread's row in the trace
+  void name_thread(const std::string _name) {
+    const int tid = trace_tid();
+    std::lock_guard<std::mutex> lock(tmtx);
+    for (auto& tn : thread_names) {
+      if (tn.first == tid) {
+        tn.second = _name;
+        return;
+      }
+    }
+    thread_names.emplace_back(tid, _name);
+  }
+
+  // call first thing in main(), before any other threads start, so they are all counted
+  void open_counters() {
+#ifdef USE_PERF_COUNTERS
+    const int nopen = counters.open();
+    if (nopen == PerfCounters::num_counters) {
+      printf("  hardware counters: all %d open\n", nopen);
+    } else {
+      printf("  hardware counters: %d of %d open:", nopen, (int)PerfCounters::num_counters);
+      for (int i=0; i<PerfCounters::num_counters; ++i) {
+        if (not counters.is_open(i)) printf(" no %s;", PerfCounters::name(i));
+      }
+      printf("\n");
+    }
+#endif
+  }
+
+#ifdef USE_PERF_COUNTERS
+  bool have_counters() const { return counters.any_open(); }
+  void read_counters(double* const _out) const { counters.read(_out); }
+#else
+  bool have_counters() const { return false; }
+#endif
+
+  // call from the stepping thread around each step, which becomes the root zone; before the
+  //   next step, the finished one is kept for the GUI
+  void begin_step() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      last_step = zones;
+    }
+    for (auto& z : zones) {
+      z.step_secs = 0.0;
+      z.step_calls = 0;
+#ifdef USE_PERF_COUNTERS
+      z.step_counts.fill(0.0);
+#endif
+    }
+    {
+      std::lock_guard<std::mutex> lock(kmtx);
+      last_kernels = kernels;
+      for (auto& k : kernels) {
+        k.step_flops = 0.0;
+        k.step_secs = 0.0;
+      }
+    }
+    owner = std::this_thread::get_id();
+    current = -1;
+    ++nsteps;
+    {
+      std::lock_guard<std::mutex> lock(tmtx);
+      if (trace_armed) {
+        trace_armed = false;
+        trace.clear();
+        trace_start = std::chrono::steady_clock::now();
+        tracing.store(true);
+      }
+    }
+    if (is_tracing() and not has_thread_name(trace_tid())) {
+      name_thread("step");
+    }
+    step_zone = enter("step");
+#ifdef USE_PERF_COUNTERS
+    counters.read(step_counts0.data());
+#endif
+    step_start = std::chrono::steady_clock::now();
+  }
+
+  void end_step() {
+    if (step_zone < 0) return;
+    const auto step_end = std::chrono::steady_clock::now();
+    const double secs = std::chrono::duration<double>(step_end - step_start).count();
+    if (is_tracing()) {
+      add_trace("step", step_start, step_end, (long)nsteps);
+      bool done = false;
+      {
+        std::lock_guard<std::mutex> lock(tmtx);
+        done = (--trace_steps_left <= 0);
+      }
+      if (done) {
+        tracing.store(false);
+        write_trace();
+      }
+    }
+#ifdef USE_PERF_COUNTERS
+    std::array<double,PerfCounters::num_counters> now;
+    counters.read(now.data());
+    for (size_t i=0; i<now.size(); ++i) now[i] -= step_counts0[i];
+    leave(step_zone, secs, now.data());
+#else
+    leave(step_zone, secs);
+#endif
+    step_zone = -1;
+  }
+
+  // returns the zone, or -1 if this thread does not record
+  int enter(const char* _name) {
+    if (std::this_thread::get_id() != owner) return -1;
+#ifdef _OPENMP
+    if (omp_in_parallel()) return -1;
+#endif
+    int idx = -1;
+    for (size_t i=0; i<zones.size(); ++i) {
+      if (zones[i].parent == current and
+          (zones[i].name == _name or std::strcmp(zones[i].name, _name) == 0)) {
+        idx = (int)i;
+        break;
+      }
+    }
+    if (idx < 0) {
+      const int depth = (current < 0) ? 0 : zones[current].depth + 1;
+      std::lock_guard<std::mutex> lock(mtx);
+      zones.push_back(Zone{_name, current, depth});
+      idx = (int)zones.size() - 1;
+    }
+    current = idx;
+    return idx;
+  }
+
+  // _counts are the hardware events while the zone was open, if any
+  void leave(const int _idx, const double _secs, const double* const _counts = nullptr) {
+    Zone& z = zones[_idx];
+    z.step_secs += _secs;
+    z.run_secs += _secs;
+    ++z.step_calls;
+    ++z.run_calls;
+#ifdef USE_PERF_COUNTERS
+    if (_counts) {
+      for (size_t i=0; i<z.step_counts.size(); ++i) {
+        z.step_counts[i] += _counts[i];
+        z.run_counts[i] += _counts[i];
+      }
+    }
+#else
+    (void)_counts;
+#endif
+    current = z.parent;
+  }
+
+  // one call of an influence kernel, from any thread
+  void add_flops(const char* _kernel, const double _flops, const double _secs) {
+    std::lock_guard<std::mutex> lock(kmtx);
+    Kernel* kp = nullptr;
+    for (auto& k : kernels) {
+      if (k.name == _kernel or std::strcmp(k.name, _kernel) == 0) {
+        kp = &k;
+        break;
+      }
+    }
+    if (not kp) {
+      kernels.push_back(Kernel{_kernel});
+      kp = &kernels.back();
+    }
+    kp->step_flops += _flops;
+    kp->step_secs += _secs;
+    kp->run_flops += _flops;
+    kp->run_secs += _secs;
+  }
+
+  // the kernels in the current step, or in the last finished one
+  std::vector<Kernel> get_kernels() const {
+    std::lock_guard<std::mutex> lock(kmtx);
+    return kernels;
+  }
+  std::vector<Kernel> get_last_kernels() const {
+    std::lock_guard<std::mutex> lock(kmtx);
+    return last_kernels;
+  }
+
+  // the machine's peak, for the percent of peak; zero means unknown
+  // where the step thread's OpenMP team runs, as "cpu/node" per thread, see Numa.h
+  void set_placement(const std::string& _where) {
+    std::lock_guard<std::mutex> lock(kmtx);
+    placement = _where;
+  }
+
+  void set_peak_gflops(const double _peak) { peak_gflops = (_peak > 0.0) ? _peak : 0.0; }
+  double get_peak_gflops() const { return peak_gflops; }
+  double percent_of_peak(const double _gflops) const {
+    const double peak = peak_gflops;
+    return (peak > 0.0) ? 100.0 * _gflops / peak : 0.0;
+  }
+
+  // the zones so far, in the order they were first opened; only for the stepping thread
+  const std::vector<Zone>& get_zones() const { return zones; }
+
+  // a copy of the last finished step, safe from any thread
+  std::vector<Zone> get_last_step() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return last_step;
+  }
+
+  // names joined by dots, for status file columns
+  std::string get_path(const std::vector<Zone>& _zones, const int _idx) const {
+    std::string path = _zones[_idx].name;
+    for (int p = _zones[_idx].parent; p >= 0; p = _zones[p].parent) {
+      path = std::string(_zones[p].name) + "." + path;
+    }
+    return path;
+  }
+
+  // every zone after its parent and before its parent's next child, for drawing as a tree
+  static std::vector<int> tree_order(const std::vector<Zone>& _zones) {
+    std::vector<int> order;
+    order.reserve(_zones.size());
+    add_children(_zones, -1, order);
+    return order;
+  }
+
+  // a table of the whole run, children under their parents
+  void print_summary(const size_t _nsteps) const {
+    if (zones.empty()) return;
+    printf("\nTime spent over %ld steps\n", (long)_nsteps);
+    printf("  %-36s %12s %10s %12s %8s\n", "zone", "seconds", "calls", "sec/step", "parent%");
+    for (const int i : tree_order(zones)) {
+      const Zone& z = zones[i];
+      const std::string label = std::string(2*z.depth, ' ') + z.name;
+      const double per_step = (_nsteps > 0) ? z.run_secs / (double)_nsteps : 0.0;
+      if (z.parent >= 0 and zones[z.parent].run_secs > 0.0) {
+        printf("  %-36s %12.4f %10ld %12.6f %7.1f%%\n", label.c_str(), z.run_secs, (long)z.run_calls,
+               per_step, 100.0 * z.run_secs / zones[z.parent].run_secs);
+      } else {
+        printf("  %-36s %12.4f %10ld %12.6f\n", label.c_str(), z.run_secs, (long)z.run_calls, per_step);
+      }
+    }
+
+#ifdef USE_PERF_COUNTERS
+    // and what the hardware did in each
+    if (counters.any_open()) {
+      printf("\n  %-36s %12s %8s %10s %8s\n", "zone", "Gcycles", "IPC", "LLC MPKI", "vector%");
+      for (const int i : tree_order(zones)) {
+        const Zone& z = zones[i];
+        const std::string label = std::string(2*z.depth, ' ') + z.name;
+        printf("  %-36s %12.4f %8s %10s %8s\n", label.c_str(), 1.e-9*z.run_counts[PerfCounters::cycles],
+               counter_ratio(z.run_counts, ipc).c_str(), counter_ratio(z.run_counts, mpki).c_str(),
+               counter_ratio(z.run_counts, vector_pct).c_str());
+      }
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(kmtx);
+    if (not placement.empty()) printf("\n  threads on cpu/node: %s\n", placement.c_str());
+    if (kernels.empty()) return;
+    printf("\n  %-12s %12s %14s %10s\n", "kernel", "seconds", "Gflop", "GFlop/s");
+    for (const auto& k : kernels) {
+      if (peak_gflops > 0.0) {
+        printf("  %-12s %12.4f %14.3f %10.3f  (%.1f%% of peak)\n", k.name, k.run_secs, 1.e-9*k.run_flops,
+               k.run_gflops(), percent_of_peak(k.run_gflops()));
+      } else {
+        printf("  %-12s %12.4f %14.3f %10.3f\n", k.name, k.run_secs, 1.e-9*k.run_flops, k.run_gflops());
+      }
+    }
+  }
+
+  // after the summary, when the run ends
+  void reset() {
+    std::lock_guard<std::mutex> lock(mtx);
+    zones.clear();
+    last_step.clear();
+    current = -1;
+    step_zone = -1;
+    nsteps = 0;
+    std::lock_guard<std::mutex> klock(kmtx);
+    kernels.clear();
+    last_kernels.clear();
+  }
+
+#ifdef USE_PERF_COUNTERS
+  enum ratio_t { ipc, mpki, vector_pct };
+
+  // a ratio of a zone's counts as text, or a dash if its counters did not open
+  static std::string counter_ratio(const std::array<double,PerfCounters::num_counters>& _c, const ratio_t _r) {
+    double num = 0.0, den = 0.0, scale = 1.0;
+    switch (_r) {
+      case ipc: num = _c[PerfCounters::instructions]; den = _c[PerfCounters::cycles]; break;
+      case mpki: num = _c[PerfCounters::llc_misses]; den = _c[PerfCounters::instructions]; scale = 1000.0; break;
+      case vector_pct: num = _c[PerfCounters::fp_packed];
+                       den = _c[PerfCounters::fp_packed] + _c[PerfCounters::fp_scalar]; scale = 100.0; break;
+    }
+    if (den <= 0.0) return "-";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", scale * num / den);
+    return std::string(buf);
+  }
+#endif
+
+private:
+  // small numbers for the threads, in the order they first record
+  static int trace_tid() {
+    static std::atomic<int> next{1};
+    thread_local int tid = next.fetch_add(1);
+    return tid;
+  }
+
+  bool has_thread_name(const int _tid) {
+    std::lock_guard<std::mutex> lock(tmtx);
+    return has_thread_name_locked(_tid);
+  }
+  bool has_thread_name_locked(const int _tid) const {
+    for (const auto& tn : thread_names) if (tn.first == _tid) return true;
+    return false;
+  }
+
+  // the trace event json format, complete ("X") events and the thread names
+  void write_trace() {
+    std::lock_guard<std::mutex> lock(tmtx);
+    std::FILE* fp = std::fopen(trace_file.c_str(), "w");
+    if (not fp) {
+      printf("  could not write trace to %s\n", trace_file.c_str());
+      return;
+    }
+    std::fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto& tn : thread_names) {
+      std::fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                   first ? "" : ",\n", tn.first, tn.second.c_str());
+      first = false;
+    }
+    for (const auto& e : trace) {
+      std::fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                   first ? "" : ",\n", e.name, e.tid, e.ts, e.dur);
+      if (e.step >= 0) std::fprintf(fp, ",\"args\":{\"step\":%ld}", e.step);
+      std::fprintf(fp, "}");
+      first = false;
+    }
+    std::fprintf(fp, "\n]}\n");
+    std::fclose(fp);
+    printf("  wrote %ld trace events to %s\n", (long)trace.size(), trace_file.c_str());
+    trace.clear();
+  }
+
+  static void add_children(const std::vector<Zone>& _zones, const int _parent, std::vector<int>& _order) {
+    for (size_t i=0; i<_zones.size(); ++i) {
+      if (_zones[i].parent == _parent) {
+        _order.push_back((int)i);
+        add_children(_zones, (int)i, _order);
+      }
+    }
+  }
+
+  std::vector<Zone> zones;
+  std::vector<Zone> last_step;
+  int current = -1;
+  int step_zone = -1;
+  std::chrono::steady_clock::time_point step_start;
+  std::thread::id owner;
+  mutable std::mutex mtx;
+
+#ifdef USE_PERF_COUNTERS
+  PerfCounters counters;
+  std::array<double,PerfCounters::num_counters> step_counts0 = {};
+#endif
+
+  size_t nsteps = 0;
+  std::atomic<bool> tracing{false};
+  std::atomic<bool> trace_armed{false};
+  int trace_steps_left = 0;
+  std::string trace_file;
+  std::chrono::steady_clock::time_point trace_start;
+  std::vector<TraceEvent> trace;
+  std::vector<std::pair<int,std::string>> thread_names;
+  mutable std::mutex tmtx;
+
+  std::vector<Kernel> kernels;
+  std::vector<Kernel> last_kernels;
+  // set from the GUI or a loaded case while the step thread reports against it
+  std::atomic<double> peak_gflops = 0.0;
+  std::string placement;
+  mutable std::mutex kmtx;
+};
+
+
+// times its own scope
+class ProfileZone {
+public:
+  explicit ProfileZone(const char* _name)
+    : name(_name),
+      idx(Profiler::get().enter(_name)),
+      traced(Profiler::get().is_tracing()) {
+    if (idx >= 0 or traced) {
+#ifdef USE_PERF_COUNTERS
+      Profiler::get().read_counters(counts0.data());
+#endif
+      start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ProfileZone() {
+    if (traced) Profiler::get().add_trace(name, start, std::chrono::steady_clock::now());
+    if (idx >= 0) {
+      const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#ifdef USE_PERF_COUNTERS
+      std::array<double,PerfCounters::num_counters> now;
+      Profiler::get().read_counters(now.data());
+      for (size_t i=0; i<now.size(); ++i) now[i] -= counts0[i];
+      Profiler::get().leave(idx, secs, now.data());
+#else
+      Profiler::get().leave(idx, secs);
+#endif
+    }
+  }
+
+  ProfileZone(const ProfileZone&) = delete;
+  ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+  const char* name;
+  int idx;
+  bool traced;
+  std::chrono::steady_clock::time_point start;
+#ifdef USE_PERF_COUNTERS
+  std::array<double,PerfCounters::num_counters> counts0;
+#endif
+};
+
+#ifdef USE_PROFILER
+#define PROFILE_CONCAT_(a,b) a##b
+#define PROFILE_CONCAT(a,b) PROFILE_CONCAT_(a,b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_BEGIN_STEP() Profiler::get().begin_step()
+#define PROFILE_END_STEP() Profiler::get().end_step()
+#define PROFILE_FLOPS(kernel, flops, secs) Profiler::get().add_flops(kernel, flops, secs)
+#define PROFILE_OPEN_COUNTERS() Profiler::get().open_counters()
+#define PROFILE_START_TRACE(file, nsteps) Profiler::get().start_trace(file, nsteps)
+#define PROFILE_THREAD_NAME(name) Profiler::get().name_thread(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_BEGIN_STEP()
+#define PROFILE_END_STEP()
+#define PROFILE_FLOPS(kernel, flops, secs)
+#define PROFILE_OPEN_COUNTERS()
+#define PROFILE_START_TRACE(file, nsteps)
+#define PROFILE_THREAD_NAME(name)
+#endif
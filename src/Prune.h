@@ -0,0 +1,239 @@
+/*
+ * Prune.h - Leave the weakest particles out of the far field of velocity sums
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Kernels.h"
+#include "Points.h"
+#include "CellList.h"
+#include "ResultsType.h"
+#include "ExecEnv.h"
+#include "Logger.h"
+
+#include <json/json.hpp>
+
+#include <vector>
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+
+//
+// The VRM leaves many particles with tiny strengths, and each still costs a kernel
+//   evaluation per target. No core function induces more than |s|/(2 pi r), so if the
+//   particles left out of a sum hold at most 2 pi R tol of circulation, together they move
+//   a target farther than R from all of them by less than tol. Targets within R of one of
+//   them get its influence added back exactly, so nowhere is the error above tol.
+//
+// sources are dropped weakest first, and only when enough of them go to pay for the
+//   extra pass; images (periodic or mirrored) are never pruned
+//
+// each case keeps its SourcePruning settings in the ExecEnv
+//
+inline SourcePruning source_pruning_from_json(const nlohmann::json simj) {
+  SourcePruning sp;
+  if (simj.find("sourcePruning") == simj.end()) return sp;
+  const nlohmann::json j = simj["sourcePruning"];
+  sp.tolerance = j.value("tolerance", sp.tolerance);
+  sp.radius = j.value("radius", sp.radius);
+  std::cout << "  setting source pruning tolerance= " << sp.tolerance;
+  if (sp.radius > 0.0) std::cout << " and recovery radius= " << sp.radius;
+  std::cout << std::endl;
+  return sp;
+}
+
+inline void source_pruning_to_json(const SourcePruning& sp, nlohmann::json& simj) {
+  if (not sp.active()) return;
+  nlohmann::json j;
+  j["tolerance"] = sp.tolerance;
+  if (sp.radius > 0.0) j["radius"] = sp.radius;
+  simj["sourcePruning"] = j;
+}
+
+//
+// the kept and dropped halves of one source collection, and where to find the dropped ones
+//
+template <class S>
+struct PrunedSources {
+  uint32_t lineage = 0;		// the source these came from, and its state
+  uint32_t gen = 0;
+  SourcePruning params;		// under these settings
+  S radius = 0.0;
+  std::unique_ptr<Points<S>> kept;
+  std::array<Vector<S>,Dimensions> dx;
+  Vector<S> dr, ds;
+  CellList<S> cells;
+
+  bool pruned() const { return (bool)kept; }
+};
+
+//
+// the last few splits, so the other targets of the same sources reuse them; like TreeCache,
+//   temporary collections (stage copies, mpi shares) never come back, so the oldest go
+//
+template <class S>
+class PruneCache {
+public:
+  std::shared_ptr<const PrunedSources<S>> find(const Points<S>& _src, const SourcePruning& _sp) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto& ps : entries) {
+      if (ps->lineage == _src.get_lineage() and ps->gen == _src.get_state_gen() and ps->params == _sp) return ps;
+    }
+    return nullptr;
+  }
+
+  void put(std::shared_ptr<const PrunedSources<S>> _ps) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if ((*it)->lineage == _ps->lineage) {
+        entries.erase(it);
+        break;
+      }
+    }
+    entries.push_back(std::move(_ps));
+    while (entries.size() > max_entries) entries.pop_front();
+  }
+
+  static PruneCache& instance() {
+    static PruneCache cache;
+    return cache;
+  }
+
+private:
+  static constexpr size_t max_entries = 8;
+
+  std::deque<std::shared_ptr<const PrunedSources<S>>> entries;
+  std::mutex mtx;
+};
+
+//
+// split the sources, or make an empty split when it would not pay
+//
+template <class S>
+std::shared_ptr<const PrunedSources<S>> prune_sources (const Points<S>& _src, const SourcePruning& sp) {
+
+  const size_t n = _src.get_n();
+  if (not sp.active() or _src.is_inert() or n < sp.min_sources) return nullptr;
+
+  if (auto found = PruneCache<S>::instance().find(_src, sp)) return found;
+
+  const std::array<Vector<S>,Dimensions>& sx = _src.get_pos();
+  const Vector<S>& sr = _src.get_rad();
+  const Vector<S>& ss = _src.get_str();
+
+  auto ps = std::make_shared<PrunedSources<S>>();
+  ps->lineage = _src.get_lineage();
+  ps->gen = _src.get_state_gen();
+  ps->params = sp;
+  ps->radius = (sp.radius > 0.0) ? (S)sp.radius : (S)4.0 * *std::max_element(sr.begin(), sr.end());
+
+  // drop the weakest first, until their circulation fills the budget
+  std::vector<uint32_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&ss](const uint32_t a, const uint32_t b) { return std::abs(ss[a]) < std::abs(ss[b]); });
+  const double budget = 2.0 * M_PI * ps->radius * sp.tolerance;
+  double dropped = 0.0;
+  size_t ndrop = 0;
+  while (ndrop < n and dropped + std::abs(ss[order[ndrop]]) <= budget) dropped += std::abs(ss[order[ndrop++]]);
+
+  // when too few would go, keep an empty split so this is not tried again for this state
+  if (ndrop >= sp.min_fraction * n) {
+    std::vector<uint8_t> keep(n, 1);
+    for (size_t k=0; k<ndrop; ++k) keep[order[k]] = 0;
+
+    // the kept sources, in their original order
+    std::vector<S> kx, ks;
+    Vector<S> kr;
+    kx.reserve(Dimensions*(n-ndrop));
+    ks.reserve(n-ndrop);
+    kr.reserve(n-ndrop);
+    for (size_t i=0; i<n; ++i) {
+      if (keep[i]) {
+        kx.push_back(sx[0][i]);
+        kx.push_back(sx[1][i]);
+        ks.push_back(ss[i]);
+        kr.push_back(sr[i]);
+      } else {
+        ps->dx[0].push_back(sx[0][i]);
+        ps->dx[1].push_back(sx[1][i]);
+        ps->dr.push_back(sr[i]);
+        ps->ds.push_back(ss[i]);
+      }
+    }
+    ps->kept = std::make_unique<Points<S>>(ElementPacket<S>(kx, std::vector<Int>(), ks, n-ndrop, 0),
+                                           active, lagrangian, nullptr, 0.0);
+    ps->kept->get_rad() = kr;
+    ps->cells.build(ps->dx, ps->radius);
+
+    LOG_DEBUG("    pruned " << ndrop << " of " << n << " sources holding " << dropped << " circulation");
+  }
+
+  PruneCache<S>::instance().put(ps);
+  return ps;
+}
+
+//
+// add back the dropped sources near each target
+//
+template <class S, class A, VelCore C>
+void add_pruned_near (const PrunedSources<S>& _ps, Points<S>& _targ, const ResultsType& _restype) {
+
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(_targ).get_pos();
+  std::array<Vector<S>,Dimensions>&       tu = _targ.get_vel();
+  const bool thick = not _targ.is_inert();
+  const Vector<S>& tr = _targ.get_rad();
+  Vector<S>* const tw = _restype.compute_vort() ? &_targ.get_vort() : nullptr;
+  std::array<Vector<S>,4>* const tg = _restype.compute_grad() ? &_targ.get_velgrad() : nullptr;
+  const S rsq = _ps.radius * _ps.radius;
+  const std::array<Vector<S>,Dimensions>& dx = _ps.dx;
+
+  #pragma omp parallel
+  {
+  std::vector<std::pair<int32_t,S>> near;
+
+  #pragma omp for schedule(dynamic,256)
+  for (int32_t i=0; i<(int32_t)_targ.get_n(); ++i) {
+    _ps.cells.radius_search(tx[0][i], tx[1][i], rsq, near);
+    if (near.empty()) continue;
+
+    std::array<A,6> acc = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    for (const auto& nb : near) {
+      const size_t j = nb.first;
+      if (tg) {
+        if (thick) kernelug_0v_0b<S,A,C>(dx[0][j], dx[1][j], _ps.dr[j], _ps.ds[j], tx[0][i], tx[1][i], tr[i],
+                                         &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+        else       kernelug_0v_0p<S,A,C>(dx[0][j], dx[1][j], _ps.dr[j], _ps.ds[j], tx[0][i], tx[1][i],
+                                         &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+      } else if (tw) {
+        if (thick) kerneluw_0v_0b<S,A,C>(dx[0][j], dx[1][j], _ps.dr[j], _ps.ds[j], tx[0][i], tx[1][i], tr[i],
+                                         &acc[0], &acc[1], &acc[2]);
+        else       kerneluw_0v_0p<S,A,C>(dx[0][j], dx[1][j], _ps.dr[j], _ps.ds[j], tx[0][i], tx[1][i],
+                                         &acc[0], &acc[1], &acc[2]);
+      } else {
+        if (thick) kernelu_0v_0b<S,A,C>(dx[0][j], dx[1][j], _ps.dr[j], _ps.ds[j], tx[0][i], tx[1][i], tr[i],
+                                        &acc[0], &acc[1]);
+        else       kernelu_0v_0p<S,A,C>(dx[0][j], dx[1][j], _ps.dr[j], _ps.ds[j], tx[0][i], tx[1][i],
+                                        &acc[0], &acc[1]);
+      }
+    }
+
+    tu[0][i] += acc[0];
+    tu[1][i] += acc[1];
+    if (tw) (*tw)[i] += acc[2];
+    if (tg) for (size_t k=0; k<4; ++k) (*tg)[k][i] += acc[k+2];
+  }
+  }
+}
@@ -9,8 +9,10 @@
 
 #include "Omega2D.h"
 #include "VectorHelper.h"
+#include "Precision.h"
 #include "Points.h"
 #include "Surfaces.h"
+#include "Logger.h"
 
 #include <iostream>
 #include <vector>
@@ -20,7 +22,7 @@
 // No need to return anything because points currently cannot be reactive
 template <class S>
 std::vector<S> vels_to_rhs_points (Points<S> const& targ) {
-  std::cout << "    NOT converting vels to RHS vector for " << targ.to_string() << std::endl;
+  LOG_DEBUG("    NOT converting vels to RHS vector for " << targ.to_string());
 
   //auto start = std::chrono::system_clock::now();
   //float flops = 0.0;
@@ -40,7 +42,7 @@ std::vector<S> vels_to_rhs_points (Points<S> const& targ) {
 
 template <class S>
 std::vector<S> vels_to_rhs_panels (Surfaces<S> const& targ) {
-  std::cout << "    convert vels to RHS vector for" << targ.to_string() << std::endl;
+  LOG_DEBUG("    convert vels to RHS vector for" << targ.to_string());
 
   // pull references to the element arrays
   const std::array<Vector<S>,Dimensions>& tu = targ.get_vel();
@@ -95,7 +97,7 @@ std::vector<S> vels_to_rhs_panels (Surfaces<S> const& targ) {
 // No need to return anything because brick elems currently cannot be reactive
 template <class S>
 std::vector<S> vels_to_rhs_elems (Volumes<S> const& targ) {
-  std::cout << "    NOT converting vels to RHS vector for " << targ.to_string() << std::endl;
+  LOG_DEBUG("    NOT converting vels to RHS vector for " << targ.to_string());
 
   // size the return vector
   //size_t ntarg  = targ.get_nelems();
@@ -109,8 +111,8 @@ std::vector<S> vels_to_rhs_elems (Volumes<S> const& targ) {
 // helper struct for dispatching through a variant
 struct RHSVisitor {
   // source collection, target collection
-  std::vector<float> operator()(Points<float> const& targ)   { return vels_to_rhs_points<float>(targ); } 
-  std::vector<float> operator()(Surfaces<float> const& targ) { return vels_to_rhs_panels<float>(targ); } 
-  std::vector<float> operator()(Volumes<float> const& targ)  { return vels_to_rhs_elems<float>(targ); } 
+  std::vector<STORE> operator()(Points<STORE> const& targ)   { return vels_to_rhs_points<STORE>(targ); } 
+  std::vector<STORE> operator()(Surfaces<STORE> const& targ) { return vels_to_rhs_panels<STORE>(targ); } 
+  std::vector<STORE> operator()(Volumes<STORE> const& targ)  { return vels_to_rhs_elems<STORE>(targ); } 
 };
 
@@ -9,9 +9,15 @@
 
 #include "Core.h"
 #include "VectorHelper.h"
+#include "Profiler.h"
+#include "Logger.h"
+#include "Philox.h"
+#include "MpiHelper.h"
+#include "Checkpoint.h"
+
+#include <json/json.hpp>
 
 #include <cassert>
-#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
@@ -35,18 +41,26 @@ public:
   void diffuse_all(std::array<Vector<ST>,2>&,
                    const Vector<ST>&,
                    const Vector<ST>&,
-                   const ST);
+                   const ST,
+                   const double);
 
   void from_json(const nlohmann::json);
   void add_to_json(nlohmann::json&) const;
 
-private:
+  // a resumed run keeps drawing from the same seed
+  void write_state(CheckpointWriter& _out) const { _out.put(seed); }
+  void read_state(CheckpointReader& _in) { seed = _in.get<uint64_t>(); }
 
+private:
+  // the walks of a step are a function of this, the time and each particle, see diffuse_all
+  uint64_t seed;
 };
 
-// primary constructor
+// primary constructor, with the same seed on every MPI rank
 template <class ST>
-RVM<ST>::RVM() {}
+RVM<ST>::RVM()
+  : seed(mpi_shared_seed())
+  {}
 
 
 //
@@ -56,7 +70,8 @@ template <class ST>
 void RVM<ST>::diffuse_all(std::array<Vector<ST>,2>& pos,
                           const Vector<ST>& str,
                           const Vector<ST>& rad,
-                          const ST h_nu) {
+                          const ST h_nu,
+                          const double _time) {
 
   // make sure all vector sizes are identical
   assert(pos[0].size()==pos[1].size() && "Input arrays are not uniform size");
@@ -64,30 +79,25 @@ void RVM<ST>::diffuse_all(std::array<Vector<ST>,2>& pos,
   assert(str.size()==rad.size() && "Input arrays are not uniform size");
   const size_t n = rad.size();
 
-  std::cout << "  Running RVM with n " << n << std::endl;
-
-  // start timer
-  auto start = std::chrono::system_clock::now();
+  LOG_DEBUG("  Running RVM with n " << n);
+  PROFILE_ZONE("rvm");
 
-  // init the random number generator
-  std::random_device rd{};
-  std::mt19937 gen{rd()};
+  // each particle's walk comes from a counter-based generator keyed by the seed, with its
+  //   own position and strength and the time as the counter, so the result does not depend
+  //   on the order of the particles, the number of threads, or whether the run was resumed
+  const PhiloxKey key = philox_key(seed);
+  const uint32_t step = philox_bits(_time);
 
-  // create a normal distribution rng with mean 0 and std deviation h_nu
-  std::normal_distribution<ST> diffuse{0.0, h_nu};
+  #pragma omp parallel for if (n > 10000)
+  for (int32_t i=0; i<(int32_t)n; ++i) {
+    const PhiloxCtr ctr = {philox_bits(pos[0][i]), philox_bits(pos[1][i]), philox_bits(str[i]), step};
+    const PhiloxCtr u = philox4x32(ctr, key);
+    const std::array<ST,2> dx = philox_normal_pair<ST>(u[0], u[1]);
 
-  // for each particle (can parallelize this part)
-  // note that an OpenMP loop here will need to use int32_t as the counter variable type
-  for (size_t i=0; i<n; ++i) {
-    // apply the random walk
-    pos[0][i] += diffuse(gen);
-    pos[1][i] += diffuse(gen);
+    // apply the random walk, with std deviation h_nu
+    pos[0][i] += h_nu * dx[0];
+    pos[1][i] += h_nu * dx[1];
   }
-
-  // finish timer and report
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  printf("    rvm.diffuse_all:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
 }
 
 //
@@ -98,33 +108,22 @@ void RVM<ST>::diffuse_all(std::array<Vector<ST>,2>& pos,
 template <class ST>
 void RVM<ST>::from_json(const nlohmann::json simj) {
 
-  /*
   if (simj.find("RVM") != simj.end()) {
     nlohmann::json j = simj["RVM"];
 
-    if (j.find("ignoreBelow") != j.end()) {
-      ignore_thresh = j["ignoreBelow"];
-      std::cout << "  setting ignore_thresh= " << ignore_thresh << std::endl;
-    }
-
-    if (j.find("relativeThresholds") != j.end()) {
-      thresholds_are_relative = j["relativeThresholds"];
-      std::cout << "  setting thresholds_are_relative= " << thresholds_are_relative << std::endl;
+    if (j.find("seed") != j.end()) {
+      seed = j["seed"];
+      std::cout << "  setting rvm seed= " << seed << std::endl;
     }
   }
-  */
 }
 
 // create and write a json object for all diffusion parameters
 template <class ST>
 void RVM<ST>::add_to_json(nlohmann::json& simj) const {
 
-  /*
-  // set rvm-specific parameters
+  // set rvm-specific parameters, with the seed this run used, so it can be repeated
   nlohmann::json j;
-  j["ignoreBelow"] = ignore_thresh;
-  j["relativeThresholds"] = thresholds_are_relative;
+  j["seed"] = seed;
   simj["RVM"] = j;
-  */
 }
-
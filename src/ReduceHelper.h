@@ -0,0 +1,60 @@
+/*
+ * ReduceHelper.h - Sums which come out the same on any number of threads
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+
+//
+// Terms are summed in fixed blocks and the block sums are combined pairwise, so the order
+//   of every addition depends only on the number of terms; threads only decide who does
+//   which block. Pairwise sums also keep the error to O(log N) instead of O(N).
+//
+
+// fall back to the one-sided velocity sums, which reduce each target on a single thread,
+//   instead of the mutual sums whose per-thread accumulators depend on the thread count
+inline bool& reproducible_sums() {
+  static bool reproducible = false;
+  return reproducible;
+}
+
+static constexpr size_t reduce_block = 256;
+
+// pairwise sum of _in[0.._n)
+template <class A>
+A pairwise_sum(const A* const _in, const size_t _n) {
+  if (_n <= 8) {
+    A sum = 0.0;
+    for (size_t i=0; i<_n; ++i) sum += _in[i];
+    return sum;
+  }
+  const size_t half = _n / 2;
+  return pairwise_sum<A>(_in, half) + pairwise_sum<A>(_in+half, _n-half);
+}
+
+// sum of _term(i) over i in [0.._n)
+template <class A, class F>
+A reproducible_sum(const size_t _n, F _term) {
+  const size_t nblocks = (_n + reduce_block - 1) / reduce_block;
+  std::vector<A> blocksum(nblocks);
+
+  #pragma omp parallel for schedule(static) if (nblocks > 16)
+  for (int32_t b=0; b<(int32_t)nblocks; ++b) {
+    A terms[reduce_block];
+    const size_t i0 = b*reduce_block;
+    const size_t nb = std::min(reduce_block, _n-i0);
+    for (size_t i=0; i<nb; ++i) terms[i] = (A)_term(i0+i);
+    blocksum[b] = pairwise_sum<A>(terms, nb);
+  }
+
+  return pairwise_sum<A>(blocksum.data(), nblocks);
+}
+
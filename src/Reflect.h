@@ -10,10 +10,18 @@
 #include "Omega2D.h"
 #include "Points.h"
 #include "Surfaces.h"
+#include "CellList.h"
+#include "PanelTree.h"
+#include "Symmetry.h"
+#include "ReduceHelper.h"
+#include "Profiler.h"
+#include "Logger.h"
 
 #include <cstdlib>
 #include <limits>
+#include <algorithm>
 #include <vector>
+#include <utility>
 #include <cmath>
 
 enum ClosestType { panel, node };
@@ -100,20 +108,110 @@ ClosestReturn<S> panel_point_distance(const S sx0, const S sy0,
 
 
 //
-// naive caller for the O(N^2) panel-particle reflection kernel
+// the same distance from one point to a block of panels at once: every lane does all of the
+//   work and selects its answer, so the loop has no branches and vectorizes
+//
+// scratch arrays are kept between calls, so give each thread its own
+//
+template <class S>
+struct PanelDistances {
+  Vector<S> x0, y0, x1, y1;
+  Vector<S> distsq, cpx, cpy;
+  std::vector<int32_t> which;	// -1 for the panel, or 0 or 1 for a node, as jidx above
+
+  void compute(const std::array<Vector<S>,Dimensions>& _sx, const std::vector<Int>& _si,
+               const std::vector<int32_t>& _panels, const S _tx, const S _ty) {
+    const size_t n = _panels.size();
+    x0.resize(n); y0.resize(n); x1.resize(n); y1.resize(n);
+    distsq.resize(n); cpx.resize(n); cpy.resize(n); which.resize(n);
+
+    // gather the end nodes first, so the arithmetic reads contiguous memory
+    for (size_t k=0; k<n; ++k) {
+      const size_t j = _panels[k];
+      x0[k] = _sx[0][_si[2*j]];
+      y0[k] = _sx[1][_si[2*j]];
+      x1[k] = _sx[0][_si[2*j+1]];
+      y1[k] = _sx[1][_si[2*j+1]];
+      assert((x1[k]-x0[k])*(x1[k]-x0[k]) + (y1[k]-y0[k])*(y1[k]-y0[k]) != 0); // Can't divide by 0
+    }
+
+    #pragma omp simd
+    for (size_t k=0; k<n; ++k) {
+      const S bx = x1[k] - x0[k];
+      const S by = y1[k] - y0[k];
+      const S blensq = bx*bx + by*by;
+      const S ax = _tx - x0[k];
+      const S ay = _ty - y0[k];
+      const S t = (ax*bx + ay*by) / blensq;
+      const bool onpanel = (t > (S)0.0) & (t < (S)1.0);
+
+      const S cross = ay*bx - ax*by;
+      const S dpanel = cross*cross / blensq;
+      const S d0 = ax*ax + ay*ay;
+      const S d1 = (_tx-x1[k])*(_tx-x1[k]) + (_ty-y1[k])*(_ty-y1[k]);
+      const bool near0 = (d0 < d1);
+
+      distsq[k] = onpanel ? dpanel : (near0 ? d0 : d1);
+      cpx[k] = onpanel ? ((S)1.0-t)*x0[k] + t*x1[k] : (near0 ? x0[k] : x1[k]);
+      cpy[k] = onpanel ? ((S)1.0-t)*y0[k] + t*y1[k] : (near0 ? y0[k] : y1[k]);
+      which[k] = onpanel ? -1 : (near0 ? 0 : 1);
+    }
+  }
+};
+
+//
+// every panel or node tied for nearest to the point, in panel order, with jidx being the
+//   panel or node index, just as comparing panel_point_distance one panel at a time
+//
+template <class S>
+void nearest_hits(const std::array<Vector<S>,Dimensions>& _sx, const std::vector<Int>& _si,
+                  const std::vector<int32_t>& _panels, const S _tx, const S _ty,
+                  PanelDistances<S>& _pd, std::vector<ClosestReturn<S>>& _hits) {
+  _hits.clear();
+  if (_panels.empty()) return;
+  _pd.compute(_sx, _si, _panels, _tx, _ty);
+
+  const size_t n = _panels.size();
+  S mindist = std::numeric_limits<S>::max();
+  #pragma omp simd reduction(min:mindist)
+  for (size_t k=0; k<n; ++k) mindist = std::min(mindist, _pd.distsq[k]);
+
+  for (size_t k=0; k<n; ++k) {
+    // within round-off of the nearest is a tie, as in the one-at-a-time comparisons
+    if (_pd.distsq[k] > std::nextafter(mindist, std::numeric_limits<S>::max())) continue;
+    ClosestReturn<S> hit;
+    const size_t j = _panels[k];
+    if (_pd.which[k] < 0) {
+      hit.disttype = panel;
+      hit.jidx = j;
+    } else {
+      hit.disttype = node;
+      hit.jidx = _si[2*j+_pd.which[k]];
+    }
+    hit.distsq = _pd.distsq[k];
+    hit.cpx = _pd.cpx[k];
+    hit.cpy = _pd.cpy[k];
+    _hits.push_back(hit);
+  }
+}
+
+
+//
+// caller for the panel-particle reflection kernel, the panel tree finds the nearest panels
 //
 template <class S>
 void reflect_panp2 (Surfaces<S> const& _src, Points<S>& _targ) {
 
   //std::cout << "  inside reflect(Surfaces, Points)" << std::endl;
-  std::cout << "  Reflecting" << _targ.to_string() << " from near" << _src.to_string() << std::endl;
-  auto start = std::chrono::system_clock::now();
+  LOG_DEBUG("  Reflecting" << _targ.to_string() << " from near" << _src.to_string());
+  PROFILE_ZONE("reflect");
 
   // get handles for the vectors
   std::array<Vector<S>,Dimensions> const& sx = _src.get_pos();
   std::vector<Int> const&                 si = _src.get_idx();
   std::array<Vector<S>,Dimensions> const& sn = _src.get_norm();
   std::array<Vector<S>,Dimensions>&       tx = _targ.get_pos();
+  const PanelTree<S>&                  ptree = _src.get_panel_tree();
 
   // pre-compute the *node* normals
   std::array<Vector<S>,Dimensions> nn;
@@ -138,53 +236,27 @@ void reflect_panp2 (Surfaces<S> const& _src, Points<S>& _targ) {
   size_t num_reflected = 0;
   //const S eps = 10.0*std::numeric_limits<S>::epsilon();
 
-  #pragma omp parallel for reduction(+:num_reflected)
+  #pragma omp parallel reduction(+:num_reflected)
+  {
+  std::vector<int32_t> near;
+  std::vector<ClosestReturn<S>> hits;
+  PanelDistances<S> pd;
+
+  #pragma omp for
   for (int32_t i=0; i<(int32_t)_targ.get_n(); ++i) {
-    S mindist = std::numeric_limits<S>::max();
-    std::vector<ClosestReturn<S>> hits;
 
-    // iterate and search for closest panel
-    for (size_t j=0; j<_src.get_npanels(); ++j) {
-      const Int jp0 = si[2*j+0];
-      const Int jp1 = si[2*j+1];
-      ClosestReturn<S> result = panel_point_distance<S>(sx[0][jp0], sx[1][jp0],
-                                                        sx[0][jp1], sx[1][jp1],
-                                                        tx[0][i],   tx[1][i]);
-
-      //if (result.distsq < mindist - eps) {
-      if (result.distsq < std::nextafter(mindist,0.0)) {
-        // we blew the old one away
-        mindist = result.distsq;
-        if (result.disttype == node) {
-          result.jidx = si[2*j+result.jidx];
-        } else {
-          result.jidx = j;
-        }
-        hits.clear();
-        hits.push_back(result);
-        //std::cout << "  THIS BLOWS AWAY THE CLOSEST, AT " << std::sqrt(mindist) << std::endl;
-
-      //} else if (result.distsq < mindist + eps) {
-      } else if (result.distsq < std::nextafter(mindist, std::numeric_limits<S>::max())) {
-        // we are effectively the same as the old closest
-        if (result.disttype == node) {
-          result.jidx = si[2*j+result.jidx];
-        } else {
-          result.jidx = j;
-        }
-        hits.push_back(result);
-        //std::cout << "  THIS TIES THE CLOSEST, AT " << std::sqrt(mindist) << std::endl;
-      }
-    }
+    // search for closest panel or node, among those that could be
+    ptree.nearest_candidates(tx[0][i], tx[1][i], near);
+    nearest_hits<S>(sx, si, near, tx[0][i], tx[1][i], pd, hits);
 
     // dump out the hits
     if (false) {
-      std::cout << "point " << i << " is " << tx[0][i] << " " << tx[1][i] << std::endl;
+      LOG_DEBUG("point " << i << " is " << tx[0][i] << " " << tx[1][i]);
       for (auto & ahit: hits) {
         if (ahit.disttype == node) {
-          std::cout << "  node " << ahit.jidx << " is " << std::sqrt(ahit.distsq) << std::endl;
+          LOG_DEBUG("  node " << ahit.jidx << " is " << std::sqrt(ahit.distsq));
         } else {
-          std::cout << "  panel " << ahit.jidx << " is " << std::sqrt(ahit.distsq) << std::endl;
+          LOG_DEBUG("  panel " << ahit.jidx << " is " << std::sqrt(ahit.distsq));
         }
       }
     }
@@ -270,23 +342,52 @@ void reflect_panp2 (Surfaces<S> const& _src, Points<S>& _targ) {
       num_reflected++;
     }
   }
+  }
 
-  std::cout << "    reflected " << num_reflected << " particles" << std::endl;
-  const S flops = _targ.get_n() * (62.0 + 27.0*_src.get_npanels());
-
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-  printf("    reflect_panp2:\t[%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+  LOG_INFO("    reflected " << num_reflected << " particles");
 }
 
 
+//
+// particles which crossed a symmetry plane have swapped places with their images, so the one
+//   to keep is the image: back above the plane, with the opposite strength (field points keep
+//   their zero strength); returns the circulation this removed from the stored half
+//
+template <class S>
+S reflect_plane (Points<S>& _targ, const SymmetryPlane& sp) {
+
+  if (not sp.active() or _targ.get_movet() == fixed) return 0.0;
+
+  const Vector<S>& ty = std::as_const(_targ).get_pos()[1];
+  const S ylo = (S)sp.height;
+  if (std::none_of(ty.begin(), ty.end(), [=](const S _y) { return _y < ylo; })) return 0.0;
+
+  std::array<Vector<S>,Dimensions>& tx = _targ.get_pos();
+  const bool have_str = not _targ.is_inert();
+  S lost_circ = 0.0;
+  size_t num_reflected = 0;
+  for (size_t i=0; i<_targ.get_n(); ++i) {
+    if (tx[1][i] < ylo) {
+      tx[1][i] = sp.mirror<S>(tx[1][i]);
+      if (have_str) {
+        Vector<S>& ts = _targ.get_str();
+        lost_circ += 2.0 * ts[i];
+        ts[i] = -ts[i];
+      }
+      ++num_reflected;
+    }
+  }
+  LOG_DEBUG("    reflected " << num_reflected << " particles across the symmetry plane");
+  return lost_circ;
+}
+
 //
 // reflect interior particles to exterior because VRM only works in free space
 //
 template <class S>
 void reflect_interior(std::vector<Collection> const & _bdry,
-                      std::vector<Collection>&        _vort) {
+                      std::vector<Collection>&        _vort,
+                      const SymmetryPlane&            _sp) {
 
   // may need to do this multiple times to clear out concave zones!
   // this should only function when _vort is Points and _bdry is Surfaces
@@ -302,6 +403,9 @@ void reflect_interior(std::vector<Collection> const & _bdry,
           (void) reflect_panp2<S>(surf, pts);
         }
       }
+
+      // and out of the other half of a symmetric domain
+      (void) reflect_plane<S>(pts, _sp);
     }
   }
 }
@@ -378,7 +482,7 @@ std::vector<std::tuple<S,S,S>> init_cut_tables (const S _dx) {
 // use the cut tables - assume _pos is normalized by vdelta
 //
 template <class S>
-std::pair<S,S> get_cut_entry (std::vector<std::tuple<S,S,S>>& ct, const S _pos) {
+std::pair<S,S> get_cut_entry (const std::vector<std::tuple<S,S,S>>& ct, const S _pos) {
   // set defaults (change nothing)
   S smult = 1.0;
   S dshift = 0.0;
@@ -415,7 +519,7 @@ std::pair<S,S> get_cut_entry (std::vector<std::tuple<S,S,S>>& ct, const S _pos)
 
 
 //
-// naive caller for the O(N^2) panel-particle clear-inner-layer kernel
+// caller for the panel-particle clear-inner-layer kernel, the panel tree finds the nearest panels
 //
 // return value is the amount of circulation removed
 //
@@ -426,20 +530,20 @@ S clear_inner_panp2 (const int _method,
                      const S _cutoff_mult,
                      const S _ips) {
 
-  std::cout << "  Clearing" << _targ.to_string() << " from near" << _src.to_string() << std::endl;
-  auto start = std::chrono::system_clock::now();
+  LOG_DEBUG("  Clearing" << _targ.to_string() << " from near" << _src.to_string());
+  PROFILE_ZONE("clear inner");
 
-  static bool made_cut_tables = false;
-  static std::vector<std::tuple<S,S,S>> ct;
-  if (not made_cut_tables) {
-    ct = init_cut_tables<S>((S)0.1);
-    made_cut_tables = true;
-  }
+  // never changes, so every simulation can share it
+  static const std::vector<std::tuple<S,S,S>> ct = init_cut_tables<S>((S)0.1);
+
+  // index the targets before the handles below mark them as changed
+  const CellList<S>& cells = _targ.get_cell_list(_ips);
 
   // get handles for the vectors
   std::array<Vector<S>,Dimensions> const& sx = _src.get_pos();
   std::vector<Int> const&                 si = _src.get_idx();
   std::array<Vector<S>,Dimensions> const& sn = _src.get_norm();
+  const PanelTree<S>&                  ptree = _src.get_panel_tree();
 
   std::array<Vector<S>,Dimensions>&       tx = _targ.get_pos();
   Vector<S>&                              ts = _targ.get_str();
@@ -467,70 +571,57 @@ S clear_inner_panp2 (const int _method,
   if (_method==0 and not are_fldpts) {
     S this_circ = 0.0;
     for (int32_t i=0; i<(int32_t)_targ.get_n(); ++i) this_circ += ts[i];
-    std::cout << "    circulation before: " << this_circ << std::endl;
+    LOG_DEBUG("    circulation before: " << this_circ);
   }
 
   size_t num_cropped = 0;
   S circ_removed = 0.0;
+  std::vector<S> removed(_method == 0 ? _targ.get_n() : 0, 0.0);
   //const S eps = 10.0*std::numeric_limits<S>::epsilon();
 
   // create array of flags - any moved particle will be tested again
-  std::vector<bool> untested;
-  untested.assign(_targ.get_n(), true);
+  //   but only particles near the body can be under the cutoff layer: this margin is
+  //   generous, because the mean normal at a sharp corner can be far from the particle's
+  //   (bytes, not bits, since threads clear their own flags at once)
+  std::vector<uint8_t> untested;
+  untested.assign(_targ.get_n(), false);
+  if (_src.get_n() > 0) {
+    const S maxrad = are_fldpts ? _ips : *std::max_element(tr.begin(), tr.end());
+    const S margin = 10.0 * (_cutoff_mult*_ips + maxrad);
+    const auto [xmin, xmax] = std::minmax_element(sx[0].begin(), sx[0].end());
+    const auto [ymin, ymax] = std::minmax_element(sx[1].begin(), sx[1].end());
+    cells.for_each_in_box(*xmin-margin, *xmax+margin, *ymin-margin, *ymax+margin,
+                          [&](const int32_t i) { untested[i] = true; });
+  }
 
   // iterate more than once to make sure particles get cleared from corners
-  while (std::any_of(untested.begin(), untested.end(), [](bool x){return x;})) {
+  while (std::any_of(untested.begin(), untested.end(), [](uint8_t x){return x;})) {
+
+    #pragma omp parallel reduction(+:num_cropped)
+    {
+    std::vector<int32_t> near;
+    std::vector<ClosestReturn<S>> hits;
+    PanelDistances<S> pd;
 
-    #pragma omp parallel for reduction(+:num_cropped,circ_removed)
+    #pragma omp for
     for (int32_t i=0; i<(int32_t)_targ.get_n(); ++i) {
 
       if (untested[i]) {
 
-        //S mindist = std::numeric_limits<S>::max();
-        S mindist = 0.1*std::numeric_limits<S>::max();
-        std::vector<ClosestReturn<S>> hits;
-
-        // iterate and search for closest panel/node
-        for (size_t j=0; j<_src.get_npanels(); ++j) {
-          ClosestReturn<S> result = panel_point_distance<S>(sx[0][si[2*j]],   sx[1][si[2*j]],
-                                                            sx[0][si[2*j+1]], sx[1][si[2*j+1]],
-                                                            tx[0][i],         tx[1][i]);
-
-          //if (result.distsq < mindist - eps) {
-          if (result.distsq < std::nextafter(mindist,0.0)) {
-            // we blew the old one away
-            mindist = result.distsq;
-            if (result.disttype == node) {
-              result.jidx = si[2*j+result.jidx];
-            } else {
-              result.jidx = j;
-            }
-            hits.clear();
-            hits.push_back(result);
-            //std::cout << "  THIS BLOWS AWAY THE CLOSEST, AT " << std::sqrt(mindist) << std::endl;
-
-          } else if (result.distsq < std::nextafter(mindist, std::numeric_limits<S>::max())) {
-            // we are effectively the same as the old closest
-            if (result.disttype == node) {
-              result.jidx = si[2*j+result.jidx];
-            } else {
-              result.jidx = j;
-            }
-            hits.push_back(result);
-            //std::cout << "  THIS TIES THE CLOSEST, AT " << std::sqrt(mindist) << std::endl;
-          }
-        } // end of loop over panels
+        // search for closest panel or node, among those that could be
+        ptree.nearest_candidates(tx[0][i], tx[1][i], near);
+        nearest_hits<S>(sx, si, near, tx[0][i], tx[1][i], pd, hits);
 
         // dump out the hits
         if (false) {
-          std::cout << "point " << i << " is " << tx[0][i] << " " << tx[1][i] << std::endl;
+          LOG_DEBUG("point " << i << " is " << tx[0][i] << " " << tx[1][i]);
           for (auto & ahit: hits) {
             if (ahit.disttype == node) {
-              std::cout << "  node " << ahit.jidx << " dist " << std::sqrt(ahit.distsq) << std::endl;
-              std::cout << "    cp is " << ahit.cpx << " " << ahit.cpy << std::endl;
+              LOG_DEBUG("  node " << ahit.jidx << " dist " << std::sqrt(ahit.distsq));
+              LOG_DEBUG("    cp is " << ahit.cpx << " " << ahit.cpy);
             } else {
-              std::cout << "  panel " << ahit.jidx << " dist " << std::sqrt(ahit.distsq) << std::endl;
-              std::cout << "    cp is " << ahit.cpx << " " << ahit.cpy << std::endl;
+              LOG_DEBUG("  panel " << ahit.jidx << " dist " << std::sqrt(ahit.distsq));
+              LOG_DEBUG("    cp is " << ahit.cpx << " " << ahit.cpy);
             }
           }
         }
@@ -593,7 +684,7 @@ S clear_inner_panp2 (const int _method,
               const std::pair<S,S> entry = get_cut_entry(ct, dotp/this_radius);
 
               // ensure that this "reabsorbed" circulation is accounted for in BEM
-              circ_removed += ts[i] * (1.0-std::get<0>(entry));
+              removed[i] += ts[i] * (1.0-std::get<0>(entry));
 
               // modify the particle in question
               ts[i] *= std::get<0>(entry);
@@ -627,31 +718,27 @@ S clear_inner_panp2 (const int _method,
 
       } // end if (untested)
     } // end loop over particles
+    } // end parallel region
   } // end loop over iterations
 
+  // add these up in a fixed order, so the total does not depend on the thread count
+  if (_method == 0) circ_removed = (S)reproducible_sum<double>(removed.size(), [&removed](const size_t i) { return removed[i]; });
+
   // we did not resize the x array, so we don't need to touch the u array
 
   if (_method == 0) {
-    std::cout << "    cropped " << num_cropped << " particles" << std::endl;
+    LOG_INFO("    cropped " << num_cropped << " particles");
   } else if (_method == 1) {
-    std::cout << "    pushed " << num_cropped << " particles" << std::endl;
+    LOG_INFO("    pushed " << num_cropped << " particles");
   }
 
   if (_method==0 and not are_fldpts) {
     S this_circ = 0.0;
     for (int32_t i=0; i<(int32_t)_targ.get_n(); ++i) this_circ += ts[i];
-    std::cout << "    circulation after: " << this_circ << std::endl;
-    std::cout << "    removed: " << circ_removed << std::endl;
+    LOG_DEBUG("    circulation after: " << this_circ);
+    LOG_DEBUG("    removed: " << circ_removed);
   }
 
-  // flops count here is taken from reflect - might be different here
-  const S flops = (_targ.get_n()+num_cropped) * (62.0 + 27.0*_src.get_npanels());
-
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
-  printf("    clear_inner_panp2:\t[%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
-
   return circ_removed;
 }
 
@@ -664,7 +751,8 @@ void clear_inner_layer(const int                _method,
                        std::vector<Collection>& _bdry,
                        std::vector<Collection>& _vort,
                        const S                  _cutoff_factor,
-                       const S                  _ips) {
+                       const S                  _ips,
+                       const SymmetryPlane&     _sp) {
 
   // may need to do this multiple times to clear out concave zones!
   // this should only function when _vort is Points and _bdry is Surfaces
@@ -686,6 +774,8 @@ void clear_inner_layer(const int                _method,
             surf.add_to_reabsorbed(lost_circ);
           }
         }
+
+        (void) reflect_plane<S>(pts, _sp);
       }
     }
 
@@ -10,7 +10,9 @@
 
 #include "ShaderHelper.h"
 
+#ifndef USE_EGL
 #include <GLFW/glfw3.h>
+#endif
 
 #include <vector>
 #include <iostream>
@@ -32,6 +34,19 @@ const std::string part_frag_shader_source =
 #include "shaders/particle.frag"
 ;
 
+const std::string density_vert_shader_source =
+#include "shaders/density.vert"
+;
+const std::string density_frag_shader_source =
+#include "shaders/density.frag"
+;
+const std::string composite_vert_shader_source =
+#include "shaders/composite.vert"
+;
+const std::string composite_frag_shader_source =
+#include "shaders/composite.frag"
+;
+
 const std::string surfline_vert_shader_source =
 #include "shaders/surfaceline.vert"
 ;
@@ -39,6 +54,13 @@ const std::string surfline_frag_shader_source =
 #include "shaders/surfaceline.frag"
 ;
 
+const std::string ptvel_comp_shader_source =
+#include "shaders/ptvel.comp"
+;
+const std::string panvel_comp_shader_source =
+#include "shaders/panvel.comp"
+;
+
 
 // Compile a shader
 GLuint load_and_compile_shader(const std::string shader_src, GLenum shaderType) {
@@ -59,7 +81,9 @@ GLuint load_and_compile_shader(const std::string shader_src, GLenum shaderType)
     std::vector<char> compilation_log(512);
     glGetShaderInfoLog(shader, compilation_log.size(), nullptr, &compilation_log[0]);
     std::cerr << &compilation_log[0] << std::endl;
+#ifndef USE_EGL
     glfwTerminate();
+#endif
     exit(-1);
   } else {
     std::cerr << "Shader compilation successful" << std::endl;
@@ -113,6 +137,41 @@ GLuint create_draw_point_program() {
 }
 
 
+// Create a program to sum particle strengths into a texture, one pixel each; its inputs must
+//   sit where the blob program's do, as both draw from one vertex array
+GLuint create_draw_density_program(const GLuint _blob_prog) {
+  // Load and compile the vertex and fragment shaders
+  GLuint vertexShader = load_and_compile_shader(density_vert_shader_source, GL_VERTEX_SHADER);
+  GLuint fragmentShader = load_and_compile_shader(density_frag_shader_source, GL_FRAGMENT_SHADER);
+
+  // Attach the above shader to a program
+  GLuint shaderProgram = glCreateProgram();
+  glAttachShader(shaderProgram, vertexShader);
+  glAttachShader(shaderProgram, fragmentShader);
+
+  // Flag the shaders for deletion
+  glDeleteShader(vertexShader);
+  glDeleteShader(fragmentShader);
+
+  for (const char* name : {"px", "py", "rad", "sx"}) {
+    const GLint loc = glGetAttribLocation(_blob_prog, name);
+    if (loc >= 0) glBindAttribLocation(shaderProgram, (GLuint)loc, name);
+  }
+
+  // Link and use the program
+  glLinkProgram(shaderProgram);
+  glUseProgram(shaderProgram);
+
+  return shaderProgram;
+}
+
+
+// Create a program to color the screen from such a texture
+GLuint create_draw_composite_program() {
+  return create_vertfrag_prog(composite_vert_shader_source, composite_frag_shader_source);
+}
+
+
 // Create a program from two shaders to render panels
 GLuint create_draw_surface_line_prog() {
   // Load and compile the vertex and fragment shaders
@@ -167,3 +226,39 @@ GLuint create_vertfrag_prog(const std::string vert_shader_src,
   return shaderProgram;
 }
 
+
+// Create a program from one compute shader
+GLuint create_compute_prog(const std::string comp_shader_src) {
+
+  // Load and compile the compute shader
+  GLuint computeShader = load_and_compile_shader(comp_shader_src, GL_COMPUTE_SHADER);
+
+  // Attach the above shader to a program
+  GLuint shaderProgram = glCreateProgram();
+  glAttachShader(shaderProgram, computeShader);
+
+  // Flag the shader for deletion
+  glDeleteShader(computeShader);
+
+  // Link the program
+  glLinkProgram(shaderProgram);
+  int success;
+  char infoLog[512];
+  glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+  if (!success) {
+    glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+    std::cout << "ERROR: Compute program linking failed\n" << infoLog << std::endl;
+  }
+
+  return shaderProgram;
+}
+
+// Create a program to find velocity (and vorticity) from particles
+GLuint create_ptvel_compute_prog() {
+  return create_compute_prog(ptvel_comp_shader_source);
+}
+
+// Create a program to find velocity from vortex and source panels
+GLuint create_panvel_compute_prog() {
+  return create_compute_prog(panvel_comp_shader_source);
+}
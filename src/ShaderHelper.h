@@ -27,8 +27,13 @@
 // Create a render program from two shaders (vertex and fragment)
 GLuint create_draw_blob_program();
 GLuint create_draw_point_program();
+GLuint create_draw_density_program(const GLuint);
+GLuint create_draw_composite_program();
 GLuint create_draw_surface_line_prog();
 GLuint create_vertfrag_prog(const std::string, const std::string);
 //GLuint create_vertgeomfrag_prog(const std::string, const std::string, const std::string);
 
 // Create a compute program from one shader
+GLuint create_ptvel_compute_prog();
+GLuint create_panvel_compute_prog();
+GLuint create_compute_prog(const std::string);
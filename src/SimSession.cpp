@@ -0,0 +1,189 @@
+/*
+ * SimSession.cpp - One simulation for a program which embeds the solver (libomega2d)
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "SimSession.h"
+#include "JsonHelper.h"
+
+#ifdef _WIN32
+  #include <ciso646>
+#endif
+
+#include <mutex>
+#include <variant>
+#include <exception>
+
+// make the starting elements from every feature, returns any error
+std::string init_features(Simulation& sim,
+                          std::vector<std::unique_ptr<FlowFeature>>& ffeatures,
+                          std::vector<std::unique_ptr<BoundaryFeature>>& bfeatures,
+                          std::vector<std::unique_ptr<MeasureFeature>>& mfeatures,
+                          const RenderParams& rparams) {
+
+  // initialize particle distributions
+  for (auto const& ff: ffeatures) {
+    if (ff->is_enabled()) {
+      ElementPacket<float> newpacket = ff->init_elements(sim.get_ips());
+      // echo any errors
+      /*if (good)*/ sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
+    }
+  }
+
+  // initialize solid objects
+  for (auto const& bf : bfeatures) {
+    if (bf->is_enabled()) {
+      ElementPacket<float> newpacket = bf->init_elements(sim.get_ips());
+      const move_t newmovetype = (bf->get_body() ? bodybound : fixed);
+      sim.add_elements(newpacket, reactive, newmovetype, bf->get_body() );
+    }
+  }
+
+  // initialize measurement features
+  for (auto const& mf: mfeatures) {
+    if (mf->is_enabled()) {
+      const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
+      sim.add_elements( mf->init_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body() );
+    }
+  }
+
+  sim.set_initialized();
+
+  // check init for blow-up or errors
+  return sim.check_initialization();
+}
+
+// and the new elements from emitters, before each step
+void step_features(Simulation& sim,
+                   std::vector<std::unique_ptr<FlowFeature>>& ffeatures,
+                   std::vector<std::unique_ptr<MeasureFeature>>& mfeatures,
+                   const RenderParams& rparams) {
+
+  // generate new particles from emitters
+  for (auto const& ff: ffeatures) {
+    if (ff->is_enabled()) {
+      ElementPacket<float> newpacket = ff->step_elements(sim.get_ips());
+      // echo any errors
+      sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
+    }
+  }
+
+  for (auto const& mf: mfeatures) {
+    if (mf->is_enabled()) {
+      const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
+      sim.add_elements( mf->step_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body() );
+    }
+  }
+}
+
+
+SimSession::~SimSession() {
+  (void) wait();
+}
+
+std::string SimSession::load(const nlohmann::json& _j) {
+  // the features draw from shared random generators, so only one session sets up at a time
+  static std::mutex setup_mtx;
+  std::lock_guard<std::mutex> lock(setup_mtx);
+
+  try {
+    parse_json(sim, ffeatures, bfeatures, mfeatures, rparams, _j);
+    error = init_features(sim, ffeatures, bfeatures, mfeatures, rparams);
+  } catch (const std::exception& e) {
+    error = e.what();
+  }
+  return error;
+}
+
+std::shared_future<void> SimSession::start_step() {
+  if (running) return sim.get_step_future();
+  if (error.empty()) error = sim.check_simulation();
+  if (not error.empty()) return std::shared_future<void>();
+
+  step_features(sim, ffeatures, mfeatures, rparams);
+  sim.async_step();
+  running = true;
+  return sim.get_step_future();
+}
+
+bool SimSession::poll() {
+  if (not running) return true;
+  try {
+    running = not sim.test_for_new_results();
+  } catch (const std::exception& e) {
+    running = false;
+    error = e.what();
+  }
+  return not running;
+}
+
+std::string SimSession::wait() {
+  if (running) {
+    sim.get_step_future().wait();
+    (void) poll();
+  }
+  return error;
+}
+
+bool SimSession::done() {
+  (void) wait();
+  return sim.test_vs_stop();
+}
+
+double SimSession::get_time() {
+  (void) wait();
+  return sim.get_time();
+}
+
+size_t SimSession::get_nstep() {
+  (void) wait();
+  return sim.get_nstep();
+}
+
+std::vector<ElementView> SimSession::particles() {
+  (void) wait();
+  return views(sim.get_vort());
+}
+
+std::vector<ElementView> SimSession::boundaries() {
+  (void) wait();
+  return views(sim.get_bdry());
+}
+
+std::vector<ElementView> SimSession::field_points() {
+  (void) wait();
+  return views(sim.get_fldpt());
+}
+
+std::vector<ElementView> SimSession::views(const std::vector<Collection>& _colls) {
+  std::vector<ElementView> vlist;
+  for (const auto& coll : _colls) {
+    ElementView v;
+    std::visit([&v](const auto& elem) {
+      v.elemt = elem.get_elemt();
+      v.movet = elem.get_movet();
+      v.n = elem.get_n();
+      for (size_t d=0; d<Dimensions; ++d) {
+        v.x[d] = elem.get_pos()[d].data();
+        v.u[d] = elem.get_vel()[d].data();
+      }
+    }, coll);
+
+    if (std::holds_alternative<Points<STORE>>(coll)) {
+      const Points<STORE>& pts = std::get<Points<STORE>>(coll);
+      if (not pts.is_inert()) {
+        v.str = pts.get_str().data();
+        v.rad = pts.get_rad().data();
+      }
+    } else if (std::holds_alternative<Surfaces<STORE>>(coll)) {
+      const Surfaces<STORE>& surf = std::get<Surfaces<STORE>>(coll);
+      v.npanels = surf.get_npanels();
+      v.idx = surf.get_idx().data();
+      v.str = surf.get_str().data();
+    }
+    vlist.push_back(v);
+  }
+  return vlist;
+}
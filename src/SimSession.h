@@ -0,0 +1,108 @@
+/*
+ * SimSession.h - One simulation for a program which embeds the solver (libomega2d)
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Simulation.h"
+#include "FlowFeature.h"
+#include "BoundaryFeature.h"
+#include "MeasureFeature.h"
+#include "RenderParams.h"
+
+#include <json/json.hpp>
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <future>
+
+
+// make the starting elements from every feature, returns any error
+std::string init_features(Simulation&,
+                          std::vector<std::unique_ptr<FlowFeature>>&,
+                          std::vector<std::unique_ptr<BoundaryFeature>>&,
+                          std::vector<std::unique_ptr<MeasureFeature>>&,
+                          const RenderParams&);
+
+// and the new elements from emitters, before each step
+void step_features(Simulation&,
+                   std::vector<std::unique_ptr<FlowFeature>>&,
+                   std::vector<std::unique_ptr<MeasureFeature>>&,
+                   const RenderParams&);
+
+//
+// the arrays of one collection, pointing into the simulation's own storage, so they are
+//   only good until the next step starts or the session goes away
+//
+struct ElementView {
+  elem_t elemt = inert;
+  move_t movet = fixed;
+  size_t n = 0;					// particles, or nodes of panels
+  size_t npanels = 0;				// panels, for boundaries
+  const Int* idx = nullptr;			// two nodes per panel
+  std::array<const STORE*,Dimensions> x = {nullptr, nullptr};
+  std::array<const STORE*,Dimensions> u = {nullptr, nullptr};	// at particles, or at panels
+  const STORE* str = nullptr;			// at particles or panels, unless inert
+  const STORE* rad = nullptr;			// core radii of vortex particles
+};
+
+//
+// A simulation set up from the same json as the programs read, stepped on the solver's own
+//   thread while the caller does something else:
+//
+//   SimSession sess;
+//   std::string err = sess.load(read_json("case.json"));
+//   while (err.empty() and not sess.done()) {
+//     std::shared_future<void> running = sess.start_step();
+//     ...                                  // other work, or sess.poll() now and then
+//     err = sess.wait();
+//     for (const ElementView& v : sess.particles()) ...
+//   }
+//
+// steps of every session run on ThreadPool::stepper(), so those of two sessions take turns
+//
+class SimSession {
+public:
+  SimSession() = default;
+  ~SimSession();
+
+  // set up from a case, returns any error
+  std::string load(const nlohmann::json&);
+
+  // check the last step and start the next, unless one is running; the future is ready
+  //   when the step ends, and rethrows anything it threw
+  std::shared_future<void> start_step();
+
+  // has the running step finished; and wait for it, returning any error
+  bool poll();
+  std::string wait();
+
+  // has the case reached its end time or step count
+  bool done();
+
+  Simulation& get_sim() { return sim; }
+  double get_time();
+  size_t get_nstep();
+
+  // the element arrays, after waiting for any running step
+  std::vector<ElementView> particles();
+  std::vector<ElementView> boundaries();
+  std::vector<ElementView> field_points();
+
+private:
+  std::vector<ElementView> views(const std::vector<Collection>&);
+
+  Simulation sim;
+  std::vector<std::unique_ptr<FlowFeature>> ffeatures;
+  std::vector<std::unique_ptr<BoundaryFeature>> bfeatures;
+  std::vector<std::unique_ptr<MeasureFeature>> mfeatures;
+  RenderParams rparams;
+
+  bool running = false;
+  std::string error;
+};
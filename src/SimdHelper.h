@@ -0,0 +1,125 @@
+/*
+ * SimdHelper.h - Portable SIMD types for influence calculations, an alternative to Vc
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "VectorHelper.h"
+
+#include <string>
+#include <vector>
+
+#ifdef USE_STDSIMD
+#include <experimental/simd>
+
+namespace stdx = std::experimental;
+
+// the widest vector supported by the compile target (SSE, AVX2, AVX-512, NEON, ...)
+template <class S> using SimdVec = stdx::native_simd<S>;
+
+// a padded array of SIMD vectors (std::vector respects the over-alignment in C++17)
+template <class S> using SimdMemory = std::vector<SimdVec<S>>;
+
+// use this to convert a std::vector<S> to an array of SIMD vectors, padding with defaultval
+template <class S>
+inline SimdMemory<S> stdvec_to_simdvec (const Vector<S>& in, const S defaultval) {
+  constexpr size_t vsize = SimdVec<S>::size();
+  const size_t nvec = (in.size() + vsize - 1) / vsize;
+  SimdMemory<S> out(nvec, SimdVec<S>(defaultval));
+  for (size_t i=0; i<nvec; ++i) {
+    const size_t ifirst = i*vsize;
+    if (ifirst+vsize <= in.size()) {
+      out[i].copy_from(in.data()+ifirst, stdx::element_aligned);
+    } else {
+      for (size_t j=ifirst; j<in.size(); ++j) out[i][j-ifirst] = in[j];
+    }
+  }
+  return out;
+}
+
+// horizontal sum
+template <class S>
+inline S simd_sum (const SimdVec<S>& in) {
+  return stdx::reduce(in);
+}
+
+// one accumulator of type A per lane of SimdVec<S>, which the kernels add SimdVec<S> results
+//   into, as Vc's SimdArray<A,N> does in the Vc path
+template <class S, class A>
+class SimdAccum {
+public:
+  typedef stdx::fixed_size_simd<A, SimdVec<S>::size()> AccVec;
+
+  SimdAccum() = default;
+  SimdAccum(const A _a) : v(_a) {}
+  SimdAccum(const AccVec& _v) : v(_v) {}
+  SimdAccum(const SimdVec<S>& _x) : v(stdx::static_simd_cast<AccVec>(_x)) {}
+
+  SimdAccum& operator+=(const SimdVec<S>& _x) { v += stdx::static_simd_cast<AccVec>(_x); return *this; }
+  SimdAccum& operator-=(const SimdVec<S>& _x) { v -= stdx::static_simd_cast<AccVec>(_x); return *this; }
+  SimdAccum& operator+=(const SimdAccum& _x) { v += _x.v; return *this; }
+  SimdAccum& operator-=(const SimdAccum& _x) { v -= _x.v; return *this; }
+  friend SimdAccum operator+(const SimdAccum& _a, const SimdAccum& _b) { return SimdAccum(_a.v + _b.v); }
+  friend SimdAccum operator-(const SimdAccum& _a, const SimdAccum& _b) { return SimdAccum(_a.v - _b.v); }
+
+  A sum() const { return stdx::reduce(v); }
+  static constexpr size_t size() { return AccVec::size(); }
+  A operator[](const size_t _i) const { return v[_i]; }
+
+private:
+  AccVec v;
+};
+
+// libstdc++ evaluates stdx::atan2 one lane at a time, so use a vectorized polynomial instead
+//   (Cephes atanf range reduction, good to float precision)
+template <class V>
+inline V simd_atan2 (const V y, const V x) {
+  using T = typename V::value_type;
+  const V ax = stdx::abs(x);
+  const V ay = stdx::abs(y);
+  V t = ay / ax;
+  V base(T(0.0));
+  const auto big = t > V(T(2.414213562373095));
+  const auto mid = (t > V(T(0.4142135623730950))) && !big;
+  stdx::where(mid, base) = V(T(0.25*M_PI));
+  stdx::where(mid, t) = (t - V(T(1.0))) / (t + V(T(1.0)));
+  stdx::where(big, base) = V(T(0.5*M_PI));
+  stdx::where(big, t) = V(T(-1.0)) / t;
+  const V z = t * t;
+  V ret = V(T(8.05374449538e-2));
+  ret = ret*z - V(T(1.38776856032e-1));
+  ret = ret*z + V(T(1.99777106478e-1));
+  ret = ret*z - V(T(3.33329491539e-1));
+  ret = base + ret*z*t + t;
+  // quadrants, and atan2(0,0)=0 like the scalar version
+  stdx::where(x < V(T(0.0)), ret) = V(T(M_PI)) - ret;
+  stdx::where(y < V(T(0.0)), ret) = -ret;
+  stdx::where(ax == V(T(0.0)) && ay == V(T(0.0)), ret) = V(T(0.0));
+  return ret;
+}
+#endif
+
+//
+// describe the vector instructions this binary was built for, and which the cpu supports
+//
+inline std::string simd_isa_string () {
+  std::string mystr;
+#ifdef USE_STDSIMD
+  mystr += "using " + std::to_string(8*sizeof(SimdVec<float>)) + "-bit vectors";
+#else
+  mystr += "not using portable SIMD";
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  if (__builtin_cpu_supports("avx512f")) mystr += ", cpu supports AVX-512";
+  else if (__builtin_cpu_supports("avx2")) mystr += ", cpu supports AVX2";
+  else if (__builtin_cpu_supports("avx")) mystr += ", cpu supports AVX";
+  else if (__builtin_cpu_supports("sse4.2")) mystr += ", cpu supports SSE4.2";
+#elif defined(__ARM_NEON)
+  mystr += ", cpu supports NEON";
+#endif
+  return mystr;
+}
+
@@ -7,16 +7,28 @@
 
 #include "Simulation.h"
 #include "Reflect.h"
+#include "Periodic.h"
+#include "Symmetry.h"
+#include "Prune.h"
+#include "Numa.h"
 #include "BEMHelper.h"
 #include "GuiHelper.h"
+#include "MpiHelper.h"
+#include "Philox.h"
+#include "ReduceHelper.h"
+#include "Profiler.h"
+#include "Logger.h"
 #ifdef HOFORTRAN
 #include "hofortran_interface.h"
 #endif
 
 #include <cassert>
+#include <algorithm>
 #include <cmath>
 #include <cfenv> // Catch fp exceptions
 #include <limits>
+#include <cfloat>
+#include <cstdio>
 #include <variant>
 
 #ifdef _WIN32
@@ -42,19 +54,65 @@ Simulation::Simulation()
     time(0.0),
     output_dt(0.0),
     end_time(100.0),
+    use_adaptive_dt(false),
+    cfl_limit(1.0),
+    strain_limit(0.5),
+    min_dt_factor(0.1),
+    max_dt_factor(4.0),
+    last_dt(0.0),
     use_end_time(false),
     overlap_ratio(2.0),
     core_size_ratio(std::sqrt(6)),
     nstep(0),
     use_max_steps(false),
     max_steps(100),
+    sort_interval(0),
+    thread_aff(affinity_none),
+    mem_use(),
+    report_memory(false),
     auto_start(false),
     quit_on_stop(false),
     sim_is_initialized(false),
     step_has_started(false),
-    step_is_finished(false)
+    step_is_finished(false),
+    step_secs(0.0),
+    diffuse_secs(0.0),
+    convect_secs(0.0),
+    status_bem_iters(0),
+    perf_hist(),
+    hist_bem_iters(0),
+    last_impulse_time(0.0),
+    last_impulse{0.0},
+    force_per_body(false),
+    last_body_impulse_time(0.0),
+    last_body_impulse(),
+    stop_reported(false),
+    checkpoint_interval(0),
+    checkpoint_file("checkpoint.o2d"),
+    vtk_enc(vtk_zlib),
+    vtk_index(),
+    part_out(),
+    fldpt_out(),
+    probes(),
+    use_hdf5(false),
+    output_depth(0),
+    output_jobs(),
+    output_done(),
+    stream_port(0),
+    stream_address("127.0.0.1"),
+    stream_interval(0),
+    stream_stride(1),
+    stream_quantize(false),
+    stream()
   {}
 
+// a pooled step does not wait for itself like std::async did, so never leave one running
+Simulation::~Simulation() {
+  if (stepfuture.valid()) stepfuture.wait();
+  flush_output();
+  probes.flush();
+}
+
 // addresses for use in imgui
 float* Simulation::addr_re() { return &re; }
 float* Simulation::addr_dt() { return &dt; }
@@ -90,6 +148,18 @@ void Simulation::set_quit_on_stop(const bool qos) { quit_on_stop = qos; }
 // access status file
 void Simulation::set_status_file_name(const std::string _fn) { sf.set_filename(_fn); }
 std::string Simulation::get_status_file_name() { return sf.get_filename(); }
+void Simulation::set_status_file_format(const std::string _fmt) {
+  if (_fmt == "csv") sf.set_format(status_csv);
+  else if (_fmt == "binary") sf.set_format(status_binary);
+  else sf.set_format(status_text);
+}
+std::string Simulation::get_status_file_format() {
+  switch (sf.get_format()) {
+    case status_csv: return "csv";
+    case status_binary: return "binary";
+    default: return "text";
+  }
+}
 
 // status
 size_t Simulation::get_npanels() {
@@ -97,8 +167,8 @@ size_t Simulation::get_npanels() {
   for (auto &coll: bdry) {
     //std::visit([&n](auto& elem) { n += elem.get_npanels(); }, coll);
     // only proceed if the last collection is Surfaces
-    if (std::holds_alternative<Surfaces<float>>(coll)) {
-      Surfaces<float>& surf = std::get<Surfaces<float>>(coll);
+    if (std::holds_alternative<Surfaces<STORE>>(coll)) {
+      Surfaces<STORE>& surf = std::get<Surfaces<STORE>>(coll);
       n += surf.get_npanels();
     }
   }
@@ -144,6 +214,10 @@ void Simulation::set_amr(const bool _do_amr) {
 void
 Simulation::flow_from_json(const nlohmann::json j) {
 
+  // a domain is open unless this file says otherwise
+  PeriodicDomain pd;
+  SymmetryPlane sp;
+
   if (j.find("Re") != j.end()) {
     re = j["Re"];
     std::cout << "  setting re= " << re << std::endl;
@@ -160,6 +234,25 @@ Simulation::flow_from_json(const nlohmann::json j) {
     for (size_t i=0; i<Dimensions; ++i) fs[i] = new_fs[i];
     std::cout << "  setting freestream to " << fs[0] << " " << fs[1] << std::endl;
   }
+  if (j.find("periodX") != j.end()) {
+    pd.period = j["periodX"];
+    std::cout << "  setting periodic in x with period= " << pd.period << std::endl;
+  }
+  if (j.find("periodOrigin") != j.end()) {
+    pd.origin = j["periodOrigin"];
+    std::cout << "  setting periodic origin= " << pd.origin << std::endl;
+  }
+  if (j.find("symmetryPlane") != j.end()) {
+    sp.on = true;
+    sp.height = j["symmetryPlane"];
+    std::cout << "  setting symmetry plane at y= " << sp.height << std::endl;
+  }
+  if (pd.active() and sp.active()) {
+    std::cout << "  a periodic domain cannot also have a symmetry plane, ignoring the plane" << std::endl;
+    sp.on = false;
+  }
+  conv.get_env().set_periodic_domain(pd);
+  conv.get_env().set_symmetry_plane(sp);
 }
 
 // create and write a json object for "flowparams"
@@ -169,6 +262,13 @@ Simulation::flow_to_json() const {
 
   j["Re"] = re;
   j["Uinf"] = {fs[0], fs[1]};
+  const PeriodicDomain& pd = conv.get_env().get_periodic_domain();
+  if (pd.active()) {
+    j["periodX"] = pd.period;
+    j["periodOrigin"] = pd.origin;
+  }
+  const SymmetryPlane& sp = conv.get_env().get_symmetry_plane();
+  if (sp.active()) j["symmetryPlane"] = sp.height;
 
   return j;
 }
@@ -187,6 +287,120 @@ Simulation::from_json(const nlohmann::json j) {
     std::cout << "  setting output dt= " << output_dt << std::endl;
   }
 
+  if (j.find("outputQueueDepth") != j.end()) {
+    output_depth = j["outputQueueDepth"];
+    std::cout << "  setting output queue depth= " << output_depth << std::endl;
+  }
+
+  if (j.find("vtkEncoding") != j.end()) {
+    const std::string enc = j["vtkEncoding"];
+    if (enc == "ascii") vtk_enc = vtk_ascii;
+    else if (enc == "base64") vtk_enc = vtk_base64;
+    else if (enc == "raw") vtk_enc = vtk_raw;
+    else if (enc == "zlib") vtk_enc = vtk_zlib;
+    else std::cout << "  unknown vtk encoding " << enc << ", keeping zlib" << std::endl;
+    std::cout << "  setting vtk encoding= " << enc << std::endl;
+  }
+
+  if (j.find("checkpointInterval") != j.end()) {
+    checkpoint_interval = j["checkpointInterval"];
+    std::cout << "  setting checkpoint interval= " << checkpoint_interval << std::endl;
+  }
+
+  if (j.find("checkpointFile") != j.end()) {
+    checkpoint_file = j["checkpointFile"];
+    std::cout << "  setting checkpoint file= " << checkpoint_file << std::endl;
+  }
+
+  if (j.find("outputParticles") != j.end()) {
+    std::cout << "  setting particle output" << std::endl;
+    part_out.from_json(j["outputParticles"]);
+  }
+  if (j.find("outputFieldPoints") != j.end()) {
+    std::cout << "  setting field point output" << std::endl;
+    fldpt_out.from_json(j["outputFieldPoints"]);
+  }
+
+  if (j.find("probes") != j.end()) {
+    std::cout << "  setting probe sampling" << std::endl;
+    probes.from_json(j["probes"]);
+  }
+
+  outflow = Outflow<STORE>();
+  if (j.find("outflow") != j.end()) outflow.from_json(j["outflow"]);
+
+  if (j.find("outputFormat") != j.end()) {
+    const std::string fmt = j["outputFormat"];
+#ifdef USE_HDF5
+    use_hdf5 = (fmt == "hdf5");
+#else
+    if (fmt == "hdf5") std::cout << "  hdf5 output was not built in, writing vtk" << std::endl;
+#endif
+    std::cout << "  setting output format= " << (use_hdf5 ? "hdf5" : "vtk") << std::endl;
+  }
+
+  if (j.find("streamPort") != j.end()) {
+    stream_port = j["streamPort"];
+    std::cout << "  setting stream port= " << stream_port << std::endl;
+    // a port alone streams every step
+    if (stream_interval == 0) stream_interval = 1;
+  }
+  if (j.find("streamAddress") != j.end()) {
+    stream_address = j["streamAddress"];
+    std::cout << "  setting stream address= " << stream_address << std::endl;
+  }
+  if (j.find("streamInterval") != j.end()) {
+    stream_interval = j["streamInterval"];
+    std::cout << "  setting stream interval= " << stream_interval << std::endl;
+  }
+  if (j.find("streamStride") != j.end()) {
+    stream_stride = std::max((size_t)1, (size_t)j["streamStride"]);
+    std::cout << "  setting stream stride= " << stream_stride << std::endl;
+  }
+  if (j.find("streamQuantize") != j.end()) {
+    stream_quantize = j["streamQuantize"];
+    std::cout << "  setting stream quantize= " << stream_quantize << std::endl;
+  }
+
+  thread_aff = affinity_none;
+  if (j.find("threadAffinity") != j.end()) {
+    if (not affinity_from_name(j["threadAffinity"], thread_aff)) {
+      std::cout << "  unknown threadAffinity " << j["threadAffinity"] << ", use none, close or spread" << std::endl;
+    }
+    std::cout << "  setting thread affinity= " << affinity_name(thread_aff) << std::endl;
+  }
+  if (j.find("reproducibleSums") != j.end()) {
+    reproducible_sums() = j["reproducibleSums"];
+    std::cout << "  setting reproducible sums= " << reproducible_sums() << std::endl;
+  }
+
+  if (j.find("sortInterval") != j.end()) {
+    sort_interval = j["sortInterval"];
+    std::cout << "  setting particle sort interval= " << sort_interval << std::endl;
+  }
+
+  if (j.find("forcePerBody") != j.end()) {
+    force_per_body = j["forcePerBody"];
+    std::cout << "  setting force per body= " << force_per_body << std::endl;
+  }
+
+  if (j.find("reportMemory") != j.end()) {
+    report_memory = j["reportMemory"];
+    std::cout << "  setting report memory= " << report_memory << std::endl;
+  }
+
+  if (j.find("adaptiveDt") != j.end()) {
+    nlohmann::json aj = j["adaptiveDt"];
+    use_adaptive_dt = true;
+    if (aj.find("cfl") != aj.end()) cfl_limit = aj["cfl"];
+    if (aj.find("strainLimit") != aj.end()) strain_limit = aj["strainLimit"];
+    if (aj.find("minFactor") != aj.end()) min_dt_factor = aj["minFactor"];
+    if (aj.find("maxFactor") != aj.end()) max_dt_factor = aj["maxFactor"];
+    std::cout << "  setting adaptive dt with cfl= " << cfl_limit << " and strain limit= " << strain_limit << std::endl;
+    // the strain limit needs the velocity gradients on the particles
+    conv.set_vort_grads(true);
+  }
+
   //if (j.find("nominalDx") != j.end()) {
   //  dx = j["nominalDx"];
   //  std::cout << "  setting dx= " << dx << std::endl;
@@ -218,7 +432,7 @@ Simulation::from_json(const nlohmann::json j) {
     std::cout << "  setting core size ratio (nominal separation over h_nu) = " << core_size_ratio << std::endl;
   }
 
-  // Convection will find and set "timeOrder"
+  // Convection will find and set "timeOrder", "velocityCore" and "sourcePruning"
   conv.from_json(j);
 
   // Diffusion will find and set "viscous", "VRM" and "AMR" parameters
@@ -226,6 +440,9 @@ Simulation::from_json(const nlohmann::json j) {
 
   // set hybrid Eulerian-Lagrangian solution parameters
   hybr.from_json(j);
+
+  // BEM will find and set its solver parameters
+  bem.from_json(j);
 }
 
 // create and write a json object for "simparams"
@@ -235,6 +452,35 @@ Simulation::to_json() const {
 
   j["nominalDt"] = dt;
   j["outputDt"] = output_dt;
+  if (output_depth > 0) j["outputQueueDepth"] = output_depth;
+  if (vtk_enc == vtk_ascii) j["vtkEncoding"] = "ascii";
+  else if (vtk_enc == vtk_base64) j["vtkEncoding"] = "base64";
+  else if (vtk_enc == vtk_raw) j["vtkEncoding"] = "raw";
+  if (part_out.is_active()) j["outputParticles"] = part_out.to_json();
+  if (fldpt_out.is_active()) j["outputFieldPoints"] = fldpt_out.to_json();
+  if (probes.is_active()) j["probes"] = probes.to_json();
+  if (outflow.is_active()) j["outflow"] = outflow.to_json();
+  if (use_hdf5) j["outputFormat"] = "hdf5";
+  if (checkpoint_interval > 0) {
+    j["checkpointInterval"] = checkpoint_interval;
+    j["checkpointFile"] = checkpoint_file;
+  }
+  if (stream_port > 0) {
+    j["streamPort"] = stream_port;
+    if (stream_address != "127.0.0.1") j["streamAddress"] = stream_address;
+    j["streamInterval"] = stream_interval;
+    if (stream_stride > 1) j["streamStride"] = stream_stride;
+    if (stream_quantize) j["streamQuantize"] = true;
+  }
+  if (thread_aff != affinity_none) j["threadAffinity"] = affinity_name(thread_aff);
+  if (reproducible_sums()) j["reproducibleSums"] = true;
+  if (sort_interval > 0) j["sortInterval"] = sort_interval;
+  if (force_per_body) j["forcePerBody"] = true;
+  if (report_memory) j["reportMemory"] = true;
+  if (use_adaptive_dt) {
+    j["adaptiveDt"] = {{"cfl", cfl_limit}, {"strainLimit", strain_limit},
+                       {"minFactor", min_dt_factor}, {"maxFactor", max_dt_factor}};
+  }
   if (using_max_steps()) j["maxSteps"] = get_max_steps();
   if (using_end_time()) j["endTime"] = get_end_time();
   j["overlapRatio"] = overlap_ratio;
@@ -249,6 +495,9 @@ Simulation::to_json() const {
   // Hybrid will create a "hybrid" section
   hybr.add_to_json(j);
 
+  // BEM will create a "bem" section
+  bem.add_to_json(j);
+
   return j;
 }
 
@@ -267,6 +516,102 @@ void Simulation::draw_advanced() {
   
   // set the hybrid parameters in Hybrid.h
   hybr.draw_advanced();
+
+  ImGui::Separator();
+  ImGui::Spacing();
+  ImGui::Text("Memory use (MB, current / peak)");
+  for (const auto& e : mem_use.get_entries()) {
+    ImGui::Text("  %-14s %9.2f / %9.2f", e.name.c_str(), e.current/1048576.0, e.peak/1048576.0);
+  }
+  ImGui::Text("  %-14s %9.2f / %9.2f", "total", mem_use.get_total()/1048576.0, mem_use.get_peak_total()/1048576.0);
+}
+
+//
+// the recent steps: where each one spent its time, how that grows with the particles, and
+//   how hard the BEM and the memory worked
+//
+void Simulation::draw_performance() {
+
+  std::vector<PerfHistory::Record> recs;
+  std::vector<std::string> phases;
+  perf_hist.get(recs, phases);
+  if (recs.empty()) {
+    ImGui::Text("No steps taken yet");
+    return;
+  }
+
+  ImDrawList* dl = ImGui::GetWindowDrawList();
+  const float width = std::max(100.0f, ImGui::GetContentRegionAvail().x);
+  const float height = 120.0f;
+  auto phase_color = [&](const size_t _ip) {
+    return (ImU32)ImColor::HSV((float)_ip / (float)std::max((size_t)1, phases.size()), 0.6f, 0.9f);
+  };
+
+  // one stacked bar per step, the newest at right
+  double tmax = 0.0;
+  for (const auto& r : recs) tmax = std::max(tmax, r.step_secs);
+  ImGui::Text("Seconds per step, last %ld steps (max %.3f s)", (long)recs.size(), tmax);
+  {
+    const ImVec2 p0 = ImGui::GetCursorScreenPos();
+    dl->AddRectFilled(p0, ImVec2(p0.x+width, p0.y+height), ImGui::GetColorU32(ImGuiCol_FrameBg));
+    const float bw = width / (float)recs.size();
+    for (size_t i=0; i<recs.size(); ++i) {
+      const float x0 = p0.x + bw*(float)i;
+      float y = p0.y + height;
+      double accounted = 0.0;
+      for (size_t ip=0; ip<recs[i].phase_secs.size(); ++ip) {
+        const float h = (tmax > 0.0) ? (float)(height * recs[i].phase_secs[ip] / tmax) : 0.0f;
+        dl->AddRectFilled(ImVec2(x0, y-h), ImVec2(x0+std::max(1.0f, bw-1.0f), y), phase_color(ip));
+        accounted += recs[i].phase_secs[ip];
+        y -= h;
+      }
+      // whatever no phase covers
+      const double rest = recs[i].step_secs - accounted;
+      if (rest > 0.0 and tmax > 0.0) {
+        const float h = (float)(height * rest / tmax);
+        dl->AddRectFilled(ImVec2(x0, y-h), ImVec2(x0+std::max(1.0f, bw-1.0f), y), IM_COL32(128,128,128,255));
+      }
+    }
+    ImGui::Dummy(ImVec2(width, height));
+  }
+
+  // the legend, with the newest step's share of each
+  const PerfHistory::Record& last = recs.back();
+  for (size_t ip=0; ip<phases.size(); ++ip) {
+    const double secs = (ip < last.phase_secs.size()) ? last.phase_secs[ip] : 0.0;
+    ImGui::TextColored(ImColor(phase_color(ip)), "  %-16s %8.4f s  %5.1f%%", phases[ip].c_str(), secs,
+                       (last.step_secs > 0.0) ? 100.0*secs/last.step_secs : 0.0);
+  }
+
+  // step time against particle count
+  size_t nmax = 0;
+  for (const auto& r : recs) nmax = std::max(nmax, r.nparts);
+  ImGui::Spacing();
+  ImGui::Text("Seconds per step against particles (max %ld)", (long)nmax);
+  {
+    const ImVec2 p0 = ImGui::GetCursorScreenPos();
+    dl->AddRectFilled(p0, ImVec2(p0.x+width, p0.y+height), ImGui::GetColorU32(ImGuiCol_FrameBg));
+    for (size_t i=0; i<recs.size(); ++i) {
+      if (nmax == 0 or tmax <= 0.0) break;
+      const float x = p0.x + 3.0f + (width-6.0f) * (float)recs[i].nparts / (float)nmax;
+      const float y = p0.y + height - 3.0f - (height-6.0f) * (float)(recs[i].step_secs / tmax);
+      // older steps fade
+      const int alpha = 64 + (int)(191 * (i+1) / recs.size());
+      dl->AddCircleFilled(ImVec2(x, y), 2.5f, IM_COL32(255,220,120,alpha));
+    }
+    ImGui::Dummy(ImVec2(width, height));
+  }
+
+  // and the BEM iterations and memory of each step
+  std::vector<float> vals(recs.size());
+  char overlay[64];
+  for (size_t i=0; i<recs.size(); ++i) vals[i] = (float)recs[i].bem_iters;
+  std::snprintf(overlay, sizeof(overlay), "%d last step", last.bem_iters);
+  ImGui::Spacing();
+  ImGui::PlotLines("BEM iters", vals.data(), (int)vals.size(), 0, overlay, 0.0f, FLT_MAX, ImVec2(width-100.0f, 50.0f));
+  for (size_t i=0; i<recs.size(); ++i) vals[i] = (float)recs[i].mem_mb;
+  std::snprintf(overlay, sizeof(overlay), "%.1f MB", last.mem_mb);
+  ImGui::PlotLines("Memory", vals.data(), (int)vals.size(), 0, overlay, 0.0f, FLT_MAX, ImVec2(width-100.0f, 50.0f));
 }
 #endif
 
@@ -288,10 +633,26 @@ void Simulation::updateGL() {
   }
 }
 
+// from the step thread: write the new state into the buffers which allow it
+void Simulation::publishGL() {
+  PROFILE_ZONE("publish to GPU");
+  for (auto &coll : vort) {
+    std::visit([=](auto& elem) { elem.publishGL(); }, coll);
+  }
+  for (auto &coll : bdry) {
+    std::visit([=](auto& elem) { elem.publishGL(); }, coll);
+  }
+  for (auto &coll : fldpt) {
+    std::visit([=](auto& elem) { elem.publishGL(); }, coll);
+  }
+}
+
 void Simulation::drawGL(std::vector<float>& _projmat,
                         RenderParams&       _rparams) {
 
-  if (step_is_finished) {
+  // nothing is drawn while a step is working on the elements, unless an earlier one finished;
+  //   the batch version steps in this thread, so none ever is
+  if (step_is_finished or not step_has_started) {
     _rparams.tracer_size = get_ips() * _rparams.tracer_scale;
     for (auto &coll : vort) {
       std::visit([&](auto& elem) { elem.drawGL(_projmat, _rparams, get_vdelta()); }, coll);
@@ -316,11 +677,26 @@ void Simulation::reset() {
   if (stepfuture.valid()) {
     stepfuture.wait();
     stepfuture.get();
+    stepfuture = std::shared_future<void>();
   }
 
+  // where the time went, once per run
+  if (nstep > 0 and is_root_rank()) Profiler::get().print_summary(nstep);
+  Profiler::get().reset();
+
+  // and for any files still being written
+  flush_output();
+  vtk_index.reset();
+  probes.flush();
+  probes.reset();
+#ifdef USE_HDF5
+  h5out.reset();
+#endif
+
   // now reset everything else
   time = 0.0;
   nstep = 0;
+  last_dt = 0.0;
   vort.clear();
   bdry.clear();
   fldpt.clear();
@@ -328,6 +704,18 @@ void Simulation::reset() {
   bem.reset();
   hybr.reset();
   sf.reset_sim();
+  step_secs = 0.0;
+  diffuse_secs = 0.0;
+  convect_secs = 0.0;
+  status_bem_iters = 0;
+  perf_hist.clear();
+  hist_bem_iters = 0;
+  diff.clear_counts();
+  outflow.reset();
+#ifdef USE_CUDA
+  // collections are gone, so are their device copies
+  cuda_release_all();
+#endif
   sim_is_initialized = false;
   step_has_started = false;
   step_is_finished = false;
@@ -343,13 +731,13 @@ std::vector<std::string> Simulation::write_vtk(const int _index,
                                                const bool _do_flow,
                                                const bool _do_measure) {
 
-  std::cout << "Inside Simulation::write_vtk at t=" << time << std::endl;
+  LOG_INFO("Inside Simulation::write_vtk at t=" << time);
 
   // solve the BEM (before any VTK or status file output)
   //std::cout << "Updating element vels" << std::endl;
   std::array<double,2> thisfs = {fs[0], fs[1]};
   //clear_inner_layer<STORE>(1, bdry, vort, 1.0/std::sqrt(2.0*M_PI), get_ips());
-  solve_bem<STORE,ACCUM,Int>(time, thisfs, vort, bdry, bem);
+  solve_bem<STORE,ACCUM,Int>(time, thisfs, vort, bdry, bem, conv.get_env());
 
   // special - only here do we cacluate the vorticity as well as velocity, true means force
   if (_do_flow)    conv.find_vels(thisfs, vort, bdry, vort, velandvort, true);
@@ -368,24 +756,83 @@ std::vector<std::string> Simulation::write_vtk(const int _index,
     stepnum = (size_t)_index;
   }
 
-  // ask Vtk to write files for each collection
-  if (_do_flow) { 
-    size_t idx = 0;
-    for (auto &coll : vort) {
-      std::visit([&](auto &&elem) { files.emplace_back(elem.write_vtk(idx++, stepnum, time)); }, coll);
+  // ask Vtk (or hdf5) to write files for each collection, all at once; this is not done on
+  //   the worker pool because it may already run there, and a single large collection instead
+  //   spreads its compression over the threads
+  auto write_all = [this,stepnum](const std::vector<std::vector<Collection>*>& _sets,
+                                  const double _time) {
+    std::vector<std::pair<Collection*,size_t>> todo;
+    for (auto set : _sets) {
+      for (size_t i=0; i<set->size(); ++i) todo.emplace_back(&(*set)[i], i);
     }
-  }
-  if (_do_measure) {
-    size_t idx = 0;
-    for (auto &coll : fldpt) {
-      std::visit([&](auto &&elem) { files.emplace_back(elem.write_vtk(idx++, stepnum, time)); }, coll);
+
+    std::vector<std::string> written(todo.size());
+    #pragma omp parallel for schedule(dynamic) if (todo.size() > 1)
+    for (int32_t i=0; i<(int32_t)todo.size(); ++i) {
+      auto write_one = [&](auto& _elem) {
+#ifdef USE_HDF5
+        if (use_hdf5) {
+          written[i] = _elem.write_hdf5(h5out, todo[i].second, stepnum, _time);
+          return;
+        }
+#endif
+        written[i] = _elem.write_vtk(todo[i].second, stepnum, _time, vtk_enc);
+      };
+
+      // points may be thinned first, and nothing is written if none are left
+      if (std::holds_alternative<Points<STORE>>(*todo[i].first)) {
+        const Points<STORE>& pts = std::get<Points<STORE>>(*todo[i].first);
+        const OutputFilter& filt = pts.is_inert() ? fldpt_out : part_out;
+        if (filt.is_active()) {
+          Points<STORE> kept = pts;
+          (void) kept.compact(filt.keep_flags(pts.get_pos(), pts.is_inert() ? nullptr : &pts.get_str()));
+          if (kept.get_n() > 0) write_one(kept);
+          continue;
+        }
+      }
+      std::visit([&](auto &&elem) { write_one(elem); }, *todo[i].first);
     }
-  }
-  if (_do_bdry) {
-    size_t idx = 0;
-    for (auto &coll : bdry) {
-      std::visit([&](auto &&elem) { files.emplace_back(elem.write_vtk(idx++, stepnum, time)); }, coll);
+
+    written.erase(std::remove(written.begin(), written.end(), std::string()), written.end());
+    if (not use_hdf5) for (const auto& file : written) vtk_index.add(file, _time);
+    return written;
+  };
+
+  if (output_depth > 0) {
+    // encoding and writing cost far more than copying, so write copies in the background
+    std::vector<Collection> snap_vort, snap_fldpt, snap_bdry;
+    if (_do_flow) snap_vort = vort;
+    if (_do_measure) snap_fldpt = fldpt;
+    if (_do_bdry) snap_bdry = bdry;
+
+    // but never keep too many snapshots around
+    while (output_jobs.size() >= output_depth) {
+      std::vector<std::string> done = output_jobs.front().get();
+      output_done.insert(output_done.end(), done.begin(), done.end());
+      output_jobs.pop_front();
+    }
+
+    output_jobs.push_back(ThreadPool::background().submit(
+        [write_all, snap_vort=std::move(snap_vort), snap_fldpt=std::move(snap_fldpt),
+         snap_bdry=std::move(snap_bdry), t=time]() mutable {
+          PROFILE_ZONE("write output");
+          return write_all({&snap_vort, &snap_fldpt, &snap_bdry}, t);
+        }));
+
+    // report the files finished so far, from this or earlier calls
+    while (not output_jobs.empty() and is_future_ready(output_jobs.front())) {
+      std::vector<std::string> done = output_jobs.front().get();
+      output_done.insert(output_done.end(), done.begin(), done.end());
+      output_jobs.pop_front();
     }
+    files.swap(output_done);
+
+  } else {
+    std::vector<std::vector<Collection>*> sets;
+    if (_do_flow) sets.push_back(&vort);
+    if (_do_measure) sets.push_back(&fldpt);
+    if (_do_bdry) sets.push_back(&bdry);
+    files = write_all(sets, time);
   }
 
   if (false) {
@@ -408,6 +855,313 @@ std::vector<std::string> Simulation::write_vtk(const int _index,
   return files;
 }
 
+//
+// wait for every background write to finish
+//
+void Simulation::flush_output() {
+  while (not output_jobs.empty()) {
+    std::vector<std::string> done = output_jobs.front().get();
+    output_done.insert(output_done.end(), done.begin(), done.end());
+    output_jobs.pop_front();
+  }
+}
+
+//
+// each collection with what it takes to make it again: its type, in the order of the Collection
+//   variant, its element and move types, and the name of its body
+//
+static void write_collections(CheckpointWriter& _out, const std::vector<Collection>& _colls) {
+  _out.put((uint64_t)_colls.size());
+  for (const auto& coll : _colls) {
+    _out.put((uint8_t)coll.index());
+    std::visit([&](const auto& elem) {
+      _out.put(elem.get_elemt());
+      _out.put(elem.get_movet());
+      _out.put_str(elem.get_body_ptr() ? elem.get_body_ptr()->get_name() : std::string());
+      elem.write_state(_out);
+    }, coll);
+  }
+}
+
+//
+// the setup makes every collection but the free particles and tracers, which come and go,
+//   so only those may be added or removed here
+//
+template <class F>
+static bool read_collections(CheckpointReader& _in, std::vector<Collection>& _colls,
+                             const bool _can_add, const float _vdelta, F&& _find_body) {
+  const size_t ncoll = (size_t)_in.get<uint64_t>();
+  if (not _can_add and ncoll != _colls.size()) return false;
+
+  for (size_t i=0; i<ncoll and _in.good(); ++i) {
+    const size_t type = _in.get<uint8_t>();
+    const elem_t e = _in.get<elem_t>();
+    const move_t m = _in.get<move_t>();
+    const std::string bname = _in.get_str();
+
+    bool matches = (i < _colls.size() and _colls[i].index() == type);
+    if (matches) {
+      std::visit([&](auto& elem) { matches = (elem.get_elemt() == e and elem.get_movet() == m); }, _colls[i]);
+    }
+    if (not matches) {
+      if (not _can_add or type != 0) return false;
+      const ElementPacket<STORE> none(std::vector<STORE>(), std::vector<Int>(), std::vector<STORE>(), 0, 0);
+      Points<STORE> pts(none, e, m, bname.empty() ? nullptr : _find_body(bname), _vdelta);
+      if (i < _colls.size()) _colls[i] = std::move(pts);
+      else _colls.emplace_back(std::move(pts));
+    }
+    std::visit([&](auto& elem) { elem.read_state(_in); }, _colls[i]);
+  }
+
+  if (_colls.size() > ncoll) _colls.erase(_colls.begin()+ncoll, _colls.end());
+  return _in.good();
+}
+
+//
+// Save everything which changes as the simulation runs; the case itself (bodies, features,
+//   parameters) comes from the json file, as it does when restarting
+//
+void Simulation::write_state(CheckpointWriter& _out) {
+  _out.put(checkpoint_magic);
+  _out.put(checkpoint_version);
+  _out.put((uint32_t)sizeof(STORE));
+
+  _out.put(time);
+  _out.put(nstep);
+  _out.put(last_dt);
+  _out.put(last_impulse_time);
+  _out.put(last_impulse);
+  _out.put(last_body_impulse_time);
+  _out.put((uint64_t)last_body_impulse.size());
+  for (const auto& imp : last_body_impulse) _out.put(imp);
+
+  conv.write_state(_out);
+  diff.write_state(_out);
+  bem.write_state(_out);
+  outflow.write_state(_out);
+
+  write_collections(_out, vort);
+  write_collections(_out, bdry);
+  write_collections(_out, fldpt);
+  _out.put((uint64_t)euler.size());
+  for (const auto& vol : euler) vol.write_state(_out);
+}
+
+bool Simulation::write_checkpoint() {
+  if (not is_root_rank()) return true;
+  // the status lines up to here belong with it
+  sf.flush();
+  LOG_INFO("Writing checkpoint at step " << nstep << " to " << checkpoint_file);
+
+  CheckpointWriter out(checkpoint_file);
+  write_state(out);
+
+  if (not out.finish()) {
+    LOG_ERROR("  could not write checkpoint " << checkpoint_file);
+    return false;
+  }
+  return true;
+}
+
+//
+// Resume from a checkpoint, after the case has been set up as for a new run
+//
+bool Simulation::read_state(CheckpointReader& _in) {
+  const auto magic = _in.get<std::array<char,8>>();
+  const uint32_t version = _in.get<uint32_t>();
+  const uint32_t storesize = _in.get<uint32_t>();
+  if (not _in.good() or std::memcmp(magic.data(), checkpoint_magic, 8) != 0 or
+      version != checkpoint_version or storesize != sizeof(STORE)) {
+    std::cout << "  not a checkpoint from this version and precision of Omega2D" << std::endl;
+    return false;
+  }
+
+  time = _in.get<double>();
+  nstep = _in.get<size_t>();
+  last_dt = _in.get<double>();
+  last_impulse_time = _in.get<double>();
+  last_impulse = _in.get<std::array<float,Dimensions>>();
+  last_body_impulse_time = _in.get<double>();
+  last_body_impulse.resize(_in.get<uint64_t>());
+  for (auto& imp : last_body_impulse) imp = _in.get<std::array<float,Dimensions>>();
+
+  conv.read_state(_in);
+  diff.read_state(_in);
+  bem.read_state(_in);
+  outflow.read_state(_in);
+
+  auto find_body = [this](const std::string& _name) { return get_pointer_to_body(_name); };
+  bool ok = read_collections(_in, vort, true, get_vdelta(), find_body) and
+            read_collections(_in, bdry, false, get_vdelta(), find_body) and
+            read_collections(_in, fldpt, true, get_vdelta(), find_body);
+
+  ok = ok and (_in.get<uint64_t>() == euler.size());
+  for (size_t i=0; ok and i<euler.size(); ++i) euler[i].read_state(_in);
+
+  if (not ok or not _in.good()) {
+    std::cout << "  checkpoint does not match this case" << std::endl;
+    return false;
+  }
+
+  // the bodies' poses follow from the time
+  for (auto &bptr : bodies) bptr->transform(time);
+  return true;
+}
+
+bool Simulation::read_checkpoint(const std::string _file) {
+  std::cout << "Reading checkpoint " << _file << std::endl;
+
+  CheckpointReader in(_file);
+  if (not read_state(in)) return false;
+
+  // keep the probe histories from before the stop
+  probes.resume();
+
+  std::cout << "  resuming at step " << nstep << " and t=" << time << " with " << get_nparts() << " particles" << std::endl;
+  return true;
+}
+
+//
+// The same, held in memory, so that the GUI can go back to an earlier time and try something
+//   else from there; the current step must finish first
+//
+CheckpointSnapshot Simulation::take_snapshot() {
+  if (stepfuture.valid()) stepfuture.wait();
+
+  auto bytes = std::make_shared<std::vector<char>>();
+  CheckpointWriter out(*bytes);
+  write_state(out);
+  bytes->shrink_to_fit();
+
+  CheckpointSnapshot snap;
+  snap.time = time;
+  snap.nstep = nstep;
+  snap.bytes = std::move(bytes);
+  LOG_INFO("Took snapshot at step " << nstep << " (" << snap.get_mem_bytes()/1048576 << " MB)");
+  return snap;
+}
+
+bool Simulation::restore_snapshot(const CheckpointSnapshot& _snap) {
+  if (_snap.empty() or not sim_is_initialized) return false;
+  if (stepfuture.valid()) {
+    stepfuture.wait();
+    stepfuture.get();
+    stepfuture = std::shared_future<void>();
+  }
+  LOG_INFO("Going back to the snapshot at step " << _snap.nstep);
+
+  // read_state fills the collections the case was set up with, so after a reset the
+  //   caller must initialize it again first
+  CheckpointReader in(_snap);
+  if (not read_state(in)) return false;
+
+  // any probe samples held or written since then belong to the abandoned run
+  probes.reset();
+
+#ifdef USE_GL
+  // nothing new will come from a step, so show this state now
+  publishGL();
+  updateGL();
+#endif
+  return true;
+}
+
+//
+// every collection of Points or Surfaces becomes one block of a frame; only the particles
+//   and field points are decimated, so bodies always look whole
+//
+Frame Simulation::make_frame() {
+  Frame f;
+  f.time = time;
+  f.step = nstep;
+  f.vdelta = get_vdelta();
+
+  auto add_block = [&](const Collection& _coll) {
+    FrameBlock b;
+    if (std::holds_alternative<Points<STORE>>(_coll)) {
+      const Points<STORE>& pts = std::get<Points<STORE>>(_coll);
+      b.kind = pts.is_inert() ? frame_fieldpts : frame_particles;
+      const auto& x = pts.get_pos();
+      for (size_t i=0; i<pts.get_n(); i+=stream_stride) {
+        b.x.push_back((float)x[0][i]);
+        b.y.push_back((float)x[1][i]);
+        if (not pts.is_inert()) b.s.push_back((float)pts.get_str()[i]);
+      }
+    } else if (std::holds_alternative<Surfaces<STORE>>(_coll)) {
+      const Surfaces<STORE>& surf = std::get<Surfaces<STORE>>(_coll);
+      b.kind = frame_panels;
+      const auto& x = surf.get_pos();
+      b.x.assign(x[0].begin(), x[0].end());
+      b.y.assign(x[1].begin(), x[1].end());
+      b.idx.assign(surf.get_idx().begin(), surf.get_idx().end());
+      if (not surf.is_inert()) b.s.assign(surf.get_str().begin(), surf.get_str().end());
+    } else {
+      return;
+    }
+    f.blocks.push_back(std::move(b));
+  };
+
+  for (const auto& coll : vort) add_block(coll);
+  for (const auto& coll : bdry) add_block(coll);
+  for (const auto& coll : fldpt) add_block(coll);
+  return f;
+}
+
+void Simulation::publish_frame() {
+  if (not is_root_rank()) return;
+  if (not stream.is_running() and not stream.start(stream_port, stream_address)) {
+    // don't keep trying
+    stream_port = 0;
+    return;
+  }
+  stream.publish(encode_frame(make_frame(), stream_quantize));
+}
+
+//
+// a viewer has no case of its own, it replaces everything with what the frame holds
+//
+void Simulation::show_frame(const Frame& _f) {
+  time = _f.time;
+  nstep = _f.step;
+  vort.clear();
+  bdry.clear();
+  fldpt.clear();
+
+  for (const auto& b : _f.blocks) {
+    const size_t n = b.x.size();
+    std::vector<STORE> x(Dimensions*n);
+    for (size_t i=0; i<n; ++i) {
+      x[2*i] = b.x[i];
+      x[2*i+1] = b.y[i];
+    }
+
+    if (b.kind == frame_panels) {
+      const size_t np = b.idx.size() / 2;
+      std::vector<Int> idx(b.idx.begin(), b.idx.end());
+      const bool has_str = (b.s.size() == np);
+      ElementPacket<STORE> packet(x, idx, std::vector<STORE>(has_str ? np : 0, 0.0), np, 1);
+      Surfaces<STORE> surf(packet, has_str ? reactive : inert, fixed, nullptr);
+      if (has_str) surf.set_str(0, np, Vector<STORE>(b.s.begin(), b.s.end()));
+      bdry.push_back(std::move(surf));
+
+    } else {
+      const bool has_str = (b.kind == frame_particles and b.s.size() == n);
+      std::vector<STORE> s;
+      if (has_str) s.assign(b.s.begin(), b.s.end());
+      ElementPacket<STORE> packet(x, std::vector<Int>(), s, n, 0);
+      Points<STORE> pts(packet, has_str ? active : inert, has_str ? lagrangian : fixed, nullptr, _f.vdelta);
+      if (has_str) vort.push_back(std::move(pts));
+      else fldpt.push_back(std::move(pts));
+    }
+  }
+
+#ifdef USE_GL
+  updateGL();
+#endif
+  sim_is_initialized = true;
+  step_is_finished = true;
+}
+
 //
 // Check all aspects of the initialization for conditions that prevent a run from starting
 //
@@ -446,6 +1200,11 @@ std::string Simulation::check_initialization() {
     retstr.append("Boundary features have too many panels, program will run out of memory. Reduce Reynolds number or increase time step or both.\n");
   }
 
+  // a plugin sums all of the targets at once, which the ranks' split of the targets can't use
+  if (conv.get_env().has_plugin() and mpi_size() > 1) {
+    retstr.append("The velocity plugin can not run across MPI ranks. Remove it, or run on one rank.\n");
+  }
+
   return retstr;
 }
 
@@ -457,6 +1216,24 @@ std::string Simulation::check_simulation() {
 
   // Are there any dynamic problems in 2D that could blow a run?
 
+  // with several ranks, each must still hold the same elements: compare their counts and
+  //   a sum of the bits of their positions, which does not depend on order
+  if (mpi_size() > 1) {
+    std::array<uint64_t,2> sig = {0, 0};
+    for (const auto& coll : vort) {
+      std::visit([&sig](const auto& elem) {
+        const auto& x = elem.get_pos();
+        sig[0] += elem.get_n();
+        for (size_t d=0; d<Dimensions; ++d) {
+          for (const auto v : x[d]) sig[1] += (uint64_t)philox_bits(v) * (2*d+1);
+        }
+      }, coll);
+    }
+    if (not mpi_all_agree(sig)) {
+      retstr.append("MPI ranks no longer hold the same particles, their results can not be combined.\n");
+    }
+  }
+
   return retstr;
 }
 
@@ -504,6 +1281,7 @@ bool Simulation::test_for_new_results() {
   } else if (is_future_ready(stepfuture)) {
     // if we did, and it's ready to give us the results
     stepfuture.get();
+    stepfuture = std::shared_future<void>();
 
 #ifdef USE_GL
     // tell flow objects to update their values to the GPU
@@ -526,14 +1304,28 @@ bool Simulation::test_for_new_results() {
 //
 void Simulation::async_first_step() {
   step_has_started = true;
-  stepfuture = std::async(std::launch::async, [this](){first_step();});
+  stepfuture = ThreadPool::stepper().submit([this](){first_step();}).share();
+}
+
+//
+// pin the OpenMP team of the thread running the steps, if asked, and say where it went;
+//   a team pinned for another Simulation goes back where it was
+//
+void Simulation::place_step_threads() {
+  const std::string where = pin_omp_team(thread_aff);
+  if (where.empty()) return;
+  LOG_INFO("  threads on cpu/node: " << where);
+  Profiler::get().set_placement(where);
 }
 
 //
 // initialize the system so we can start drawing things
 //
 void Simulation::first_step() {
-  std::cout << std::endl << "Taking step " << nstep << " at t=" << time << std::endl;
+  PROFILE_BEGIN_STEP();
+  LOG_INFO("\nTaking step " << nstep << " at t=" << time);
+  place_step_threads();
+  pull_body_motions();
 
   // we wind up using this a lot
   std::array<double,2> thisfs = {fs[0], fs[1]};
@@ -545,9 +1337,16 @@ void Simulation::first_step() {
 
   // call HO grid solver, but only to send first velocity results and initialize vorticity
   hybr.first_step(time, thisfs, vort, bdry, bem, conv, euler);
+#ifdef USE_GL
+  publishGL();
+#endif
+  PROFILE_END_STEP();
 
   // and write status file
   dump_stats_to_status();
+
+  // so that anything printed from here on comes after this step's messages
+  Logger::get().flush();
 }
 
 //
@@ -555,7 +1354,7 @@ void Simulation::first_step() {
 //
 void Simulation::async_step() {
   step_has_started = true;
-  stepfuture = std::async(std::launch::async, [this](){step();});
+  stepfuture = ThreadPool::stepper().submit([this](){step();}).share();
 }
 
 //
@@ -566,53 +1365,247 @@ void Simulation::step() {
   // unsigned int current_word = 0;
   // _controlfp_s(&current_word, _EM_UNDERFLOW | _EM_OVERFLOW | _EM_INEXACT, _MCW_EM);
 
-  std::cout << std::endl << "Taking step " << nstep << " at t=" << time << " with n=" << get_nparts() << std::endl;
+  PROFILE_BEGIN_STEP();
+  place_step_threads();
+  pull_body_motions();
+  const auto step_start = std::chrono::steady_clock::now();
+  auto secs_since = [](const std::chrono::steady_clock::time_point _t) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _t).count();
+  };
+
+  // the nominal dt, unless the step size adapts to the flow
+  const double this_dt = use_adaptive_dt ? choose_dt() : (double)dt;
+  last_dt = this_dt;
+
+  LOG_INFO("\nTaking step " << nstep << " at t=" << time << " with n=" << get_nparts());
+
+  // count how often the element arrays had to move this step
+  array_reallocs() = 0;
 
   const bool use_2nd_order_operator_splitting = true;
 
   // we wind up using this a lot
   std::array<double,2> thisfs = {fs[0], fs[1]};
 
+  auto phase_start = std::chrono::steady_clock::now();
   if (use_2nd_order_operator_splitting) {
     // operator splitting requires one half-step diffuse (use coefficients from previous step, if available)
-    diff.step(time, 0.5*dt, re, overlap_ratio, get_vdelta(), thisfs, vort, bdry, bem);
+    diff.step(time, 0.5*this_dt, re, overlap_ratio, get_vdelta(), thisfs, vort, bdry, bem, conv.get_env());
   } else {
     // for simplicity's sake, just run one full diffusion step here
-    diff.step(time, dt, re, overlap_ratio, get_vdelta(), thisfs, vort, bdry, bem);
+    diff.step(time, this_dt, re, overlap_ratio, get_vdelta(), thisfs, vort, bdry, bem, conv.get_env());
   }
+  diffuse_secs = secs_since(phase_start);
+
+  // moving field points need a full update on the first step and on any step ending at an
+  //   output time; fixed ones are never evaluated in a step, only when output asks for them
+  const bool at_output = (nstep == 0) or
+                         (output_dt > 0.0 and std::floor((time+this_dt)/output_dt + 1.e-6) > std::floor(time/output_dt + 1.e-6));
 
   // advect with no diffusion (must update BEM strengths)
-  conv.advect(time, dt, thisfs, get_ips(), vort, bdry, fldpt, bem);
+  phase_start = std::chrono::steady_clock::now();
+  conv.advect(time, this_dt, thisfs, get_ips(), vort, bdry, fldpt, bem, at_output);
+  convect_secs = secs_since(phase_start);
 
   if (use_2nd_order_operator_splitting) {
     // operator splitting requires another half-step diffuse (must compute new coefficients)
-    diff.step(time+dt, 0.5*dt, re, overlap_ratio, get_vdelta(), thisfs, vort, bdry, bem);
+    phase_start = std::chrono::steady_clock::now();
+    diff.step(time+this_dt, 0.5*this_dt, re, overlap_ratio, get_vdelta(), thisfs, vort, bdry, bem, conv.get_env());
+    diffuse_secs += secs_since(phase_start);
+  }
+
+  // in a periodic domain, whatever left one side comes back in the other
+  const PeriodicDomain& pd = conv.get_env().get_periodic_domain();
+  if (pd.active()) {
+    for (auto &coll : vort) {
+      if (std::holds_alternative<Points<STORE>>(coll)) wrap_into_period(std::get<Points<STORE>>(coll), pd);
+    }
+    for (auto &coll : fldpt) {
+      if (std::holds_alternative<Points<STORE>>(coll)) wrap_into_period(std::get<Points<STORE>>(coll), pd);
+    }
+  }
+
+  // the far wake leaves through the outflow sponge
+  if (outflow.is_active()) {
+    (void) outflow.apply(vort, fldpt, this_dt, thisfs, get_vdelta());
+  }
+
+  // keep particles which are near each other near in memory, too; the GUI will send the
+  //   new order to the GPU with the rest of this step's state, in updateGL
+  if (sort_interval > 0) {
+    for (auto &coll : vort) {
+      if (std::holds_alternative<Points<STORE>>(coll)) {
+        (void) std::get<Points<STORE>>(coll).sort_spatially(nstep % sort_interval == 0);
+      }
+    }
   }
 
   // call HO grid solver to recalculate vorticity at the end of this time step
-  hybr.step(time, dt, re, thisfs, vort, bdry, bem, conv, euler, overlap_ratio, get_vdelta());
+  hybr.step(time, this_dt, re, thisfs, vort, bdry, bem, conv, euler, overlap_ratio, get_vdelta());
 
   // update time
-  time += (double)dt;
+  time += this_dt;
 
   // push field points out of objects every few steps
-  if (nstep%5 == 0) clear_inner_layer<STORE>(1, bdry, fldpt, (STORE)0.0, (STORE)(0.5*get_ips()));
+  if (nstep%5 == 0) clear_inner_layer<STORE>(1, bdry, fldpt, (STORE)0.0, (STORE)(0.5*get_ips()),
+                                              conv.get_env().get_symmetry_plane());
+
+  LOG_DEBUG("  " << array_reallocs() << " array reallocations this step");
+
+#ifdef USE_GL
+  // so the GUI thread only has to switch buffers when it picks up these results
+  publishGL();
+#endif
 
   // only increment step here!
   nstep++;
+  step_secs = secs_since(step_start);
+  PROFILE_END_STEP();
 
   // and write status file
   dump_stats_to_status();
+  push_body_loads();
+  record_perf();
+  if (probes.is_due(nstep)) sample_probes();
+
+  // so that anything printed from here on comes after this step's messages
+  Logger::get().flush();
+
+  if (checkpoint_interval > 0 and nstep % checkpoint_interval == 0) (void) write_checkpoint();
+
+  if (stream_port > 0 and stream_interval > 0 and nstep % stream_interval == 0) publish_frame();
+}
+
+//
+// find the velocity and vorticity at every field point and keep them, see ProbeSampler
+//
+void Simulation::sample_probes() {
+  if (get_nfldpts() == 0) return;
+  PROFILE_ZONE("sample probes");
+
+  // the BEM was likely just solved for the status file, and then this costs nothing; every
+  //   rank takes part in the sums, but only one keeps the samples
+  std::array<double,2> thisfs = {fs[0], fs[1]};
+  solve_bem<STORE,ACCUM,Int>(time, thisfs, vort, bdry, bem, conv.get_env());
+  conv.find_vels(thisfs, vort, bdry, fldpt, velandvort, true);
+
+  if (is_root_rank()) probes.sample(time, nstep, fldpt);
+}
+
+//
+// find the bytes held by every part of the simulation
+//
+void Simulation::update_mem_use() {
+  mem_use.set("particles", get_mem_bytes(vort));
+  mem_use.set("boundaries", get_mem_bytes(bdry));
+  mem_use.set("field points", get_mem_bytes(fldpt));
+  mem_use.set("BEM", bem.get_mem_bytes());
+  mem_use.set("RK stages", conv.get_mem_bytes());
+  mem_use.set("VRM", diff.get_vrm_mem_bytes());
+  mem_use.set("PSE", diff.get_pse_mem_bytes());
+#ifdef USE_GL
+  mem_use.set("GL buffers", get_gl_bytes(vort) + get_gl_bytes(bdry) + get_gl_bytes(fldpt));
+#endif
+  mem_use.update_peak();
+}
+
+//
+// keep this step's timings for the performance panel: the profiler's top-level zones if it
+//   was built in, otherwise the two halves of the operator splitting
+//
+void Simulation::record_perf() {
+  PerfHistory::Record rec;
+  rec.nstep = nstep;
+  rec.nparts = get_nparts();
+  rec.step_secs = step_secs;
+  rec.bem_iters = (int)(bem.get_num_iterations() - hist_bem_iters);
+  hist_bem_iters = bem.get_num_iterations();
+  rec.mem_mb = mem_use.get_total()/1048576.0;
+
+  auto set_phase = [&](const std::string& _name, const double _secs) {
+    const size_t ip = perf_hist.phase(_name);
+    if (rec.phase_secs.size() <= ip) rec.phase_secs.resize(ip+1, 0.0);
+    rec.phase_secs[ip] += _secs;
+  };
+#ifdef USE_PROFILER
+  const std::vector<Profiler::Zone>& zones = Profiler::get().get_zones();
+  for (const auto& z : zones) {
+    if (z.depth == 1 and z.step_calls > 0) set_phase(z.name, z.step_secs);
+  }
+#else
+  set_phase("diffusion", diffuse_secs);
+  set_phase("convection", convect_secs);
+  set_phase("other", std::max(0.0, step_secs - diffuse_secs - convect_secs));
+#endif
+
+  perf_hist.add(std::move(rec));
+}
+
+//
+// pick a step size from the last velocities: no particle should move more than cfl_limit
+//   cores, or be strained or turned more than strain_limit (from the norm of its velocity
+//   gradient, or without one its peak vorticity), in one step
+//
+double Simulation::choose_dt() {
+  const double nom_dt = (double)dt;
+
+  // no velocities yet, so trust the nominal step
+  if (nstep == 0 or last_dt <= 0.0) return nom_dt;
+
+  STORE maxvelsq = 0.0;
+  STORE maxrate = 0.0;
+  for (auto &coll : vort) {
+    if (std::holds_alternative<Points<STORE>>(coll)) {
+      const Points<STORE>& pts = std::get<Points<STORE>>(coll);
+      if (pts.is_inert()) continue;
+      const std::array<Vector<STORE>,Dimensions>& u = pts.get_vel();
+      const Vector<STORE>& s = pts.get_str();
+      const Vector<STORE>& r = pts.get_rad();
+      const std::array<Vector<STORE>,4>* g = pts.has_velgrad() ? &pts.get_velgrad() : nullptr;
+      for (size_t i=0; i<pts.get_n(); ++i) {
+        maxvelsq = std::max(maxvelsq, u[0][i]*u[0][i] + u[1][i]*u[1][i]);
+        if (g) {
+          const STORE gsq = (*g)[0][i]*(*g)[0][i] + (*g)[1][i]*(*g)[1][i] + (*g)[2][i]*(*g)[2][i] + (*g)[3][i]*(*g)[3][i];
+          maxrate = std::max(maxrate, std::sqrt(gsq));
+        } else {
+          maxrate = std::max(maxrate, std::abs(s[i]) / (STORE)(M_PI*r[i]*r[i]));
+        }
+      }
+    }
+  }
+
+  double new_dt = max_dt_factor * nom_dt;
+  if (maxvelsq > 0.0) new_dt = std::min(new_dt, (double)(cfl_limit * get_vdelta() / std::sqrt(maxvelsq)));
+  if (maxrate > 0.0) new_dt = std::min(new_dt, (double)(strain_limit / maxrate));
+
+  // grow slowly, but shrink as quickly as needed
+  new_dt = std::min(new_dt, 1.25*last_dt);
+  new_dt = std::max(new_dt, min_dt_factor * nom_dt);
+
+  // land exactly on the next output time (and the end time) with evenly-sized steps
+  auto land_on = [&](const double _tstop) {
+    const double remain = _tstop - time;
+    if (remain > 1.e-6*nom_dt and remain < 2.0*new_dt) {
+      new_dt = remain / std::ceil(remain / new_dt - 1.e-6);
+    }
+  };
+  if (output_dt > 0.0) land_on((std::floor(time/output_dt + 1.e-6) + 1.0) * output_dt);
+  if (using_end_time()) land_on(end_time);
+
+  LOG_INFO("  adaptive dt is " << new_dt << " (nominal " << nom_dt << ")");
+  return new_dt;
 }
 
 //
 // close out the step with some work and output to the status file
 //
 void Simulation::dump_stats_to_status() {
-  if (sf.is_active()) {
+  update_mem_use();
+
+  if (sf.is_active() and is_root_rank()) {
     // the basics
-    sf.append_value((float)time);
-    sf.append_value((int)get_nparts());
+    sf.append_value("time", (float)time);
+    sf.append_value("nparts", (int)get_nparts());
 
     // more advanced info
 
@@ -621,7 +1614,7 @@ void Simulation::dump_stats_to_status() {
     // push away particles inside or too close to the body
     //clear_inner_layer<STORE>(1, bdry, vort, 1.0/std::sqrt(2.0*M_PI), get_ips());
     // solve the BEM (before any VTK or status file output)
-    solve_bem<STORE,ACCUM,Int>(time, thisfs, vort, bdry, bem);
+    solve_bem<STORE,ACCUM,Int>(time, thisfs, vort, bdry, bem, conv.get_env());
 
     // but do we really need to do these?
     //conv.find_vels(thisfs, vort, bdry, vort);
@@ -638,11 +1631,79 @@ void Simulation::dump_stats_to_status() {
       tot_circ += std::visit([=](auto& elem) { return elem.get_total_circ(time); }, src);
       tot_circ += std::visit([=](auto& elem) { return elem.get_body_circ(time); }, src);
     }
-    sf.append_value(tot_circ);
+    // and what the outflow took from the wake
+    tot_circ += outflow.get_retired_circ();
+    sf.append_value("circulation", tot_circ);
 
     // now forces
     std::array<float,Dimensions> impulse = calculate_simple_forces();
-    for (size_t i=0; i<Dimensions; ++i) sf.append_value(impulse[i]);
+    for (size_t i=0; i<Dimensions; ++i) sf.append_value(std::string("force_") + "xyz"[i], impulse[i]);
+    if (force_per_body) {
+      for (const auto& bf : calculate_body_forces()) {
+        for (size_t i=0; i<Dimensions; ++i) sf.append_value(std::string("force_") + "xyz"[i] + "_" + bf.first, bf.second[i]);
+      }
+    }
+
+    // where the time went, how hard the BEM worked, and how the particles changed this step
+    sf.append_value("step_secs", (float)step_secs);
+    sf.append_value("diffuse_secs", (float)diffuse_secs);
+    sf.append_value("convect_secs", (float)convect_secs);
+    sf.append_value("bem_iters", (int)(bem.get_num_iterations() - status_bem_iters));
+    status_bem_iters = bem.get_num_iterations();
+    sf.append_value("created", (int)diff.get_num_created());
+    sf.append_value("merged", (int)diff.get_num_merged());
+    diff.clear_counts();
+
+    // and how many BEM solves were avoided so far
+    sf.append_value("bem_skipped", (int)bem.get_num_skipped());
+
+    // the step size, if it changes
+    if (use_adaptive_dt) sf.append_value("dt", (float)last_dt);
+
+    // how the fast summation last compared with direct sums
+    if (conv.get_validate_interval() > 0) {
+      sf.append_value("vel_err_max", (float)conv.get_last_validation().max_err);
+      sf.append_value("vel_err_rms", (float)conv.get_last_validation().rms_err);
+      sf.append_value("vel_speedup", (float)conv.get_last_validation().speedup);
+    }
+
+    // and what the particle budget did this step
+    if (diff.get_budget() > 0) {
+      sf.append_value("budget_boost", (float)diff.get_budget_boost());
+      sf.append_value("budget_action", (int)diff.get_budget_action());
+    }
+
+#ifdef USE_PROFILER
+    // seconds in the two levels of timing zones below the whole step
+    const std::vector<Profiler::Zone>& zones = Profiler::get().get_zones();
+    for (size_t i=0; i<zones.size(); ++i) {
+      if (zones[i].depth < 1 or zones[i].depth > 2) continue;
+      std::string path = Profiler::get().get_path(zones, (int)i);
+      if (path.compare(0, 5, "step.") != 0) continue;
+      std::replace(path.begin(), path.end(), ' ', '_');
+      sf.append_value("secs_" + path.substr(5), (float)zones[i].step_secs);
+    }
+
+    // and the rate of each influence kernel which ran this step
+    const bool have_peak = (Profiler::get().get_peak_gflops() > 0.0);
+    for (const auto& k : Profiler::get().get_kernels()) {
+      if (k.step_secs <= 0.0) continue;
+      sf.append_value(std::string("gflops_") + k.name, (float)k.step_gflops());
+      if (have_peak) sf.append_value(std::string("pctpeak_") + k.name, (float)Profiler::get().percent_of_peak(k.step_gflops()));
+    }
+#endif
+
+    // megabytes held by each part, current and peak
+    if (report_memory) {
+      auto mem_column = [](std::string _name) {
+        std::replace(_name.begin(), _name.end(), ' ', '_');
+        return "mb_" + _name;
+      };
+      for (const auto& e : mem_use.get_entries()) {
+        sf.append_value(mem_column(e.name), (float)(e.current/1048576.0));
+        sf.append_value(mem_column(e.name) + "_peak", (float)(e.peak/1048576.0));
+      }
+    }
 
     // write here
     sf.write_line();
@@ -653,40 +1714,123 @@ void Simulation::dump_stats_to_status() {
 std::array<float,Dimensions>
 Simulation::calculate_simple_forces() {
 
-  static double last_time = 0.0;
-  static std::array<float,Dimensions> last_impulse = {0.0};
   std::array<float,Dimensions> this_impulse = {0.0};
 
   // reset the "last" values if time is zero
   if (time < 0.1*dt) {
-    last_time = -dt;
+    last_impulse_time = -dt;
     last_impulse.fill(0.0);
   }
 
   // calculate impulse from particles
   for (auto &src : vort) {
-    std::array<float,Dimensions> this_imp = std::visit([=](auto& elem) { return elem.get_total_impulse(); }, src);
+    const auto this_imp = std::visit([=](auto& elem) { return elem.get_total_impulse(); }, src);
     for (size_t i=0; i<Dimensions; ++i) this_impulse[i] += this_imp[i];
   }
   // then add up the impulse from bodies - DO WE NEED TO RE-SOLVE BEM FIRST?
   for (auto &src : bdry) {
-    std::array<float,Dimensions> this_imp = std::visit([=](auto& elem) { return elem.get_total_impulse(); }, src);
+    const auto this_imp = std::visit([=](auto& elem) { return elem.get_total_impulse(); }, src);
     for (size_t i=0; i<Dimensions; ++i) this_impulse[i] += this_imp[i];
   }
+  // and the wake the outflow has retired
+  for (size_t i=0; i<Dimensions; ++i) this_impulse[i] += outflow.get_retired_impulse()[i];
 
   // find the time derivative of the impulses
   std::array<float,Dimensions> forces;
-  for (size_t i=0; i<Dimensions; ++i) forces[i] = (this_impulse[i] - last_impulse[i]) / (time - last_time);
+  for (size_t i=0; i<Dimensions; ++i) forces[i] = (this_impulse[i] - last_impulse[i]) / (time - last_impulse_time);
 
   // save the last condition
-  last_time = time;
+  last_impulse_time = time;
   for (size_t i=0; i<Dimensions; ++i) last_impulse[i] = this_impulse[i];
 
   return forces;
 }
 
-// Add elements - any kind
-void Simulation::add_elements(const ElementPacket<float> _elems,
+// The same, for each body with a boundary: its own bound vorticity, plus every particle
+//   nearer its center than any other body's
+std::vector<std::pair<std::string,std::array<float,Dimensions>>>
+Simulation::calculate_body_forces() {
+
+  // these are differences since the last call, so a second call at the same time repeats it
+  std::vector<std::shared_ptr<Body>> bods = bodies_with_bdry();
+  if (time == last_body_impulse_time and last_body_forces.size() == bods.size()) return last_body_forces;
+
+  std::vector<std::array<double,Dimensions>> ctr(bods.size());
+  std::vector<std::array<double,Dimensions>> imp(bods.size(), {0.0});
+  for (size_t b=0; b<bods.size(); ++b) ctr[b] = bods[b]->get_pos(time);
+
+  for (auto &src : vort) {
+    if (std::holds_alternative<Points<STORE>>(src)) {
+      std::get<Points<STORE>>(src).add_impulse_by_nearest(ctr, imp);
+    }
+  }
+  for (auto &src : bdry) {
+    std::shared_ptr<Body> bp = std::visit([=](auto& elem) { return elem.get_body_ptr(); }, src);
+    const auto it = std::find(bods.begin(), bods.end(), bp);
+    if (it == bods.end()) continue;
+    const auto this_imp = std::visit([=](auto& elem) { return elem.get_total_impulse(); }, src);
+    for (size_t i=0; i<Dimensions; ++i) imp[it-bods.begin()][i] += this_imp[i];
+  }
+
+  // restart the differences if time is zero or the bodies changed
+  if (time < 0.1*dt or last_body_impulse.size() != bods.size()) {
+    last_body_impulse_time = -dt;
+    last_body_impulse.assign(bods.size(), {0.0});
+  }
+
+  std::vector<std::pair<std::string,std::array<float,Dimensions>>> forces;
+  for (size_t b=0; b<bods.size(); ++b) {
+    std::string name = bods[b]->get_name();
+    if (name.empty()) name = "body" + std::to_string(b);
+    std::replace(name.begin(), name.end(), ' ', '_');
+
+    std::array<float,Dimensions> f;
+    for (size_t i=0; i<Dimensions; ++i) {
+      f[i] = ((float)imp[b][i] - last_body_impulse[b][i]) / (time - last_body_impulse_time);
+      last_body_impulse[b][i] = (float)imp[b][i];
+    }
+    forces.push_back({name, f});
+  }
+  last_body_impulse_time = time;
+  last_body_forces = forces;
+
+  return forces;
+}
+
+// the bodies, in the order their boundaries appear
+std::vector<std::shared_ptr<Body>> Simulation::bodies_with_bdry() {
+  std::vector<std::shared_ptr<Body>> bods;
+  for (auto &src : bdry) {
+    std::shared_ptr<Body> bp = std::visit([=](auto& elem) { return elem.get_body_ptr(); }, src);
+    if (bp and std::find(bods.begin(), bods.end(), bp) == bods.end()) bods.push_back(bp);
+  }
+  return bods;
+}
+
+//
+// coupled bodies take their motion from their structures at the start of a step...
+//
+void Simulation::pull_body_motions() {
+  for (auto& bp : bodies) bp->pull_motion(time);
+}
+
+// ...and give back the forces on them at its end
+void Simulation::push_body_loads() {
+  const std::vector<std::shared_ptr<Body>> bods = bodies_with_bdry();
+  if (std::none_of(bods.begin(), bods.end(), [](const auto& bp) { return bp->is_coupled(); })) return;
+  PROFILE_ZONE("body loads");
+
+  // the status file may have solved the BEM at this time already, then this costs nothing
+  std::array<double,2> thisfs = {fs[0], fs[1]};
+  solve_bem<STORE,ACCUM,Int>(time, thisfs, vort, bdry, bem, conv.get_env());
+  const auto forces = calculate_body_forces();
+  for (size_t b=0; b<bods.size(); ++b) {
+    if (bods[b]->is_coupled()) bods[b]->push_load(time, {forces[b].second[0], forces[b].second[1]});
+  }
+}
+
+// Add elements - any kind, the packet is only read as it is copied into a collection
+void Simulation::add_elements(const ElementPacket<float>& _elems,
                               const elem_t _et, const move_t _mt,
                               std::shared_ptr<Body> _bptr) {
 
@@ -707,7 +1851,7 @@ void Simulation::add_elements(const ElementPacket<float> _elems,
 
 // File the new elements into the correct collection
 void Simulation::file_elements(std::vector<Collection>& _collvec,
-                               const ElementPacket<float> _elems,
+                               const ElementPacket<float>& _elems,
                                const elem_t _et, const move_t _mt,
                                std::shared_ptr<Body> _bptr) {
 
@@ -731,11 +1875,11 @@ void Simulation::file_elements(std::vector<Collection>& _collvec,
 
     // check Collections element dimension
     auto& coll = _collvec[i];
-    if (std::holds_alternative<Points<float>>(coll) and _elems.ndim != 0) {
+    if (std::holds_alternative<Points<STORE>>(coll) and _elems.ndim != 0) {
       this_match = false;
-    } else if (std::holds_alternative<Surfaces<float>>(coll) and _elems.ndim != 1) {
+    } else if (std::holds_alternative<Surfaces<STORE>>(coll) and _elems.ndim != 1) {
       this_match = false;
-    } else if (std::holds_alternative<Volumes<float>>(coll) and _elems.ndim != 2) {
+    } else if (std::holds_alternative<Volumes<STORE>>(coll) and _elems.ndim != 2) {
       this_match = false;
     }
 
@@ -745,15 +1889,18 @@ void Simulation::file_elements(std::vector<Collection>& _collvec,
     }
   }
 
+  // features make float elements, the collections hold them in this build's precision
+  const ElementPacket<STORE>& elems = as_precision<STORE>(_elems);
+
   // if no match, or no collections exist
   if (no_match) {
     // make a new collection according to element dimension
     if (_elems.ndim == 0) {
-      _collvec.push_back(Points<float>(_elems, _et, _mt, _bptr, get_vdelta()));
+      _collvec.push_back(Points<STORE>(elems, _et, _mt, _bptr, get_vdelta()));
     } else if (_elems.ndim == 1) {
-      _collvec.push_back(Surfaces<float>(_elems, _et, _mt, _bptr));
+      _collvec.push_back(Surfaces<STORE>(elems, _et, _mt, _bptr));
     } else if (_elems.ndim == 2) {
-      _collvec.push_back(Volumes<float>(_elems, _et, _mt, _bptr));
+      _collvec.push_back(Volumes<STORE>(elems, _et, _mt, _bptr));
     }
 
   } else {
@@ -762,20 +1909,20 @@ void Simulation::file_elements(std::vector<Collection>& _collvec,
 
     // proceed to add the correct object type
     if (_elems.ndim == 0) {
-      Points<float>& pts = std::get<Points<float>>(coll);
-      pts.add_new(_elems, get_vdelta());
+      Points<STORE>& pts = std::get<Points<STORE>>(coll);
+      pts.add_new(elems, get_vdelta());
     } else if (_elems.ndim == 1) {
-      Surfaces<float>& surf = std::get<Surfaces<float>>(coll);
-      surf.add_new(_elems);
+      Surfaces<STORE>& surf = std::get<Surfaces<STORE>>(coll);
+      surf.add_new(elems);
     } else if (_elems.ndim == 2) {
-      Volumes<float>& vols = std::get<Volumes<float>>(coll);
-      vols.add_new(_elems);
+      Volumes<STORE>& vols = std::get<Volumes<STORE>>(coll);
+      vols.add_new(elems);
     }
   }
 }
 
 // Add elements - cells for hybrid calculation
-void Simulation::add_hybrid(const std::vector<ElementPacket<float>>  _elems,
+void Simulation::add_hybrid(const std::vector<ElementPacket<float>>& _elems,
                             std::shared_ptr<Body> _bptr) {
 
   // skip out early if nothing's here
@@ -792,7 +1939,8 @@ void Simulation::add_hybrid(const std::vector<ElementPacket<float>>  _elems,
   //_elems[0] is the volume elements - always add unique Collection to euler
   //_elems[1] is the wall boundaries
   //_elems[2] is the open boundaries
-  euler.emplace_back(HOVolumes<float>(_elems[0], _elems[1], _elems[2], hybrid, fixed, _bptr));
+  euler.emplace_back(HOVolumes<STORE>(as_precision<STORE>(_elems[0]), as_precision<STORE>(_elems[1]),
+                                      as_precision<STORE>(_elems[2]), hybrid, fixed, _bptr));
   std::cout << "  euler now has " << euler.size() << " HOVolumes" << std::endl;
 
   // alternate way to assign the wall and open bc elements
@@ -852,7 +2000,9 @@ bool Simulation::test_vs_stop() {
     std::cout << "Stopping at step " << get_max_steps() << std::endl;
     should_stop = true;
   }
-  if (using_end_time() and get_end_time() <= time+0.5*dt){
+  // compare against the step actually taken, which may not be the nominal one
+  const double step_dt = (last_dt > 0.0) ? last_dt : (double)dt;
+  if (using_end_time() and get_end_time() <= time+0.5*step_dt){
     std::cout << "Stopping at time " << get_end_time() << std::endl;
     should_stop = true;
   }
@@ -862,27 +2012,26 @@ bool Simulation::test_vs_stop() {
 // this is different because we have to trigger when last step is still running
 bool Simulation::test_vs_stop_async() {
   bool should_stop = false;
-  static bool already_reported = false;
 
   if (using_max_steps() and get_max_steps() == nstep+1) {
-    if (not already_reported) {
+    if (not stop_reported) {
       std::cout << std::endl << "Stopping at step " << get_max_steps() << std::endl;
-      already_reported = true;
+      stop_reported = true;
     }
     should_stop = true;
   }
 
   if (using_end_time() and get_end_time() >= time+0.5*dt
                        and get_end_time() <= time+1.5*dt) {
-    if (not already_reported) {
+    if (not stop_reported) {
       std::cout << std::endl << "Stopping at time " << get_end_time() << std::endl;
-      already_reported = true;
+      stop_reported = true;
     }
     should_stop = true;
   }
 
   // reset the toggle
-  if (not should_stop) already_reported = false;
+  if (not should_stop) stop_reported = false;
 
   return should_stop;
 }
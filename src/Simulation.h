@@ -17,6 +17,13 @@
 #include "Hybrid.h"
 #include "ElementPacket.h"
 #include "StatusFile.h"
+#include "ThreadPool.h"
+#include "MemoryHelper.h"
+#include "PerfHistory.h"
+#include "FrameStream.h"
+#include "OutputFilter.h"
+#include "ProbeSampler.h"
+#include "Outflow.h"
 
 #ifdef USE_GL
 #include "RenderParams.h"
@@ -25,18 +32,12 @@
 #include <string>
 #include <vector>
 #include <future>
+#include <deque>
 #include <chrono>
 
-#ifdef USE_VC
-#define STORE float
-#define ACCUM float
-#else
-#define STORE float
-#define ACCUM double
-#endif
 
-template <class T>
-bool is_future_ready(std::future<T> const& f) {
+template <class F>
+bool is_future_ready(F const& f) {
     if (!f.valid()) return false;
     return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
 }
@@ -47,6 +48,7 @@ bool is_future_ready(std::future<T> const& f) {
 class Simulation {
 public:
   Simulation();
+  ~Simulation();
 
   // imgui needs access to memory locations
   float* addr_re();
@@ -83,6 +85,8 @@ public:
   // access status file
   void set_status_file_name(const std::string);
   std::string get_status_file_name();
+  void set_status_file_format(const std::string);
+  std::string get_status_file_format();
 
   // get runtime status
   size_t get_npanels();
@@ -93,9 +97,9 @@ public:
   void set_re_for_ips(float);
 
   // receive and add a set of elements
-  void add_elements(const ElementPacket<float>, const elem_t, const move_t, std::shared_ptr<Body>);
-  void file_elements(std::vector<Collection>&, const ElementPacket<float>, const elem_t, const move_t, std::shared_ptr<Body>);
-  void add_hybrid(const std::vector<ElementPacket<float>>, std::shared_ptr<Body>);
+  void add_elements(const ElementPacket<float>&, const elem_t, const move_t, std::shared_ptr<Body>);
+  void file_elements(std::vector<Collection>&, const ElementPacket<float>&, const elem_t, const move_t, std::shared_ptr<Body>);
+  void add_hybrid(const std::vector<ElementPacket<float>>&, std::shared_ptr<Body>);
 
   // access body list
   void add_body(std::shared_ptr<Body>);
@@ -117,8 +121,15 @@ public:
   void first_step();
   void async_step();
   void step();
+  double choose_dt();
+  void update_mem_use();
   void dump_stats_to_status();
+  void record_perf();
+  void sample_probes();
   std::array<float,Dimensions> calculate_simple_forces();
+  std::vector<std::pair<std::string,std::array<float,Dimensions>>> calculate_body_forces();
+  void pull_body_motions();
+  void push_body_loads();
   bool is_initialized();
   void set_initialized();
   std::string check_initialization();
@@ -126,13 +137,29 @@ public:
   bool do_any_bodies_move();
   bool any_nonzero_bcs();
   bool test_for_new_results();
+  std::shared_future<void> get_step_future() const { return stepfuture; }
   std::vector<std::string> write_vtk(const int _index = -1,
                                      const bool _do_bdry = true,
                                      const bool _do_flow = true,
                                      const bool _do_measure = true);
+  void flush_output();
+  bool write_checkpoint();
+  bool read_checkpoint(const std::string);
+  CheckpointSnapshot take_snapshot();
+  bool restore_snapshot(const CheckpointSnapshot&);
+
+  // send the current state to remote viewers, or show a state received from one
+  Frame make_frame();
+  void publish_frame();
+  void show_frame(const Frame&);
   bool test_vs_stop();
   bool test_vs_stop_async();
 
+  // the element lists, to read between steps
+  const std::vector<Collection>& get_vort() const { return vort; }
+  const std::vector<Collection>& get_bdry() const { return bdry; }
+  const std::vector<Collection>& get_fldpt() const { return fldpt; }
+
   // read to and write from a json object
   void flow_from_json(const nlohmann::json);
   nlohmann::json flow_to_json() const;
@@ -142,14 +169,21 @@ public:
 #ifdef USE_GL
   // graphics pass-through calls
   void updateGL();
+  void publishGL();
   void drawGL(std::vector<float>&, RenderParams&);
 #endif
 
 #ifdef USE_IMGUI
   void draw_advanced();
+  void draw_performance();
 #endif
 
 private:
+  // the dynamic state, to and from a checkpoint file or snapshot
+  void write_state(CheckpointWriter&);
+  bool read_state(CheckpointReader&);
+  void place_step_threads();
+
   // primary simulation params
   float re;
   float dt;
@@ -201,17 +235,98 @@ private:
   double time;
   double output_dt;
   double end_time;
+  // adaptive step size: limits on the particle motion (in cores) and the rotation per step,
+  //   and the bounds as multiples of the nominal dt, which still sets the resolution
+  bool use_adaptive_dt;
+  float cfl_limit;
+  float strain_limit;
+  float min_dt_factor;
+  float max_dt_factor;
+  double last_dt;
   bool use_end_time;
   float overlap_ratio;
   float core_size_ratio;
   size_t nstep;
   bool use_max_steps;
   size_t max_steps;
+  // steps between spatial sorts of the particles, 0 never sorts, see Points::sort_spatially
+  size_t sort_interval;
+  // cores for the OpenMP team of the thread which steps this, see Numa.h
+  affinity_t thread_aff;
+  // bytes held by each part, updated every step; also written to the status file if asked
+  MemoryUse mem_use;
+  bool report_memory;
   bool auto_start;
   bool quit_on_stop;
   bool sim_is_initialized;
   bool step_has_started;
   bool step_is_finished;
-  std::future<void> stepfuture;  // this future needs to be listed after the big four: diff, conv, ...
+  std::shared_future<void> stepfuture;  // runs on ThreadPool::stepper(), the destructor waits for it
+
+  // wall-clock seconds of the last step and of its diffusion and convection, and the BEM
+  //   iterations counted when the last status line was written
+  double step_secs;
+  double diffuse_secs;
+  double convect_secs;
+  size_t status_bem_iters;
+
+  // the recent steps, for the GUI's performance panel, and the BEM iterations before the last
+  PerfHistory perf_hist;
+  size_t hist_bem_iters;
+
+  // for the impulse-based force estimate
+  double last_impulse_time;
+  std::array<float,Dimensions> last_impulse;
+
+  // and the same, split among the bodies, each taking its own bound vorticity and the
+  //   particles nearest it, if asked for
+  bool force_per_body;
+  double last_body_impulse_time;
+  std::vector<std::array<float,Dimensions>> last_body_impulse;
+  std::vector<std::shared_ptr<Body>> bodies_with_bdry();
+  std::vector<std::pair<std::string,std::array<float,Dimensions>>> last_body_forces;
+
+  // so that the async stop message only prints once
+  bool stop_reported;
+
+  // the complete dynamic state is saved this often (0 means never) and can be resumed from
+  size_t checkpoint_interval;
+  std::string checkpoint_file;
+
+  // how vtk data arrays are stored, and the time series of each file written
+  vtk_enc_t vtk_enc;
+  VtkPvdIndex vtk_index;
+
+  // only some particles and field points need be written
+  OutputFilter part_out;
+  OutputFilter fldpt_out;
+
+  // velocity and vorticity at the field points, every few steps, kept in memory until written
+  ProbeSampler probes;
+
+  // the sponge downstream which retires the wake, and keeps what it took
+  Outflow<STORE> outflow;
+
+  // or write hdf5 series instead
+  bool use_hdf5;
+#ifdef USE_HDF5
+  Hdf5Writer h5out;
+#endif
+
+  // vtk files are written from snapshots on background threads, at most this many at once (0 means
+  //   write them here), and each job returns its file names; list these last so they finish first
+  size_t output_depth;
+  std::deque<std::future<std::vector<std::string>>> output_jobs;
+  std::vector<std::string> output_done;
+
+  // frames go to viewers on this port every stream_interval steps (0 means never), with
+  //   every stream_stride-th particle or field point, and optionally quantized to 16 bits;
+  //   only local viewers unless stream_address names another interface
+  int stream_port;
+  std::string stream_address;
+  size_t stream_interval;
+  size_t stream_stride;
+  bool stream_quantize;
+  FrameStreamServer stream;
 };
 
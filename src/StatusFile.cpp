@@ -12,8 +12,8 @@
 #endif
 
 #include <iostream>
-#include <fstream>
 #include <cassert>
+#include <cstdint>
 
 // are we even using the status file?
 bool
@@ -25,6 +25,7 @@ StatusFile::is_active() {
 void
 StatusFile::set_filename(const std::string _fn) {
   assert(not _fn.empty() && "Filename is blank");
+  if (outfile.is_open() and _fn != fn) outfile.close();
   use_it = true;
   fn = _fn;
 }
@@ -34,52 +35,117 @@ StatusFile::get_filename() {
   return fn;
 }
 
+// text and csv can be read by anything, binary has no parsing at all
+void
+StatusFile::set_format(const status_fmt_t _fmt) {
+  if (outfile.is_open() and _fmt != format) outfile.close();
+  format = _fmt;
+  header.clear();
+}
+
+status_fmt_t
+StatusFile::get_format() {
+  return format;
+}
+
 // begin writing a new data set to the file
 void
 StatusFile::reset_sim() {
   if (use_it) {
+    flush();
     num_lines = 0;
   }
 }
 
-// append an int or float to the list to write
+// append a named int or float to the list to write
 void
-StatusFile::append_value(const float _val) {
+StatusFile::append_value(const std::string _name, const float _val) {
+  names.push_back(_name);
   vals.push_back(_val);
 }
 void
-StatusFile::append_value(const int _val) {
+StatusFile::append_value(const std::string _name, const int _val) {
+  names.push_back(_name);
   vals.push_back(_val);
 }
 
+// push everything buffered out to the file
+void
+StatusFile::flush() {
+  if (outfile.is_open()) outfile.flush();
+  last_flush = std::chrono::steady_clock::now();
+}
+
+//
+// every data set, and every change in the columns, starts with the column names: a
+//   commented line for text, a plain line for csv, and for binary the tag "O2DS", the
+//   number of columns, and each column's type (0 float, 1 int) and length-prefixed name
+//
+void
+StatusFile::write_header() {
+  if (format == status_binary) {
+    const uint32_t ncols = (uint32_t)names.size();
+    outfile.write("O2DS", 4);
+    outfile.write((const char*)&ncols, sizeof(ncols));
+    for (size_t i=0; i<names.size(); ++i) {
+      const uint8_t type = std::holds_alternative<int>(vals[i]) ? 1 : 0;
+      const uint32_t len = (uint32_t)names[i].size();
+      outfile.write((const char*)&type, sizeof(type));
+      outfile.write((const char*)&len, sizeof(len));
+      outfile.write(names[i].data(), len);
+    }
+  } else {
+    if (format == status_text) outfile << "# ";
+    for (size_t i=0; i<names.size(); ++i) {
+      outfile << names[i] << (i+1 < names.size() ? (format == status_csv ? "," : " ") : "\n");
+    }
+  }
+  header = names;
+}
+
 // write a line
 void
 StatusFile::write_line() {
   if (use_it) {
-    std::ofstream outfile;
     assert(not fn.empty() && "Filename is blank");
-    outfile.open(fn, std::ios::app);
+    if (not outfile.is_open()) {
+      const auto mode = (format == status_binary) ? std::ios::app | std::ios::binary : std::ios::app;
+      outfile.open(fn, mode);
+      last_flush = std::chrono::steady_clock::now();
+      header.clear();
+    }
 
     // is this a new data set?
     if (num_lines == 0) {
-      if (num_sims > 0) outfile << std::endl;
-      outfile << "# new run" << std::endl;
+      if (format == status_text) {
+        if (num_sims > 0) outfile << "\n";
+        outfile << "# new run\n";
+      }
+      header.clear();
       num_sims++;
     }
+    if (names != header) write_header();
 
     // write data line
-    for (auto &val : vals) {
-      std::visit([&outfile](const auto& v) { outfile << v; }, val);
-      if (val == vals.back()) {
-        outfile << std::endl;
-      } else {
-        outfile << " ";
+    if (format == status_binary) {
+      for (auto &val : vals) {
+        std::visit([this](const auto& v) { outfile.write((const char*)&v, sizeof(v)); }, val);
+      }
+    } else {
+      const char sep = (format == status_csv) ? ',' : ' ';
+      for (size_t i=0; i<vals.size(); ++i) {
+        std::visit([this](const auto& v) { outfile << v; }, vals[i]);
+        outfile << (i+1 < vals.size() ? sep : '\n');
       }
     }
     num_lines++;
+
+    // lines sit in the buffer for no longer than this
+    if (std::chrono::steady_clock::now() - last_flush > std::chrono::duration<double>(flush_secs)) flush();
   }
 
-  // empty the vector
+  // empty the vectors
   vals.clear();
+  names.clear();
 }
 
@@ -10,11 +10,20 @@
 #include <variant>
 #include <string>
 #include <vector>
+#include <fstream>
+#include <chrono>
 
 
 // a float or integer element
 using StatusValue = std::variant<float, int>;
 
+// space-separated text, comma-separated, or packed 4-byte values
+enum status_fmt_t {
+  status_text   = 1,
+  status_csv    = 2,
+  status_binary = 3
+};
+
 
 // 1-D elements
 class StatusFile {
@@ -24,23 +33,39 @@ public:
     num_sims(0),
     num_lines(0),
     fn(""),
-    vals()
+    format(status_text),
+    flush_secs(10.0),
+    vals(),
+    names()
   {}
 
   // functions
   bool is_active();
   void set_filename(const std::string);
   std::string get_filename();
+  void set_format(const status_fmt_t);
+  status_fmt_t get_format();
   void reset_sim();
-  void append_value(const float);
-  void append_value(const int);
+  void append_value(const std::string, const float);
+  void append_value(const std::string, const int);
   void write_line();
+  void flush();
 
   // member variables
   bool use_it;
   int num_sims;				// number of data sets in this file
   int num_lines;			// number of data lines in this set
   std::string fn;			// the status file name
+  status_fmt_t format;			// how each line is written
+  double flush_secs;			// longest time a line waits in the buffer
   std::vector<StatusValue> vals;	// values to write at each step
+  std::vector<std::string> names;	// and their column names
+
+private:
+  void write_header();
+
+  std::ofstream outfile;		// stays open between lines
+  std::vector<std::string> header;	// the columns last written in a header
+  std::chrono::steady_clock::time_point last_flush;
 };
 
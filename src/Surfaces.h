@@ -9,7 +9,9 @@
 
 #include "Omega2D.h"
 #include "VectorHelper.h"
+#include "Hdf5Writer.h"
 #include "ElementBase.h"
+#include "PanelTree.h"
 
 #ifdef USE_GL
 #include "GlState.h"
@@ -25,6 +27,7 @@
 #include <array>
 #include <algorithm> // for max_element
 #include <optional>
+#include <cmath>
 #include <cassert>
 
 
@@ -199,18 +202,76 @@ public:
   const std::array<Vector<S>,Dimensions>&  get_norm() const { return b[1]; }
   const Vector<S>&                         get_area() const { return area; }
 
+  // nodes, and the panel arrays
+  size_t get_mem_bytes() const {
+    size_t bytes = ElementBase<S>::get_mem_bytes() + vec_bytes(idx) + vec_bytes(area) + vec_bytes(pu);
+    for (const auto& bv : b) bytes += vec_bytes(bv);
+    return bytes + vec_bytes(ps) + vec_bytes(bc);
+  }
+
+  // the panels never change, but their positions, strengths, and solved rotation do
+  void write_state(CheckpointWriter& _out) const {
+    ElementBase<S>::write_state(_out);
+    _out.put(np);
+    _out.put_vec(area);
+    for (const auto& bv : b) _out.put_vecs(bv);
+    _out.put_vecs(pu);
+    for (const auto& str : ps) _out.put_opt(str);
+    for (const auto& str : bc) _out.put_opt(str);
+    _out.put(utc);
+    _out.put(tc);
+    _out.put(solved_omega);
+    _out.put(omega_error);
+    _out.put(this_omega);
+    _out.put(reabsorbed_gamma);
+  }
+  void read_state(CheckpointReader& _in) {
+    ElementBase<S>::read_state(_in);
+    if (_in.get<size_t>() != np) _in.fail();
+    _in.get_vec(area);
+    for (auto& bv : b) _in.get_vecs(bv);
+    _in.get_vecs(pu);
+    for (auto& str : ps) _in.get_opt(str);
+    for (auto& str : bc) _in.get_opt(str);
+    utc = _in.get<std::array<S,Dimensions>>();
+    tc = _in.get<std::array<S,Dimensions>>();
+    solved_omega = _in.get<double>();
+    omega_error = _in.get<double>();
+    this_omega = _in.get<double>();
+    reabsorbed_gamma = _in.get<S>();
+    // the nodes were moved without a transform
+    geom_gen = next_state_gen();
+    geom_pose = {std::nan(""), std::nan(""), std::nan("")};
+    for (auto& t : ut) t.clear();
+  }
+  size_t get_gl_bytes() const {
+#ifdef USE_GL
+    if (mgl) return mgl->num_bytes;
+#endif
+    return 0;
+  }
+
+  // the tree for nearest-panel searches, rebuilt only when the nodes have moved
+  const PanelTree<S>& get_panel_tree() const {
+    if (ptree.size() != np or ptree_gen != geom_gen) {
+      ptree.build(this->x, idx);
+      ptree_gen = geom_gen;
+    }
+    return ptree;
+  }
+
   // override the ElementBase versions and send the panel-center vels
   const std::array<Vector<S>,Dimensions>&   get_vel() const { return pu; }
   std::array<Vector<S>,Dimensions>&         get_vel()       { return pu; }
 
   // fixed or unknown surface strengths, or those due to rotation
   const Vector<S>&                          get_str() const { return *ps[0]; }
-  Vector<S>&                                get_str()       { return *ps[0]; }
+  Vector<S>&                                get_str()       { this->str_changed(); return *ps[0]; }
   const Vector<S>&                     get_vort_str() const { return *ps[0]; }
-  Vector<S>&                           get_vort_str()       { return *ps[0]; }
+  Vector<S>&                           get_vort_str()       { this->str_changed(); return *ps[0]; }
   const bool                           have_src_str() const { return (bool)ps[1]; }
   const Vector<S>&                      get_src_str() const { return *ps[1]; }
-  Vector<S>&                            get_src_str()       { return *ps[1]; }
+  Vector<S>&                            get_src_str()       { this->str_changed(); return *ps[1]; }
 
   // and (reactive only) boundary conditions
   const Vector<S>&                     get_tang_bcs() const { return *bc[0]; }
@@ -224,21 +285,23 @@ public:
   const Int get_next_row()  const { return istart+get_num_rows(); }
 
   // assign the new strengths from BEM - do not let base class do this
-  void set_str(const size_t ioffset, const size_t icnt, Vector<S> _in) {
+  void set_str(const size_t ioffset, const size_t icnt, const Vector<S>& _in) {
 
     assert(ps[0] && "Strength array does not exist");
 
-    // pop off the "unknown" rotation rate and save it
+    // the "unknown" rotation rate is last, save it
+    size_t nstr = _in.size();
     if (is_augmented()) {
       solved_omega = _in.back();
-      std::cout << "    solved rotation rate is " << solved_omega << std::endl;
+      LOG_DEBUG("    solved rotation rate is " << solved_omega);
       omega_error = solved_omega - this->B->get_rotvel();
-      std::cout << "    error in rotation rate is " << omega_error << std::endl;
-      _in.pop_back();
+      LOG_DEBUG("    error in rotation rate is " << omega_error);
+      --nstr;
     }
 
-    assert(_in.size() == (*ps[0]).size()*num_unknowns_per_panel() && "Set strength array size does not match");
+    assert(nstr == (*ps[0]).size()*num_unknowns_per_panel() && "Set strength array size does not match");
     //assert(ioffset == 0 && "Offset is not zero");
+    this->str_changed();
 
     // copy the BEM-solved strengths into the panel-strength data structures
     if (source_str_is_unknown) {
@@ -252,7 +315,7 @@ public:
       }
     } else {
       // only vortex strengths
-      *ps[0] = _in;
+      ps[0]->assign(_in.begin(), _in.begin()+nstr);
       //for (size_t i=0; i<get_npanels(); ++i) {
         //Int id0 = idx[2*i];
         //Int id1 = idx[2*i+1];
@@ -300,7 +363,7 @@ public:
   }
 
   // append nodes and panels to this collection
-  void add_new(const ElementPacket<float>& _in) {
+  void add_new(const ElementPacket<S>& _in) {
 
     // ensure that this packet really is Surfaces
     assert(_in.idx.size() != 0 && "Input ElementPacket is not Surfaces");
@@ -340,6 +403,8 @@ public:
         this->x[d][nnold+i] = _in.x[Dimensions*i+d];
       }
     }
+    this->state_changed();
+    geom_gen = next_state_gen();
 
     // save them as untransformed if we have a Body pointer
     if (this->B) {
@@ -500,6 +565,19 @@ public:
     }
   }
 
+  // the strengths as they are, to put back to the bit (generations too) once the rotation
+  //   has been added and used, in place of subtracting it again
+  struct SavedStrengths {
+    Strength<S> str;
+    uint32_t state_gen, str_gen;
+  };
+  SavedStrengths save_strengths() const { return {ps, this->state_gen, this->str_gen}; }
+  void restore_strengths(SavedStrengths&& _saved) {
+    ps = std::move(_saved.str);
+    this->state_gen = _saved.state_gen;
+    this->str_gen = _saved.str_gen;
+  }
+
   // augment the strengths with a value equal to that which accounts for
   //   the solid-body rotation of the object
   // NOTE: this needs to provide both the vortex AND source strengths!
@@ -521,6 +599,20 @@ public:
 
     assert(ps[0]->size() == get_npanels() && "Strength array is not the same as panel count");
     assert(ps[1]->size() == get_npanels() && "Strength array is not the same as panel count");
+    // adding zero leaves every strength as it was
+    if (_rotvel == 0.0) {
+      // no change at all
+    } else if (this->str_gen == rot_base_gen and this->pos_gen == rot_base_pos and _rotvel == rot_rate) {
+      // the same rotation added to the same strengths gives the same strengths, to the bit,
+      //   so they can have the same generation as last time
+      this->state_gen = this->str_gen = rot_gen;
+    } else {
+      rot_base_gen = this->str_gen;
+      rot_base_pos = this->pos_gen;
+      rot_rate = _rotvel;
+      this->str_changed();
+      rot_gen = this->str_gen;
+    }
 
     // still here? let's do it. use the untransformed coordinates
     for (size_t i=0; i<get_npanels(); i++) {
@@ -656,9 +748,6 @@ public:
     // must explicitly call the method in the base class
     ElementBase<S>::transform(_time);
 
-    // and recalculate the basis vectors
-    compute_bases(np);
-
     if (this->B and this->M == bodybound) {
     //if (this->B) {
       // prepare for the transform
@@ -671,13 +760,64 @@ public:
       tc[0] = (S)thispos[0] + utc[0]*ct - utc[1]*st;
       tc[1] = (S)thispos[1] + utc[0]*st + utc[1]*ct;
 
+      // the nodes only really moved if the body did
+      const std::array<double,3> pose = {thispos[0], thispos[1], theta};
+      if (pose != geom_pose or this->get_pos_gen() != bases_gen) {
+        rotate_bases(st, ct);
+        bases_gen = this->get_pos_gen();
+      }
+      if (pose != geom_pose) {
+        geom_pose = pose;
+        geom_gen = next_state_gen();
+      }
+
     } else {
+      // and recalculate the basis vectors
+      compute_bases(np);
+
       // transform the utc to tc here
       tc[0] = utc[0];
       tc[1] = utc[1];
     }
   }
 
+  // a rigid motion only turns the panels, so rotate the tangents of the untransformed
+  //   geometry, found once, rather than recomputing them; areas do not change
+  void rotate_bases(const S _st, const S _ct) {
+    assert(this->ux && "Untransformed positions have not been set");
+    if (ut[0].size() != np) {
+      for (size_t d=0; d<Dimensions; ++d) ut[d].resize(np);
+      for (size_t i=0; i<np; ++i) {
+        const size_t id0 = idx[2*i];
+        const size_t id1 = idx[2*i+1];
+        const S dx = (*this->ux)[0][id1] - (*this->ux)[0][id0];
+        const S dy = (*this->ux)[1][id1] - (*this->ux)[1][id0];
+        const S ilen = 1.0 / std::sqrt(dx*dx + dy*dy);
+        ut[0][i] = dx * ilen;
+        ut[1][i] = dy * ilen;
+      }
+    }
+    // a collection grown since its bases were computed needs the new areas, too
+    if (area.size() != np) compute_bases(np);
+
+    const S* const ut0 = ut[0].data();
+    const S* const ut1 = ut[1].data();
+    S* const t0 = b[0][0].data();
+    S* const t1 = b[0][1].data();
+    S* const n0 = b[1][0].data();
+    S* const n1 = b[1][1].data();
+    #pragma omp simd
+    for (size_t i=0; i<np; ++i) {
+      const S tx = ut0[i]*_ct - ut1[i]*_st;
+      const S ty = ut0[i]*_st + ut1[i]*_ct;
+      t0[i] = tx;
+      t1[i] = ty;
+      // the normal points into the fluid, as in compute_bases
+      n0[i] = -ty;
+      n1[i] = tx;
+    }
+  }
+
 
   void zero_vels() {
     // zero the local, panel-center vels
@@ -729,6 +869,7 @@ public:
 
     // must explicitly call the method in the base class
     ElementBase<S>::move(_time, _dt, _wt1, _u1);
+    if (this->M == lagrangian) geom_gen = next_state_gen();
 
 /*
     // no specialization needed
@@ -752,6 +893,7 @@ public:
         if (thisstr > thismax) thismax = thisstr;
 
       }
+      this->state_changed();
       if (max_strength < 0.0) {
         max_strength = thismax;
       } else {
@@ -777,6 +919,7 @@ public:
             const double _wt2, Surfaces<S> const & _u2) {
     // must explicitly call the method in the base class
     ElementBase<S>::move(_time, _dt, _wt1, _u1, _wt2, _u2);
+    if (this->M == lagrangian) geom_gen = next_state_gen();
 
     // must confirm that incoming time derivates include velocity (?)
 
@@ -794,6 +937,7 @@ public:
             const double _wt2, Surfaces<S> const & _u2) {
     // must explicitly call the method in the base class
     ElementBase<S>::move(_time, _dt, _wt0, _u0, _wt1, _u1, _wt2, _u2);
+    if (this->M == lagrangian) geom_gen = next_state_gen();
 
     // must confirm that incoming time derivates include velocity (?)
 
@@ -832,7 +976,7 @@ public:
       px[4*i+0] += _offset * norm[0][i];
       px[4*i+1] += _offset * norm[1][i];
       // the panel strength is the solved strength plus the boundary condition
-      float this_str = (*ps[0])[i];
+      S this_str = (*ps[0])[i];
       // add on the (vortex) bc value here
       if (this->E == reactive) this_str += (*bc[0])[i];
       // complete the element with a strength
@@ -851,9 +995,9 @@ public:
     // how many panels?
     const size_t num_pts = get_npanels();
 
-    std::vector<float> _x(Dimensions*num_pts);
+    std::vector<S> _x(Dimensions*num_pts);
     std::vector<Int> _idx;
-    std::vector<float> _vals(num_pts);
+    std::vector<S> _vals(num_pts);
 
     // get basis vectors
     std::array<Vector<S>,2>& norm = b[1];
@@ -873,14 +1017,14 @@ public:
       _x[2*i+0] += _offset * norm[0][i];
       _x[2*i+1] += _offset * norm[1][i];
       // the panel strength is the solved strength plus the boundary condition
-      float this_str = (*ps[0])[i];
+      S this_str = (*ps[0])[i];
       // add on the (vortex) bc value here
       if (this->E == reactive) this_str += (*bc[0])[i];
       // complete the element with a strength
       _vals[i] = this_str * area[i];
     }
 
-    return ElementPacket<float>({_x, _idx, _vals, (size_t)num_pts, 0});
+    return ElementPacket<S>({_x, _idx, _vals, (size_t)num_pts, 0});
   }
 
   // find the new peak vortex strength magnitude
@@ -985,6 +1129,8 @@ public:
   void reset_augmentation_vars() {
     this_omega = this->B->get_rotvel();
     reabsorbed_gamma = 0.0;
+    // both feed the augmented BEM row
+    this->state_changed();
   }
 
   S get_last_body_circ_error() {
@@ -994,6 +1140,7 @@ public:
   // *add* the given circulation to the reabsorbed accumulator
   void add_to_reabsorbed(const S _circ) {
     reabsorbed_gamma += _circ;
+    this->state_changed();
   }
 
   // return that amount of reabsorbed circulation
@@ -1078,6 +1225,9 @@ public:
     glBindVertexArray(0);
   }
 
+  // panels are few, so they are still uploaded by updateGL, see Points::publishGL
+  void publishGL() {}
+
   // this gets done every time we change the size of the index array
   void updateGL() {
     //std::cout << "inside Surfaces.updateGL" << std::endl;
@@ -1117,6 +1267,8 @@ public:
 
       // must tell draw call how many elements are there - or, really, how many indices
       mgl->num_uploaded = idx.size();
+      mgl->num_bytes = vlen*Dimensions + sizeof(Int)*idx.size() +
+                       ((this->E != inert and ps[0]) ? ps[0]->size()*sizeof(S) : 0);
     }
   }
 
@@ -1177,10 +1329,10 @@ public:
     return retstr;
   }
 
-  std::string write_vtk(const size_t _index, const size_t _frameno, const double _time) {
+  std::string write_vtk(const size_t _index, const size_t _frameno, const double _time,
+                        const vtk_enc_t _enc = vtk_zlib) {
     assert(this->np > 0 && "Inside write_vtu_panels with no panels");
   
-    const bool asbase64 = true;
     bool has_vort_str = false;
     bool has_src_str = false;
     std::string prefix = "panel_";
@@ -1192,7 +1344,7 @@ public:
     // generate file name
     std::stringstream vtkfn;
     vtkfn << prefix << std::setfill('0') << std::setw(2) << _index << "_" << std::setw(5) << _frameno << ".vtu";
-    VtkXmlWriter panelWriter = VtkXmlWriter(vtkfn.str(), asbase64);
+    VtkXmlWriter panelWriter = VtkXmlWriter(vtkfn.str(), _enc);
     // push comment with sim time?
   
     // include simulation time here
@@ -1219,9 +1371,9 @@ public:
     {
       std::map<std::string, std::string> attribs = {{"NumberOfComponents", "3"},
                                                     {"Name",               "position"},
-                                                    {"type",               "Float32"}}; 
+                                                    {"type",               vtk_type_name<S>()}}; 
       panelWriter.addElement("DataArray", attribs);
-      Vector<float> pos = panelWriter.unpackArray(this->x);
+      Vector<S> pos = panelWriter.unpackArray(this->x);
       panelWriter.writeDataArray(pos);
       panelWriter.closeElement();
     }
@@ -1279,7 +1431,7 @@ public:
   
     if (has_vort_str) {
       std::map<std::string, std::string> attribs = {{"Name", "vortex sheet strength"},
-                                                    {"type", "Float32"}};
+                                                    {"type", vtk_type_name<S>()}};
       panelWriter.addElement("DataArray", attribs);
       panelWriter.writeDataArray(*this->ps[0]);
       panelWriter.closeElement();
@@ -1287,7 +1439,7 @@ public:
   
     if (has_src_str) {
       std::map<std::string, std::string> attribs = {{"Name", "source sheet strength"},
-                                                    {"type", "Float32"}};
+                                                    {"type", vtk_type_name<S>()}};
       panelWriter.addElement("DataArray", attribs);
       panelWriter.writeDataArray(*this->ps[1]);
       panelWriter.closeElement();
@@ -1296,9 +1448,9 @@ public:
     {
       std::map<std::string, std::string> attribs = {{"NumberOfComponents", "3"},
                                                     {"Name",               "velocity"},
-                                                    {"type",               "Float32"}}; 
+                                                    {"type",               vtk_type_name<S>()}}; 
       panelWriter.addElement("DataArray", attribs);
-      Vector<float> vel = panelWriter.unpackArray(this->u);
+      Vector<S> vel = panelWriter.unpackArray(this->u);
       panelWriter.writeDataArray(vel);
       panelWriter.closeElement();
     }
@@ -1308,10 +1460,30 @@ public:
     panelWriter.closeElement();
   
     panelWriter.finish();
-    std::cout << "Wrote " << this->np << " panels to " << vtkfn.str() << std::endl;
+    LOG_INFO("Wrote " << this->np << " panels to " << vtkfn.str());
     return vtkfn.str();
   }
 
+#ifdef USE_HDF5
+  // the same data as write_vtk, as one step of an hdf5 series
+  std::string write_hdf5(Hdf5Writer& _out, const size_t _index, const size_t _frameno, const double _time) {
+    assert(this->np > 0 && "Inside write_hdf5 with no panels");
+
+    std::stringstream series;
+    series << "panel_" << std::setfill('0') << std::setw(2) << _index;
+    Hdf5Step step(_out, series.str(), _frameno, _time);
+    step.add_geometry(this->x);
+    step.add_topology("Polyline", this->np, idx.size()/this->np, idx);
+    if (not this->E) {
+      step.add_scalar("vortex sheet strength", *this->ps[0], true);
+      if (this->ps[1]) step.add_scalar("source sheet strength", *this->ps[1], true);
+    }
+    step.add_vector("velocity", this->u, true);
+    LOG_INFO("Wrote " << this->np << " panels to " << series.str() << ".h5");
+    return step.end_step();
+  }
+#endif
+
 protected:
   // ElementBase.h has x, s, u, ux on the *nodes*
 
@@ -1340,6 +1512,20 @@ protected:
   double                    this_omega; // rotation rate at most recent Diffusion step
   S                   reabsorbed_gamma; // amount of circulation reabsorbed by this collection since last Diffusion step
 
+  // the strengths and rotation rate of the last add_rot_strengths_base, and the generation it gave
+  uint32_t        rot_base_gen = 0;
+  uint32_t        rot_base_pos = 0;
+  S                   rot_rate = 0.0;
+  uint32_t             rot_gen = 0;
+
+  // nearest-panel search tree, and the geometry it was built from
+  uint32_t     geom_gen = next_state_gen(); // new whenever the nodes move
+  std::array<double,3>         geom_pose = {std::nan(""), std::nan(""), std::nan("")}; // body pose at last transform
+  uint32_t                     bases_gen = 0; // generation of the nodes the bases were rotated for
+  std::array<Vector<S>,Dimensions>    ut; // unit tangents of the untransformed panels
+  mutable PanelTree<S>           ptree;
+  mutable uint32_t           ptree_gen = 0;
+
 private:
 #ifdef USE_GL
   std::shared_ptr<GlState> mgl;
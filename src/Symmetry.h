@@ -0,0 +1,79 @@
+/*
+ * Symmetry.h - A symmetry plane (or slip ground plane) through implicit images
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Kernels.h"
+#include "Surfaces.h"
+#include "ExecEnv.h"
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+
+//
+// Only the half of the flow above the plane y=height is stored; every vortex and panel there
+//   has an image below, with the opposite vortex strength and the same source strength, so
+//   the plane carries no normal flow. The images are never made: the mirrored kernels in
+//   Kernels.h add them pair by pair, and the fast summations evaluate the stored half at the
+//   mirrored targets, whose velocity reflects into that of the images. Each case keeps
+//   its plane in the ExecEnv.
+//
+
+//
+// Add the images of the source panels to a block of BEM coefficients (already scaled by
+//   1/2pi, and before augmentation), so the system holds only the stored half
+//
+template <class S>
+void add_mirror_panel_coeffs (const Surfaces<S>& src, const Surfaces<S>& targ, const SymmetryPlane& sp,
+                              Vector<S>& coeffs) {
+
+  const S yp = (S)sp.get_yp();
+  const size_t nsrc  = src.get_npanels();
+  const size_t ntarg = targ.get_npanels();
+  const size_t nus = src.num_unknowns_per_panel();
+  const size_t nut = targ.num_unknowns_per_panel();
+  const size_t nrows = ntarg * nut;
+
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const std::vector<Int>&                 si = src.get_idx();
+  const std::array<Vector<S>,Dimensions>& tx = targ.get_pos();
+  const std::vector<Int>&                 ti = targ.get_idx();
+  const std::array<Vector<S>,Dimensions>& tt = targ.get_tang();
+  const std::array<Vector<S>,Dimensions>& tn = targ.get_norm();
+
+  const S fac = 1.0 / (2.0 * M_PI);
+
+  #pragma omp parallel for
+  for (int32_t j=0; j<(int32_t)nsrc; ++j) {
+    // only the image, since the block already has the panel itself
+    const S sx0 = sx[0][si[2*j]];
+    const S sy0 = yp - sx[1][si[2*j]];
+    const S sx1 = sx[0][si[2*j+1]];
+    const S sy1 = yp - sx[1][si[2*j+1]];
+
+    for (size_t i=0; i<ntarg; ++i) {
+      const S xi = 0.5 * (tx[0][ti[2*i]] + tx[0][ti[2*i+1]]);
+      const S yi = 0.5 * (tx[1][ti[2*i]] + tx[1][ti[2*i+1]]);
+
+      S vu, vv, su, sv;
+      kernelu_1vos_0p<S,S>(sx0, sy0, sx1, sy1, -1.0, 1.0, xi, yi, &vu, &vv, &su, &sv);
+
+      for (size_t q=0; q<nus; ++q) {
+        const S u = (q == 0) ? vu : su;
+        const S v = (q == 0) ? vv : sv;
+        S* const col = coeffs.data() + (j*nus + q)*nrows;
+        col[i*nut] += fac * (u*tt[0][i] + v*tt[1][i]);
+        if (nut == 2) col[i*nut+1] += fac * (u*tn[0][i] + v*tn[1][i]);
+      }
+    }
+  }
+}
@@ -0,0 +1,127 @@
+/*
+ * ThreadPool.h - Long-lived worker threads for stepping and background jobs
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Profiler.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+
+//
+// A fixed set of threads running jobs in the order they were submitted
+//
+// OpenMP keeps a team of threads for every thread which opens a parallel region, so a
+//   thread which lives for the whole run reuses its team each step instead of starting a
+//   new one; and background workers ask for only a quarter of the cores each, so while they
+//   run beside the step thread there are at most half again as many threads as cores
+//
+// the workers are not bound to cores: threads inherit their creator's affinity, so that
+//   would confine a worker's whole OpenMP team to one core; use OMP_PROC_BIND for the teams,
+//   or threadAffinity for the step thread's team (see Numa.h)
+//
+// unlike those from std::async, these futures do not wait for their job when destroyed
+//
+class ThreadPool {
+public:
+  ThreadPool(const size_t _nworkers, const int _ompthreads, const std::string _name)
+    : stopping(false) {
+    for (size_t i=0; i<_nworkers; ++i) {
+      const std::string name = _name + (_nworkers > 1 ? " " + std::to_string(i) : "");
+      workers.emplace_back([this, _ompthreads, name]() { run(_ompthreads, name); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stopping = true;
+    }
+    cv.notify_all();
+    for (auto &w : workers) w.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template <class F>
+  auto submit(F&& _func) -> std::future<decltype(_func())> {
+    using R = decltype(_func());
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(_func));
+    std::future<R> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      jobs.emplace_back([task]() { (*task)(); });
+    }
+    cv.notify_one();
+    return result;
+  }
+
+  // the one thread which runs the simulation, with every core for its OpenMP loops
+  static ThreadPool& stepper() {
+    static ThreadPool instance(1, num_cores(), "step");
+    return instance;
+  }
+
+  // output and field point jobs
+  static ThreadPool& background() {
+    static ThreadPool instance(2, std::max(1, num_cores()/4), "background");
+    return instance;
+  }
+
+private:
+  static int num_cores() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return std::max(1, (int)std::thread::hardware_concurrency());
+#endif
+  }
+
+  void run(const int _ompthreads, const std::string _name) {
+    // the row for this thread in a profiler trace
+    PROFILE_THREAD_NAME(_name);
+    (void) _name;
+#ifdef _OPENMP
+    // this only sets the team size for regions opened from this thread
+    omp_set_num_threads(_ompthreads);
+#else
+    (void) _ompthreads;
+#endif
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this]() { return stopping or not jobs.empty(); });
+        if (jobs.empty()) return;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool stopping;
+};
+
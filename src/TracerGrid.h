@@ -0,0 +1,267 @@
+/*
+ * TracerGrid.h - Tracer velocities interpolated from a grid over the tracer cloud
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Collection.h"
+#include "PanelTree.h"
+#include "Logger.h"
+
+#include <json/json.hpp>
+
+#include <vector>
+#include <array>
+#include <variant>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+
+//
+// Dense flow-visualization tracers cost as much per target as the particles do, though
+//   nothing depends on them. With a spacing set, each velocity evaluation instead finds the
+//   velocity on a grid of that spacing over the box around all free tracers (and two cells
+//   more on every side), and gives each tracer the bicubic (Catmull-Rom) interpolation from
+//   its 4x4 nearest nodes: the cost goes from N_tracers*N_vort to N_grid*N_vort + N_tracers.
+//
+// the grid moves and grows with the cloud, and is remade at every stage, so the integrator
+//   keeps its order; tracers within three cells of a boundary, where the velocity changes
+//   quickly, still get their own evaluation, and when the grid would have more nodes than
+//   there are tracers, all of them do
+//
+template <class S>
+class TracerGrid {
+public:
+  bool is_active() const { return spacing > 0.0; }
+
+  // _find_vels evaluates velocities on a vector of collections, as Convection::find_vels
+  template <class F>
+  void find_vels(std::vector<Collection>& _fldpt, const std::vector<Collection>& _bdry, F&& _find_vels) {
+
+    // the free tracers go on the grid, anything else is evaluated as usual
+    std::vector<Collection> others;
+    std::vector<size_t> other_idx;
+    std::vector<Points<S>*> tracers;
+    size_t ntracers = 0;
+    for (size_t c=0; c<_fldpt.size(); ++c) {
+      Points<S>* pts = std::get_if<Points<S>>(&_fldpt[c]);
+      if (pts and pts->is_inert() and pts->get_movet() == lagrangian and pts->get_n() > 0) {
+        tracers.push_back(pts);
+        ntracers += pts->get_n();
+      } else {
+        others.push_back(std::move(_fldpt[c]));
+        other_idx.push_back(c);
+      }
+    }
+
+    // the box around every tracer, then the grid over it
+    S xmin = std::numeric_limits<S>::max();
+    S xmax = std::numeric_limits<S>::lowest();
+    S ymin = xmin;
+    S ymax = xmax;
+    for (const Points<S>* pts : tracers) {
+      const std::array<Vector<S>,Dimensions>& x = pts->get_pos();
+      const auto [x0, x1] = std::minmax_element(x[0].begin(), x[0].end());
+      const auto [y0, y1] = std::minmax_element(x[1].begin(), x[1].end());
+      xmin = std::min(xmin, *x0);
+      xmax = std::max(xmax, *x1);
+      ymin = std::min(ymin, *y0);
+      ymax = std::max(ymax, *y1);
+    }
+    const S h = (S)spacing;
+    x0 = xmin - (S)2.0*h;
+    y0 = ymin - (S)2.0*h;
+    nx = (size_t)std::ceil((xmax - xmin) / h) + 5;
+    ny = (size_t)std::ceil((ymax - ymin) / h) + 5;
+
+    // not worth it, so evaluate them all
+    if (tracers.empty() or nx*ny >= ntracers) {
+      for (size_t k=0; k<others.size(); ++k) _fldpt[other_idx[k]] = std::move(others[k]);
+      _find_vels(_fldpt);
+      return;
+    }
+
+    // the grid nodes, and the tracers too near a wall for it, in collections kept between calls
+    if (probes.empty()) {
+      for (size_t k=0; k<2; ++k) {
+        probes.push_back(Points<S>(ElementPacket<S>(std::vector<S>(), std::vector<Int>(), std::vector<S>(), 0, 0),
+                                   inert, lagrangian, nullptr, 0.0));
+      }
+    }
+    Points<S>& grid = std::get<Points<S>>(probes[0]);
+    grid.resize(nx*ny);
+    std::array<Vector<S>,Dimensions>& gx = grid.get_pos();
+    for (size_t j=0; j<ny; ++j) {
+      for (size_t i=0; i<nx; ++i) {
+        gx[0][j*nx+i] = x0 + h*(S)i;
+        gx[1][j*nx+i] = y0 + h*(S)j;
+      }
+    }
+
+    std::vector<std::vector<uint32_t>> near(tracers.size());
+    size_t nnear = 0;
+    for (size_t t=0; t<tracers.size(); ++t) {
+      near[t] = near_walls(*tracers[t], _bdry, (S)3.0*h);
+      nnear += near[t].size();
+    }
+    Points<S>& exact = std::get<Points<S>>(probes[1]);
+    exact.resize(nnear);
+    std::array<Vector<S>,Dimensions>& ex = exact.get_pos();
+    size_t inear = 0;
+    for (size_t t=0; t<tracers.size(); ++t) {
+      const std::array<Vector<S>,Dimensions>& x = std::as_const(*tracers[t]).get_pos();
+      for (const uint32_t i : near[t]) {
+        ex[0][inear] = x[0][i];
+        ex[1][inear] = x[1][i];
+        ++inear;
+      }
+    }
+
+    const size_t nothers = others.size();
+    for (auto& probe : probes) others.push_back(std::move(probe));
+    LOG_DEBUG("    tracer velocities from a " << nx << " x " << ny << " grid, " << nnear << " of "
+              << ntracers << " tracers near walls evaluated directly");
+    _find_vels(others);
+
+    // interpolate onto the tracers, then take the exact ones
+    for (size_t k=0; k<probes.size(); ++k) probes[k] = std::move(others[nothers+k]);
+    const std::array<Vector<S>,Dimensions>& gu = grid.get_vel();
+    const std::array<Vector<S>,Dimensions>& eu = exact.get_vel();
+    inear = 0;
+    for (size_t t=0; t<tracers.size(); ++t) {
+      Points<S>& pts = *tracers[t];
+      const std::array<Vector<S>,Dimensions>& x = std::as_const(pts).get_pos();
+      std::array<Vector<S>,Dimensions>& u = pts.get_vel();
+
+      #pragma omp parallel for
+      for (int32_t i=0; i<(int32_t)pts.get_n(); ++i) {
+        const std::pair<S,S> vel = interpolate(gu, x[0][i], x[1][i]);
+        u[0][i] = vel.first;
+        u[1][i] = vel.second;
+      }
+
+      for (const uint32_t i : near[t]) {
+        u[0][i] = eu[0][inear];
+        u[1][i] = eu[1][inear];
+        ++inear;
+      }
+    }
+
+    for (size_t k=0; k<other_idx.size(); ++k) _fldpt[other_idx[k]] = std::move(others[k]);
+  }
+
+  void from_json(const nlohmann::json simj) {
+    spacing = 0.0;
+    if (simj.find("tracerGrid") == simj.end()) return;
+    const nlohmann::json j = simj["tracerGrid"];
+    spacing = j.value("spacing", spacing);
+    std::cout << "  setting tracer velocity grid spacing= " << spacing << std::endl;
+  }
+
+  void add_to_json(nlohmann::json& simj) const {
+    if (not is_active()) return;
+    simj["tracerGrid"] = {{"spacing", spacing}};
+  }
+
+private:
+  // Catmull-Rom weights for the four nodes around fraction _t of a cell
+  static std::array<S,4> weights(const S _t) {
+    const S t2 = _t*_t;
+    const S t3 = t2*_t;
+    return {(S)0.5*(-t3 + (S)2.0*t2 - _t),
+            (S)0.5*((S)3.0*t3 - (S)5.0*t2 + (S)2.0),
+            (S)0.5*((S)-3.0*t3 + (S)4.0*t2 + _t),
+            (S)0.5*(t3 - t2)};
+  }
+
+  std::pair<S,S> interpolate(const std::array<Vector<S>,Dimensions>& _gu, const S _x, const S _y) const {
+    const S fx = (_x - x0) / (S)spacing;
+    const S fy = (_y - y0) / (S)spacing;
+    const size_t i = std::clamp((size_t)fx, (size_t)1, nx-3);
+    const size_t j = std::clamp((size_t)fy, (size_t)1, ny-3);
+    const std::array<S,4> wx = weights(fx - (S)i);
+    const std::array<S,4> wy = weights(fy - (S)j);
+    S u = 0.0;
+    S v = 0.0;
+    for (size_t b=0; b<4; ++b) {
+      const size_t row = (j-1+b)*nx + i-1;
+      for (size_t a=0; a<4; ++a) {
+        const S w = wx[a] * wy[b];
+        u += w * _gu[0][row+a];
+        v += w * _gu[1][row+a];
+      }
+    }
+    return {u, v};
+  }
+
+  // indices of the tracers closer than _dist to any panel
+  static std::vector<uint32_t> near_walls(const Points<S>& _pts, const std::vector<Collection>& _bdry, const S _dist) {
+    std::vector<uint8_t> flag(_pts.get_n(), 0);
+    const std::array<Vector<S>,Dimensions>& x = _pts.get_pos();
+
+    for (const auto& coll : _bdry) {
+      if (not std::holds_alternative<Surfaces<S>>(coll)) continue;
+      const Surfaces<S>& surf = std::get<Surfaces<S>>(coll);
+      if (surf.get_npanels() == 0) continue;
+      const std::array<Vector<S>,Dimensions>& sx = surf.get_pos();
+      const std::vector<Int>& si = surf.get_idx();
+      const auto [bx0, bx1] = std::minmax_element(sx[0].begin(), sx[0].end());
+      const auto [by0, by1] = std::minmax_element(sx[1].begin(), sx[1].end());
+      const PanelTree<S>& ptree = surf.get_panel_tree();
+
+      #pragma omp parallel
+      {
+      std::vector<int32_t> cand;
+      #pragma omp for
+      for (int32_t i=0; i<(int32_t)_pts.get_n(); ++i) {
+        if (flag[i]) continue;
+        const S px = x[0][i];
+        const S py = x[1][i];
+        if (px < *bx0-_dist or px > *bx1+_dist or py < *by0-_dist or py > *by1+_dist) continue;
+
+        // the tree returns the nearest panel among a few which might be
+        ptree.nearest_candidates(px, py, cand);
+        for (const int32_t jp : cand) {
+          const S ax = px - sx[0][si[2*jp]];
+          const S ay = py - sx[1][si[2*jp]];
+          const S bx = sx[0][si[2*jp+1]] - sx[0][si[2*jp]];
+          const S by = sx[1][si[2*jp+1]] - sx[1][si[2*jp]];
+          const S blensq = bx*bx + by*by;
+          const S t = (blensq > 0.0) ? std::clamp((ax*bx + ay*by) / blensq, (S)0.0, (S)1.0) : (S)0.0;
+          const S dx = ax - t*bx;
+          const S dy = ay - t*by;
+          if (dx*dx + dy*dy < _dist*_dist) {
+            flag[i] = 1;
+            break;
+          }
+        }
+      }
+      }
+    }
+
+    std::vector<uint32_t> idx;
+    for (size_t i=0; i<flag.size(); ++i) if (flag[i]) idx.push_back((uint32_t)i);
+    return idx;
+  }
+
+  // grid spacing, or zero to evaluate every tracer
+  double spacing = 0.0;
+
+  // the grid nodes and the tracers evaluated directly
+  std::vector<Collection> probes;
+
+  // the last grid: its first node and how many nodes along each side
+  S x0 = 0.0;
+  S y0 = 0.0;
+  size_t nx = 0;
+  size_t ny = 0;
+};
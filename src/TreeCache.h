@@ -0,0 +1,87 @@
+/*
+ * TreeCache.h - Keep fast-summation trees between the stages of a time step
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+
+
+//
+// Each stage of a Runge-Kutta step evaluates copies of the same elements, moved by only
+//   part of a step, so a tree sorted at the first stage still groups them well: later
+//   stages can keep its topology (and any interaction lists) and only refit the node
+//   centers, sizes, and expansions
+//
+// trees are found by the lineage of their source and target collections (copies share
+//   it), their sizes, and the tree parameters; each is tagged with the ExecEnv tree tag
+//   it was built under, and only given out again under that same tag
+//
+struct TreeKey {
+  uint32_t src, targ;
+  size_t nsrc, ntarg;
+  int32_t order;
+  size_t leafsize;
+  float theta;
+
+  bool operator==(const TreeKey& _k) const {
+    return src == _k.src and targ == _k.targ and nsrc == _k.nsrc and ntarg == _k.ntarg and
+           order == _k.order and leafsize == _k.leafsize and theta == _k.theta;
+  }
+};
+
+template <class T>
+class TreeCache {
+public:
+  // remove and return the tree built for this key under this tag, or null if none
+  std::unique_ptr<T> take(const TreeKey& _key, const uint32_t _tag) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (not (it->key == _key)) continue;
+      std::unique_ptr<T> tree;
+      if (it->tag == _tag) tree = std::move(it->tree);
+      entries.erase(it);
+      return tree;
+    }
+    return nullptr;
+  }
+
+  // hand a tree back when done with it; a thread holding one means others build their own
+  void put(const TreeKey& _key, const uint32_t _tag, std::unique_ptr<T> _tree) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (it->key == _key) {
+        entries.erase(it);
+        break;
+      }
+    }
+    entries.push_back(Entry{_key, _tag, std::move(_tree)});
+    // temporary collections (mpi shares, new particles) never come back, drop the oldest
+    while (entries.size() > max_entries) entries.pop_front();
+  }
+
+  static TreeCache& instance() {
+    static TreeCache cache;
+    return cache;
+  }
+
+private:
+  struct Entry {
+    TreeKey key;
+    uint32_t tag;
+    std::unique_ptr<T> tree;
+  };
+
+  static constexpr size_t max_entries = 8;
+
+  std::deque<Entry> entries;
+  std::mutex mtx;
+};
+
@@ -0,0 +1,483 @@
+/*
+ * Treecode.h - Barnes-Hut treecode for particle-on-particle influence
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "Kernels.h"
+#include "Points.h"
+#include "ResultsType.h"
+#include "ExecEnv.h"
+#include "TreeCache.h"
+#include "Logger.h"
+#include "Profiler.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <array>
+#include <complex>
+#include <numeric>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cassert>
+
+
+//
+// One node in the source tree
+//
+template <class S>
+struct TreeNode {
+  S cx, cy;		// center of the multipole expansion
+  S rad;		// radius of the circle about the center which contains all sources
+  S maxr;		// largest core radius of any source in this node
+  size_t ibeg, iend;	// range of the sorted sources contained in this node
+  int32_t child[2];	// indices of the two children, or -1 if this is a leaf
+};
+
+
+//
+// Recursively split the given range of elements along the longer axis of its bounding box
+//
+// elements are given by their centers and optional extents (half-length) and core radii,
+//   nodes are appended to the vector in depth-first order, so children follow their parents
+//
+template <class S>
+int32_t build_tree_node(std::vector<TreeNode<S>>& _nodes,
+                        std::vector<size_t>& _idx,
+                        const size_t _ibeg,
+                        const size_t _iend,
+                        const Vector<S>& _x,
+                        const Vector<S>& _y,
+                        const Vector<S>* _ext,
+                        const Vector<S>* _core,
+                        const size_t _leafsize) {
+
+  // find the bounding box and largest core radius
+  S xmin = _x[_idx[_ibeg]];
+  S xmax = xmin;
+  S ymin = _y[_idx[_ibeg]];
+  S ymax = ymin;
+  S maxr = 0.0;
+  for (size_t i=_ibeg; i<_iend; ++i) {
+    const size_t j = _idx[i];
+    xmin = std::min(xmin, _x[j]);
+    xmax = std::max(xmax, _x[j]);
+    ymin = std::min(ymin, _y[j]);
+    ymax = std::max(ymax, _y[j]);
+    if (_core) maxr = std::max(maxr, (*_core)[j]);
+  }
+
+  TreeNode<S> node;
+  node.cx = 0.5 * (xmin + xmax);
+  node.cy = 0.5 * (ymin + ymax);
+  node.rad = 0.0;
+  for (size_t i=_ibeg; i<_iend; ++i) {
+    const size_t j = _idx[i];
+    const S dx = _x[j] - node.cx;
+    const S dy = _y[j] - node.cy;
+    const S extent = _ext ? (*_ext)[j] : 0.0;
+    node.rad = std::max(node.rad, std::sqrt(dx*dx + dy*dy) + extent);
+  }
+  node.maxr = maxr;
+  node.ibeg = _ibeg;
+  node.iend = _iend;
+  node.child[0] = -1;
+  node.child[1] = -1;
+
+  const int32_t inode = (int32_t)_nodes.size();
+  _nodes.push_back(node);
+
+  // split if we have too many elements and they are not all coincident
+  if (_iend - _ibeg > _leafsize and xmax-xmin + ymax-ymin > 0.0) {
+    const Vector<S>& xs = (xmax-xmin > ymax-ymin) ? _x : _y;
+    const size_t imid = _ibeg + (_iend - _ibeg) / 2;
+    std::nth_element(_idx.begin()+_ibeg, _idx.begin()+imid, _idx.begin()+_iend,
+                     [&xs](const size_t a, const size_t b) { return xs[a] < xs[b]; });
+
+    // do not hold a reference into _nodes, as it may reallocate
+    const int32_t c0 = build_tree_node<S>(_nodes, _idx, _ibeg, imid, _x, _y, _ext, _core, _leafsize);
+    const int32_t c1 = build_tree_node<S>(_nodes, _idx, imid, _iend, _x, _y, _ext, _core, _leafsize);
+    _nodes[inode].child[0] = c0;
+    _nodes[inode].child[1] = c1;
+  }
+
+  return inode;
+}
+
+//
+// Move the nodes over elements which kept their places in the tree but moved in space
+//
+// elements are given in tree order, so each node's range is contiguous, and children
+//   always follow their parents, so a reverse sweep finds every child before its parent
+//
+template <class S>
+void refit_tree_nodes(std::vector<TreeNode<S>>& _nodes,
+                      const Vector<S>& _x,
+                      const Vector<S>& _y,
+                      const Vector<S>* _core) {
+
+  // bounding boxes and largest core radii, from the leaves up
+  std::vector<std::array<S,4>> box(_nodes.size());
+  for (int32_t i=(int32_t)_nodes.size()-1; i>=0; --i) {
+    TreeNode<S>& node = _nodes[i];
+    std::array<S,4>& b = box[i];
+    if (node.child[0] < 0) {
+      b = {_x[node.ibeg], _x[node.ibeg], _y[node.ibeg], _y[node.ibeg]};
+      node.maxr = 0.0;
+      for (size_t j=node.ibeg; j<node.iend; ++j) {
+        b[0] = std::min(b[0], _x[j]);
+        b[1] = std::max(b[1], _x[j]);
+        b[2] = std::min(b[2], _y[j]);
+        b[3] = std::max(b[3], _y[j]);
+        if (_core) node.maxr = std::max(node.maxr, (*_core)[j]);
+      }
+    } else {
+      const std::array<S,4>& b0 = box[node.child[0]];
+      const std::array<S,4>& b1 = box[node.child[1]];
+      b = {std::min(b0[0], b1[0]), std::max(b0[1], b1[1]), std::min(b0[2], b1[2]), std::max(b0[3], b1[3])};
+      node.maxr = std::max(_nodes[node.child[0]].maxr, _nodes[node.child[1]].maxr);
+    }
+    node.cx = 0.5 * (b[0] + b[1]);
+    node.cy = 0.5 * (b[2] + b[3]);
+  }
+
+  // and the enclosing radii, exactly as when built
+  #pragma omp parallel for schedule(dynamic,16)
+  for (int32_t i=0; i<(int32_t)_nodes.size(); ++i) {
+    TreeNode<S>& node = _nodes[i];
+    S rad = 0.0;
+    for (size_t j=node.ibeg; j<node.iend; ++j) {
+      const S dx = _x[j] - node.cx;
+      const S dy = _y[j] - node.cy;
+      rad = std::max(rad, std::sqrt(dx*dx + dy*dy));
+    }
+    node.rad = rad;
+  }
+}
+
+
+//
+// A binary tree over a set of vortex particles, with complex-valued multipole
+//   expansions in each node
+//
+// templatized on 'S'torage and 'A'ccumulator types
+//
+template <class S, class A>
+class SourceTree {
+public:
+  SourceTree(const Points<S>&, const int32_t, const size_t);
+
+  size_t get_n() const { return ss.size(); }
+  size_t get_nnodes() const { return nodes.size(); }
+  int32_t get_order() const { return order; }
+
+  // the same sources, moved: keep the tree and recompute its nodes and multipoles
+  void refit(const Points<S>&);
+
+  template <bool DO_VORT, bool DO_GRAD, bool THICK, VelCore C>
+  size_t evaluate(const S, const S, const S, const S, A*, A*, A*, A*, size_t*) const;
+
+private:
+  void make_multipoles();
+
+  // number of terms in each expansion, and max sources per leaf
+  int32_t order;
+  size_t leaf_size;
+
+  // the nodes, root is node 0
+  std::vector<TreeNode<S>> nodes;
+
+  // the multipole coefficients, order per node
+  std::vector<std::complex<A>> mp;
+
+  // re-ordered copies of the source particles, and where each came from
+  std::array<Vector<S>,Dimensions> sx;
+  Vector<S> sr, ss;
+  std::vector<size_t> perm;
+};
+
+
+//
+// Build the tree: re-order the sources and compute multipole moments
+//
+template <class S, class A>
+SourceTree<S,A>::SourceTree(const Points<S>& _src,
+                            const int32_t _order,
+                            const size_t _leafsize)
+  : order(_order),
+    leaf_size(_leafsize) {
+
+  assert(order > 0 && "Treecode expansion order must be positive");
+  assert(leaf_size > 0 && "Treecode leaf size must be positive");
+
+  const size_t n = _src.get_n();
+
+  // sort an index array instead of the particles themselves
+  std::vector<size_t>& idx = perm;
+  idx.resize(n);
+  std::iota(idx.begin(), idx.end(), 0);
+
+  // get references to use locally
+  const std::array<Vector<S>,Dimensions>& x = _src.get_pos();
+  const Vector<S>&                        r = _src.get_rad();
+  const Vector<S>&                        s = _src.get_str();
+
+  // a balanced binary tree needs at most 2n/leafsize nodes
+  nodes.reserve(2*(n/leaf_size+1));
+  if (n > 0) (void) build_tree_node<S>(nodes, idx, 0, n, x[0], x[1], nullptr, &r, leaf_size);
+
+  // copy the sources into tree order
+  for (size_t d=0; d<Dimensions; ++d) sx[d].resize(n);
+  sr.resize(n);
+  ss.resize(n);
+  for (size_t i=0; i<n; ++i) {
+    sx[0][i] = x[0][idx[i]];
+    sx[1][i] = x[1][idx[i]];
+    sr[i] = r[idx[i]];
+    ss[i] = s[idx[i]];
+  }
+
+  make_multipoles();
+}
+
+//
+// Refit the tree to the moved sources, which must be the ones it was built over
+//
+template <class S, class A>
+void SourceTree<S,A>::refit(const Points<S>& _src) {
+
+  assert(_src.get_n() == perm.size() && "Refit sources do not match the tree");
+
+  const std::array<Vector<S>,Dimensions>& x = _src.get_pos();
+  const Vector<S>&                        r = _src.get_rad();
+  const Vector<S>&                        s = _src.get_str();
+  for (size_t i=0; i<perm.size(); ++i) {
+    sx[0][i] = x[0][perm[i]];
+    sx[1][i] = x[1][perm[i]];
+    sr[i] = r[perm[i]];
+    ss[i] = s[perm[i]];
+  }
+
+  refit_tree_nodes<S>(nodes, sx[0], sx[1], &sr);
+  make_multipoles();
+}
+
+//
+// Compute the multipole coefficients a_k = sum_j s_j (z_j - z_c)^k for every node
+//
+template <class S, class A>
+void SourceTree<S,A>::make_multipoles() {
+
+  mp.resize(nodes.size() * order);
+
+  #pragma omp parallel for schedule(dynamic,16)
+  for (int32_t i=0; i<(int32_t)nodes.size(); ++i) {
+    const TreeNode<S>& node = nodes[i];
+    std::complex<A>* a = &mp[i*order];
+    for (int32_t k=0; k<order; ++k) a[k] = 0.0;
+
+    for (size_t j=node.ibeg; j<node.iend; ++j) {
+      const std::complex<A> dz((A)(sx[0][j] - node.cx), (A)(sx[1][j] - node.cy));
+      std::complex<A> zk((A)ss[j], (A)0.0);
+      for (int32_t k=0; k<order; ++k) {
+        a[k] += zk;
+        zk *= dz;
+      }
+    }
+  }
+}
+
+//
+// Find the velocity (and optionally vorticity, or the four velocity gradients) at one
+//   target point
+//
+// the opening criterion keeps the cores of the sources and target well away from
+//   the node, so the far-field vorticity (which decays with the core function) is
+//   taken as zero, and the far-field gradients come from the derivative of the series
+//
+// returns the number of direct source interactions, and counts the number of
+//   multipole evaluations in the last argument
+//
+template <class S, class A>
+template <bool DO_VORT, bool DO_GRAD, bool THICK, VelCore C>
+size_t SourceTree<S,A>::evaluate(const S _tx, const S _ty, const S _tr,
+                                 const S _theta,
+                                 A* const __restrict__ _tu,
+                                 A* const __restrict__ _tv,
+                                 A* const __restrict__ _tw,
+                                 A* const __restrict__ _tg,
+                                 size_t* const _nfar) const {
+
+  size_t nnear = 0;
+  if (nodes.empty()) return nnear;
+
+  // depth of the tree is logarithmic in n, this will rarely reallocate
+  std::vector<int32_t> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+
+  // accumulate the far-field complex velocity u - iv = -i sum_k a_k / (z-z_c)^(k+1)
+  std::complex<A> farvel(0.0, 0.0);
+  // and sum_k (k+1) a_k / (z-z_c)^(k+2), which times i is its derivative
+  std::complex<A> fargrad(0.0, 0.0);
+
+  while (not stack.empty()) {
+    const int32_t inode = stack.back();
+    stack.pop_back();
+    const TreeNode<S>& node = nodes[inode];
+
+    const S dx = _tx - node.cx;
+    const S dy = _ty - node.cy;
+    const S dist = std::sqrt(dx*dx + dy*dy);
+
+    if (node.rad + node.maxr + _tr < _theta * dist) {
+      // far enough away to use the multipole expansion
+      const std::complex<A>* a = &mp[inode*order];
+      const std::complex<A> oodz = (A)1.0 / std::complex<A>((A)dx, (A)dy);
+      std::complex<A> oodzk = oodz;
+      for (int32_t k=0; k<order; ++k) {
+        farvel += a[k] * oodzk;
+        oodzk *= oodz;
+        if constexpr (DO_GRAD) fargrad += (A)(k+1) * a[k] * oodzk;
+      }
+      (*_nfar)++;
+
+    } else if (node.child[0] < 0) {
+      // a leaf that is too close, sum directly
+      for (size_t j=node.ibeg; j<node.iend; ++j) {
+        if constexpr (DO_GRAD) {
+          if constexpr (THICK) {
+            kernelug_0v_0b<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], _tx, _ty, _tr, _tu, _tv, _tg, _tg+1, _tg+2, _tg+3);
+          } else {
+            kernelug_0v_0p<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], _tx, _ty, _tu, _tv, _tg, _tg+1, _tg+2, _tg+3);
+          }
+        } else if constexpr (THICK) {
+          if constexpr (DO_VORT) {
+            kerneluw_0v_0b<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], _tx, _ty, _tr, _tu, _tv, _tw);
+          } else {
+            kernelu_0v_0b<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], _tx, _ty, _tr, _tu, _tv);
+          }
+        } else {
+          if constexpr (DO_VORT) {
+            kerneluw_0v_0p<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], _tx, _ty, _tu, _tv, _tw);
+          } else {
+            kernelu_0v_0p<S,A,C>(sx[0][j], sx[1][j], sr[j], ss[j], _tx, _ty, _tu, _tv);
+          }
+        }
+      }
+      nnear += node.iend - node.ibeg;
+
+    } else {
+      // open this node
+      stack.push_back(node.child[0]);
+      stack.push_back(node.child[1]);
+    }
+  }
+
+  // multiplying by -i: u = Im(sum), v = Re(sum)
+  *_tu += farvel.imag();
+  *_tv += farvel.real();
+
+  // the derivative is u_x - i v_x, and the far field is irrotational and solenoidal
+  if constexpr (DO_GRAD) {
+    _tg[0] -= fargrad.imag();
+    _tg[1] -= fargrad.real();
+    _tg[2] -= fargrad.real();
+    _tg[3] += fargrad.imag();
+  }
+
+  return nnear;
+}
+
+
+//
+// Points/Particles affecting Points/Particles with a Barnes-Hut treecode
+//
+template <class S, class A, VelCore C>
+void points_affect_points_treecode (const Points<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+
+  LOG_DEBUG("    0v_0" << (targ.is_inert() ? "p" : "v") << " treecode influence of" << src.to_string() << " on" << targ.to_string());
+  assert (!restype.compute_psi() && "Point elements cannot compute streamfunction yet.");
+
+  auto start = std::chrono::system_clock::now();
+
+  // build the tree over the sources, or refit the one from an earlier stage, see TreeCache.h
+  const int32_t order = env.get_expansion_order();
+  const uint32_t tag = env.get_tree_tag();
+  const TreeKey key = {src.get_lineage(), 0, src.get_n(), 0, order, env.get_leaf_size(), 0.0};
+  std::unique_ptr<SourceTree<S,A>> treeptr;
+  if (tag != 0) treeptr = TreeCache<SourceTree<S,A>>::instance().take(key, tag);
+  const bool refit = (treeptr != nullptr);
+  if (refit) treeptr->refit(src);
+  else treeptr = std::make_unique<SourceTree<S,A>>(src, order, env.get_leaf_size());
+  const SourceTree<S,A>& tree = *treeptr;
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    treecode " << (refit ? "refit" : "build") << ":\t[" << elapsed_seconds.count() << "] seconds with " << tree.get_nnodes() << " nodes");
+  start = std::chrono::system_clock::now();
+
+  // get references to use locally
+  const std::array<Vector<S>,Dimensions>& tx = targ.get_pos();
+  std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
+  const bool do_vort = (restype.get_type() == velandvort);
+  const bool do_grad = (restype.get_type() == velandgrad);
+  const S theta = env.get_opening_angle();
+
+  // the target radii only exist for non-inert elements
+  const bool thick = not targ.is_inert();
+  const Vector<S>& tr = targ.get_rad();
+
+  // get_vort() will allocate if necessary, so do that before the parallel loop
+  Vector<S>* tw = do_vort ? &targ.get_vort() : nullptr;
+  std::array<Vector<S>,4>* tg = do_grad ? &targ.get_velgrad() : nullptr;
+
+  size_t nnear = 0;
+  size_t nfar = 0;
+
+  #pragma omp parallel for schedule(dynamic,64) reduction(+:nnear,nfar)
+  for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
+    A accumu = 0.0;
+    A accumv = 0.0;
+    A accumw = 0.0;
+    A accumg[4] = {0.0, 0.0, 0.0, 0.0};
+    if (thick) {
+      if (do_grad)      nnear += tree.template evaluate<false,true,true,C>(tx[0][i], tx[1][i], tr[i], theta, &accumu, &accumv, &accumw, accumg, &nfar);
+      else if (do_vort) nnear += tree.template evaluate<true,false,true,C>(tx[0][i], tx[1][i], tr[i], theta, &accumu, &accumv, &accumw, accumg, &nfar);
+      else              nnear += tree.template evaluate<false,false,true,C>(tx[0][i], tx[1][i], tr[i], theta, &accumu, &accumv, &accumw, accumg, &nfar);
+    } else {
+      if (do_grad)      nnear += tree.template evaluate<false,true,false,C>(tx[0][i], tx[1][i], 0.0, theta, &accumu, &accumv, &accumw, accumg, &nfar);
+      else if (do_vort) nnear += tree.template evaluate<true,false,false,C>(tx[0][i], tx[1][i], 0.0, theta, &accumu, &accumv, &accumw, accumg, &nfar);
+      else              nnear += tree.template evaluate<false,false,false,C>(tx[0][i], tx[1][i], 0.0, theta, &accumu, &accumv, &accumw, accumg, &nfar);
+    }
+    tu[0][i] += accumu;
+    tu[1][i] += accumv;
+    if (do_vort) (*tw)[i] += accumw;
+    if (do_grad) for (size_t k=0; k<4; ++k) (*tg)[k][i] += accumg[k];
+  }
+
+  // direct flops depend on the kernel, each multipole term is a complex multiply-add and multiply
+  float flops = (float)targ.get_n() * 2.0;
+  if (thick) {
+    flops += (float)nnear * (float)(do_grad ? flopsug_0v_0b<S,A,C>() : do_vort ? flopsuw_0v_0b<S,A,C>() : flopsu_0v_0b<S,A,C>());
+  } else {
+    flops += (float)nnear * (float)(do_grad ? flopsug_0v_0p<S,A,C>() : do_vort ? flopsuw_0v_0p<S,A,C>() : flopsu_0v_0p<S,A,C>());
+  }
+  flops += (float)nfar * (float)(20 + (do_grad ? 22 : 14)*order);
+
+  end = std::chrono::system_clock::now();
+  elapsed_seconds = end-start;
+  LOG_DEBUG("    points_affect_points: [" << elapsed_seconds.count() << "] seconds at " << (1.e-9 * flops / elapsed_seconds.count()) << " GFlop/s");
+  PROFILE_FLOPS((thick ? "0v_0v" : "0v_0p"), flops, elapsed_seconds.count());
+  LOG_DEBUG("    treecode used " << nnear << " direct and " << nfar << " multipole evaluations");
+
+  if (tag != 0) TreeCache<SourceTree<S,A>>::instance().put(key, tag, std::move(treeptr));
+}
+
@@ -9,7 +9,10 @@
 
 #include "Core.h"
 #include "VectorHelper.h"
-#include "nanoflann/nanoflann.hpp"
+#include "CellList.h"
+#include "MemoryHelper.h"
+#include "Profiler.h"
+#include "Logger.h"
 #ifdef PLUGIN_SIMPLEX
 #include "simplex.h"
 #endif
@@ -20,7 +23,6 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
-#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
@@ -49,11 +51,20 @@ public:
   const bool get_relative() const { return thresholds_are_relative; }
   const float get_ignore() const { return ignore_thresh; }
   const bool get_simplex() const { return (use_solver==simplex); }
+  void set_reuse_tol(const float _in) { reuse_tol = _in; }
+  const float get_reuse_tol() const { return reuse_tol; }
 
-  // all-to-all diffuse; can change array sizes
+  // the solution cache, and the scratch space of the last call
+  size_t get_mem_bytes() const {
+    return vec_bytes(cache_start) + vec_bytes(cache_dx) + vec_bytes(cache_dy) + vec_bytes(cache_frac) +
+           scratch_bytes;
+  }
+
+  // all-to-all diffuse; can change array sizes; the cell list covers the incoming particles
   void diffuse_all(std::array<Vector<ST>,2>&,
                    Vector<ST>&,
                    Vector<ST>&,
+                   const CellList<ST>&,
                    const ST,
                    const CoreType,
                    const ST);
@@ -66,30 +77,54 @@ public:
   void add_to_json(nlohmann::json&) const;
 
 protected:
-  // search for new target location
-  std::pair<ST,ST> fill_neighborhood_search(const int32_t,
+  // solve VRM to how many moments?
+  static const int32_t num_moments = MAXMOM;
+  static constexpr int32_t num_rows = (num_moments+1) * (num_moments+2) / 2;
+  // we needed 16 here for static solutions, 32 for dynamic, and 64 for dynamic with adaptivity
+  static constexpr int32_t max_near = 32 * num_moments;
+
+  // one neighborhood's moment equations and solution, with maximum sizes fixed by MAXMOM;
+  //   each chunk of particles reuses one of these for all of its solves, off of the heap
+  typedef Eigen::Matrix<CT, num_rows, Eigen::Dynamic, 0, num_rows, max_near> MomentMatrix;
+  typedef Eigen::Matrix<CT, Eigen::Dynamic, 1, 0, max_near, 1> FractionVector;
+  struct SolveWorkspace {
+    MomentMatrix A;
+    Eigen::Matrix<CT, num_rows, 1> b;
+    FractionVector fractions;
+  };
+
+  // search for new target location, given the diffusing particle and its neighbors' positions
+  std::pair<ST,ST> fill_neighborhood_search(const ST,
+                                            const ST,
                                             const Vector<ST>&,
                                             const Vector<ST>&,
-                                            const std::vector<int32_t>&,
                                             const ST);
 
-  // set up and call the solver
-  bool attempt_solution(const int32_t,
-                        std::vector<int32_t>&,
-                        Vector<ST>&,
-                        Vector<ST>&,
-                        Vector<ST>&,
-                        Vector<ST>&,
+  // fill in the moment equations
+  void set_up_equations(const ST,
+                        const ST,
+                        const Vector<ST>&,
+                        const Vector<ST>&,
+                        const ST,
+                        SolveWorkspace&);
+
+  // set up and call the solver, same arguments, the fractions are left in the workspace
+  bool attempt_solution(const ST,
+                        const ST,
+                        const Vector<ST>&,
+                        const Vector<ST>&,
                         const ST,
                         const CoreType,
-                        Eigen::Matrix<CT, Eigen::Dynamic, 1>&);
+                        SolveWorkspace&);
 
 private:
-  // solve VRM to how many moments?
-  static const int32_t num_moments = MAXMOM;
-  static constexpr int32_t num_rows = (num_moments+1) * (num_moments+2) / 2;
-  // we needed 16 here for static solutions, 32 for dynamic, and 64 for dynamic with adaptivity
-  static constexpr int32_t max_near = 32 * num_moments;
+  // a solution is good enough when the moment equations' squared error is below this
+  //   (default to 1e-6, but drop to 1e-4 for adaptive with high overlap?)
+  static constexpr CT nnls_thresh = 1.e-6;
+
+  // particles are diffused in fixed-size chunks, each of which only sees its own new particles,
+  //   so that the result does not depend on the number of threads
+  static constexpr size_t chunk_size = 512;
 
   // new point insertion sites (normalized to h_nu and centered around origin)
   static constexpr size_t num_sites = 30 * ((MAXMOM>2) ? 2 : 1);
@@ -108,9 +143,23 @@ private:
   bool adapt_radii = false;
   // would have more here
 
-  // use nanoflann for nearest-neighbor searching? false uses direct search
+  // use the cell list for nearest-neighbor searching? false uses direct search
   const bool use_tree = true;
 
+  // reuse last call's fractions for a particle whose neighbors have all moved less than this
+  //   fraction of the nominal separation (relative to it), 0 turns the cache off; reused
+  //   fractions must still meet nnls_thresh
+  ST reuse_tol = 0.0;
+  // and the cache: particle i's neighbor offsets and fractions are entries
+  //   cache_start[i] to cache_start[i+1]-1, from the last call with this h_nu
+  ST cache_hnu = 0.0;
+  std::vector<uint32_t> cache_start;
+  Vector<ST> cache_dx, cache_dy;
+  std::vector<CT> cache_frac;
+
+  // largest that the chunks' new particles and lists were in the last call
+  size_t scratch_bytes = 0;
+
   SolverType use_solver = nnls;
   //SolverType use_solver = simplex;
 };
@@ -184,17 +233,17 @@ void VRM<ST,CT,MAXMOM>::set_adaptive_radii(const bool _doamr) {
 // use a ring of sites to determine the location of a new particle
 //
 template <class ST, class CT, uint8_t MAXMOM>
-std::pair<ST,ST> VRM<ST,CT,MAXMOM>::fill_neighborhood_search(const int32_t idx,
-                                                             const Vector<ST>& x,
-                                                             const Vector<ST>& y,
-                                                             const std::vector<int32_t>& inear,
+std::pair<ST,ST> VRM<ST,CT,MAXMOM>::fill_neighborhood_search(const ST xi,
+                                                             const ST yi,
+                                                             const Vector<ST>& nx,
+                                                             const Vector<ST>& ny,
                                                              const ST nom_sep) {
 
   // create array of potential sites
   std::array<ST,num_sites> tx,ty,nearest;
   for (size_t i=0; i<num_sites; ++i) {
-    tx[i] = x[idx] + nom_sep * xsite[i];
-    ty[i] = y[idx] + nom_sep * ysite[i];
+    tx[i] = xi + nom_sep * xsite[i];
+    ty[i] = yi + nom_sep * ysite[i];
   }
 
   // test all points vs. all sites
@@ -203,8 +252,8 @@ std::pair<ST,ST> VRM<ST,CT,MAXMOM>::fill_neighborhood_search(const int32_t idx,
   for (size_t i=0; i<num_sites; ++i) {
     // find the nearest particle to this site
     ST mindistsq = nom_sep * nom_sep;
-    for (size_t j=0; j<inear.size(); ++j) {
-      ST distsq = std::pow(x[inear[j]]-tx[i], 2) + std::pow(y[inear[j]]-ty[i], 2);
+    for (size_t j=0; j<nx.size(); ++j) {
+      ST distsq = std::pow(nx[j]-tx[i], 2) + std::pow(ny[j]-ty[i], 2);
       if (distsq < mindistsq) mindistsq = distsq;
     }
     nearest[i] = mindistsq;
@@ -228,6 +277,7 @@ template <class ST, class CT, uint8_t MAXMOM>
 void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,2>& pos,
                                     Vector<ST>& str,
                                     Vector<ST>& rad,
+                                    const CellList<ST>& cells,
                                     const ST h_nu,
                                     const CoreType core_func,
                                     const ST particle_overlap) {
@@ -238,10 +288,8 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,2>& pos,
   assert(str.size()==rad.size() && "Input arrays are not uniform size");
   size_t n = rad.size();
 
-  std::cout << "  Running VRM with n " << n << std::endl;
-
-  // start timer
-  auto start = std::chrono::system_clock::now();
+  LOG_DEBUG("  Running VRM with n " << n);
+  PROFILE_ZONE("vrm");
 
   // reference or generate the local set of vectors
   Vector<ST>& x = pos[0];
@@ -249,21 +297,11 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,2>& pos,
   Vector<ST>& r = rad;
   Vector<ST>& s = str;
 
-  Vector<ST> newr, ds;
-  newr.resize(n);
-  ds.resize(n);
-
-  // zero out delta vector
-  std::fill(ds.begin(), ds.end(), 0.0);
-
-  // and copy the new radius
-  std::copy(r.begin(), r.end(), newr.begin());
-
-  // create the matrix elements, reusable, and dynamically allocated
-  Eigen::Matrix<CT, Eigen::Dynamic, 1> fractions;
+  // do not adapt particle radii -- copy current to new
+  Vector<ST> newr = r;
 
-  const int32_t minNearby = 7;
-  const int32_t maxNewParts = num_moments*8 - 4;
+  const size_t minNearby = 7;
+  const size_t maxNewParts = num_moments*8 - 4;
 
   // what is maximum strength of all particles?
   const ST maxStr = s[std::max_element(s.begin(), s.end()) - s.begin()];
@@ -271,115 +309,109 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,2>& pos,
   const ST maxAbsStr = std::max(maxStr, -1.f*minStr);
   //std::cout << "maxAbsStr " << maxAbsStr << std::endl;
 
-  // convert particle positions into something nanoflann can understand
-  Eigen::Matrix<ST, Eigen::Dynamic, Dimensions> xp;
-  xp.resize(n,Dimensions);
-  xp.col(0) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(x.data(), n);
-  xp.col(1) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(y.data(), n);
-  
-  // generate the searchable data structure
-  typedef typename Eigen::Matrix<ST, Eigen::Dynamic, 2> EigenMatType;
-  typedef typename EigenMatType::Index EigenIndexType;
-  typedef nanoflann::KDTreeEigenMatrixAdaptor< EigenMatType >  my_kd_tree_t;
-  my_kd_tree_t mat_index(Dimensions, std::cref(xp));
-  if (use_tree) mat_index.index->buildIndex();
-
-  std::vector<std::pair<EigenIndexType,ST> > ret_matches;
-  ret_matches.reserve(max_near);
-  nanoflann::SearchParams params;
-  params.sorted = true;
+  assert((not use_tree or cells.size()==n) && "Cell list does not match particles");
+
+  // everything one chunk produces: new particles, and changes to strengths of the originals
+  //   (indices at or above initial_n in a chunk's neighbor lists refer to its own new particles)
+  struct Chunk {
+    Vector<ST> x, y, r, ds;
+    std::vector<std::pair<int32_t,ST>> dorig;
+    size_t nsolved = 0;
+    size_t nreused = 0;
+    size_t nneibs = 0;
+    size_t minneibs = 999999;
+    size_t maxneibs = 0;
+    // this call's solutions, for the cache
+    std::vector<uint32_t> cnum;
+    Vector<ST> cdx, cdy;
+    std::vector<CT> cfrac;
+  };
+  const bool use_cache = (reuse_tol > 0.0);
+  const bool cache_valid = use_cache and (h_nu == cache_hnu);
+  const size_t initial_n = n;
+  const size_t nchunks = (initial_n + chunk_size - 1) / chunk_size;
+  std::vector<Chunk> chunks(nchunks);
 
-  // do not adapt particle radii -- copy current to new
-  newr = r;
+  // for each particle, in parallel over chunks
+  #pragma omp parallel for schedule(dynamic,1)
+  for (int32_t ic=0; ic<(int32_t)nchunks; ++ic) {
+    Chunk& ch = chunks[ic];
 
-  // for each particle (can parallelize this part)
-  const size_t initial_n = n;
-  size_t nsolved = 0;
-  size_t nneibs = 0;
-  //size_t ntooclose = 0;
-  size_t minneibs = 999999;
-  size_t maxneibs = 0;
-  // note that an OpenMP loop here will need to use int32_t as the counter variable type
-  for (size_t i=0; i<initial_n; ++i) {
+    std::vector<std::pair<int32_t,ST> > ret_matches;
+    ret_matches.reserve(max_near);
 
-    // find the nearest neighbor particles
-    //std::cout << "\nDiffusing particle " << i << " with strength " << s[i] << std::endl;
-    //std::cout << "  part " << i << " with strength " << s[i] << std::endl;
+    // the neighbors of the diffusing particle, by index and position
+    std::vector<int32_t> inear;
+    Vector<ST> nx, ny;
+    SolveWorkspace ws;
+    const FractionVector& fractions = ws.fractions;
+
+    auto add_near = [&](const int32_t _idx, const ST _x, const ST _y) {
+      inear.push_back(_idx);
+      nx.push_back(_x);
+      ny.push_back(_y);
+    };
+    // new particles get the radius of the particle that made them
+    auto add_new = [&](const std::pair<ST,ST>& _pt, const ST _r) {
+      ch.x.push_back(_pt.first);
+      ch.y.push_back(_pt.second);
+      ch.r.push_back(_r);
+      ch.ds.push_back(0.0);
+      return (int32_t)(initial_n + ch.x.size() - 1);
+    };
+
+    const size_t ibeg = ic*chunk_size;
+    const size_t iend = std::min(initial_n, ibeg+chunk_size);
+    if (use_cache) ch.cnum.assign(iend-ibeg, 0);
+    for (size_t i=ibeg; i<iend; ++i) {
 
     // if current particle strength is very small, skip out
     //   (this particle could still core-spread if adaptive particle size is on)
     if ((thresholds_are_relative && (std::abs(s[i]) < maxAbsStr * ignore_thresh)) or
         (!thresholds_are_relative && (std::abs(s[i]) < ignore_thresh))) continue;
 
-    nsolved++;
+    ch.nsolved++;
 
     // nominal separation for this particle (insertion distance)
     const ST nom_sep = r[i] / particle_overlap;
 
     // what is search radius?
     const ST search_rad = nom_sep * ((num_moments > 2) ? 2.5 : 1.6);
+    const ST distsq_thresh = std::pow(search_rad, 2);
 
     // initialize vector of indexes of nearest particles
-    std::vector<int32_t> inear;
+    inear.clear();
+    nx.clear();
+    ny.clear();
 
     // switch on search method
     if (use_tree) {
-      // tree-based search with nanoflann
-      const ST distsq_thresh = std::pow(search_rad, 2);
-      const ST query_pt[2] = { x[i], y[i] };
-      (void) mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
-      //if (ret_matches.size() > 20) std::cout << "part " << i << " at " << x[i] << " " << y[i] << " " << z[i] << " has " << ret_matches.size() << " matches" << std::endl;
+      // search the cell list, which returns them sorted by distance
+      cells.radius_search(x[i], y[i], distsq_thresh, ret_matches);
 
       // copy the indexes into my vector
-      for (size_t j=0; j<ret_matches.size(); ++j) inear.push_back((int32_t)ret_matches[j].first);
-
-      // now direct search over all newer particles
-      for (size_t j=initial_n; j<n; ++j) {
-        ST distsq = std::pow(x[i]-x[j], 2) + std::pow(y[i]-y[j], 2);
-        if (distsq < distsq_thresh) inear.push_back((int32_t)j);
+      for (size_t j=0; j<ret_matches.size(); ++j) {
+        const int32_t jdx = ret_matches[j].first;
+        add_near(jdx, x[jdx], y[jdx]);
       }
-      //std::cout << " and " << (inear.size()-nMatches) << " matches";
-
-      // is the closest of these "too close"? Start at 0.5 if you want to catch the most egregious.
-      //if (std::sqrt(ret_matches[1].second) < 0.5*nom_sep) ntooclose++;
-
-      //std::cout << "radiusSearch(): radius " << search_rad << " found " << inear.size();
-      //std::cout << std::endl;
-      //for (size_t j=0; j<ret_matches.size(); ++j) std::cout << "   " << ret_matches[j].first << "\t" << ret_matches[j].second << std::endl;
     } else {
-      // direct search: look for all neighboring particles, include newly-created ones
-      //   ideally this would be a tree search
-      const ST distsq_thresh = std::pow(search_rad, 2);
-      for (size_t j=0; j<n; ++j) {
+      // direct search: look for all neighboring particles
+      for (size_t j=0; j<initial_n; ++j) {
         ST distsq = std::pow(x[i]-x[j], 2) + std::pow(y[i]-y[j], 2);
-        if (distsq < distsq_thresh) inear.push_back((int32_t)j);
+        if (distsq < distsq_thresh) add_near((int32_t)j, x[j], y[j]);
       }
-      //std::cout << "radiusSearch(): radius " << search_rad << " found " << inear.size() << " matches";
+    }
 
+    // now direct search over all newer particles from this chunk
+    for (size_t j=0; j<ch.x.size(); ++j) {
+      ST distsq = std::pow(x[i]-ch.x[j], 2) + std::pow(y[i]-ch.y[j], 2);
+      if (distsq < distsq_thresh) add_near((int32_t)(initial_n+j), ch.x[j], ch.y[j]);
     }
-    //std::cout << "  found " << inear.size() << " particles close to particle " << i << std::endl;
-    //std::cout << " :";
-    //for (size_t j=0; j<inear.size(); ++j) std::cout << " " << inear[j];
-    //std::cout << std::endl;
 
     // if there are less than, say, 6, we should just add some now
     while (inear.size() < minNearby) {
-      auto newpt = fill_neighborhood_search(i, x, y, inear, nom_sep);
-      // add the index to the near list
-      inear.push_back(n);
-      // add it to the master list
-      x.push_back(newpt.first);
-      y.push_back(newpt.second);
-      const ST thisnewr = newr[i];
-      r.push_back(thisnewr);
-      newr.push_back(thisnewr);
-      s.push_back(0.0);
-      ds.push_back(0.0);
-      n++;
-      //std::cout << "  inear is";
-      //for (int32_t j=0; j<inear.size(); ++j) std::cout << " " << inear[j];
-      //std::cout << std::endl;
-      //std::cout << "    fill neib with new part at " << newpt[0] << " " << newpt[1] << std::endl;
+      auto newpt = fill_neighborhood_search(x[i], y[i], nx, ny, nom_sep);
+      add_near(add_new(newpt, newr[i]), newpt.first, newpt.second);
     }
 
     // now remove close parts if we have more than max_near
@@ -388,9 +420,8 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,2>& pos,
       int32_t jclose = 0;
       ST distnear = std::numeric_limits<ST>::max();
       for (size_t j=0; j<inear.size(); ++j) {
-        const size_t inearj = static_cast<size_t>(inear[j]);
-        if (inearj != i) {
-          const ST distsq = std::pow(x[i]-x[inearj], 2) + std::pow(y[i]-y[inearj], 2);
+        if (static_cast<size_t>(inear[j]) != i) {
+          const ST distsq = std::pow(x[i]-nx[j], 2) + std::pow(y[i]-ny[j], 2);
           if (distsq < distnear) {
             distnear = distsq;
             jclose = j;
@@ -398,24 +429,42 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,2>& pos,
         }
       }
       // and remove it
-      //std::cout << "removing pt near " << x[i] << " " << y[i] << std::endl;
       inear.erase(inear.begin()+jclose);
+      nx.erase(nx.begin()+jclose);
+      ny.erase(ny.begin()+jclose);
     }
 
     bool haveSolution = false;
     size_t numNewParts = 0;
 
+    // if every neighbor is still where it was last time, try the last fractions
+    if (cache_valid and i+1 < cache_start.size() and cache_start[i+1]-cache_start[i] == nx.size()) {
+      const ST tolsq = std::pow(reuse_tol*nom_sep, 2);
+      bool same = true;
+      for (size_t j=0; j<nx.size() and same; ++j) {
+        const uint32_t k = cache_start[i] + j;
+        same = (std::pow(nx[j]-x[i]-cache_dx[k], 2) + std::pow(ny[j]-y[i]-cache_dy[k], 2) < tolsq);
+      }
+      if (same) {
+        set_up_equations(x[i], y[i], nx, ny, h_nu, ws);
+        for (size_t j=0; j<nx.size(); ++j) ws.fractions(j) = cache_frac[cache_start[i]+j];
+        const Eigen::Matrix<CT,num_rows,1> err = ws.A*ws.fractions - ws.b;
+        haveSolution = (err.dot(err) < nnls_thresh);
+        if (haveSolution) ch.nreused++;
+      }
+    }
+
     // assemble the underdetermined system
     while (not haveSolution and ++numNewParts < maxNewParts) {
-      //std::cout << "  attempt solution with " << inear.size() << " close particles" << std::endl;
 
       // this does the heavy lifting - assemble and solve the VRM equations for the 
       //   diffusion from particle i to particles in inear
-      haveSolution = attempt_solution(i, inear, x, y, r, newr, h_nu, core_func, fractions);
+      haveSolution = attempt_solution(x[i], y[i], nx, ny, h_nu, core_func, ws);
 
       // if that didn't work, add a particle and try again
       if (not haveSolution) {
-        auto newpt = fill_neighborhood_search(i, x, y, inear, nom_sep);
+        auto newpt = fill_neighborhood_search(x[i], y[i], nx, ny, nom_sep);
+        const int32_t inew = add_new(newpt, newr[i]);
 
         if (inear.size() == max_near) {
           // replace an old particle with this new one
@@ -428,60 +477,97 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,2>& pos,
             }
           }
           // we are moving an original particle from the near list, but not the global list
-          // but we are adding a new particle to the global list, hence the n
-          inear[ireplace] = n;
-          //std::cout << "  replacing pt " << ireplace << " in the list of " << inear.size() << std::endl;
+          inear[ireplace] = inew;
+          nx[ireplace] = newpt.first;
+          ny[ireplace] = newpt.second;
         } else {
-          // add a new one to the inear list and the master particle lists
-          inear.push_back(n);
+          // add a new one to the inear list
+          add_near(inew, newpt.first, newpt.second);
         }
-
-        // add it to the master list
-        x.push_back(newpt.first);
-        y.push_back(newpt.second);
-        const ST thisnewr = newr[i];
-        r.push_back(thisnewr);
-        newr.push_back(thisnewr);
-        s.push_back(0.0);
-        ds.push_back(0.0);
-        n++;
-        //std::cout << "    no solution, added part at " << newpt[0] << " " << newpt[1] << " " << newpt[2] << std::endl;
       }
     }
 
     // did we eventually reach a solution?
     if (numNewParts >= maxNewParts) {
-      std::cout << "Something went wrong" << std::endl;
-      std::cout << "  at " << x[i] << " " << y[i] << std::endl;
-      std::cout << "  with " << inear.size() << " near neibs" << std::endl;
-      std::cout << "  needed numNewParts= " << numNewParts << std::endl;
+      LOG_ERROR("Something went wrong\n  at " << x[i] << " " << y[i] << "\n  with " << inear.size()
+                << " near neibs\n  needed numNewParts= " << numNewParts);
       // ideally, in this situation, we would create 6 new particles around the original particle with optimal fractions,
       //   ignoring every other nearby particle - let merge take care of the higher density later
       exit(0);
     }
 
-    nneibs += inear.size();
-    if (inear.size() < minneibs) minneibs = inear.size();
-    if (inear.size() > maxneibs) maxneibs = inear.size();
+    // remember this solution for next time
+    if (use_cache) {
+      ch.cnum[i-ibeg] = nx.size();
+      for (size_t j=0; j<nx.size(); ++j) {
+        ch.cdx.push_back(nx[j]-x[i]);
+        ch.cdy.push_back(ny[j]-y[i]);
+        ch.cfrac.push_back(fractions(j));
+      }
+    }
+
+    ch.nneibs += inear.size();
+    if (inear.size() < ch.minneibs) ch.minneibs = inear.size();
+    if (inear.size() > ch.maxneibs) ch.maxneibs = inear.size();
 
-    // apply those fractions to the delta vector
-    //std::cout << "Added strengths" << std::endl;
+    // apply those fractions to the chunk's delta vectors
     for (size_t j=0; j<inear.size(); ++j) {
-      size_t idx = inear[j];
-      if (idx == i) {
-        // self-influence
-        ds[idx] += s[i] * (fractions(j) - 1.0);
-      } else {
-        ds[idx] += s[i] * fractions(j);
-      }
-      //std::cout << "  " << (s[i]*fractions(j)) << " to particle " << idx << std::endl;
+      const size_t idx = inear[j];
+      // self-influence loses what it gives away
+      const ST thisds = s[i] * (fractions(j) - ((idx == i) ? 1.0 : 0.0));
+      if (idx < initial_n) ch.dorig.emplace_back((int32_t)idx, thisds);
+      else ch.ds[idx-initial_n] += thisds;
     }
 
-  } // end loop over all current particles
+    } // end loop over particles in this chunk
+  } // end loop over all chunks
 
-  std::cout << "    neighbors: min/avg/max " << minneibs << "/" << ((ST)nneibs / (ST)nsolved) << "/" << maxneibs << std::endl;
+  // merge the chunks in order, so the sums are the same for any number of threads
+  Vector<ST> ds(initial_n, 0.0);
+  size_t nsolved = 0;
+  size_t nreused = 0;
+  if (use_cache) {
+    cache_hnu = h_nu;
+    cache_start.assign(1, 0);
+    cache_dx.clear();
+    cache_dy.clear();
+    cache_frac.clear();
+  }
+  size_t nneibs = 0;
+  size_t minneibs = 999999;
+  size_t maxneibs = 0;
+  scratch_bytes = vec_bytes(chunks) + vec_bytes(ds) + vec_bytes(newr);
+  for (const auto& ch : chunks) {
+    scratch_bytes += vec_bytes(ch.x) + vec_bytes(ch.y) + vec_bytes(ch.r) + vec_bytes(ch.ds) +
+                     vec_bytes(ch.dorig) + vec_bytes(ch.cnum) + vec_bytes(ch.cdx) + vec_bytes(ch.cdy) +
+                     vec_bytes(ch.cfrac);
+  }
+  for (auto& ch : chunks) {
+    for (const auto& [idx, thisds] : ch.dorig) ds[idx] += thisds;
+    x.insert(x.end(), ch.x.begin(), ch.x.end());
+    y.insert(y.end(), ch.y.begin(), ch.y.end());
+    r.insert(r.end(), ch.r.begin(), ch.r.end());
+    newr.insert(newr.end(), ch.r.begin(), ch.r.end());
+    s.resize(x.size(), 0.0);
+    ds.insert(ds.end(), ch.ds.begin(), ch.ds.end());
+    nsolved += ch.nsolved;
+    nreused += ch.nreused;
+    nneibs += ch.nneibs;
+    if (use_cache) {
+      for (const uint32_t num : ch.cnum) cache_start.push_back(cache_start.back() + num);
+      cache_dx.insert(cache_dx.end(), ch.cdx.begin(), ch.cdx.end());
+      cache_dy.insert(cache_dy.end(), ch.cdy.begin(), ch.cdy.end());
+      cache_frac.insert(cache_frac.end(), ch.cfrac.begin(), ch.cfrac.end());
+    }
+    minneibs = std::min(minneibs, ch.minneibs);
+    maxneibs = std::max(maxneibs, ch.maxneibs);
+  }
+  n = x.size();
+
+  LOG_DEBUG("    neighbors: min/avg/max " << minneibs << "/" << ((ST)nneibs / (ST)nsolved) << "/" << maxneibs);
+  if (use_cache) LOG_DEBUG("    reused " << nreused << " of " << nsolved << " solutions");
   //std::cout << "  number of close pairs " << (ntooclose/2) << std::endl;
-  std::cout << "    after VRM, n is " << n << std::endl;
+  LOG_INFO("    after VRM, n is " << n);
 
   // apply the changes to the master vectors
   assert(n==s.size() and ds.size()==s.size() && "Array size mismatch in VRM");
@@ -490,33 +576,22 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,2>& pos,
     s[i] += ds[i];
     r[i] = newr[i];
   }
-
-  // finish timer and report
-  auto end = std::chrono::system_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end-start;
-  printf("    vrm.diffuse_all:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
 }
 
 //
-// Set up and solve the VRM equations
+// Fill in the moment equations for one diffusing particle and its neighbors
 //
 template <class ST, class CT, uint8_t MAXMOM>
-bool VRM<ST,CT,MAXMOM>::attempt_solution(const int32_t idiff,
-                                         std::vector<int32_t>& inear,
-                                         Vector<ST>& x,
-                                         Vector<ST>& y,
-                                         Vector<ST>& r,
-                                         Vector<ST>& newr,
+void VRM<ST,CT,MAXMOM>::set_up_equations(const ST xi,
+                                         const ST yi,
+                                         const Vector<ST>& nx,
+                                         const Vector<ST>& ny,
                                          const ST h_nu,
-                                         const CoreType core_func,
-                                         Eigen::Matrix<CT, Eigen::Dynamic, 1>& fracout) {
-
-  bool haveSolution = false;
+                                         SolveWorkspace& ws) {
 
-  // the matricies that we will repeatedly work on
-  static Eigen::Matrix<CT, num_rows, Eigen::Dynamic, 0, num_rows, max_near> A;
-  static Eigen::Matrix<CT, num_rows, 1> b;
-  static Eigen::Matrix<CT, Eigen::Dynamic, 1, 0, max_near, 1> fractions;
+  MomentMatrix& A = ws.A;
+  Eigen::Matrix<CT, num_rows, 1>& b = ws.b;
+  FractionVector& fractions = ws.fractions;
 
   // second moment in each direction
   // one dt should generate 4 hnu^2 of second moment, or when distances
@@ -527,36 +602,21 @@ bool VRM<ST,CT,MAXMOM>::attempt_solution(const int32_t idiff,
 
   const CT oohnu = 1.0 / h_nu;
 
-  // the Ixx and Iyy moments of these core functions is half of the 2nd radial moment
-  //static const CT core_second_mom = get_core_second_mom<CT>(core_func);
-  // the Ixxxx and Iyyyy moments of these core functions is 3/8th of the 4th radial moment
-  //static const CT core_fourth_mom = get_core_fourth_mom<CT>(core_func);
-
-  // for non-adaptive method and floats, 1e-6 fails immediately, 1e-5 fails quickly, 3e-5 seems to work
-  // for doubles, can use 1e-6, will increase accuracy for slight performance hit (see vrm3d)
-  static const CT nnls_eps = 1.e-6;
-  // default to 1e-6, but drop to 1e-4 for adaptive with high overlap?
-  static const CT nnls_thresh = 1.e-6;
-#ifdef PLUGIN_SIMPLEX
-  // default to 1e-6, but drop to 1e-4 for adaptive with high overlap?
-  static const CT simplex_thresh = 1.e-6;
-#endif
-
   // reset the arrays
   //std::cout << "\nSetting up Ax=b least-squares problem" << std::endl;
-  assert(inear.size() <= static_cast<size_t>(max_near) && "Too many neighbors in VRM");
+  const size_t nnear = nx.size();
+  assert(nnear <= static_cast<size_t>(max_near) && "Too many neighbors in VRM");
   b.setZero();
-  A.resize(num_rows, inear.size());
+  A.resize(num_rows, nnear);
   A.setZero();
-  fractions.resize(inear.size());
+  fractions.resize(nnear);
   fractions.setZero();
 
   // fill it in
-  for (size_t j=0; j<inear.size(); ++j) {
-    const int32_t jdx = inear[j];
+  for (size_t j=0; j<nnear; ++j) {
     // all distances are normalized to h_nu
-    CT dx = (x[idiff]-x[jdx]) * oohnu;
-    CT dy = (y[idiff]-y[jdx]) * oohnu;
+    CT dx = (xi-nx[j]) * oohnu;
+    CT dy = (yi-ny[j]) * oohnu;
     A(0,j) = 1.0;
     if (num_moments > 0) {
       A(1,j) = dx;
@@ -593,6 +653,43 @@ bool VRM<ST,CT,MAXMOM>::attempt_solution(const int32_t idiff,
     b(12) = fourth_moment / 3.0;
     b(14) = fourth_moment;
   }
+}
+
+//
+// Set up and solve the VRM equations
+//
+template <class ST, class CT, uint8_t MAXMOM>
+bool VRM<ST,CT,MAXMOM>::attempt_solution(const ST xi,
+                                         const ST yi,
+                                         const Vector<ST>& nx,
+                                         const Vector<ST>& ny,
+                                         const ST h_nu,
+                                         const CoreType core_func,
+                                         SolveWorkspace& ws) {
+
+  bool haveSolution = false;
+
+  // the matricies that we will repeatedly work on
+  MomentMatrix& A = ws.A;
+  Eigen::Matrix<CT, num_rows, 1>& b = ws.b;
+  FractionVector& fractions = ws.fractions;
+
+  // the Ixx and Iyy moments of these core functions is half of the 2nd radial moment
+  //static const CT core_second_mom = get_core_second_mom<CT>(core_func);
+  // the Ixxxx and Iyyyy moments of these core functions is 3/8th of the 4th radial moment
+  //static const CT core_fourth_mom = get_core_fourth_mom<CT>(core_func);
+
+  // for non-adaptive method and floats, 1e-6 fails immediately, 1e-5 fails quickly, 3e-5 seems to work
+  // for doubles, can use 1e-6, will increase accuracy for slight performance hit (see vrm3d)
+  static const CT nnls_eps = 1.e-6;
+#ifdef PLUGIN_SIMPLEX
+  // default to 1e-6, but drop to 1e-4 for adaptive with high overlap?
+  static const CT simplex_thresh = 1.e-6;
+#endif
+
+  // reset the arrays and fill them in
+  const size_t nnear = nx.size();
+  set_up_equations(xi, yi, nx, ny, h_nu, ws);
   //std::cout << "  Here is the matrix A^T:\n" << A.transpose() << std::endl;
   //std::cout << "  Here is the right hand side b:\n\t" << b.transpose() << std::endl;
   //std::cout << "  Here is the solution vector:\n\t" << fractions.transpose() << std::endl;
@@ -602,7 +699,7 @@ bool VRM<ST,CT,MAXMOM>::attempt_solution(const int32_t idiff,
     //std::cout << "    using NNLS solver\n" << std::endl;
 
     // solve with non-negative least-squares
-    Eigen::NNLS<Eigen::Matrix<CT,Eigen::Dynamic,Eigen::Dynamic> > nnls_solver(A, 100, nnls_eps);
+    Eigen::NNLS<MomentMatrix> nnls_solver(A, 100, nnls_eps);
 
     //std::cout << "A is" << std::endl << A << std::endl;
     //std::cout << "b is" << std::endl << b.transpose() << std::endl;
@@ -611,14 +708,14 @@ bool VRM<ST,CT,MAXMOM>::attempt_solution(const int32_t idiff,
       //std::cout << "  success! required " << nnls_solver.numLS() << " LS problems" << std::endl;
       //std::cout << "  check says " << nnls_solver.check(b) << std::endl;
     } else {
-      for (size_t j=0; j<inear.size(); ++j) fractions(j) = 0.f;
+      for (size_t j=0; j<nnear; ++j) fractions(j) = 0.f;
       //std::cout << "  fail!" << std::endl;
     }
 
     //std::cout << "  fractions are:\n\t" << fractions.transpose() << std::endl;
 
     // measure the results
-    Eigen::Matrix<CT,Eigen::Dynamic,1> err = A*fractions - b;
+    const Eigen::Matrix<CT,num_rows,1> err = A*fractions - b;
     //std::cout << "  error is:\n" << err.transpose() << std::endl;
     //std::cout << "  error magnitude is " << std::sqrt(err.dot(err)) << std::endl;
 
@@ -660,8 +757,6 @@ bool VRM<ST,CT,MAXMOM>::attempt_solution(const int32_t idiff,
 #endif
   }
 
-  // set output fractions and result
-  fracout = fractions;
   return haveSolution;
 }
 
@@ -686,6 +781,11 @@ void VRM<ST,CT,MAXMOM>::from_json(const nlohmann::json simj) {
       std::cout << "  setting thresholds_are_relative= " << thresholds_are_relative << std::endl;
     }
 
+    if (j.find("reuseTolerance") != j.end()) {
+      reuse_tol = j["reuseTolerance"];
+      std::cout << "  setting reuse_tol= " << reuse_tol << std::endl;
+    }
+
     if (j.find("solver") != j.end()) {
       std::string solverstr = j["solver"];
       if (solverstr == "simplex") {
@@ -719,6 +819,7 @@ void VRM<ST,CT,MAXMOM>::add_to_json(nlohmann::json& simj) const {
   nlohmann::json j;
   j["ignoreBelow"] = ignore_thresh;
   j["relativeThresholds"] = thresholds_are_relative;
+  if (reuse_tol > 0.0) j["reuseTolerance"] = reuse_tol;
   j["solver"] = use_solver ? "simplex" : "nnls";
   simj["VRM"] = j;
 }
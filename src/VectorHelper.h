@@ -9,11 +9,54 @@
 
 #include <vector>
 
+#ifdef USE_NUMA
+#include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+// while this is set on a thread, vectors it grows leave their new elements unwritten
+inline bool& deferred_init() {
+  thread_local bool defer = false;
+  return defer;
+}
+
+// an allocator which can skip the zeroing of new elements, so the threads which will use
+//   them can write them first and the pages land on their own NUMA nodes (see Numa.h)
+template <class T, class B>
+struct FirstTouchAllocator : public B {
+  using value_type = T;
+  template <class U> struct rebind {
+    using other = FirstTouchAllocator<U, typename std::allocator_traits<B>::template rebind_alloc<U>>;
+  };
+
+  FirstTouchAllocator() = default;
+  template <class U, class C> FirstTouchAllocator(const FirstTouchAllocator<U,C>&) {}
+
+  template <class U, class... Args>
+  void construct(U* _p, Args&&... _args) {
+    if constexpr (sizeof...(Args) == 0 and std::is_trivially_default_constructible<U>::value) {
+      if (deferred_init()) return;
+    }
+    ::new((void*)_p) U(std::forward<Args>(_args)...);
+  }
+};
+
+template <class T, class B, class U, class C>
+bool operator==(const FirstTouchAllocator<T,B>&, const FirstTouchAllocator<U,C>&) { return true; }
+template <class T, class B, class U, class C>
+bool operator!=(const FirstTouchAllocator<T,B>&, const FirstTouchAllocator<U,C>&) { return false; }
+#endif
+
 #ifdef USE_VC
 #include <Vc/Vc>
 
 // Must use Vc's allocator to ensure memory alignment
+#ifdef USE_NUMA
+template <class S> using Vector = std::vector<S, FirstTouchAllocator<S, Vc::Allocator<S>>>;
+#else
 template <class S> using Vector = std::vector<S, Vc::Allocator<S>>;
+#endif
 // now we can use Vector<float> in code
 
 //using VectorF = std::vector<float, Vc::Allocator<float>>;
@@ -40,7 +83,11 @@ inline const Vc::Memory<Vc::Vector<S>> stdvec_to_vcvec (const Vector<S>& in, con
 
 #else	// no Vc present, use stdlib instead
 
+#ifdef USE_NUMA
+template <class S> using Vector = std::vector<S, FirstTouchAllocator<S, std::allocator<S>>>;
+#else
 template <class S> using Vector = std::vector<S>;
+#endif
 
 //using VectorF = std::vector<float>;
 //using VectorD = std::vector<double>;
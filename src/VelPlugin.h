@@ -0,0 +1,94 @@
+/*
+ * VelPlugin.h - Load velocity summation plugins at run time
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "VelPluginAbi.h"
+#include "Logger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <cstddef>
+#include <type_traits>
+
+
+//
+// Each library is opened once, the first time an ExecEnv names it, and stays open for the
+//   life of the program; a library which fails to open or to pass the version checks is
+//   remembered as such and warned about only once
+//
+class VelPlugin {
+public:
+  // the plugin's table, or nullptr
+  static const Omega2DVelPlugin* get(const std::string& _path) {
+    static std::map<std::string, const Omega2DVelPlugin*> loaded;
+    static std::mutex mtx;
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = loaded.find(_path);
+    if (it != loaded.end()) return it->second;
+    const Omega2DVelPlugin* table = open(_path);
+    loaded[_path] = table;
+    return table;
+  }
+
+  // its batched points-on-points solver in this precision, or nullptr
+  template <class S>
+  static auto points_on_points(const Omega2DVelPlugin* _p) {
+    if constexpr (std::is_same<S,float>::value) return _p ? _p->points_on_points_f : nullptr;
+    else return _p ? _p->points_on_points_d : nullptr;
+  }
+
+private:
+  static const Omega2DVelPlugin* open(const std::string& _path) {
+    Omega2DVelPluginEntry entry = nullptr;
+#ifdef _WIN32
+    HMODULE lib = LoadLibraryA(_path.c_str());
+    if (not lib) {
+      LOG_WARN("Could not load velocity plugin " << _path);
+      return nullptr;
+    }
+    entry = (Omega2DVelPluginEntry)GetProcAddress(lib, "omega2d_vel_plugin");
+#else
+    void* lib = dlopen(_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (not lib) {
+      LOG_WARN("Could not load velocity plugin " << _path << ": " << dlerror());
+      return nullptr;
+    }
+    entry = (Omega2DVelPluginEntry)dlsym(lib, "omega2d_vel_plugin");
+#endif
+    if (not entry) {
+      LOG_WARN("Velocity plugin " << _path << " has no omega2d_vel_plugin function");
+      return nullptr;
+    }
+
+    const Omega2DVelPlugin* table = entry();
+    if (not table) {
+      LOG_WARN("Velocity plugin " << _path << " returned no table");
+      return nullptr;
+    }
+    if (table->abi_version != OMEGA2D_VEL_PLUGIN_ABI_VERSION) {
+      LOG_WARN("Velocity plugin " << _path << " has interface version " << table->abi_version
+               << ", need " << OMEGA2D_VEL_PLUGIN_ABI_VERSION);
+      return nullptr;
+    }
+    if (table->struct_size < offsetof(Omega2DVelPlugin, points_on_points_d) + sizeof(table->points_on_points_d)) {
+      LOG_WARN("Velocity plugin " << _path << " has a short table");
+      return nullptr;
+    }
+
+    LOG_INFO("Loaded velocity plugin " << (table->name ? table->name : _path));
+    return table;
+  }
+};
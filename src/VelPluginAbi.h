@@ -0,0 +1,55 @@
+/*
+ * VelPluginAbi.h - The C interface a velocity summation plugin exports, see VelPlugin.h
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ *
+ * A plugin is a shared library with one C function, omega2d_vel_plugin, returning a pointer
+ *   to a table which lives as long as the library does. This header includes nothing from
+ *   Omega2D, so a plugin needs only this file to build.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// a plugin built against another major version is refused
+#define OMEGA2D_VEL_PLUGIN_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// The table: new entries only ever go on the end, and struct_size tells which a plugin has.
+//   Each solver takes every particle source and point target of one velocity evaluation in
+//   one call: the counts of sources and targets, then arrays of pointers into each
+//   collection's own arrays, so nothing is copied; a target's radius pointer is null if it
+//   is a set of field points, with no core. It adds the unscaled Biot-Savart sums to
+//   the target velocities, as the internal kernels do, and returns the flops it spent. A
+//   null entry means the plugin does not take that precision.
+//
+typedef struct {
+  uint32_t abi_version;         // OMEGA2D_VEL_PLUGIN_ABI_VERSION
+  uint32_t struct_size;         // sizeof(Omega2DVelPlugin) in the plugin's build
+  const char* name;             // for the console
+
+  float (*points_on_points_f)(int* nsrcs, const int* ns,
+                              const float* const* sx, const float* const* sy,
+                              const float* const* ss, const float* const* sr,
+                              int* ntargs, const int* nt,
+                              const float* const* tx, const float* const* ty, const float* const* tr,
+                              float* const* tu, float* const* tv);
+  float (*points_on_points_d)(int* nsrcs, const int* ns,
+                              const double* const* sx, const double* const* sy,
+                              const double* const* ss, const double* const* sr,
+                              int* ntargs, const int* nt,
+                              const double* const* tx, const double* const* ty, const double* const* tr,
+                              double* const* tu, double* const* tv);
+} Omega2DVelPlugin;
+
+typedef const Omega2DVelPlugin* (*Omega2DVelPluginEntry)(void);
+
+#ifdef __cplusplus
+}
+#endif
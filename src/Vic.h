@@ -0,0 +1,297 @@
+/*
+ * Vic.h - Vortex-in-cell (particle-mesh) velocity evaluation
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega2D.h"
+#include "VectorHelper.h"
+#include "CoreFunc.h"
+#include "Points.h"
+#include "ResultsType.h"
+#include "ExecEnv.h"
+#include "CellList.h"
+#include "Fmm.h"
+#include "Logger.h"
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <complex>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+
+
+//
+// Particle strengths are spread onto a uniform grid with the M4' kernel, the grid is
+//   convolved with the Green's function of the Gaussian-smoothed point vortex by FFT (zero-
+//   padded to twice the grid in each direction, as in Hockney and Eastwood, so the domain
+//   is unbounded), and the velocities are interpolated back with the same kernel
+//
+// the mesh only resolves the smoothed kernel, so every pair closer than a few smoothing
+//   radii also gets the difference between the true core function and the smoothed one,
+//   summed directly; the Gaussian smoothing's part of that difference is below 0.3% by the
+//   cutoff, but an algebraic core's part falls only as a power of r, and the M4' spreading
+//   and interpolation add an error which shrinks with the grid spacing, not with r, so the
+//   result is only as good as the grid; validate_vels measures it
+//
+// the smoothed streamfunction's gradient is taken analytically, making one complex kernel
+//   for u - iv, so each evaluation is three FFTs of the padded grid: O(N + M log M)
+//
+
+// smoothing radius and near-field cutoff, in grid cells
+static constexpr double vic_sigma = 1.25;
+static constexpr double vic_cutoff = 3.5 * vic_sigma;
+
+// beyond this many padded grid nodes the fmm is cheaper, and uses far less memory
+static constexpr size_t vic_max_nodes = 1 << 22;
+
+//
+// the M4' interpolation kernel, t in grid cells
+//
+template <class S>
+inline S m4p_weight(const S _t) {
+  const S t = std::abs(_t);
+  if (t < 1.0) return 1.0 - 2.5*t*t + 1.5*t*t*t;
+  if (t < 2.0) return 0.5 * (2.0-t) * (2.0-t) * (1.0-t);
+  return 0.0;
+}
+
+// the leftmost of the four nodes a point at _t touches, and their weights
+template <class S>
+inline int32_t m4p_weights(const S _t, S* const _w) {
+  const int32_t i0 = (int32_t)std::floor(_t) - 1;
+  for (int32_t k=0; k<4; ++k) _w[k] = m4p_weight<S>(_t - (S)(i0+k));
+  return i0;
+}
+
+//
+// the smoothed kernel's velocity factor, so that u = -dy*f and v = dx*f, like core_func
+//
+template <class S>
+inline S vic_smooth_func(const S _distsq, const S _sigma) {
+  const S ood2 = 1.0 / (2.0*_sigma*_sigma);
+  if (_distsq < 1.e-6*_sigma*_sigma) return ood2 * (1.0 - 0.5*_distsq*ood2);
+  return (1.0 - std::exp(-_distsq*ood2)) / _distsq;
+}
+
+//
+// in-place radix-2 FFT of _n values spaced _stride apart, _sign is -1 forward, +1 inverse
+//
+template <class A>
+void vic_fft(std::complex<A>* const _x, const size_t _n, const size_t _stride, const int _sign) {
+  // bit-reversal permutation
+  for (size_t i=1, j=0; i<_n; ++i) {
+    size_t bit = _n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) std::swap(_x[i*_stride], _x[j*_stride]);
+  }
+
+  // butterflies
+  for (size_t len=2; len<=_n; len<<=1) {
+    const A ang = (A)_sign * 2.0 * M_PI / (A)len;
+    const std::complex<A> wlen(std::cos(ang), std::sin(ang));
+    for (size_t i=0; i<_n; i+=len) {
+      std::complex<A> w(1.0, 0.0);
+      for (size_t k=0; k<len/2; ++k) {
+        const std::complex<A> a = _x[(i+k)*_stride];
+        const std::complex<A> b = w * _x[(i+k+len/2)*_stride];
+        _x[(i+k)*_stride] = a + b;
+        _x[(i+k+len/2)*_stride] = a - b;
+        w *= wlen;
+      }
+    }
+  }
+}
+
+//
+// 2D FFT of a _px by _py grid stored by rows; only the first _nrow rows are transformed
+//   first (forward) or last (inverse), since the rest are padding on input or unneeded
+//
+template <class A>
+void vic_fft_2d(std::vector<std::complex<A>>& _g, const size_t _px, const size_t _py,
+                const size_t _nrow, const int _sign) {
+
+  if (_sign < 0) {
+    #pragma omp parallel for schedule(static)
+    for (int32_t i=0; i<(int32_t)_nrow; ++i) vic_fft<A>(&_g[i*_py], _py, 1, _sign);
+  }
+
+  // columns are copied out, a strided transform thrashes the cache
+  #pragma omp parallel
+  {
+    std::vector<std::complex<A>> col(_px);
+    #pragma omp for schedule(static)
+    for (int32_t j=0; j<(int32_t)_py; ++j) {
+      for (size_t i=0; i<_px; ++i) col[i] = _g[i*_py+j];
+      vic_fft<A>(col.data(), _px, 1, _sign);
+      for (size_t i=0; i<_px; ++i) _g[i*_py+j] = col[i];
+    }
+  }
+
+  if (_sign > 0) {
+    #pragma omp parallel for schedule(static)
+    for (int32_t i=0; i<(int32_t)_nrow; ++i) vic_fft<A>(&_g[i*_py], _py, 1, _sign);
+  }
+}
+
+
+//
+// Points/Particles affecting Points/Particles through a mesh
+//
+template <class S, class A, VelCore C>
+void points_affect_points_vic (const Points<S>& src, Points<S>& targ, const ResultsType& restype, const ExecEnv& env) {
+
+  // the mesh only finds velocities, and needs thick sources
+  const Vector<S>& sr = src.get_rad();
+  A meanrad = 0.0;
+  for (size_t j=0; j<src.get_n(); ++j) meanrad += sr[j];
+  if (restype.get_type() != velonly or not (meanrad > 0.0)) {
+    points_affect_points_fmm<S,A>(src, targ, restype, env);
+    return;
+  }
+
+  LOG_DEBUG("    0v_0" << (targ.is_inert() ? "p" : "v") << " vic influence of" << src.to_string() << " on" << targ.to_string());
+
+  auto start = std::chrono::system_clock::now();
+
+  const std::array<Vector<S>,Dimensions>& sx = src.get_pos();
+  const Vector<S>&                        ss = src.get_str();
+  const std::array<Vector<S>,Dimensions>& tx = std::as_const(targ).get_pos();
+  std::array<Vector<S>,Dimensions>&       tu = targ.get_vel();
+  const bool thick = not targ.is_inert();
+  const Vector<S>& tr = targ.get_rad();
+  const size_t ns = src.get_n();
+  const size_t nt = targ.get_n();
+
+  // grid size follows the particle cores
+  const S h = env.get_vic_cell_ratio() * meanrad / (A)ns;
+  const S sigma = vic_sigma * h;
+  const S cutoff = vic_cutoff * h;
+
+  // the grid covers sources and targets, plus the interpolation stencil
+  S xmin = std::numeric_limits<S>::max();
+  S xmax = std::numeric_limits<S>::lowest();
+  S ymin = xmin;
+  S ymax = xmax;
+  for (size_t j=0; j<ns; ++j) {
+    xmin = std::min(xmin, sx[0][j]);
+    xmax = std::max(xmax, sx[0][j]);
+    ymin = std::min(ymin, sx[1][j]);
+    ymax = std::max(ymax, sx[1][j]);
+  }
+  for (size_t i=0; i<nt; ++i) {
+    xmin = std::min(xmin, tx[0][i]);
+    xmax = std::max(xmax, tx[0][i]);
+    ymin = std::min(ymin, tx[1][i]);
+    ymax = std::max(ymax, tx[1][i]);
+  }
+  const S x0 = xmin - 2.0*h;
+  const S y0 = ymin - 2.0*h;
+  const size_t nx = (size_t)std::ceil((xmax-xmin)/h) + 5;
+  const size_t ny = (size_t)std::ceil((ymax-ymin)/h) + 5;
+  size_t px = 1;
+  size_t py = 1;
+  while (px < 2*nx) px *= 2;
+  while (py < 2*ny) py *= 2;
+
+  if ((double)px*(double)py > (double)vic_max_nodes) {
+    LOG_DEBUG("    vic grid would be " << px << "x" << py << ", using the fmm");
+    points_affect_points_fmm<S,A>(src, targ, restype, env);
+    return;
+  }
+
+  typedef std::complex<A> cplx;
+  const S ooh = 1.0 / h;
+
+  // the kernel, with negative offsets wrapped into the upper half of the padding
+  std::vector<cplx> kern(px*py);
+  #pragma omp parallel for schedule(static)
+  for (int32_t i=0; i<(int32_t)px; ++i) {
+    const S dx = h * (S)(i < (int32_t)(px/2) ? i : i-(int32_t)px);
+    for (size_t j=0; j<py; ++j) {
+      const S dy = h * (S)((int32_t)j < (int32_t)(py/2) ? (int32_t)j : (int32_t)j-(int32_t)py);
+      const S f = vic_smooth_func<S>(dx*dx + dy*dy, sigma);
+      kern[i*py+j] = cplx(-dy*f, -dx*f);
+    }
+  }
+  vic_fft_2d<A>(kern, px, py, px, -1);
+
+  // spread the strengths, in order, so the result does not depend on the thread count
+  std::vector<cplx> grid(px*py, cplx(0.0, 0.0));
+  for (size_t j=0; j<ns; ++j) {
+    S wx[4], wy[4];
+    const int32_t ix = m4p_weights<S>((sx[0][j]-x0)*ooh, wx);
+    const int32_t iy = m4p_weights<S>((sx[1][j]-y0)*ooh, wy);
+    for (int32_t a=0; a<4; ++a) {
+      for (int32_t b=0; b<4; ++b) {
+        grid[(ix+a)*py + iy+b] += (A)(ss[j] * wx[a] * wy[b]);
+      }
+    }
+  }
+
+  // convolve
+  vic_fft_2d<A>(grid, px, py, nx, -1);
+  const A scale = 1.0 / ((A)px * (A)py);
+  #pragma omp parallel for schedule(static)
+  for (int32_t i=0; i<(int32_t)(px*py); ++i) grid[i] *= kern[i] * scale;
+  vic_fft_2d<A>(grid, px, py, nx, 1);
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  LOG_DEBUG("    vic mesh:\t\t[" << elapsed_seconds.count() << "] seconds on a " << px << "x" << py << " grid");
+  start = std::chrono::system_clock::now();
+
+  // interpolate back and correct the near field
+  CellList<S> cells;
+  cells.build(sx, cutoff);
+  const S cutsq = cutoff * cutoff;
+  size_t nnear = 0;
+
+  #pragma omp parallel for schedule(dynamic,256) reduction(+:nnear)
+  for (int32_t i=0; i<(int32_t)nt; ++i) {
+    const S xi = tx[0][i];
+    const S yi = tx[1][i];
+    S wx[4], wy[4];
+    const int32_t ix = m4p_weights<S>((xi-x0)*ooh, wx);
+    const int32_t iy = m4p_weights<S>((yi-y0)*ooh, wy);
+    A accumu = 0.0;
+    A accumv = 0.0;
+    for (int32_t a=0; a<4; ++a) {
+      for (int32_t b=0; b<4; ++b) {
+        const cplx g = grid[(ix+a)*py + iy+b];
+        accumu += wx[a] * wy[b] * g.real();
+        accumv -= wx[a] * wy[b] * g.imag();
+      }
+    }
+
+    cells.for_each_in_box(xi-cutoff, xi+cutoff, yi-cutoff, yi+cutoff, [&](const int32_t j) {
+      const S dx = xi - sx[0][j];
+      const S dy = yi - sx[1][j];
+      const S distsq = dx*dx + dy*dy;
+      if (distsq >= cutsq) return;
+      const S cf = thick ? core_func<S,C>(distsq, sr[j], tr[i]) : core_func<S,C>(distsq, sr[j]);
+      const S r2 = ss[j] * (cf - vic_smooth_func<S>(distsq, sigma));
+      accumu -= r2 * dy;
+      accumv += r2 * dx;
+      ++nnear;
+    });
+
+    tu[0][i] += accumu;
+    tu[1][i] += accumv;
+  }
+
+  end = std::chrono::system_clock::now();
+  elapsed_seconds = end-start;
+  LOG_DEBUG("    vic near field:\t[" << elapsed_seconds.count() << "] seconds with " << nnear << " pairs");
+}
+
@@ -9,6 +9,8 @@
 
 #include "Omega2D.h"
 #include "VectorHelper.h"
+#include "Points.h"
+#include "Hdf5Writer.h"
 
 #ifdef USE_GL
 #include "GlState.h"
@@ -124,6 +126,10 @@ public:
 
     // now, depending on the element type, put the value somewhere
     if (this->E == active) {
+      // value is the vorticity on each node, which makes this a source of velocity
+      Vector<S> new_s(nnodes, 0.0);
+      if (_val.size() == nnodes) std::copy(_val.begin(), _val.end(), new_s.begin());
+      this->s = std::move(new_s);
 /*
       // value is a fixed strength for the segment
       Vector<S> new_s(_val.size());
@@ -210,6 +216,94 @@ public:
   // element geometry
   const std::vector<Int>&                  get_idx()  const { return idx; }
   const Vector<S>&                         get_area() const { return area; }
+
+  // whether there is vorticity on the nodes to act as a source of velocity
+  //   active Volumes keep it in s; w is a result, and zero_vels clears it
+  bool has_src_vort() const { return nb > 0 and this->s; }
+
+  // that vorticity as particles at Gauss points: each element is split into _nsub by _nsub
+  //   quads with 2x2 points each, so element i owns the 4*_nsub*_nsub points from there times
+  //   i; only the four corners are used, so higher-order elements are taken as straight;
+  //   positions, weights and radii are kept until the nodes move, strengths are redone
+  const Points<S>& get_quad_src(const int _nsub = 1) const {
+    QuadSrc& q = (_nsub > 1) ? fine_quad : coarse_quad;
+    const size_t nq = 4 * _nsub * _nsub;
+    const size_t nper = idx.size() / nb;
+    const Vector<S>& nodal = *this->s;
+
+    if (not q.pts or q.gen != this->pos_gen or q.nsub != _nsub) {
+      const S g = 1.0 / std::sqrt(3.0);
+      std::vector<S> qx(Dimensions*nq*nb);
+      q.shape.resize(4*nq*nb);
+      q.wgt.resize(nq*nb);
+      Vector<S> qr(nq*nb);
+
+      for (size_t e=0; e<nb; ++e) {
+        const Int* c = &idx[e*nper];
+        size_t k = e*nq;
+        for (int si=0; si<_nsub; ++si) for (int sj=0; sj<_nsub; ++sj) {
+          for (const S gi : {-g, g}) for (const S gj : {-g, g}) {
+            const S xi  = -1.0 + (2*si + 1 + gi) / (S)_nsub;
+            const S eta = -1.0 + (2*sj + 1 + gj) / (S)_nsub;
+            const S n[4] = {(S)0.25*(1-xi)*(1-eta), (S)0.25*(1+xi)*(1-eta),
+                            (S)0.25*(1+xi)*(1+eta), (S)0.25*(1-xi)*(1+eta)};
+            std::array<S,Dimensions> pos = {0.0, 0.0}, dxi, deta;
+            for (size_t d=0; d<Dimensions; ++d) {
+              const Vector<S>& xd = this->x[d];
+              for (int a=0; a<4; ++a) pos[d] += n[a] * xd[c[a]];
+              dxi[d]  = 0.25*((xd[c[1]]-xd[c[0]])*(1-eta) + (xd[c[2]]-xd[c[3]])*(1+eta));
+              deta[d] = 0.25*((xd[c[3]]-xd[c[0]])*(1-xi)  + (xd[c[2]]-xd[c[1]])*(1+xi));
+            }
+            for (size_t d=0; d<Dimensions; ++d) qx[Dimensions*k+d] = pos[d];
+            for (int a=0; a<4; ++a) q.shape[4*k+a] = n[a];
+            q.wgt[k] = std::abs(dxi[0]*deta[1] - dxi[1]*deta[0]) / (S)(_nsub*_nsub);
+            // each point stands for a patch of this area, so it gets that patch's width
+            qr[k] = std::sqrt(q.wgt[k]);
+            ++k;
+          }
+        }
+      }
+
+      ElementPacket<S> packet(qx, std::vector<Int>(), std::vector<S>(nq*nb, 0.0), nq*nb, 0);
+      q.pts.reset();
+      q.pts.emplace(packet, active, fixed, nullptr, 0.0);
+      std::copy(qr.begin(), qr.end(), q.pts->get_rad().begin());
+      q.gen = this->pos_gen;
+      q.nsub = _nsub;
+    }
+
+    // and the strengths, as the interpolated vorticity times the weight
+    Vector<S>& qs = q.pts->get_str();
+    for (size_t e=0; e<nb; ++e) {
+      const Int* c = &idx[e*nper];
+      for (size_t k=e*nq; k<(e+1)*nq; ++k) {
+        const S* n = &q.shape[4*k];
+        qs[k] = q.wgt[k] * (n[0]*nodal[c[0]] + n[1]*nodal[c[1]] + n[2]*nodal[c[2]] + n[3]*nodal[c[3]]);
+      }
+    }
+    return *q.pts;
+  }
+
+  // nodes, and the element arrays
+  size_t get_mem_bytes() const {
+    return ElementBase<S>::get_mem_bytes() + vec_bytes(idx) + vec_bytes(area);
+  }
+
+  // the elements never change, only the values on their nodes
+  void write_state(CheckpointWriter& _out) const {
+    ElementBase<S>::write_state(_out);
+    _out.put(nb);
+  }
+  void read_state(CheckpointReader& _in) {
+    ElementBase<S>::read_state(_in);
+    if (_in.get<size_t>() != nb) _in.fail();
+  }
+  size_t get_gl_bytes() const {
+#ifdef USE_GL
+    if (mgl) return mgl->num_bytes;
+#endif
+    return 0;
+  }
 /*
   const std::array<Vector<S>,Dimensions>&  get_tang() const { return b[0]; }
   const std::array<Vector<S>,Dimensions>&  get_norm() const { return b[1]; }
@@ -250,9 +344,9 @@ public:
     // pop off the "unknown" rotation rate and save it
     if (is_augmented()) {
       solved_omega = _in.back();
-      std::cout << "    solved rotation rate is " << solved_omega << std::endl;
+      LOG_DEBUG("    solved rotation rate is " << solved_omega);
       omega_error = solved_omega - this->B->get_rotvel();
-      std::cout << "    error in rotation rate is " << omega_error << std::endl;
+      LOG_DEBUG("    error in rotation rate is " << omega_error);
       _in.pop_back();
     }
 
@@ -310,7 +404,7 @@ public:
 
 
   // append nodes and bricks to this collection
-  void add_new(const ElementPacket<float>& _in) {
+  void add_new(const ElementPacket<S>& _in) {
 
     // ensure that this packet really is Volumes
     assert(_in.idx.size() != 0 && "Input ElementPacket is not Volumes");
@@ -353,6 +447,7 @@ public:
         this->x[d][nnold+i] = _in.x[Dimensions*i+d];
       }
     }
+    this->state_changed();
 
     // save them as untransformed if we have a Body pointer
     if (this->B) {
@@ -379,6 +474,10 @@ public:
 
     // now, depending on the element type, put the value somewhere - but element-wise, so here
     if (this->E == active) {
+      // nodal vorticity, as in the constructor
+      if (not this->s) this->s = Vector<S>(nnold, 0.0);
+      this->s->resize(nnold+nnodes, 0.0);
+      if (_in.val.size() == nnodes) std::copy(_in.val.begin(), _in.val.end(), this->s->begin()+nnold);
 /*
       // value is a fixed strength for the element
       ps[0]->reserve(neold+nelems); 
@@ -796,6 +895,7 @@ public:
         // update strengths
         (*this->s)[i] = this_s + _dt * wdu[0];
       }
+      this->state_changed();
     } else {
       //std::cout << "  Not stretching" << to_string() << std::endl;
     }
@@ -889,9 +989,9 @@ public:
     // how many nodes?
     const size_t num_pts = this->get_n();
 
-    std::vector<float> _x(Dimensions*num_pts);
+    std::vector<S> _x(Dimensions*num_pts);
     std::vector<Int> _idx;
-    std::vector<float> _vals;
+    std::vector<S> _vals;
 
     if (not _inert) {
       // vals are strength or radius?
@@ -907,7 +1007,7 @@ public:
       _x[2*i+1] = this->x[1][i];
     }
 
-    return ElementPacket<float>({_x, _idx, _vals, (size_t)num_pts, 0});
+    return ElementPacket<S>({_x, _idx, _vals, (size_t)num_pts, 0});
   }
 
   // return a scalar value representative of the core size of the nodes
@@ -1033,6 +1133,8 @@ public:
   void reset_augmentation_vars() {
     this_omega = this->B->get_rotvel();
     reabsorbed_gamma = 0.0;
+    // both feed the augmented BEM row
+    this->state_changed();
   }
 
   S get_last_body_circ_error() {
@@ -1042,6 +1144,7 @@ public:
   // *add* the given circulation to the reabsorbed accumulator
   void add_to_reabsorbed(const S _circ) {
     reabsorbed_gamma += _circ;
+    this->state_changed();
   }
 
   // return that amount of reabsorbed circulation
@@ -1132,6 +1235,9 @@ public:
     glBindVertexArray(0);
   }
 
+  // panels are few, so they are still uploaded by updateGL, see Points::publishGL
+  void publishGL() {}
+
   // this gets done every time we change the size of the index array
   void updateGL() {
     //std::cout << "inside Volumes.updateGL" << std::endl;
@@ -1173,6 +1279,7 @@ public:
 
       // must tell draw call how many elements are there - or, really, how many indices
       mgl->num_uploaded = idx.size();
+      mgl->num_bytes = vlen*Dimensions + sizeof(Int)*idx.size();
     }
   }
 
@@ -1233,15 +1340,15 @@ public:
     return retstr;
   }
 
-  std::string write_vtk(const size_t _index, const size_t _frameno, const double _time) {
+  std::string write_vtk(const size_t _index, const size_t _frameno, const double _time,
+                        const vtk_enc_t _enc = vtk_zlib) {
     assert(this->nb > 0 && "Inside write_vtk_grid with no elements");
-    const bool asbase64 = true;
   
     // generate file name
     std::string prefix = "grid_";
     std::stringstream vtkfn;
     vtkfn << prefix << std::setfill('0') << std::setw(2) << _index << "_" << std::setw(5) << _frameno << ".vtu";
-    VtkXmlWriter gridWriter = VtkXmlWriter(vtkfn.str(), asbase64);
+    VtkXmlWriter gridWriter = VtkXmlWriter(vtkfn.str(), _enc);
   
     // include simulation time here
     gridWriter.addElement("FieldData");
@@ -1267,9 +1374,9 @@ public:
     {
       std::map<std::string, std::string> attribs = {{"NumberOfComponents", "3"},
                                                     {"Name", "position"},
-                                                    {"type", "Float32"}};
+                                                    {"type", vtk_type_name<S>()}};
       gridWriter.addElement("DataArray", attribs);
-      Vector<float> pos = gridWriter.unpackArray(this->x);
+      Vector<S> pos = gridWriter.unpackArray(this->x);
       gridWriter.writeDataArray(pos);
       gridWriter.closeElement();
     }
@@ -1343,7 +1450,7 @@ public:
 
     if (this->has_vort()) {
       std::map<std::string, std::string> attribs = {{"Name", "vorticity"},
-                                                    {"type", "Float32"}};
+                                                    {"type", vtk_type_name<S>()}};
       gridWriter.addElement("DataArray", attribs);
       gridWriter.writeDataArray(*(this->w));
       gridWriter.closeElement(); // DataArray
@@ -1352,9 +1459,9 @@ public:
     {
       std::map<std::string, std::string> attribs = {{"NumberOfComponents", "3"},
                                                     {"Name", "velocity"},
-                                                    {"type", "Float32"}};
+                                                    {"type", vtk_type_name<S>()}};
       gridWriter.addElement("DataArray", attribs);
-      Vector<float> vel = gridWriter.unpackArray(this->u);
+      Vector<S> vel = gridWriter.unpackArray(this->u);
       gridWriter.writeDataArray(vel);
       // DataArray
       gridWriter.closeElement();
@@ -1370,6 +1477,28 @@ public:
     return vtkfn.str();
   }
 
+#ifdef USE_HDF5
+  // the same data as write_vtk, as one step of an hdf5 series
+  std::string write_hdf5(Hdf5Writer& _out, const size_t _index, const size_t _frameno, const double _time) {
+    assert(this->nb > 0 && "Inside write_hdf5 with no elements");
+    const size_t nper = idx.size() / nb;
+    if (nper != 4 and nper != 9) {
+      std::cout << "WARNING: hdf5 output only supports 4- and 9-node quads, not writing grid" << std::endl;
+      return std::string();
+    }
+
+    std::stringstream series;
+    series << "grid_" << std::setfill('0') << std::setw(2) << _index;
+    Hdf5Step step(_out, series.str(), _frameno, _time);
+    step.add_geometry(this->x);
+    step.add_topology(nper==4 ? "Quadrilateral" : "Quadrilateral_9", nb, nper, idx);
+    if (this->has_vort()) step.add_scalar("vorticity", *(this->w));
+    step.add_vector("velocity", this->u);
+    std::cout << "Wrote " << this->n << " elements to " << series.str() << ".h5" << std::endl;
+    return step.end_step();
+  }
+#endif
+
 protected:
   // ElementBase.h has x, s, u, ux on the *nodes*
 
@@ -1398,5 +1527,15 @@ private:
   std::shared_ptr<GlState> mgl;
 #endif
   float max_strength;
+
+  // the Gauss point sources and what it takes to refresh their strengths
+  struct QuadSrc {
+    std::optional<Points<S>> pts;
+    std::vector<S> shape;               // the four corner weights at each point
+    Vector<S> wgt;                      // area each point stands for
+    uint32_t gen = 0;
+    int nsub = 0;
+  };
+  mutable QuadSrc coarse_quad, fine_quad;
 };
 
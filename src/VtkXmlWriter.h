@@ -1,6 +1,6 @@
 /*
  * This class manages a writer object for vtk using the xml format.
- * Currently only supports 64 encoding and unstructured grids.
+ * Supports ascii, base64, and raw or zlib-compressed appended data for unstructured grids.
  * The next step is to start generalizing bigger writing processes for the vtu format.
  * 
  * (c)2019-20 Applied Scientific Research, Inc.
@@ -15,13 +15,35 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <cstring>
 
 #include <cppcodec/base64_rfc4648.hpp>
 #include <tinyxml2/tinyxml2.h>
+#include <miniz/miniz.h>
+
+// how DataArrays are stored
+enum vtk_enc_t {
+  vtk_ascii  = 1, // as text
+  vtk_base64 = 2, // inline, base64-encoded
+  vtk_raw    = 3, // appended after the xml, as raw bytes
+  vtk_zlib   = 4  // appended after the xml, as zlib-compressed blocks
+};
+
+// the names VTK uses for each stored type
+template <class T> inline const char* vtk_type_name();
+template <> inline const char* vtk_type_name<float>() { return "Float32"; }
+template <> inline const char* vtk_type_name<double>() { return "Float64"; }
+template <> inline const char* vtk_type_name<int32_t>() { return "Int32"; }
+template <> inline const char* vtk_type_name<uint8_t>() { return "UInt8"; }
 
 class VtkXmlWriter {
 public:
-  VtkXmlWriter(const std::string _file, const bool _base64) {
+  VtkXmlWriter(const std::string _file, const vtk_enc_t _enc) {
     // prepare file pointer and p
     m_fp = std::fopen(_file.c_str(), "wb");
     m_p = std::make_unique<tinyxml2::XMLPrinter>(m_fp);
@@ -34,10 +56,11 @@ public:
     m_p->PushAttribute( "byte_order", "LittleEndian" );
     // note this is still unsigned even though all indices later are signed!
     m_p->PushAttribute( "header_type", "UInt32" );
+    if (_enc == vtk_zlib) m_p->PushAttribute( "compressor", "vtkZLibDataCompressor" );
     m_p->OpenElement( "UnstructuredGrid" );
 
     // Set writer properties 
-    m_base64 = _base64;
+    m_enc = _enc;
     m_openElements = 2;
   }
 
@@ -75,7 +98,21 @@ public:
     using base64 = cppcodec::base64_rfc4648;
   
     // why would you ever want to use base64 for floats and such? so wasteful.
-    if (m_base64) {
+    if (m_enc == vtk_raw or m_enc == vtk_zlib) {
+      // the bytes are only held here, and written after the xml in finish()
+      m_p->PushAttribute( "format", "appended" );
+      m_p->PushAttribute( "offset", std::to_string(m_offset).c_str() );
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(_data.data());
+      const size_t nbytes = sizeof(S) * _data.size();
+      if (m_enc == vtk_raw) {
+        const uint32_t length = (uint32_t)nbytes;
+        append_block(std::vector<uint8_t>((const uint8_t*)&length, (const uint8_t*)&length + sizeof(uint32_t)));
+        append_block(std::vector<uint8_t>(bytes, bytes+nbytes));
+      } else {
+        append_compressed(bytes, nbytes);
+      }
+
+    } else if (m_enc == vtk_base64) {
       m_p->PushAttribute( "format", "binary" );
       std::string encoded = base64::encode((const char*)_data.data(), (size_t)(sizeof(_data[0])*_data.size()));
   
@@ -117,16 +154,113 @@ public:
 
   void finish() {
     if (m_openElements != 2) { std::cout << "WARNING: " << m_openElements << " WERE NOT CLOSED" << std::endl; }
-    while (m_openElements) {
+    while (m_openElements > 1) {
       this->closeElement();
     }
+
+    // the appended section follows the grid, and starts its bytes after the underscore;
+    //   the printer writes straight to the file, so nothing goes out of order
+    if (not m_appended.empty()) {
+      m_p->OpenElement( "AppendedData" );
+      m_p->PushAttribute( "encoding", "raw" );
+      m_p->PushText( " _" );
+      for (const auto& block : m_appended) {
+        std::fwrite(block.data(), 1, block.size(), m_fp);
+      }
+      m_p->PushText( " " );
+      m_p->CloseElement();
+      m_appended.clear();
+    }
+
+    this->closeElement();
     std::fclose(m_fp);
   }
 
 private:
-  bool m_base64;
+  void append_block(std::vector<uint8_t>&& _block) {
+    m_offset += _block.size();
+    m_appended.emplace_back(std::move(_block));
+  }
+
+  // compress separate blocks in parallel, then prepend VTK's header: the number of blocks,
+  //   the block size, the size of a partial last block (or 0), and each compressed size
+  void append_compressed(const uint8_t* _bytes, const size_t _nbytes) {
+    const size_t nblocks = (_nbytes + zlib_block - 1) / zlib_block;
+    std::vector<std::vector<uint8_t>> blocks(nblocks);
+    bool failed = false;
+
+    #pragma omp parallel for schedule(dynamic) if (nblocks > 4)
+    for (int32_t b=0; b<(int32_t)nblocks; ++b) {
+      const size_t i0 = b*zlib_block;
+      const mz_ulong len = (mz_ulong)std::min(zlib_block, _nbytes-i0);
+      mz_ulong clen = mz_compressBound(len);
+      blocks[b].resize(clen);
+      if (mz_compress2(blocks[b].data(), &clen, _bytes+i0, len, MZ_BEST_SPEED) != MZ_OK) failed = true;
+      blocks[b].resize(clen);
+    }
+    if (failed) std::cout << "WARNING: could not compress vtk data array" << std::endl;
+
+    std::vector<uint32_t> header = {(uint32_t)nblocks, (uint32_t)zlib_block, (uint32_t)(_nbytes % zlib_block)};
+    for (const auto& block : blocks) header.push_back((uint32_t)block.size());
+    const uint8_t* hbytes = reinterpret_cast<const uint8_t*>(header.data());
+    append_block(std::vector<uint8_t>(hbytes, hbytes + sizeof(uint32_t)*header.size()));
+    for (auto& block : blocks) append_block(std::move(block));
+  }
+
+  static constexpr size_t zlib_block = 1 << 15;
+
+  vtk_enc_t m_enc;
   std::FILE* m_fp;
   int m_openElements;
   std::unique_ptr<tinyxml2::XMLPrinter> m_p;
+
+  // appended data, and the offset of the next array within it
+  std::vector<std::vector<uint8_t>> m_appended;
+  size_t m_offset = 0;
+};
+
+//
+// A ParaView .pvd time-series index for each series of files (part_00_*.vtu goes in
+//   part_00.pvd), each new entry written over the closing tags so the file is always whole
+//
+class VtkPvdIndex {
+public:
+  void add(const std::string& _file, const double _time) {
+    const size_t sep = _file.rfind('_');
+    if (sep == std::string::npos) return;
+    const std::string pvdfile = _file.substr(0, sep) + ".pvd";
+
+    std::lock_guard<std::mutex> lock(mtx);
+    // the first entry of a run starts a new file
+    std::FILE* fp = nullptr;
+    if (started.count(pvdfile)) fp = std::fopen(pvdfile.c_str(), "r+b");
+    if (fp) {
+      std::fseek(fp, -(long)std::strlen(tail), SEEK_END);
+    } else {
+      fp = std::fopen(pvdfile.c_str(), "wb");
+      if (not fp) return;
+      std::fputs(head, fp);
+      started.insert(pvdfile);
+    }
+    std::fprintf(fp, "    <DataSet timestep=\"%.10g\" part=\"0\" file=\"%s\"/>\n", _time, _file.c_str());
+    std::fputs(tail, fp);
+    std::fclose(fp);
+  }
+
+  // the next entries start new files
+  void reset() {
+    std::lock_guard<std::mutex> lock(mtx);
+    started.clear();
+  }
+
+private:
+  static constexpr const char* head = "<?xml version=\"1.0\"?>\n"
+                                      "<VTKFile type=\"Collection\" version=\"0.1\" byte_order=\"LittleEndian\">\n"
+                                      "  <Collection>\n";
+  static constexpr const char* tail = "  </Collection>\n"
+                                      "</VTKFile>\n";
+
+  std::set<std::string> started;
+  std::mutex mtx;
 };
 #endif
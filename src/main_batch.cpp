@@ -11,8 +11,19 @@
 #include "BoundaryFeature.h"
 #include "MeasureFeature.h"
 #include "Simulation.h"
+#include "SimSession.h"
 #include "JsonHelper.h"
 #include "RenderParams.h"
+#include "SimdHelper.h"
+#include "CpuDispatch.h"
+#include "MpiHelper.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+#ifdef USE_EGL
+#include "OffscreenGL.h"
+#include "FrameSaver.h"
+#endif
 
 #ifdef _WIN32
   // for glad
@@ -23,16 +34,425 @@
   #include <ciso646>
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <iostream>
+#include <fstream>
+#include <iomanip>
 #include <vector>
+#include <map>
+#include <string>
+#include <mutex>
+#include <future>
+#include <filesystem>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <csignal>
+
+
+// a batch job asked to stop (by its scheduler, usually) saves its state first
+static volatile std::sig_atomic_t stop_requested = 0;
+static void request_stop(int) { stop_requested = 1; }
+
+// the signal reaches each rank on its own, maybe steps apart, and a rank which left the step
+//   loop alone would hang the others in their next collective; so every rank asks, at the
+//   same point, whether any of them has been told to stop
+static bool stop_agreed() { return mpi_any(stop_requested != 0); }
+
+#ifdef USE_EGL
+// did the last step reach or pass an output time; every step does when there is no output dt
+static bool passed_output_time(const double _t0, const double _t1, const double _outdt) {
+  if (_outdt <= 0.0) return true;
+  return std::floor(_t1/_outdt + 1.e-6) > std::floor(_t0/_outdt + 1.e-6);
+}
+
+// draw the simulation as the GUI would and queue it to be written as the next png
+static void render_frame(Simulation& sim,
+                         RenderParams& rparams,
+                         const OffscreenGL& offscreen,
+                         FrameSaver& saver,
+                         int& frameno) {
+  PROFILE_ZONE("render frame");
+
+  // the GUI does this when it picks up the results of a step
+  sim.updateGL();
+
+  glViewport(0, 0, offscreen.get_width(), offscreen.get_height());
+  glClearColor(rparams.clear_color[0], rparams.clear_color[1], rparams.clear_color[2], rparams.clear_color[3]);
+  glClear(GL_COLOR_BUFFER_BIT);
+  std::vector<float> gl_projection = offscreen.get_projection(rparams.vcx, rparams.vcy, rparams.vsize);
+  sim.drawGL(gl_projection, rparams);
+
+  std::stringstream pngfn;
+  pngfn << "img_" << std::setfill('0') << std::setw(5) << frameno << ".png";
+  saver.request(pngfn.str());
+  saver.service();
+  std::cout << "  queued frame " << pngfn.str() << std::endl;
+  ++frameno;
+}
+#endif
+
+static std::vector<std::string> split_list(const std::string _list) {
+  std::vector<std::string> items;
+  std::stringstream ss(_list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (not item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+//
+// Strong scaling: run the same case from the start at each thread count (and each velocity
+//   summation, if given), time the steps after the warm-up ones, and report the speedup and
+//   parallel efficiency of every profiled phase against the first thread count
+//
+// a phase which barely speeds up with many more threads has likely lost its parallel region
+//
+static int run_scaling(const nlohmann::json& _j, std::vector<int> _threads,
+                       const int _nsteps, const int _nwarm, std::vector<std::string> _summations) {
+
+#ifdef _OPENMP
+  const int maxthreads = omp_get_max_threads();
+#else
+  const int maxthreads = 1;
+#endif
+  if (_threads.empty()) {
+    for (int t=1; t<maxthreads; t*=2) _threads.push_back(t);
+    _threads.push_back(maxthreads);
+  }
+  if (_summations.empty()) _summations.push_back("");
+
+  std::signal(SIGTERM, request_stop);
+  std::signal(SIGINT, request_stop);
+
+  // one set of runs at each summation
+  for (const std::string& summ : _summations) {
+
+    // seconds per step of each phase, by path, for each thread count
+    std::vector<std::map<std::string,double>> secs(_threads.size());
+    std::vector<std::string> order;
+
+    for (size_t it=0; it<_threads.size(); ++it) {
+#ifdef _OPENMP
+      omp_set_num_threads(_threads[it]);
+#endif
+      std::cout << std::endl << "Scaling run with " << _threads[it] << " threads";
+      if (not summ.empty()) std::cout << " and " << summ << " summation";
+      std::cout << std::endl;
+
+      // a fresh simulation every time
+      Simulation sim;
+      std::vector< std::unique_ptr<FlowFeature> > ffeatures;
+      std::vector< std::unique_ptr<BoundaryFeature> > bfeatures;
+      std::vector< std::unique_ptr<MeasureFeature> > mfeatures;
+      RenderParams rparams;
+
+      nlohmann::json j = _j;
+      if (not summ.empty()) j["simparams"]["velocity"]["summation"] = summ;
+      // these runs are only for timing
+      if (j.find("runtime") != j.end()) {
+        j["runtime"].erase("statusFile");
+        j["runtime"].erase("traceFile");
+      }
+      if (j.find("simparams") != j.end()) j["simparams"]["outputDt"] = 0.0;
+      parse_json(sim, ffeatures, bfeatures, mfeatures, rparams, j);
+
+      const std::string err = init_features(sim, ffeatures, bfeatures, mfeatures, rparams);
+      if (not err.empty()) {
+        std::cout << std::endl << "ERROR: " << err;
+        return 1;
+      }
+
+      for (int istep=0; istep<_nwarm+_nsteps; ++istep) {
+        const std::string serr = sim.check_simulation();
+        if (not serr.empty()) {
+          std::cout << std::endl << "ERROR: " << serr;
+          return 1;
+        }
+        step_features(sim, ffeatures, mfeatures, rparams);
+
+        const auto start = std::chrono::steady_clock::now();
+        sim.step();
+        const double step_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (stop_agreed()) break;
+        if (istep < _nwarm) continue;
+
+        secs[it]["step"] += step_secs / _nsteps;
+#ifdef USE_PROFILER
+        // this step's zones, under the whole step
+        const std::vector<Profiler::Zone>& zones = Profiler::get().get_zones();
+        for (const int iz : Profiler::tree_order(zones)) {
+          if (zones[iz].depth < 1) continue;
+          const std::string path = Profiler::get().get_path(zones, iz);
+          if (std::find(order.begin(), order.end(), path) == order.end()) order.push_back(path);
+          secs[it][path] += zones[iz].step_secs / _nsteps;
+        }
+#endif
+      }
+      Logger::get().flush();
+      sim.reset();
+      if (stop_agreed()) return 1;
+    }
+
+    // and the table
+    Logger::get().flush();
+    printf("\nStrong scaling over %d steps after %d warm-up", _nsteps, _nwarm);
+    if (not summ.empty()) printf(", %s summation", summ.c_str());
+    printf("\n  %-40s", "phase, secs/step (speedup, efficiency)");
+    for (const int t : _threads) printf(" %20d", t);
+    printf("\n");
+
+    std::vector<std::string> serial;
+    order.insert(order.begin(), "step");
+    for (const std::string& path : order) {
+      const double base = secs[0][path];
+      // indent by depth, like the profiler's summary
+      const size_t depth = (size_t)std::count(path.begin(), path.end(), '.');
+      const std::string label = std::string(2*depth, ' ') + path.substr(path.rfind('.') == std::string::npos ? 0 : path.rfind('.')+1);
+      printf("  %-40s", label.c_str());
+      for (size_t it=0; it<_threads.size(); ++it) {
+        const double t = secs[it][path];
+        if (t > 0.0 and base > 0.0) {
+          const double speedup = base / t;
+          const double eff = speedup * (double)_threads[0] / (double)_threads[it];
+          printf(" %8.4f (%4.1f,%4.0f%%)", t, speedup, 100.0*eff);
+        } else {
+          printf(" %8.4f %11s", t, "");
+        }
+      }
+      printf("\n");
 
+      // flag anything large enough to matter which gained under 20% from 4x the threads
+      const size_t il = _threads.size()-1;
+      if (_threads[il] >= 4*_threads[0] and base > 0.05*secs[0]["step"] and
+          secs[il][path] > 0.0 and base / secs[il][path] < 1.2) serial.push_back(path);
+    }
+    for (const std::string& path : serial) {
+      printf("  warning: %s does not speed up with more threads\n", path.c_str());
+    }
+    std::fflush(stdout);
+  }
+
+  return 0;
+}
+
+//
+// Ensemble: many variants of one case, each run start to finish as its own Simulation, several
+//   at once in this one process; the grid file names the inputs to vary, as JSON pointers into
+//   the case file, and the values of each, and every combination becomes one variant:
+//
+//   {"parameters": {"/flowparams/Re": [100, 200, 400], "/bodies/0/rotation": [0, 5]},
+//    "output": "sweep", "jobs": 4}
+//
+// each variant gets a directory under the output one, holding its input file, status file and
+//   checkpoint, and the output directory gets a table with one line per variant; the cores
+//   are split evenly between the variants running at any one time
+//
+struct EnsembleCase {
+  nlohmann::json input;
+  std::string label;
+  std::string dir;
+};
+
+struct EnsembleResult {
+  size_t nsteps = 0;
+  double secs = 0.0;
+  std::string error;
+};
+
+// every combination of the parameters' values, the last parameter varying fastest
+static std::vector<EnsembleCase> make_ensemble(const nlohmann::json& _base, const nlohmann::json& _grid,
+                                               const std::string& _outdir) {
+  std::vector<std::string> names;
+  std::vector<std::vector<nlohmann::json>> values;
+  if (_grid.find("parameters") != _grid.end()) {
+    for (auto it = _grid["parameters"].begin(); it != _grid["parameters"].end(); ++it) {
+      names.push_back(it.key());
+      values.push_back(it.value().is_array() ? it.value().get<std::vector<nlohmann::json>>()
+                                             : std::vector<nlohmann::json>{it.value()});
+    }
+  }
+
+  size_t ncases = 1;
+  for (const auto& v : values) ncases *= v.size();
+
+  std::vector<EnsembleCase> cases;
+  for (size_t c=0; c<ncases; ++c) {
+    EnsembleCase ec;
+    ec.input = _base;
+    std::stringstream dir;
+    dir << _outdir << "/case_" << std::setfill('0') << std::setw(4) << c;
+    ec.dir = dir.str();
+
+    std::vector<std::string> parts(names.size());
+    size_t rem = c;
+    for (size_t ip=names.size(); ip-- > 0; ) {
+      const nlohmann::json& val = values[ip][rem % values[ip].size()];
+      rem /= values[ip].size();
+      ec.input[nlohmann::json::json_pointer(names[ip])] = val;
+      parts[ip] = names[ip] + "=" + val.dump();
+    }
+    for (const auto& part : parts) ec.label += (ec.label.empty() ? "" : " ") + part;
+
+    // files go in the variant's own directory, nothing is traced
+    if (not ec.input["runtime"].is_object()) ec.input["runtime"] = nlohmann::json::object();
+    if (not ec.input["simparams"].is_object()) ec.input["simparams"] = nlohmann::json::object();
+    nlohmann::json& rt = ec.input["runtime"];
+    const std::string sfile = rt.value("statusFile", std::string("status.txt"));
+    rt["statusFile"] = ec.dir + "/" + std::filesystem::path(sfile).filename().string();
+    rt.erase("traceFile");
+    nlohmann::json& sp = ec.input["simparams"];
+    const std::string cfile = sp.value("checkpointFile", std::string("checkpoint.o2d"));
+    sp["checkpointFile"] = ec.dir + "/" + std::filesystem::path(cfile).filename().string();
+    if (sp.find("probes") != sp.end() and sp["probes"].is_object()) {
+      const std::string pfile = sp["probes"].value("file", std::string("probes.csv"));
+      sp["probes"]["file"] = ec.dir + "/" + std::filesystem::path(pfile).filename().string();
+    }
+
+    cases.push_back(std::move(ec));
+  }
+  return cases;
+}
+
+static int run_ensemble(const nlohmann::json& _base, const nlohmann::json& _grid, int _jobs) {
+
+  if (mpi_size() > 1) {
+    std::cout << std::endl << "ERROR: run an ensemble on one rank only" << std::endl;
+    return 1;
+  }
+
+  const std::string outdir = _grid.value("output", std::string("ensemble"));
+  std::vector<EnsembleCase> cases = make_ensemble(_base, _grid, outdir);
+
+#ifdef _OPENMP
+  const int maxthreads = omp_get_max_threads();
+#else
+  const int maxthreads = 1;
+#endif
+  if (_jobs < 1) _jobs = _grid.value("jobs", 0);
+  if (_jobs < 1) _jobs = maxthreads;
+  _jobs = std::min(_jobs, (int)cases.size());
+  const int share = std::max(1, maxthreads / _jobs);
+
+  std::cout << std::endl << "Ensemble of " << cases.size() << " variants, " << _jobs
+            << " at a time with " << share << " threads each, into " << outdir << std::endl;
+
+  // the teams of several jobs would all pin onto the first cores, so leave them unpinned
+  if (_jobs > 1) {
+    bool unpinned = false;
+    for (auto& ec : cases) unpinned |= (ec.input["simparams"].erase("threadAffinity") > 0);
+    if (unpinned) std::cout << "  ignoring threadAffinity with more than one job at a time" << std::endl;
+  }
+
+  // each variant's directory and the input it ran from
+  for (const auto& ec : cases) {
+    std::error_code err;
+    std::filesystem::create_directories(ec.dir, err);
+    if (err) {
+      std::cout << std::endl << "ERROR: could not make " << ec.dir << ": " << err.message() << std::endl;
+      return 1;
+    }
+    std::ofstream(ec.dir + "/input.json") << std::setw(2) << ec.input << std::endl;
+  }
+
+  std::signal(SIGTERM, request_stop);
+  std::signal(SIGINT, request_stop);
+
+  // the features draw from shared random generators, so only one variant sets up at a time
+  std::mutex setup_mtx;
+
+  ThreadPool pool((size_t)_jobs, share, "ensemble");
+  std::vector<std::future<EnsembleResult>> results;
+  for (size_t c=0; c<cases.size(); ++c) {
+    results.push_back(pool.submit([&cases, &setup_mtx, c]() {
+      EnsembleResult res;
+      // an ensemble runs on one rank, so this only reads the flag
+      if (stop_agreed()) {
+        res.error = "not run";
+        return res;
+      }
+
+      Simulation sim;
+      std::vector< std::unique_ptr<FlowFeature> > ffeatures;
+      std::vector< std::unique_ptr<BoundaryFeature> > bfeatures;
+      std::vector< std::unique_ptr<MeasureFeature> > mfeatures;
+      RenderParams rparams;
+      {
+        std::lock_guard<std::mutex> lock(setup_mtx);
+        std::cout << std::endl << "Starting variant " << c << ": " << cases[c].label << std::endl;
+        parse_json(sim, ffeatures, bfeatures, mfeatures, rparams, cases[c].input);
+        res.error = init_features(sim, ffeatures, bfeatures, mfeatures, rparams);
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+      while (res.error.empty()) {
+        res.error = sim.check_simulation();
+        if (not res.error.empty()) break;
+        step_features(sim, ffeatures, mfeatures, rparams);
+        sim.step();
+        ++res.nsteps;
+        if (stop_agreed()) {
+          (void) sim.write_checkpoint();
+          res.error = "stopped on request";
+          break;
+        }
+        if (sim.test_vs_stop()) break;
+      }
+      res.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      sim.flush_output();
+      sim.reset();
+      return res;
+    }));
+  }
+
+  std::vector<EnsembleResult> done;
+  for (auto& res : results) done.push_back(res.get());
+
+  // and the table, on the console and in the output directory
+  std::ofstream table(outdir + "/ensemble.txt");
+  table << "# case steps seconds result parameters" << std::endl;
+  int rc = 0;
+  Logger::get().flush();
+  std::cout << std::endl << "Ensemble results" << std::endl;
+  for (size_t c=0; c<cases.size(); ++c) {
+    const EnsembleResult& res = done[c];
+    const std::string result = res.error.empty() ? "ok" : res.error;
+    if (not res.error.empty()) rc = 1;
+    printf("  %4zu %8zu steps %10.3f s  %-10s %s\n", c, res.nsteps, res.secs,
+           res.error.empty() ? "ok" : "FAILED", cases[c].label.c_str());
+    table << c << " " << res.nsteps << " " << res.secs << " \"" << result << "\" " << cases[c].label << std::endl;
+  }
+  std::fflush(stdout);
+
+  return rc;
+}
 
 // execution starts here
 
 int main(int argc, char const *argv[]) {
 
+  // before any threads start
+  PROFILE_OPEN_COUNTERS();
+  PROFILE_THREAD_NAME("main");
+
+#ifdef USE_MPI
+  MPI_Init(&argc, const_cast<char***>(&argv));
+  // every rank runs the same simulation, so only one needs to talk about it
+  if (not is_root_rank()) (void) std::freopen("/dev/null", "w", stdout);
+#endif
+
   std::cout << std::endl << "Omega2D Batch" << std::endl;
+  if (mpi_size() > 1) std::cout << "  MPI ranks: " << mpi_size() << std::endl;
   if (VERBOSE) { std::cout << "  VERBOSE is on" << std::endl; }
+  std::cout << "  SIMD: " << simd_isa_string() << std::endl;
+  std::cout << "  kernels: " << kernel_isa_string() << std::endl;
 
   // Set up vortex particle simulation
   Simulation sim;
@@ -44,58 +464,134 @@ int main(int argc, char const *argv[]) {
   // a string to hold any error messages
   std::string sim_err_msg;
 
+  // options for a scaling study come before the file name
+  bool scaling = false;
+  std::vector<int> scale_threads;
+  std::vector<std::string> scale_summations;
+  int scale_steps = 10;
+  int scale_warmup = 2;
+  std::string ensemble_file;
+  int ensemble_jobs = 0;
+  bool render_frames = false;
+  while (argc > 1 and std::strncmp(argv[1], "--", 2) == 0) {
+    const std::string opt = argv[1];
+    const size_t eq = opt.find('=');
+    const std::string key = opt.substr(0, eq);
+    const std::string val = (eq == std::string::npos) ? "" : opt.substr(eq+1);
+    if (key == "--scaling") {
+      scaling = true;
+      for (const auto& t : split_list(val)) scale_threads.push_back(std::max(1, std::stoi(t)));
+    } else if (key == "--steps" and not val.empty()) {
+      scale_steps = std::max(1, std::stoi(val));
+    } else if (key == "--warmup" and not val.empty()) {
+      scale_warmup = std::max(0, std::stoi(val));
+    } else if (key == "--summation" and not val.empty()) {
+      scale_summations = split_list(val);
+    } else if (key == "--ensemble" and not val.empty()) {
+      ensemble_file = val;
+    } else if (key == "--jobs" and not val.empty()) {
+      ensemble_jobs = std::max(1, std::stoi(val));
+    } else if (key == "--frames") {
+      render_frames = true;
+    } else {
+      std::cout << "Unknown option " << opt << std::endl;
+      argc = 0;
+      break;
+    }
+    ++argv;
+    --argc;
+  }
+
+  if (scaling and argc == 2) {
+    const int rc = run_scaling(read_json(argv[1]), scale_threads, scale_steps, scale_warmup, scale_summations);
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+    return rc;
+  }
+
+  if (not ensemble_file.empty() and not scaling and argc == 2) {
+    const int rc = run_ensemble(read_json(argv[1]), read_json(ensemble_file), ensemble_jobs);
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+    return rc;
+  }
+
   // load a simulation from a JSON file - check command line for file name
-  if (argc == 2) {
+  if (not scaling and ensemble_file.empty() and (argc == 2 or argc == 3)) {
     std::string infile = argv[1];
     nlohmann::json j = read_json(infile);
     parse_json(sim, ffeatures, bfeatures, mfeatures, rparams, j);
   } else {
     std::cout << std::endl << "Usage:" << std::endl;
-    std::cout << "  " << argv[0] << " filename.json" << std::endl << std::endl;
+    std::cout << "  " << argv[0] << " [--frames] filename.json [checkpoint]" << std::endl;
+    std::cout << "  " << argv[0] << " --scaling[=1,2,4,8] [--steps=10] [--warmup=2] [--summation=direct,fmm] filename.json" << std::endl;
+    std::cout << "  " << argv[0] << " --ensemble=grid.json [--jobs=4] filename.json" << std::endl << std::endl;
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
     return -1;
   }
 
-
-  std::cout << std::endl << "Initializing simulation" << std::endl;
-
-  // initialize particle distributions
-  for (auto const& ff: ffeatures) {
-    if (ff->is_enabled()) {
-      ElementPacket<float> newpacket = ff->init_elements(sim.get_ips());
-      // echo any errors
-      /*if (good)*/ sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
-    }
-  }
-
-  // initialize solid objects
-  for (auto const& bf : bfeatures) {
-    if (bf->is_enabled()) {
-      ElementPacket<float> newpacket = bf->init_elements(sim.get_ips());
-      const move_t newmovetype = (bf->get_body() ? bodybound : fixed);
-      sim.add_elements(newpacket, reactive, newmovetype, bf->get_body() );
+  // the GL buffers are made as the elements are, so the context comes first
+#ifdef USE_EGL
+  OffscreenGL offscreen;
+  FrameSaver frame_saver;
+  int frameno = 0;
+  // every rank has the same flow to draw
+  render_frames = render_frames and is_root_rank();
+  if (render_frames) {
+    sim_err_msg = offscreen.init(rparams.width, rparams.height);
+    if (not sim_err_msg.empty()) {
+      std::cout << std::endl << "ERROR: " << sim_err_msg;
+#ifdef USE_MPI
+      MPI_Finalize();
+#endif
+      return 1;
     }
   }
-
-  // initialize measurement features
-  for (auto const& mf: mfeatures) {
-    if (mf->is_enabled()) {
-      const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
-      sim.add_elements( mf->init_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body() );
-    }
+#else
+  if (render_frames) {
+    std::cout << std::endl << "ERROR: this build can not draw frames, configure with USE_EGL to allow it" << std::endl;
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+    return 1;
   }
+#endif
 
-  sim.set_initialized();
+  std::cout << std::endl << "Initializing simulation" << std::endl;
 
-  // check init for blow-up or errors
-  sim_err_msg = sim.check_initialization();
+  sim_err_msg = init_features(sim, ffeatures, bfeatures, mfeatures, rparams);
 
   if (not sim_err_msg.empty()) {
     // the initialization had some difficulty
     std::cout << std::endl << "ERROR: " << sim_err_msg;
     // stop the run
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
     return 1;
   }
 
+  // continue an earlier run of the same case
+  if (argc == 3 and not sim.read_checkpoint(argv[2])) {
+    std::cout << std::endl << "ERROR: could not resume from " << argv[2] << std::endl;
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+    return 1;
+  }
+
+  std::signal(SIGTERM, request_stop);
+  std::signal(SIGINT, request_stop);
+
+#ifdef USE_EGL
+  // the starting state is the first frame
+  if (render_frames) render_frame(sim, rparams, offscreen, frame_saver, frameno);
+#endif
+
 
   //
   // Main loop
@@ -106,23 +602,13 @@ int main(int argc, char const *argv[]) {
     // check flow for blow-up or errors
     sim_err_msg = sim.check_simulation();
 
+#ifdef USE_EGL
+    const double last_time = sim.get_time();
+#endif
+
     if (sim_err_msg.empty()) {
       // the last simulation step was fine, OK to continue
-      // generate new particles from emitters
-      for (auto const& ff: ffeatures) {
-        if (ff->is_enabled()) {
-          ElementPacket<float> newpacket = ff->step_elements(sim.get_ips());
-          // echo any errors
-          sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
-        }
-      }
-
-      for (auto const& mf: mfeatures) {
-        if (mf->is_enabled()) {
-          const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
-          sim.add_elements( mf->step_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body() );
-        }
-      }
+      step_features(sim, ffeatures, mfeatures, rparams);
 
       // begin a new dynamic step: convection and diffusion
       sim.step();
@@ -135,6 +621,18 @@ int main(int argc, char const *argv[]) {
     }
 
     // export data files at this step?
+#ifdef USE_EGL
+    if (render_frames and passed_output_time(last_time, sim.get_time(), sim.get_output_dt())) {
+      render_frame(sim, rparams, offscreen, frame_saver, frameno);
+    }
+#endif
+
+    // save the state and quit between steps
+    if (stop_agreed()) {
+      std::cout << std::endl << "Stopping on request at step " << sim.get_nstep() << std::endl;
+      (void) sim.write_checkpoint();
+      break;
+    }
 
     // check vs. stopping conditions
     if (sim.test_vs_stop()) break;
@@ -153,9 +651,16 @@ int main(int argc, char const *argv[]) {
 
   // Cleanup
   std::cout << "Starting shutdown procedure" << std::endl;
+#ifdef USE_EGL
+  // the last frames are still reading back or compressing
+  if (render_frames) frame_saver.finish();
+#endif
   sim.reset();
   std::cout << "Quitting" << std::endl;
 
+#ifdef USE_MPI
+  MPI_Finalize();
+#endif
   return 0;
 }
 
@@ -0,0 +1,336 @@
+/*
+ * main_bench.cpp - Timings of the inner influence kernels, for catching regressions
+ *                  and comparing the instruction sets on one machine
+ *
+ * (c)2021 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "Kernels.h"
+#include "SimdHelper.h"
+#include "CpuDispatch.h"
+
+#ifdef USE_VC
+#include <Vc/Vc>
+#endif
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+
+//
+// Each kernel from Kernels.h runs over every pair of nt targets and ns sources the way
+//   Influence.h runs them: one target broadcast across a vector of sources, summing into
+//   per-lane accumulators, then a horizontal sum; one pass on one thread
+//
+// the kernels take the core function (RM, exponential, WL, V2, V3) as a template parameter;
+//   this times the default one from CoreFunc.h, which the compile line picks, so CMake
+//   builds one of these per core
+//
+constexpr VelCore bench_core = default_vel_core;
+
+// which core this was built with
+static const char* core_name() {
+  static const std::string name = vel_core_name(bench_core);
+  return name.c_str();
+}
+
+// the number of lanes in a scalar or a SIMD type
+template <class V>
+constexpr size_t lanes() {
+  if constexpr (std::is_arithmetic<V>::value) return 1;
+  else return V::size();
+}
+
+// one value of a scalar or a SIMD type
+template <class V, class S>
+inline S lane(const V& _v, const size_t _l) {
+  if constexpr (std::is_arithmetic<V>::value) { (void)_l; return _v; }
+  else return (S)_v[_l];
+}
+
+// pack a list of values into vectors, padding the last with _pad
+template <class V, class S>
+std::vector<V> pack(const std::vector<S>& _in, const S _pad) {
+  constexpr size_t nl = lanes<V>();
+  const size_t nv = (_in.size() + nl - 1) / nl;
+  std::vector<V> out(nv);
+  for (size_t i=0; i<nv; ++i) {
+    if constexpr (std::is_arithmetic<V>::value) {
+      out[i] = _in[i];
+    } else {
+      V v(_pad);
+      for (size_t l=0; l<nl and i*nl+l<_in.size(); ++l) v[l] = _in[i*nl+l];
+      out[i] = v;
+    }
+  }
+  return out;
+}
+
+// random points in the unit square, the other end of each panel a little away
+template <class S>
+struct Elems {
+  std::vector<S> x, y, x1, y1, r, s, s2;
+
+  Elems(const size_t _n, const uint32_t _seed) {
+    std::mt19937 gen(_seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (size_t i=0; i<_n; ++i) {
+      x.push_back((S)unit(gen));
+      y.push_back((S)unit(gen));
+      x1.push_back(x.back() + (S)(0.01 + 0.01*unit(gen)));
+      y1.push_back(y.back() + (S)(0.01*unit(gen)));
+      r.push_back((S)(0.005 + 0.005*unit(gen)));
+      s.push_back((S)(unit(gen) - 0.5));
+      s2.push_back((S)(unit(gen) - 0.5));
+    }
+  }
+};
+
+// and the same, packed for one instruction set
+template <class V>
+struct Packed {
+  std::vector<V> x, y, x1, y1, r, s, s2;
+
+  template <class S>
+  explicit Packed(const Elems<S>& _e)
+    // padding sources have zero strength, and sit away from the targets to keep the logs finite
+    : x(pack<V>(_e.x, S(-10.0))), y(pack<V>(_e.y, S(-10.0))),
+      x1(pack<V>(_e.x1, S(-9.9))), y1(pack<V>(_e.y1, S(-10.0))),
+      r(pack<V>(_e.r, S(0.01))), s(pack<V>(_e.s, S(0.0))), s2(pack<V>(_e.s2, S(0.0))) {}
+};
+
+struct BenchCase {
+  std::string kernel;
+  std::string isa;
+  std::string prec;
+  size_t n;
+  double secs;
+  double flops;
+  double checksum;
+};
+
+//
+// time one kernel: _k(src, j, tx, ty, tr, acc) adds the influence of source vector j on
+//   one target into the NACC accumulators; repeat whole passes until _mintime has passed
+//   and keep the fastest one
+//
+template <class S, class A, class V, class AV, size_t NACC, class KERN>
+KERNEL_CLONES
+BenchCase time_kernel(const std::string _name, const std::string _isa, const size_t _flops_per,
+                      const Elems<S>& _src, const Elems<S>& _targ, const double _mintime, KERN _k) {
+
+  const Packed<V> src(_src);
+  const size_t nt = _targ.x.size();
+  const size_t nsv = src.x.size();
+
+  double best = 1.e+30;
+  double total = 0.0;
+  double checksum = 0.0;
+  do {
+    double sum = 0.0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i=0; i<nt; ++i) {
+      const V tx = _targ.x[i];
+      const V ty = _targ.y[i];
+      const V tr = _targ.r[i];
+      AV acc[NACC];
+      for (size_t a=0; a<NACC; ++a) acc[a] = AV(A(0.0));
+      for (size_t j=0; j<nsv; ++j) _k(src, j, tx, ty, tr, acc);
+      for (size_t a=0; a<NACC; ++a) {
+        for (size_t l=0; l<lanes<AV>(); ++l) sum += (double)lane<AV,A>(acc[a], l);
+      }
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, secs);
+    total += secs;
+    checksum = sum;
+  } while (total < _mintime);
+
+  std::string prec = std::is_same<S,float>::value ? "float" : "double";
+  if (not std::is_same<S,A>::value) prec = "mixed";
+
+  return BenchCase{_name, _isa, prec, nt, best,
+                   (double)nt * (double)_src.x.size() * (double)_flops_per, checksum};
+}
+
+//
+// every kernel in Kernels.h, with store type V and accumulator type AV
+//
+template <class S, class A, class V, class AV>
+void bench_all(const std::string _isa, const std::vector<size_t>& _sizes, const double _mintime,
+               const std::string _only, std::vector<BenchCase>& _out) {
+
+  auto want = [&](const char* _name) { return _only.empty() or _only == _name; };
+
+  for (const size_t n : _sizes) {
+    const Elems<S> src(n, 1234);
+    const Elems<S> targ(n, 5678);
+
+    // point sources
+    if (want("kernelp_0v_0b")) _out.push_back(time_kernel<S,A,V,AV,1>("kernelp_0v_0b", _isa,
+      flopsp_0v_0b<S,A>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V tr, AV* acc) {
+        kernelp_0v_0b<V,AV>(p.x[j], p.y[j], p.r[j], p.s[j], tx, ty, tr, &acc[0]);
+      }));
+    if (want("kernelp_0v_0p")) _out.push_back(time_kernel<S,A,V,AV,1>("kernelp_0v_0p", _isa,
+      flopsp_0v_0p<S,A>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V, AV* acc) {
+        kernelp_0v_0p<V,AV>(p.x[j], p.y[j], p.r[j], p.s[j], tx, ty, &acc[0]);
+      }));
+    if (want("kernelu_0v_0b")) _out.push_back(time_kernel<S,A,V,AV,2>("kernelu_0v_0b", _isa,
+      flopsu_0v_0b<S,A,bench_core>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V tr, AV* acc) {
+        kernelu_0v_0b<V,AV,bench_core>(p.x[j], p.y[j], p.r[j], p.s[j], tx, ty, tr, &acc[0], &acc[1]);
+      }));
+    if (want("kernelu_0v_0p")) _out.push_back(time_kernel<S,A,V,AV,2>("kernelu_0v_0p", _isa,
+      flopsu_0v_0p<S,A,bench_core>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V, AV* acc) {
+        kernelu_0v_0p<V,AV,bench_core>(p.x[j], p.y[j], p.r[j], p.s[j], tx, ty, &acc[0], &acc[1]);
+      }));
+    if (want("kernelug_0v_0b")) _out.push_back(time_kernel<S,A,V,AV,6>("kernelug_0v_0b", _isa,
+      flopsug_0v_0b<S,A,bench_core>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V tr, AV* acc) {
+        kernelug_0v_0b<V,AV,bench_core>(p.x[j], p.y[j], p.r[j], p.s[j], tx, ty, tr,
+                             &acc[0], &acc[1], &acc[2], &acc[3], &acc[4], &acc[5]);
+      }));
+    if (want("kerneluw_0v_0p")) _out.push_back(time_kernel<S,A,V,AV,3>("kerneluw_0v_0p", _isa,
+      flopsuw_0v_0p<S,A,bench_core>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V, AV* acc) {
+        kerneluw_0v_0p<V,AV,bench_core>(p.x[j], p.y[j], p.r[j], p.s[j], tx, ty, &acc[0], &acc[1], &acc[2]);
+      }));
+    if (want("kerneluw_0v_0b")) _out.push_back(time_kernel<S,A,V,AV,3>("kerneluw_0v_0b", _isa,
+      flopsuw_0v_0b<S,A,bench_core>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V tr, AV* acc) {
+        kerneluw_0v_0b<V,AV,bench_core>(p.x[j], p.y[j], p.r[j], p.s[j], tx, ty, tr, &acc[0], &acc[1], &acc[2]);
+      }));
+
+    // panel sources, which write their result instead of adding to it
+    if (want("kernelu_1v_0p")) _out.push_back(time_kernel<S,A,V,AV,2>("kernelu_1v_0p", _isa,
+      flopsu_1v_0p<S,A>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V, AV* acc) {
+        AV u(A(0.0)), v(A(0.0));
+        kernelu_1v_0p<V,AV>(p.x[j], p.y[j], p.x1[j], p.y1[j], p.s[j], tx, ty, &u, &v);
+        acc[0] += u;
+        acc[1] += v;
+      }));
+    if (want("kernelu_1vs_0p")) _out.push_back(time_kernel<S,A,V,AV,2>("kernelu_1vs_0p", _isa,
+      flopsu_1vs_0p<S,A>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V, AV* acc) {
+        AV u(A(0.0)), v(A(0.0));
+        kernelu_1vs_0p<V,AV>(p.x[j], p.y[j], p.x1[j], p.y1[j], p.s[j], p.s2[j], tx, ty, &u, &v);
+        acc[0] += u;
+        acc[1] += v;
+      }));
+    if (want("kernelu_1vs_0p_far")) _out.push_back(time_kernel<S,A,V,AV,2>("kernelu_1vs_0p_far", _isa,
+      flopsu_1vs_0p_far<S,A>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V, AV* acc) {
+        AV u(A(0.0)), v(A(0.0));
+        kernelu_1vs_0p_far<V,AV>(p.x[j], p.y[j], p.s[j], p.s2[j], tx, ty, &u, &v);
+        acc[0] += u;
+        acc[1] += v;
+      }));
+    if (want("kernelu_1vos_0p")) _out.push_back(time_kernel<S,A,V,AV,4>("kernelu_1vos_0p", _isa,
+      flopsu_1vos_0p<S,A>(), src, targ, _mintime,
+      [](const Packed<V>& p, const size_t j, const V tx, const V ty, const V, AV* acc) {
+        AV vu(A(0.0)), vv(A(0.0)), su(A(0.0)), sv(A(0.0));
+        kernelu_1vos_0p<V,AV>(p.x[j], p.y[j], p.x1[j], p.y1[j], p.s[j], p.s2[j], tx, ty, &vu, &vv, &su, &sv);
+        acc[0] += vu;
+        acc[1] += vv;
+        acc[2] += su;
+        acc[3] += sv;
+      }));
+  }
+}
+
+// the scalar code and whichever vector instruction set was built in, each in every precision
+static void bench_all_isas(const std::vector<size_t>& _sizes, const double _mintime,
+                           const std::string _only, std::vector<BenchCase>& _out) {
+
+  bench_all<float,float,float,float>("x86", _sizes, _mintime, _only, _out);
+  bench_all<float,double,float,double>("x86", _sizes, _mintime, _only, _out);
+  bench_all<double,double,double,double>("x86", _sizes, _mintime, _only, _out);
+
+#ifdef USE_VC
+  bench_all<float,float,Vc::Vector<float>,Vc::Vector<float>>("Vc", _sizes, _mintime, _only, _out);
+  bench_all<float,double,Vc::Vector<float>,Vc::SimdArray<double,Vc::Vector<float>::size()>>("Vc", _sizes, _mintime, _only, _out);
+  bench_all<double,double,Vc::Vector<double>,Vc::Vector<double>>("Vc", _sizes, _mintime, _only, _out);
+#endif
+
+#ifdef USE_STDSIMD
+  bench_all<float,float,SimdVec<float>,SimdAccum<float,float>>("simd", _sizes, _mintime, _only, _out);
+  bench_all<float,double,SimdVec<float>,SimdAccum<float,double>>("simd", _sizes, _mintime, _only, _out);
+  bench_all<double,double,SimdVec<double>,SimdAccum<double,double>>("simd", _sizes, _mintime, _only, _out);
+#endif
+}
+
+static std::vector<size_t> parse_sizes(const std::string _list) {
+  std::vector<size_t> sizes;
+  std::stringstream ss(_list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (not item.empty()) sizes.push_back((size_t)std::stoul(item));
+  }
+  return sizes;
+}
+
+// execution starts here
+
+int main(int argc, char const *argv[]) {
+
+  std::vector<size_t> sizes = {100, 1000, 4000};
+  double mintime = 0.2;
+  std::string only;
+  bool csv = false;
+
+  for (int i=1; i<argc; ++i) {
+    if (std::strcmp(argv[i], "-n") == 0 and i+1 < argc) {
+      sizes = parse_sizes(argv[++i]);
+    } else if (std::strcmp(argv[i], "-t") == 0 and i+1 < argc) {
+      mintime = std::stod(argv[++i]);
+    } else if (std::strcmp(argv[i], "-k") == 0 and i+1 < argc) {
+      only = argv[++i];
+    } else if (std::strcmp(argv[i], "-csv") == 0) {
+      csv = true;
+    } else {
+      std::cout << "Usage: " << argv[0] << " [-n 100,1000,4000] [-t secs] [-k kernel] [-csv]" << std::endl;
+      std::cout << "  -n  numbers of targets and of sources, each run is n^2 pairs" << std::endl;
+      std::cout << "  -t  minimum seconds to repeat each case, the fastest pass is kept" << std::endl;
+      std::cout << "  -k  run only this kernel, like kernelu_0v_0p" << std::endl;
+      std::cout << "  -csv  write comma-separated lines instead of a table" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<BenchCase> cases;
+  bench_all_isas(sizes, mintime, only, cases);
+
+  if (csv) {
+    printf("core,kernel,isa,precision,n,seconds,gflops,mpairs_per_sec,checksum\n");
+    for (const auto& c : cases) {
+      printf("%s,%s,%s,%s,%ld,%.6e,%.4f,%.3f,%.9e\n", core_name(), c.kernel.c_str(), c.isa.c_str(),
+             c.prec.c_str(), (long)c.n, c.secs, 1.e-9*c.flops/c.secs,
+             1.e-6*(double)c.n*(double)c.n/c.secs, c.checksum);
+    }
+  } else {
+    printf("\nOmega2D kernel benchmarks\n");
+    printf("  core function: %s\n", core_name());
+    printf("  SIMD: %s\n", simd_isa_string().c_str());
+    printf("  kernels: %s\n\n", kernel_isa_string().c_str());
+    printf("  %-20s %-5s %-7s %7s %12s %10s %12s\n", "kernel", "isa", "prec", "n", "seconds", "GFlop/s", "Mpairs/s");
+    for (const auto& c : cases) {
+      printf("  %-20s %-5s %-7s %7ld %12.6f %10.3f %12.3f\n", c.kernel.c_str(), c.isa.c_str(),
+             c.prec.c_str(), (long)c.n, c.secs, 1.e-9*c.flops/c.secs,
+             1.e-6*(double)c.n*(double)c.n/c.secs);
+    }
+  }
+
+  return 0;
+}
@@ -31,9 +31,13 @@
 
 // header-only immediate-mode GUI
 #include "GuiHelper.h"
+#ifdef USE_OGL_COMPUTE
+#include "OglCompute.h"
+#endif
 
 // header-only png writing
-#include "miniz/FrameBufferToImage.h"
+#include "FrameSaver.h"
+#include "Profiler.h"
 
 //#include <GL/gl3w.h>    // This example is using gl3w to access OpenGL
 // functions (because it is small). You may use glew/glad/glLoadGen/etc.
@@ -51,6 +55,10 @@
 
 int main(int argc, char const *argv[]) {
 
+  // before any threads start
+  PROFILE_OPEN_COUNTERS();
+  PROFILE_THREAD_NAME("gui");
+
   std::cout << std::endl << "Omega2D GUI" << std::endl;
   if (VERBOSE) { std::cout << "  VERBOSE is on" << std::endl; }
 
@@ -66,6 +74,9 @@ int main(int argc, char const *argv[]) {
   static bool sim_is_running = false;
   static bool begin_single_step = false;
 
+  // states to go back to, which outlive a reset
+  std::vector<CheckpointSnapshot> snapshots;
+
   // placeholder for command-line input file
   std::string command_line_input;
 
@@ -90,8 +101,14 @@ int main(int argc, char const *argv[]) {
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 #else
   const char* glsl_version = "#version 150";
+  #ifdef USE_OGL_COMPUTE
+  // compute shaders need 4.3
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  #else
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  #endif
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 #endif
   GLFWwindow* window = glfwCreateWindow(1280, 720, "Omega2D GUI", nullptr, nullptr);
@@ -109,6 +126,22 @@ int main(int argc, char const *argv[]) {
     exit(-1);
   }
 
+#ifdef USE_OGL_COMPUTE
+  // the simulation steps in a worker thread, so give it a hidden window with a shared context
+  GLFWwindow* compute_window = nullptr;
+  if (GLAD_GL_VERSION_4_3) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    compute_window = glfwCreateWindow(1, 1, "Omega2D compute", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+  }
+  if (compute_window) {
+    OglCompute::acquire_context = [compute_window]() { glfwMakeContextCurrent(compute_window); return true; };
+    OglCompute::release_context = []() { glfwMakeContextCurrent(nullptr); };
+  } else {
+    std::cout << "OpenGL 4.3 is not available, gpu influence calculations will run on the cpu" << std::endl;
+  }
+#endif
+
   // Setup ImGui binding
   ImGui::CreateContext();
   ImGui_ImplGlfw_InitForOpenGL(window, true);
@@ -163,6 +196,7 @@ int main(int argc, char const *argv[]) {
   bool export_png_when_ready = false;	// write frame to png as soon as its done
   bool write_png_immediately = false;	// write frame to png right now
   std::string png_out_file;		// the name of the recently-written png
+  FrameSaver frame_saver;		// reads back and writes pngs in the background
   bool show_stats_window = true;
   bool show_welcome_window = true;
   bool show_terminal_window = false;
@@ -177,6 +211,46 @@ int main(int argc, char const *argv[]) {
   std::vector<float> gl_projection;
   compute_ortho_proj_mat(window, rparams.vcx, rparams.vcy, &rparams.vsize, gl_projection);
 
+  // make the elements of every enabled feature, as at the start of a run
+  auto init_case = [&]() {
+    // initialize particle distributions
+    for (auto const& ff: ffeatures) {
+      if (ff->is_enabled()) {
+        ElementPacket<float> newpacket = ff->init_elements(sim.get_ips());
+        sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
+      }
+    }
+
+    // initialize solid objects
+    for (auto const& bf : bfeatures) {
+      if (bf->is_enabled()) {
+        ElementPacket<float> newpacket = bf->init_elements(sim.get_ips());
+        const move_t newMoveType = (bf->get_body() ? bodybound : fixed);
+        sim.add_elements(newpacket, reactive, newMoveType, bf->get_body() );
+      }
+    }
+
+    // initialize measurement features
+    for (auto const& mf: mfeatures) {
+      if (mf->is_enabled()) {
+        ElementPacket<float> newpacket = mf->init_elements(rparams.tracer_scale*sim.get_ips());
+        const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
+        sim.add_elements(newpacket, inert, newMoveType, mf->get_body() );
+      }
+    }
+
+    // initialize hybrid features
+    for (auto const& bf : bfeatures) {
+      if (bf->is_enabled()) {
+        // get interior elems and then boundaries
+        // this is a noop if hybrid is not enabled
+        sim.add_hybrid(bf->init_hybrid(1.0), bf->get_body() );
+      }
+    }
+
+    sim.set_initialized();
+  };
+
   // adjust some UI settings
   ImGuiStyle& style = ImGui::GetStyle();
   style.Colors[ImGuiCol_WindowBg]              = ImVec4(0.00f, 0.00f, 0.00f, 1.00f);
@@ -194,14 +268,34 @@ int main(int argc, char const *argv[]) {
   std::vector<std::string> descriptions = {"Select a simulation"};
   LoadJsonSims(sims, descriptions, EXAMPLES_DIR);
 
+  // or only watch a run elsewhere, one which has a streamPort
+  FrameStreamClient viewer;
+  if (argc == 3 and std::string(argv[1]) == "--connect") {
+    if (viewer.connect_to(argv[2])) {
+      std::cout << "Viewing frames from " << argv[2] << std::endl;
+      show_welcome_window = false;
+    } else {
+      std::cout << "Could not connect to " << argv[2] << std::endl;
+    }
+  }
+
   // Main loop
   std::cout << "Starting main loop" << std::endl;
   while (!glfwWindowShouldClose(window)) {
+    PROFILE_ZONE("gui frame");
     glfwPollEvents();
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
     
+    // a viewer shows the newest frame which has arrived, and runs nothing itself
+    if (viewer.is_connected()) {
+      Frame frame;
+      if (viewer.poll(frame)) sim.show_frame(frame);
+      sim_is_running = false;
+      begin_single_step = false;
+    }
+
     //
     // Initialize simulation
     //
@@ -210,42 +304,7 @@ int main(int argc, char const *argv[]) {
 
       std::cout << std::endl << "Initializing simulation" << std::endl;
 
-      // initialize particle distributions
-      for (auto const& ff: ffeatures) {
-        if (ff->is_enabled()) {
-          ElementPacket<float> newpacket = ff->init_elements(sim.get_ips());
-          sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
-        }
-      }
-
-      // initialize solid objects
-      for (auto const& bf : bfeatures) {
-        if (bf->is_enabled()) {
-          ElementPacket<float> newpacket = bf->init_elements(sim.get_ips());
-          const move_t newMoveType = (bf->get_body() ? bodybound : fixed);
-          sim.add_elements(newpacket, reactive, newMoveType, bf->get_body() );
-        }
-      }
-
-      // initialize measurement features
-      for (auto const& mf: mfeatures) {
-        if (mf->is_enabled()) {
-          ElementPacket<float> newpacket = mf->init_elements(rparams.tracer_scale*sim.get_ips());
-          const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
-          sim.add_elements(newpacket, inert, newMoveType, mf->get_body() );
-        }
-      }
-
-      // initialize hybrid features
-      for (auto const& bf : bfeatures) {
-        if (bf->is_enabled()) {
-          // get interior elems and then boundaries
-          // this is a noop if hybrid is not enabled
-          sim.add_hybrid(bf->init_hybrid(1.0), bf->get_body() );
-        }
-      }
-
-      sim.set_initialized();
+      init_case();
 
       // check setup for obvious errors
       sim_err_msg = sim.check_initialization();
@@ -302,7 +361,7 @@ int main(int argc, char const *argv[]) {
       ImGui::SetNextWindowPos(ImVec2(0,0), 0);
       ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoResize;
       ImGui::Begin("Vtk written", NULL, window_flags);
-      ImGui::Text("Wrote %ld file(s):", vtk_out_files.size());
+      ImGui::Text("Wrote %zu file(s):", vtk_out_files.size());
       for (auto &thisfile : vtk_out_files) {
         ImGui::Text("  %s", thisfile.c_str());
       }
@@ -863,6 +922,46 @@ int main(int argc, char const *argv[]) {
     ImGui::Spacing();
     if (ImGui::CollapsingHeader("Solver parameters (advanced)")) { sim.draw_advanced(); }
 
+    // how the recent steps went
+    ImGui::Spacing();
+    if (ImGui::CollapsingHeader("Performance")) { sim.draw_performance(); }
+
+#ifdef USE_PROFILER
+    // where the last step spent its time
+    ImGui::Spacing();
+    if (ImGui::CollapsingHeader("Step timing")) {
+      const std::vector<Profiler::Zone> zones = Profiler::get().get_last_step();
+      if (zones.empty()) ImGui::Text("No steps taken yet");
+      for (const int i : Profiler::tree_order(zones)) {
+        const Profiler::Zone& z = zones[i];
+        if (z.step_calls == 0) continue;
+#ifdef USE_PERF_COUNTERS
+        if (Profiler::get().have_counters()) {
+          ImGui::Text("%*s%-20s %9.4f s  x%ld  IPC %s  vec %s%%", 2*z.depth, "", z.name, z.step_secs,
+                      (long)z.step_calls, Profiler::counter_ratio(z.step_counts, Profiler::ipc).c_str(),
+                      Profiler::counter_ratio(z.step_counts, Profiler::vector_pct).c_str());
+          continue;
+        }
+#endif
+        ImGui::Text("%*s%-20s %9.4f s  x%ld", 2*z.depth, "", z.name, z.step_secs, (long)z.step_calls);
+      }
+
+      // every thread's zones for a few steps, for chrome://tracing or ui.perfetto.dev
+      static int trace_steps = 10;
+      static char trace_file[128] = "trace.json";
+      ImGui::Spacing();
+      ImGui::PushItemWidth(-270);
+      ImGui::InputText("trace file", trace_file, IM_ARRAYSIZE(trace_file));
+      ImGui::SliderInt("steps to trace", &trace_steps, 1, 100);
+      ImGui::PopItemWidth();
+      if (Profiler::get().trace_pending()) {
+        ImGui::Text("Tracing...");
+      } else if (ImGui::Button("Trace the next steps", ImVec2(10+11*fontSize,0))) {
+        PROFILE_START_TRACE(std::string(trace_file), trace_steps);
+      }
+    }
+#endif
+
     // Output buttons, under a header
     ImGui::Spacing();
     if (ImGui::CollapsingHeader("Save output")) {
@@ -899,6 +998,42 @@ int main(int argc, char const *argv[]) {
       ImGui::Unindent();
     }
 
+    // keep the current state in memory, or go back to one kept earlier; the parameters
+    //   (not the features) can change in between, to try something else from there
+    ImGui::Spacing();
+    if (ImGui::CollapsingHeader("Snapshots")) {
+      ImGui::Spacing();
+      const bool can_snap = sim.is_initialized() and not sim_is_running and sim.test_for_new_results();
+      if (not can_snap) ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
+      if (ImGui::Button("Take snapshot", ImVec2(10+8*fontSize,0))) snapshots.push_back(sim.take_snapshot());
+      if (not can_snap) ImGui::PopItemFlag();
+
+      size_t snap_bytes = 0;
+      for (const auto& snap : snapshots) snap_bytes += snap.get_mem_bytes();
+      ImGui::SameLine();
+      ImGui::Text("%zu held, %.1f MB", snapshots.size(), snap_bytes/1048576.0);
+
+      int to_remove = -1;
+      for (size_t i=0; i<snapshots.size(); ++i) {
+        ImGui::PushID((int)i);
+        ImGui::Text("step %zu, t=%g", snapshots[i].nstep, snapshots[i].time);
+        ImGui::SameLine();
+        if (ImGui::Button("Go back")) {
+          sim_is_running = false;
+          // after a reset, the snapshot needs the case's collections to read into
+          if (not sim.is_initialized()) init_case();
+          if (not sim.restore_snapshot(snapshots[i])) {
+            sim_err_msg = "Snapshot does not match the current features, it came from another case\n";
+            sim.reset();
+          }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Forget")) to_remove = (int)i;
+        ImGui::PopID();
+      }
+      if (to_remove >= 0) snapshots.erase(snapshots.begin()+to_remove);
+    }
+
     if (show_file_output_window) {
       bool try_it = false;
       static std::string outfile = "file_name.json";
@@ -1053,8 +1188,8 @@ int main(int argc, char const *argv[]) {
       std::stringstream pngfn;
       pngfn << "img_" << std::setfill('0') << std::setw(5) << frameno << ".png";
       png_out_file = pngfn.str();
-      (void) saveFramePNG(png_out_file);
-      std::cout << "Wrote screenshot to " << png_out_file << std::endl;
+      frame_saver.request(png_out_file);
+      std::cout << "Saving screenshot to " << png_out_file << std::endl;
       frameno++;
       // no need to tell the user every frame
       if (export_png_when_ready) png_out_file.clear();
@@ -1062,6 +1197,9 @@ int main(int argc, char const *argv[]) {
       export_png_when_ready = false;
     }
 
+    // pass on the readbacks the GPU has finished
+    frame_saver.service();
+
     // if we're just drawing this one frame, then announce that we wrote it
     if (not png_out_file.empty()) {
       static int32_t pngframect = 0;
@@ -1092,11 +1230,15 @@ int main(int argc, char const *argv[]) {
 
   // Cleanup
   std::cout << "Starting shutdown procedure" << std::endl;
+  frame_saver.finish();
   sim.reset();
   std::cout << "Quitting" << std::endl;
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
+#ifdef USE_OGL_COMPUTE
+  if (compute_window) glfwDestroyWindow(compute_window);
+#endif
   glfwDestroyWindow(window);
   glfwTerminate();
 
@@ -0,0 +1,26 @@
+R"(
+#version 150
+
+uniform sampler2D density;
+uniform vec4 pos_color;
+uniform vec4 neg_color;
+uniform float str_scale;
+in vec2 txcoord;
+out vec4 frag_color;
+
+void main() {
+  // share each pixel's sums with its neighbors, about as far as the splats would have reached
+  ivec2 size = textureSize(density, 0);
+  ivec2 ij = ivec2(txcoord * vec2(size));
+  vec2 sums = vec2(0.0f);
+  for (int j=-1; j<=1; ++j) {
+    for (int i=-1; i<=1; ++i) {
+      ivec2 at = clamp(ij + ivec2(i,j), ivec2(0), size - ivec2(1));
+      sums += float((2-abs(i))*(2-abs(j))) * texelFetch(density, at, 0).rg;
+    }
+  }
+  sums /= 16.0f;
+
+  frag_color = str_scale * (sums.x*pos_color + sums.y*neg_color);
+}
+)"
@@ -0,0 +1,12 @@
+R"(
+#version 150
+
+out vec2 txcoord;
+
+void main() {
+  // one triangle covers the screen, no vertex buffer needed
+  vec2 corner = vec2((gl_VertexID == 1) ? 3.0f : -1.0f, (gl_VertexID == 2) ? 3.0f : -1.0f);
+  txcoord = 0.5f*corner + 0.5f;
+  gl_Position = vec4(corner, 0.f, 1.f);
+}
+)"
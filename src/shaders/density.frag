@@ -0,0 +1,10 @@
+R"(
+#version 150
+
+in vec2 weight;
+out vec4 frag_color;
+
+void main() {
+  frag_color = vec4(weight, 0.0f, 0.0f);
+}
+)"
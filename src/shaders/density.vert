@@ -0,0 +1,29 @@
+R"(
+#version 150
+
+uniform mat4 Projection;
+uniform float rad_scale;
+uniform float px_per_unit;
+in float px;
+in float py;
+in float rad;
+in float sx;
+out vec2 weight;
+
+void main() {
+  // the splat particle.vert would make of this particle
+  float rscale = 2.5f * rad * rad_scale;
+  float draw_scale = max(0.002/Projection[0][0], rscale);
+  float scale_ratio = rscale / (rad*draw_scale);
+
+  // all the color that splat would add up, in one pixel: its area in pixels times the
+  //   mean of particle.frag's blob over the quad
+  float halfwidth = draw_scale * px_per_unit;
+  float total = abs(sx) * scale_ratio*scale_ratio * 0.3058f * 4.0f*halfwidth*halfwidth;
+
+  // positive and negative sums are kept apart, as each has its own color
+  weight = vec2(step(0.0f, sx), step(0.0f, -sx)) * total;
+
+  gl_Position = Projection * vec4(px, py, 0.f, 1.f);
+}
+)"